@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+
+"""
+This script encodes a file with several mpv instances in parallel. The input
+is split into time segments, the video of each segment is encoded by a separate
+mpv process, and the audio by one more process. The results are then joined
+with ffmpeg's concat demuxer (without reencoding), which also makes the
+timestamps of the segments continuous.
+
+Usage:
+
+    segenc.py [-j <jobs>] [-s <seconds>] <input> <output> [<mpv options>...]
+
+All mpv options are passed to each encoding process, e.g.:
+
+    segenc.py -j 8 in.mkv out.mkv --ovc=libx264 --ovcopts=preset=fast,crf=20
+
+Each segment starts with a keyframe in the output, and is decoded from the
+previous keyframe in the input (using precise seeking), so segment boundaries
+don't need to match the keyframes of the input.
+
+Limitations: this works only for seekable files with a known duration, 2-pass
+encoding does not work, and encoder rate control is per segment. Options like
+--ofps, --vf, or --sub-file work as usual, since they apply to each segment.
+
+You can supply a custom mpv or ffmpeg binary with the MPV or FFMPEG environment
+variables.
+"""
+
+import sys
+import os
+import argparse
+import shutil
+import subprocess
+import tempfile
+from concurrent.futures import ThreadPoolExecutor
+
+MPV = os.getenv("MPV", "mpv")
+FFMPEG = os.getenv("FFMPEG", "ffmpeg")
+
+def get_duration(filename):
+    out = subprocess.check_output([MPV, "--term-playing-msg=DURATION=${=duration}",
+                                   "--vo=null", "--ao=null", "--frames=1",
+                                   "--quiet", "--no-config", "--", filename])
+    for line in out.decode("utf-8", "replace").splitlines():
+        if line.startswith("DURATION="):
+            try:
+                return float(line[len("DURATION="):])
+            except ValueError:
+                pass
+    return None
+
+def run(args):
+    proc = subprocess.run(args, stdout=subprocess.DEVNULL)
+    return proc.returncode
+
+def main():
+    parser = argparse.ArgumentParser(usage="%(prog)s [-j <jobs>] [-s <seconds>] "
+                                     "<input> <output> [<mpv options>...]")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count() or 1,
+                        help="number of parallel mpv processes")
+    parser.add_argument("-s", "--segment", type=float, default=0,
+                        help="segment length in seconds (default: split "
+                        "the input evenly between the jobs)")
+    parser.add_argument("input")
+    parser.add_argument("output")
+    parser.add_argument("options", nargs=argparse.REMAINDER)
+    args = parser.parse_args()
+
+    duration = get_duration(args.input)
+    if not duration or duration <= 0:
+        sys.exit("Could not determine the duration of the input.")
+
+    seglen = args.segment
+    if seglen <= 0:
+        seglen = duration / max(args.jobs, 1)
+    seglen = max(seglen, 1.0)
+    count = max(int(-(-duration // seglen)), 1)
+
+    ext = os.path.splitext(args.output)[1] or ".mkv"
+    tmpdir = tempfile.mkdtemp(prefix="segenc-",
+                              dir=os.path.dirname(os.path.abspath(args.output)))
+    try:
+        base = [MPV, "--quiet", "--hr-seek=yes"] + args.options
+        jobs = []
+        segments = []
+        audio = os.path.join(tmpdir, "audio" + ext)
+        jobs.append(base + ["--no-video", "--o=" + audio, "--", args.input])
+        for n in range(count):
+            seg = os.path.join(tmpdir, "video%05d%s" % (n, ext))
+            segments.append(seg)
+            cmd = base + ["--no-audio", "--start=%f" % (n * seglen)]
+            if n < count - 1:
+                cmd.append("--end=%f" % ((n + 1) * seglen))
+            jobs.append(cmd + ["--o=" + seg, "--", args.input])
+
+        print("Encoding %d segments of %.1f seconds with %d jobs..." %
+              (count, seglen, args.jobs))
+        with ThreadPoolExecutor(max_workers=max(args.jobs, 1)) as pool:
+            results = list(pool.map(run, jobs))
+        # The audio job fails without writing a file if there is no audio.
+        has_audio = os.path.exists(audio)
+        if not has_audio:
+            results[0] = 0
+        if any(results):
+            sys.exit("Encoding failed for %d of %d jobs." %
+                     (len([r for r in results if r]), len(results)))
+
+        listfile = os.path.join(tmpdir, "segments.txt")
+        with open(listfile, "w") as f:
+            for seg in segments:
+                f.write("file '%s'\n" % seg.replace("'", "'\\''"))
+
+        cmd = [FFMPEG, "-y", "-loglevel", "error", "-f", "concat", "-safe", "0",
+               "-i", listfile]
+        if has_audio:
+            cmd += ["-i", audio, "-map", "0:v", "-map", "1:a"]
+        cmd += ["-c", "copy", args.output]
+        if run(cmd):
+            sys.exit("Joining the segments failed.")
+    finally:
+        shutil.rmtree(tmpdir, ignore_errors=True)
+
+if __name__ == "__main__":
+    main()
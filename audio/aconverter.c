@@ -50,6 +50,11 @@ struct mp_aconverter {
     struct mpv_global *global;
     double playback_speed;
     bool is_resampling;
+    // Set once the playback speed changed away from 1.0. The resampler is then
+    // kept open at the nominal input rate, and speed changes only adjust the
+    // ratio with avresample_set_compensation(), which avoids reinitialization
+    // (and draining the resampler) for every small change.
+    bool dynamic_rate;
     bool passthrough_mode;
     struct AVAudioResampleContext *avrctx;
     struct mp_aframe *avrctx_fmt; // output format of avrctx
@@ -101,6 +106,10 @@ static void close_lavrr(struct mp_aconverter *p)
     TA_FREEP(&p->pool_fmt);
 }
 
+// Maximum deviation of the playback speed from 1.0 for which the resampler
+// ratio is adjusted without reinitialization.
+#define MAX_DYNAMIC_CHANGE 0.2
+
 static int rate_from_speed(int rate, double speed)
 {
     return lrint(rate * speed);
@@ -157,9 +166,10 @@ static bool configure_lavrr(struct mp_aconverter *p, bool verbose)
 {
     close_lavrr(p);
 
-    p->in_rate = rate_from_speed(p->in_rate_user, p->playback_speed);
+    p->in_rate = p->dynamic_rate ? p->in_rate_user
+                                 : rate_from_speed(p->in_rate_user, p->playback_speed);
 
-    p->passthrough_mode = p->opts->allow_passthrough &&
+    p->passthrough_mode = !p->dynamic_rate && p->opts->allow_passthrough &&
                           p->in_rate == p->out_rate &&
                           p->in_format == p->out_format &&
                           mp_chmap_equals(&p->in_channels, &p->out_channels);
@@ -184,6 +194,13 @@ static bool configure_lavrr(struct mp_aconverter *p, bool verbose)
     av_opt_set_int(p->avrctx, "filter_size",        p->opts->filter_size, 0);
     av_opt_set_int(p->avrctx, "phase_shift",        p->opts->phase_shift, 0);
     av_opt_set_int(p->avrctx, "linear_interp",      p->opts->linear, 0);
+    if (p->dynamic_rate) {
+        // Without a real rate conversion, libswresample wouldn't create the
+        // polyphase filter compensation needs. Interpolating between filter
+        // phases makes the continuously changing ratio click-free.
+        av_opt_set_int(p->avrctx, "force_resampling", 1, 0);
+        av_opt_set_int(p->avrctx, "linear_interp", 1, 0);
+    }
 
     double cutoff = p->opts->cutoff;
     if (cutoff <= 0.0)
@@ -321,6 +338,7 @@ bool mp_aconverter_reconfig(struct mp_aconverter *p,
     p->input_eof = p->output_eof = false;
 
     p->playback_speed = 1.0;
+    p->dynamic_rate = false;
 
     p->in_rate_user = in_rate;
     p->in_format    = in_format;
@@ -487,8 +505,22 @@ static void filter(struct mp_aconverter *p)
 
     int new_rate = rate_from_speed(p->in_rate_user, p->playback_speed);
 
-    if (p->passthrough_mode && new_rate != p->in_rate)
-        configure_lavrr(p, false);
+    // Small speed changes (as used by display-sync) switch to the dynamic
+    // ratio mode, and stay there even if the speed goes back to 1.0.
+    bool in_range = fabs(p->playback_speed - 1.0) <= MAX_DYNAMIC_CHANGE;
+    bool dynamic = in_range && (p->dynamic_rate || p->playback_speed != 1.0);
+    if (dynamic != p->dynamic_rate) {
+        p->dynamic_rate = dynamic;
+        if (p->passthrough_mode || !p->avrctx) {
+            configure_lavrr(p, false);
+        } else {
+            filter_resample(p, NULL);
+            configure_lavrr(p, false);
+            p->output_eof = false;
+            if (p->output)
+                return; // need to read output before continuing filtering
+        }
+    }
 
     if (p->passthrough_mode) {
         p->output = p->input;
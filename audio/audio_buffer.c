@@ -32,7 +32,14 @@ struct mp_audio_buffer {
     int sstride;
     int num_planes;
     uint8_t *data[MP_NUM_CHANNELS];
+    uint8_t *read_ptrs[MP_NUM_CHANNELS];    // returned by peek
+    // The planes have room for 2 * allocated samples. The buffered samples
+    // start at offset start, so skipping data doesn't need to move it. It's
+    // moved back to the start only if appending reaches the end of the
+    // planes, which copies at most allocated samples after at least
+    // allocated samples were consumed.
     int allocated;
+    int start;
     int num_samples;
 };
 
@@ -52,6 +59,7 @@ void mp_audio_buffer_reinit_fmt(struct mp_audio_buffer *ab, int format,
     ab->channels = *channels;
     ab->srate = srate;
     ab->allocated = 0;
+    ab->start = 0;
     ab->num_samples = 0;
     ab->sstride = af_fmt_to_bytes(ab->format);
     ab->num_planes = 1;
@@ -62,18 +70,50 @@ void mp_audio_buffer_reinit_fmt(struct mp_audio_buffer *ab, int format,
     }
 }
 
+// All integer parameters are in samples.
+// dst and src can overlap.
+static void copy_planes(struct mp_audio_buffer *ab,
+                        uint8_t **dst, int dst_offset,
+                        uint8_t **src, int src_offset, int length)
+{
+    for (int n = 0; n < ab->num_planes; n++) {
+        memmove((char *)dst[n] + dst_offset * ab->sstride,
+                (char *)src[n] + src_offset * ab->sstride,
+                length * ab->sstride);
+    }
+}
+
+// Move the buffered data to the start of the planes.
+static void compact(struct mp_audio_buffer *ab)
+{
+    if (ab->start) {
+        copy_planes(ab, ab->data, 0, ab->data, ab->start, ab->num_samples);
+        ab->start = 0;
+    }
+}
+
 // Make the total size of the internal buffer at least this number of samples.
 void mp_audio_buffer_preallocate_min(struct mp_audio_buffer *ab, int samples)
 {
     if (samples > ab->allocated) {
+        compact(ab);
         for (int n = 0; n < ab->num_planes; n++) {
             ab->data[n] = talloc_realloc(ab, ab->data[n], char,
-                                         ab->sstride * samples);
+                                         ab->sstride * samples * 2);
         }
         ab->allocated = samples;
     }
 }
 
+// Make sure the given number of samples can be written after the end of the
+// buffered data.
+static void reserve_tail(struct mp_audio_buffer *ab, int samples)
+{
+    mp_audio_buffer_preallocate_min(ab, ab->num_samples + samples);
+    if (ab->start + ab->num_samples + samples > ab->allocated * 2)
+        compact(ab);
+}
+
 // Get number of samples that can be written without forcing a resize of the
 // internal buffer.
 int mp_audio_buffer_get_write_available(struct mp_audio_buffer *ab)
@@ -81,25 +121,13 @@ int mp_audio_buffer_get_write_available(struct mp_audio_buffer *ab)
     return ab->allocated - ab->num_samples;
 }
 
-// All integer parameters are in samples.
-// dst and src can overlap.
-static void copy_planes(struct mp_audio_buffer *ab,
-                        uint8_t **dst, int dst_offset,
-                        uint8_t **src, int src_offset, int length)
-{
-    for (int n = 0; n < ab->num_planes; n++) {
-        memmove((char *)dst[n] + dst_offset * ab->sstride,
-                (char *)src[n] + src_offset * ab->sstride,
-                length * ab->sstride);
-    }
-}
-
 // Append data to the end of the buffer.
 // If the buffer is not large enough, it is transparently resized.
 void mp_audio_buffer_append(struct mp_audio_buffer *ab, void **ptr, int samples)
 {
-    mp_audio_buffer_preallocate_min(ab, ab->num_samples + samples);
-    copy_planes(ab, ab->data, ab->num_samples, (uint8_t **)ptr, 0, samples);
+    reserve_tail(ab, samples);
+    copy_planes(ab, ab->data, ab->start + ab->num_samples,
+                (uint8_t **)ptr, 0, samples);
     ab->num_samples += samples;
 }
 
@@ -107,19 +135,26 @@ void mp_audio_buffer_append(struct mp_audio_buffer *ab, void **ptr, int samples)
 void mp_audio_buffer_prepend_silence(struct mp_audio_buffer *ab, int samples)
 {
     assert(samples >= 0);
-    mp_audio_buffer_preallocate_min(ab, ab->num_samples + samples);
-    copy_planes(ab, ab->data, samples, ab->data, 0, ab->num_samples);
+    if (samples > ab->start) {
+        mp_audio_buffer_preallocate_min(ab, ab->num_samples + samples);
+        copy_planes(ab, ab->data, samples, ab->data, ab->start,
+                    ab->num_samples);
+        ab->start = samples;
+    }
+    ab->start -= samples;
     ab->num_samples += samples;
-    for (int n = 0; n < ab->num_planes; n++)
-        af_fill_silence(ab->data[n], samples * ab->sstride, ab->format);
+    for (int n = 0; n < ab->num_planes; n++) {
+        af_fill_silence(ab->data[n] + ab->start * ab->sstride,
+                        samples * ab->sstride, ab->format);
+    }
 }
 
 void mp_audio_buffer_duplicate(struct mp_audio_buffer *ab, int samples)
 {
     assert(samples >= 0 && samples <= ab->num_samples);
-    mp_audio_buffer_preallocate_min(ab, ab->num_samples + samples);
-    copy_planes(ab, ab->data, ab->num_samples,
-                ab->data, ab->num_samples - samples, samples);
+    reserve_tail(ab, samples);
+    int end = ab->start + ab->num_samples;
+    copy_planes(ab, ab->data, end, ab->data, end - samples, samples);
     ab->num_samples += samples;
 }
 
@@ -127,7 +162,9 @@ void mp_audio_buffer_duplicate(struct mp_audio_buffer *ab, int samples)
 void mp_audio_buffer_peek(struct mp_audio_buffer *ab, uint8_t ***ptr,
                           int *samples)
 {
-    *ptr = ab->data;
+    for (int n = 0; n < ab->num_planes; n++)
+        ab->read_ptrs[n] = ab->data[n] + ab->start * ab->sstride;
+    *ptr = ab->read_ptrs;
     *samples = ab->num_samples;
 }
 
@@ -135,12 +172,15 @@ void mp_audio_buffer_peek(struct mp_audio_buffer *ab, uint8_t ***ptr,
 void mp_audio_buffer_skip(struct mp_audio_buffer *ab, int samples)
 {
     assert(samples >= 0 && samples <= ab->num_samples);
-    copy_planes(ab, ab->data, 0, ab->data, samples, ab->num_samples - samples);
+    ab->start += samples;
     ab->num_samples -= samples;
+    if (!ab->num_samples)
+        ab->start = 0;
 }
 
 void mp_audio_buffer_clear(struct mp_audio_buffer *ab)
 {
+    ab->start = 0;
     ab->num_samples = 0;
 }
 
@@ -36,8 +36,11 @@ struct spdifContext {
     struct mp_log   *log;
     enum AVCodecID   codec_id;
     AVFormatContext *lavf_ctx;
+    // The muxer writes directly into the data of this frame (allocated from
+    // pool with room for OUTBUF_SIZE bytes).
+    uint8_t         *out_buffer;
     int              out_buffer_len;
-    uint8_t          out_buffer[OUTBUF_SIZE];
+    int              out_buffer_size;
     bool             need_close;
     bool             use_dts_hd;
     struct mp_aframe *fmt;
@@ -51,7 +54,11 @@ static int write_packet(void *p, uint8_t *buf, int buf_size)
 {
     struct spdifContext *ctx = p;
 
-    int buffer_left = OUTBUF_SIZE - ctx->out_buffer_len;
+    // Data written outside of receive_frame() (header/trailer) is not output.
+    if (!ctx->out_buffer)
+        return buf_size;
+
+    int buffer_left = ctx->out_buffer_size - ctx->out_buffer_len;
     if (buf_size > buffer_left) {
         MP_ERR(ctx, "spdif packet too large.\n");
         buf_size = buffer_left;
@@ -307,17 +314,12 @@ static bool receive_frame(struct dec_audio *da, struct mp_aframe **out)
         if (init_filter(da, &pkt) < 0)
             goto done;
     }
-    spdif_ctx->out_buffer_len  = 0;
-    int ret = av_write_frame(spdif_ctx->lavf_ctx, &pkt);
-    avio_flush(spdif_ctx->lavf_ctx->pb);
-    if (ret < 0) {
-        MP_ERR(da, "spdif mux error: '%s'\n", mp_strerror(AVUNERROR(ret)));
-        goto done;
-    }
 
+    // Let the muxer write into a (refcounted, pooled) frame, which is passed
+    // on as is, instead of copying the muxed data.
     *out = mp_aframe_new_ref(spdif_ctx->fmt);
-    int samples = spdif_ctx->out_buffer_len / spdif_ctx->sstride;
-    if (mp_aframe_pool_allocate(spdif_ctx->pool, *out, samples) < 0) {
+    int max_samples = OUTBUF_SIZE / spdif_ctx->sstride;
+    if (mp_aframe_pool_allocate(spdif_ctx->pool, *out, max_samples) < 0) {
         TA_FREEP(out);
         goto done;
     }
@@ -328,7 +330,20 @@ static bool receive_frame(struct dec_audio *da, struct mp_aframe **out)
         goto done;
     }
 
-    memcpy(data[0], spdif_ctx->out_buffer, spdif_ctx->out_buffer_len);
+    spdif_ctx->out_buffer = data[0];
+    spdif_ctx->out_buffer_len = 0;
+    spdif_ctx->out_buffer_size = max_samples * spdif_ctx->sstride;
+    int ret = av_write_frame(spdif_ctx->lavf_ctx, &pkt);
+    avio_flush(spdif_ctx->lavf_ctx->pb);
+    spdif_ctx->out_buffer = NULL;
+    spdif_ctx->out_buffer_size = 0;
+    if (ret < 0) {
+        MP_ERR(da, "spdif mux error: '%s'\n", mp_strerror(AVUNERROR(ret)));
+        TA_FREEP(out);
+        goto done;
+    }
+
+    mp_aframe_set_size(*out, spdif_ctx->out_buffer_len / spdif_ctx->sstride);
     mp_aframe_set_pts(*out, pts);
 
 done:
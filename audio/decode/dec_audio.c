@@ -20,6 +20,7 @@
 #include <unistd.h>
 #include <math.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/mem.h>
 
@@ -30,6 +31,7 @@
 #include "common/recorder.h"
 #include "misc/bstr.h"
 #include "options/options.h"
+#include "osdep/threads.h"
 
 #include "stream/stream.h"
 #include "demux/demux.h"
@@ -50,9 +52,58 @@ static const struct ad_functions * const ad_drivers[] = {
     NULL
 };
 
+// State for decoding on a separate thread (audio_start_thread()).
+struct dec_audio_async {
+    pthread_t thread;
+    // Protects the decoder (i.e. all other dec_audio state). The worker holds
+    // it while decoding. Lock order: dec_lock, then lock.
+    pthread_mutex_t dec_lock;
+    // Protects the fields below.
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool terminate;
+    int64_t work_gen;           // incremented on every audio_work() call
+    int64_t wait_gen;           // worker got DATA_WAIT during this work_gen
+    struct mp_aframe **frames;  // decoded frames not yet returned
+    int num_frames;
+    double buffered;            // duration of frames[] in seconds
+    double max_buffered;
+    bool eof;
+    struct demux_packet **rec_packets; // to be fed to the recorder
+    int num_rec_packets;
+    void (*wakeup_cb)(void *ctx);
+    void *wakeup_ctx;
+};
+
+static void lock_dec(struct dec_audio *d_audio)
+{
+    if (d_audio->async)
+        pthread_mutex_lock(&d_audio->async->dec_lock);
+}
+
+static void unlock_dec(struct dec_audio *d_audio)
+{
+    if (d_audio->async)
+        pthread_mutex_unlock(&d_audio->async->dec_lock);
+}
+
+static void reset(struct dec_audio *d_audio)
+{
+    if (d_audio->ad_driver)
+        d_audio->ad_driver->control(d_audio, ADCTRL_RESET, NULL);
+    d_audio->pts = MP_NOPTS_VALUE;
+    talloc_free(d_audio->current_frame);
+    d_audio->current_frame = NULL;
+    talloc_free(d_audio->packet);
+    d_audio->packet = NULL;
+    talloc_free(d_audio->new_segment);
+    d_audio->new_segment = NULL;
+    d_audio->start = d_audio->end = MP_NOPTS_VALUE;
+}
+
 static void uninit_decoder(struct dec_audio *d_audio)
 {
-    audio_reset_decoding(d_audio);
+    reset(d_audio);
     if (d_audio->ad_driver) {
         MP_VERBOSE(d_audio, "Uninit audio decoder.\n");
         d_audio->ad_driver->uninit(d_audio);
@@ -112,7 +163,7 @@ static const struct ad_functions *find_driver(const char *name)
     return NULL;
 }
 
-int audio_init_best_codec(struct dec_audio *d_audio)
+static int init_best_codec(struct dec_audio *d_audio)
 {
     uninit_decoder(d_audio);
     assert(!d_audio->ad_driver);
@@ -149,26 +200,106 @@ int audio_init_best_codec(struct dec_audio *d_audio)
     return !!d_audio->ad_driver;
 }
 
+static void flush_async(struct dec_audio *d_audio)
+{
+    struct dec_audio_async *a = d_audio->async;
+    if (!a)
+        return;
+    pthread_mutex_lock(&a->lock);
+    for (int n = 0; n < a->num_frames; n++)
+        talloc_free(a->frames[n]);
+    a->num_frames = 0;
+    a->buffered = 0;
+    a->eof = false;
+    a->wait_gen = -1;
+    pthread_cond_broadcast(&a->wakeup);
+    pthread_mutex_unlock(&a->lock);
+}
+
+// Also drops all buffered frames.
+int audio_init_best_codec(struct dec_audio *d_audio)
+{
+    lock_dec(d_audio);
+    int r = init_best_codec(d_audio);
+    flush_async(d_audio);
+    unlock_dec(d_audio);
+    return r;
+}
+
+static void stop_thread(struct dec_audio *d_audio)
+{
+    struct dec_audio_async *a = d_audio->async;
+    if (!a)
+        return;
+
+    pthread_mutex_lock(&a->lock);
+    a->terminate = true;
+    pthread_cond_broadcast(&a->wakeup);
+    pthread_mutex_unlock(&a->lock);
+    pthread_join(a->thread, NULL);
+
+    for (int n = 0; n < a->num_frames; n++)
+        talloc_free(a->frames[n]);
+    for (int n = 0; n < a->num_rec_packets; n++)
+        talloc_free(a->rec_packets[n]);
+    pthread_cond_destroy(&a->wakeup);
+    pthread_mutex_destroy(&a->lock);
+    pthread_mutex_destroy(&a->dec_lock);
+    talloc_free(a);
+    d_audio->async = NULL;
+}
+
 void audio_uninit(struct dec_audio *d_audio)
 {
     if (!d_audio)
         return;
+    stop_thread(d_audio);
     uninit_decoder(d_audio);
     talloc_free(d_audio);
 }
 
 void audio_reset_decoding(struct dec_audio *d_audio)
 {
-    if (d_audio->ad_driver)
-        d_audio->ad_driver->control(d_audio, ADCTRL_RESET, NULL);
-    d_audio->pts = MP_NOPTS_VALUE;
-    talloc_free(d_audio->current_frame);
-    d_audio->current_frame = NULL;
-    talloc_free(d_audio->packet);
-    d_audio->packet = NULL;
-    talloc_free(d_audio->new_segment);
-    d_audio->new_segment = NULL;
-    d_audio->start = d_audio->end = MP_NOPTS_VALUE;
+    lock_dec(d_audio);
+    reset(d_audio);
+    flush_async(d_audio);
+    unlock_dec(d_audio);
+}
+
+// Return the duration of the frames decoded ahead by the decoder thread, or 0.
+double audio_get_buffered(struct dec_audio *d_audio)
+{
+    struct dec_audio_async *a = d_audio->async;
+    if (!a)
+        return 0;
+    pthread_mutex_lock(&a->lock);
+    double res = a->buffered;
+    pthread_mutex_unlock(&a->lock);
+    return res;
+}
+
+void audio_set_recorder_sink(struct dec_audio *d_audio,
+                             struct mp_recorder_sink *sink)
+{
+    lock_dec(d_audio);
+    d_audio->recorder_sink = sink;
+    unlock_dec(d_audio);
+}
+
+static void feed_recorder(struct dec_audio *d_audio, struct demux_packet *pkt)
+{
+    struct dec_audio_async *a = d_audio->async;
+    if (!d_audio->recorder_sink)
+        return;
+    if (a) {
+        // The recorder is not thread-safe; feed it from audio_work().
+        pthread_mutex_lock(&a->lock);
+        MP_TARRAY_APPEND(a, a->rec_packets, a->num_rec_packets,
+                         demux_copy_packet(pkt));
+        pthread_mutex_unlock(&a->lock);
+    } else {
+        mp_recorder_feed_packet(d_audio->recorder_sink, pkt);
+    }
 }
 
 static void fix_audio_pts(struct dec_audio *da)
@@ -202,7 +333,7 @@ static bool is_new_segment(struct dec_audio *da, struct demux_packet *p)
         (p->start != da->start || p->end != da->end || p->codec != da->codec);
 }
 
-void audio_work(struct dec_audio *da)
+static void work(struct dec_audio *da)
 {
     if (da->current_frame || !da->ad_driver)
         return;
@@ -221,8 +352,7 @@ void audio_work(struct dec_audio *da)
     }
 
     if (da->ad_driver->send_packet(da, da->packet)) {
-        if (da->recorder_sink)
-            mp_recorder_feed_packet(da->recorder_sink, da->packet);
+        feed_recorder(da, da->packet);
 
         talloc_free(da->packet);
         da->packet = NULL;
@@ -255,12 +385,12 @@ void audio_work(struct dec_audio *da)
         da->new_segment = NULL;
 
         if (da->codec == new_segment->codec) {
-            audio_reset_decoding(da);
+            reset(da);
         } else {
             da->codec = new_segment->codec;
             da->ad_driver->uninit(da);
             da->ad_driver = NULL;
-            audio_init_best_codec(da);
+            init_best_codec(da);
         }
 
         da->start = new_segment->start;
@@ -271,12 +401,7 @@ void audio_work(struct dec_audio *da)
     }
 }
 
-// Fetch an audio frame decoded with audio_work(). Returns one of:
-//  DATA_OK:    *out_frame is set to a new image
-//  DATA_WAIT:  waiting for demuxer; will receive a wakeup signal
-//  DATA_EOF:   end of file, no more frames to be expected
-//  DATA_AGAIN: dropped frame or something similar
-int audio_get_frame(struct dec_audio *da, struct mp_aframe **out_frame)
+static int get_frame(struct dec_audio *da, struct mp_aframe **out_frame)
 {
     *out_frame = NULL;
     if (da->current_frame) {
@@ -288,3 +413,134 @@ int audio_get_frame(struct dec_audio *da, struct mp_aframe **out_frame)
         return DATA_AGAIN;
     return da->current_state;
 }
+
+void audio_work(struct dec_audio *d_audio)
+{
+    struct dec_audio_async *a = d_audio->async;
+    if (!a) {
+        work(d_audio);
+        return;
+    }
+
+    pthread_mutex_lock(&a->lock);
+    a->work_gen++;
+    pthread_cond_broadcast(&a->wakeup);
+    struct demux_packet **pkts = a->rec_packets;
+    int num_pkts = a->num_rec_packets;
+    a->rec_packets = NULL;
+    a->num_rec_packets = 0;
+    pthread_mutex_unlock(&a->lock);
+
+    for (int n = 0; n < num_pkts; n++) {
+        if (d_audio->recorder_sink)
+            mp_recorder_feed_packet(d_audio->recorder_sink, pkts[n]);
+        talloc_free(pkts[n]);
+    }
+    talloc_free(pkts);
+}
+
+// Fetch an audio frame decoded with audio_work(). Returns one of:
+//  DATA_OK:    *out_frame is set to a new image
+//  DATA_WAIT:  waiting for demuxer; will receive a wakeup signal
+//  DATA_EOF:   end of file, no more frames to be expected
+//  DATA_AGAIN: dropped frame or something similar
+int audio_get_frame(struct dec_audio *d_audio, struct mp_aframe **out_frame)
+{
+    struct dec_audio_async *a = d_audio->async;
+    if (!a)
+        return get_frame(d_audio, out_frame);
+
+    *out_frame = NULL;
+    pthread_mutex_lock(&a->lock);
+    int res = a->eof ? DATA_EOF : DATA_WAIT;
+    if (a->num_frames) {
+        *out_frame = a->frames[0];
+        MP_TARRAY_REMOVE_AT(a->frames, a->num_frames, 0);
+        a->buffered -= mp_aframe_duration(*out_frame);
+        if (!a->num_frames)
+            a->buffered = 0; // avoid accumulating rounding errors
+        pthread_cond_broadcast(&a->wakeup);
+        res = DATA_OK;
+    }
+    pthread_mutex_unlock(&a->lock);
+    return res;
+}
+
+static void *audio_thread(void *ptr)
+{
+    struct dec_audio *d_audio = ptr;
+    struct dec_audio_async *a = d_audio->async;
+
+    mpthread_set_name("adec");
+
+    while (1) {
+        pthread_mutex_lock(&a->lock);
+        while (!a->terminate && (a->eof || a->buffered >= a->max_buffered ||
+                                 a->wait_gen == a->work_gen))
+            pthread_cond_wait(&a->wakeup, &a->lock);
+        bool terminate = a->terminate;
+        int64_t gen = a->work_gen;
+        pthread_mutex_unlock(&a->lock);
+
+        if (terminate)
+            break;
+
+        pthread_mutex_lock(&a->dec_lock);
+        work(d_audio);
+        struct mp_aframe *frame;
+        int res = get_frame(d_audio, &frame);
+
+        pthread_mutex_lock(&a->lock);
+        if (res == DATA_OK) {
+            MP_TARRAY_APPEND(a, a->frames, a->num_frames, frame);
+            a->buffered += mp_aframe_duration(frame);
+        }
+        if (res == DATA_EOF)
+            a->eof = true;
+        // Wait until the demuxer wakes up the player, which calls audio_work().
+        if (res == DATA_WAIT)
+            a->wait_gen = gen;
+        pthread_mutex_unlock(&a->lock);
+        pthread_mutex_unlock(&a->dec_lock);
+
+        if (res == DATA_OK || res == DATA_EOF)
+            a->wakeup_cb(a->wakeup_ctx);
+    }
+
+    return NULL;
+}
+
+// Decode on a separate thread, buffering up to max_buffered seconds of decoded
+// audio. audio_work() and audio_get_frame() then only pass on requests and
+// frames, and wakeup_cb is called (from the decoder thread) when new output is
+// available. The packet source must be safe to read from the decoder thread,
+// i.e. the demuxer must use its own thread.
+bool audio_start_thread(struct dec_audio *d_audio, double max_buffered,
+                        void (*wakeup_cb)(void *ctx), void *wakeup_ctx)
+{
+    assert(!d_audio->async);
+
+    struct dec_audio_async *a = talloc_zero(NULL, struct dec_audio_async);
+    *a = (struct dec_audio_async){
+        .wait_gen = -1,
+        .max_buffered = max_buffered,
+        .wakeup_cb = wakeup_cb,
+        .wakeup_ctx = wakeup_ctx,
+    };
+    pthread_mutex_init(&a->dec_lock, NULL);
+    pthread_mutex_init(&a->lock, NULL);
+    pthread_cond_init(&a->wakeup, NULL);
+    d_audio->async = a;
+
+    if (pthread_create(&a->thread, NULL, audio_thread, d_audio)) {
+        pthread_cond_destroy(&a->wakeup);
+        pthread_mutex_destroy(&a->lock);
+        pthread_mutex_destroy(&a->dec_lock);
+        talloc_free(a);
+        d_audio->async = NULL;
+        return false;
+    }
+
+    MP_VERBOSE(d_audio, "Decoding on a separate thread.\n");
+    return true;
+}
@@ -49,6 +49,7 @@ struct dec_audio {
     struct demux_packet *new_segment;
     struct mp_aframe *current_frame;
     int current_state;
+    struct dec_audio_async *async; // if decoding on a thread
 };
 
 struct mp_decoder_list *audio_decoder_list(void);
@@ -59,6 +60,11 @@ void audio_work(struct dec_audio *d_audio);
 int audio_get_frame(struct dec_audio *d_audio, struct mp_aframe **out_frame);
 
 void audio_reset_decoding(struct dec_audio *d_audio);
+double audio_get_buffered(struct dec_audio *d_audio);
+void audio_set_recorder_sink(struct dec_audio *d_audio,
+                             struct mp_recorder_sink *sink);
+bool audio_start_thread(struct dec_audio *d_audio, double max_buffered,
+                        void (*wakeup_cb)(void *ctx), void *wakeup_ctx);
 
 // ad_spdif.c
 struct mp_decoder_list *select_spdif_codec(const char *codec, const char *pref);
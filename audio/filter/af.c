@@ -766,7 +766,10 @@ int af_filter_frame(struct af_stream *s, struct mp_audio *frame)
         talloc_free(frame);
         return -1;
     }
-    return af_do_filter(s->first, frame);
+    MP_STATS(s, "start filter audio");
+    int r = af_do_filter(s->first, frame);
+    MP_STATS(s, "end filter audio");
+    return r;
 }
 
 // Output the next queued frame (if any) from the full filter chain.
@@ -24,6 +24,7 @@
 #include <string.h>
 #include <inttypes.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavutil/intreadwrite.h>
@@ -35,6 +36,8 @@
 
 #include "common/av_common.h"
 #include "common/common.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
 #include "af.h"
 #include "audio/audio_buffer.h"
 #include "audio/chmap_sel.h"
@@ -44,6 +47,7 @@
 #define AC3_MAX_CHANNELS 6
 #define AC3_MAX_CODED_FRAME_SIZE 3840
 #define AC3_FRAME_SIZE (6  * 256)
+#define MAX_QUEUE 16
 const uint16_t ac3_bitrate_tab[19] = {
     32, 40, 48, 56, 64, 80, 96, 112, 128,
     160, 192, 224, 256, 320, 384, 448, 512, 576, 640
@@ -59,12 +63,33 @@ typedef struct af_ac3enc_s {
     int in_samples;     // samples of input per AC3 frame
     int out_samples;    // upper bound on encoded output per AC3 frame
     int64_t encoder_buffered;
+    bool eof;
+
+    // Encoder thread (if thread_valid). The fields below are protected by
+    // lock. The thread accesses lavc_actx only while busy is set, or while
+    // frames are queued.
+    bool thread_valid;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool terminate;
+    bool busy;                  // encoder thread is encoding a frame
+    bool failed;                // an encoding error happened
+    AVFrame *queue[MAX_QUEUE];  // frames waiting for encoding
+    int num_queue;
+    AVPacket **packets;         // encoded packets, not yet output
+    int num_packets;
+    AVPacket **free_packets;    // returned packets, reused for encoding
+    int num_free_packets;
+    int64_t encode_time, encode_time_max; // in microseconds
+    int64_t encoded_frames;
 
     int cfg_add_iec61937_header;
     int cfg_bit_rate;
     int cfg_min_channel_num;
     char *cfg_encoder;
     char **cfg_avopts;
+    int cfg_queue;
 } af_ac3enc_t;
 
 // fmt carries the input format. Change it to the best next-possible format
@@ -104,6 +129,110 @@ done_fmt: ;
         mp_audio_set_channels(fmt, &res);
 }
 
+// Encode a frame, and append the resulting packets to s->packets.
+static bool encode_frame(struct af_instance *af, AVFrame *frame)
+{
+    af_ac3enc_t *s = af->priv;
+
+    int64_t start = mp_time_us();
+    int lavc_ret = avcodec_send_frame(s->lavc_actx, frame);
+    if (lavc_ret < 0)
+        return false;
+
+    while (1) {
+        pthread_mutex_lock(&s->lock);
+        AVPacket *pkt = NULL;
+        if (s->num_free_packets)
+            pkt = s->free_packets[--s->num_free_packets];
+        pthread_mutex_unlock(&s->lock);
+        if (!pkt)
+            pkt = av_packet_alloc();
+        if (!pkt)
+            return false;
+
+        lavc_ret = avcodec_receive_packet(s->lavc_actx, pkt);
+
+        pthread_mutex_lock(&s->lock);
+        if (lavc_ret >= 0) {
+            MP_TARRAY_APPEND(s, s->packets, s->num_packets, pkt);
+        } else {
+            MP_TARRAY_APPEND(s, s->free_packets, s->num_free_packets, pkt);
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        if (lavc_ret == AVERROR(EAGAIN))
+            break;
+        if (lavc_ret < 0)
+            return false;
+    }
+
+    int64_t t = mp_time_us() - start;
+    pthread_mutex_lock(&s->lock);
+    s->encode_time += t;
+    s->encode_time_max = MPMAX(s->encode_time_max, t);
+    s->encoded_frames++;
+    pthread_mutex_unlock(&s->lock);
+    return true;
+}
+
+static void *encode_thread(void *ptr)
+{
+    struct af_instance *af = ptr;
+    af_ac3enc_t *s = af->priv;
+
+    mpthread_set_name("ac3enc");
+
+    pthread_mutex_lock(&s->lock);
+    while (!s->terminate) {
+        if (!s->num_queue || s->failed) {
+            pthread_cond_wait(&s->wakeup, &s->lock);
+            continue;
+        }
+
+        AVFrame *frame = s->queue[0];
+        MP_TARRAY_REMOVE_AT(s->queue, s->num_queue, 0);
+        s->busy = true;
+        pthread_mutex_unlock(&s->lock);
+
+        bool ok = encode_frame(af, frame);
+        av_frame_free(&frame);
+
+        pthread_mutex_lock(&s->lock);
+        s->busy = false;
+        if (!ok)
+            s->failed = true;
+        pthread_cond_broadcast(&s->wakeup);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+// Wait until the encoder thread is idle. If discard is set, drop the frames
+// that weren't encoded yet, and all packets that weren't output yet.
+static void wait_encoder(struct af_instance *af, bool discard)
+{
+    af_ac3enc_t *s = af->priv;
+
+    pthread_mutex_lock(&s->lock);
+    if (discard) {
+        for (int n = 0; n < s->num_queue; n++)
+            av_frame_free(&s->queue[n]);
+        s->num_queue = 0;
+    }
+    while (s->busy || (s->num_queue && !s->failed))
+        pthread_cond_wait(&s->wakeup, &s->lock);
+    if (discard) {
+        for (int n = 0; n < s->num_packets; n++) {
+            av_packet_unref(s->packets[n]);
+            MP_TARRAY_APPEND(s, s->free_packets, s->num_free_packets,
+                             s->packets[n]);
+        }
+        s->num_packets = 0;
+        s->failed = false;
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
 // Initialization and runtime control
 static int control(struct af_instance *af, int cmd, void *arg)
 {
@@ -130,6 +259,9 @@ static int control(struct af_instance *af, int cmd, void *arg)
         if (!mp_audio_config_equals(in, &orig_in))
             return AF_FALSE;
 
+        wait_encoder(af, true);
+        s->eof = false;
+
         if (s->cfg_add_iec61937_header) {
             s->out_samples = AC3_FRAME_SIZE;
         } else {
@@ -175,6 +307,8 @@ static int control(struct af_instance *af, int cmd, void *arg)
         return AF_OK;
     }
     case AF_CONTROL_RESET:
+        wait_encoder(af, true);
+        s->eof = false;
         if (avcodec_is_open(s->lavc_actx))
             avcodec_flush_buffers(s->lavc_actx);
         talloc_free(s->pending);
@@ -192,6 +326,24 @@ static void uninit(struct af_instance* af)
     af_ac3enc_t *s = af->priv;
 
     if (s) {
+        if (s->thread_valid) {
+            pthread_mutex_lock(&s->lock);
+            s->terminate = true;
+            pthread_cond_broadcast(&s->wakeup);
+            pthread_mutex_unlock(&s->lock);
+            pthread_join(s->thread, NULL);
+        }
+        wait_encoder(af, true);
+        for (int n = 0; n < s->num_free_packets; n++)
+            av_packet_free(&s->free_packets[n]);
+        if (s->encoded_frames) {
+            MP_VERBOSE(af, "Encoded %"PRId64" frames, average %.3f ms, "
+                       "max %.3f ms per frame.\n", s->encoded_frames,
+                       s->encode_time / 1e3 / s->encoded_frames,
+                       s->encode_time_max / 1e3);
+        }
+        pthread_cond_destroy(&s->wakeup);
+        pthread_mutex_destroy(&s->lock);
         avcodec_free_context(&s->lavc_actx);
         talloc_free(s->pending);
     }
@@ -214,6 +366,7 @@ static int filter_frame(struct af_instance *af, struct mp_audio *audio)
 
     talloc_free(s->pending);
     s->pending = audio;
+    s->eof = !audio;
     update_delay(af);
     return 0;
 }
@@ -260,70 +413,29 @@ static int read_input_frame(struct af_instance *af, AVFrame *frame)
     return 1;
 }
 
-static int filter_out(struct af_instance *af)
+// Write the packet as AC3 or IEC 61937 frame to the output.
+static bool output_packet(struct af_instance *af, AVPacket *pkt)
 {
     af_ac3enc_t *s = af->priv;
 
-    if (!s->pending)
-        return 0;
-
-    AVFrame *frame = av_frame_alloc();
-    if (!frame) {
-        MP_FATAL(af, "Could not allocate memory \n");
-        return -1;
-    }
-    int err = -1;
-
-    AVPacket pkt = {0};
-    av_init_packet(&pkt);
-
-    // Send input as long as it wants.
-    while (1) {
-        err = read_input_frame(af, frame);
-        if (err < 0)
-            goto done;
-        if (err == 0)
-            break;
-        err = -1;
-        int lavc_ret = avcodec_send_frame(s->lavc_actx, frame);
-        // On EAGAIN, we're supposed to read remaining output.
-        if (lavc_ret == AVERROR(EAGAIN))
-            break;
-        if (lavc_ret < 0) {
-            MP_FATAL(af, "Encode failed.\n");
-            goto done;
-        }
-        s->encoder_buffered += s->input->samples;
-        s->input->samples = 0;
-    }
-    int lavc_ret = avcodec_receive_packet(s->lavc_actx, &pkt);
-    if (lavc_ret == AVERROR(EAGAIN)) {
-        // Need to buffer more input.
-        err = 0;
-        goto done;
-    }
-    if (lavc_ret < 0) {
-        MP_FATAL(af, "Encode failed.\n");
-        goto done;
-    }
-
     MP_DBG(af, "avcodec_encode_audio got %d, pending %d.\n",
-           pkt.size, s->pending->samples + s->input->samples);
+           pkt->size, (s->pending ? s->pending->samples : 0) + s->input->samples);
 
     s->encoder_buffered -= AC3_FRAME_SIZE;
 
     struct mp_audio *out =
         mp_audio_pool_get(af->out_pool, af->data, s->out_samples);
     if (!out)
-        goto done;
-    mp_audio_copy_attributes(out, s->pending);
+        return false;
+    if (s->pending)
+        mp_audio_copy_attributes(out, s->pending);
 
-    int frame_size = pkt.size;
+    int frame_size = pkt->size;
     int header_len = 0;
     char hdr[8];
 
-    if (s->cfg_add_iec61937_header && pkt.size > 5) {
-        int bsmod = pkt.data[5] & 0x7;
+    if (s->cfg_add_iec61937_header && pkt->size > 5) {
+        int bsmod = pkt->data[5] & 0x7;
         int len = frame_size;
 
         frame_size = AC3_FRAME_SIZE * 2 * 2;
@@ -341,17 +453,88 @@ static int filter_out(struct af_instance *af)
 
     char *buf = (char *)out->planes[0];
     memcpy(buf, hdr, header_len);
-    memcpy(buf + header_len, pkt.data, pkt.size);
-    memset(buf + header_len + pkt.size, 0,
-           frame_size - (header_len + pkt.size));
-    swap_16((uint16_t *)(buf + header_len), pkt.size / 2);
+    memcpy(buf + header_len, pkt->data, pkt->size);
+    memset(buf + header_len + pkt->size, 0,
+           frame_size - (header_len + pkt->size));
+    swap_16((uint16_t *)(buf + header_len), pkt->size / 2);
     out->samples = frame_size / out->sstride;
     af_add_output_frame(af, out);
+    return true;
+}
+
+static int filter_out(struct af_instance *af)
+{
+    af_ac3enc_t *s = af->priv;
+    int err = -1;
+
+    // Send input as long as it wants. With the encoder thread, this blocks
+    // only if the queue is full.
+    while (s->pending) {
+        pthread_mutex_lock(&s->lock);
+        while (s->thread_valid && s->num_queue >= s->cfg_queue && !s->failed)
+            pthread_cond_wait(&s->wakeup, &s->lock);
+        bool failed = s->failed;
+        pthread_mutex_unlock(&s->lock);
+        if (failed)
+            break;
+
+        AVFrame *frame = av_frame_alloc();
+        if (!frame) {
+            MP_FATAL(af, "Could not allocate memory \n");
+            return -1;
+        }
+        int r = read_input_frame(af, frame);
+        if (r <= 0) {
+            av_frame_free(&frame);
+            if (r < 0)
+                goto done;
+            break;
+        }
+        s->encoder_buffered += s->input->samples;
+        s->input->samples = 0;
+
+        if (s->thread_valid) {
+            pthread_mutex_lock(&s->lock);
+            s->queue[s->num_queue++] = frame;
+            pthread_cond_broadcast(&s->wakeup);
+            pthread_mutex_unlock(&s->lock);
+        } else {
+            bool ok = encode_frame(af, frame);
+            av_frame_free(&frame);
+            if (!ok) {
+                MP_FATAL(af, "Encode failed.\n");
+                goto done;
+            }
+        }
+    }
+
+    // On EOF, the filter chain reads output only until there is none.
+    if (s->eof && s->thread_valid)
+        wait_encoder(af, false);
+
+    pthread_mutex_lock(&s->lock);
+    bool failed = s->failed;
+    AVPacket **packets = s->packets;
+    int num_packets = s->num_packets;
+    s->packets = NULL;
+    s->num_packets = 0;
+    pthread_mutex_unlock(&s->lock);
+
+    if (failed)
+        MP_FATAL(af, "Encode failed.\n");
+
+    err = failed ? -1 : 0;
+    for (int n = 0; n < num_packets; n++) {
+        if (!err && !output_packet(af, packets[n]))
+            err = -1;
+        av_packet_unref(packets[n]);
+        pthread_mutex_lock(&s->lock);
+        MP_TARRAY_APPEND(s, s->free_packets, s->num_free_packets, packets[n]);
+        pthread_mutex_unlock(&s->lock);
+    }
+    talloc_free(packets);
 
-    err = 0;
 done:
-    av_packet_unref(&pkt);
-    av_frame_free(&frame);
     update_delay(af);
     return err;
 }
@@ -359,6 +542,8 @@ done:
 static int af_open(struct af_instance* af){
 
     af_ac3enc_t *s = af->priv;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->wakeup, NULL);
     af->control=control;
     af->uninit=uninit;
     af->filter_frame = filter_frame;
@@ -406,6 +591,14 @@ static int af_open(struct af_instance* af){
         }
     }
 
+    if (s->cfg_queue > 0) {
+        s->thread_valid = true;
+        if (pthread_create(&s->thread, NULL, encode_thread, af)) {
+            MP_WARN(af, "Could not start encoder thread.\n");
+            s->thread_valid = false;
+        }
+    }
+
     return AF_OK;
 }
 
@@ -421,6 +614,7 @@ const struct af_info af_info_lavcac3enc = {
         .cfg_bit_rate = 640,
         .cfg_min_channel_num = 3,
         .cfg_encoder = "ac3",
+        .cfg_queue = 4,
     },
     .options = (const struct m_option[]) {
         OPT_FLAG("tospdif", cfg_add_iec61937_header, 0),
@@ -429,6 +623,7 @@ const struct af_info af_info_lavcac3enc = {
         OPT_INTRANGE("minch", cfg_min_channel_num, 0, 2, 6),
         OPT_STRING("encoder", cfg_encoder, 0),
         OPT_KEYVALUELIST("o", cfg_avopts, 0),
+        OPT_INTRANGE("queue", cfg_queue, 0, 0, MAX_QUEUE),
         {0}
     },
 };
@@ -40,10 +40,22 @@
 #include "af.h"
 
 #include "common/av_common.h"
+#include "common/lavfi_threads.h"
 #include "common/tags.h"
 
 #include "options/m_option.h"
 
+// Number of unused graphs kept around for other input parameters.
+#define GRAPH_CACHE_SIZE 4
+
+// A configured graph, and the input format it was created for.
+struct graph_entry {
+    AVFilterGraph *graph;
+    AVFilterContext *in;
+    AVFilterContext *out;
+    struct mp_audio config;
+};
+
 struct priv {
     // Single filter bridge, instead of a graph.
     bool is_bridge;
@@ -58,6 +70,18 @@ struct priv {
 
     bool eof;
 
+    // Input format of the current graph. fresh means it was never fed any
+    // data or commands, and is equivalent to a newly created graph.
+    struct mp_audio graph_config;
+    bool graph_fresh;
+
+    // Fresh graphs for other input formats (see vf_lavfi.c).
+    struct graph_entry cache[GRAPH_CACHE_SIZE];
+    int num_cache;
+
+    // Shared by all graphs above; created on first use.
+    struct mp_lavfi_threads *threads;
+
     struct mp_tags *metadata;
 
     // options
@@ -74,11 +98,70 @@ static void destroy_graph(struct af_instance *af)
     p->in = p->out = NULL;
     p->samples_in = 0;
     p->eof = false;
+    p->graph_fresh = false;
+}
+
+static void flush_graph_cache(struct af_instance *af)
+{
+    struct priv *p = af->priv;
+    for (int n = 0; n < p->num_cache; n++)
+        avfilter_graph_free(&p->cache[n].graph);
+    p->num_cache = 0;
+}
+
+// Only the parameters that are passed to the buffer source matter.
+static bool graph_config_equal(struct mp_audio *a, struct mp_audio *b)
+{
+    return a->format == b->format && a->rate == b->rate &&
+           mp_chmap_equals(&a->channels, &b->channels);
+}
+
+// Replace the current graph with a cached or the current one, if possible.
+// If the current graph can't be used, it's destroyed or put into the cache.
+static bool reuse_graph(struct af_instance *af, struct mp_audio *config)
+{
+    struct priv *p = af->priv;
+
+    if (p->graph && p->graph_fresh && graph_config_equal(&p->graph_config, config))
+    {
+        MP_VERBOSE(af, "lavfi: reusing graph\n");
+        return true;
+    }
+
+    if (p->graph && p->graph_fresh) {
+        if (p->num_cache == GRAPH_CACHE_SIZE) {
+            avfilter_graph_free(&p->cache[0].graph);
+            MP_TARRAY_REMOVE_AT(p->cache, p->num_cache, 0);
+        }
+        p->cache[p->num_cache++] = (struct graph_entry){
+            .graph = p->graph,
+            .in = p->in,
+            .out = p->out,
+            .config = p->graph_config,
+        };
+        p->graph = NULL;
+    }
+    destroy_graph(af);
+
+    for (int n = 0; n < p->num_cache; n++) {
+        struct graph_entry *e = &p->cache[n];
+        if (graph_config_equal(&e->config, config)) {
+            MP_VERBOSE(af, "lavfi: using cached graph\n");
+            p->graph = e->graph;
+            p->in = e->in;
+            p->out = e->out;
+            p->graph_config = e->config;
+            p->graph_fresh = true;
+            MP_TARRAY_REMOVE_AT(p->cache, p->num_cache, n);
+            return true;
+        }
+    }
+
+    return false;
 }
 
 static bool recreate_graph(struct af_instance *af, struct mp_audio *config)
 {
-    void *tmp = talloc_new(NULL);
     struct priv *p = af->priv;
     AVFilterContext *in = NULL, *out = NULL;
     bool ok = false;
@@ -88,12 +171,19 @@ static bool recreate_graph(struct af_instance *af, struct mp_audio *config)
         return false;
     }
 
-    destroy_graph(af);
+    if (reuse_graph(af, config))
+        return true;
+
+    void *tmp = talloc_new(NULL);
 
     AVFilterGraph *graph = avfilter_graph_alloc();
     if (!graph)
         goto error;
 
+    if (!p->threads)
+        p->threads = mp_lavfi_threads_create(p, af->global, af->log);
+    mp_lavfi_threads_setup(p->threads, graph);
+
     if (mp_set_avopts(af->log, graph, p->cfg_avopts) < 0)
         goto error;
 
@@ -163,6 +253,8 @@ static bool recreate_graph(struct af_instance *af, struct mp_audio *config)
     p->in = in;
     p->out = out;
     p->graph = graph;
+    p->graph_config = *config;
+    p->graph_fresh = true;
 
     assert(out->nb_inputs == 1);
     assert(in->nb_outputs == 1);
@@ -229,6 +321,9 @@ static int control(struct af_instance *af, int cmd, void *arg)
     case AF_CONTROL_COMMAND: {
         if (!p->graph)
             break;
+        // Cached graphs wouldn't have the changed parameters.
+        flush_graph_cache(af);
+        p->graph_fresh = false;
         char **args = arg;
         return avfilter_graph_send_command(p->graph, "all",
                                            args[0], args[1], &(char){0}, 0, 0)
@@ -273,6 +368,8 @@ static int filter_frame(struct af_instance *af, struct mp_audio *data)
         p->eof = true;
     }
 
+    p->graph_fresh = false;
+
     if (data) {
         frame = mp_audio_to_avframe_and_unref(data);
         data = NULL;
@@ -344,6 +441,7 @@ error:
 static void uninit(struct af_instance *af)
 {
     destroy_graph(af);
+    flush_graph_cache(af);
 }
 
 static int af_open(struct af_instance *af)
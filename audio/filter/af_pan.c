@@ -26,6 +26,7 @@
 
 #include "common/common.h"
 #include "af.h"
+#include "dsp.h"
 
 // Data for specific instances of this filter
 typedef struct af_pan_s {
@@ -136,41 +137,68 @@ static int control(struct af_instance *af, int cmd, void *arg)
     return AF_UNKNOWN;
 }
 
+static bool is_identity(af_pan_t *s, int nchi, int ncho)
+{
+    if (nchi != ncho)
+        return false;
+    for (int j = 0; j < ncho; j++) {
+        for (int k = 0; k < nchi; k++) {
+            if (s->level[j][k] != (j == k ? 1.0f : 0.0f))
+                return false;
+        }
+    }
+    return true;
+}
+
 static int filter_frame(struct af_instance *af, struct mp_audio *c)
 {
     if (!c)
         return 0;
-    struct mp_audio *l = mp_audio_pool_get(af->out_pool, &af->fmt_out, c->samples);
-    if (!l) {
-        talloc_free(c);
-        return -1;
-    }
-    mp_audio_copy_attributes(l, c);
 
     af_pan_t*     s    = af->priv;        // Setup for this instance
-    float         *in  = c->planes[0];    // Input audio data
-    float         *out = NULL;            // Output audio data
-    float         *end = in+c->samples * c->nch;    // End of loop
     int           nchi = c->nch;          // Number of input channels
-    int           ncho = l->nch;          // Number of output channels
-    register int  j, k;
-
-    out = l->planes[0];
-    // Execute panning
-    // FIXME: Too slow
-    while (in < end) {
-        for (j = 0; j < ncho; j++) {
-            register float  x    = 0.0;
-            register float  *tin = in;
-            for (k = 0; k < nchi; k++)
-                x += tin[k] * s->level[j][k];
-            out[j] = x;
+    int           ncho = af->fmt_out.nch; // Number of output channels
+
+    // Only the channel layout changes.
+    if (is_identity(s, nchi, ncho)) {
+        mp_audio_copy_config(c, &af->fmt_out);
+        af_add_output_frame(af, c);
+        return 0;
+    }
+
+    // If the number of channels doesn't increase, each output frame fits in
+    // the space of the input frame it's computed from, so the data can be
+    // processed in place.
+    struct mp_audio *l = c;
+    if (ncho <= nchi) {
+        if (af_make_writeable(af, c) < 0) {
+            talloc_free(c);
+            return -1;
+        }
+    } else {
+        l = mp_audio_pool_get(af->out_pool, &af->fmt_out, c->samples);
+        if (!l) {
+            talloc_free(c);
+            return -1;
         }
-        out += ncho;
-        in += nchi;
+        mp_audio_copy_attributes(l, c);
     }
 
-    talloc_free(c);
+    // Execute panning. The mixing code wants the matrix transposed, with the
+    // unused entries set to 0.
+    float cols[AF_NCH * AF_NCH] = {0};
+    for (int j = 0; j < ncho; j++) {
+        for (int k = 0; k < nchi; k++)
+            cols[k * AF_NCH + j] = s->level[j][k];
+    }
+    mp_dsp_matrix_float(l->planes[0], c->planes[0], c->samples, nchi, ncho,
+                        cols, AF_NCH);
+
+    if (l == c) {
+        mp_audio_copy_config(l, &af->fmt_out);
+    } else {
+        talloc_free(c);
+    }
     af_add_output_frame(af, l);
     return 0;
 }
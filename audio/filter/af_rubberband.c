@@ -16,15 +16,52 @@
  */
 
 #include <stdlib.h>
+#include <limits.h>
 #include <assert.h>
+#include <pthread.h>
 
+#include <libavutil/cpu.h>
 #include <rubberband/rubberband-c.h>
 
 #include "common/common.h"
+#include "misc/thread_pool.h"
+#include "osdep/timer.h"
 #include "af.h"
 
-struct priv {
+// Measure the processing load over this much output (in seconds).
+#define LOAD_WINDOW 1.0
+// Switch to cheaper settings if processing takes more than this fraction of
+// the real time duration of the output.
+#define LOAD_LIMIT 0.7
+
+// Channels are split into groups of stereo pairs. Each group has its own
+// stretcher, and the groups are processed in parallel. All stretchers get the
+// same input and parameters, and output is retrieved from all of them in
+// lockstep, so they stay in sync.
+struct group {
     RubberBandState rubber;
+    int first, num;         // channel range
+};
+
+struct priv {
+    struct group groups[MP_NUM_CHANNELS];
+    int num_groups;
+    struct mp_thread_pool *pool;
+    int pool_threads;
+
+    // State of the current rubberband_process() step; protected by lock.
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int next_group, groups_done;
+    const float *const *in_data;
+    size_t in_samples;
+    bool final;
+
+    // Processing load estimation for the fallback.
+    int64_t proc_time;      // in us
+    double proc_output;     // in seconds
+    int fallback_level;
+
     double speed;
     double pitch;
     struct mp_audio *pending;
@@ -35,6 +72,7 @@ struct priv {
     // command line options
     int opt_transients, opt_detector, opt_phase, opt_window,
         opt_smoothing, opt_formant, opt_pitch, opt_channels;
+    int opt_threads, opt_fallback;
 };
 
 static void update_speed(struct af_instance *af, double new_speed)
@@ -42,7 +80,8 @@ static void update_speed(struct af_instance *af, double new_speed)
     struct priv *p = af->priv;
 
     p->speed = new_speed;
-    rubberband_set_time_ratio(p->rubber, 1.0 / p->speed);
+    for (int n = 0; n < p->num_groups; n++)
+        rubberband_set_time_ratio(p->groups[n].rubber, 1.0 / p->speed);
 }
 
 static void update_pitch(struct af_instance *af, double new_pitch)
@@ -50,7 +89,154 @@ static void update_pitch(struct af_instance *af, double new_pitch)
     struct priv *p = af->priv;
 
     p->pitch = new_pitch;
-    rubberband_set_pitch_scale(p->rubber, p->pitch);
+    for (int n = 0; n < p->num_groups; n++)
+        rubberband_set_pitch_scale(p->groups[n].rubber, p->pitch);
+}
+
+static void destroy_groups(struct af_instance *af)
+{
+    struct priv *p = af->priv;
+
+    for (int n = 0; n < p->num_groups; n++)
+        rubberband_delete(p->groups[n].rubber);
+    p->num_groups = 0;
+}
+
+static bool create_groups(struct af_instance *af, struct mp_audio *in, int opts)
+{
+    struct priv *p = af->priv;
+
+    int threads = p->opt_threads ? p->opt_threads : av_cpu_count();
+    int pairs = (in->channels.num + 1) / 2;
+    int num_groups = MPCLAMP(threads, 1, pairs);
+    int pairs_per_group = (pairs + num_groups - 1) / num_groups;
+
+    for (int ch = 0; ch < in->channels.num; ch += pairs_per_group * 2) {
+        struct group *g = &p->groups[p->num_groups++];
+        g->first = ch;
+        g->num = MPMIN(pairs_per_group * 2, in->channels.num - ch);
+        g->rubber = rubberband_new(in->rate, g->num, opts, 1.0, 1.0);
+        if (!g->rubber) {
+            p->num_groups--;
+            return false;
+        }
+    }
+
+    int helpers = p->num_groups - 1;
+    if (helpers != p->pool_threads) {
+        talloc_free(p->pool);
+        p->pool = NULL;
+        p->pool_threads = 0;
+        if (helpers > 0) {
+            p->pool = mp_thread_pool_create_shared(p, af->global, helpers);
+            if (p->pool)
+                p->pool_threads = helpers;
+        }
+    }
+
+    MP_VERBOSE(af, "Using %d stretcher(s) for %d channels.\n",
+               p->num_groups, in->channels.num);
+    return true;
+}
+
+// Process groups of the current step until none are left.
+static void process_groups(struct priv *p)
+{
+    pthread_mutex_lock(&p->lock);
+    while (p->next_group < p->num_groups) {
+        struct group *g = &p->groups[p->next_group++];
+        pthread_mutex_unlock(&p->lock);
+        rubberband_process(g->rubber, p->in_data + g->first, p->in_samples,
+                           p->final);
+        pthread_mutex_lock(&p->lock);
+        if (++p->groups_done == p->num_groups)
+            pthread_cond_broadcast(&p->wakeup);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void process_worker(void *ctx)
+{
+    process_groups(ctx);
+}
+
+static void process(struct priv *p, const float *const *in_data,
+                    size_t in_samples, bool final)
+{
+    pthread_mutex_lock(&p->lock);
+    p->in_data = in_data;
+    p->in_samples = in_samples;
+    p->final = final;
+    p->next_group = 0;
+    p->groups_done = 0;
+    pthread_mutex_unlock(&p->lock);
+
+    // The filter thread works on groups too, so a busy shared pool only
+    // costs parallelism. Helpers which start late find nothing left to do.
+    for (int n = 0; n < p->pool_threads; n++)
+        mp_thread_pool_queue(p->pool, process_worker, p);
+
+    process_groups(p);
+
+    pthread_mutex_lock(&p->lock);
+    while (p->groups_done < p->num_groups)
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static int get_available(struct priv *p)
+{
+    int available = p->num_groups ? INT_MAX : 0;
+    for (int n = 0; n < p->num_groups; n++)
+        available = MPMIN(available, rubberband_available(p->groups[n].rubber));
+    return available;
+}
+
+static size_t get_samples_required(struct priv *p)
+{
+    size_t required = 0;
+    for (int n = 0; n < p->num_groups; n++) {
+        required = MPMAX(required,
+                         rubberband_get_samples_required(p->groups[n].rubber));
+    }
+    return required;
+}
+
+static void reset_groups(struct priv *p)
+{
+    for (int n = 0; n < p->num_groups; n++)
+        rubberband_reset(p->groups[n].rubber);
+}
+
+// Switch to cheaper settings step by step if the filter can't keep up.
+static void check_load(struct af_instance *af)
+{
+    struct priv *p = af->priv;
+
+    if (!p->opt_fallback || p->proc_output < LOAD_WINDOW)
+        return;
+
+    double load = p->proc_time / 1e6 / p->proc_output;
+    p->proc_time = 0;
+    p->proc_output = 0;
+    if (load < LOAD_LIMIT || p->fallback_level >= 2)
+        return;
+
+    p->fallback_level++;
+    MP_WARN(af, "Processing too slow (%d%% load), switching to faster "
+            "settings (level %d).\n", (int)(load * 100), p->fallback_level);
+
+    for (int n = 0; n < p->num_groups; n++) {
+        RubberBandState rubber = p->groups[n].rubber;
+        if (p->fallback_level == 1) {
+            rubberband_set_formant_option(rubber, RubberBandOptionFormantShifted);
+            rubberband_set_pitch_option(rubber, RubberBandOptionPitchHighSpeed);
+        } else {
+            rubberband_set_transients_option(rubber,
+                                             RubberBandOptionTransientsSmooth);
+            rubberband_set_phase_option(rubber, RubberBandOptionPhaseIndependent);
+        }
+    }
 }
 
 static int control(struct af_instance *af, int cmd, void *arg)
@@ -66,17 +252,17 @@ static int control(struct af_instance *af, int cmd, void *arg)
         in->format = AF_FORMAT_FLOATP;
         mp_audio_copy_config(out, in);
 
-        if (p->rubber)
-            rubberband_delete(p->rubber);
+        destroy_groups(af);
+        p->fallback_level = 0;
 
         int opts = p->opt_transients | p->opt_detector | p->opt_phase |
                    p->opt_window | p->opt_smoothing | p->opt_formant |
                    p->opt_pitch | p-> opt_channels |
                    RubberBandOptionProcessRealTime;
 
-        p->rubber = rubberband_new(in->rate, in->channels.num, opts, 1.0, 1.0);
-        if (!p->rubber) {
+        if (!create_groups(af, in, opts)) {
             MP_FATAL(af, "librubberband initialization failed.\n");
+            destroy_groups(af);
             return AF_ERROR;
         }
 
@@ -91,8 +277,7 @@ static int control(struct af_instance *af, int cmd, void *arg)
         return AF_OK;
     }
     case AF_CONTROL_RESET:
-        if (p->rubber)
-            rubberband_reset(p->rubber);
+        reset_groups(p);
         talloc_free(p->pending);
         p->pending = NULL;
         p->rubber_delay = 0;
@@ -128,7 +313,9 @@ static int filter_out(struct af_instance *af)
 {
     struct priv *p = af->priv;
 
-    while (rubberband_available(p->rubber) <= 0) {
+    int64_t start = mp_time_us();
+
+    while (get_available(p) <= 0) {
         const float *dummy[MP_NUM_CHANNELS] = {0};
         const float **in_data = dummy;
         size_t in_samples = 0;
@@ -138,12 +325,12 @@ static int filter_out(struct af_instance *af)
 
             // recover from previous EOF
             if (p->needs_reset) {
-                rubberband_reset(p->rubber);
+                reset_groups(p);
                 p->rubber_delay = 0;
             }
             p->needs_reset = false;
 
-            size_t needs = rubberband_get_samples_required(p->rubber);
+            size_t needs = get_samples_required(p);
             in_data = (void *)&p->pending->planes;
             in_samples = MPMIN(p->pending->samples, needs);
         }
@@ -152,7 +339,7 @@ static int filter_out(struct af_instance *af)
             break; // previous EOF
         p->needs_reset = !p->pending; // EOF
 
-        rubberband_process(p->rubber, in_data, in_samples, p->needs_reset);
+        process(p, in_data, in_samples, p->needs_reset);
         p->rubber_delay += in_samples;
 
         if (!p->pending)
@@ -160,7 +347,7 @@ static int filter_out(struct af_instance *af)
         mp_audio_skip_samples(p->pending, in_samples);
     }
 
-    int out_samples = rubberband_available(p->rubber);
+    int out_samples = get_available(p);
     if (out_samples > 0) {
         struct mp_audio *out =
             mp_audio_pool_get(af->out_pool, af->data, out_samples);
@@ -170,12 +357,19 @@ static int filter_out(struct af_instance *af)
             mp_audio_copy_config(out, p->pending);
 
         float **out_data = (void *)&out->planes;
-        out->samples = rubberband_retrieve(p->rubber, out_data, out->samples);
+        for (int n = 0; n < p->num_groups; n++) {
+            struct group *g = &p->groups[n];
+            rubberband_retrieve(g->rubber, out_data + g->first, out->samples);
+        }
         p->rubber_delay -= out->samples * p->speed;
 
+        p->proc_output += out->samples / (double)af->data->rate;
         af_add_output_frame(af, out);
     }
 
+    p->proc_time += mp_time_us() - start;
+    check_load(af);
+
     int delay_samples = p->rubber_delay;
     if (p->pending)
         delay_samples += p->pending->samples;
@@ -188,13 +382,21 @@ static void uninit(struct af_instance *af)
 {
     struct priv *p = af->priv;
 
-    if (p->rubber)
-        rubberband_delete(p->rubber);
+    // Wait for late helpers before destroying the state they use.
+    talloc_free(p->pool);
+    destroy_groups(af);
     talloc_free(p->pending);
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
 }
 
 static int af_open(struct af_instance *af)
 {
+    struct priv *p = af->priv;
+
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+
     af->control = control;
     af->filter_frame = filter_frame;
     af->filter_out = filter_out;
@@ -215,6 +417,7 @@ const struct af_info af_info_rubberband = {
         .opt_transients = RubberBandOptionTransientsMixed,
         .opt_formant = RubberBandOptionFormantPreserved,
         .opt_channels = RubberBandOptionChannelsTogether,
+        .opt_fallback = 1,
     },
     .options = (const struct m_option[]) {
         OPT_CHOICE("transients", opt_transients, 0,
@@ -246,6 +449,9 @@ const struct af_info af_info_rubberband = {
                    ({"apart", RubberBandOptionChannelsApart},
                     {"together", RubberBandOptionChannelsTogether})),
         OPT_DOUBLE("pitch-scale", pitch, M_OPT_RANGE, .min = 0.01, .max = 100),
+        OPT_CHOICE_OR_INT("threads", opt_threads, 0, 1, MP_NUM_CHANNELS,
+                          ({"auto", 0})),
+        OPT_FLAG("fallback", opt_fallback, 0),
         {0}
     },
 };
@@ -34,11 +34,16 @@
 #include <string.h>
 #include <limits.h>
 #include <assert.h>
+#include <pthread.h>
 
+#include <libavutil/cpu.h>
+
+#include "config.h"
 #include "common/common.h"
 
 #include "af.h"
 #include "options/m_option.h"
+#include "af_scaletempo_x86.h"
 
 // Data for specific instances of this filter
 typedef struct af_scaletempo_s
@@ -117,6 +122,28 @@ static int fill_queue(struct af_instance *af, struct mp_audio *data, int offset)
 
 #define UNROLL_PADDING (4 * 4)
 
+// Vectorized cross correlation (see af_scaletempo_x86.h), or NULL.
+static float (*corr_float)(const float *a, const float *b, int n);
+static int64_t (*corr_s16)(const int32_t *a, const int16_t *b, int n);
+
+static pthread_once_t corr_init_once = PTHREAD_ONCE_INIT;
+
+static void corr_init(void)
+{
+    int flags = av_get_cpu_flags();
+    (void)flags;
+#if HAVE_SSE2_INTRINSICS
+    if (flags & AV_CPU_FLAG_SSE2)
+        corr_float = mp_scaletempo_corr_float_sse2;
+#endif
+#if HAVE_AVX2_INTRINSICS
+    if (flags & AV_CPU_FLAG_AVX2) {
+        corr_float = mp_scaletempo_corr_float_avx2;
+        corr_s16 = mp_scaletempo_corr_s16_avx2;
+    }
+#endif
+}
+
 static int best_overlap_offset_float(af_scaletempo_t *s)
 {
     float best_corr = INT_MIN;
@@ -130,6 +157,19 @@ static int best_overlap_offset_float(af_scaletempo_t *s)
         *ppc++ = *pw++ **po++;
 
     float *search_start = (float *)s->buf_queue + s->num_channels;
+    if (corr_float) {
+        int n = s->samples_overlap - s->num_channels;
+        for (int off = 0; off < s->frames_search; off++) {
+            float corr = corr_float(s->buf_pre_corr, search_start, n);
+            if (corr > best_corr) {
+                best_corr = corr;
+                best_off  = off;
+            }
+            search_start += s->num_channels;
+        }
+        return best_off * 4 * s->num_channels;
+    }
+
     for (int off = 0; off < s->frames_search; off++) {
         float corr = 0;
         float *ps = search_start;
@@ -159,6 +199,19 @@ static int best_overlap_offset_s16(af_scaletempo_t *s)
         *ppc++ = (*pw++ **po++) >> 15;
 
     int16_t *search_start = (int16_t *)s->buf_queue + s->num_channels;
+    if (corr_s16) {
+        int n = s->samples_overlap - s->num_channels;
+        for (int off = 0; off < s->frames_search; off++) {
+            int64_t corr = corr_s16(s->buf_pre_corr, search_start, n);
+            if (corr > best_corr) {
+                best_corr = corr;
+                best_off  = off;
+            }
+            search_start += s->num_channels;
+        }
+        return best_off * 2 * s->num_channels;
+    }
+
     for (int off = 0; off < s->frames_search; off++) {
         int64_t corr = 0;
         int16_t *ps = search_start;
@@ -355,6 +408,7 @@ static int control(struct af_instance *af, int cmd, void *arg)
         }
 
         s->frames_search = (frames_overlap > 1) ? srate * s->ms_search : 0;
+        pthread_once(&corr_init_once, corr_init);
         if (s->frames_search <= 0)
             s->best_overlap_offset = NULL;
         else {
@@ -369,8 +423,9 @@ static int control(struct af_instance *af, int cmd, void *arg)
                     MP_FATAL(af, "Out of memory\n");
                     return AF_ERROR;
                 }
-                memset((char *)s->buf_pre_corr + s->bytes_overlap * 2, 0,
-                       UNROLL_PADDING);
+                // The unrolled C loop reads past the end of the data.
+                memset((char *)s->buf_pre_corr + s->bytes_overlap * 2 -
+                       nch * bps * 2, 0, nch * bps * 2 + UNROLL_PADDING);
                 int32_t *pw = s->table_window;
                 for (int i = 1; i < frames_overlap; i++) {
                     int32_t v = (i * (t - i) * n) >> 15;
@@ -0,0 +1,72 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "af_scaletempo_x86.h"
+
+float mp_scaletempo_corr_float_avx2(const float *a, const float *b, int n)
+{
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        s0 = _mm256_add_ps(s0, _mm256_mul_ps(_mm256_loadu_ps(a + i),
+                                             _mm256_loadu_ps(b + i)));
+        s1 = _mm256_add_ps(s1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8),
+                                             _mm256_loadu_ps(b + i + 8)));
+    }
+    s0 = _mm256_add_ps(s0, s1);
+    __m128 r = _mm_add_ps(_mm256_castps256_ps128(s0),
+                          _mm256_extractf128_ps(s0, 1));
+    r = _mm_add_ps(r, _mm_movehl_ps(r, r));
+    r = _mm_add_ss(r, _mm_shuffle_ps(r, r, 1));
+    float sum = _mm_cvtss_f32(r);
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+// Like the C code, the products are computed with 32 bit integers, and summed
+// with 64 bit integers.
+int64_t mp_scaletempo_corr_s16_avx2(const int32_t *a, const int16_t *b, int n)
+{
+    __m256i s0 = _mm256_setzero_si256(), s1 = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vb = _mm256_cvtepi16_epi32(
+                        _mm_loadu_si128((const __m128i *)(b + i)));
+        __m256i p = _mm256_mullo_epi32(va, vb);
+        s0 = _mm256_add_epi64(s0,
+                _mm256_cvtepi32_epi64(_mm256_castsi256_si128(p)));
+        s1 = _mm256_add_epi64(s1,
+                _mm256_cvtepi32_epi64(_mm256_extracti128_si256(p, 1)));
+    }
+    s0 = _mm256_add_epi64(s0, s1);
+    int64_t t[4];
+    _mm256_storeu_si256((__m256i *)t, s0);
+    int64_t sum = t[0] + t[1] + t[2] + t[3];
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+#pragma GCC pop_options
@@ -0,0 +1,34 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_AF_SCALETEMPO_X86_H_
+#define MP_AF_SCALETEMPO_X86_H_
+
+#include <stdint.h>
+
+// Vectorized versions of the cross correlation inner loops in
+// af_scaletempo.c. Each returns the dot product of the first n elements of a
+// and b. The s16 version produces exactly the same result as the C code; the
+// float versions sum in a different order. The caller must check the CPU
+// flags at runtime.
+
+float mp_scaletempo_corr_float_sse2(const float *a, const float *b, int n);
+float mp_scaletempo_corr_float_avx2(const float *a, const float *b, int n);
+
+int64_t mp_scaletempo_corr_s16_avx2(const int32_t *a, const int16_t *b, int n);
+
+#endif
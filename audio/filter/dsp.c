@@ -0,0 +1,107 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <libavutil/cpu.h>
+
+#include "config.h"
+#include "common/common.h"
+
+#include "af.h"
+#include "dsp.h"
+#include "dsp_x86.h"
+
+static void (*gain_s16)(int16_t *a, int n, int vol);
+static int gain_s16_max; // largest abs(vol) gain_s16 supports
+static void (*gain_float)(float *a, int n, float vol);
+static void (*matrix_float)(float *out, const float *in, int frames, int nchi,
+                            int ncho, const float *cols, int stride);
+
+static pthread_once_t dsp_init_once = PTHREAD_ONCE_INIT;
+
+static void dsp_init(void)
+{
+    int flags = av_get_cpu_flags();
+    (void)flags;
+#if HAVE_SSE2_INTRINSICS
+    if (flags & AV_CPU_FLAG_SSE2) {
+        gain_s16 = mp_dsp_gain_s16_sse2;
+        gain_s16_max = SHRT_MAX;
+        gain_float = mp_dsp_gain_float_sse2;
+        matrix_float = mp_dsp_matrix_float_sse2;
+    }
+#endif
+#if HAVE_AVX2_INTRINSICS
+    if (flags & AV_CPU_FLAG_AVX2) {
+        gain_s16 = mp_dsp_gain_s16_avx2;
+        gain_s16_max = INT_MAX;
+        gain_float = mp_dsp_gain_float_avx2;
+        matrix_float = mp_dsp_matrix_float_avx2;
+    }
+#endif
+}
+
+void mp_dsp_gain_s16(int16_t *a, int n, int vol)
+{
+    pthread_once(&dsp_init_once, dsp_init);
+    if (gain_s16 && vol >= -gain_s16_max && vol <= gain_s16_max) {
+        gain_s16(a, n, vol);
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        int x = (a[i] * vol) >> 8;
+        a[i] = MPCLAMP(x, SHRT_MIN, SHRT_MAX);
+    }
+}
+
+void mp_dsp_gain_float(float *a, int n, float vol)
+{
+    pthread_once(&dsp_init_once, dsp_init);
+    if (gain_float) {
+        gain_float(a, n, vol);
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        float x = a[i] * vol;
+        a[i] = MPCLAMP(x, -1.0f, 1.0f);
+    }
+}
+
+void mp_dsp_matrix_float(float *out, const float *in, int frames, int nchi,
+                         int ncho, const float *cols, int stride)
+{
+    pthread_once(&dsp_init_once, dsp_init);
+    if (matrix_float) {
+        matrix_float(out, in, frames, nchi, ncho, cols, stride);
+        return;
+    }
+    float tmp[AF_NCH];
+    for (int f = 0; f < frames; f++) {
+        for (int j = 0; j < ncho; j++) {
+            float x = 0.0f;
+            for (int k = 0; k < nchi; k++)
+                x += in[k] * cols[k * stride + j];
+            tmp[j] = x;
+        }
+        memcpy(out, tmp, ncho * sizeof(float));
+        out += ncho;
+        in += nchi;
+    }
+}
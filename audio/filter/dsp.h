@@ -0,0 +1,41 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_AF_DSP_H_
+#define MP_AF_DSP_H_
+
+#include <stdint.h>
+
+// Sample processing loops shared by the audio filters. These use SSE2/AVX2
+// code if the CPU supports it, and plain C otherwise. The results are the same
+// as those of the C code.
+
+// a[i] = clamp((a[i] * vol) >> 8) for the first n samples.
+void mp_dsp_gain_s16(int16_t *a, int n, int vol);
+
+// a[i] = clamp(a[i] * vol, -1.0, 1.0) for the first n samples.
+void mp_dsp_gain_float(float *a, int n, float vol);
+
+// Mix interleaved audio with nchi channels to ncho channels:
+//  out[f * ncho + j] = sum(k = 0..nchi-1) in[f * nchi + k] * cols[k * stride + j]
+// cols is the transposed mixing matrix. Each row must be readable (and should
+// be 0-padded) up to ncho rounded up to a multiple of 8, and stride must be at
+// least that. out may be equal to in if ncho <= nchi.
+void mp_dsp_matrix_float(float *out, const float *in, int frames, int nchi,
+                         int ncho, const float *cols, int stride);
+
+#endif
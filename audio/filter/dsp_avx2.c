@@ -0,0 +1,87 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "audio/chmap.h"
+#include "dsp_x86.h"
+
+void mp_dsp_gain_s16_avx2(int16_t *a, int n, int vol)
+{
+    // Full 32 bit products like the C code, so any vol works.
+    __m256i v = _mm256_set1_epi32(vol);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i x0 = _mm256_cvtepi16_epi32(
+                        _mm_loadu_si128((const __m128i *)(a + i)));
+        __m256i x1 = _mm256_cvtepi16_epi32(
+                        _mm_loadu_si128((const __m128i *)(a + i + 8)));
+        x0 = _mm256_srai_epi32(_mm256_mullo_epi32(x0, v), 8);
+        x1 = _mm256_srai_epi32(_mm256_mullo_epi32(x1, v), 8);
+        // packs works per 128 bit lane, so fix up the order of the quads.
+        __m256i r = _mm256_permute4x64_epi64(_mm256_packs_epi32(x0, x1),
+                                             _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i *)(a + i), r);
+    }
+    for (; i < n; i++) {
+        int x = (a[i] * vol) >> 8;
+        a[i] = x < INT16_MIN ? INT16_MIN : (x > INT16_MAX ? INT16_MAX : x);
+    }
+}
+
+void mp_dsp_gain_float_avx2(float *a, int n, float vol)
+{
+    __m256 v = _mm256_set1_ps(vol);
+    __m256 lo = _mm256_set1_ps(-1.0f), hi = _mm256_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = _mm256_mul_ps(_mm256_loadu_ps(a + i), v);
+        _mm256_storeu_ps(a + i, _mm256_min_ps(_mm256_max_ps(x, lo), hi));
+    }
+    for (; i < n; i++) {
+        float x = a[i] * vol;
+        a[i] = x > -1.0f ? (x < 1.0f ? x : 1.0f) : -1.0f;
+    }
+}
+
+void mp_dsp_matrix_float_avx2(float *out, const float *in, int frames, int nchi,
+                              int ncho, const float *cols, int stride)
+{
+    float tmp[MP_NUM_CHANNELS];
+    for (int f = 0; f < frames; f++) {
+        // 8 output channels at a time.
+        for (int j = 0; j < ncho; j += 8) {
+            __m256 acc = _mm256_setzero_ps();
+            for (int k = 0; k < nchi; k++) {
+                acc = _mm256_add_ps(acc,
+                        _mm256_mul_ps(_mm256_set1_ps(in[k]),
+                                      _mm256_loadu_ps(cols + k * stride + j)));
+            }
+            _mm256_storeu_ps(tmp + j, acc);
+        }
+        memcpy(out, tmp, ncho * sizeof(float));
+        out += ncho;
+        in += nchi;
+    }
+}
+
+#pragma GCC pop_options
@@ -0,0 +1,83 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+
+#include <stdint.h>
+#include <string.h>
+#include <emmintrin.h>
+
+#include "audio/chmap.h"
+#include "dsp_x86.h"
+
+void mp_dsp_gain_s16_sse2(int16_t *a, int n, int vol)
+{
+    // 16x16->32 bit products from the low and high halves, shifted and
+    // packed back with signed saturation (which does the clamping).
+    __m128i v = _mm_set1_epi16(vol);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i lo = _mm_mullo_epi16(x, v);
+        __m128i hi = _mm_mulhi_epi16(x, v);
+        __m128i p0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 8);
+        __m128i p1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 8);
+        _mm_storeu_si128((__m128i *)(a + i), _mm_packs_epi32(p0, p1));
+    }
+    for (; i < n; i++) {
+        int x = (a[i] * vol) >> 8;
+        a[i] = x < INT16_MIN ? INT16_MIN : (x > INT16_MAX ? INT16_MAX : x);
+    }
+}
+
+void mp_dsp_gain_float_sse2(float *a, int n, float vol)
+{
+    __m128 v = _mm_set1_ps(vol);
+    __m128 lo = _mm_set1_ps(-1.0f), hi = _mm_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_mul_ps(_mm_loadu_ps(a + i), v);
+        _mm_storeu_ps(a + i, _mm_min_ps(_mm_max_ps(x, lo), hi));
+    }
+    for (; i < n; i++) {
+        float x = a[i] * vol;
+        a[i] = x > -1.0f ? (x < 1.0f ? x : 1.0f) : -1.0f;
+    }
+}
+
+void mp_dsp_matrix_float_sse2(float *out, const float *in, int frames, int nchi,
+                              int ncho, const float *cols, int stride)
+{
+    float tmp[MP_NUM_CHANNELS];
+    for (int f = 0; f < frames; f++) {
+        // 4 output channels at a time.
+        for (int j = 0; j < ncho; j += 4) {
+            __m128 acc = _mm_setzero_ps();
+            for (int k = 0; k < nchi; k++) {
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(in[k]),
+                                        _mm_loadu_ps(cols + k * stride + j)));
+            }
+            _mm_storeu_ps(tmp + j, acc);
+        }
+        memcpy(out, tmp, ncho * sizeof(float));
+        out += ncho;
+        in += nchi;
+    }
+}
+
+#pragma GCC pop_options
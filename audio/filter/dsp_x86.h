@@ -0,0 +1,36 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_AF_DSP_X86_H_
+#define MP_AF_DSP_X86_H_
+
+#include <stdint.h>
+
+// Vectorized versions of the loops in dsp.c. The caller must check the CPU
+// flags at runtime. The sse2 gain_s16 variant requires vol to fit into int16_t.
+
+void mp_dsp_gain_s16_sse2(int16_t *a, int n, int vol);
+void mp_dsp_gain_float_sse2(float *a, int n, float vol);
+void mp_dsp_matrix_float_sse2(float *out, const float *in, int frames, int nchi,
+                              int ncho, const float *cols, int stride);
+
+void mp_dsp_gain_s16_avx2(int16_t *a, int n, int vol);
+void mp_dsp_gain_float_avx2(float *a, int n, float vol);
+void mp_dsp_matrix_float_avx2(float *out, const float *in, int frames, int nchi,
+                              int ncho, const float *cols, int stride);
+
+#endif
@@ -30,6 +30,7 @@
 #include "options/options.h"
 #include "options/m_config.h"
 #include "osdep/endian.h"
+#include "osdep/timer.h"
 #include "common/msg.h"
 #include "common/common.h"
 #include "common/global.h"
@@ -369,6 +370,37 @@ double ao_get_delay(struct ao *ao)
     return ao->api->get_delay(ao);
 }
 
+// Split ao_get_delay() into the AO's own buffer and the device, and return the
+// underrun history.
+void ao_get_latency_stats(struct ao *ao, struct ao_latency_stats *st)
+{
+    *st = (struct ao_latency_stats){0};
+    double delay = ao_get_delay(ao);
+    if (ao->api->get_buffered)
+        st->buffered = MPMIN(ao->api->get_buffered(ao), delay);
+    st->device = delay - st->buffered;
+
+    // Times can be overwritten concurrently; this only makes the history
+    // slightly inaccurate.
+    long long num = atomic_load(&ao->num_underruns);
+    st->underruns = num;
+    st->num_underrun_times = MPMIN(num, AO_UNDERRUN_HISTORY);
+    for (int n = 0; n < st->num_underrun_times; n++) {
+        st->underrun_times[n] =
+            atomic_load(&ao->underrun_times[(num - 1 - n) % AO_UNDERRUN_HISTORY]);
+    }
+}
+
+// Called by the push/pull code or the driver (from any thread) when the device
+// ran out of audio while playing. Call it once per underrun, not for every
+// chunk of silence played during it. Doesn't lock, so it can be called from
+// realtime audio callbacks.
+void ao_report_underrun(struct ao *ao)
+{
+    long long n = atomic_fetch_add(&ao->num_underruns, 1);
+    atomic_store(&ao->underrun_times[n % AO_UNDERRUN_HISTORY], mp_time_us());
+}
+
 // Return free size of the internal audio buffer. This controls how much audio
 // the core should decode and try to queue with ao_play().
 int ao_get_space(struct ao *ao)
@@ -39,6 +39,8 @@ enum aocontrol {
     AOCONTROL_HAS_SOFT_VOLUME,
     // like above, but volume persists (per app), mpv won't restore volume
     AOCONTROL_HAS_PER_APP_VOLUME,
+    // struct ao_device_stats*
+    AOCONTROL_GET_DEVICE_STATS,
 };
 
 // If set, then the queued audio data is the last. Note that after a while, new
@@ -67,6 +69,25 @@ typedef struct ao_control_vol {
     float right;
 } ao_control_vol_t;
 
+#define AO_UNDERRUN_HISTORY 16
+
+// See ao_get_latency_stats().
+struct ao_latency_stats {
+    double buffered;        // audio buffered by the AO itself, in seconds
+    double device;          // rest of ao_get_delay(), in seconds
+    int64_t underruns;      // number of underruns since the AO was created
+    // mp_time_us() of the most recent underruns, newest first
+    int64_t underrun_times[AO_UNDERRUN_HISTORY];
+    int num_underrun_times;
+};
+
+struct ao_device_stats {
+    int64_t underruns;      // number of device buffer underruns detected
+    double buffer_time;     // device buffer size in seconds
+    double period_time;     // device period size in seconds
+    double latency;         // last measured output latency in seconds, or 0
+};
+
 struct ao_device_desc {
     const char *name;   // symbolic name; will be set on ao->device
     const char *desc;   // verbose human readable name
@@ -96,6 +117,7 @@ bool ao_untimed(struct ao *ao);
 int ao_play(struct ao *ao, void **data, int samples, int flags);
 int ao_control(struct ao *ao, enum aocontrol cmd, void *arg);
 double ao_get_delay(struct ao *ao);
+void ao_get_latency_stats(struct ao *ao, struct ao_latency_stats *st);
 int ao_get_space(struct ao *ao);
 void ao_reset(struct ao *ao);
 void ao_pause(struct ao *ao);
@@ -60,6 +60,8 @@ struct ao_alsa_opts {
     int resample;
     int ni;
     int ignore_chmap;
+    int mmap;
+    int latency;
 };
 
 #define OPT_BASE_STRUCT struct ao_alsa_opts
@@ -71,6 +73,8 @@ static const struct m_sub_options ao_alsa_conf = {
         OPT_INTRANGE("alsa-mixer-index", mixer_index, 0, 0, 99),
         OPT_FLAG("alsa-non-interleaved", ni, 0),
         OPT_FLAG("alsa-ignore-chmap", ignore_chmap, 0),
+        OPT_FLAG("alsa-mmap", mmap, 0),
+        OPT_INTRANGE("alsa-latency", latency, 0, 0, 2000),
         {0}
     },
     .defaults = &(const struct ao_alsa_opts) {
@@ -92,6 +96,8 @@ struct priv {
     double delay_before_pause;
     snd_pcm_uframes_t buffersize;
     snd_pcm_uframes_t outburst;
+    bool mmap;              // write directly into the device buffer
+    int64_t underruns;
 
     snd_output_t *output;
 
@@ -102,6 +108,7 @@ struct priv {
 
 #define BUFFER_TIME 250000  // 250ms
 #define FRAGCOUNT 16
+#define LATENCY_FRAGCOUNT 4 // periods if --alsa-latency is set
 
 #define CHECK_ALSA_ERROR(message) \
     do { \
@@ -243,6 +250,15 @@ static int control(struct ao *ao, enum aocontrol cmd, void *arg)
         return CONTROL_OK;
     }
 
+    case AOCONTROL_GET_DEVICE_STATS: {
+        struct ao_device_stats *st = arg;
+        *st = (struct ao_device_stats){
+            .underruns = p->underruns,
+            .buffer_time = p->buffersize / (double)ao->samplerate,
+            .period_time = p->outburst / (double)ao->samplerate,
+        };
+        return CONTROL_OK;
+    }
     } //end switch
     return CONTROL_UNKNOWN;
 
@@ -700,16 +716,34 @@ static int init_device(struct ao *ao, int mode)
     }
     dump_hw_params(ao, MSGL_DEBUG, "HW params after rate:\n", alsa_hwparams);
 
-    snd_pcm_access_t access = af_fmt_is_planar(ao->format)
-                                    ? SND_PCM_ACCESS_RW_NONINTERLEAVED
-                                    : SND_PCM_ACCESS_RW_INTERLEAVED;
-    err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
-    if (err < 0 && af_fmt_is_planar(ao->format)) {
-        ao->format = af_fmt_from_planar(ao->format);
-        access = SND_PCM_ACCESS_RW_INTERLEAVED;
+    p->mmap = false;
+    if (p->opts->mmap) {
+        snd_pcm_access_t access = af_fmt_is_planar(ao->format)
+                                    ? SND_PCM_ACCESS_MMAP_NONINTERLEAVED
+                                    : SND_PCM_ACCESS_MMAP_INTERLEAVED;
+        err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
+        if (err < 0 && af_fmt_is_planar(ao->format)) {
+            access = SND_PCM_ACCESS_MMAP_INTERLEAVED;
+            err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
+            if (err >= 0)
+                ao->format = af_fmt_from_planar(ao->format);
+        }
+        p->mmap = err >= 0;
+        if (!p->mmap)
+            MP_VERBOSE(ao, "mmap access not supported, using read/write.\n");
+    }
+    if (!p->mmap) {
+        snd_pcm_access_t access = af_fmt_is_planar(ao->format)
+                                        ? SND_PCM_ACCESS_RW_NONINTERLEAVED
+                                        : SND_PCM_ACCESS_RW_INTERLEAVED;
         err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
+        if (err < 0 && af_fmt_is_planar(ao->format)) {
+            ao->format = af_fmt_from_planar(ao->format);
+            access = SND_PCM_ACCESS_RW_INTERLEAVED;
+            err = snd_pcm_hw_params_set_access(p->alsa, alsa_hwparams, access);
+        }
+        CHECK_ALSA_ERROR("Unable to set access type");
     }
-    CHECK_ALSA_ERROR("Unable to set access type");
     dump_hw_params(ao, MSGL_DEBUG, "HW params after access:\n", alsa_hwparams);
 
     bool found_format = false;
@@ -799,12 +833,19 @@ static int init_device(struct ao *ao, int mode)
     snd_pcm_hw_params_copy(hwparams_backup, alsa_hwparams);
 
     // Cargo-culted buffer settings; might still be useful for PulseAudio.
+    // With a latency target, use few periods, so that the device wakes us up
+    // often enough, but not for every few samples.
+    unsigned int buffer_time = BUFFER_TIME, periods = FRAGCOUNT;
+    if (p->opts->latency > 0) {
+        buffer_time = p->opts->latency * 1000;
+        periods = LATENCY_FRAGCOUNT;
+    }
     err = snd_pcm_hw_params_set_buffer_time_near
-            (p->alsa, alsa_hwparams, &(unsigned int){BUFFER_TIME}, NULL);
+            (p->alsa, alsa_hwparams, &buffer_time, NULL);
     CHECK_ALSA_WARN("Unable to set buffer time near");
     if (err >= 0) {
         err = snd_pcm_hw_params_set_periods_near
-                    (p->alsa, alsa_hwparams, &(unsigned int){FRAGCOUNT}, NULL);
+                    (p->alsa, alsa_hwparams, &periods, NULL);
         CHECK_ALSA_WARN("Unable to set periods");
     }
     if (err < 0)
@@ -873,6 +914,7 @@ static int init_device(struct ao *ao, int mode)
     MP_VERBOSE(ao, "hw pausing supported: %s\n", p->can_pause ? "yes" : "no");
     MP_VERBOSE(ao, "buffersize: %d samples\n", (int)p->buffersize);
     MP_VERBOSE(ao, "period size: %d samples\n", (int)p->outburst);
+    MP_VERBOSE(ao, "mmap access: %s\n", p->mmap ? "yes" : "no");
 
     ao->device_buffer = p->buffersize;
     ao->period_size = p->outburst;
@@ -978,6 +1020,7 @@ static double get_delay(struct ao *ao)
 
     if (delay < 0) {
         /* underrun - move the application pointer forward to catch up */
+        p->underruns++;
         snd_pcm_forward(p->alsa, -delay);
         delay = 0;
     }
@@ -1093,6 +1136,54 @@ static void reset(struct ao *ao)
 alsa_error: ;
 }
 
+// Copy the data directly into the device buffer. Returns the number of
+// samples written (may be less than requested), or an ALSA error code.
+static snd_pcm_sframes_t write_mmap(struct ao *ao, void **data, int samples)
+{
+    struct priv *p = ao->priv;
+    int num_ch = ao->channels.num;
+    bool planar = af_fmt_is_planar(ao->format);
+    int width = snd_pcm_format_physical_width(p->alsa_fmt);
+
+    snd_pcm_channel_area_t src[MP_NUM_CHANNELS];
+    for (int c = 0; c < num_ch; c++) {
+        src[c] = (snd_pcm_channel_area_t){
+            .addr = planar ? data[c] : data[0],
+            .first = planar ? 0 : c * width,
+            .step = planar ? width : num_ch * width,
+        };
+    }
+
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(p->alsa);
+    if (avail < 0)
+        return avail;
+    if (avail == 0) {
+        // Normally doesn't happen, because the caller respects get_space().
+        int err = snd_pcm_wait(p->alsa, 100);
+        return err < 0 ? err : 0;
+    }
+
+    snd_pcm_sframes_t written = 0;
+    while (written < samples) {
+        const snd_pcm_channel_area_t *areas;
+        snd_pcm_uframes_t offset, frames = samples - written;
+        int err = snd_pcm_mmap_begin(p->alsa, &areas, &offset, &frames);
+        if (err < 0)
+            return err;
+        if (!frames)
+            break;
+        snd_pcm_areas_copy(areas, offset, src, written, num_ch, frames,
+                           p->alsa_fmt);
+        snd_pcm_sframes_t res = snd_pcm_mmap_commit(p->alsa, offset, frames);
+        if (res < 0)
+            return res;
+        written += res;
+        if (res != (snd_pcm_sframes_t)frames)
+            break;
+    }
+    return written;
+}
+
 static int play(struct ao *ao, void **data, int samples, int flags)
 {
     struct priv *p = ao->priv;
@@ -1106,7 +1197,9 @@ static int play(struct ao *ao, void **data, int samples, int flags)
     do {
         ao_convert_inplace(&p->convert, data, samples);
 
-        if (af_fmt_is_planar(ao->format)) {
+        if (p->mmap) {
+            res = write_mmap(ao, data, samples);
+        } else if (af_fmt_is_planar(ao->format)) {
             res = snd_pcm_writen(p->alsa, data, samples);
         } else {
             res = snd_pcm_writei(p->alsa, data[0], samples);
@@ -1119,6 +1212,9 @@ static int play(struct ao *ao, void **data, int samples, int flags)
         } else if (res < 0) {
             if (res == -ESTRPIPE) {  /* suspend */
                 resume_device(ao);
+            } else if (res == -EPIPE) {
+                p->underruns++;
+                MP_WARN(ao, "Device underrun.\n");
             } else {
                 MP_ERR(ao, "Write error: %s\n", snd_strerror(res));
             }
@@ -22,6 +22,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <limits.h>
 
@@ -39,9 +40,13 @@
 
 #include "common/encode_lavc.h"
 
+// Number of frames queued for the encoder thread
+#define ENCODE_QUEUE_SIZE 16
+
 struct priv {
     AVStream *stream;
     AVCodecContext *codec;
+    struct encode_thread *encoder;
     int pcmhack;
     int aframesize;
     int aframecount;
@@ -58,6 +63,8 @@ struct priv {
     bool shutdown;
 };
 
+static void write_packet(void *priv, AVFrame *frame, AVPacket *packet);
+
 static bool supports_format(AVCodec *codec, int format)
 {
     for (const enum AVSampleFormat *sampleformat = codec->sample_fmts;
@@ -165,6 +172,11 @@ static int init(struct ao *ao)
     if (ao->channels.num > AV_NUM_DATA_POINTERS)
         goto fail;
 
+    ac->encoder = encode_thread_create(ao->encode_lavc_ctx, ac->codec, ao->log,
+                                       ENCODE_QUEUE_SIZE, write_packet, ao);
+    if (!ac->encoder)
+        goto fail;
+
     pthread_mutex_unlock(&ao->encode_lavc_ctx->lock);
     return 0;
 
@@ -188,11 +200,7 @@ static void uninit(struct ao *ao)
 
     if (!encode_lavc_start(ectx)) {
         MP_WARN(ao, "not even ready to encode audio at end -> dropped\n");
-        pthread_mutex_unlock(&ectx->lock);
-        return;
-    }
-
-    if (ac->stream) {
+    } else if (ac->stream) {
         double outpts = ac->expected_next_pts;
         if (!ectx->options->rawts && ectx->options->copyts)
             outpts += ectx->discontinuity_pts_offset;
@@ -202,6 +210,9 @@ static void uninit(struct ao *ao)
 
     pthread_mutex_unlock(&ectx->lock);
 
+    encode_thread_destroy(ac->encoder);
+    ac->encoder = NULL;
+
     ac->shutdown = true;
 }
 
@@ -213,11 +224,16 @@ static int get_space(struct ao *ao)
     return ac->aframesize * ac->framecount;
 }
 
-static void write_packet(struct ao *ao, AVPacket *packet)
+// Called on the encoder thread, with the encode_lavc_context lock held.
+static void write_packet(void *priv, AVFrame *frame, AVPacket *packet)
 {
     // TODO: Can we unify this with the equivalent video code path?
+    struct ao *ao = priv;
     struct priv *ac = ao->priv;
 
+    if (frame && ac->savepts == AV_NOPTS_VALUE)
+        ac->savepts = frame->pts;
+
     packet->stream_index = ac->stream->index;
     if (packet->pts != AV_NOPTS_VALUE) {
         packet->pts = av_rescale_q(packet->pts,
@@ -255,52 +271,6 @@ static void write_packet(struct ao *ao, AVPacket *packet)
     }
 }
 
-static void encode_audio_and_write(struct ao *ao, AVFrame *frame)
-{
-    // TODO: Can we unify this with the equivalent video code path?
-    struct priv *ac = ao->priv;
-    AVPacket packet = {0};
-
-    int status = avcodec_send_frame(ac->codec, frame);
-    if (status < 0) {
-        MP_ERR(ao, "error encoding at %d %d/%d\n",
-               frame ? (int) frame->pts : -1,
-               ac->codec->time_base.num,
-               ac->codec->time_base.den);
-        return;
-    }
-    for (;;) {
-        av_init_packet(&packet);
-        status = avcodec_receive_packet(ac->codec, &packet);
-        if (status == AVERROR(EAGAIN)) { // No more packets for now.
-            if (frame == NULL) {
-                MP_ERR(ao, "sent flush frame, got EAGAIN");
-            }
-            break;
-        }
-        if (status == AVERROR_EOF) { // No more packets, ever.
-            if (frame != NULL) {
-                MP_ERR(ao, "sent audio frame, got EOF");
-            }
-            break;
-        }
-        if (status < 0) {
-            MP_ERR(ao, "error encoding at %d %d/%d\n",
-                   frame ? (int) frame->pts : -1,
-                   ac->codec->time_base.num,
-                   ac->codec->time_base.den);
-            break;
-        }
-        if (frame) {
-            if (ac->savepts == AV_NOPTS_VALUE)
-                ac->savepts = frame->pts;
-        }
-        encode_lavc_write_stats(ao->encode_lavc_ctx, ac->codec);
-        write_packet(ao, &packet);
-        av_packet_unref(&packet);
-    }
-}
-
 // must get exactly ac->aframesize amount of data
 static void encode(struct ao *ao, double apts, void **data)
 {
@@ -316,15 +286,22 @@ static void encode(struct ao *ao, double apts, void **data)
 
     if(data) {
         AVFrame *frame = av_frame_alloc();
+        if (!frame)
+            abort();
         frame->format = af_to_avformat(ao->format);
         frame->nb_samples = ac->aframesize;
+        frame->channels = ao->channels.num;
+        frame->channel_layout = ac->codec->channel_layout;
+        // The frame is encoded asynchronously, so copy the samples.
+        if (av_frame_get_buffer(frame, 0) < 0)
+            abort();
 
         size_t num_planes = af_fmt_is_planar(ao->format) ? ao->channels.num : 1;
         assert(num_planes <= AV_NUM_DATA_POINTERS);
-        for (int n = 0; n < num_planes; n++)
-            frame->extended_data[n] = data[n];
-
-        frame->linesize[0] = frame->nb_samples * ao->sstride;
+        for (int n = 0; n < num_planes; n++) {
+            memcpy(frame->extended_data[n], data[n],
+                   frame->nb_samples * ao->sstride);
+        }
 
         if (ectx->options->rawts || ectx->options->copyts) {
             // real audio pts
@@ -346,11 +323,10 @@ static void encode(struct ao *ao, double apts, void **data)
         ac->lastpts = frame_pts;
 
         frame->quality = ac->codec->global_quality;
-        encode_audio_and_write(ao, frame);
-        av_frame_free(&frame);
+        encode_thread_submit(ac->encoder, frame);
     }
     else
-        encode_audio_and_write(ao, NULL);
+        encode_thread_submit(ac->encoder, NULL);
 }
 
 // this should round samples down to frame sizes
@@ -116,11 +116,15 @@ static bool thread_feed(struct ao *ao)
     MP_TRACE(ao, "Frame to fill: %"PRIu32". Padding: %"PRIu32"\n",
              frame_count, padding);
 
+    if (!padding && atomic_load(&state->sample_count) > 0)
+        state->underruns++;
+
     double delay_us;
     hr = get_device_delay(state, &delay_us);
     EXIT_ON_ERROR(hr);
     // add the buffer delay
     delay_us += frame_count * 1e6 / state->format.Format.nSamplesPerSec;
+    state->last_delay = delay_us / 1e6;
 
     BYTE *pData;
     hr = IAudioRenderClient_GetBuffer(state->pRenderClient,
@@ -430,6 +434,17 @@ static int thread_control(struct ao *ao, enum aocontrol cmd, void *arg)
         SAFE_DESTROY(tmp, CoTaskMemFree(tmp));
         talloc_free(title);
         return CONTROL_OK;
+    case AOCONTROL_GET_DEVICE_STATS: {
+        struct ao_device_stats *st = arg;
+        *st = (struct ao_device_stats){
+            .underruns = state->underruns,
+            .buffer_time = state->bufferFrameCount /
+                           (double)state->format.Format.nSamplesPerSec,
+            .period_time = state->devicePeriod / 1e7,
+            .latency = state->last_delay,
+        };
+        return CONTROL_OK;
+    }
     }
 
     return state->share_mode == AUDCLNT_SHAREMODE_EXCLUSIVE ?
@@ -502,4 +517,9 @@ const struct ao_driver audio_out_wasapi = {
     .hotplug_init   = hotplug_init,
     .hotplug_uninit = hotplug_uninit,
     .priv_size      = sizeof(wasapi_state),
+    .options = (const struct m_option[]){
+        OPT_FLAG("low-latency", opt_low_latency, 0),
+        {0}
+    },
+    .options_prefix = "wasapi",
 };
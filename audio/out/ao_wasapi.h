@@ -87,14 +87,20 @@ typedef struct wasapi_state {
 
     // ao options
     int opt_exclusive;
+    int opt_low_latency;
 
     // format info
     WAVEFORMATEXTENSIBLE format;
     AUDCLNT_SHAREMODE share_mode; // AUDCLNT_SHAREMODE_EXCLUSIVE / SHARED
     UINT32 bufferFrameCount;      // number of frames in buffer
+    REFERENCE_TIME devicePeriod;  // period the client was initialized with
     struct ao_convert_fmt convert_format;
 
     change_notify change;
+
+    // for AOCONTROL_GET_DEVICE_STATS (accessed by the audio thread only)
+    int64_t underruns; // device buffer ran empty while playing
+    double last_delay; // device delay measured at the last feed, in seconds
 } wasapi_state;
 
 char *mp_PKEY_to_str_buf(char *buf, size_t buf_size, const PROPERTYKEY *pkey);
@@ -583,16 +583,24 @@ static HRESULT fix_format(struct ao *ao, bool align_hack)
     struct wasapi_state *state = ao->priv;
 
     MP_DBG(state, "IAudioClient::GetDevicePeriod\n");
-    REFERENCE_TIME devicePeriod;
+    REFERENCE_TIME devicePeriod, minimumPeriod;
     HRESULT hr = IAudioClient_GetDevicePeriod(state->pAudioClient,&devicePeriod,
-                                              NULL);
-    MP_VERBOSE(state, "Device period: %.2g ms\n",
-               (double) devicePeriod / 10000.0 );
+                                              &minimumPeriod);
+    MP_VERBOSE(state, "Device period: %.2g ms (minimum: %.2g ms)\n",
+               (double) devicePeriod / 10000.0,
+               (double) minimumPeriod / 10000.0);
+
+    // exclusive mode can run at the minimum period the device supports
+    if (state->opt_low_latency &&
+        state->share_mode == AUDCLNT_SHAREMODE_EXCLUSIVE && minimumPeriod > 0)
+        devicePeriod = minimumPeriod;
 
     REFERENCE_TIME bufferDuration = devicePeriod;
     if (state->share_mode == AUDCLNT_SHAREMODE_SHARED) {
         // for shared mode, use integer multiple of device period close to 50ms
-        bufferDuration = devicePeriod * ceil(50.0 * 10000.0 / devicePeriod);
+        // (or just 2 periods for low latency)
+        bufferDuration = state->opt_low_latency ? 2 * devicePeriod :
+                         devicePeriod * ceil(50.0 * 10000.0 / devicePeriod);
     }
 
     // handle unsupported buffer size if AUDCLNT_E_BUFFER_SIZE_NOT_ALIGNED was
@@ -607,6 +615,7 @@ static HRESULT fix_format(struct ao *ao, bool align_hack)
 
     REFERENCE_TIME bufferPeriod =
         state->share_mode == AUDCLNT_SHAREMODE_EXCLUSIVE ? bufferDuration : 0;
+    state->devicePeriod = bufferPeriod ? bufferPeriod : devicePeriod;
 
     MP_DBG(state, "IAudioClient::Initialize\n");
     hr = IAudioClient_Initialize(state->pAudioClient,
@@ -640,6 +649,15 @@ static HRESULT fix_format(struct ao *ao, bool align_hack)
     MP_VERBOSE(state, "Buffer frame count: %"PRIu32" (%.2g ms)\n",
                state->bufferFrameCount, (double) bufferDuration / 10000.0 );
 
+    if (state->opt_low_latency) {
+        // The soft buffer in front of the device would otherwise add
+        // --audio-buffer (200 ms by default) of latency. Keep it to a few
+        // device buffers.
+        double device_secs = bufferDuration / 1e7;
+        ao->def_buffer = MPMIN(ao->def_buffer, MPMAX(4 * device_secs, 0.02));
+        MP_VERBOSE(state, "Soft buffer: %.2g ms\n", ao->def_buffer * 1000);
+    }
+
     hr = init_clock(state);
     EXIT_ON_ERROR(hr);
 
@@ -651,6 +669,10 @@ static HRESULT fix_format(struct ao *ao, bool align_hack)
     if (!state->hTask) {
         MP_WARN(state, "Failed to set AV thread to Pro Audio: %s\n",
                 mp_LastError_to_str());
+    } else if (state->opt_low_latency &&
+               !AvSetMmThreadPriority(state->hTask, AVRT_PRIORITY_HIGH)) {
+        MP_WARN(state, "Failed to raise AV thread priority: %s\n",
+                mp_LastError_to_str());
     }
 #endif
 
@@ -64,6 +64,10 @@ struct ao {
     // Application name to report to the audio API.
     char *client_name;
 
+    // See ao_report_underrun().
+    atomic_llong num_underruns;
+    atomic_llong underrun_times[AO_UNDERRUN_HISTORY];
+
     // Used during init: if init fails, redirect to this ao
     char *redirect;
 
@@ -148,6 +152,9 @@ struct ao_driver {
     int (*play)(struct ao *ao, void **data, int samples, int flags);
     // push based: see ao_get_delay()
     double (*get_delay)(struct ao *ao);
+    // Return the part of get_delay() which is buffered by the AO code itself,
+    // and not by the device. Implemented by push.c/pull.c, not by drivers.
+    double (*get_buffered)(struct ao *ao);
     // push based: block until all queued audio is played (optional)
     void (*drain)(struct ao *ao);
     // Optional. Return true if audio has stopped in any way.
@@ -200,6 +207,8 @@ int ao_wait_poll(struct ao *ao, struct pollfd *fds, int num_fds,
                  pthread_mutex_t *lock);
 void ao_wakeup_poll(struct ao *ao);
 
+void ao_report_underrun(struct ao *ao);
+
 bool ao_chmap_sel_adjust(struct ao *ao, const struct mp_chmap_sel *s,
                          struct mp_chmap *map);
 bool ao_chmap_sel_adjust2(struct ao *ao, const struct mp_chmap_sel *s,
@@ -65,6 +65,10 @@ struct ao_pull_state {
     // Device delay of the last written sample, in realtime.
     atomic_llong end_time_us;
 
+    // Only accessed by the audio thread: reported an underrun which didn't
+    // end yet.
+    bool underrun;
+
     char *convert_buffer;
 };
 
@@ -156,6 +160,11 @@ int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
     if (buffered_bytes < bytes && !atomic_load(&p->draining))
         atomic_fetch_add(&p->underflow, (bytes - buffered_bytes) / ao->sstride);
 
+    bool underrun = buffered_bytes < full_bytes && !atomic_load(&p->draining);
+    if (underrun && !p->underrun)
+        ao_report_underrun(ao);
+    p->underrun = underrun;
+
     if (bytes > 0)
         atomic_store(&p->end_time_us, out_time_us);
 
@@ -204,6 +213,14 @@ int ao_read_data_converted(struct ao *ao, struct ao_convert_fmt *fmt,
     int src_plane_size = plane_samples * af_fmt_to_bytes(fmt->src_fmt);
     int dst_plane_size = plane_samples * fmt->dst_bits / 8;
 
+    // If the sample size doesn't change (e.g. MSB padding), convert directly
+    // in the destination buffer.
+    if (src_plane_size == dst_plane_size) {
+        int res = ao_read_data(ao, data, samples, out_time_us);
+        ao_convert_inplace(fmt, data, samples);
+        return res;
+    }
+
     int needed = src_plane_size * planes;
     if (needed > talloc_get_size(p->convert_buffer) || !p->convert_buffer) {
         talloc_free(p->convert_buffer);
@@ -244,6 +261,12 @@ static double get_delay(struct ao *ao)
     return mp_ring_buffered(p->buffers[0]) / (double)ao->bps + driver_delay;
 }
 
+static double get_buffered(struct ao *ao)
+{
+    struct ao_pull_state *p = ao->api_priv;
+    return mp_ring_buffered(p->buffers[0]) / (double)ao->bps;
+}
+
 static void reset(struct ao *ao)
 {
     struct ao_pull_state *p = ao->api_priv;
@@ -328,6 +351,7 @@ const struct ao_driver ao_api_pull = {
     .get_space = get_space,
     .play = play,
     .get_delay = get_delay,
+    .get_buffered = get_buffered,
     .get_eof = get_eof,
     .pause = pause,
     .resume = resume,
@@ -34,6 +34,7 @@
 #include "input/input.h"
 
 #include "osdep/threads.h"
+#include "misc/thread_sched.h"
 #include "osdep/timer.h"
 #include "osdep/atomic.h"
 
@@ -56,6 +57,7 @@ struct ao_push_state {
     bool still_playing;
     bool need_wakeup;
     bool paused;
+    bool underrun;      // reported an underrun which didn't end yet
 
     // Whether the current buffer contains the complete audio.
     bool final_chunk;
@@ -95,6 +97,15 @@ static double unlocked_get_delay(struct ao *ao)
     return driver_delay + mp_audio_buffer_seconds(p->buffer);
 }
 
+static double get_buffered(struct ao *ao)
+{
+    struct ao_push_state *p = ao->api_priv;
+    pthread_mutex_lock(&p->lock);
+    double buffered = mp_audio_buffer_seconds(p->buffer);
+    pthread_mutex_unlock(&p->lock);
+    return buffered;
+}
+
 static double get_delay(struct ao *ao)
 {
     struct ao_push_state *p = ao->api_priv;
@@ -297,6 +308,16 @@ static void ao_play_data(struct ao *ao)
     int max = samples;
     if (samples > space)
         samples = space;
+    // The device buffer is empty, and there is nothing to write.
+    if (!play_silence && p->still_playing && !p->final_chunk && !max &&
+        space >= ao->device_buffer)
+    {
+        if (!p->underrun)
+            ao_report_underrun(ao);
+        p->underrun = true;
+    }
+    if (max)
+        p->underrun = false;
     int flags = 0;
     if (p->final_chunk && samples == max) {
         flags |= AOPLAY_FINAL_CHUNK;
@@ -354,6 +375,7 @@ static void *playthread(void *arg)
     struct ao *ao = arg;
     struct ao_push_state *p = ao->api_priv;
     mpthread_set_name("ao");
+    mp_thread_set_role(ao->global, ao->log, MP_THREAD_ROLE_AUDIO);
     pthread_mutex_lock(&p->lock);
     while (!p->terminate) {
         bool playing = !p->paused || ao->stream_silence;
@@ -481,6 +503,7 @@ const struct ao_driver ao_api_push = {
     .get_space = get_space,
     .play = play,
     .get_delay = get_delay,
+    .get_buffered = get_buffered,
     .pause = audio_pause,
     .resume = resume,
     .drain = drain,
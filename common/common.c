@@ -27,6 +27,16 @@
 #include "common/common.h"
 #include "osdep/strnlen.h"
 
+const char *const mp_mem_account_names[MP_MEM_ACCOUNT_COUNT] = {
+    [MP_MEM_OTHER]      = "other",
+    [MP_MEM_STREAM]     = "stream",
+    [MP_MEM_DEMUX]      = "demux",
+    [MP_MEM_DECODER]    = "decoder",
+    [MP_MEM_VO]         = "vo",
+    [MP_MEM_OSD]        = "osd",
+    [MP_MEM_CLIENT]     = "client",
+};
+
 #define appendf(ptr, ...) \
     do {(*(ptr)) = talloc_asprintf_append_buffer(*(ptr), __VA_ARGS__);} while(0)
 
@@ -58,6 +58,21 @@ enum stream_type {
     STREAM_TYPE_COUNT,
 };
 
+// Memory accounts (see ta_set_account()), reported by the memory-usage
+// property. MP_MEM_OTHER is for allocations not attributed to a subsystem.
+enum mp_mem_account {
+    MP_MEM_OTHER,
+    MP_MEM_STREAM,
+    MP_MEM_DEMUX,
+    MP_MEM_DECODER,
+    MP_MEM_VO,
+    MP_MEM_OSD,
+    MP_MEM_CLIENT,
+    MP_MEM_ACCOUNT_COUNT,
+};
+
+extern const char *const mp_mem_account_names[MP_MEM_ACCOUNT_COUNT];
+
 enum {
     DATA_OK     = 1,        // data is actually being returned
     DATA_WAIT   = 0,        // async wait: check state again after next wakeup
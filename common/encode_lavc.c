@@ -29,6 +29,7 @@
 #include "common/msg_control.h"
 #include "options/m_option.h"
 #include "options/options.h"
+#include "osdep/threads.h"
 #include "osdep/timer.h"
 #include "video/out/vo.h"
 #include "mpv_talloc.h"
@@ -1201,4 +1202,143 @@ enum mp_csp_levels encode_lavc_get_csp_levels(struct encode_lavc_context *ctx,
     return avcol_range_to_mp_csp_levels(codec->color_range);
 }
 
+struct encode_thread {
+    struct encode_lavc_context *ctx;
+    AVCodecContext *codec;
+    struct mp_log *log;
+    encode_thread_write_fn write_packet;
+    void *priv;
+
+    pthread_t thread;
+    pthread_cond_t wakeup;  // used with ctx->lock, which guards the fields below
+
+    AVFrame **queue;        // NULL entries are flush requests
+    int num_queue;
+    int max_queue;
+    bool busy;              // a frame is being encoded
+    bool terminate;
+};
+
+static void encode_thread_encode(struct encode_thread *t, AVFrame *frame)
+{
+    AVCodecContext *codec = t->codec;
+    AVPacket packet = {0};
+
+    int status = avcodec_send_frame(codec, frame);
+    if (status < 0) {
+        mp_err(t->log, "error encoding at %d %d/%d\n",
+               frame ? (int) frame->pts : -1,
+               codec->time_base.num, codec->time_base.den);
+        return;
+    }
+    for (;;) {
+        av_init_packet(&packet);
+        status = avcodec_receive_packet(codec, &packet);
+        if (status == AVERROR(EAGAIN)) { // No more packets for now.
+            if (frame == NULL)
+                mp_err(t->log, "sent flush frame, got EAGAIN\n");
+            break;
+        }
+        if (status == AVERROR_EOF) { // No more packets, ever.
+            if (frame != NULL)
+                mp_err(t->log, "sent frame, got EOF\n");
+            break;
+        }
+        if (status < 0) {
+            mp_err(t->log, "error encoding at %d %d/%d\n",
+                   frame ? (int) frame->pts : -1,
+                   codec->time_base.num, codec->time_base.den);
+            break;
+        }
+        pthread_mutex_lock(&t->ctx->lock);
+        encode_lavc_write_stats(t->ctx, codec);
+        t->write_packet(t->priv, frame, &packet);
+        pthread_mutex_unlock(&t->ctx->lock);
+        av_packet_unref(&packet);
+    }
+}
+
+static void *encode_thread_run(void *arg)
+{
+    struct encode_thread *t = arg;
+    mpthread_set_name(t->codec->codec_type == AVMEDIA_TYPE_VIDEO ?
+                      "vencode" : "aencode");
+
+    pthread_mutex_lock(&t->ctx->lock);
+    while (1) {
+        if (t->num_queue) {
+            AVFrame *frame = t->queue[0];
+            MP_TARRAY_REMOVE_AT(t->queue, t->num_queue, 0);
+            t->busy = true;
+            pthread_cond_broadcast(&t->wakeup);
+            pthread_mutex_unlock(&t->ctx->lock);
+
+            encode_thread_encode(t, frame);
+            av_frame_free(&frame);
+
+            pthread_mutex_lock(&t->ctx->lock);
+            t->busy = false;
+            pthread_cond_broadcast(&t->wakeup);
+            continue;
+        }
+        if (t->terminate)
+            break;
+        pthread_cond_wait(&t->wakeup, &t->ctx->lock);
+    }
+    pthread_mutex_unlock(&t->ctx->lock);
+    return NULL;
+}
+
+struct encode_thread *encode_thread_create(struct encode_lavc_context *ctx,
+                                           AVCodecContext *codec,
+                                           struct mp_log *log, int queue_size,
+                                           encode_thread_write_fn write_packet,
+                                           void *priv)
+{
+    struct encode_thread *t = talloc_ptrtype(NULL, t);
+    *t = (struct encode_thread){
+        .ctx = ctx,
+        .codec = codec,
+        .log = log,
+        .write_packet = write_packet,
+        .priv = priv,
+        .max_queue = MPMAX(queue_size, 1),
+    };
+    pthread_cond_init(&t->wakeup, NULL);
+    if (pthread_create(&t->thread, NULL, encode_thread_run, t)) {
+        pthread_cond_destroy(&t->wakeup);
+        talloc_free(t);
+        return NULL;
+    }
+    return t;
+}
+
+void encode_thread_submit(struct encode_thread *t, AVFrame *frame)
+{
+    while (t->num_queue >= t->max_queue)
+        pthread_cond_wait(&t->wakeup, &t->ctx->lock);
+    MP_TARRAY_APPEND(t, t->queue, t->num_queue, frame);
+    pthread_cond_broadcast(&t->wakeup);
+
+    if (!frame) {
+        while (t->num_queue || t->busy)
+            pthread_cond_wait(&t->wakeup, &t->ctx->lock);
+    }
+}
+
+void encode_thread_destroy(struct encode_thread *t)
+{
+    if (!t)
+        return;
+    pthread_mutex_lock(&t->ctx->lock);
+    t->terminate = true;
+    pthread_cond_broadcast(&t->wakeup);
+    pthread_mutex_unlock(&t->ctx->lock);
+    pthread_join(t->thread, NULL);
+    for (int n = 0; n < t->num_queue; n++)
+        av_frame_free(&t->queue[n]);
+    pthread_cond_destroy(&t->wakeup);
+    talloc_free(t);
+}
+
 // vim: ts=4 sw=4 et
@@ -122,4 +122,29 @@ enum mp_csp encode_lavc_get_csp(struct encode_lavc_context *ctx,
 enum mp_csp_levels encode_lavc_get_csp_levels(struct encode_lavc_context *ctx,
                                               AVCodecContext *codec);
 
+// Runs avcodec_send_frame()/avcodec_receive_packet() for an opened codec on
+// a separate thread, so the caller doesn't wait for the encoder.
+struct encode_thread;
+
+// Called on the encoder thread with the encode_lavc_context lock held, for
+// each packet the codec returns. frame is the frame that was sent before the
+// packet was received (NULL when flushing).
+typedef void (*encode_thread_write_fn)(void *priv, AVFrame *frame,
+                                       AVPacket *packet);
+
+// At most queue_size frames are queued before encode_thread_submit() blocks.
+struct encode_thread *encode_thread_create(struct encode_lavc_context *ctx,
+                                           AVCodecContext *codec,
+                                           struct mp_log *log, int queue_size,
+                                           encode_thread_write_fn write_packet,
+                                           void *priv);
+// Queue a frame for encoding, and take ownership of it. The frame must not
+// reference external memory. If frame is NULL, flush the codec, and wait until
+// all packets were written. Must be called with the context lock held, which
+// is temporarily released while waiting.
+void encode_thread_submit(struct encode_thread *t, AVFrame *frame);
+// Stop the thread. Frames that were not encoded yet are dropped (submit a
+// NULL frame first to encode them). Must be called without the lock held.
+void encode_thread_destroy(struct encode_thread *t);
+
 #endif
@@ -0,0 +1,184 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+
+#include <libavutil/cpu.h>
+#include <libavfilter/avfilter.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/thread_pool.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
+
+#include "lavfi_threads.h"
+
+struct lavfi_threads_opts {
+    int threads;
+};
+
+#define OPT_BASE_STRUCT struct lavfi_threads_opts
+const struct m_sub_options lavfi_threads_conf = {
+    .opts = (const struct m_option[]){
+        OPT_CHOICE_OR_INT("lavfi-threads", threads, 0, 1, 64,
+                          ({"auto", 0})),
+        {0}
+    },
+    .size = sizeof(struct lavfi_threads_opts),
+};
+
+struct mp_lavfi_threads {
+    int threads;
+    struct mp_thread_pool *pool;
+};
+
+// State of a single execute() call. Helpers which get to run only after the
+// caller has returned still reference it, so it's freed by the last user.
+struct exec_ctx {
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int refs;
+    int next_job;
+    int jobs_done;
+    int nb_jobs;
+    AVFilterContext *filter;
+    avfilter_action_func *func;
+    void *arg;
+    int *ret;
+};
+
+static void exec_unref(struct exec_ctx *e)
+{
+    pthread_mutex_lock(&e->lock);
+    bool last = --e->refs == 0;
+    pthread_mutex_unlock(&e->lock);
+    if (last) {
+        pthread_cond_destroy(&e->wakeup);
+        pthread_mutex_destroy(&e->lock);
+        talloc_free(e);
+    }
+}
+
+static void exec_run(struct exec_ctx *e)
+{
+    pthread_mutex_lock(&e->lock);
+    while (e->next_job < e->nb_jobs) {
+        int job = e->next_job++;
+        pthread_mutex_unlock(&e->lock);
+        int r = e->func(e->filter, e->arg, job, e->nb_jobs);
+        if (e->ret)
+            e->ret[job] = r;
+        pthread_mutex_lock(&e->lock);
+        if (++e->jobs_done == e->nb_jobs)
+            pthread_cond_broadcast(&e->wakeup);
+    }
+    pthread_mutex_unlock(&e->lock);
+}
+
+static void exec_helper(void *ctx)
+{
+    struct exec_ctx *e = ctx;
+    exec_run(e);
+    exec_unref(e);
+}
+
+// AVFilterGraph.execute; the calling filter thread always works on jobs too,
+// so progress doesn't depend on pool threads being free.
+static int execute(AVFilterContext *filter, avfilter_action_func *func,
+                   void *arg, int *ret, int nb_jobs)
+{
+    struct mp_lavfi_threads *t = filter->graph->opaque;
+    int helpers = MPMIN(nb_jobs, t->threads) - 1;
+
+    if (helpers < 1) {
+        for (int n = 0; n < nb_jobs; n++) {
+            int r = func(filter, arg, n, nb_jobs);
+            if (ret)
+                ret[n] = r;
+        }
+        return 0;
+    }
+
+    struct exec_ctx *e = talloc_ptrtype(NULL, e);
+    *e = (struct exec_ctx){
+        .refs = 1 + helpers,
+        .nb_jobs = nb_jobs,
+        .filter = filter,
+        .func = func,
+        .arg = arg,
+        .ret = ret,
+    };
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->wakeup, NULL);
+
+    for (int n = 0; n < helpers; n++) {
+        mp_thread_pool_queue_job(t->pool, &(struct mp_thread_pool_job){
+            .fn = exec_helper,
+            .fn_ctx = e,
+            .prio = MP_THREAD_POOL_PRIO_HIGH,
+        });
+    }
+
+    exec_run(e);
+
+    pthread_mutex_lock(&e->lock);
+    while (e->jobs_done < e->nb_jobs)
+        pthread_cond_wait(&e->wakeup, &e->lock);
+    pthread_mutex_unlock(&e->lock);
+
+    exec_unref(e);
+    return 0;
+}
+
+struct mp_lavfi_threads *mp_lavfi_threads_create(void *ta_parent,
+                                                 struct mpv_global *global,
+                                                 struct mp_log *log)
+{
+    struct mp_lavfi_threads *t = talloc_zero(ta_parent, struct mp_lavfi_threads);
+
+    struct lavfi_threads_opts *opts =
+        mp_get_config_group(t, global, &lavfi_threads_conf);
+    t->threads = opts->threads;
+    if (t->threads == 0) {
+        // Decoders use all cores by default (--vd-lavc-threads), so take only
+        // half of them to avoid oversubscribing the CPU.
+        t->threads = MPCLAMP(av_cpu_count() / 2, 1, 16);
+    }
+
+    if (t->threads > 1) {
+        t->pool = mp_thread_pool_create_shared(t, global, t->threads - 1);
+        if (!t->pool) {
+            mp_warn(log, "Could not create filter threads.\n");
+            t->threads = 1;
+        }
+    }
+
+    mp_verbose(log, "Using %d threads for libavfilter.\n", t->threads);
+    return t;
+}
+
+void mp_lavfi_threads_setup(struct mp_lavfi_threads *t,
+                            struct AVFilterGraph *graph)
+{
+    graph->nb_threads = t->threads;
+    if (t->pool) {
+        graph->thread_type = AVFILTER_THREAD_SLICE;
+        graph->opaque = t;
+        graph->execute = execute;
+    }
+}
@@ -0,0 +1,37 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_LAVFI_THREADS_H_
+#define MP_LAVFI_THREADS_H_
+
+struct mpv_global;
+struct mp_log;
+struct AVFilterGraph;
+struct mp_lavfi_threads;
+
+// Per filter instance state for slice threading libavfilter graphs. The
+// threads come from a pool created with mp_thread_pool_create_shared(), and
+// are freed with ta_parent. All graphs using it must be freed before that.
+struct mp_lavfi_threads *mp_lavfi_threads_create(void *ta_parent,
+                                                 struct mpv_global *global,
+                                                 struct mp_log *log);
+
+// Call right after avfilter_graph_alloc(), before any filter is added.
+void mp_lavfi_threads_setup(struct mp_lavfi_threads *t,
+                            struct AVFilterGraph *graph);
+
+#endif
@@ -30,12 +30,14 @@
 #include "osdep/atomic.h"
 #include "common/common.h"
 #include "common/global.h"
+#include "misc/json.h"
 #include "misc/ring.h"
 #include "misc/bstr.h"
 #include "options/options.h"
 #include "options/path.h"
 #include "osdep/terminal.h"
 #include "osdep/io.h"
+#include "osdep/threads.h"
 #include "osdep/timer.h"
 
 #include "libmpv/client.h"
@@ -43,6 +45,25 @@
 #include "msg.h"
 #include "msg_control.h"
 
+// Number of MSGL_STATS events each thread keeps for --dump-trace.
+#define TRACE_RING_SIZE 8192
+
+struct trace_event {
+    int64_t time;
+    char module[20];
+    char text[44];
+};
+
+// Events of a single thread, in a ring buffer. Only the thread itself writes
+// to it, so the lock is contended only while the trace is dumped.
+struct trace_ring {
+    pthread_mutex_t lock;
+    int tid;
+    char name[20];                  // module of the first event
+    struct trace_event *events;     // TRACE_RING_SIZE entries
+    uint64_t count;                 // number of events ever written
+};
+
 struct mp_log_root {
     struct mpv_global *global;
     // --- protected by mp_msg_lock
@@ -53,6 +74,7 @@ struct mp_log_root {
     bool termosd;       // use terminal control codes for status line
     int blank_lines;    // number of lines usable by status
     int status_lines;   // number of current status lines
+    char *status_text;  // last single-line status printed without decorations
     bool color;
     int verbose;
     bool really_quiet;
@@ -70,6 +92,24 @@ struct mp_log_root {
     atomic_ulong reload_counter;
     // --- protected by mp_msg_lock
     bstr buffer;
+    // --- protected by log_file_lock
+    // Lines formatted for the log file, written by log_file_thread. This
+    // keeps file I/O out of mp_msg_lock.
+    pthread_mutex_t log_file_lock;
+    pthread_cond_t log_file_wakeup;
+    pthread_t log_file_thread;
+    bool log_file_thread_active; // (also accessed under mp_msg_lock)
+    bool log_file_terminate;
+    bstr log_file_queue;
+    int64_t log_file_dropped;   // lines dropped because the queue was full
+    // --- protected by mp_msg_lock
+    char *trace_path;
+    struct trace_ring **trace_rings;
+    int num_trace_rings;
+    uint64_t trace_id;          // unique ID for the thread-local ring cache
+    // --- must be accessed atomically
+    atomic_bool tracing;        // --dump-trace is set
+    atomic_bool stats_active;   // stats_file is set
 };
 
 struct mp_log {
@@ -93,6 +133,13 @@ struct mp_log_buffer {
 // Protects some (not all) state in mp_log_root
 static pthread_mutex_t mp_msg_lock = PTHREAD_MUTEX_INITIALIZER;
 
+// Unique ID for each mp_log_root (protected by mp_msg_lock)
+static uint64_t trace_id_counter;
+
+// Ring of the current thread, valid if trace_tls_id matches the root.
+static __thread struct trace_ring *trace_tls_ring;
+static __thread uint64_t trace_tls_id;
+
 static const struct mp_log null_log = {0};
 struct mp_log *const mp_null_log = (struct mp_log *)&null_log;
 
@@ -121,7 +168,7 @@ static void update_loglevel(struct mp_log *log)
         log->level = MPMAX(log->level, log->root->buffers[n]->level);
     if (log->root->log_file)
         log->level = MPMAX(log->level, MSGL_V);
-    if (log->root->stats_file)
+    if (log->root->stats_file || atomic_load(&log->root->tracing))
         log->level = MPMAX(log->level, MSGL_STATS);
     atomic_store(&log->reload_counter, atomic_load(&log->root->reload_counter));
     pthread_mutex_unlock(&mp_msg_lock);
@@ -185,6 +232,7 @@ static void flush_status_line(struct mp_log_root *root)
         fprintf(stderr, "\n");
     root->status_lines = 0;
     root->blank_lines = 0;
+    TA_FREEP(&root->status_text);
 }
 
 void mp_msg_flush_status_line(struct mp_log *log)
@@ -281,6 +329,41 @@ static void print_terminal_line(struct mp_log *log, int lev,
     fflush(stream);
 }
 
+// If a single-line status replaces another single-line status, write only the
+// part after the common prefix, which matters for slow terminals. Returns false
+// if the full line must be written. Must be called with mp_msg_lock held.
+static bool write_status_diff(struct mp_log *log, char *text)
+{
+    struct mp_log_root *root = log->root;
+
+    const char *prefix = root->verbose || root->module ? log->verbose_prefix
+                                                       : log->prefix;
+    bool plain = !strchr(text, '\n') && !root->color && !root->show_time &&
+                 !prefix && test_terminal_level(log, MSGL_STATUS);
+
+    char *old = root->status_text;
+    root->status_text = plain ? talloc_strdup(root, text) : NULL;
+    bool can_diff = plain && old && root->status_lines == 1;
+    if (can_diff) {
+        // Moving the cursor by bytes is correct only for ASCII.
+        int n = 0;
+        while (old[n] && old[n] == text[n] && (unsigned char)text[n] < 0x80)
+            n++;
+        FILE *f = stderr;
+        fprintf(f, "\r");
+        if (n)
+            fprintf(f, "\033[%dC", n);
+        fprintf(f, "%s\033[K\r", text + n);
+        fflush(f);
+    }
+    talloc_free(old);
+    return can_diff;
+}
+
+// Maximum amount of data queued for the log file. If the disk can't keep up,
+// further lines are dropped (and counted) instead of blocking the caller.
+#define LOG_FILE_QUEUE_MAX (4 * 1024 * 1024)
+
 static void write_log_file(struct mp_log *log, int lev, char *text)
 {
     struct mp_log_root *root = log->root;
@@ -288,11 +371,100 @@ static void write_log_file(struct mp_log *log, int lev, char *text)
     if (!root->log_file || lev > MPMAX(MSGL_V, log->terminal_level))
         return;
 
-    fprintf(root->log_file, "[%8.3f][%c][%s] %s",
-            (mp_time_us() - MP_START_TIME) / 1e6,
-            mp_log_levels[lev][0],
-            log->verbose_prefix, text);
-    fflush(root->log_file);
+    // Format it before taking the lock, so it's held only for the copy.
+    double t = (mp_time_us() - MP_START_TIME) / 1e6;
+    char buf[512];
+    int len = snprintf(buf, sizeof(buf), "[%8.3f][%c][%s] %s", t,
+                       mp_log_levels[lev][0], log->verbose_prefix, text);
+    char *line = buf;
+    if (len < 0)
+        return;
+    if (len >= sizeof(buf)) {
+        line = talloc_asprintf(NULL, "[%8.3f][%c][%s] %s", t,
+                               mp_log_levels[lev][0], log->verbose_prefix, text);
+    }
+
+    pthread_mutex_lock(&root->log_file_lock);
+    if (root->log_file_queue.len + len > LOG_FILE_QUEUE_MAX) {
+        root->log_file_dropped++;
+    } else {
+        if (!root->log_file_queue.len)
+            pthread_cond_signal(&root->log_file_wakeup);
+        // (not allocated under root, because talloc is not thread-safe)
+        bstr_xappend(NULL, &root->log_file_queue, (bstr){line, len});
+    }
+    pthread_mutex_unlock(&root->log_file_lock);
+
+    if (line != buf)
+        talloc_free(line);
+}
+
+// Writes the queued log file lines. The thread exits when log_file_terminate
+// is set and the queue is empty, so no lines are lost on shutdown.
+static void *log_file_thread(void *p)
+{
+    struct mp_log_root *root = p;
+    mpthread_set_name("log-file");
+
+    bstr buf = {0};
+
+    pthread_mutex_lock(&root->log_file_lock);
+    while (1) {
+        if (!root->log_file_queue.len && !root->log_file_dropped) {
+            if (root->log_file_terminate)
+                break;
+            pthread_cond_wait(&root->log_file_wakeup, &root->log_file_lock);
+            continue;
+        }
+        // Swap buffers, so producers can continue while we write.
+        MPSWAP(bstr, buf, root->log_file_queue);
+        root->log_file_queue.len = 0;
+        int64_t dropped = root->log_file_dropped;
+        root->log_file_dropped = 0;
+        pthread_mutex_unlock(&root->log_file_lock);
+
+        fwrite(buf.start, buf.len, 1, root->log_file);
+        if (dropped) {
+            fprintf(root->log_file, "[%8.3f][w][log] %"PRId64" log messages "
+                    "dropped (log file too slow)\n",
+                    (mp_time_us() - MP_START_TIME) / 1e6, dropped);
+        }
+        fflush(root->log_file);
+
+        pthread_mutex_lock(&root->log_file_lock);
+    }
+    pthread_mutex_unlock(&root->log_file_lock);
+
+    talloc_free(buf.start);
+    return NULL;
+}
+
+// Called with mp_msg_lock held, after root->log_file was opened.
+static void start_log_file_thread(struct mp_log_root *root)
+{
+    assert(!root->log_file_thread_active);
+    root->log_file_terminate = false;
+    if (pthread_create(&root->log_file_thread, NULL, log_file_thread, root)) {
+        // Can't log from here; just disable the log file.
+        fclose(root->log_file);
+        root->log_file = NULL;
+        return;
+    }
+    root->log_file_thread_active = true;
+}
+
+// Called with mp_msg_lock held, before root->log_file is closed. This waits
+// until all queued lines are written.
+static void stop_log_file_thread(struct mp_log_root *root)
+{
+    if (!root->log_file_thread_active)
+        return;
+    pthread_mutex_lock(&root->log_file_lock);
+    root->log_file_terminate = true;
+    pthread_cond_signal(&root->log_file_wakeup);
+    pthread_mutex_unlock(&root->log_file_lock);
+    pthread_join(root->log_file_thread, NULL);
+    root->log_file_thread_active = false;
 }
 
 static void write_msg_to_buffers(struct mp_log *log, int lev, char *text)
@@ -337,22 +509,78 @@ static void dump_stats(struct mp_log *log, int lev, char *text)
         fprintf(root->stats_file, "%"PRId64" %s\n", mp_time_us(), text);
 }
 
+static struct trace_ring *get_trace_ring(struct mp_log_root *root)
+{
+    if (trace_tls_ring && trace_tls_id == root->trace_id)
+        return trace_tls_ring;
+
+    pthread_mutex_lock(&mp_msg_lock);
+    struct trace_ring *ring = talloc_zero(root, struct trace_ring);
+    pthread_mutex_init(&ring->lock, NULL);
+    ring->tid = root->num_trace_rings + 1;
+    ring->events = talloc_array(ring, struct trace_event, TRACE_RING_SIZE);
+    MP_TARRAY_APPEND(root, root->trace_rings, root->num_trace_rings, ring);
+    pthread_mutex_unlock(&mp_msg_lock);
+
+    trace_tls_ring = ring;
+    trace_tls_id = root->trace_id;
+    return ring;
+}
+
+// Add a MSGL_STATS event to the current thread's trace ring. This doesn't
+// take mp_msg_lock (except for the first event of each thread).
+static void record_trace_event(struct mp_log *log, const char *text)
+{
+    struct trace_ring *ring = get_trace_ring(log->root);
+    const char *module = log->verbose_prefix ? log->verbose_prefix : "global";
+    int64_t now = mp_time_us();
+
+    pthread_mutex_lock(&ring->lock);
+    if (!ring->count)
+        snprintf(ring->name, sizeof(ring->name), "%s", module);
+    struct trace_event *ev = &ring->events[ring->count % TRACE_RING_SIZE];
+    ev->time = now;
+    snprintf(ev->module, sizeof(ev->module), "%s", module);
+    snprintf(ev->text, sizeof(ev->text), "%s", text);
+    ring->count++;
+    pthread_mutex_unlock(&ring->lock);
+}
+
 void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
 {
     if (!mp_msg_test(log, lev))
         return; // do not display
 
-    pthread_mutex_lock(&mp_msg_lock);
+    // Format short messages before taking the lock, which is shared by all
+    // threads.
+    char tmp[256];
+    va_list copy;
+    va_copy(copy, va);
+    int len = vsnprintf(tmp, sizeof(tmp), format, copy);
+    va_end(copy);
 
     struct mp_log_root *root = log->root;
 
+    if (lev == MSGL_STATS && atomic_load(&root->tracing)) {
+        if (len >= 0)
+            record_trace_event(log, tmp);
+        if (!atomic_load(&root->stats_active))
+            return;
+    }
+
+    pthread_mutex_lock(&mp_msg_lock);
+
     root->buffer.len = 0;
 
     if (log->partial[0])
         bstr_xappend_asprintf(root, &root->buffer, "%s", log->partial);
     log->partial[0] = '\0';
 
-    bstr_xappend_vasprintf(root, &root->buffer, format, va);
+    if (len >= 0 && len < sizeof(tmp)) {
+        bstr_xappend_asprintf(root, &root->buffer, "%s", tmp);
+    } else {
+        bstr_xappend_vasprintf(root, &root->buffer, format, va);
+    }
 
     char *text = root->buffer.start;
 
@@ -360,6 +588,10 @@ void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
         dump_stats(log, lev, text);
     } else if (lev == MSGL_STATUS && !test_terminal_level(log, lev)) {
         /* discard */
+    } else if (lev == MSGL_STATUS && root->termosd &&
+               write_status_diff(log, text))
+    {
+        /* only the changed part was written */
     } else {
         if (lev == MSGL_STATUS && root->termosd)
             prepare_status_line(root, text);
@@ -454,7 +686,14 @@ void mp_msg_init(struct mpv_global *global)
     *root = (struct mp_log_root){
         .global = global,
         .reload_counter = ATOMIC_VAR_INIT(1),
+        .tracing = ATOMIC_VAR_INIT(false),
+        .stats_active = ATOMIC_VAR_INIT(false),
     };
+    pthread_mutex_lock(&mp_msg_lock);
+    root->trace_id = ++trace_id_counter;
+    pthread_mutex_unlock(&mp_msg_lock);
+    pthread_mutex_init(&root->log_file_lock, NULL);
+    pthread_cond_init(&root->log_file_wakeup, NULL);
 
     struct mp_log dummy = { .root = root };
     struct mp_log *log = mp_log_new(root, &dummy, "");
@@ -467,10 +706,13 @@ void mp_msg_init(struct mpv_global *global)
 // If opt is different from *current_path, reopen *file and update *current_path.
 // If there's an error, _append_ it to err_buf.
 // *current_path and *file are, rather trickily, only accessible under the
-// mp_msg_lock.
+// mp_msg_lock. If writer_thread is set, the file is written by
+// log_file_thread, which is restarted accordingly.
 static void reopen_file(char *opt, char **current_path, FILE **file,
-                        const char *type, struct mpv_global *global)
+                        const char *type, bool writer_thread,
+                        struct mpv_global *global)
 {
+    struct mp_log_root *root = global->log->root;
     void *tmp = talloc_new(NULL);
     bool fail = false;
 
@@ -482,6 +724,8 @@ static void reopen_file(char *opt, char **current_path, FILE **file,
 
     char *old_path = *current_path ? *current_path : "";
     if (strcmp(old_path, new_path) != 0) {
+        if (writer_thread)
+            stop_log_file_thread(root);
         if (*file)
             fclose(*file);
         *file = NULL;
@@ -490,6 +734,8 @@ static void reopen_file(char *opt, char **current_path, FILE **file,
         if (new_path[0]) {
             *file = fopen(new_path, "wb");
             fail = !*file;
+            if (*file && writer_thread)
+                start_log_file_thread(root);
         }
     }
 
@@ -509,6 +755,10 @@ void mp_msg_update_msglevels(struct mpv_global *global)
     if (!opts)
         return;
 
+    char *trace_path = NULL;
+    if (opts->dump_trace && opts->dump_trace[0])
+        trace_path = mp_get_user_path(NULL, global, opts->dump_trace);
+
     pthread_mutex_lock(&mp_msg_lock);
 
     root->verbose = opts->verbose;
@@ -525,14 +775,123 @@ void mp_msg_update_msglevels(struct mpv_global *global)
     m_option_type_msglevels.copy(NULL, &root->msg_levels,
                                  &global->opts->msg_levels);
 
+    talloc_free(root->trace_path);
+    root->trace_path = trace_path;
+    atomic_store(&root->tracing, !!root->trace_path);
+
     atomic_fetch_add(&root->reload_counter, 1);
     pthread_mutex_unlock(&mp_msg_lock);
 
     reopen_file(opts->log_file, &root->log_path, &root->log_file,
-                "log", global);
+                "log", true, global);
 
     reopen_file(opts->dump_stats, &root->stats_path, &root->stats_file,
-                "stats", global);
+                "stats", false, global);
+
+    pthread_mutex_lock(&mp_msg_lock);
+    atomic_store(&root->stats_active, !!root->stats_file);
+    pthread_mutex_unlock(&mp_msg_lock);
+}
+
+static void write_json_string(FILE *f, const char *s)
+{
+    char *res = talloc_strdup(NULL, "");
+    json_write(&res, &(struct mpv_node){.format = MPV_FORMAT_STRING,
+                                        .u.string = (char *)s});
+    fputs(res, f);
+    talloc_free(res);
+}
+
+static void write_trace_event(FILE *f, int tid, struct trace_event *ev)
+{
+    // The MSGL_STATS text is "start <name>", "end <name>", "value <v> <name>",
+    // or just "<name>" for singular events.
+    bstr text = bstr0(ev->text);
+    const char *ph = "i";
+    double value = 0;
+    if (bstr_eatstart0(&text, "start ")) {
+        ph = "B";
+    } else if (bstr_eatstart0(&text, "end ")) {
+        ph = "E";
+    } else if (bstr_eatstart0(&text, "value ")) {
+        bstr rest;
+        value = bstrtod(text, &rest);
+        if (rest.len < text.len)
+            ph = "C";
+        text = bstr_strip(rest);
+    }
+    char *name = bstrto0(NULL, text);
+
+    fprintf(f, ",\n{\"ph\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%"PRId64
+            ",\"name\":", ph, tid, ev->time);
+    write_json_string(f, name);
+    fprintf(f, ",\"cat\":");
+    write_json_string(f, ev->module);
+    if (ph[0] == 'C') {
+        fprintf(f, ",\"args\":{\"value\":%f}", value);
+    } else if (ph[0] == 'i') {
+        fprintf(f, ",\"s\":\"t\"");
+    }
+    fprintf(f, "}");
+    talloc_free(name);
+}
+
+// Write the events recorded for --dump-trace to the given file, in the Chrome
+// trace event format (as understood by chrome://tracing or Perfetto). The
+// rings are copied first, so threads are blocked only briefly.
+bool mp_msg_dump_trace(struct mpv_global *global, const char *filename)
+{
+    struct mp_log_root *root = global->log->root;
+
+    if (!atomic_load(&root->tracing)) {
+        mp_err(global->log, "Tracing is not enabled (see --dump-trace).\n");
+        return false;
+    }
+
+    FILE *f = fopen(filename, "wb");
+    if (!f) {
+        mp_err(global->log, "Failed to open trace file '%s'\n", filename);
+        return false;
+    }
+
+    pthread_mutex_lock(&mp_msg_lock);
+    struct trace_ring **rings = talloc_memdup(NULL, root->trace_rings,
+                        root->num_trace_rings * sizeof(root->trace_rings[0]));
+    int num_rings = root->num_trace_rings;
+    pthread_mutex_unlock(&mp_msg_lock);
+
+    struct trace_event *events =
+        talloc_array(rings, struct trace_event, TRACE_RING_SIZE);
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\","
+            "\"args\":{\"name\":\"mpv\"}}");
+    for (int n = 0; n < num_rings; n++) {
+        struct trace_ring *ring = rings[n];
+
+        pthread_mutex_lock(&ring->lock);
+        uint64_t count = ring->count;
+        int num = MPMIN(count, TRACE_RING_SIZE);
+        for (int i = 0; i < num; i++)
+            events[i] = ring->events[(count - num + i) % TRACE_RING_SIZE];
+        char name[sizeof(ring->name)];
+        memcpy(name, ring->name, sizeof(name));
+        pthread_mutex_unlock(&ring->lock);
+
+        fprintf(f, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                "\"name\":\"thread_name\",\"args\":{\"name\":", ring->tid);
+        write_json_string(f, name);
+        fprintf(f, "}}");
+        for (int i = 0; i < num; i++)
+            write_trace_event(f, ring->tid, &events[i]);
+    }
+    fprintf(f, "\n]}\n");
+
+    talloc_free(rings);
+    bool ok = fclose(f) == 0;
+    if (!ok)
+        mp_err(global->log, "Failed to write trace file '%s'\n", filename);
+    return ok;
 }
 
 void mp_msg_force_stderr(struct mpv_global *global, bool force_stderr)
@@ -558,13 +917,22 @@ bool mp_msg_has_log_file(struct mpv_global *global)
 void mp_msg_uninit(struct mpv_global *global)
 {
     struct mp_log_root *root = global->log->root;
+    if (root->trace_path)
+        mp_msg_dump_trace(global, root->trace_path);
+    for (int n = 0; n < root->num_trace_rings; n++)
+        pthread_mutex_destroy(&root->trace_rings[n]->lock);
+    talloc_free(root->trace_path);
     if (root->stats_file)
         fclose(root->stats_file);
     talloc_free(root->stats_path);
+    stop_log_file_thread(root);
     if (root->log_file)
         fclose(root->log_file);
     talloc_free(root->log_path);
     m_option_type_msglevels.free(&root->msg_levels);
+    talloc_free(root->log_file_queue.start);
+    pthread_cond_destroy(&root->log_file_wakeup);
+    pthread_mutex_destroy(&root->log_file_lock);
     talloc_free(root);
     global->log = NULL;
 }
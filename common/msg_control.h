@@ -10,6 +10,7 @@ void mp_msg_update_msglevels(struct mpv_global *global);
 void mp_msg_force_stderr(struct mpv_global *global, bool force_stderr);
 bool mp_msg_has_status_line(struct mpv_global *global);
 bool mp_msg_has_log_file(struct mpv_global *global);
+bool mp_msg_dump_trace(struct mpv_global *global, const char *filename);
 
 void mp_msg_flush_status_line(struct mp_log *log);
 
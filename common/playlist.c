@@ -49,32 +49,50 @@ void playlist_entry_add_params(struct playlist_entry *e,
         playlist_entry_add_param(e, params[n].name, params[n].value);
 }
 
+// Update the list links and indexes of pl->entries[start] and all following
+// entries. The entry before start gets its next link updated as well.
+static void playlist_relink(struct playlist *pl, int start)
+{
+    int num = pl->num_entries;
+    for (int n = MPMAX(start - 1, 0); n < num; n++) {
+        struct playlist_entry *e = pl->entries[n];
+        e->prev = n > 0 ? pl->entries[n - 1] : NULL;
+        e->next = n + 1 < num ? pl->entries[n + 1] : NULL;
+        e->pl_index = n;
+    }
+    pl->first = num ? pl->entries[0] : NULL;
+    pl->last = num ? pl->entries[num - 1] : NULL;
+}
+
+// Insert num_add entries (not in any playlist) at position "at".
+static void playlist_insert_at(struct playlist *pl, int at,
+                               struct playlist_entry **add, int num_add)
+{
+    assert(at >= 0 && at <= pl->num_entries);
+    MP_TARRAY_GROW(pl, pl->entries, pl->num_entries + num_add);
+    memmove(&pl->entries[at + num_add], &pl->entries[at],
+            (pl->num_entries - at) * sizeof(pl->entries[0]));
+    for (int n = 0; n < num_add; n++) {
+        struct playlist_entry *e = add[n];
+        assert(e->pl == NULL && e->next == NULL && e->prev == NULL);
+        pl->entries[at + n] = e;
+        e->pl = pl;
+        talloc_steal(pl, e);
+    }
+    pl->num_entries += num_add;
+    playlist_relink(pl, at);
+}
+
 // Add entry "add" after entry "after".
 // If "after" is NULL, add as first entry.
 // Post condition: add->prev == after
 void playlist_insert(struct playlist *pl, struct playlist_entry *after,
                      struct playlist_entry *add)
 {
-    assert(pl && add->pl == NULL && add->next == NULL && add->prev == NULL);
-    if (after) {
+    assert(pl);
+    if (after)
         assert(after->pl == pl);
-        assert(pl->first && pl->last);
-    }
-    add->prev = after;
-    if (after) {
-        add->next = after->next;
-        after->next = add;
-    } else {
-        add->next = pl->first;
-        pl->first = add;
-    }
-    if (add->next) {
-        add->next->prev = add;
-    } else {
-        pl->last = add;
-    }
-    add->pl = pl;
-    talloc_steal(pl, add);
+    playlist_insert_at(pl, after ? after->pl_index + 1 : 0, &add, 1);
 }
 
 void playlist_add(struct playlist *pl, struct playlist_entry *add)
@@ -91,16 +109,11 @@ static void playlist_unlink(struct playlist *pl, struct playlist_entry *entry)
         pl->current_was_replaced = true;
     }
 
-    if (entry->next) {
-        entry->next->prev = entry->prev;
-    } else {
-        pl->last = entry->prev;
-    }
-    if (entry->prev) {
-        entry->prev->next = entry->next;
-    } else {
-        pl->first = entry->next;
-    }
+    int index = entry->pl_index;
+    assert(pl->entries[index] == entry);
+    MP_TARRAY_REMOVE_AT(pl->entries, pl->num_entries, index);
+    playlist_relink(pl, index);
+
     entry->next = entry->prev = NULL;
     // xxx: we'd want to reset the talloc parent of entry
     entry->pl = NULL;
@@ -122,8 +135,9 @@ void playlist_remove(struct playlist *pl, struct playlist_entry *entry)
 
 void playlist_clear(struct playlist *pl)
 {
-    while (pl->first)
-        playlist_remove(pl, pl->first);
+    // Removing from the end avoids moving the remaining entries each time.
+    while (pl->last)
+        playlist_remove(pl, pl->last);
     assert(!pl->current);
     pl->current_was_replaced = false;
 }
@@ -150,34 +164,15 @@ void playlist_add_file(struct playlist *pl, const char *filename)
     playlist_add(pl, playlist_entry_new(filename));
 }
 
-static int playlist_count(struct playlist *pl)
-{
-    int c = 0;
-    for (struct playlist_entry *e = pl->first; e; e = e->next)
-        c++;
-    return c;
-}
-
 void playlist_shuffle(struct playlist *pl)
 {
-    struct playlist_entry *save_current = pl->current;
-    bool save_replaced = pl->current_was_replaced;
-    int count = playlist_count(pl);
-    struct playlist_entry **arr = talloc_array(NULL, struct playlist_entry *,
-                                               count);
-    for (int n = 0; n < count; n++) {
-        arr[n] = pl->first;
-        playlist_unlink(pl, pl->first);
-    }
+    struct playlist_entry **arr = pl->entries;
+    int count = pl->num_entries;
     for (int n = 0; n < count - 1; n++) {
         int j = (int)((double)(count - n) * rand() / (RAND_MAX + 1.0));
         MPSWAP(struct playlist_entry *, arr[n], arr[n + j]);
     }
-    for (int n = 0; n < count; n++)
-        playlist_add(pl, arr[n]);
-    talloc_free(arr);
-    pl->current = save_current;
-    pl->current_was_replaced = save_replaced;
+    playlist_relink(pl, 0);
 }
 
 struct playlist_entry *playlist_get_next(struct playlist *pl, int direction)
@@ -216,6 +211,32 @@ void playlist_add_redirect(struct playlist *pl, const char *redirected_from)
     }
 }
 
+// Move all entries from source_pl to pl at index "at", without unlinking them
+// one by one.
+static void playlist_move_entries(struct playlist *pl, int at,
+                                  struct playlist *source_pl)
+{
+    struct playlist_entry **entries = source_pl->entries;
+    int num_entries = source_pl->num_entries;
+
+    // Same end state as unlinking every entry with playlist_unlink().
+    if (source_pl->current) {
+        source_pl->current = NULL;
+        source_pl->current_was_replaced = true;
+    }
+    source_pl->entries = NULL;
+    source_pl->num_entries = 0;
+    source_pl->first = source_pl->last = NULL;
+
+    for (int n = 0; n < num_entries; n++) {
+        struct playlist_entry *e = entries[n];
+        e->next = e->prev = NULL;
+        e->pl = NULL;
+    }
+    playlist_insert_at(pl, at, entries, num_entries);
+    talloc_free(entries);
+}
+
 // Move all entries from source_pl to pl, appending them after the current entry
 // of pl. source_pl will be empty, and all entries have changed ownership to pl.
 void playlist_transfer_entries(struct playlist *pl, struct playlist *source_pl)
@@ -226,53 +247,36 @@ void playlist_transfer_entries(struct playlist *pl, struct playlist *source_pl)
     if (!add_after)
         add_after = pl->last;
 
-    while (source_pl->first) {
-        struct playlist_entry *e = source_pl->first;
-        playlist_unlink(source_pl, e);
-        playlist_insert(pl, add_after, e);
-        add_after = e;
-    }
+    playlist_move_entries(pl, add_after ? add_after->pl_index + 1 : 0,
+                          source_pl);
 }
 
 void playlist_append_entries(struct playlist *pl, struct playlist *source_pl)
 {
-    while (source_pl->first) {
-        struct playlist_entry *e = source_pl->first;
-        playlist_unlink(source_pl, e);
-        playlist_add(pl, e);
-    }
+    playlist_move_entries(pl, pl->num_entries, source_pl);
 }
 
 // Return number of entries between list start and e.
 // Return -1 if e is not on the list, or if e is NULL.
 int playlist_entry_to_index(struct playlist *pl, struct playlist_entry *e)
 {
-    struct playlist_entry *cur = pl->first;
-    int pos = 0;
-    if (!e)
+    if (!e || e->pl != pl)
         return -1;
-    while (cur && cur != e) {
-        cur = cur->next;
-        pos++;
-    }
-    return cur == e ? pos : -1;
+    return e->pl_index;
 }
 
 int playlist_entry_count(struct playlist *pl)
 {
-    return playlist_entry_to_index(pl, pl->last) + 1;
+    return pl->num_entries;
 }
 
 // Return entry for which playlist_entry_to_index() would return index.
 // Return NULL if not found.
 struct playlist_entry *playlist_entry_from_index(struct playlist *pl, int index)
 {
-    struct playlist_entry *e = pl->first;
-    for (int n = 0; ; n++) {
-        if (!e || n == index)
-            return e;
-        e = e->next;
-    }
+    if (index < 0 || index >= pl->num_entries)
+        return NULL;
+    return pl->entries[index];
 }
 
 struct playlist *playlist_parse_file(const char *file, struct mpv_global *global)
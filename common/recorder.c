@@ -313,6 +313,21 @@ void mp_recorder_destroy(struct mp_recorder *priv)
     talloc_free(priv);
 }
 
+// Write all queued packets, even if they don't end on a keyframe. Useful before
+// mp_recorder_mark_discontinuity() if the source is known to be complete up
+// to this point (otherwise these packets would be dropped).
+void mp_recorder_flush(struct mp_recorder *priv)
+{
+    for (int n = 0; n < priv->num_streams; n++) {
+        struct mp_recorder_sink *rst = priv->streams[n];
+        rst->proper_eof = true;
+    }
+    check_restart(priv);
+
+    for (int n = 0; n < priv->num_streams; n++)
+        mux_packets(priv->streams[n], true);
+}
+
 // This is called on a seek, or when recording was started mid-stream.
 void mp_recorder_mark_discontinuity(struct mp_recorder *priv)
 {
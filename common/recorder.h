@@ -13,6 +13,7 @@ struct mp_recorder *mp_recorder_create(struct mpv_global *global,
                                        int num_streams);
 void mp_recorder_destroy(struct mp_recorder *r);
 void mp_recorder_mark_discontinuity(struct mp_recorder *r);
+void mp_recorder_flush(struct mp_recorder *r);
 
 struct mp_recorder_sink *mp_recorder_get_sink(struct mp_recorder *r, int stream);
 void mp_recorder_feed_packet(struct mp_recorder_sink *s,
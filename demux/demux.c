@@ -31,16 +31,21 @@
 #include "config.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
+#include "options/path.h"
 #include "mpv_talloc.h"
 #include "common/msg.h"
 #include "common/global.h"
 #include "osdep/threads.h"
+#include "misc/thread_sched.h"
+#include "osdep/timer.h"
+#include "common/recorder.h"
 
 #include "stream/stream.h"
 #include "demux.h"
 #include "timeline.h"
 #include "stheader.h"
 #include "cue.h"
+#include "spill.h"
 
 // Demuxer list
 extern const struct demuxer_desc demuxer_desc_edl;
@@ -92,6 +97,11 @@ struct demux_opts {
     int access_references;
     int seekable_cache;
     int create_ccs;
+    int probe_threads;
+    int64_t max_spill_bytes;
+    char *spill_dir;
+    int reserve_bytes[STREAM_TYPE_COUNT];
+    double reserve_secs[STREAM_TYPE_COUNT];
 };
 
 #define OPT_BASE_STRUCT struct demux_opts
@@ -107,6 +117,22 @@ const struct m_sub_options demux_conf = {
         OPT_CHOICE("demuxer-seekable-cache", seekable_cache, 0,
                    ({"auto", -1}, {"no", 0}, {"yes", 1})),
         OPT_FLAG("sub-create-cc-track", create_ccs, 0),
+        OPT_INTRANGE("demuxer-probe-threads", probe_threads, 0, 0, 16),
+        OPT_INT64("demuxer-max-spill-bytes", max_spill_bytes, M_OPT_MIN,
+                  .min = 0),
+        OPT_STRING("demuxer-spill-dir", spill_dir, 0),
+        OPT_INTRANGE("demuxer-back-reserve-video-bytes",
+                     reserve_bytes[STREAM_VIDEO], 0, 0, INT_MAX),
+        OPT_INTRANGE("demuxer-back-reserve-audio-bytes",
+                     reserve_bytes[STREAM_AUDIO], 0, 0, INT_MAX),
+        OPT_INTRANGE("demuxer-back-reserve-sub-bytes",
+                     reserve_bytes[STREAM_SUB], 0, 0, INT_MAX),
+        OPT_DOUBLE("demuxer-back-reserve-video-secs",
+                   reserve_secs[STREAM_VIDEO], M_OPT_MIN, .min = 0),
+        OPT_DOUBLE("demuxer-back-reserve-audio-secs",
+                   reserve_secs[STREAM_AUDIO], M_OPT_MIN, .min = 0),
+        OPT_DOUBLE("demuxer-back-reserve-sub-secs",
+                   reserve_secs[STREAM_SUB], M_OPT_MIN, .min = 0),
         {0}
     },
     .size = sizeof(struct demux_opts),
@@ -137,10 +163,15 @@ struct demux_internal {
     pthread_cond_t wakeup;
     pthread_t thread;
 
+    // Packets created by the demuxer implementation are allocated from this.
+    // (Thread-safe on its own.)
+    struct demux_packet_pool *packet_pool;
+
     // -- All the following fields are protected by lock.
 
     bool thread_terminate;
     bool threading;
+    bool thread_waiting;        // demuxer thread blocks on wakeup
     void (*wakeup_cb)(void *ctx);
     void *wakeup_cb_ctx;
 
@@ -179,6 +210,10 @@ struct demux_internal {
     void (*run_fn)(void *);     // if non-NULL, function queued to be run on
     void *run_fn_arg;           // the thread as run_fn(run_fn_arg)
 
+    // Queued by demux_control_async(), executed in order.
+    struct demux_async_ctrl **async_ctrls;
+    int num_async_ctrls;
+
     // (sorted by least recent use: index 0 is least recently used)
     struct demux_cached_range **ranges;
     int num_ranges;
@@ -186,6 +221,22 @@ struct demux_internal {
     size_t total_bytes;         // total sum of packet data buffered
     size_t fw_bytes;            // sum of forward packet data in current_range
 
+    // Back buffer packet data moved to disk (--demuxer-max-spill-bytes).
+    // total_bytes does not include the data of spilled packets.
+    int64_t max_spill_bytes;
+    char *spill_dir;
+    struct demux_spill *spill;  // created on first use
+
+    // Per stream type part of the back buffer protected from pruning.
+    int reserve_bytes[STREAM_TYPE_COUNT];
+    double reserve_secs[STREAM_TYPE_COUNT];
+
+    // Telemetry (DEMUXER_CTRL_GET_STATS, and periodically with --dump-stats).
+    int64_t stat_reads;
+    int64_t stat_read_us, stat_read_max_us;
+    int64_t stat_wakeups;
+    int64_t last_stats_time;
+
     // Range from which decoder is reading, and to which demuxer is appending.
     // This is never NULL. This is always ranges[num_ranges - 1].
     struct demux_cached_range *current_range;
@@ -194,7 +245,12 @@ struct demux_internal {
     bool force_cache_update;
     struct mp_tags *stream_metadata;
     struct stream_cache_info stream_cache_info;
+    struct stream_connection_info stream_conn_info;
+    struct stream_io_stats stream_io_stats;
     int64_t stream_size;
+    double stream_bitrate;      // last value sent with STREAM_CTRL_SET_BITRATE
+    double net_throughput;      // DEMUXER_CTRL_GET_NET_THROUGHPUT
+    struct stream_snapshot stream_snapshot;
     // Updated during init only.
     char *stream_base_filename;
 };
@@ -211,8 +267,6 @@ struct demux_cached_range {
     double seek_start, seek_end;
 };
 
-#define MAX_INDEX_ENTRIES 16
-
 // A continuous list of cached packets for a single stream/range. There is one
 // for each stream and range. Also contains some state for use during demuxing
 // (keeping it across seeks makes it easier to resume demuxing).
@@ -224,6 +278,8 @@ struct demux_queue {
     struct demux_packet *tail;
 
     struct demux_packet *next_prune_target; // cached value for faster pruning
+    struct demux_packet *spill_next; // all packets before this are spilled
+    size_t bytes;           // sum of all packets (like in->total_bytes)
 
     bool correct_dts;       // packet DTS is strictly monotonically increasing
     bool correct_pos;       // packet pos is strictly monotonically increasing
@@ -239,11 +295,14 @@ struct demux_queue {
     double seek_start, seek_end;
     double last_pruned;     // timestamp of last pruned keyframe
 
-    // incomplete index to somewhat speed up seek operations
-    // the entries in index[] must be in packet queue append/removal order
-    int num_index;          // valid index[] entries
-    double index_distance;  // minimum keyframe distance to add index element
-    struct demux_packet *index[MAX_INDEX_ENTRIES];
+    // Index of all keyframes with kf_seek_pts set, in packet queue order.
+    // Valid entries are [index_start, index_start + num_index). index_pts[]
+    // contains the maximum kf_seek_pts of all entries up to the same position
+    // (i.e. it's sorted even if the keyframe PTS are not).
+    struct demux_packet **index;
+    double *index_pts;
+    int index_start;
+    int num_index;
 };
 
 struct demux_stream {
@@ -279,6 +338,10 @@ struct demux_stream {
     bool skip_to_keyframe;
     bool attached_picture_added;
 
+    // telemetry (DEMUXER_CTRL_GET_STATS)
+    int64_t stat_packets_read;
+    int64_t stat_wait_us, stat_wait_max_us;
+
     // for closed captions (demuxer_feed_caption)
     struct sh_stream *cc;
     bool ignore_eof;        // ignore stream in underrun detection
@@ -295,6 +358,10 @@ struct demux_stream {
 static void demuxer_sort_chapters(demuxer_t *demuxer);
 static void *demux_thread(void *pctx);
 static void update_cache(struct demux_internal *in);
+static void update_stream_snapshot(struct demux_internal *in);
+static void run_async_ctrl(struct demux_internal *in,
+                           struct demux_async_ctrl *c);
+static void cancel_async_ctrls(struct demux_internal *in);
 
 #if 0
 // very expensive check for redundant cached queue state
@@ -316,12 +383,14 @@ static void check_queue_consistency(struct demux_internal *in)
 
             assert(queue->range == range);
 
+            size_t queue_bytes = 0;
             size_t fw_bytes = 0;
             size_t fw_packs = 0;
             bool is_forward = false;
             bool kf_found = false;
             bool npt_found = false;
             int next_index = 0;
+            struct demux_packet **index = queue->index + queue->index_start;
             for (struct demux_packet *dp = queue->head; dp; dp = dp->next) {
                 is_forward |= dp == queue->ds->reader_head;
                 kf_found |= dp == queue->keyframe_latest;
@@ -329,6 +398,7 @@ static void check_queue_consistency(struct demux_internal *in)
 
                 size_t bytes = demux_packet_estimate_total_size(dp);
                 total_bytes += bytes;
+                queue_bytes += bytes;
                 if (is_forward) {
                     fw_bytes += bytes;
                     fw_packs += 1;
@@ -339,12 +409,15 @@ static void check_queue_consistency(struct demux_internal *in)
                 if (!dp->next)
                     assert(queue->tail == dp);
 
-                if (next_index < queue->num_index && queue->index[next_index] == dp)
+                if (next_index < queue->num_index && index[next_index] == dp)
                     next_index += 1;
+                if (dp->keyframe && dp->kf_seek_pts != MP_NOPTS_VALUE)
+                    assert(next_index > 0 && index[next_index - 1] == dp);
             }
             if (!queue->head)
                 assert(!queue->tail);
             assert(next_index == queue->num_index);
+            assert(queue->bytes == queue_bytes);
 
             // If the queue is currently used...
             if (queue->ds->queue == queue) {
@@ -459,11 +532,22 @@ static void remove_head_packet(struct demux_queue *queue)
         queue->next_prune_target = NULL;
     if (queue->keyframe_latest == dp)
         queue->keyframe_latest = NULL;
+    if (queue->spill_next == dp)
+        queue->spill_next = NULL;
 
-    queue->ds->in->total_bytes -= demux_packet_estimate_total_size(dp);
+    size_t bytes = demux_packet_estimate_total_size(dp);
+    queue->ds->in->total_bytes -= bytes;
+    queue->bytes -= bytes;
+    ta_account_add_external(MP_MEM_DEMUX, -(long long)bytes);
+    if (dp->spill_pos >= 0)
+        demux_spill_release(queue->ds->in->spill, dp);
 
-    if (queue->num_index && queue->index[0] == dp)
-        MP_TARRAY_REMOVE_AT(queue->index, queue->num_index, 0);
+    if (queue->num_index && queue->index[queue->index_start] == dp) {
+        queue->index_start += 1;
+        queue->num_index -= 1;
+        if (!queue->num_index)
+            queue->index_start = 0;
+    }
 
     queue->head = dp->next;
     if (!queue->head)
@@ -480,18 +564,25 @@ static void clear_queue(struct demux_queue *queue)
     struct demux_packet *dp = queue->head;
     while (dp) {
         struct demux_packet *dn = dp->next;
-        in->total_bytes -= demux_packet_estimate_total_size(dp);
+        size_t bytes = demux_packet_estimate_total_size(dp);
+        in->total_bytes -= bytes;
+        ta_account_add_external(MP_MEM_DEMUX, -(long long)bytes);
+        if (dp->spill_pos >= 0)
+            demux_spill_release(in->spill, dp);
         assert(ds->reader_head != dp);
         talloc_free(dp);
         dp = dn;
     }
     queue->head = queue->tail = NULL;
     queue->next_prune_target = NULL;
+    queue->spill_next = NULL;
+    queue->bytes = 0;
     queue->keyframe_latest = NULL;
     queue->seek_start = queue->seek_end = queue->last_pruned = MP_NOPTS_VALUE;
 
-    queue->num_index = 0;
-    queue->index_distance = 1.0;
+    TA_FREEP(&queue->index);
+    TA_FREEP(&queue->index_pts);
+    queue->index_start = queue->num_index = 0;
 
     queue->correct_dts = queue->correct_pos = true;
     queue->last_pos = -1;
@@ -759,6 +850,7 @@ void free_demuxer(demuxer_t *demuxer)
     assert(demuxer == in->d_user);
 
     demux_stop_thread(demuxer);
+    cancel_async_ctrls(in);
 
     if (demuxer->desc->close)
         demuxer->desc->close(in->d_thread);
@@ -768,6 +860,15 @@ void free_demuxer(demuxer_t *demuxer)
 
     for (int n = 0; n < in->num_streams; n++)
         talloc_free(in->streams[n]);
+    if (in->packet_pool) {
+        struct demux_packet_pool_stats st;
+        demux_packet_pool_get_stats(in->packet_pool, &st);
+        MP_VERBOSE(demuxer, "Packet pool: %"PRId64"/%"PRId64" packets and "
+                   "%"PRId64"/%"PRId64" buffers reused.\n",
+                   st.packets_reused, st.packets_reused + st.packets_allocated,
+                   st.buffers_reused, st.buffers_reused + st.buffers_allocated);
+    }
+    demux_packet_pool_destroy(in->packet_pool);
     pthread_mutex_destroy(&in->lock);
     pthread_cond_destroy(&in->wakeup);
     talloc_free(demuxer);
@@ -868,25 +969,33 @@ void demuxer_feed_caption(struct sh_stream *stream, demux_packet_t *dp)
     demux_add_packet(sh, dp);
 }
 
-// Add the keyframe to the end of the index. Not all packets are actually added.
+// Add the keyframe to the end of the index.
 static void add_index_entry(struct demux_queue *queue, struct demux_packet *dp)
 {
     assert(dp->keyframe && dp->kf_seek_pts != MP_NOPTS_VALUE);
 
+    double pts = dp->kf_seek_pts;
     if (queue->num_index) {
-        double prev = queue->index[queue->num_index - 1]->kf_seek_pts;
-        if (dp->kf_seek_pts < prev + queue->index_distance)
-            return;
+        int last = queue->index_start + queue->num_index - 1;
+        pts = MPMAX(pts, queue->index_pts[last]);
     }
 
-    if (queue->num_index == MAX_INDEX_ENTRIES) {
-        for (int n = 0; n < MAX_INDEX_ENTRIES / 2; n++)
-            queue->index[n] = queue->index[n * 2];
-        queue->num_index = MAX_INDEX_ENTRIES / 2;
-        queue->index_distance *= 2;
+    // Entries are removed from the start when pruning; reclaim the space
+    // once more than half of the array is unused.
+    if (queue->index_start > 64 && queue->index_start >= queue->num_index) {
+        memmove(queue->index, queue->index + queue->index_start,
+                queue->num_index * sizeof(queue->index[0]));
+        memmove(queue->index_pts, queue->index_pts + queue->index_start,
+                queue->num_index * sizeof(queue->index_pts[0]));
+        queue->index_start = 0;
     }
 
-    queue->index[queue->num_index++] = dp;
+    int pos = queue->index_start + queue->num_index;
+    MP_TARRAY_GROW(queue, queue->index, pos);
+    MP_TARRAY_GROW(queue, queue->index_pts, pos);
+    queue->index[pos] = dp;
+    queue->index_pts[pos] = pts;
+    queue->num_index += 1;
 }
 
 // Check whether the next range in the list is, and if it appears to overlap,
@@ -1018,13 +1127,17 @@ static void attempt_range_joining(struct demux_internal *in)
         q1->keyframe_end_pts = q2->keyframe_end_pts;
         q1->keyframe_latest = q2->keyframe_latest;
 
+        q1->bytes += q2->bytes;
+
         q2->head = q2->tail = NULL;
         q2->next_prune_target = NULL;
+        q2->spill_next = NULL;
+        q2->bytes = 0;
         q2->keyframe_latest = NULL;
 
         for (int i = 0; i < q2->num_index; i++)
-            add_index_entry(q1, q2->index[i]);
-        q2->num_index = 0;
+            add_index_entry(q1, q2->index[q2->index_start + i]);
+        q2->index_start = q2->num_index = 0;
 
         recompute_buffers(ds);
         in->fw_bytes += ds->fw_bytes;
@@ -1101,6 +1214,13 @@ void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
         return;
     }
     struct demux_internal *in = ds->in;
+
+    // (Work that doesn't need the lock is done before taking it.)
+    size_t bytes = demux_packet_estimate_total_size(dp);
+    dp->stream = stream->index;
+    dp->next = NULL;
+    dp->queue_time = mp_time_us();
+
     pthread_mutex_lock(&in->lock);
 
     struct demux_queue *queue = ds->queue;
@@ -1134,9 +1254,6 @@ void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
     ds->global_correct_pos &= queue->correct_pos;
     ds->global_correct_dts &= queue->correct_dts;
 
-    dp->stream = stream->index;
-    dp->next = NULL;
-
     // (keep in mind that even if the reader went out of data, the queue is not
     // necessarily empty due to the backbuffer)
     if (!ds->reader_head && (!ds->skip_to_keyframe || dp->keyframe)) {
@@ -1144,8 +1261,9 @@ void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
         ds->skip_to_keyframe = false;
     }
 
-    size_t bytes = demux_packet_estimate_total_size(dp);
     ds->in->total_bytes += bytes;
+    queue->bytes += bytes;
+    ta_account_add_external(MP_MEM_DEMUX, bytes);
     if (ds->reader_head) {
         ds->fw_packs++;
         ds->fw_bytes += bytes;
@@ -1187,9 +1305,14 @@ void demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
     adjust_seek_range_on_packet(ds, dp);
 
     // Wake up if this was the first packet after start/possible underrun.
-    if (ds->in->wakeup_cb && ds->reader_head && !ds->reader_head->next)
-        ds->in->wakeup_cb(ds->in->wakeup_cb_ctx);
-    pthread_cond_signal(&in->wakeup);
+    // Readers block only while they have no packet, so there is no need to
+    // signal otherwise. (Broadcast, because the signal is not repeated, and
+    // must reach the reader of this stream.)
+    if (ds->reader_head == dp) {
+        if (ds->in->wakeup_cb)
+            ds->in->wakeup_cb(ds->in->wakeup_cb_ctx);
+        pthread_cond_broadcast(&in->wakeup);
+    }
     pthread_mutex_unlock(&in->lock);
 }
 
@@ -1260,12 +1383,25 @@ static bool read_packet(struct demux_internal *in)
     struct demuxer *demux = in->d_thread;
 
     bool eof = true;
-    if (demux->desc->fill_buffer && !demux_cancel_test(demux))
+    int64_t read_time = 0;
+    if (demux->desc->fill_buffer && !demux_cancel_test(demux)) {
+        struct demux_packet_pool *prev_pool =
+            demux_packet_pool_set_current(in->packet_pool);
+        MP_STATS(in, "start demux read");
+        int64_t read_start = mp_time_us();
         eof = demux->desc->fill_buffer(demux) <= 0;
+        read_time = mp_time_us() - read_start;
+        MP_STATS(in, "end demux read");
+        demux_packet_pool_set_current(prev_pool);
+    }
     update_cache(in);
 
     pthread_mutex_lock(&in->lock);
 
+    in->stat_reads++;
+    in->stat_read_us += read_time;
+    in->stat_read_max_us = MPMAX(in->stat_read_max_us, read_time);
+
     if (!in->seeking) {
         if (eof) {
             for (int n = 0; n < in->num_streams; n++) {
@@ -1287,6 +1423,112 @@ static bool read_packet(struct demux_internal *in)
     return true;
 }
 
+// Move the data of the oldest back buffer packet that is still in memory to
+// the spill file. Returns false if there is none, or the spill file is full.
+static bool spill_old_packet(struct demux_internal *in)
+{
+    if (!in->spill && in->max_spill_bytes > 0) {
+        in->spill = demux_spill_create(in, in->log, in->spill_dir,
+                                       in->max_spill_bytes);
+        if (!in->spill)
+            in->max_spill_bytes = 0;
+    }
+    if (!in->spill)
+        return false;
+
+    // (Start from least recently used range.)
+    for (int r = 0; r < in->num_ranges; r++) {
+        struct demux_cached_range *range = in->ranges[r];
+        for (int n = 0; n < range->num_streams; n++) {
+            struct demux_queue *queue = range->streams[n];
+            struct demux_packet *reader = queue->ds->reader_head;
+            struct demux_packet *dp =
+                queue->spill_next ? queue->spill_next : queue->head;
+            while (dp && dp != reader && dp->spill_pos >= 0)
+                dp = dp->next;
+            if (dp)
+                queue->spill_next = dp;
+            if (!dp || dp == reader)
+                continue;
+
+            size_t bytes = demux_packet_estimate_total_size(dp);
+            if (!demux_spill_packet(in->spill, dp))
+                return false;
+            size_t new_bytes = demux_packet_estimate_total_size(dp);
+            in->total_bytes -= bytes;
+            in->total_bytes += new_bytes;
+            ta_account_add_external(MP_MEM_DEMUX,
+                                    (long long)new_bytes - (long long)bytes);
+            queue->bytes -= bytes;
+            queue->bytes += new_bytes;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether the back buffer of this queue is within the reserve for its stream
+// type, and should not be pruned if there's anything else to prune.
+static bool is_back_buffer_reserved(struct demux_internal *in,
+                                    struct demux_queue *queue)
+{
+    struct demux_stream *ds = queue->ds;
+    int max_bytes = in->reserve_bytes[ds->type];
+    double max_secs = in->reserve_secs[ds->type];
+    if (!max_bytes && !max_secs)
+        return false;
+
+    bool current = ds->queue == queue;
+    size_t bytes = queue->bytes - (current ? ds->fw_bytes : 0);
+    if (max_bytes && bytes >= max_bytes)
+        return false;
+
+    if (max_secs) {
+        struct demux_packet *head = queue->head;
+        double start = head ? PTS_OR_DEF(head->pts, head->dts) : MP_NOPTS_VALUE;
+        double end = current ? ds->base_ts : queue->last_ts;
+        if (start == MP_NOPTS_VALUE || end == MP_NOPTS_VALUE ||
+            end - start >= max_secs)
+            return false;
+    }
+
+    return true;
+}
+
+// Return the stream whose oldest packets should be pruned first.
+static struct demux_stream *find_prune_stream(struct demux_internal *in,
+                                              struct demux_cached_range *range,
+                                              bool use_reserves)
+{
+    double earliest_ts = MP_NOPTS_VALUE;
+    struct demux_stream *earliest_stream = NULL;
+
+    for (int n = 0; n < range->num_streams; n++) {
+        struct demux_queue *queue = range->streams[n];
+        struct demux_stream *ds = queue->ds;
+
+        if (use_reserves && is_back_buffer_reserved(in, queue))
+            continue;
+
+        if (queue->head && queue->head != ds->reader_head) {
+            struct demux_packet *dp = queue->head;
+            double ts = dp->kf_seek_pts;
+            // Note: in obscure cases, packets might have no timestamps set,
+            // in which case we still need to prune _something_.
+            bool prune_always =
+                !in->seekable_cache || ts == MP_NOPTS_VALUE || !dp->keyframe;
+            if (prune_always || !earliest_stream || ts < earliest_ts) {
+                earliest_ts = ts;
+                earliest_stream = ds;
+                if (prune_always)
+                    break;
+            }
+        }
+    }
+
+    return earliest_stream;
+}
+
 static void prune_old_packets(struct demux_internal *in)
 {
     assert(in->current_range == in->ranges[in->num_ranges - 1]);
@@ -1296,33 +1538,20 @@ static void prune_old_packets(struct demux_internal *in)
     // big.
     size_t max_bytes = in->seekable_cache ? in->max_bytes_bw : 0;
     while (in->total_bytes - in->fw_bytes > max_bytes) {
+        // Prefer moving packet data to disk over throwing it away.
+        if (in->seekable_cache && spill_old_packet(in))
+            continue;
+
         // (Start from least recently used range.)
         struct demux_cached_range *range = in->ranges[0];
-        double earliest_ts = MP_NOPTS_VALUE;
-        struct demux_stream *earliest_stream = NULL;
 
-        for (int n = 0; n < range->num_streams; n++) {
-            struct demux_queue *queue = range->streams[n];
-            struct demux_stream *ds = queue->ds;
-
-            if (queue->head && queue->head != ds->reader_head) {
-                struct demux_packet *dp = queue->head;
-                double ts = dp->kf_seek_pts;
-                // Note: in obscure cases, packets might have no timestamps set,
-                // in which case we still need to prune _something_.
-                bool prune_always =
-                    !in->seekable_cache || ts == MP_NOPTS_VALUE || !dp->keyframe;
-                if (prune_always || !earliest_stream || ts < earliest_ts) {
-                    earliest_ts = ts;
-                    earliest_stream = ds;
-                    if (prune_always)
-                        break;
-                }
-            }
-        }
+        // If all prunable streams are within their reserve, the global limit
+        // still wins, so try again without reserves.
+        struct demux_stream *ds = find_prune_stream(in, range, true);
+        if (!ds)
+            ds = find_prune_stream(in, range, false);
 
-        assert(earliest_stream); // incorrect accounting of buffered sizes?
-        struct demux_stream *ds = earliest_stream;
+        assert(ds); // incorrect accounting of buffered sizes?
         struct demux_queue *queue = range->streams[ds->index];
 
         // Prune all packets until the next keyframe or reader_head. Keeping
@@ -1400,14 +1629,32 @@ static void execute_seek(struct demux_internal *in)
 
     MP_VERBOSE(in, "seek done\n");
 
+    update_stream_snapshot(in);
+
     pthread_mutex_lock(&in->lock);
 }
 
 // Make demuxing progress. Return whether progress was made.
 static bool thread_work(struct demux_internal *in)
 {
+    // Before run_fn, so that a blocking control sees the effects of async
+    // controls that were queued before it.
+    if (in->num_async_ctrls) {
+        struct demux_async_ctrl *c = in->async_ctrls[0];
+        MP_TARRAY_REMOVE_AT(in->async_ctrls, in->num_async_ctrls, 0);
+        pthread_mutex_unlock(&in->lock);
+        run_async_ctrl(in, c);
+        update_stream_snapshot(in);
+        pthread_mutex_lock(&in->lock);
+        return true;
+    }
     if (in->run_fn) {
         in->run_fn(in->run_fn_arg);
+        // (run_fn is only used for controls.) The caller keeps waiting until
+        // run_fn is cleared, so it sees the new state.
+        pthread_mutex_unlock(&in->lock);
+        update_stream_snapshot(in);
+        pthread_mutex_lock(&in->lock);
         in->run_fn = NULL;
         pthread_cond_signal(&in->wakeup);
         return true;
@@ -1434,16 +1681,55 @@ static bool thread_work(struct demux_internal *in)
     return false;
 }
 
+// Forward buffered duration of the stream, or -1 if unknown.
+static double get_fw_secs(struct demux_stream *ds)
+{
+    double last_ts = ds->queue->last_ts, base_ts = ds->base_ts;
+    if (last_ts == MP_NOPTS_VALUE || base_ts == MP_NOPTS_VALUE ||
+        last_ts < base_ts)
+        return -1;
+    return last_ts - base_ts;
+}
+
+// Periodically dump queue state for --dump-stats.
+static void write_stats(struct demux_internal *in)
+{
+    if (!mp_msg_test(in->log, MSGL_STATS))
+        return;
+
+    int64_t now = mp_time_us();
+    if (now - in->last_stats_time < 1000000)
+        return;
+    in->last_stats_time = now;
+
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        if (!ds->selected)
+            continue;
+        const char *t = stream_type_name(ds->type);
+        MP_STATS(in, "value %zd demux-%s%d-packets", ds->fw_packs, t, n);
+        MP_STATS(in, "value %zd demux-%s%d-bytes", ds->fw_bytes, t, n);
+        MP_STATS(in, "value %f demux-%s%d-secs", get_fw_secs(ds), t, n);
+    }
+    MP_STATS(in, "value %"PRId64" demux-wakeups", in->stat_wakeups);
+}
+
 static void *demux_thread(void *pctx)
 {
     struct demux_internal *in = pctx;
     mpthread_set_name("demux");
+    ta_set_thread_account(MP_MEM_DEMUX);
+    mp_thread_set_role(in->d_thread->global, in->log, MP_THREAD_ROLE_DEMUX);
     pthread_mutex_lock(&in->lock);
     while (!in->thread_terminate) {
+        write_stats(in);
         if (thread_work(in))
             continue;
         pthread_cond_signal(&in->wakeup);
+        in->thread_waiting = true;
         pthread_cond_wait(&in->wakeup, &in->lock);
+        in->thread_waiting = false;
+        in->stat_wakeups++;
     }
     pthread_mutex_unlock(&in->lock);
     return NULL;
@@ -1467,6 +1753,15 @@ static struct demux_packet *dequeue_packet(struct demux_stream *ds)
     struct demux_packet *pkt = ds->reader_head;
     ds->reader_head = pkt->next;
 
+    // (Packets returned again after seeking within the cache are not counted.)
+    if (pkt->queue_time) {
+        int64_t wait = mp_time_us() - pkt->queue_time;
+        ds->stat_packets_read++;
+        ds->stat_wait_us += wait;
+        ds->stat_wait_max_us = MPMAX(ds->stat_wait_max_us, wait);
+        pkt->queue_time = 0;
+    }
+
     // Update cached packet queue state.
     ds->fw_packs--;
     size_t bytes = demux_packet_estimate_total_size(pkt);
@@ -1474,7 +1769,11 @@ static struct demux_packet *dequeue_packet(struct demux_stream *ds)
     ds->in->fw_bytes -= bytes;
 
     // The returned packet is mutated etc. and will be owned by the user.
-    pkt = demux_copy_packet(pkt);
+    if (pkt->spill_pos >= 0) {
+        pkt = demux_spill_read(ds->in->spill, pkt);
+    } else {
+        pkt = demux_copy_packet(pkt);
+    }
     if (!pkt)
         abort();
     pkt->next = NULL;
@@ -1544,7 +1843,8 @@ struct demux_packet *demux_read_packet(struct sh_stream *sh)
         }
     }
     struct demux_packet *pkt = dequeue_packet(ds);
-    pthread_cond_signal(&in->wakeup); // possibly read more
+    if (in->thread_waiting)
+        pthread_cond_broadcast(&in->wakeup); // possibly read more
     pthread_mutex_unlock(&in->lock);
     return pkt;
 }
@@ -1575,7 +1875,9 @@ int demux_read_packet_async(struct sh_stream *sh, struct demux_packet **out_pkt)
             r = *out_pkt ? 1 : (ds->eof ? -1 : 0);
             ds->in->reading = true; // enable readahead
             ds->in->eof = false; // force retry
-            pthread_cond_signal(&ds->in->wakeup); // possibly read more
+            // (If the thread is not waiting, it rechecks the state anyway.)
+            if (ds->in->thread_waiting)
+                pthread_cond_broadcast(&ds->in->wakeup); // possibly read more
         } else {
             r = *out_pkt ? 1 : -1;
         }
@@ -1859,6 +2161,8 @@ static void demux_init_cache(struct demuxer *demuxer)
     char *base = NULL;
     stream_control(stream, STREAM_CTRL_GET_BASE_FILENAME, &base);
     in->stream_base_filename = talloc_steal(demuxer, base);
+
+    stream_update_snapshot(stream, in, &in->stream_snapshot);
 }
 
 static void demux_init_cuesheet(struct demuxer *demuxer)
@@ -1924,6 +2228,7 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         return NULL;
 
     struct demuxer *demuxer = talloc_ptrtype(NULL, demuxer);
+    ta_set_account(demuxer, MP_MEM_DEMUX);
     struct demux_opts *opts = mp_get_config_group(demuxer, global, &demux_conf);
     *demuxer = (struct demuxer) {
         .desc = desc,
@@ -1952,7 +2257,14 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         .max_bytes = opts->max_bytes,
         .max_bytes_bw = opts->max_bytes_bw,
         .initial_state = true,
+        .packet_pool = demux_packet_pool_create(),
+        .max_spill_bytes = opts->max_spill_bytes,
+        .spill_dir = mp_get_user_path(demuxer, global, opts->spill_dir),
     };
+    for (int n = 0; n < STREAM_TYPE_COUNT; n++) {
+        in->reserve_bytes[n] = opts->reserve_bytes[n];
+        in->reserve_secs[n] = opts->reserve_secs[n];
+    }
     pthread_mutex_init(&in->lock, NULL);
     pthread_cond_init(&in->wakeup, NULL);
 
@@ -1982,7 +2294,14 @@ static struct demuxer *open_given_type(struct mpv_global *global,
     stream_peek(stream, STREAM_BUFFER_SIZE);
 
     in->d_thread->params = params; // temporary during open()
+    struct demux_packet_pool *prev_pool =
+        demux_packet_pool_set_current(in->packet_pool);
+    int64_t open_start = mp_time_us();
     int ret = demuxer->desc->open(in->d_thread, check);
+    demux_packet_pool_set_current(prev_pool);
+    mp_dbg(log, "Demuxer %s %s after %.3f ms.\n", desc->name,
+           ret >= 0 ? "succeeded" : "failed",
+           (mp_time_us() - open_start) / 1000.0);
     if (ret >= 0) {
         in->d_thread->params = NULL;
         if (in->d_thread->filetype)
@@ -2037,6 +2356,183 @@ static const int d_normal[]  = {DEMUX_CHECK_NORMAL, DEMUX_CHECK_UNSAFE, -1};
 static const int d_request[] = {DEMUX_CHECK_REQUEST, -1};
 static const int d_force[]   = {DEMUX_CHECK_FORCE, -1};
 
+// Amount of data the parallel probes (--demuxer-probe-threads) get to see.
+#define PROBE_PREFIX_SIZE (512 * 1024)
+
+// One demuxer/check level combination, in the same order as demux_open()
+// would try them.
+struct probe_task {
+    const struct demuxer_desc *desc;
+    enum demux_check level;
+    bool done;
+    bool success;
+    bool incomplete;    // result might differ with the real stream
+    double time_ms;
+};
+
+struct probe_ctx {
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    pthread_t *threads;
+    int num_threads;
+
+    // Immutable while threads are running.
+    struct mpv_global *global;
+    struct mp_log *log;
+    struct stream *stream;  // real stream, only used for copying metadata
+    struct demuxer_params params;
+    bstr prefix;
+    int64_t size;
+
+    // Protected by lock.
+    struct probe_task *tasks;
+    int num_tasks;
+    int next_task;
+    bool terminate;
+};
+
+static void *probe_thread(void *pctx)
+{
+    struct probe_ctx *ctx = pctx;
+    mpthread_set_name("demux-probe");
+
+    pthread_mutex_lock(&ctx->lock);
+    while (!ctx->terminate && ctx->next_task < ctx->num_tasks) {
+        struct probe_task *task = &ctx->tasks[ctx->next_task++];
+        pthread_mutex_unlock(&ctx->lock);
+
+        int64_t start = mp_time_us();
+        struct stream *s = open_prefix_stream(ctx->stream, ctx->prefix, ctx->size);
+        struct demuxer_params params = ctx->params;
+        struct demuxer *demuxer = open_given_type(ctx->global, ctx->log,
+                                                  task->desc, s, &params,
+                                                  task->level);
+        bool success = !!demuxer;
+        free_demuxer(demuxer);
+        bool incomplete = prefix_stream_incomplete(s);
+        free_stream(s);
+
+        pthread_mutex_lock(&ctx->lock);
+        task->success = success;
+        task->incomplete = incomplete;
+        task->time_ms = (mp_time_us() - start) / 1000.0;
+        task->done = true;
+        pthread_cond_broadcast(&ctx->wakeup);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+// Parallel probing runs the demuxers' open functions on a copy of the start
+// of the stream. This is restricted to plain byte streams, because some
+// demuxers check the stream implementation, or access its internals.
+static bool can_probe_in_parallel(struct stream *stream)
+{
+    struct stream *cur = stream;
+    while (cur->underlying)
+        cur = cur->underlying;
+    const char *name = cur->info ? cur->info->name : "";
+    return strcmp(name, "file") == 0 || strcmp(name, "ffmpeg") == 0 ||
+           strcmp(name, "smb") == 0;
+}
+
+static struct probe_ctx *start_probing(struct mpv_global *global,
+                                       struct mp_log *log,
+                                       struct stream *stream,
+                                       struct demuxer_params *params,
+                                       const int *check_levels, int threads)
+{
+    if (threads < 1 || (params && params->timeline) ||
+        !can_probe_in_parallel(stream))
+        return NULL;
+
+    struct probe_ctx *ctx = talloc_ptrtype(NULL, ctx);
+    *ctx = (struct probe_ctx){
+        .global = global,
+        .log = mp_log_new(ctx, log, "probe"),
+        .stream = stream,
+        .size = stream_get_size(stream),
+    };
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_cond_init(&ctx->wakeup, NULL);
+
+    if (params)
+        ctx->params = *params;
+    // Avoid side effects. The real open does them.
+    ctx->params.matroska_was_valid = NULL;
+    ctx->params.disable_timeline = true;
+    ctx->params.initial_readahead = false;
+
+    for (int pass = 0; check_levels[pass] != -1; pass++) {
+        for (int n = 0; demuxer_list[n]; n++) {
+            struct probe_task task = {demuxer_list[n], check_levels[pass]};
+            MP_TARRAY_APPEND(ctx, ctx->tasks, ctx->num_tasks, task);
+        }
+    }
+
+    if (stream->seekable)
+        stream_seek(stream, 0);
+    ctx->prefix = bstrdup(ctx, stream_peek(stream, PROBE_PREFIX_SIZE));
+
+    ctx->threads = talloc_array(ctx, pthread_t, threads);
+    for (int n = 0; n < threads; n++) {
+        if (pthread_create(&ctx->threads[n], NULL, probe_thread, ctx))
+            break;
+        ctx->num_threads++;
+    }
+    if (!ctx->num_threads) {
+        pthread_mutex_destroy(&ctx->lock);
+        pthread_cond_destroy(&ctx->wakeup);
+        talloc_free(ctx);
+        return NULL;
+    }
+    mp_verbose(log, "Probing with %d threads on %zu bytes.\n",
+               ctx->num_threads, ctx->prefix.len);
+    return ctx;
+}
+
+// Wait for the result of the given task. Returns false if the demuxer
+// certainly fails on the real stream, so there's no need to try it.
+static bool probe_result(struct probe_ctx *ctx, int task_index)
+{
+    if (!ctx)
+        return true;
+    assert(task_index < ctx->num_tasks);
+    struct probe_task *task = &ctx->tasks[task_index];
+    pthread_mutex_lock(&ctx->lock);
+    while (!task->done)
+        pthread_cond_wait(&ctx->wakeup, &ctx->lock);
+    bool r = task->success || task->incomplete;
+    pthread_mutex_unlock(&ctx->lock);
+    return r;
+}
+
+static void stop_probing(struct probe_ctx *ctx)
+{
+    if (!ctx)
+        return;
+    pthread_mutex_lock(&ctx->lock);
+    ctx->terminate = true;
+    pthread_mutex_unlock(&ctx->lock);
+    for (int n = 0; n < ctx->num_threads; n++)
+        pthread_join(ctx->threads[n], NULL);
+
+    for (int n = 0; n < ctx->num_tasks; n++) {
+        struct probe_task *task = &ctx->tasks[n];
+        if (task->done) {
+            mp_verbose(ctx->log, "%s (level=%s): %s%s, %.3f ms\n",
+                       task->desc->name, d_level(task->level),
+                       task->success ? "success" : "failure",
+                       task->incomplete ? " (needs more data)" : "",
+                       task->time_ms);
+        }
+    }
+
+    pthread_mutex_destroy(&ctx->lock);
+    pthread_cond_destroy(&ctx->wakeup);
+    talloc_free(ctx);
+}
+
 // params can be NULL
 struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
                            struct mpv_global *global)
@@ -2045,6 +2541,7 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
     const struct demuxer_desc *check_desc = NULL;
     struct mp_log *log = mp_log_new(NULL, global->log, "!demux");
     struct demuxer *demuxer = NULL;
+    struct probe_ctx *probe = NULL;
     char *force_format = params ? params->force_format : NULL;
 
     if (!force_format)
@@ -2066,13 +2563,25 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
         }
     }
 
+    if (!check_desc) {
+        void *tmp = talloc_new(NULL);
+        struct demux_opts *opts = mp_get_config_group(tmp, global, &demux_conf);
+        probe = start_probing(global, log, stream, params, check_levels,
+                              opts->probe_threads);
+        talloc_free(tmp);
+    }
+
     // Test demuxers from first to last, one pass for each check_levels[] entry
+    int task_index = 0;
     for (int pass = 0; check_levels[pass] != -1; pass++) {
         enum demux_check level = check_levels[pass];
         mp_verbose(log, "Trying demuxers for level=%s.\n", d_level(level));
         for (int n = 0; demuxer_list[n]; n++) {
             const struct demuxer_desc *desc = demuxer_list[n];
             if (!check_desc || desc == check_desc) {
+                // (Tasks are only created if check_desc is not set.)
+                if (!probe_result(probe, task_index++))
+                    continue;
                 demuxer = open_given_type(global, log, desc, stream, params, level);
                 if (demuxer) {
                     talloc_steal(demuxer, log);
@@ -2084,6 +2593,7 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
     }
 
 done:
+    stop_probing(probe);
     talloc_free(log);
     return demuxer;
 }
@@ -2140,6 +2650,193 @@ void demux_flush(demuxer_t *demuxer)
     pthread_mutex_unlock(&demuxer->in->lock);
 }
 
+static double range_sort_ts(struct demux_cached_range *range)
+{
+    return range->seek_start == MP_NOPTS_VALUE ? INFINITY : range->seek_start;
+}
+
+// Write the packets cur[n] up to (excluding) end[n] to the recorder, interleaved
+// by DTS. end can be NULL to write until the end of each packet list.
+static void dump_packets(struct demux_internal *in, struct demux_packet **cur,
+                         struct demux_packet **end, int num_streams,
+                         struct mp_recorder *rec, int *sink_map)
+{
+    while (1) {
+        int next = -1;
+        double next_ts = INFINITY;
+        for (int n = 0; n < num_streams; n++) {
+            if (!cur[n] || (end && cur[n] == end[n]))
+                continue;
+            double ts = PTS_OR_DEF(cur[n]->dts, cur[n]->pts);
+            if (ts == MP_NOPTS_VALUE) {
+                next = n; // keep packets without timestamps in stream order
+                break;
+            }
+            if (next < 0 || ts < next_ts) {
+                next = n;
+                next_ts = ts;
+            }
+        }
+        if (next < 0)
+            break;
+
+        struct demux_packet *dp = cur[next];
+        cur[next] = dp->next;
+
+        struct mp_recorder_sink *sink = mp_recorder_get_sink(rec, sink_map[next]);
+        if (dp->spill_pos >= 0) {
+            struct demux_packet *copy = demux_spill_read(in->spill, dp);
+            if (copy)
+                mp_recorder_feed_packet(sink, copy);
+            talloc_free(copy);
+        } else {
+            mp_recorder_feed_packet(sink, dp);
+        }
+    }
+}
+
+// Write the packets of a cached range to the recorder, interleaved by DTS.
+static void dump_cached_range(struct demux_internal *in,
+                              struct demux_cached_range *range,
+                              struct mp_recorder *rec, int *sink_map)
+{
+    struct demux_packet **cur = talloc_zero_array(NULL, struct demux_packet *,
+                                                  range->num_streams);
+    for (int n = 0; n < range->num_streams; n++) {
+        if (sink_map[n] >= 0)
+            cur[n] = range->streams[n]->head;
+    }
+
+    dump_packets(in, cur, NULL, range->num_streams, rec, sink_map);
+
+    talloc_free(cur);
+}
+
+// Write all cached packets to the given file (the format is guessed from the
+// file extension). Cached ranges are written in order of their timestamps,
+// with discontinuities between them. This blocks the demuxer thread until the
+// file was written. Returns success.
+bool demux_cache_dump(struct demuxer *demuxer, const char *filename)
+{
+    struct demux_internal *in = demuxer->in;
+    assert(demuxer == in->d_user);
+
+    bool ok = false;
+    pthread_mutex_lock(&in->lock);
+
+    struct sh_stream **streams = NULL;
+    int num_streams = 0;
+    int *sink_map = talloc_array(NULL, int, in->num_streams);
+    for (int n = 0; n < in->num_streams; n++) {
+        sink_map[n] = -1;
+        if (in->streams[n]->ds->selected) {
+            sink_map[n] = num_streams;
+            MP_TARRAY_APPEND(sink_map, streams, num_streams, in->streams[n]);
+        }
+    }
+
+    struct mp_recorder *rec =
+        mp_recorder_create(demuxer->global, filename, streams, num_streams);
+    if (!rec)
+        goto done;
+
+    struct demux_cached_range **ranges =
+        talloc_memdup(sink_map, in->ranges, in->num_ranges * sizeof(ranges[0]));
+    int num_ranges = in->num_ranges;
+    // Few ranges; a simple insertion sort is fine.
+    for (int n = 1; n < num_ranges; n++) {
+        for (int i = n; i > 0; i--) {
+            if (range_sort_ts(ranges[i - 1]) <= range_sort_ts(ranges[i]))
+                break;
+            MPSWAP(struct demux_cached_range *, ranges[i - 1], ranges[i]);
+        }
+    }
+
+    for (int n = 0; n < num_ranges; n++) {
+        if (n > 0) {
+            mp_recorder_flush(rec);
+            mp_recorder_mark_discontinuity(rec);
+        }
+        dump_cached_range(in, ranges[n], rec, sink_map);
+        MP_VERBOSE(in, "Dumped cached range %f - %f.\n",
+                   ranges[n]->seek_start, ranges[n]->seek_end);
+    }
+
+    for (int n = 0; n < num_streams; n++)
+        mp_recorder_feed_packet(mp_recorder_get_sink(rec, n), NULL);
+    mp_recorder_destroy(rec);
+    ok = true;
+
+done:
+    pthread_mutex_unlock(&in->lock);
+    talloc_free(sink_map);
+    return ok;
+}
+
+// Write the packets of the last secs seconds before the current decoder
+// position (i.e. the back buffer of the current range) to the recorder. This is
+// used to start recording in the past. streams[n] is the stream for sink n of
+// the recorder; streams which don't belong to this demuxer are skipped. Each
+// stream starts at the last keyframe at or before the target time (or the
+// oldest cached keyframe). The caller must not feed the recorder with packets
+// read before this call, and must feed it with all packets read after it.
+void demux_cache_dump_backlog(struct demuxer *demuxer, double secs,
+                              struct mp_recorder *rec,
+                              struct sh_stream **streams, int num_streams)
+{
+    struct demux_internal *in = demuxer->in;
+    assert(demuxer == in->d_user);
+
+    pthread_mutex_lock(&in->lock);
+
+    int *sink_map = talloc_array(NULL, int, in->num_streams);
+    struct demux_packet **cur =
+        talloc_zero_array(sink_map, struct demux_packet *, in->num_streams);
+    struct demux_packet **end =
+        talloc_zero_array(sink_map, struct demux_packet *, in->num_streams);
+
+    for (int n = 0; n < in->num_streams; n++)
+        sink_map[n] = -1;
+
+    double end_ts = MP_NOPTS_VALUE;
+    for (int n = 0; n < num_streams; n++) {
+        struct demux_stream *ds = streams[n]->ds;
+        if (!ds || ds->in != in)
+            continue;
+        sink_map[ds->index] = n;
+        end_ts = MP_PTS_MAX(end_ts, ds->base_ts);
+    }
+
+    int num_packets = 0;
+    if (end_ts != MP_NOPTS_VALUE) {
+        double start_ts = end_ts - secs;
+        for (int n = 0; n < in->num_streams; n++) {
+            struct demux_stream *ds = in->streams[n]->ds;
+            if (sink_map[n] < 0)
+                continue;
+            end[n] = ds->reader_head;
+            for (struct demux_packet *dp = ds->queue->head;
+                 dp && dp != ds->reader_head; dp = dp->next)
+            {
+                double ts = PTS_OR_DEF(dp->pts, dp->dts);
+                if (dp->keyframe && (!cur[n] ||
+                    (ts != MP_NOPTS_VALUE && ts <= start_ts)))
+                    cur[n] = dp;
+            }
+            for (struct demux_packet *dp = cur[n]; dp && dp != end[n];
+                 dp = dp->next)
+                num_packets++;
+        }
+    }
+
+    dump_packets(in, cur, end, in->num_streams, rec, sink_map);
+
+    MP_VERBOSE(in, "Dumped %d backlog packets.\n", num_packets);
+
+    pthread_mutex_unlock(&in->lock);
+    talloc_free(sink_map);
+}
+
 // Does some (but not all) things for switching to another range.
 static void switch_current_range(struct demux_internal *in,
                                  struct demux_cached_range *range)
@@ -2187,19 +2884,27 @@ static void switch_current_range(struct demux_internal *in,
 static struct demux_packet *find_seek_target(struct demux_queue *queue,
                                              double pts, int flags)
 {
-    struct demux_packet *start = queue->head;
-    for (int n = 0; n < queue->num_index; n++) {
-        if (queue->index[n]->kf_seek_pts > pts)
-            break;
-        start = queue->index[n];
+    struct demux_packet **index = queue->index + queue->index_start;
+    double *index_pts = queue->index_pts + queue->index_start;
+
+    // Binary search for the first entry after the last one with pts <= pts.
+    int lo = 0, hi = queue->num_index;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (index_pts[mid] > pts) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
     }
 
+    // The index contains all possible targets, so we never need to walk the
+    // packet list itself.
     struct demux_packet *target = NULL;
     double target_diff = MP_NOPTS_VALUE;
-    for (struct demux_packet *dp = start; dp; dp = dp->next) {
+    for (int n = MPMAX(lo - 1, 0); n < queue->num_index; n++) {
+        struct demux_packet *dp = index[n];
         double range_pts = dp->kf_seek_pts;
-        if (!dp->keyframe || range_pts == MP_NOPTS_VALUE)
-            continue;
 
         double diff = range_pts - pts;
         if (flags & SEEK_FORWARD) {
@@ -2566,19 +3271,58 @@ static void update_cache(struct demux_internal *in)
     // Don't lock while querying the stream.
     struct mp_tags *stream_metadata = NULL;
     struct stream_cache_info stream_cache_info = {.size = -1};
+    struct stream_connection_info stream_conn_info = {0};
+    struct stream_io_stats stream_io_stats = {0};
 
     int64_t stream_size = stream_get_size(stream);
     stream_control(stream, STREAM_CTRL_GET_METADATA, &stream_metadata);
     stream_control(stream, STREAM_CTRL_GET_CACHE_INFO, &stream_cache_info);
+    stream_control(stream, STREAM_CTRL_GET_CONNECTION_INFO, &stream_conn_info);
+    stream_control(stream, STREAM_CTRL_GET_IO_STATS, &stream_io_stats);
+
+    double net_throughput = 0;
+    if (demuxer->desc->control)
+        demuxer->desc->control(demuxer, DEMUXER_CTRL_GET_NET_THROUGHPUT,
+                               &net_throughput);
 
     pthread_mutex_lock(&in->lock);
+    in->net_throughput = net_throughput;
     in->stream_size = stream_size;
     in->stream_cache_info = stream_cache_info;
+    in->stream_conn_info = stream_conn_info;
+    in->stream_io_stats = stream_io_stats;
     if (stream_metadata) {
         talloc_free(in->stream_metadata);
         in->stream_metadata = talloc_steal(in, stream_metadata);
         in->d_buffer->events |= DEMUX_EVENT_METADATA;
     }
+    // Let the stream cache size its readahead by how fast data is consumed.
+    double bitrate = 0;
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        if (ds->selected && ds->bitrate > 0)
+            bitrate += ds->bitrate;
+    }
+    bool bitrate_changed = bitrate != in->stream_bitrate;
+    in->stream_bitrate = bitrate;
+    pthread_mutex_unlock(&in->lock);
+
+    if (bitrate_changed)
+        stream_control(stream, STREAM_CTRL_SET_BITRATE, &bitrate);
+}
+
+// Refresh the state that is expected to change only due to STREAM_CTRLs or
+// seeks, so this is not done on every packet like update_cache().
+// must be called not locked
+static void update_stream_snapshot(struct demux_internal *in)
+{
+    struct stream_snapshot snap = {0};
+    stream_update_snapshot(in->d_thread->stream, NULL, &snap);
+
+    pthread_mutex_lock(&in->lock);
+    talloc_free(in->stream_snapshot.channel_name);
+    in->stream_snapshot = snap;
+    talloc_steal(in, snap.channel_name);
     pthread_mutex_unlock(&in->lock);
 }
 
@@ -2597,6 +3341,14 @@ static int cached_stream_control(struct demux_internal *in, int cmd, void *arg)
             return STREAM_UNSUPPORTED;
         *(struct stream_cache_info *)arg = in->stream_cache_info;
         return STREAM_OK;
+    case STREAM_CTRL_GET_IO_STATS:
+        *(struct stream_io_stats *)arg = in->stream_io_stats;
+        return STREAM_OK;
+    case STREAM_CTRL_GET_CONNECTION_INFO:
+        if (!in->stream_conn_info.num_connections)
+            return STREAM_UNSUPPORTED;
+        *(struct stream_connection_info *)arg = in->stream_conn_info;
+        return STREAM_OK;
     case STREAM_CTRL_GET_SIZE:
         if (in->stream_size < 0)
             return STREAM_UNSUPPORTED;
@@ -2608,7 +3360,7 @@ static int cached_stream_control(struct demux_internal *in, int cmd, void *arg)
         *(char **)arg = talloc_strdup(NULL, in->stream_base_filename);
         return STREAM_OK;
     }
-    return STREAM_ERROR;
+    return stream_snapshot_control(&in->stream_snapshot, cmd, arg);
 }
 
 // must be called locked
@@ -2634,6 +3386,35 @@ static int cached_demux_control(struct demux_internal *in, int cmd, void *arg)
         }
         return CONTROL_OK;
     }
+    case DEMUXER_CTRL_GET_STATS: {
+        struct demux_ctrl_stats *r = arg;
+        *r = (struct demux_ctrl_stats){
+            .ta_parent = r->ta_parent,
+            .reads = in->stat_reads,
+            .read_time = in->stat_read_us / 1e6,
+            .read_time_max = in->stat_read_max_us / 1e6,
+            .thread_wakeups = in->stat_wakeups,
+        };
+        r->streams = talloc_array(r->ta_parent, struct demux_stream_stats,
+                                  in->num_streams);
+        r->num_streams = in->num_streams;
+        for (int n = 0; n < in->num_streams; n++) {
+            struct demux_stream *ds = in->streams[n]->ds;
+            r->streams[n] = (struct demux_stream_stats){
+                .index = ds->index,
+                .type = ds->type,
+                .selected = ds->selected,
+                .fw_packets = ds->fw_packs,
+                .fw_bytes = ds->fw_bytes,
+                .fw_secs = get_fw_secs(ds),
+                .packets_read = ds->stat_packets_read,
+                .wait_avg = ds->stat_packets_read ?
+                    ds->stat_wait_us / 1e6 / ds->stat_packets_read : 0,
+                .wait_max = ds->stat_wait_max_us / 1e6,
+            };
+        }
+        return CONTROL_OK;
+    }
     case DEMUXER_CTRL_GET_READER_STATE: {
         struct demux_ctrl_reader_state *r = arg;
         *r = (struct demux_ctrl_reader_state){
@@ -2644,6 +3425,9 @@ static int cached_demux_control(struct demux_internal *in, int cmd, void *arg)
             .total_bytes = in->total_bytes,
             .fw_bytes = in->fw_bytes,
         };
+        demux_packet_pool_get_stats(in->packet_pool, &r->packet_pool);
+        r->spilled_bytes = demux_spill_get_bytes(in->spill);
+        r->net_throughput = in->net_throughput;
         bool any_packets = false;
         for (int n = 0; n < in->num_streams; n++) {
             struct demux_stream *ds = in->streams[n]->ds;
@@ -2684,6 +3468,7 @@ struct demux_control_args {
     int cmd;
     void *arg;
     int *r;
+    bool async;
 };
 
 static void thread_demux_control(void *p)
@@ -2693,18 +3478,19 @@ static void thread_demux_control(void *p)
     int cmd = args->cmd;
     void *arg = args->arg;
     struct demux_internal *in = demuxer->in;
+    bool log = in->threading && !args->async;
     int r = CONTROL_UNKNOWN;
 
     if (cmd == DEMUXER_CTRL_STREAM_CTRL) {
         struct demux_ctrl_stream_ctrl *c = arg;
-        if (in->threading)
+        if (log)
             MP_VERBOSE(demuxer, "blocking for STREAM_CTRL %d\n", c->ctrl);
         c->res = stream_control(demuxer->stream, c->ctrl, c->arg);
         if (c->res != STREAM_UNSUPPORTED)
             r = CONTROL_OK;
     }
     if (r != CONTROL_OK) {
-        if (in->threading)
+        if (log)
             MP_VERBOSE(demuxer, "blocking for DEMUXER_CTRL %d\n", cmd);
         if (demuxer->desc->control)
             r = demuxer->desc->control(demuxer->in->d_thread, cmd, arg);
@@ -2713,6 +3499,99 @@ static void thread_demux_control(void *p)
     *args->r = r;
 }
 
+struct demux_async_ctrl {
+    int cmd;
+    void *arg;
+    struct demux_ctrl_stream_ctrl stream_ctrl; // for DEMUXER_CTRL_STREAM_CTRL
+    void (*cb)(void *ctx, int res);
+    void *cb_ctx;
+};
+
+// Execute and free c. The callback gets the STREAM_CTRL result for stream
+// controls, and the DEMUXER_CTRL result otherwise.
+// must be called not locked
+static void run_async_ctrl(struct demux_internal *in,
+                           struct demux_async_ctrl *c)
+{
+    int r = 0;
+    struct demux_control_args args = {in->d_user, c->cmd, c->arg, &r, true};
+    thread_demux_control(&args);
+    if (c->cmd == DEMUXER_CTRL_STREAM_CTRL)
+        r = c->stream_ctrl.res;
+    if (c->cb)
+        c->cb(c->cb_ctx, r);
+    talloc_free(c);
+}
+
+// Call the callbacks of controls that never got to run.
+static void cancel_async_ctrls(struct demux_internal *in)
+{
+    for (int n = 0; n < in->num_async_ctrls; n++) {
+        struct demux_async_ctrl *c = in->async_ctrls[n];
+        if (c->cb) {
+            c->cb(c->cb_ctx, c->cmd == DEMUXER_CTRL_STREAM_CTRL ? STREAM_ERROR
+                                                               : CONTROL_ERROR);
+        }
+        talloc_free(c);
+    }
+    in->num_async_ctrls = 0;
+}
+
+// Like demux_control(), but queue the control to the demuxer thread instead
+// of waiting for it. cb(ctx, res) is called once the control was run, or with
+// an error if the demuxer is destroyed before that. It is called on the
+// demuxer thread (or within this function if the demuxer is not threaded),
+// without any demuxer locks held. arg must stay valid until then. cb can be
+// NULL.
+void demux_control_async(struct demuxer *demuxer, int cmd, void *arg,
+                         void (*cb)(void *ctx, int res), void *ctx)
+{
+    struct demux_internal *in = demuxer->in;
+    assert(demuxer == in->d_user);
+
+    struct demux_async_ctrl *c = talloc_ptrtype(NULL, c);
+    *c = (struct demux_async_ctrl){cmd, arg, .cb = cb, .cb_ctx = ctx};
+
+    if (!in->threading) {
+        run_async_ctrl(in, c);
+        update_stream_snapshot(in);
+        return;
+    }
+
+    pthread_mutex_lock(&in->lock);
+    MP_TARRAY_APPEND(in, in->async_ctrls, in->num_async_ctrls, c);
+    pthread_cond_signal(&in->wakeup);
+    pthread_mutex_unlock(&in->lock);
+}
+
+// See demux_control_async(). cb gets the STREAM_CTRL result.
+void demux_stream_control_async(struct demuxer *demuxer, int ctrl, void *arg,
+                                void (*cb)(void *ctx, int res), void *ctx)
+{
+    struct demux_internal *in = demuxer->in;
+    assert(demuxer == in->d_user);
+
+    struct demux_async_ctrl *c = talloc_ptrtype(NULL, c);
+    *c = (struct demux_async_ctrl){
+        .cmd = DEMUXER_CTRL_STREAM_CTRL,
+        .stream_ctrl = {ctrl, arg, STREAM_UNSUPPORTED},
+        .cb = cb,
+        .cb_ctx = ctx,
+    };
+    c->arg = &c->stream_ctrl;
+
+    if (!in->threading) {
+        run_async_ctrl(in, c);
+        update_stream_snapshot(in);
+        return;
+    }
+
+    pthread_mutex_lock(&in->lock);
+    MP_TARRAY_APPEND(in, in->async_ctrls, in->num_async_ctrls, c);
+    pthread_cond_signal(&in->wakeup);
+    pthread_mutex_unlock(&in->lock);
+}
+
 int demux_control(demuxer_t *demuxer, int cmd, void *arg)
 {
     struct demux_internal *in = demuxer->in;
@@ -37,7 +37,9 @@ enum demux_ctrl {
     DEMUXER_CTRL_STREAM_CTRL,
     DEMUXER_CTRL_GET_READER_STATE,
     DEMUXER_CTRL_GET_BITRATE_STATS, // double[STREAM_TYPE_COUNT]
+    DEMUXER_CTRL_GET_STATS,         // struct demux_ctrl_stats*
     DEMUXER_CTRL_REPLACE_STREAM,
+    DEMUXER_CTRL_GET_NET_THROUGHPUT, // double* (bits/s)
 };
 
 #define MAX_SEEK_RANGES 10
@@ -57,6 +59,36 @@ struct demux_ctrl_reader_state {
     // level seek.
     int num_seek_ranges;
     struct demux_seek_range seek_ranges[MAX_SEEK_RANGES];
+    struct demux_packet_pool_stats packet_pool;
+    int64_t spilled_bytes;
+    // Download rate measured by the demuxer's own network accesses (such as
+    // HLS segment prefetching), in bits/s. 0 if unknown.
+    double net_throughput;
+};
+
+struct demux_stream_stats {
+    int index;              // sh_stream.index
+    int type;               // enum stream_type
+    bool selected;
+    // Forward packet queue depth.
+    int64_t fw_packets;
+    int64_t fw_bytes;
+    double fw_secs;         // -1 if unknown
+    // Packets returned to the reader for the first time, and how long they
+    // were queued between demux_add_packet() and being returned (seconds).
+    int64_t packets_read;
+    double wait_avg;
+    double wait_max;
+};
+
+struct demux_ctrl_stats {
+    void *ta_parent;        // (in) allocation parent for streams[]
+    int64_t reads;          // calls to the demuxer's fill_buffer callback
+    double read_time;       // total time spent in them (seconds)
+    double read_time_max;
+    int64_t thread_wakeups; // times the demuxer thread was woken up
+    struct demux_stream_stats *streams;
+    int num_streams;
 };
 
 struct demux_ctrl_stream_ctrl {
@@ -275,6 +307,11 @@ void demux_set_wakeup_cb(struct demuxer *demuxer, void (*cb)(void *ctx), void *c
 bool demux_cancel_test(struct demuxer *demuxer);
 
 void demux_flush(struct demuxer *demuxer);
+bool demux_cache_dump(struct demuxer *demuxer, const char *filename);
+struct mp_recorder;
+void demux_cache_dump_backlog(struct demuxer *demuxer, double secs,
+                              struct mp_recorder *rec,
+                              struct sh_stream **streams, int num_streams);
 int demux_seek(struct demuxer *demuxer, double rel_seek_secs, int flags);
 void demux_set_ts_offset(struct demuxer *demuxer, double offset);
 
@@ -294,6 +331,10 @@ void demux_set_stream_tags(struct demuxer *demuxer, struct sh_stream *sh,
                            struct mp_tags *tags);
 
 int demux_stream_control(demuxer_t *demuxer, int ctrl, void *arg);
+void demux_control_async(struct demuxer *demuxer, int cmd, void *arg,
+                         void (*cb)(void *ctx, int res), void *ctx);
+void demux_stream_control_async(struct demuxer *demuxer, int ctrl, void *arg,
+                                void (*cb)(void *ctx, int res), void *ctx);
 
 void demux_changed(demuxer_t *demuxer, int events);
 void demux_update(demuxer_t *demuxer);
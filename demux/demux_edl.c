@@ -28,13 +28,34 @@
 #include "demux.h"
 #include "timeline.h"
 #include "common/msg.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
 #include "options/path.h"
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
 #include "common/common.h"
 #include "stream/stream.h"
 
 #define HEADER "# mpv EDL v0\n"
 
+#define OPT_BASE_STRUCT struct demux_edl_opts
+struct demux_edl_opts {
+    int open_threads;
+    int lazy_open;
+};
+
+const struct m_sub_options demux_edl_conf = {
+    .opts = (const m_option_t[]) {
+        OPT_INTRANGE("open-threads", open_threads, 0, 1, 64),
+        OPT_FLAG("lazy-open", lazy_open, 0),
+        {0}
+    },
+    .size = sizeof(struct demux_edl_opts),
+    .defaults = &(const struct demux_edl_opts){
+        .open_threads = 4,
+    },
+};
+
 struct tl_part {
     char *filename;             // what is stream_open()ed
     double offset;              // offset into the source file
@@ -155,17 +176,25 @@ error:
     return NULL;
 }
 
-static struct demuxer *open_source(struct timeline *tl, char *filename)
+static struct demuxer *find_source(struct timeline *tl, char *filename)
 {
     for (int n = 0; n < tl->num_sources; n++) {
         struct demuxer *d = tl->sources[n];
         if (strcmp(d->stream->url, filename) == 0)
             return d;
     }
+    return NULL;
+}
+
+static struct demuxer *open_source(struct timeline *tl, char *filename)
+{
+    struct demuxer *d = find_source(tl, filename);
+    if (d)
+        return d;
     struct demuxer_params params = {
         .init_fragment = tl->init_fragment,
     };
-    struct demuxer *d = demux_open_url(filename, &params, tl->cancel, tl->global);
+    d = demux_open_url(filename, &params, tl->cancel, tl->global);
     if (d) {
         MP_TARRAY_APPEND(tl, tl->sources, tl->num_sources, d);
     } else {
@@ -174,6 +203,83 @@ static struct demuxer *open_source(struct timeline *tl, char *filename)
     return d;
 }
 
+struct source_job {
+    struct timeline *tl;
+    char *filename;
+    struct demuxer *d;
+};
+
+static void open_source_fn(void *ctx)
+{
+    struct source_job *job = ctx;
+    struct demuxer_params params = {
+        .init_fragment = job->tl->init_fragment,
+    };
+    job->d = demux_open_url(job->filename, &params, job->tl->cancel,
+                            job->tl->global);
+}
+
+// Whether the part can be played without opening its source first. This is
+// the case if its position and length within the file are known.
+static bool part_is_lazy(struct demux_edl_opts *opts, struct tl_part *part,
+                         int index)
+{
+    // The first part defines the track layout.
+    return opts->lazy_open && index > 0 && part->offset_set &&
+           part->length >= 0 && !part->chapter_ts;
+}
+
+// Open all sources needed by build_timeline() at once, so open_source() finds
+// them in tl->sources. Return false if any of them failed to open.
+static bool open_sources_parallel(struct timeline *tl, struct tl_parts *parts,
+                                  struct demux_edl_opts *opts)
+{
+    void *tmp = talloc_new(NULL);
+    struct source_job *jobs = NULL;
+    int num_jobs = 0;
+    bool ok = true;
+
+    for (int n = 0; n < parts->num_parts; n++) {
+        struct tl_part *part = &parts->parts[n];
+        if (part_is_lazy(opts, part, n))
+            continue;
+        bool dup = !!find_source(tl, part->filename);
+        for (int i = 0; i < num_jobs; i++)
+            dup |= strcmp(jobs[i].filename, part->filename) == 0;
+        if (!dup) {
+            struct source_job job = {tl, part->filename};
+            MP_TARRAY_APPEND(tmp, jobs, num_jobs, job);
+        }
+    }
+
+    int threads = MPMIN(opts->open_threads, num_jobs);
+    struct mp_thread_pool *pool = NULL;
+    if (threads > 1)
+        pool = mp_thread_pool_create(tmp, threads);
+    if (!pool)
+        goto done; // open them one by one in build_timeline()
+
+    MP_VERBOSE(tl, "Opening %d sources with %d threads...\n", num_jobs, threads);
+    for (int n = 0; n < num_jobs; n++)
+        mp_thread_pool_queue(pool, open_source_fn, &jobs[n]);
+    talloc_free(pool); // waits until all jobs are done
+
+    for (int n = 0; n < num_jobs; n++) {
+        struct source_job *job = &jobs[n];
+        if (job->d) {
+            MP_TARRAY_APPEND(tl, tl->sources, tl->num_sources, job->d);
+        } else {
+            MP_ERR(tl, "EDL: Could not open source file '%s'.\n",
+                   job->filename);
+            ok = false;
+        }
+    }
+
+done:
+    talloc_free(tmp);
+    return ok;
+}
+
 static double demuxer_chapter_time(struct demuxer *demuxer, int n)
 {
     if (n < 0 || n >= demuxer->num_chapters)
@@ -241,6 +347,12 @@ static void build_timeline(struct timeline *tl, struct tl_parts *parts)
         }
     }
 
+    struct demux_edl_opts *opts =
+        mp_get_config_group(tl, tl->global, &demux_edl_conf);
+
+    if (!tl->dash && !open_sources_parallel(tl, parts, opts))
+        goto error;
+
     tl->parts = talloc_array_ptrtype(tl, tl->parts, parts->num_parts + 1);
     double starttime = 0;
     for (int n = 0; n < parts->num_parts; n++) {
@@ -260,6 +372,18 @@ static void build_timeline(struct timeline *tl, struct tl_parts *parts)
                 if (!source)
                     goto error;
             }
+        } else if (part_is_lazy(opts, part, n) &&
+                   !find_source(tl, part->filename))
+        {
+            // Opened on demand by demux_timeline.
+            MP_VERBOSE(tl, "Segment %d will be opened on demand.\n", n);
+
+            struct demux_chapter ch = {
+                .pts = starttime,
+                .metadata = talloc_zero(tl, struct mp_tags),
+            };
+            mp_tags_set_str(ch.metadata, "title", part->filename);
+            MP_TARRAY_APPEND(tl, tl->chapters, tl->num_chapters, ch);
         } else {
             MP_VERBOSE(tl, "Opening segment %d...\n", n);
 
@@ -45,6 +45,7 @@
 
 #include "stream/stream.h"
 #include "demux.h"
+#include "hls_prefetch.h"
 #include "stheader.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
@@ -66,6 +67,7 @@ struct demux_lavf_opts {
     int probescore;
     float analyzeduration;
     int buffersize;
+    int direct_io;
     int allow_mimetype;
     char *format;
     char **avopts;
@@ -73,6 +75,7 @@ struct demux_lavf_opts {
     int genptsmode;
     char *sub_cp;
     int rtsp_transport;
+    int hls_prefetch;
 };
 
 const struct m_sub_options demux_lavf_conf = {
@@ -85,6 +88,7 @@ const struct m_sub_options demux_lavf_conf = {
                        0, 3600),
         OPT_INTRANGE("demuxer-lavf-buffersize", buffersize, 0, 1,
                      10 * 1024 * 1024, OPTDEF_INT(BIO_BUFFER_SIZE)),
+        OPT_FLAG("demuxer-lavf-direct-io", direct_io, 0),
         OPT_FLAG("demuxer-lavf-allow-mimetype", allow_mimetype, 0),
         OPT_INTRANGE("demuxer-lavf-probescore", probescore, 0,
                      1, AVPROBE_SCORE_MAX),
@@ -98,6 +102,7 @@ const struct m_sub_options demux_lavf_conf = {
                 {"udp", 1},
                 {"tcp", 2},
                 {"http", 3})),
+        OPT_INTRANGE("demuxer-lavf-hls-prefetch", hls_prefetch, 0, 0, 16),
         {0}
     },
     .size = sizeof(struct demux_lavf_opts),
@@ -202,6 +207,8 @@ typedef struct lavf_priv {
 
     struct demux_lavf_opts *opts;
     double mf_fps;
+
+    struct hls_prefetch *prefetch;
 } lavf_priv_t;
 
 // At least mp4 has name="mov,mp4,m4a,3gp,3g2,mj2", so we split the name
@@ -315,34 +322,120 @@ static void list_formats(struct demuxer *demuxer)
         MP_INFO(demuxer, "%15s : %s\n", fmt->name, fmt->long_name);
 }
 
+#define CHARSET_MAX_SIZE (128 * 1024 * 1024)
+
+// Read the start, middle, and end of a large seekable stream, cut to whole
+// lines, and rewind it. Returns .start==NULL if the stream is small, not
+// seekable, or on errors.
+static bstr read_charset_sample(stream_t *s, void *talloc_ctx)
+{
+    int64_t size = stream_get_size(s);
+    if (!s->seekable || size <= 3 * MP_CHARSET_SAMPLE_SIZE)
+        return (bstr){0};
+
+    bstr res = {0};
+    char *buf = talloc_size(NULL, MP_CHARSET_SAMPLE_SIZE);
+    for (int n = 0; n < 3; n++) {
+        if (!stream_seek(s, n * (size - MP_CHARSET_SAMPLE_SIZE) / 2)) {
+            res = (bstr){0};
+            break;
+        }
+        int len = stream_read(s, buf, MP_CHARSET_SAMPLE_SIZE);
+        bstr sample = (bstr){buf, MPMAX(len, 0)};
+        bstr_xappend(talloc_ctx, &res, mp_charset_sample_lines(sample, n == 0,
+                                                               n == 2));
+    }
+    talloc_free(buf);
+    if (!stream_seek(s, 0))
+        return (bstr){0};
+    return res;
+}
+
+// Convert the rest of the stream to UTF-8. This reads and converts it in
+// chunks of whole lines, so the complete unconverted data is never in memory.
+static bstr convert_stream(struct demuxer *demuxer, stream_t *s,
+                           const char *cp, void *talloc_ctx)
+{
+    bstr res = {0};
+    int alloc = MP_CHARSET_SAMPLE_SIZE;
+    bstr buf = {talloc_size(NULL, alloc), 0};
+    while (1) {
+        if (buf.len == alloc) {
+            // Very long line; make the chunk larger.
+            alloc *= 2;
+            buf.start = talloc_realloc_size(NULL, buf.start, alloc);
+        }
+        int len = stream_read(s, buf.start + buf.len, alloc - buf.len);
+        bool eof = len <= 0;
+        buf.len += MPMAX(len, 0);
+
+        bstr chunk = mp_charset_sample_lines(buf, true, eof);
+        if (chunk.len) {
+            bstr conv = mp_iconv_to_utf8(demuxer->log, chunk, cp,
+                                         MP_ICONV_VERBOSE);
+            if (conv.start)
+                bstr_xappend(talloc_ctx, &res, conv);
+            if (conv.start != chunk.start)
+                talloc_free(conv.start);
+            memmove(buf.start, buf.start + chunk.len, buf.len - chunk.len);
+            buf.len -= chunk.len;
+        }
+
+        if (res.len > CHARSET_MAX_SIZE) {
+            MP_WARN(demuxer, "File too big - skip charset conversion.\n");
+            talloc_free(res.start);
+            res = (bstr){0};
+            break;
+        }
+        if (eof)
+            break;
+    }
+    talloc_free(buf.start);
+    return res;
+}
+
 static void convert_charset(struct demuxer *demuxer)
 {
     lavf_priv_t *priv = demuxer->priv;
     char *cp = priv->opts->sub_cp;
     if (!cp || mp_charset_is_utf8(cp))
         return;
-    bstr data = stream_read_complete(priv->stream, NULL, 128 * 1024 * 1024);
-    if (!data.start) {
-        MP_WARN(demuxer, "File too big (or error reading) - skip charset probing.\n");
-        return;
+    void *tmp = talloc_new(NULL);
+    // For large files, guess from samples, and convert in chunks. Otherwise
+    // read the file completely.
+    bstr data = {0};
+    bstr sample = read_charset_sample(priv->stream, tmp);
+    if (!sample.start) {
+        data = stream_read_complete(priv->stream, tmp, CHARSET_MAX_SIZE);
+        if (!data.start) {
+            MP_WARN(demuxer, "File too big (or error reading) - skip charset probing.\n");
+            goto done;
+        }
+        sample = data;
     }
-    void *alloc = data.start;
-    cp = (char *)mp_charset_guess(priv, demuxer->log, data, cp, 0);
+    cp = (char *)mp_charset_guess(priv, demuxer->log, sample, cp, 0);
     if (cp && !mp_charset_is_utf8(cp))
         MP_INFO(demuxer, "Using subtitle charset: %s\n", cp);
     // libavformat transparently converts UTF-16 to UTF-8
     if (!mp_charset_is_utf16(cp) && !mp_charset_is_utf8(cp)) {
-        bstr conv = mp_iconv_to_utf8(demuxer->log, data, cp, MP_ICONV_VERBOSE);
+        bstr conv = data.start
+            ? mp_iconv_to_utf8(demuxer->log, data, cp, MP_ICONV_VERBOSE)
+            : convert_stream(demuxer, priv->stream, cp, tmp);
         if (conv.start && conv.start != data.start)
-            talloc_steal(alloc, conv.start);
-        if (conv.start)
+            talloc_steal(tmp, conv.start);
+        if (conv.start) {
             data = conv;
+        } else if (!data.start) {
+            stream_seek(priv->stream, 0);
+        }
     }
+    // (If data is unset, the original stream was rewound and is used as is.)
     if (data.start) {
         priv->stream = open_memory_stream(data.start, data.len);
         priv->own_stream = true;
     }
-    talloc_free(alloc);
+done:
+    talloc_free(tmp);
 }
 
 static char *remove_prefix(char *s, const char *const *prefixes)
@@ -615,6 +708,7 @@ static void handle_new_stream(demuxer_t *demuxer, int i)
         sh = demux_alloc_sh_stream(STREAM_VIDEO);
 
         if (st->disposition & AV_DISPOSITION_ATTACHED_PIC) {
+            sh->codec->image = true;
             sh->attached_picture =
                 new_demux_packet_from_avpacket(&st->attached_pic);
             if (sh->attached_picture) {
@@ -628,8 +722,10 @@ static void handle_new_stream(demuxer_t *demuxer, int i)
         sh->codec->disp_h = codec->height;
         if (st->avg_frame_rate.num)
             sh->codec->fps = av_q2d(st->avg_frame_rate);
-        if (priv->format_hack.image_format)
+        if (priv->format_hack.image_format) {
             sh->codec->fps = priv->mf_fps;
+            sh->codec->image = true;
+        }
         sh->codec->par_w = st->sample_aspect_ratio.num;
         sh->codec->par_h = st->sample_aspect_ratio.den;
 
@@ -772,6 +868,21 @@ static int block_io_open(struct AVFormatContext *s, AVIOContext **pb,
     return AVERROR(EACCES);
 }
 
+static int prefetch_io_open(struct AVFormatContext *s, AVIOContext **pb,
+                            const char *url, int flags, AVDictionary **options)
+{
+    struct demuxer *demuxer = s->opaque;
+    lavf_priv_t *priv = demuxer->priv;
+    return hls_prefetch_io_open(priv->prefetch, pb, url, flags, options);
+}
+
+static void prefetch_io_close(struct AVFormatContext *s, AVIOContext *pb)
+{
+    struct demuxer *demuxer = s->opaque;
+    lavf_priv_t *priv = demuxer->priv;
+    hls_prefetch_io_close(priv->prefetch, pb);
+}
+
 static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
 {
     AVFormatContext *avfc;
@@ -840,6 +951,10 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
         }
         priv->pb->read_seek = mp_read_seek;
         priv->pb->seekable = demuxer->seekable ? AVIO_SEEKABLE_NORMAL : 0;
+        // Let reads bypass the AVIO buffer, so packet data is copied from the
+        // stream buffer (or the file mapping) into the packet directly. Our
+        // stream does its own buffering, so the AVIO buffer is redundant.
+        priv->pb->direct = lavfdopts->direct_io;
         avfc->pb = priv->pb;
         if (stream_control(priv->stream, STREAM_CTRL_HAS_AVSEEK, NULL) > 0)
             demuxer->seekable = true;
@@ -868,8 +983,24 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
     };
 
     avfc->opaque = demuxer;
-    if (!demuxer->access_references)
+    if (!demuxer->access_references) {
         avfc->io_open = block_io_open;
+    } else if (lavfdopts->hls_prefetch &&
+               matches_avinputformat_name(priv, "hls"))
+    {
+        double cache_secs = 0;
+        mp_read_option_raw(demuxer->global, "cache-secs", &m_option_type_double,
+                           &cache_secs);
+        priv->prefetch = hls_prefetch_create(demuxer->log, avfc,
+                                             lavfdopts->hls_prefetch,
+                                             MPMAX(cache_secs, 10));
+        avfc->io_open = prefetch_io_open;
+        avfc->io_close = prefetch_io_close;
+        // Segments are fetched on our own connections; libavformat's
+        // persistent/multiple request handling would bypass io_open.
+        av_dict_set(&dopts, "http_persistent", "0", 0);
+        av_dict_set(&dopts, "http_multiple", "0", 0);
+    }
 
     mp_set_avdict(&dopts, lavfdopts->avopts);
 
@@ -1132,6 +1263,11 @@ redo:
         av_seek_frame(priv->avfc, 0, stream_tell(priv->stream),
                       AVSEEK_FLAG_BYTE);
         return CONTROL_OK;
+    case DEMUXER_CTRL_GET_NET_THROUGHPUT:
+        if (!priv->prefetch)
+            return CONTROL_UNKNOWN;
+        *(double *)arg = hls_prefetch_get_throughput(priv->prefetch);
+        return CONTROL_OK;
     case DEMUXER_CTRL_REPLACE_STREAM:
         if (priv->own_stream)
             free_stream(priv->stream);
@@ -1148,6 +1284,7 @@ static void demux_close_lavf(demuxer_t *demuxer)
     lavf_priv_t *priv = demuxer->priv;
     if (priv) {
         avformat_close_input(&priv->avfc);
+        hls_prefetch_destroy(priv->prefetch);
         if (priv->pb)
             av_freep(&priv->pb->buffer);
         av_freep(&priv->pb);
@@ -17,8 +17,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <assert.h>
 #include <strings.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -30,6 +32,7 @@
 #include "options/m_config.h"
 #include "options/path.h"
 #include "misc/ctype.h"
+#include "misc/thread_pool.h"
 
 #include "stream/stream.h"
 #include "demux.h"
@@ -38,6 +41,8 @@
 
 #define MF_MAX_FILE_SIZE (1024 * 1024 * 256)
 
+struct mf_job;
+
 typedef struct mf {
     struct mp_log *log;
     struct sh_stream *sh;
@@ -46,8 +51,28 @@ typedef struct mf {
     char **names;
     // optional
     struct stream **streams;
+
+    // Readahead (--mf-readahead). jobs[] are the frames starting at
+    // curr_frame, in order. The fields below are protected by lock.
+    struct mpv_global *global;
+    struct mp_thread_pool *pool;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    struct mf_job **jobs;
+    int num_jobs;
+    int max_jobs;
+    int64_t queued_bytes;       // data of finished jobs not yet returned
+    int64_t max_bytes;
 } mf_t;
 
+struct mf_job {
+    mf_t *mf;
+    char *filename;
+    struct demux_packet *pkt;   // result, NULL on failure
+    bool done;
+    bool abandoned;             // freed by the worker when it's done
+};
+
 
 static void mf_add(mf_t *mf, const char *fname)
 {
@@ -160,6 +185,111 @@ static mf_t *open_mf_single(void *talloc_ctx, struct mp_log *log, char *filename
     return mf;
 }
 
+static struct demux_packet *read_image(struct mpv_global *global,
+                                       const char *filename,
+                                       struct stream *stream)
+{
+    struct stream *s = stream;
+    if (!s && filename)
+        s = stream_open(filename, global);
+
+    struct demux_packet *dp = NULL;
+    if (s) {
+        stream_seek(s, 0);
+        bstr data = stream_read_complete(s, NULL, MF_MAX_FILE_SIZE);
+        if (data.len) {
+            dp = new_demux_packet(data.len);
+            if (dp)
+                memcpy(dp->buffer, data.start, data.len);
+        }
+        talloc_free(data.start);
+    }
+
+    if (s && s != stream)
+        free_stream(s);
+    return dp;
+}
+
+static void read_job_fn(void *ctx)
+{
+    struct mf_job *job = ctx;
+    mf_t *mf = job->mf;
+
+    pthread_mutex_lock(&mf->lock);
+    bool skip = job->abandoned;
+    pthread_mutex_unlock(&mf->lock);
+
+    struct demux_packet *pkt = NULL;
+    if (!skip)
+        pkt = read_image(mf->global, job->filename, NULL);
+
+    pthread_mutex_lock(&mf->lock);
+    if (job->abandoned) {
+        talloc_free(pkt);
+        talloc_free(job);
+    } else {
+        job->pkt = pkt;
+        job->done = true;
+        if (pkt)
+            mf->queued_bytes += pkt->len;
+        pthread_cond_broadcast(&mf->wakeup);
+    }
+    pthread_mutex_unlock(&mf->lock);
+}
+
+// Queue reads of the frames following the already queued ones, as far as the
+// limits allow (but at least one). Caller must hold mf->lock.
+static void queue_jobs(mf_t *mf)
+{
+    while (mf->num_jobs < mf->max_jobs &&
+           (!mf->num_jobs || mf->queued_bytes < mf->max_bytes))
+    {
+        int frame = mf->curr_frame + mf->num_jobs;
+        if (frame >= mf->nr_of_files)
+            break;
+        struct mf_job *job = talloc_ptrtype(NULL, job);
+        *job = (struct mf_job){
+            .mf = mf,
+            .filename = talloc_strdup(job, mf->names[frame]),
+        };
+        MP_TARRAY_APPEND(mf, mf->jobs, mf->num_jobs, job);
+        mp_thread_pool_queue(mf->pool, read_job_fn, job);
+    }
+}
+
+// Caller must hold mf->lock.
+static void drop_jobs(mf_t *mf)
+{
+    for (int n = 0; n < mf->num_jobs; n++) {
+        struct mf_job *job = mf->jobs[n];
+        if (job->done) {
+            talloc_free(job->pkt);
+            talloc_free(job);
+        } else {
+            job->abandoned = true;
+        }
+    }
+    mf->num_jobs = 0;
+    mf->queued_bytes = 0;
+}
+
+static struct demux_packet *read_image_readahead(mf_t *mf)
+{
+    pthread_mutex_lock(&mf->lock);
+    queue_jobs(mf);
+    assert(mf->num_jobs > 0);
+    struct mf_job *job = mf->jobs[0];
+    while (!job->done)
+        pthread_cond_wait(&mf->wakeup, &mf->lock);
+    MP_TARRAY_REMOVE_AT(mf->jobs, mf->num_jobs, 0);
+    struct demux_packet *pkt = job->pkt;
+    if (pkt)
+        mf->queued_bytes -= pkt->len;
+    talloc_free(job);
+    pthread_mutex_unlock(&mf->lock);
+    return pkt;
+}
+
 static void demux_seek_mf(demuxer_t *demuxer, double seek_pts, int flags)
 {
     mf_t *mf = demuxer->priv;
@@ -170,6 +300,11 @@ static void demux_seek_mf(demuxer_t *demuxer, double seek_pts, int flags)
         newpos = 0;
     if (newpos >= mf->nr_of_files)
         newpos = mf->nr_of_files;
+    if (mf->pool && newpos != mf->curr_frame) {
+        pthread_mutex_lock(&mf->lock);
+        drop_jobs(mf);
+        pthread_mutex_unlock(&mf->lock);
+    }
     mf->curr_frame = newpos;
 }
 
@@ -182,34 +317,23 @@ static int demux_mf_fill_buffer(demuxer_t *demuxer)
     if (mf->curr_frame >= mf->nr_of_files)
         return 0;
 
-    struct stream *entry_stream = NULL;
-    if (mf->streams)
-        entry_stream = mf->streams[mf->curr_frame];
-    struct stream *stream = entry_stream;
-    if (!stream) {
-        char *filename = mf->names[mf->curr_frame];
-        if (filename)
-            stream = stream_open(filename, demuxer->global);
+    struct demux_packet *dp;
+    if (mf->pool) {
+        dp = read_image_readahead(mf);
+    } else {
+        struct stream *entry_stream = NULL;
+        if (mf->streams)
+            entry_stream = mf->streams[mf->curr_frame];
+        dp = read_image(demuxer->global, mf->names[mf->curr_frame],
+                        entry_stream);
     }
 
-    if (stream) {
-        stream_seek(stream, 0);
-        bstr data = stream_read_complete(stream, NULL, MF_MAX_FILE_SIZE);
-        if (data.len) {
-            demux_packet_t *dp = new_demux_packet(data.len);
-            if (dp) {
-                memcpy(dp->buffer, data.start, data.len);
-                dp->pts = mf->curr_frame / mf->sh->codec->fps;
-                dp->keyframe = true;
-                demux_add_packet(mf->sh, dp);
-            }
-        }
-        talloc_free(data.start);
+    if (dp) {
+        dp->pts = mf->curr_frame / mf->sh->codec->fps;
+        dp->keyframe = true;
+        demux_add_packet(mf->sh, dp);
     }
 
-    if (stream && stream != entry_stream)
-        free_stream(stream);
-
     mf->curr_frame++;
     return 1;
 }
@@ -329,6 +453,7 @@ static int demux_open_mf(demuxer_t *demuxer, enum demux_check check)
     c->disp_h = 0;
     c->fps = mf_fps;
     c->reliable_fps = true;
+    c->image = true;
 
     demux_add_sh_stream(demuxer, sh);
 
@@ -337,6 +462,27 @@ static int demux_open_mf(demuxer_t *demuxer, enum demux_check check)
     demuxer->seekable = true;
     demuxer->duration = mf->nr_of_files / mf->sh->codec->fps;
 
+    // Read the next images in parallel. Not useful for a single file, which
+    // also reuses the already opened stream.
+    if (!mf->streams && mf->nr_of_files > 1) {
+        int readahead, readahead_bytes;
+        mp_read_option_raw(demuxer->global, "mf-readahead", &m_option_type_int,
+                           &readahead);
+        mp_read_option_raw(demuxer->global, "mf-readahead-bytes",
+                           &m_option_type_int, &readahead_bytes);
+        if (readahead > 0) {
+            mf->pool = mp_thread_pool_create_shared(NULL, demuxer->global,
+                                                    readahead);
+            if (mf->pool) {
+                mf->global = demuxer->global;
+                mf->max_jobs = readahead;
+                mf->max_bytes = readahead_bytes;
+                pthread_mutex_init(&mf->lock, NULL);
+                pthread_cond_init(&mf->wakeup, NULL);
+            }
+        }
+    }
+
     return 0;
 
 error:
@@ -345,6 +491,16 @@ error:
 
 static void demux_close_mf(demuxer_t *demuxer)
 {
+    mf_t *mf = demuxer->priv;
+    if (!mf || !mf->pool)
+        return;
+
+    pthread_mutex_lock(&mf->lock);
+    drop_jobs(mf);
+    pthread_mutex_unlock(&mf->lock);
+    talloc_free(mf->pool); // waits until all jobs are done
+    pthread_cond_destroy(&mf->wakeup);
+    pthread_mutex_destroy(&mf->lock);
 }
 
 const demuxer_desc_t demuxer_desc_mf = {
@@ -31,6 +31,7 @@
 #include <libavutil/lzo.h>
 #include <libavutil/intreadwrite.h>
 #include <libavutil/avstring.h>
+#include <libavutil/sha.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavcodec/version.h>
@@ -45,6 +46,8 @@
 #include "common/av_common.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
+#include "options/path.h"
+#include "osdep/io.h"
 #include "misc/bstr.h"
 #include "stream/stream.h"
 #include "video/csputils.h"
@@ -188,6 +191,12 @@ typedef struct mkv_demuxer {
     bool index_complete;
     int index_mode;
 
+    // --demuxer-mkv-index-cache-dir state
+    char *index_cache_file;     // NULL if not used (yet)
+    char *index_cache_key;
+    bool index_cache_tried;
+    size_t num_indexes_cached;  // entries already in the cache file
+
     int edition_id;
 
     struct header_elem {
@@ -217,6 +226,7 @@ struct demux_mkv_opts {
     double subtitle_preroll_secs_index;
     int probe_duration;
     int probe_start_time;
+    char *index_cache_dir;
 };
 
 const struct m_sub_options demux_mkv_conf = {
@@ -230,6 +240,7 @@ const struct m_sub_options demux_mkv_conf = {
         OPT_CHOICE("probe-video-duration", probe_duration, 0,
                    ({"no", 0}, {"yes", 1}, {"full", 2})),
         OPT_FLAG("probe-start-time", probe_start_time, 0),
+        OPT_STRING("index-cache-dir", index_cache_dir, 0),
         {0}
     },
     .size = sizeof(struct demux_mkv_opts),
@@ -844,6 +855,159 @@ static void add_block_position(demuxer_t *demuxer, struct mkv_track *track,
     track->last_index_entry = mkv_d->num_indexes - 1;
 }
 
+// The index cache file starts with this, followed by the key (see
+// load_index_cache()), the file size, the has-durations flag, the number of
+// entries, and the raw mkv_index_t array.
+#define INDEX_CACHE_MAGIC "mpv-mkv-index-1\n"
+
+// Load the index generated by a previous run if --demuxer-mkv-index-cache-dir
+// is set. This is used only for files without (usable) Cues. Since the file
+// may have grown since then, indexing continues after the loaded entries.
+static void load_index_cache(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    char *dir = mkv_d->opts->index_cache_dir;
+
+    if (mkv_d->index_cache_tried || mkv_d->index_complete || !dir || !dir[0])
+        return;
+    mkv_d->index_cache_tried = true;
+
+    int64_t size = stream_get_size(demuxer->stream);
+    if (size < 0 || !demuxer->stream->seekable)
+        return;
+
+    void *tmp = talloc_new(NULL);
+
+    // Identify the file by its (absolute) name and the segment.
+    char *url = demuxer->stream->url;
+    if (!mp_is_url(bstr0(url)))
+        url = mp_path_join(tmp, mp_getcwd(tmp), url);
+    char *key = talloc_asprintf(tmp, "url=%s\nsegment=%"PRId64"\nuid=", url,
+                                mkv_d->segment_start);
+    for (int i = 0; i < sizeof(demuxer->matroska_data.uid.segment); i++)
+        key = talloc_asprintf_append(key, "%02X",
+                                     demuxer->matroska_data.uid.segment[i]);
+    key = talloc_asprintf_append(key, "\nentry=%zu\n", sizeof(mkv_index_t));
+
+    uint8_t hash[32];
+    struct AVSHA *sha = av_sha_alloc();
+    if (!sha)
+        abort();
+    av_sha_init(sha, 256);
+    av_sha_update(sha, key, strlen(key));
+    av_sha_final(sha, hash);
+    av_free(sha);
+
+    char *name = talloc_strdup(tmp, "");
+    for (int i = 0; i < sizeof(hash); i++)
+        name = talloc_asprintf_append(name, "%02X", hash[i]);
+
+    dir = mp_get_user_path(tmp, demuxer->global, dir);
+    mkv_d->index_cache_file = mp_path_join(mkv_d, dir, name);
+    mkv_d->index_cache_key = talloc_steal(mkv_d, key);
+
+    FILE *f = fopen(mkv_d->index_cache_file, "rb");
+    if (!f)
+        goto done;
+
+    size_t header_size = strlen(INDEX_CACHE_MAGIC) + strlen(key);
+    char *header = talloc_size(tmp, header_size);
+    int64_t cached_size = 0;
+    uint8_t has_durations = 0;
+    uint64_t num = 0;
+    bool ok = fread(header, header_size, 1, f) == 1 &&
+              memcmp(header, INDEX_CACHE_MAGIC, strlen(INDEX_CACHE_MAGIC)) == 0 &&
+              memcmp(header + strlen(INDEX_CACHE_MAGIC), key, strlen(key)) == 0 &&
+              fread(&cached_size, sizeof(cached_size), 1, f) == 1 &&
+              fread(&has_durations, sizeof(has_durations), 1, f) == 1 &&
+              fread(&num, sizeof(num), 1, f) == 1;
+    // A smaller file was replaced or truncated, so the entries are useless.
+    ok = ok && cached_size <= size && num > 0 &&
+         num < SIZE_MAX / sizeof(mkv_index_t);
+    mkv_index_t *entries = NULL;
+    if (ok) {
+        entries = talloc_array(tmp, mkv_index_t, num);
+        ok = fread(entries, sizeof(mkv_index_t), num, f) == num;
+        for (size_t n = 0; ok && n < num; n++) {
+            ok = entries[n].filepos >= mkv_d->segment_start &&
+                 entries[n].filepos < size;
+        }
+    }
+    fclose(f);
+
+    if (ok) {
+        for (size_t n = 0; n < num; n++) {
+            mkv_index_t *e = &entries[n];
+            cue_index_add(demuxer, e->tnum, e->filepos, e->timecode,
+                          e->duration);
+            // Make add_block_position() skip what is already indexed.
+            for (int i = 0; i < mkv_d->num_tracks; i++) {
+                mkv_track_t *track = mkv_d->tracks[i];
+                if (track->tnum != e->tnum)
+                    continue;
+                size_t last = track->last_index_entry;
+                if (last == (size_t)-1 ||
+                    mkv_d->indexes[last].timecode < e->timecode)
+                    track->last_index_entry = mkv_d->num_indexes - 1;
+            }
+        }
+        mkv_d->index_has_durations |= has_durations;
+        mkv_d->num_indexes_cached = mkv_d->num_indexes;
+        MP_VERBOSE(demuxer, "Loaded %"PRIu64" index entries from '%s'%s.\n",
+                   num, mkv_d->index_cache_file,
+                   cached_size < size ? " (file has grown)" : "");
+    } else {
+        MP_WARN(demuxer, "Ignoring invalid index cache '%s'.\n",
+                mkv_d->index_cache_file);
+    }
+
+done:
+    talloc_free(tmp);
+}
+
+// Write the generated index, if it has changed since it was loaded.
+static void save_index_cache(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+
+    if (!mkv_d->index_cache_file || mkv_d->index_complete ||
+        mkv_d->num_indexes <= mkv_d->num_indexes_cached)
+        return;
+
+    void *tmp = talloc_new(NULL);
+    char *dir = bstrto0(tmp, mp_dirname(mkv_d->index_cache_file));
+    mp_mkdirp(dir);
+
+    int64_t size = stream_get_size(demuxer->stream);
+    uint8_t has_durations = mkv_d->index_has_durations;
+    uint64_t num = mkv_d->num_indexes;
+    char *key = mkv_d->index_cache_key;
+    char *tmpname = talloc_asprintf(tmp, "%s.tmp", mkv_d->index_cache_file);
+    FILE *f = fopen(tmpname, "wb");
+    bool ok = f &&
+        fwrite(INDEX_CACHE_MAGIC, strlen(INDEX_CACHE_MAGIC), 1, f) == 1 &&
+        fwrite(key, strlen(key), 1, f) == 1 &&
+        fwrite(&size, sizeof(size), 1, f) == 1 &&
+        fwrite(&has_durations, sizeof(has_durations), 1, f) == 1 &&
+        fwrite(&num, sizeof(num), 1, f) == 1 &&
+        fwrite(mkv_d->indexes, sizeof(mkv_index_t), num, f) == num;
+    if (f && fclose(f))
+        ok = false;
+    if (ok && rename(tmpname, mkv_d->index_cache_file)) {
+        // Windows does not replace existing files with rename().
+        unlink(mkv_d->index_cache_file);
+        ok = !rename(tmpname, mkv_d->index_cache_file);
+    }
+    if (ok) {
+        MP_VERBOSE(demuxer, "Saved %"PRIu64" index entries to '%s'.\n",
+                   num, mkv_d->index_cache_file);
+    } else {
+        MP_WARN(demuxer, "Could not write '%s'.\n", mkv_d->index_cache_file);
+        unlink(tmpname);
+    }
+    talloc_free(tmp);
+}
+
 static int demux_mkv_read_cues(demuxer_t *demuxer)
 {
     mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
@@ -1314,6 +1478,7 @@ static void add_coverart(struct demuxer *demuxer)
         struct sh_stream *sh = demux_alloc_sh_stream(STREAM_VIDEO);
         sh->demuxer_id = -1 - sh->index; // don't clash with mkv IDs
         sh->codec->codec = codec;
+        sh->codec->image = true;
         sh->attached_picture = new_demux_packet_from(att->data, att->data_size);
         if (sh->attached_picture) {
             sh->attached_picture->pts = 0;
@@ -2075,6 +2240,17 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
     add_coverart(demuxer);
     process_tags(demuxer);
 
+    // Files with Cues don't need the index cache (only_cue means the Cues
+    // are read lazily on the first seek, which also loads the cache if the
+    // Cues turn out to be unusable).
+    if (!mkv_d->index_complete && only_cue != 1) {
+        bool has_cues = false;
+        for (int n = 0; n < mkv_d->num_headers; n++)
+            has_cues |= mkv_d->headers[n].id == MATROSKA_ID_CUES;
+        if (!has_cues)
+            load_index_cache(demuxer);
+    }
+
     probe_first_timestamp(demuxer);
     if (mkv_d->opts->probe_duration)
         probe_last_timestamp(demuxer, start_pos);
@@ -2084,8 +2260,10 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
 
 // Read the laced block data at the current stream position (until endpos as
 // indicated by the block length field) into individual buffers.
+// Split the block payload in data (which points into buf) into laces. The
+// laces reference buf, so no packet data is copied.
 static int demux_mkv_read_block_lacing(struct block_info *block, int type,
-                                       struct stream *s, uint64_t endpos)
+                                       AVBufferRef *buf, struct bstr data)
 {
     int laces;
     uint32_t lace_size[MAX_NUM_LACES];
@@ -2093,12 +2271,12 @@ static int demux_mkv_read_block_lacing(struct block_info *block, int type,
 
     if (type == 0) {           /* no lacing */
         laces = 1;
-        lace_size[0] = endpos - stream_tell(s);
+        lace_size[0] = data.len;
     } else {
-        laces = stream_read_char(s);
-        if (laces < 0 || stream_tell(s) > endpos)
+        if (!data.len)
             goto error;
-        laces += 1;
+        laces = data.start[0] + 1;
+        data = bstr_cut(data, 1);
 
         switch (type) {
         case 1: {              /* xiph lacing */
@@ -2107,40 +2285,38 @@ static int demux_mkv_read_block_lacing(struct block_info *block, int type,
                 lace_size[i] = 0;
                 uint8_t t;
                 do {
-                    t = stream_read_char(s);
-                    if (stream_eof(s) || stream_tell(s) >= endpos)
+                    if (data.len < 2)
                         goto error;
+                    t = data.start[0];
+                    data = bstr_cut(data, 1);
                     lace_size[i] += t;
                 } while (t == 0xFF);
                 total += lace_size[i];
             }
-            uint32_t rest_length = endpos - stream_tell(s);
-            lace_size[laces - 1] = rest_length - total;
+            lace_size[laces - 1] = data.len - total;
             break;
         }
 
         case 2: {              /* fixed-size lacing */
-            uint32_t full_length = endpos - stream_tell(s);
             for (int i = 0; i < laces; i++)
-                lace_size[i] = full_length / laces;
+                lace_size[i] = data.len / laces;
             break;
         }
 
         case 3: {              /* EBML lacing */
-            uint64_t num = ebml_read_length(s);
-            if (num == EBML_UINT_INVALID || stream_tell(s) >= endpos)
+            uint64_t num = ebml_buf_read_length(&data);
+            if (num == EBML_UINT_INVALID || !data.len)
                 goto error;
 
             uint32_t total = lace_size[0] = num;
             for (int i = 1; i < laces - 1; i++) {
-                int64_t snum = ebml_read_signed_length(s);
-                if (snum == EBML_INT_INVALID || stream_tell(s) >= endpos)
+                int64_t snum = ebml_buf_read_signed_length(&data);
+                if (snum == EBML_INT_INVALID || !data.len)
                     goto error;
                 lace_size[i] = lace_size[i - 1] + snum;
                 total += lace_size[i];
             }
-            uint32_t rest_length = endpos - stream_tell(s);
-            lace_size[laces - 1] = rest_length - total;
+            lace_size[laces - 1] = data.len - total;
             break;
         }
 
@@ -2151,22 +2327,18 @@ static int demux_mkv_read_block_lacing(struct block_info *block, int type,
 
     for (int i = 0; i < laces; i++) {
         uint32_t size = lace_size[i];
-        if (stream_tell(s) + size > endpos || size > (1 << 30))
-            goto error;
-        int pad = MPMAX(AV_INPUT_BUFFER_PADDING_SIZE, AV_LZO_INPUT_PADDING);
-        AVBufferRef *buf = av_buffer_alloc(size + pad);
-        if (!buf)
+        if (size > data.len || size > (1 << 30))
             goto error;
-        buf->size = size;
-        if (stream_read(s, buf->data, buf->size) != buf->size) {
-            av_buffer_unref(&buf);
+        AVBufferRef *lace = av_buffer_ref(buf);
+        if (!lace)
             goto error;
-        }
-        memset(buf->data + buf->size, 0, pad);
-        block->laces[block->num_laces++] = buf;
+        lace->data = data.start;
+        lace->size = size;
+        block->laces[block->num_laces++] = lace;
+        data = bstr_cut(data, size);
     }
 
-    if (stream_tell(s) != endpos)
+    if (data.len)
         goto error;
 
     return 0;
@@ -2500,30 +2672,44 @@ static int read_block(demuxer_t *demuxer, int64_t end, struct block_info *block)
     if (!length || length > 500000000 || stream_tell(s) + length > (uint64_t)end)
         return -1;
 
-    uint64_t endpos = stream_tell(s) + length;
+    int64_t startpos = stream_tell(s);
+    uint64_t endpos = startpos + length;
     int res = -1;
 
+    // Read the whole Block element at once, and parse it from memory. The
+    // laces are slices of this buffer.
+    // Reference the data directly if the file is memory mapped.
+    AVBufferRef *buf = stream_read_ref(s, length);
+    if (!buf) {
+        int pad = MPMAX(AV_INPUT_BUFFER_PADDING_SIZE, AV_LZO_INPUT_PADDING);
+        buf = av_buffer_alloc(length + pad);
+        if (!buf)
+            goto exit;
+        buf->size = length;
+        if (stream_read(s, buf->data, buf->size) != buf->size)
+            goto exit;
+        memset(buf->data + buf->size, 0, pad);
+    }
+    struct bstr data = {buf->data, buf->size};
+
     // Parse header of the Block element
     /* first byte(s): track num */
-    num = ebml_read_length(s);
-    if (num == EBML_UINT_INVALID || stream_tell(s) >= endpos)
+    num = ebml_buf_read_length(&data);
+    if (num == EBML_UINT_INVALID || !data.len)
         goto exit;
 
     /* time (relative to cluster time) */
-    if (stream_tell(s) + 3 >= endpos)
+    if (data.len <= 3)
         goto exit;
-    uint8_t c1 = stream_read_char(s);
-    uint8_t c2 = stream_read_char(s);
-    time = c1 << 8 | c2;
+    time = data.start[0] << 8 | data.start[1];
 
-    if (stream_tell(s) + 2 > endpos)
-        goto exit;
-    uint8_t header_flags = stream_read_char(s);
+    uint8_t header_flags = data.start[2];
+    data = bstr_cut(data, 3);
 
-    block->filepos = stream_tell(s);
+    block->filepos = startpos + (data.start - buf->data);
 
     int lace_type = (header_flags >> 1) & 0x03;
-    if (demux_mkv_read_block_lacing(block, lace_type, s, endpos))
+    if (demux_mkv_read_block_lacing(block, lace_type, buf, data))
         goto exit;
 
     if (block->simple)
@@ -2540,11 +2726,9 @@ static int read_block(demuxer_t *demuxer, int64_t end, struct block_info *block)
         goto exit;
     }
 
-    if (stream_tell(s) != endpos)
-        goto exit;
-
     res = 1;
 exit:
+    av_buffer_unref(&buf);
     if (res <= 0)
         free_block(block);
     stream_seek(s, endpos);
@@ -2881,6 +3065,8 @@ static int create_index_until(struct demuxer *demuxer, int64_t timecode)
     if (mkv_d->index_complete)
         return 0;
 
+    load_index_cache(demuxer);
+
     mkv_index_t *index = get_highest_index_entry(demuxer);
 
     if (!index || index->timecode * mkv_d->tc_scale < timecode) {
@@ -3174,6 +3360,7 @@ static void mkv_free(struct demuxer *demuxer)
     struct mkv_demuxer *mkv_d = demuxer->priv;
     if (!mkv_d)
         return;
+    save_index_cache(demuxer);
     mkv_seek_reset(demuxer);
     for (int i = 0; i < mkv_d->num_tracks; i++)
         demux_mkv_free_trackentry(mkv_d->tracks[i]);
@@ -52,7 +52,8 @@ struct pl_parser {
     bool error;
     bool probing;
     bool force;
-    bool add_base;
+    bstr base_path;     // prepended to relative entries while parsing
+    char *tmp;          // scratch buffer for 0-terminated entry names
     enum demux_check check_level;
     struct stream *real_stream;
     char *format;
@@ -76,11 +77,23 @@ static bstr pl_get_line(struct pl_parser *p)
     return bstr0(pl_get_line0(p));
 }
 
-static void pl_add(struct pl_parser *p, bstr entry)
+// Add an entry, resolving it relative to the playlist's location. Playlists
+// can have a huge number of entries, so avoid temporary allocations.
+static struct playlist_entry *pl_add(struct pl_parser *p, bstr entry)
 {
-    char *s = bstrto0(NULL, entry);
-    playlist_add_file(p->pl, s);
-    talloc_free(s);
+    struct playlist_entry *e;
+    if (p->base_path.len && !mp_is_url(entry)) {
+        char *s = mp_path_join_bstr(NULL, p->base_path, entry);
+        e = playlist_entry_new(s);
+        talloc_free(s);
+    } else {
+        MP_TARRAY_GROW(p, p->tmp, entry.len);
+        memcpy(p->tmp, entry.start, entry.len);
+        p->tmp[entry.len] = '\0';
+        e = playlist_entry_new(p->tmp);
+    }
+    playlist_add(p->pl, e);
+    return e;
 }
 
 static bool pl_eof(struct pl_parser *p)
@@ -132,12 +145,9 @@ ok:
         } else if (bstr_startswith0(line, "#EXT-X-")) {
             p->format = "hls";
         } else if (line.len > 0 && !bstr_startswith0(line, "#")) {
-            char *fn = bstrto0(NULL, line);
-            struct playlist_entry *e = playlist_entry_new(fn);
-            talloc_free(fn);
+            struct playlist_entry *e = pl_add(p, line);
             e->title = talloc_steal(e, title);
             title = NULL;
-            playlist_add(p->pl, e);
         }
         line = bstr_strip(pl_get_line(p));
     }
@@ -309,8 +319,6 @@ static int parse_dir(struct pl_parser *p)
     for (int n = 0; n < num_files; n++)
         playlist_add_file(p->pl, files[n]);
 
-    p->add_base = false;
-
     return num_files > 0 ? 0 : -1;
 }
 
@@ -362,7 +370,6 @@ static int open_file(struct demuxer *demuxer, enum demux_check check)
     p->log = demuxer->log;
     p->pl = talloc_zero(p, struct playlist);
     p->real_stream = demuxer->stream;
-    p->add_base = true;
 
     bstr probe_buf = stream_peek(demuxer->stream, PROBE_SIZE);
     p->s = open_memory_stream(probe_buf.start, probe_buf.len);
@@ -383,9 +390,10 @@ static int open_file(struct demuxer *demuxer, enum demux_check check)
     p->error = false;
     p->s = demuxer->stream;
     p->utf16 = stream_skip_bom(p->s);
+    bstr base_path = mp_dirname(demuxer->filename);
+    if (bstrcmp0(base_path, ".") != 0)
+        p->base_path = base_path;
     bool ok = fmt->parse(p) >= 0 && !p->error;
-    if (p->add_base)
-        playlist_add_base_path(p->pl, mp_dirname(demuxer->filename));
     demuxer->playlist = talloc_steal(demuxer, p->pl);
     demuxer->filetype = p->format ? p->format : fmt->name;
     demuxer->fully_read = true;
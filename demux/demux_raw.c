@@ -37,6 +37,7 @@
 
 #include "video/fmt-conversion.h"
 #include "video/img_format.h"
+#include "video/mp_image.h"
 
 #include "osdep/endian.h"
 
@@ -209,9 +210,11 @@ static int demux_rawvideo_open(demuxer_t *demuxer, enum demux_check check)
         mp_imgfmt = opts->mp_format;
         if (!imgsize) {
             struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(opts->mp_format);
+            // Tightly packed planes, as libavcodec and vd_lavc expect them.
             for (int p = 0; p < desc.num_planes; p++) {
-                imgsize += ((width >> desc.xs[p]) * (height >> desc.ys[p]) *
-                            desc.bpp[p] + 7) / 8;
+                int w = mp_chroma_div_up(width, desc.xs[p]);
+                int h = mp_chroma_div_up(height, desc.ys[p]);
+                imgsize += (w * desc.bpp[p] + 7) / 8 * h;
             }
         }
     } else if (opts->codec && opts->codec[0])
@@ -276,17 +279,29 @@ static int raw_fill_buffer(demuxer_t *demuxer)
     if (demuxer->stream->eof)
         return 0;
 
-    struct demux_packet *dp = new_demux_packet(p->frame_size * p->read_frames);
+    int64_t pos = stream_tell(demuxer->stream);
+    int size = p->frame_size * p->read_frames;
+
+    struct demux_packet *dp = NULL;
+    struct AVBufferRef *ref = stream_read_ref(demuxer->stream, size);
+    if (ref) {
+        dp = new_demux_packet_from_buf(ref);
+        av_buffer_unref(&ref);
+    } else {
+        dp = new_demux_packet(size);
+        if (dp) {
+            int len = stream_read(demuxer->stream, dp->buffer, dp->len);
+            demux_packet_shorten(dp, len);
+        }
+    }
     if (!dp) {
         MP_ERR(demuxer, "Can't read packet.\n");
         return 1;
     }
 
-    dp->pos = stream_tell(demuxer->stream);
+    dp->pos = pos;
     dp->pts = (dp->pos  / p->frame_size) / p->frame_rate;
 
-    int len = stream_read(demuxer->stream, dp->buffer, dp->len);
-    demux_packet_shorten(dp, len);
     demux_add_packet(p->sh, dp);
 
     return 1;
@@ -17,15 +17,53 @@
 
 #include <assert.h>
 #include <limits.h>
+#include <pthread.h>
 
 #include "common/common.h"
 #include "common/msg.h"
+#include "misc/thread_pool.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
 
 #include "demux.h"
 #include "timeline.h"
 #include "stheader.h"
 #include "stream/stream.h"
 
+#define OPT_BASE_STRUCT struct demux_timeline_opts
+struct demux_timeline_opts {
+    int lookahead;
+};
+
+const struct m_sub_options demux_timeline_conf = {
+    .opts = (const m_option_t[]) {
+        OPT_INTRANGE("lookahead", lookahead, 0, 0, 16),
+        {0}
+    },
+    .size = sizeof(struct demux_timeline_opts),
+    .defaults = &(const struct demux_timeline_opts){
+        .lookahead = 1,
+    },
+};
+
+struct priv;
+
+// Background opening of a lazy segment.
+struct preopen {
+    struct priv *p;
+    char *url;
+    struct demuxer_params params;
+    struct mp_cancel *cancel;
+    struct mpv_global *global;
+
+    // --- the following fields are protected by priv.preopen_lock
+    bool done;
+    // If set, the segment doesn't want the result anymore, and whoever sees
+    // the job in the done state last frees it.
+    bool abandoned;
+    struct demuxer *d;
+};
+
 struct segment {
     int index;
     double start, end;
@@ -33,6 +71,7 @@ struct segment {
     char *url;
     bool lazy;
     struct demuxer *d;
+    struct preopen *preopen;    // if non-NULL, d is being opened in background
     // stream_map[sh_stream.index] = index into priv.streams, where sh_stream
     // is a stream from the source d. It's used to map the streams of the
     // source onto the set of streams of the virtual timeline.
@@ -50,6 +89,7 @@ struct virtual_stream {
 };
 
 struct priv {
+    struct demux_timeline_opts *opts;
     struct timeline *tl;
 
     double duration;
@@ -66,6 +106,11 @@ struct priv {
     // Total number of packets received past end of segment. Used
     // to be clever about determining when to switch segments.
     int eos_packets;
+
+    // For opening the next lazy segments ahead of time.
+    struct mp_thread_pool *preopen_pool;
+    pthread_mutex_t preopen_lock;
+    pthread_cond_t preopen_wakeup;
 };
 
 static bool target_stream_used(struct segment *seg, int target_index)
@@ -139,14 +184,128 @@ static void reselect_streams(struct demuxer *demuxer)
     }
 }
 
+// Whether seg is one of the segments following the current one that should be
+// opened ahead of time.
+static bool in_lookahead(struct priv *p, struct segment *seg)
+{
+    return p->current && seg->index > p->current->index &&
+           seg->index <= p->current->index + p->opts->lookahead;
+}
+
+static void preopen_fn(void *ctx)
+{
+    struct preopen *po = ctx;
+    struct priv *p = po->p;
+
+    pthread_mutex_lock(&p->preopen_lock);
+    bool abandoned = po->abandoned;
+    pthread_mutex_unlock(&p->preopen_lock);
+
+    struct demuxer *d = NULL;
+    if (!abandoned)
+        d = demux_open_url(po->url, &po->params, po->cancel, po->global);
+
+    pthread_mutex_lock(&p->preopen_lock);
+    abandoned = po->abandoned;
+    po->d = d;
+    po->done = true;
+    pthread_cond_broadcast(&p->preopen_wakeup);
+    pthread_mutex_unlock(&p->preopen_lock);
+
+    if (abandoned) {
+        free_demuxer_and_stream(d);
+        talloc_free(po);
+    }
+}
+
+// Wait until the background open of seg is done, and use its result.
+static void finish_preopen(struct priv *p, struct segment *seg)
+{
+    struct preopen *po = seg->preopen;
+    if (!po)
+        return;
+    seg->preopen = NULL;
+
+    pthread_mutex_lock(&p->preopen_lock);
+    while (!po->done)
+        pthread_cond_wait(&p->preopen_wakeup, &p->preopen_lock);
+    pthread_mutex_unlock(&p->preopen_lock);
+
+    assert(!seg->d);
+    seg->d = po->d;
+    talloc_free(po);
+}
+
+// Discard the result of the background open of seg. Doesn't wait.
+static void drop_preopen(struct priv *p, struct segment *seg)
+{
+    struct preopen *po = seg->preopen;
+    if (!po)
+        return;
+    seg->preopen = NULL;
+
+    pthread_mutex_lock(&p->preopen_lock);
+    bool done = po->done;
+    po->abandoned = true;
+    pthread_mutex_unlock(&p->preopen_lock);
+
+    if (done) {
+        free_demuxer_and_stream(po->d);
+        talloc_free(po);
+    }
+}
+
+// Start opening the lazy segments following the current one.
+static void start_lookahead(struct demuxer *demuxer)
+{
+    struct priv *p = demuxer->priv;
+
+    if (!p->current)
+        return;
+
+    for (int n = p->current->index + 1; n < p->num_segments; n++) {
+        struct segment *seg = p->segments[n];
+        if (!in_lookahead(p, seg))
+            break;
+        if (!seg->lazy || seg->d || seg->preopen)
+            continue;
+
+        if (!p->preopen_pool) {
+            p->preopen_pool = mp_thread_pool_create(p, p->opts->lookahead);
+            if (!p->preopen_pool) {
+                MP_WARN(demuxer, "could not create segment open threads\n");
+                return;
+            }
+        }
+
+        struct preopen *po = talloc_ptrtype(NULL, po);
+        *po = (struct preopen){
+            .p = p,
+            .url = talloc_strdup(po, seg->url),
+            .params = {
+                .init_fragment = p->tl->init_fragment,
+                .skip_lavf_probing = p->tl->dash,
+            },
+            .cancel = demuxer->stream->cancel,
+            .global = demuxer->global,
+        };
+        seg->preopen = po;
+        MP_VERBOSE(demuxer, "opening segment %d ahead of time\n", seg->index);
+        mp_thread_pool_queue(p->preopen_pool, preopen_fn, po);
+    }
+}
+
 static void close_lazy_segments(struct demuxer *demuxer)
 {
     struct priv *p = demuxer->priv;
 
-    // unload previous segment
+    // unload previous segment, but keep the ones opened ahead of time
     for (int n = 0; n < p->num_segments; n++) {
         struct segment *seg = p->segments[n];
-        if (seg != p->current && seg->d && seg->lazy) {
+        if (seg == p->current || in_lookahead(p, seg))
+            continue;
+        drop_preopen(p, seg);
+        if (seg->d && seg->lazy) {
             free_demuxer_and_stream(seg->d);
             seg->d = NULL;
         }
@@ -157,20 +316,23 @@ static void reopen_lazy_segments(struct demuxer *demuxer)
 {
     struct priv *p = demuxer->priv;
 
-    if (p->current->d)
-        return;
-
+    finish_preopen(p, p->current);
     close_lazy_segments(demuxer);
 
-    struct demuxer_params params = {
-        .init_fragment = p->tl->init_fragment,
-        .skip_lavf_probing = true,
-    };
-    p->current->d = demux_open_url(p->current->url, &params,
-                                   demuxer->stream->cancel, demuxer->global);
-    if (!p->current->d && !demux_cancel_test(demuxer))
-        MP_ERR(demuxer, "failed to load segment\n");
+    if (!p->current->d) {
+        struct demuxer_params params = {
+            .init_fragment = p->tl->init_fragment,
+            .skip_lavf_probing = p->tl->dash,
+        };
+        p->current->d = demux_open_url(p->current->url, &params,
+                                       demuxer->stream->cancel,
+                                       demuxer->global);
+        if (!p->current->d && !demux_cancel_test(demuxer))
+            MP_ERR(demuxer, "failed to load segment\n");
+    }
     associate_streams(demuxer, p->current);
+
+    start_lookahead(demuxer);
 }
 
 static void switch_segment(struct demuxer *demuxer, struct segment *new,
@@ -346,6 +508,10 @@ static int d_open(struct demuxer *demuxer, enum demux_check check)
     if (!p->tl || p->tl->num_parts < 1)
         return -1;
 
+    p->opts = mp_get_config_group(p, demuxer->global, &demux_timeline_conf);
+    pthread_mutex_init(&p->preopen_lock, NULL);
+    pthread_cond_init(&p->preopen_wakeup, NULL);
+
     p->duration = p->tl->parts[p->tl->num_parts].start;
 
     demuxer->chapters = p->tl->chapters;
@@ -423,6 +589,10 @@ static void d_close(struct demuxer *demuxer)
     struct demuxer *master = p->tl->demuxer;
     p->current = NULL;
     close_lazy_segments(demuxer);
+    // Wait for abandoned background opens to finish.
+    talloc_free(p->preopen_pool);
+    pthread_cond_destroy(&p->preopen_wakeup);
+    pthread_mutex_destroy(&p->preopen_lock);
     timeline_destroy(p->tl);
     free_demuxer(master);
 }
@@ -119,6 +119,48 @@ int64_t ebml_read_signed_length(stream_t *s)
     return unum - ((1LL << ((7 * l) - 1)) - 1);
 }
 
+/*
+ * Read a variable length unsigned int from a memory buffer, and advance the
+ * buffer past it. Behaves like ebml_read_length().
+ */
+uint64_t ebml_buf_read_length(struct bstr *buf)
+{
+    if (!buf->len)
+        return EBML_UINT_INVALID;
+    uint64_t len = buf->start[0];
+    int i, len_mask = 0x80;
+    for (i = 0; i < 8 && !(len & len_mask); i++)
+        len_mask >>= 1;
+    if (i >= 8 || buf->len < i + 1)
+        return EBML_UINT_INVALID;
+    int num_ffs = 0;
+    if ((int) (len &= (len_mask - 1)) == len_mask - 1)
+        num_ffs++;
+    for (int n = 1; n <= i; n++) {
+        len = (len << 8) | buf->start[n];
+        if (buf->start[n] == 0xFF)
+            num_ffs++;
+    }
+    if (num_ffs == i + 1)
+        return EBML_UINT_INVALID;
+    *buf = bstr_cut(*buf, i + 1);
+    return len;
+}
+
+/*
+ * Read a variable length signed int from a memory buffer.
+ */
+int64_t ebml_buf_read_signed_length(struct bstr *buf)
+{
+    size_t prev_len = buf->len;
+    uint64_t unum = ebml_buf_read_length(buf);
+    if (unum == EBML_UINT_INVALID)
+        return EBML_INT_INVALID;
+    int l = prev_len - buf->len;
+
+    return unum - ((1LL << ((7 * l) - 1)) - 1);
+}
+
 /*
  * Read the next element as an unsigned int.
  */
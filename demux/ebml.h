@@ -82,6 +82,8 @@ bool ebml_is_mkv_level1_id(uint32_t id);
 uint32_t ebml_read_id (stream_t *s);
 uint64_t ebml_read_length (stream_t *s);
 int64_t ebml_read_signed_length(stream_t *s);
+uint64_t ebml_buf_read_length(struct bstr *buf);
+int64_t ebml_buf_read_signed_length(struct bstr *buf);
 uint64_t ebml_read_uint (stream_t *s);
 int64_t ebml_read_int (stream_t *s);
 int ebml_read_skip(struct mp_log *log, int64_t end, stream_t *s);
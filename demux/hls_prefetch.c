@@ -0,0 +1,767 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Segment prefetching for libavformat's HLS demuxer. All URLs the demuxer
+// opens go through AVFormatContext.io_open. Playlists are read completely and
+// parsed for their segment lists; when the demuxer opens a segment, the
+// following segments of the same playlist are downloaded in the background,
+// and later opens of them are served from memory.
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <libavformat/avformat.h>
+#include <libavformat/avio.h>
+#include <libavutil/mem.h>
+#include <libavutil/opt.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/bstr.h"
+#include "osdep/atomic.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
+#include "mpv_talloc.h"
+
+#include "hls_prefetch.h"
+
+#define MAX_THREADS 16
+#define MAX_AHEAD 32                        // max. segments per playlist
+#define MAX_PLAYLIST_SIZE (4 * 1024 * 1024)
+#define READ_SIZE (64 * 1024)
+// Playlists without segment opens for this long (e.g. the variant was
+// deselected) lose their prefetched segments.
+#define PLAYLIST_TIMEOUT_US (30 * 1000 * 1000)
+
+struct segment {
+    char *url;
+    double duration;
+};
+
+struct playlist {
+    char *url;
+    void *parse_ctx;            // owns segs and other_urls
+    struct segment *segs;
+    int num_segs;
+    char **other_urls;          // init sections and keys, not playlists
+    int num_other_urls;
+    bool unsupported;           // byte ranges or encryption
+    struct AVDictionary *opts;  // as passed by the demuxer for segments
+    int64_t last_use;
+};
+
+enum {
+    ENTRY_QUEUED,
+    ENTRY_RUNNING,
+    ENTRY_DONE,
+    ENTRY_FAILED,
+};
+
+struct entry {
+    struct hls_prefetch *pf;
+    struct playlist *pl;
+    char *url;
+    int state;
+    atomic_bool abort;
+    int refs;                   // pf->entries, the download, readers
+    uint8_t *data;
+    int64_t size;
+};
+
+struct reader {
+    struct hls_prefetch *pf;
+    struct entry *e;            // prefetched segment, or NULL
+    uint8_t *data;              // buffered playlist data
+    int64_t size;
+    struct AVIOContext *src;    // rest of the data, if not fully buffered
+    int64_t pos;
+};
+
+struct hls_prefetch {
+    struct mp_log *log;
+    struct AVFormatContext *avfc;
+    int (*default_open)(struct AVFormatContext *s, struct AVIOContext **pb,
+                        const char *url, int flags,
+                        struct AVDictionary **options);
+    void (*default_close)(struct AVFormatContext *s, struct AVIOContext *pb);
+    double ahead_secs;
+
+    pthread_t threads[MAX_THREADS];
+    int num_threads;
+    int max_threads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;      // new queued entries, or terminate
+    pthread_cond_t data;        // data was added to an entry
+    atomic_bool terminate;
+
+    struct playlist **playlists;
+    int num_playlists;
+    // Segments being prefetched or ready, in the order they are needed.
+    struct entry **entries;
+    int num_entries;
+
+    // Throughput estimation. Time is only counted while downloads run, so
+    // parallel downloads measure the total link rate.
+    int active;
+    int64_t busy_since;
+    int64_t busy_us;
+    int64_t bytes;
+    int64_t sample_busy_us, sample_bytes;
+    double throughput;
+};
+
+static int reader_read(void *opaque, uint8_t *buf, int size);
+
+static void entry_unref_locked(struct entry *e)
+{
+    assert(e->refs > 0);
+    if (--e->refs == 0)
+        talloc_free(e);
+}
+
+static void drop_entry_locked(struct hls_prefetch *pf, int index)
+{
+    struct entry *e = pf->entries[index];
+    MP_TARRAY_REMOVE_AT(pf->entries, pf->num_entries, index);
+    atomic_store(&e->abort, true);
+    entry_unref_locked(e);
+}
+
+static int find_entry_locked(struct hls_prefetch *pf, const char *url)
+{
+    for (int n = 0; n < pf->num_entries; n++) {
+        if (strcmp(pf->entries[n]->url, url) == 0)
+            return n;
+    }
+    return -1;
+}
+
+static struct playlist *find_playlist_locked(struct hls_prefetch *pf,
+                                             const char *url)
+{
+    for (int n = 0; n < pf->num_playlists; n++) {
+        if (strcmp(pf->playlists[n]->url, url) == 0)
+            return pf->playlists[n];
+    }
+    return NULL;
+}
+
+// Return the playlist containing url as segment, and its index in *index.
+static struct playlist *find_segment_locked(struct hls_prefetch *pf,
+                                            const char *url, int *index)
+{
+    // Search backwards; with live streams, new segments are at the end.
+    for (int n = 0; n < pf->num_playlists; n++) {
+        struct playlist *pl = pf->playlists[n];
+        for (int i = pl->num_segs - 1; i >= 0; i--) {
+            if (strcmp(pl->segs[i].url, url) == 0) {
+                *index = i;
+                return pl;
+            }
+        }
+    }
+    return NULL;
+}
+
+static bool is_other_url_locked(struct hls_prefetch *pf, const char *url)
+{
+    for (int n = 0; n < pf->num_playlists; n++) {
+        struct playlist *pl = pf->playlists[n];
+        for (int i = 0; i < pl->num_other_urls; i++) {
+            if (strcmp(pl->other_urls[i], url) == 0)
+                return true;
+        }
+    }
+    return false;
+}
+
+// Resolve a playlist URI relative to the playlist's URL, the same way
+// libavformat's HLS demuxer does for the common cases.
+static char *resolve_url(void *ta_parent, const char *base, bstr rel)
+{
+    if (bstr_find0(rel, "://") >= 0)
+        return bstrto0(ta_parent, rel);
+
+    bstr b = bstr0(base);
+    int q = bstrcspn(b, "?#");
+    b = bstr_splice(b, 0, q);
+    int proto = bstr_find0(b, "://");
+    if (proto < 0)
+        return bstrto0(ta_parent, rel);
+    int path = bstrcspn(bstr_cut(b, proto + 3), "/") + proto + 3;
+
+    if (bstr_startswith0(rel, "//"))
+        return talloc_asprintf(ta_parent, "%.*s:%.*s", proto, b.start,
+                               BSTR_P(rel));
+    if (bstr_startswith0(rel, "/"))
+        return talloc_asprintf(ta_parent, "%.*s%.*s", path, b.start,
+                               BSTR_P(rel));
+
+    // Directory of the base, including the trailing "/".
+    int dir = bstrrchr(b, '/') + 1;
+    if (dir <= path)
+        dir = path;
+    while (bstr_startswith0(rel, "../") || bstr_startswith0(rel, "./")) {
+        if (bstr_eatstart0(&rel, "./"))
+            continue;
+        bstr_eatstart0(&rel, "../");
+        bstr d = bstr_splice(b, path, MPMAX(dir - 1, path));
+        int up = bstrrchr(d, '/');
+        dir = up >= 0 ? path + up + 1 : path;
+    }
+    if (dir == path)
+        return talloc_asprintf(ta_parent, "%.*s/%.*s", path, b.start,
+                               BSTR_P(rel));
+    return talloc_asprintf(ta_parent, "%.*s%.*s", dir, b.start, BSTR_P(rel));
+}
+
+// Extract the URI="..." attribute of a tag line.
+static bool get_uri_attr(bstr line, bstr *out)
+{
+    int i = bstr_find0(line, "URI=\"");
+    if (i < 0)
+        return false;
+    bstr rest = bstr_cut(line, i + 5);
+    int end = bstrchr(rest, '"');
+    if (end < 0)
+        return false;
+    *out = bstr_splice(rest, 0, end);
+    return true;
+}
+
+static void parse_playlist_locked(struct hls_prefetch *pf, const char *url,
+                                  bstr data)
+{
+    struct playlist *pl = find_playlist_locked(pf, url);
+    if (!pl) {
+        pl = talloc_zero(pf, struct playlist);
+        pl->url = talloc_strdup(pl, url);
+        MP_TARRAY_APPEND(pf, pf->playlists, pf->num_playlists, pl);
+    }
+    // Live playlists are reloaded all the time, so don't accumulate memory.
+    talloc_free(pl->parse_ctx);
+    pl->parse_ctx = talloc_new(pl);
+    void *ctx = pl->parse_ctx;
+    pl->segs = NULL;
+    pl->num_segs = 0;
+    pl->other_urls = NULL;
+    pl->num_other_urls = 0;
+    pl->unsupported = false;
+
+    double duration = -1;
+    while (data.len) {
+        bstr line = bstr_strip(bstr_getline(data, &data));
+        bstr uri;
+        if (bstr_eatstart0(&line, "#EXTINF:")) {
+            duration = bstrtod(line, NULL);
+        } else if (bstr_startswith0(line, "#EXT-X-BYTERANGE")) {
+            pl->unsupported = true;
+        } else if (bstr_startswith0(line, "#EXT-X-KEY:")) {
+            if (bstr_find0(line, "METHOD=NONE") < 0)
+                pl->unsupported = true;
+            if (get_uri_attr(line, &uri)) {
+                MP_TARRAY_APPEND(ctx, pl->other_urls, pl->num_other_urls,
+                                 resolve_url(ctx, url, uri));
+            }
+        } else if (bstr_startswith0(line, "#EXT-X-MAP:")) {
+            if (get_uri_attr(line, &uri)) {
+                MP_TARRAY_APPEND(ctx, pl->other_urls, pl->num_other_urls,
+                                 resolve_url(ctx, url, uri));
+            }
+        } else if (line.len && line.start[0] != '#' && duration >= 0) {
+            struct segment seg = {
+                .url = resolve_url(ctx, url, line),
+                .duration = duration,
+            };
+            MP_TARRAY_APPEND(ctx, pl->segs, pl->num_segs, seg);
+            duration = -1;
+        }
+    }
+    if (pl->unsupported)
+        pl->num_segs = 0;
+
+    MP_DBG(pf, "Playlist '%s': %d segments%s.\n", url, pl->num_segs,
+           pl->unsupported ? " (not prefetched)" : "");
+}
+
+static void update_throughput_locked(struct hls_prefetch *pf, int64_t now)
+{
+    int64_t busy = pf->busy_us + (pf->active ? now - pf->busy_since : 0);
+    int64_t dt = busy - pf->sample_busy_us;
+    int64_t bytes = pf->bytes - pf->sample_bytes;
+    if (dt < 50 * 1000 || bytes <= 0)
+        return;
+    double rate = bytes * 8 / (dt / 1e6);
+    pf->throughput = pf->throughput > 0 ? pf->throughput * 0.7 + rate * 0.3
+                                        : rate;
+    pf->sample_busy_us = busy;
+    pf->sample_bytes = pf->bytes;
+}
+
+static int fetch_interrupt_cb(void *ctx)
+{
+    struct entry *e = ctx;
+    return atomic_load(&e->abort) || atomic_load(&e->pf->terminate);
+}
+
+static void fetch_entry(struct hls_prefetch *pf, struct entry *e,
+                        struct AVDictionary *opts)
+{
+    AVIOInterruptCB cb = {.callback = fetch_interrupt_cb, .opaque = e};
+    AVIOContext *pb = NULL;
+    uint8_t *buf = talloc_size(NULL, READ_SIZE);
+
+    MP_TRACE(pf, "Prefetching '%s'.\n", e->url);
+
+    pthread_mutex_lock(&pf->lock);
+    if (!pf->active++)
+        pf->busy_since = mp_time_us();
+    pthread_mutex_unlock(&pf->lock);
+
+    int r = avio_open2(&pb, e->url, AVIO_FLAG_READ, &cb, &opts);
+    while (r >= 0) {
+        r = avio_read(pb, buf, READ_SIZE);
+        if (r <= 0)
+            break;
+        pthread_mutex_lock(&pf->lock);
+        MP_TARRAY_GROW(e, e->data, e->size + r);
+        memcpy(e->data + e->size, buf, r);
+        e->size += r;
+        pf->bytes += r;
+        pthread_cond_broadcast(&pf->data);
+        pthread_mutex_unlock(&pf->lock);
+    }
+    avio_closep(&pb);
+    talloc_free(buf);
+
+    pthread_mutex_lock(&pf->lock);
+    int64_t now = mp_time_us();
+    if (!--pf->active)
+        pf->busy_us += now - pf->busy_since;
+    bool ok = r == 0 || r == AVERROR_EOF;
+    if (ok) {
+        update_throughput_locked(pf, now);
+    } else if (!atomic_load(&e->abort)) {
+        MP_VERBOSE(pf, "Prefetching '%s' failed.\n", e->url);
+    }
+    e->state = ok ? ENTRY_DONE : ENTRY_FAILED;
+    pthread_cond_broadcast(&pf->data);
+    pthread_mutex_unlock(&pf->lock);
+}
+
+static void *prefetch_thread(void *p)
+{
+    struct hls_prefetch *pf = p;
+    mpthread_set_name("hls/prefetch");
+
+    pthread_mutex_lock(&pf->lock);
+    while (!atomic_load(&pf->terminate)) {
+        struct entry *e = NULL;
+        for (int n = 0; n < pf->num_entries; n++) {
+            if (pf->entries[n]->state == ENTRY_QUEUED) {
+                e = pf->entries[n];
+                break;
+            }
+        }
+        if (!e) {
+            pthread_cond_wait(&pf->wakeup, &pf->lock);
+            continue;
+        }
+        e->state = ENTRY_RUNNING;
+        e->refs++;
+        AVDictionary *opts = NULL;
+        av_dict_copy(&opts, e->pl->opts, 0);
+        pthread_mutex_unlock(&pf->lock);
+
+        fetch_entry(pf, e, opts);
+        av_dict_free(&opts);
+
+        pthread_mutex_lock(&pf->lock);
+        entry_unref_locked(e);
+    }
+    pthread_mutex_unlock(&pf->lock);
+    return NULL;
+}
+
+// The demuxer opened segment index of pl. Queue the segments after it, and
+// drop everything that won't be needed anymore.
+static void update_window_locked(struct hls_prefetch *pf, struct playlist *pl,
+                                 int index)
+{
+    int64_t now = mp_time_us();
+    pl->last_use = now;
+
+    int end = index + 1;
+    double secs = 0;
+    while (end < pl->num_segs && end - index <= MAX_AHEAD &&
+           (end == index + 1 || secs < pf->ahead_secs))
+    {
+        secs += pl->segs[end].duration;
+        end++;
+    }
+
+    for (int n = pf->num_entries - 1; n >= 0; n--) {
+        struct entry *e = pf->entries[n];
+        bool keep;
+        if (e->pl == pl) {
+            keep = false;
+            for (int i = index + 1; i < end; i++)
+                keep |= strcmp(pl->segs[i].url, e->url) == 0;
+        } else {
+            keep = now - e->pl->last_use < PLAYLIST_TIMEOUT_US;
+        }
+        if (!keep)
+            drop_entry_locked(pf, n);
+    }
+
+    bool added = false;
+    for (int i = index + 1; i < end; i++) {
+        if (find_entry_locked(pf, pl->segs[i].url) >= 0)
+            continue;
+        struct entry *e = talloc_zero(NULL, struct entry);
+        e->pf = pf;
+        e->pl = pl;
+        e->url = talloc_strdup(e, pl->segs[i].url);
+        e->state = ENTRY_QUEUED;
+        e->refs = 1;
+        MP_TARRAY_APPEND(pf, pf->entries, pf->num_entries, e);
+        added = true;
+    }
+    if (!added)
+        return;
+
+    while (pf->num_threads < pf->max_threads) {
+        if (pthread_create(&pf->threads[pf->num_threads], NULL,
+                           prefetch_thread, pf))
+            break;
+        pf->num_threads++;
+    }
+    pthread_cond_broadcast(&pf->wakeup);
+}
+
+static int reader_wait_locked(struct hls_prefetch *pf, struct entry *e,
+                              int64_t pos)
+{
+    while (pos >= e->size &&
+           (e->state == ENTRY_QUEUED || e->state == ENTRY_RUNNING))
+    {
+        AVIOInterruptCB *cb = &pf->avfc->interrupt_callback;
+        if (cb->callback && cb->callback(cb->opaque))
+            return AVERROR_EXIT;
+        struct timespec ts = mp_rel_time_to_timespec(0.1);
+        pthread_cond_timedwait(&pf->data, &pf->lock, &ts);
+    }
+    return 0;
+}
+
+static int reader_read(void *opaque, uint8_t *buf, int size)
+{
+    struct reader *r = opaque;
+    struct hls_prefetch *pf = r->pf;
+
+    if (r->e) {
+        pthread_mutex_lock(&pf->lock);
+        int res = reader_wait_locked(pf, r->e, r->pos);
+        if (res >= 0) {
+            if (r->pos < r->e->size) {
+                res = MPMIN(size, r->e->size - r->pos);
+                memcpy(buf, r->e->data + r->pos, res);
+                r->pos += res;
+            } else {
+                res = r->e->state == ENTRY_DONE ? AVERROR_EOF : AVERROR(EIO);
+            }
+        }
+        pthread_mutex_unlock(&pf->lock);
+        return res;
+    }
+
+    if (r->pos < r->size) {
+        int res = MPMIN(size, r->size - r->pos);
+        memcpy(buf, r->data + r->pos, res);
+        r->pos += res;
+        return res;
+    }
+    if (!r->src)
+        return AVERROR_EOF;
+    int res = avio_read(r->src, buf, size);
+    if (res > 0)
+        r->pos += res;
+    return res;
+}
+
+static int64_t reader_seek(void *opaque, int64_t pos, int whence)
+{
+    struct reader *r = opaque;
+    struct hls_prefetch *pf = r->pf;
+
+    // Seeking is supported only within the data that is already there.
+    int64_t size = r->size;
+    bool complete = !r->src;
+    if (r->e) {
+        pthread_mutex_lock(&pf->lock);
+        size = r->e->size;
+        complete = r->e->state == ENTRY_DONE;
+        pthread_mutex_unlock(&pf->lock);
+    }
+
+    whence &= ~AVSEEK_FORCE;
+    if (whence == AVSEEK_SIZE)
+        return complete ? size : AVERROR(ENOSYS);
+    if (whence == SEEK_CUR) {
+        pos += r->pos;
+    } else if (whence == SEEK_END) {
+        if (!complete)
+            return AVERROR(ENOSYS);
+        pos += size;
+    } else if (whence != SEEK_SET) {
+        return AVERROR(EINVAL);
+    }
+    // Past the buffered part of a non-playlist, only the current position.
+    if (r->src && r->pos > r->size)
+        return pos == r->pos ? pos : AVERROR(ENOSYS);
+    if (pos < 0 || pos > size)
+        return AVERROR(EINVAL);
+    r->pos = pos;
+    return pos;
+}
+
+static int open_reader(struct hls_prefetch *pf, struct AVIOContext **pb,
+                       struct reader *r)
+{
+    uint8_t *buffer = av_malloc(READ_SIZE);
+    if (buffer)
+        *pb = avio_alloc_context(buffer, READ_SIZE, 0, r, reader_read, NULL,
+                                 reader_seek);
+    if (!*pb) {
+        av_free(buffer);
+        return AVERROR(ENOMEM);
+    }
+    (*pb)->seekable = 0;
+    return 0;
+}
+
+static void free_reader(struct hls_prefetch *pf, struct reader *r)
+{
+    if (r->src)
+        pf->default_close(pf->avfc, r->src);
+    if (r->e) {
+        pthread_mutex_lock(&pf->lock);
+        // Not in pf->entries anymore, so nobody else wants the rest.
+        atomic_store(&r->e->abort, true);
+        entry_unref_locked(r->e);
+        pthread_mutex_unlock(&pf->lock);
+    }
+    talloc_free(r);
+}
+
+// Open something that is not a known segment. If it turns out to be a
+// playlist, it's read completely, parsed, and returned from memory.
+static int open_playlist(struct hls_prefetch *pf, struct AVIOContext **pb,
+                         const char *url, int flags,
+                         struct AVDictionary **options)
+{
+    // Keep the options for a possible second open.
+    AVDictionary *opts = NULL;
+    if (options)
+        av_dict_copy(&opts, *options, 0);
+
+    AVIOContext *src = NULL;
+    int res = pf->default_open(pf->avfc, &src, url, flags, options);
+    if (res < 0) {
+        av_dict_free(&opts);
+        return res;
+    }
+
+    struct reader *r = talloc_zero(NULL, struct reader);
+    r->pf = pf;
+    bool eof = false;
+    while (r->size < MAX_PLAYLIST_SIZE) {
+        MP_TARRAY_GROW(r, r->data, r->size + READ_SIZE);
+        int len = avio_read(src, r->data + r->size, READ_SIZE);
+        if (len <= 0) {
+            if (len < 0 && len != AVERROR_EOF) {
+                av_dict_free(&opts);
+                pf->default_close(pf->avfc, src);
+                talloc_free(r);
+                return len;
+            }
+            eof = true;
+            break;
+        }
+        r->size += len;
+        if (r->size >= 7 && memcmp(r->data, "#EXTM3U", 7) != 0)
+            break;
+    }
+
+    bstr data = {r->data, r->size};
+    bool reopen = false;
+    if (eof && bstr_startswith0(data, "#EXTM3U")) {
+        pthread_mutex_lock(&pf->lock);
+        parse_playlist_locked(pf, url, data);
+        pthread_mutex_unlock(&pf->lock);
+
+        // The demuxer takes the redirect location and cookies from the
+        // http protocol context, which a memory buffer doesn't have. Open
+        // the URL again in this case, so these get through.
+        char *location = NULL, *cookies = NULL;
+        av_opt_get(src, "location", AV_OPT_SEARCH_CHILDREN,
+                   (uint8_t **)&location);
+        av_opt_get(src, "cookies", AV_OPT_SEARCH_CHILDREN,
+                   (uint8_t **)&cookies);
+        reopen = (location && strcmp(location, url) != 0) ||
+                 (cookies && cookies[0]);
+        av_free(location);
+        av_free(cookies);
+    }
+    if (eof) {
+        pf->default_close(pf->avfc, src);
+        src = NULL;
+    }
+    if (reopen) {
+        talloc_free(r);
+        res = pf->default_open(pf->avfc, pb, url, flags, &opts);
+        av_dict_free(&opts);
+        return res;
+    }
+    av_dict_free(&opts);
+    r->src = src;
+
+    res = open_reader(pf, pb, r);
+    if (res < 0)
+        free_reader(pf, r);
+    return res;
+}
+
+int hls_prefetch_io_open(struct hls_prefetch *pf, struct AVIOContext **pb,
+                         const char *url, int flags,
+                         struct AVDictionary **options)
+{
+    if (flags & AVIO_FLAG_WRITE)
+        return pf->default_open(pf->avfc, pb, url, flags, options);
+
+    pthread_mutex_lock(&pf->lock);
+    int index;
+    struct playlist *pl = find_segment_locked(pf, url, &index);
+    if (!pl) {
+        bool other = is_other_url_locked(pf, url);
+        pthread_mutex_unlock(&pf->lock);
+        if (other)
+            return pf->default_open(pf->avfc, pb, url, flags, options);
+        return open_playlist(pf, pb, url, flags, options);
+    }
+
+    if (!pl->opts && options) {
+        av_dict_copy(&pl->opts, *options, 0);
+        if (pf->avfc->protocol_whitelist) {
+            av_dict_set(&pl->opts, "protocol_whitelist",
+                        pf->avfc->protocol_whitelist, 0);
+        }
+    }
+
+    // Take the entry out of the list; the reader owns the reference now.
+    struct entry *e = NULL;
+    int n = find_entry_locked(pf, url);
+    if (n >= 0) {
+        struct entry *cur = pf->entries[n];
+        if (cur->state == ENTRY_RUNNING || cur->state == ENTRY_DONE) {
+            e = cur;
+            MP_TARRAY_REMOVE_AT(pf->entries, pf->num_entries, n);
+        } else {
+            // Not started yet or failed: it's faster to read it directly.
+            drop_entry_locked(pf, n);
+        }
+    }
+    update_window_locked(pf, pl, index);
+    pthread_mutex_unlock(&pf->lock);
+
+    if (!e) {
+        MP_TRACE(pf, "Segment '%s' not prefetched.\n", url);
+        return pf->default_open(pf->avfc, pb, url, flags, options);
+    }
+
+    struct reader *r = talloc_zero(NULL, struct reader);
+    r->pf = pf;
+    r->e = e;
+    int res = open_reader(pf, pb, r);
+    if (res < 0)
+        free_reader(pf, r);
+    return res;
+}
+
+void hls_prefetch_io_close(struct hls_prefetch *pf, struct AVIOContext *pb)
+{
+    if (!pb)
+        return;
+    if (pb->read_packet != reader_read) {
+        pf->default_close(pf->avfc, pb);
+        return;
+    }
+    free_reader(pf, pb->opaque);
+    av_freep(&pb->buffer);
+    av_free(pb);
+}
+
+double hls_prefetch_get_throughput(struct hls_prefetch *pf)
+{
+    pthread_mutex_lock(&pf->lock);
+    double r = pf->throughput;
+    pthread_mutex_unlock(&pf->lock);
+    return r;
+}
+
+struct hls_prefetch *hls_prefetch_create(struct mp_log *log,
+                                         struct AVFormatContext *avfc,
+                                         int connections, double ahead_secs)
+{
+    struct hls_prefetch *pf = talloc_zero(NULL, struct hls_prefetch);
+    pf->log = log;
+    pf->avfc = avfc;
+    pf->default_open = avfc->io_open;
+    pf->default_close = avfc->io_close;
+    pf->max_threads = MPCLAMP(connections, 1, MAX_THREADS);
+    pf->ahead_secs = ahead_secs;
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->wakeup, NULL);
+    pthread_cond_init(&pf->data, NULL);
+    return pf;
+}
+
+void hls_prefetch_destroy(struct hls_prefetch *pf)
+{
+    if (!pf)
+        return;
+
+    pthread_mutex_lock(&pf->lock);
+    atomic_store(&pf->terminate, true);
+    while (pf->num_entries)
+        drop_entry_locked(pf, pf->num_entries - 1);
+    pthread_cond_broadcast(&pf->wakeup);
+    pthread_mutex_unlock(&pf->lock);
+
+    for (int n = 0; n < pf->num_threads; n++)
+        pthread_join(pf->threads[n], NULL);
+
+    for (int n = 0; n < pf->num_playlists; n++)
+        av_dict_free(&pf->playlists[n]->opts);
+    pthread_cond_destroy(&pf->wakeup);
+    pthread_cond_destroy(&pf->data);
+    pthread_mutex_destroy(&pf->lock);
+    talloc_free(pf);
+}
@@ -0,0 +1,47 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_DEMUX_HLS_PREFETCH_H_
+#define MP_DEMUX_HLS_PREFETCH_H_
+
+#include <stdbool.h>
+
+struct mp_log;
+struct AVFormatContext;
+struct AVIOContext;
+struct AVDictionary;
+struct hls_prefetch;
+
+// Install on avfc (before avformat_open_input()). connections is the number
+// of parallel segment downloads, ahead_secs how much media time is fetched
+// ahead of the segment libavformat is reading.
+struct hls_prefetch *hls_prefetch_create(struct mp_log *log,
+                                         struct AVFormatContext *avfc,
+                                         int connections, double ahead_secs);
+// Call after avformat_close_input().
+void hls_prefetch_destroy(struct hls_prefetch *pf);
+
+// Replacements for AVFormatContext.io_open/io_close.
+int hls_prefetch_io_open(struct hls_prefetch *pf, struct AVIOContext **pb,
+                         const char *url, int flags,
+                         struct AVDictionary **options);
+void hls_prefetch_io_close(struct hls_prefetch *pf, struct AVIOContext *pb);
+
+// Measured download rate in bits/second, or 0 if unknown.
+double hls_prefetch_get_throughput(struct hls_prefetch *pf);
+
+#endif
@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavutil/intreadwrite.h>
@@ -30,10 +31,259 @@
 
 #include "packet.h"
 
+// Payload buffers are rounded up to size classes, with POOL_STEPS classes per
+// power of two (so at most 25% of a buffer is wasted), from 1 KiB to 1 MiB.
+// Larger packets are rare, and are allocated directly.
+#define POOL_MIN_SHIFT 10
+#define POOL_MAX_SHIFT 20
+#define POOL_STEPS 4
+#define POOL_NUM_CLASSES ((POOL_MAX_SHIFT - POOL_MIN_SHIFT) * POOL_STEPS + 1)
+
+// Limits on what is kept around for reuse. Everything beyond that is freed
+// immediately, so a large demuxer cache doesn't stay allocated forever.
+#define POOL_MAX_FREE_BUFFERS 32    // per size class
+#define POOL_MAX_FREE_BYTES (16 * 1024 * 1024)
+#define POOL_MAX_FREE_PACKETS 256
+
+// Stored in front of each pooled payload buffer. The size is a multiple of
+// the strictest alignment av_malloc() provides.
+#define POOL_BUF_HEADER 64
+
+struct pool_buf_header {
+    struct demux_packet_pool *pool;
+    int size_class;
+};
+
+struct demux_packet_pool {
+    pthread_mutex_t lock;
+    // All fields below are protected by the lock.
+    int refcount;       // owner + live packets and buffers
+    bool closed;        // owner is gone; don't cache freed memory anymore
+    struct demux_packet *free_packets; // linked via next
+    int num_free_packets;
+    struct pool_class {
+        void *bufs[POOL_MAX_FREE_BUFFERS];
+        int num_bufs;
+    } classes[POOL_NUM_CLASSES];
+    struct demux_packet_pool_stats stats;
+};
+
+// The demux_packet header, its AVPacket, and the pool it comes from are
+// allocated together.
+struct packet_alloc {
+    struct demux_packet dp; // must be first
+    AVPacket avpkt;
+    struct demux_packet_pool *pool;
+};
+
+// Tags pooled AVBufferRefs (via their opaque field).
+static char pool_buffer_tag;
+
+// Pool used by new_demux_packet*() on the current thread.
+static __thread struct demux_packet_pool *current_pool;
+
+struct demux_packet_pool *demux_packet_pool_create(void)
+{
+    struct demux_packet_pool *pool = talloc_zero(NULL, struct demux_packet_pool);
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->refcount = 1;
+    return pool;
+}
+
+static void pool_unref(struct demux_packet_pool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    bool last = --pool->refcount == 0;
+    pthread_mutex_unlock(&pool->lock);
+    if (last) {
+        pthread_mutex_destroy(&pool->lock);
+        talloc_free(pool);
+    }
+}
+
+// Release the owner's reference. Cached memory is freed immediately; packets
+// and buffers which are still in use keep the pool alive until they're freed.
+void demux_packet_pool_destroy(struct demux_packet_pool *pool)
+{
+    if (!pool)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->closed = true;
+    struct demux_packet *packets = pool->free_packets;
+    pool->free_packets = NULL;
+    pool->num_free_packets = 0;
+    for (int c = 0; c < POOL_NUM_CLASSES; c++) {
+        for (int n = 0; n < pool->classes[c].num_bufs; n++)
+            av_free(pool->classes[c].bufs[n]);
+        pool->classes[c].num_bufs = 0;
+    }
+    pool->stats.cached_bytes = 0;
+    pthread_mutex_unlock(&pool->lock);
+    // (Freeing the packets drops their pool references; must not hold lock.)
+    while (packets) {
+        struct demux_packet *next = packets->next;
+        talloc_free(packets);
+        packets = next;
+    }
+    pool_unref(pool);
+}
+
+void demux_packet_pool_get_stats(struct demux_packet_pool *pool,
+                                 struct demux_packet_pool_stats *stats)
+{
+    pthread_mutex_lock(&pool->lock);
+    *stats = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Make new_demux_packet*() on the calling thread allocate from the given pool
+// (or use plain allocations if pool==NULL). Returns the previously set pool,
+// which the caller should restore when done.
+struct demux_packet_pool *demux_packet_pool_set_current(
+                                            struct demux_packet_pool *pool)
+{
+    struct demux_packet_pool *prev = current_pool;
+    current_pool = pool;
+    return prev;
+}
+
+static int size_class(size_t size)
+{
+    if (size <= ((size_t)1 << POOL_MIN_SHIFT))
+        return 0;
+    if (size > ((size_t)1 << POOL_MAX_SHIFT))
+        return -1;
+    int shift = POOL_MIN_SHIFT;
+    while (((size_t)2 << shift) < size)
+        shift++;
+    size_t step = ((size_t)1 << shift) / POOL_STEPS;
+    int k = (size - ((size_t)1 << shift) + step - 1) / step;
+    return (shift - POOL_MIN_SHIFT) * POOL_STEPS + k;
+}
+
+static size_t class_size(int c)
+{
+    if (c == 0)
+        return (size_t)1 << POOL_MIN_SHIFT;
+    size_t base = (size_t)1 << (POOL_MIN_SHIFT + (c - 1) / POOL_STEPS);
+    return base + ((c - 1) % POOL_STEPS + 1) * (base / POOL_STEPS);
+}
+
+static void pool_buffer_free(void *opaque, uint8_t *data)
+{
+    void *mem = data - POOL_BUF_HEADER;
+    struct pool_buf_header *hdr = mem;
+    struct demux_packet_pool *pool = hdr->pool;
+    size_t size = class_size(hdr->size_class);
+
+    pthread_mutex_lock(&pool->lock);
+    struct pool_class *cl = &pool->classes[hdr->size_class];
+    if (!pool->closed && cl->num_bufs < POOL_MAX_FREE_BUFFERS &&
+        pool->stats.cached_bytes + size <= POOL_MAX_FREE_BYTES)
+    {
+        cl->bufs[cl->num_bufs++] = mem;
+        pool->stats.cached_bytes += size;
+        mem = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    av_free(mem);
+    pool_unref(pool);
+}
+
+// Allocate a payload buffer of at least size bytes from the pool. Returns NULL
+// if size is outside of the pooled range, or on OOM.
+static AVBufferRef *pool_buffer_alloc(struct demux_packet_pool *pool,
+                                      size_t size)
+{
+    int c = size_class(size);
+    if (c < 0)
+        return NULL;
+
+    void *mem = NULL;
+    pthread_mutex_lock(&pool->lock);
+    struct pool_class *cl = &pool->classes[c];
+    if (cl->num_bufs) {
+        mem = cl->bufs[--cl->num_bufs];
+        pool->stats.cached_bytes -= class_size(c);
+        pool->stats.buffers_reused++;
+    } else {
+        pool->stats.buffers_allocated++;
+    }
+    pool->refcount++;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!mem)
+        mem = av_malloc(POOL_BUF_HEADER + class_size(c));
+    if (!mem) {
+        pool_unref(pool);
+        return NULL;
+    }
+    *(struct pool_buf_header *)mem = (struct pool_buf_header){pool, c};
+
+    uint8_t *data = (uint8_t *)mem + POOL_BUF_HEADER;
+    AVBufferRef *buf = av_buffer_create(data, class_size(c), pool_buffer_free,
+                                        &pool_buffer_tag, 0);
+    if (!buf)
+        pool_buffer_free(NULL, data);
+    return buf;
+}
+
 static void packet_destroy(void *ptr)
 {
-    struct demux_packet *dp = ptr;
-    av_packet_unref(dp->avpacket);
+    struct packet_alloc *a = ptr;
+    av_packet_unref(&a->avpkt);
+    if (a->pool)
+        pool_unref(a->pool);
+}
+
+static struct packet_alloc *packet_alloc(struct demux_packet_pool *pool)
+{
+    struct packet_alloc *a = NULL;
+    if (pool) {
+        pthread_mutex_lock(&pool->lock);
+        if (pool->free_packets) {
+            a = (struct packet_alloc *)pool->free_packets;
+            pool->free_packets = a->dp.next;
+            pool->num_free_packets--;
+            pool->stats.packets_reused++;
+        } else {
+            pool->stats.packets_allocated++;
+            pool->refcount++;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    if (!a) {
+        a = talloc(NULL, struct packet_alloc);
+        talloc_set_destructor(a, packet_destroy);
+        a->pool = pool;
+    }
+    return a;
+}
+
+// Copy or allocate the payload of avpkt into the pooled buffer. Returns 1 on
+// success, 0 if pooling is not possible, and a negative value on errors.
+static int pool_packet_ref(struct demux_packet_pool *pool, AVPacket *dst,
+                           AVPacket *src)
+{
+    if (!pool || src->buf)
+        return 0;
+    AVBufferRef *buf =
+        pool_buffer_alloc(pool, (size_t)src->size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!buf)
+        return 0;
+    int r = av_packet_copy_props(dst, src);
+    if (r < 0) {
+        av_buffer_unref(&buf);
+        return r;
+    }
+    if (src->data)
+        memcpy(buf->data, src->data, src->size);
+    memset(buf->data + src->size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    dst->buf = buf;
+    dst->data = buf->data;
+    dst->size = src->size;
+    return 1;
 }
 
 // This actually preserves only data and side data, not PTS/DTS/pos/etc.
@@ -43,8 +293,9 @@ struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt)
 {
     if (avpkt->size > 1000000000)
         return NULL;
-    struct demux_packet *dp = talloc(NULL, struct demux_packet);
-    talloc_set_destructor(dp, packet_destroy);
+    struct demux_packet_pool *pool = current_pool;
+    struct packet_alloc *a = packet_alloc(pool);
+    struct demux_packet *dp = &a->dp;
     *dp = (struct demux_packet) {
         .pts = MP_NOPTS_VALUE,
         .dts = MP_NOPTS_VALUE,
@@ -53,12 +304,16 @@ struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt)
         .start = MP_NOPTS_VALUE,
         .end = MP_NOPTS_VALUE,
         .stream = -1,
-        .avpacket = talloc_zero(dp, AVPacket),
+        .avpacket = &a->avpkt,
         .kf_seek_pts = MP_NOPTS_VALUE,
+        .spill_pos = -1,
     };
+    *dp->avpacket = (AVPacket){0};
     av_init_packet(dp->avpacket);
-    int r = -1;
-    if (avpkt->data) {
+    int r = pool_packet_ref(pool, dp->avpacket, avpkt);
+    if (r) {
+        // pooled, or error
+    } else if (avpkt->data) {
         // We hope that this function won't need/access AVPacket input padding,
         // because otherwise new_demux_packet_from() wouldn't work.
         r = av_packet_ref(dp->avpacket, avpkt);
@@ -110,8 +365,28 @@ void demux_packet_shorten(struct demux_packet *dp, size_t len)
     memset(dp->buffer + dp->len, 0, AV_INPUT_BUFFER_PADDING_SIZE);
 }
 
+// Packets can also be freed with talloc_free(), but going through this
+// function allows reusing the packet allocation.
 void free_demux_packet(struct demux_packet *dp)
 {
+    if (!dp)
+        return;
+    struct packet_alloc *a = (struct packet_alloc *)dp;
+    struct demux_packet_pool *pool = a->pool;
+    if (pool && !talloc_parent(dp)) {
+        av_packet_unref(&a->avpkt);
+        pthread_mutex_lock(&pool->lock);
+        bool keep = !pool->closed &&
+                    pool->num_free_packets < POOL_MAX_FREE_PACKETS;
+        if (keep) {
+            dp->next = pool->free_packets;
+            pool->free_packets = dp;
+            pool->num_free_packets++;
+        }
+        pthread_mutex_unlock(&pool->lock);
+        if (keep)
+            return;
+    }
     talloc_free(dp);
 }
 
@@ -157,7 +432,12 @@ struct demux_packet *demux_copy_packet(struct demux_packet *dp)
 size_t demux_packet_estimate_total_size(struct demux_packet *dp)
 {
     size_t size = ROUND_ALLOC(sizeof(struct demux_packet));
-    size += ROUND_ALLOC(dp->len);
+    size_t data = dp->spill_pos >= 0 ? 0 : dp->len;
+    // Pooled buffers are rounded up to their size class.
+    AVBufferRef *buf = dp->avpacket ? dp->avpacket->buf : NULL;
+    if (buf && av_buffer_get_opaque(buf) == &pool_buffer_tag)
+        data = buf->size;
+    size += ROUND_ALLOC(data);
     if (dp->avpacket) {
         size += ROUND_ALLOC(sizeof(AVPacket));
         size += ROUND_ALLOC(sizeof(AVBufferRef));
@@ -44,10 +44,28 @@ typedef struct demux_packet {
     struct demux_packet *next;
     struct AVPacket *avpacket;   // keep the buffer allocation and sidedata
     double kf_seek_pts; // demux.c internal: seek pts for keyframe range
+    int64_t spill_pos;  // demux.c internal: data is in spill file, or -1
+    int64_t queue_time; // demux.c internal: mp_time_us() when queued, or 0
 } demux_packet_t;
 
 struct AVBufferRef;
 
+struct demux_packet_pool_stats {
+    int64_t packets_allocated;  // packet allocations not served by the pool
+    int64_t packets_reused;     // packet allocations served by the pool
+    int64_t buffers_allocated;  // same for payload buffers
+    int64_t buffers_reused;
+    int64_t cached_bytes;       // unused payload memory kept by the pool
+};
+
+struct demux_packet_pool;
+struct demux_packet_pool *demux_packet_pool_create(void);
+void demux_packet_pool_destroy(struct demux_packet_pool *pool);
+void demux_packet_pool_get_stats(struct demux_packet_pool *pool,
+                                 struct demux_packet_pool_stats *stats);
+struct demux_packet_pool *demux_packet_pool_set_current(
+                                            struct demux_packet_pool *pool);
+
 struct demux_packet *new_demux_packet(size_t len);
 struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt);
 struct demux_packet *new_demux_packet_from(void *data, size_t len);
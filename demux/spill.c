@@ -0,0 +1,203 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Disk storage for the payload of cached demuxer packets. The packet structs
+// stay in memory (and in the packet queues), only their data is moved to a
+// temporary file, and read back if the packet is returned to the reader.
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <libavcodec/avcodec.h>
+
+#include "osdep/io.h"
+#include "common/common.h"
+#include "common/msg.h"
+#include "options/path.h"
+#include "mpv_talloc.h"
+
+#include "packet.h"
+#include "spill.h"
+
+// The file is split into segments. Data is appended to the current segment,
+// and a segment is reused once all packets stored in it have been released.
+// Since packets are pruned roughly in the order they were spilled, this
+// keeps the file size close to max_bytes without a real allocator.
+#define SEGMENT_SIZE (64 * 1024 * 1024)
+
+struct spill_segment {
+    int64_t used;   // bytes written
+    int64_t live;   // bytes still referenced by packets
+};
+
+struct demux_spill {
+    struct mp_log *log;
+    FILE *f;
+    char *filename;     // to remove on close (NULL if anonymous)
+    int64_t segment_size;
+    int max_segments;
+    struct spill_segment *segments;
+    int num_segments;
+    int cur;            // segment written to
+    int64_t bytes;      // sum of live bytes
+    bool failed;        // I/O error, don't try again
+};
+
+static void destroy(void *ptr)
+{
+    struct demux_spill *sp = ptr;
+    if (sp->f)
+        fclose(sp->f);
+    if (sp->filename)
+        unlink(sp->filename);
+}
+
+// Create a spill file in dir (or the system's temporary directory if dir is
+// empty or NULL), which holds at most about max_bytes.
+struct demux_spill *demux_spill_create(void *ta_parent, struct mp_log *log,
+                                       const char *dir, int64_t max_bytes)
+{
+    struct demux_spill *sp = talloc_zero(ta_parent, struct demux_spill);
+    talloc_set_destructor(sp, destroy);
+    sp->log = log;
+    sp->segment_size = MPMIN(SEGMENT_SIZE, max_bytes);
+    sp->max_segments = MPMAX(max_bytes / sp->segment_size, 1);
+
+    if (dir && dir[0]) {
+        static int counter;
+        mp_mkdirp(dir);
+        char *name = talloc_asprintf(sp, "mpv-spill-%d-%d", (int)getpid(),
+                                     counter++);
+        sp->filename = mp_path_join(sp, dir, name);
+        sp->f = fopen(sp->filename, "wb+");
+#ifndef _WIN32
+        // (Windows can't delete open files.)
+        if (sp->f && unlink(sp->filename) == 0)
+            sp->filename = NULL;
+#endif
+    } else {
+        sp->f = tmpfile();
+    }
+
+    if (!sp->f) {
+        MP_ERR(sp, "Could not create demuxer spill file.\n");
+        sp->filename = NULL;
+        talloc_free(sp);
+        return NULL;
+    }
+
+    MP_VERBOSE(sp, "Spilling up to %"PRId64" bytes of packet data to disk.\n",
+               (int64_t)sp->max_segments * sp->segment_size);
+    return sp;
+}
+
+// Find a segment with room for size bytes. Returns false if the file is full.
+static bool find_space(struct demux_spill *sp, int64_t size)
+{
+    if (sp->num_segments) {
+        struct spill_segment *seg = &sp->segments[sp->cur];
+        if (!seg->live)
+            seg->used = 0;
+        if (seg->used + size <= sp->segment_size)
+            return true;
+    }
+    for (int n = 0; n < sp->num_segments; n++) {
+        if (!sp->segments[n].live) {
+            sp->segments[n].used = 0;
+            sp->cur = n;
+            return true;
+        }
+    }
+    if (sp->num_segments >= sp->max_segments)
+        return false;
+    MP_TARRAY_APPEND(sp, sp->segments, sp->num_segments,
+                     (struct spill_segment){0});
+    sp->cur = sp->num_segments - 1;
+    return true;
+}
+
+// Write the packet data to the file and free it. Returns false if this is not
+// possible (full or I/O error), in which case the packet is unchanged.
+bool demux_spill_packet(struct demux_spill *sp, struct demux_packet *dp)
+{
+    if (sp->failed || !dp->avpacket || dp->spill_pos >= 0 ||
+        dp->len > sp->segment_size || !find_space(sp, dp->len))
+        return false;
+
+    struct spill_segment *seg = &sp->segments[sp->cur];
+    int64_t pos = sp->cur * sp->segment_size + seg->used;
+    if (fseeko(sp->f, pos, SEEK_SET) ||
+        fwrite(dp->buffer, dp->len, 1, sp->f) != 1)
+    {
+        MP_ERR(sp, "Error writing spill file, disabling it.\n");
+        sp->failed = true;
+        return false;
+    }
+    seg->used += dp->len;
+    seg->live += dp->len;
+    sp->bytes += dp->len;
+
+    // Keep side data and the size; only the payload goes away.
+    av_buffer_unref(&dp->avpacket->buf);
+    dp->avpacket->data = NULL;
+    dp->buffer = NULL;
+    dp->spill_pos = pos;
+    return true;
+}
+
+// Return a new packet, which is a copy of the spilled packet dp with its data
+// read back from disk. dp itself stays spilled.
+struct demux_packet *demux_spill_read(struct demux_spill *sp,
+                                      struct demux_packet *dp)
+{
+    struct demux_packet *new = new_demux_packet(dp->len);
+    if (!new)
+        return NULL;
+    demux_packet_copy_attribs(new, dp);
+    if (av_packet_copy_props(new->avpacket, dp->avpacket) < 0) {
+        talloc_free(new);
+        return NULL;
+    }
+    if (fseeko(sp->f, dp->spill_pos, SEEK_SET) ||
+        fread(new->buffer, dp->len, 1, sp->f) != 1)
+    {
+        // Can't do much about it; decoders will have to deal with it.
+        MP_ERR(sp, "Error reading spill file.\n");
+        memset(new->buffer, 0, dp->len);
+    }
+    return new;
+}
+
+// Must be called when a spilled packet is freed.
+void demux_spill_release(struct demux_spill *sp, struct demux_packet *dp)
+{
+    if (dp->spill_pos < 0)
+        return;
+    struct spill_segment *seg = &sp->segments[dp->spill_pos / sp->segment_size];
+    seg->live -= dp->len;
+    sp->bytes -= dp->len;
+    assert(seg->live >= 0);
+    dp->spill_pos = -1;
+}
+
+int64_t demux_spill_get_bytes(struct demux_spill *sp)
+{
+    return sp ? sp->bytes : 0;
+}
@@ -0,0 +1,36 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_DEMUX_SPILL_H_
+#define MP_DEMUX_SPILL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct mp_log;
+struct demux_packet;
+struct demux_spill;
+
+struct demux_spill *demux_spill_create(void *ta_parent, struct mp_log *log,
+                                       const char *dir, int64_t max_bytes);
+bool demux_spill_packet(struct demux_spill *sp, struct demux_packet *dp);
+struct demux_packet *demux_spill_read(struct demux_spill *sp,
+                                      struct demux_packet *dp);
+void demux_spill_release(struct demux_spill *sp, struct demux_packet *dp);
+int64_t demux_spill_get_bytes(struct demux_spill *sp);
+
+#endif
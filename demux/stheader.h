@@ -92,6 +92,7 @@ struct mp_codec_params {
     int disp_w, disp_h;   // display size
     int rotate;           // intended display rotation, in degrees, [0, 359]
     int stereo_mode;      // mp_stereo3d_mode (0 if none/unknown)
+    bool image;           // consists of still images (image files, cover art)
     struct mp_colorspace color; // colorspace info where available
     struct mp_spherical_params spherical;
 
@@ -133,6 +133,7 @@ const struct mp_cmd_def mp_cmds[] = {
                       {"window", 1},
                       {"subtitles", 2})),
   }},
+  { MP_CMD_THUMBNAIL, "thumbnail", { ARG_TIME, OARG_INT(160) }},
   { MP_CMD_LOADFILE, "loadfile", {
       ARG_STRING,
       OARG_CHOICE(0, ({"replace", 0},
@@ -190,6 +191,8 @@ const struct mp_cmd_def mp_cmds[] = {
   { MP_CMD_AB_LOOP, "ab-loop", },
 
   { MP_CMD_DROP_BUFFERS, "drop-buffers", },
+  { MP_CMD_DUMP_CACHE, "dump-cache", { ARG_STRING } },
+  { MP_CMD_DUMP_TRACE, "dump-trace", { OARG_STRING("") } },
 
   { MP_CMD_AF, "af", { ARG_STRING, ARG_STRING } },
   { MP_CMD_AF_COMMAND, "af-command", { ARG_STRING, ARG_STRING, ARG_STRING } },
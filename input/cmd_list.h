@@ -49,6 +49,7 @@ enum mp_command_type {
     MP_CMD_SCREENSHOT,
     MP_CMD_SCREENSHOT_TO_FILE,
     MP_CMD_SCREENSHOT_RAW,
+    MP_CMD_THUMBNAIL,
     MP_CMD_LOADFILE,
     MP_CMD_LOADLIST,
     MP_CMD_PLAYLIST_CLEAR,
@@ -85,6 +86,8 @@ enum mp_command_type {
     MP_CMD_AB_LOOP,
 
     MP_CMD_DROP_BUFFERS,
+    MP_CMD_DUMP_CACHE,
+    MP_CMD_DUMP_TRACE,
 
     MP_CMD_MOUSE,
     MP_CMD_KEYPRESS,
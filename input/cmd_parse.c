@@ -419,6 +419,7 @@ mp_cmd_t *mp_cmd_clone(mp_cmd_t *cmd)
     }
     ret->original = bstrdup(ret, cmd->original);
     ret->key_name = talloc_strdup(ret, ret->key_name);
+    ret->arrival_time = 0; // e.g. key repeats are new input
 
     if (cmd->id == MP_CMD_COMMAND_LIST) {
         struct mp_cmd *prev = NULL;
@@ -70,6 +70,17 @@ struct cmd_bind {
     char *location;     // filename/line number of definition
     bool is_builtin;
     struct cmd_bind_section *owner;
+    struct mp_cmd *parsed; // cached parse result of cmd (cloned on use)
+};
+
+// Parsed command strings sent by clients, see mp_input_parse_cmd_cached().
+#define CMD_CACHE_SIZE 16
+#define CMD_CACHE_MAX_LEN 1024
+
+struct cmd_cache_entry {
+    char *str;
+    struct mp_cmd *cmd;
+    uint64_t last_use;
 };
 
 struct cmd_bind_section {
@@ -155,6 +166,9 @@ struct input_ctx {
 
     struct cmd_queue cmd_queue;
 
+    struct cmd_cache_entry cmd_cache[CMD_CACHE_SIZE];
+    uint64_t cmd_cache_uses;
+
     void (*cancel)(void *cancel_ctx);
     void *cancel_ctx;
 
@@ -280,12 +294,24 @@ static struct mp_cmd *queue_peek_tail(struct cmd_queue *queue)
     return cur;
 }
 
+// Return a new command for the binding. The parse result is cached, so key
+// presses and repeated bindings don't parse the command string every time.
+static struct mp_cmd *get_bind_cmd(struct input_ctx *ictx,
+                                   struct cmd_bind *bind)
+{
+    if (!bind->parsed) {
+        bind->parsed = mp_input_parse_cmd(ictx, bstr0(bind->cmd),
+                                          bind->location);
+        talloc_steal(bind->owner->binds, bind->parsed);
+    }
+    return mp_cmd_clone(bind->parsed);
+}
+
 static void append_bind_info(struct input_ctx *ictx, char **pmsg,
                              struct cmd_bind *bind)
 {
     char *msg = *pmsg;
-    struct mp_cmd *cmd = mp_input_parse_cmd(ictx, bstr0(bind->cmd),
-                                            bind->location);
+    struct mp_cmd *cmd = get_bind_cmd(ictx, bind);
     bstr stripped = cmd ? cmd->original : bstr0(bind->cmd);
     msg = talloc_asprintf_append(msg, " '%.*s'", BSTR_P(stripped));
     if (!cmd)
@@ -474,7 +500,7 @@ static mp_cmd_t *get_cmd_from_keys(struct input_ctx *ictx, char *force_section,
         talloc_free(key_buf);
         return NULL;
     }
-    mp_cmd_t *ret = mp_input_parse_cmd(ictx, bstr0(cmd->cmd), cmd->location);
+    mp_cmd_t *ret = get_bind_cmd(ictx, cmd);
     if (ret) {
         ret->input_section = cmd->owner->section;
         ret->key_name = talloc_steal(ret, mp_input_get_key_combo_name(&code, 1));
@@ -903,6 +929,8 @@ int mp_input_queue_cmd(struct input_ctx *ictx, mp_cmd_t *cmd)
 {
     input_lock(ictx);
     if (cmd) {
+        if (!cmd->arrival_time)
+            cmd->arrival_time = mp_time_us();
         if (ictx->cancel && test_abort_cmd(ictx, cmd))
             ictx->cancel(ictx->cancel_ctx);
         queue_add_tail(&ictx->cmd_queue, cmd);
@@ -1092,6 +1120,7 @@ static void bind_dealloc(struct cmd_bind *bind)
 {
     talloc_free(bind->cmd);
     talloc_free(bind->location);
+    talloc_free(bind->parsed);
 }
 
 // builtin: if true, remove all builtin binds, else remove all user binds
@@ -1421,6 +1450,10 @@ void mp_input_uninit(struct input_ctx *ictx)
     close_input_sources(ictx);
     clear_queue(&ictx->cmd_queue);
     talloc_free(ictx->current_down_cmd);
+    for (int n = 0; n < CMD_CACHE_SIZE; n++) {
+        talloc_free(ictx->cmd_cache[n].str);
+        talloc_free(ictx->cmd_cache[n].cmd);
+    }
     pthread_mutex_destroy(&ictx->mutex);
     talloc_free(ictx);
 }
@@ -1455,6 +1488,43 @@ struct mp_cmd *mp_input_parse_cmd(struct input_ctx *ictx, bstr str,
     return mp_input_parse_cmd_(ictx->log, str, location);
 }
 
+// Like mp_input_parse_cmd(), but keep the parse results of the most recently
+// used strings, and return clones of them. Meant for command strings which
+// are likely sent again and again (e.g. by scripts).
+struct mp_cmd *mp_input_parse_cmd_cached(struct input_ctx *ictx, bstr str,
+                                         const char *location)
+{
+    if (str.len > CMD_CACHE_MAX_LEN)
+        return mp_input_parse_cmd(ictx, str, location);
+
+    input_lock(ictx);
+    struct cmd_cache_entry *entry = NULL;
+    for (int n = 0; n < CMD_CACHE_SIZE; n++) {
+        struct cmd_cache_entry *e = &ictx->cmd_cache[n];
+        if (e->str && bstr_equals0(str, e->str)) {
+            entry = e;
+            break;
+        }
+        if (!entry || (entry->str && e->last_use < entry->last_use))
+            entry = e; // least recently used one, unless it's found
+    }
+    if (!entry->str || !bstr_equals0(str, entry->str)) {
+        struct mp_cmd *cmd = mp_input_parse_cmd(ictx, str, location);
+        if (!cmd) {
+            input_unlock(ictx);
+            return NULL;
+        }
+        talloc_free(entry->str);
+        talloc_free(entry->cmd);
+        entry->str = bstrto0(NULL, str);
+        entry->cmd = cmd;
+    }
+    entry->last_use = ++ictx->cmd_cache_uses;
+    struct mp_cmd *res = mp_cmd_clone(entry->cmd);
+    input_unlock(ictx);
+    return res;
+}
+
 void mp_input_run_cmd(struct input_ctx *ictx, const char **cmd)
 {
     mp_input_queue_cmd(ictx, mp_input_parse_cmd_strv(ictx->log, cmd));
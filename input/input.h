@@ -89,6 +89,7 @@ typedef struct mp_cmd {
     const struct mp_cmd_def *def;
     char *sender; // name of the client API user which sent this
     char *key_name; // string representation of the key binding
+    int64_t arrival_time; // mp_time_us() when the command was received
 } mp_cmd_t;
 
 struct mp_input_src {
@@ -176,6 +177,11 @@ struct mp_cmd *mp_input_read_cmd(struct input_ctx *ictx);
 struct mp_cmd *mp_input_parse_cmd(struct input_ctx *ictx, bstr str,
                                   const char *location);
 
+// Like mp_input_parse_cmd(), but reuse the parse result if the same string was
+// parsed recently.
+struct mp_cmd *mp_input_parse_cmd_cached(struct input_ctx *ictx, bstr str,
+                                         const char *location);
+
 // Set current input section. The section is appended on top of the list of
 // active sections, so its bindings are considered first. If the section was
 // already active, it's moved to the top as well.
@@ -277,4 +283,18 @@ char *mp_json_encode_event(struct mpv_event *event);
 struct mpv_handle;
 char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf);
 
+// Binary IPC protocol (length prefixed MessagePack frames, see ipc.rst).
+#define MP_IPC_MAX_FRAME (16 * 1024 * 1024)
+
+// Like mp_json_encode_event(), but returns a binary frame allocated under
+// ta_parent (empty on failure).
+bstr mp_msgpack_encode_event(void *ta_parent, struct mpv_event *event);
+
+// Like mp_ipc_consume_next_command(), but for binary frames. Returns 0 if buf
+// doesn't contain a complete frame yet, -1 on fatal protocol errors, and 1 if
+// a frame was executed. Then the reply frame is stored in *out (allocated
+// under ctx), and the frame is removed from buf.
+int mp_ipc_consume_next_frame(struct mpv_handle *client, void *ctx, bstr *buf,
+                              bstr *out);
+
 #endif /* MPLAYER_INPUT_H */
@@ -44,14 +44,10 @@
 #define MSG_NOSIGNAL 0
 #endif
 
-struct mp_ipc_ctx {
-    struct mp_log *log;
-    struct mp_client_api *client_api;
-    const char *path;
-
-    pthread_t thread;
-    int death_pipe[2];
-};
+// Once this much output is pending for a client, stop reading its requests.
+#define OUT_SOFT_LIMIT (1024 * 1024)
+// A client with this much pending output is not reading, and is disconnected.
+#define OUT_HARD_LIMIT (64 * 1024 * 1024)
 
 struct client_arg {
     struct mp_log *log;
@@ -62,156 +58,233 @@ struct client_arg {
     bool close_client_fd;
 
     bool writable;
+
+    // Set once the client sent the binary protocol marker byte.
+    bool binary;
+    bool negotiated;
+
+    int wakeup_fd;
+    bstr client_msg;        // unprocessed input
+    bstr out;               // output not yet sent (from out_pos on)
+    size_t out_pos;
 };
 
-static int ipc_write_str(struct client_arg *client, const char *buf)
+struct mp_ipc_ctx {
+    struct mp_log *log;
+    struct mp_client_api *client_api;
+    const char *path;
+
+    pthread_t thread;
+    int death_pipe[2];
+
+    // Owned by the IPC thread once it runs.
+    struct client_arg **clients;
+    int num_clients;
+};
+
+static void ipc_write_data(struct client_arg *client, const char *buf,
+                           size_t count)
 {
-    size_t count = strlen(buf);
-    while (count > 0) {
-        ssize_t rc = send(client->client_fd, buf, count, MSG_NOSIGNAL);
+    if (client->writable)
+        bstr_xappend(client, &client->out, (bstr){(char *)buf, count});
+}
+
+static void ipc_write_str(struct client_arg *client, const char *buf)
+{
+    ipc_write_data(client, buf, strlen(buf));
+}
+
+static size_t ipc_pending(struct client_arg *client)
+{
+    return client->out.len - client->out_pos;
+}
+
+// Send as much of the pending output as possible without blocking.
+static int ipc_flush(struct client_arg *client)
+{
+    while (ipc_pending(client)) {
+        ssize_t rc = send(client->client_fd, client->out.start + client->out_pos,
+                          ipc_pending(client), MSG_NOSIGNAL);
         if (rc <= 0) {
             if (rc == 0)
                 return -1;
 
             if (errno == EBADF) {
                 client->writable = false;
-                return 0;
+                client->out_pos = client->out.len;
+                break;
             }
 
-            if (errno == EINTR || errno == EAGAIN)
+            if (errno == EINTR)
                 continue;
 
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+
             return rc;
         }
 
-        count -= rc;
-        buf   += rc;
+        client->out_pos += rc;
     }
 
+    client->out.len = client->out_pos = 0;
     return 0;
 }
 
-static void *client_thread(void *p)
+static int ipc_write_event(struct client_arg *client, mpv_event *event)
 {
-    pthread_detach(pthread_self());
+    if (client->binary) {
+        bstr frame = mp_msgpack_encode_event(NULL, event);
+        ipc_write_data(client, frame.start, frame.len);
+        talloc_free(frame.start);
+        return frame.len ? 0 : -1;
+    } else {
+        char *event_msg = mp_json_encode_event(event);
+        if (event_msg)
+            ipc_write_str(client, event_msg);
+        talloc_free(event_msg);
+        return event_msg ? 0 : -1;
+    }
+}
 
-    // We don't use MSG_NOSIGNAL because the moldy fruit OS doesn't support it.
-    struct sigaction sa = { .sa_handler = SIG_IGN, .sa_flags = SA_RESTART };
-    sigfillset(&sa.sa_mask);
-    sigaction(SIGPIPE, &sa, NULL);
+// Execute all complete requests in the buffer. Returns false on fatal errors.
+static bool ipc_handle_input(struct client_arg *arg, bstr *client_msg)
+{
+    if (!arg->negotiated && client_msg->len) {
+        arg->negotiated = true;
+        if (client_msg->start[0] == '\0') {
+            arg->binary = true;
+            bstr rest = bstrdup(NULL, bstr_cut(*client_msg, 1));
+            talloc_free(client_msg->start);
+            *client_msg = rest;
+            // Tells the client where JSON output ends and frames begin.
+            ipc_write_data(arg, "", 1);
+            MP_VERBOSE(arg, "Using binary protocol\n");
+        }
+    }
 
-    int rc;
+    if (arg->binary) {
+        while (1) {
+            bstr reply = {0};
+            int r = mp_ipc_consume_next_frame(arg->client, NULL, client_msg,
+                                              &reply);
+            if (r == 0)
+                return true;
+            if (r < 0) {
+                MP_ERR(arg, "Invalid binary request\n");
+                talloc_free(reply.start);
+                return false;
+            }
+            ipc_write_data(arg, reply.start, reply.len);
+            talloc_free(reply.start);
+        }
+    }
 
-    struct client_arg *arg = p;
-    bstr client_msg = { talloc_strdup(NULL, ""), 0 };
+    while (bstrchr(*client_msg, '\n') != -1) {
+        char *reply_msg = mp_ipc_consume_next_command(arg->client,
+            NULL, client_msg);
 
-    mpthread_set_name(arg->client_name);
+        if (reply_msg)
+            ipc_write_str(arg, reply_msg);
 
-    int pipe_fd = mpv_get_wakeup_pipe(arg->client);
-    if (pipe_fd < 0) {
-        MP_ERR(arg, "Could not get wakeup pipe\n");
-        goto done;
+        talloc_free(reply_msg);
     }
 
-    MP_VERBOSE(arg, "Client connected\n");
-
-    struct pollfd fds[2] = {
-        {.events = POLLIN, .fd = pipe_fd},
-        {.events = POLLIN, .fd = arg->client_fd},
-    };
+    return true;
+}
 
-    fcntl(arg->client_fd, F_SETFL, fcntl(arg->client_fd, F_GETFL, 0) | O_NONBLOCK);
+// Returns false if the client should be destroyed.
+static bool client_handle_events(struct client_arg *arg)
+{
+    mp_flush_wakeup_pipe(arg->wakeup_fd);
 
     while (1) {
-        rc = poll(fds, 2, 0);
-        if (rc == 0)
-            rc = poll(fds, 2, -1);
-        if (rc < 0) {
-            MP_ERR(arg, "Poll error\n");
-            continue;
-        }
-
-        if (fds[0].revents & POLLIN) {
-            mp_flush_wakeup_pipe(pipe_fd);
+        mpv_event *event = mpv_wait_event(arg->client, 0);
 
-            while (1) {
-                mpv_event *event = mpv_wait_event(arg->client, 0);
+        if (event->event_id == MPV_EVENT_NONE)
+            return true;
 
-                if (event->event_id == MPV_EVENT_NONE)
-                    break;
+        if (event->event_id == MPV_EVENT_SHUTDOWN)
+            return false;
 
-                if (event->event_id == MPV_EVENT_SHUTDOWN)
-                    goto done;
-
-                if (!arg->writable)
-                    continue;
-
-                char *event_msg = mp_json_encode_event(event);
-                if (!event_msg) {
-                    MP_ERR(arg, "Encoding error\n");
-                    goto done;
-                }
+        if (!arg->writable)
+            continue;
 
-                rc = ipc_write_str(arg, event_msg);
-                talloc_free(event_msg);
-                if (rc < 0) {
-                    MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                    goto done;
-                }
-            }
+        if (ipc_write_event(arg, event) < 0) {
+            MP_ERR(arg, "Encoding error\n");
+            return false;
         }
+    }
+}
 
-        if (fds[1].revents & (POLLIN | POLLHUP)) {
-            while (1) {
-                char buf[128];
-                bstr append = { buf, 0 };
-
-                ssize_t bytes = read(arg->client_fd, buf, sizeof(buf));
-                if (bytes < 0) {
-                    if (errno == EAGAIN)
-                        break;
-
-                    MP_ERR(arg, "Read error (%s)\n", mp_strerror(errno));
-                    goto done;
-                }
+// Returns false if the client should be destroyed.
+static bool client_handle_input(struct client_arg *arg)
+{
+    while (ipc_pending(arg) < OUT_SOFT_LIMIT) {
+        char buf[4096];
 
-                if (bytes == 0) {
-                    MP_VERBOSE(arg, "Client disconnected\n");
-                    goto done;
-                }
+        ssize_t bytes = read(arg->client_fd, buf, sizeof(buf));
+        if (bytes < 0) {
+            if (errno == EINTR)
+                continue;
 
-                append.len = bytes;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
 
-                bstr_xappend(NULL, &client_msg, append);
+            MP_ERR(arg, "Read error (%s)\n", mp_strerror(errno));
+            return false;
+        }
 
-                while (bstrchr(client_msg, '\n') != -1) {
-                    char *reply_msg = mp_ipc_consume_next_command(arg->client,
-                        NULL, &client_msg);
+        if (bytes == 0) {
+            MP_VERBOSE(arg, "Client disconnected\n");
+            return false;
+        }
 
-                    if (reply_msg && arg->writable) {
-                        rc = ipc_write_str(arg, reply_msg);
-                        if (rc < 0) {
-                            MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                            talloc_free(reply_msg);
-                            goto done;
-                        }
-                    }
+        bstr_xappend(NULL, &arg->client_msg, (bstr){buf, bytes});
 
-                    talloc_free(reply_msg);
-                }
-            }
-        }
+        if (!ipc_handle_input(arg, &arg->client_msg))
+            return false;
     }
 
-done:
-    if (client_msg.len > 0)
+    return true;
+}
+
+static void client_destroy(struct client_arg *arg)
+{
+    if (arg->client_msg.len > 0)
         MP_WARN(arg, "Ignoring unterminated command on disconnect.\n");
-    talloc_free(client_msg.start);
+    talloc_free(arg->client_msg.start);
     if (arg->close_client_fd)
         close(arg->client_fd);
     mpv_detach_destroy(arg->client);
     talloc_free(arg);
-    return NULL;
+}
+
+// Serve the client after poll() returned. Returns false if it should be
+// destroyed.
+static bool client_process(struct client_arg *arg, struct pollfd *fds)
+{
+    if (fds[0].revents & POLLIN) {
+        if (!client_handle_events(arg))
+            return false;
+    }
+
+    if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+        if (ipc_pending(arg) < OUT_SOFT_LIMIT && !client_handle_input(arg))
+            return false;
+    }
+
+    if (ipc_flush(arg) < 0) {
+        MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
+        return false;
+    }
+
+    if (ipc_pending(arg) >= OUT_HARD_LIMIT) {
+        MP_ERR(arg, "Client is not reading its data, disconnecting.\n");
+        return false;
+    }
+
+    return true;
 }
 
 static void ipc_start_client(struct mp_ipc_ctx *ctx, struct client_arg *client)
@@ -219,13 +292,21 @@ static void ipc_start_client(struct mp_ipc_ctx *ctx, struct client_arg *client)
     client->client = mp_new_client(ctx->client_api, client->client_name),
     client->log    = mp_client_get_log(client->client);
 
-    pthread_t client_thr;
-    if (pthread_create(&client_thr, NULL, client_thread, client)) {
-        mpv_detach_destroy(client->client);
-        if (client->close_client_fd)
-            close(client->client_fd);
-        talloc_free(client);
+    client->client_msg = (bstr){ talloc_strdup(NULL, ""), 0 };
+
+    client->wakeup_fd = mpv_get_wakeup_pipe(client->client);
+    if (client->wakeup_fd < 0) {
+        MP_ERR(client, "Could not get wakeup pipe\n");
+        client_destroy(client);
+        return;
     }
+
+    fcntl(client->client_fd, F_SETFL,
+          fcntl(client->client_fd, F_GETFL, 0) | O_NONBLOCK);
+
+    MP_VERBOSE(client, "Client connected\n");
+
+    MP_TARRAY_APPEND(ctx, ctx->clients, ctx->num_clients, client);
 }
 
 static void ipc_start_client_json(struct mp_ipc_ctx *ctx, int id, int fd)
@@ -284,23 +365,16 @@ static void ipc_start_client_text(struct mp_ipc_ctx *ctx, const char *path)
     ipc_start_client(ctx, client);
 }
 
-static void *ipc_thread(void *p)
+static int ipc_listen(struct mp_ipc_ctx *arg)
 {
     int rc;
 
-    int ipc_fd;
     struct sockaddr_un ipc_un = {0};
 
-    struct mp_ipc_ctx *arg = p;
-
-    mpthread_set_name("ipc socket listener");
-
-    MP_VERBOSE(arg, "Starting IPC master\n");
-
-    ipc_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    int ipc_fd = socket(AF_UNIX, SOCK_STREAM, 0);
     if (ipc_fd < 0) {
         MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        goto error;
     }
 
 #if HAVE_FCHMOD
@@ -310,7 +384,7 @@ static void *ipc_thread(void *p)
     size_t path_len = strlen(arg->path);
     if (path_len >= sizeof(ipc_un.sun_path) - 1) {
         MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        goto error;
     }
 
     ipc_un.sun_family = AF_UNIX,
@@ -327,46 +401,107 @@ static void *ipc_thread(void *p)
     rc = bind(ipc_fd, (struct sockaddr *) &ipc_un, addr_len);
     if (rc < 0) {
         MP_ERR(arg, "Could not bind IPC socket\n");
-        goto done;
+        goto error;
     }
 
     rc = listen(ipc_fd, 10);
     if (rc < 0) {
         MP_ERR(arg, "Could not listen on IPC socket\n");
-        goto done;
+        goto error;
     }
 
     MP_VERBOSE(arg, "Listening to IPC socket.\n");
+    return ipc_fd;
+
+error:
+    if (ipc_fd >= 0)
+        close(ipc_fd);
+    return -1;
+}
+
+// Serves the listening socket and all clients.
+static void *ipc_thread(void *p)
+{
+    int rc;
+
+    struct mp_ipc_ctx *arg = p;
+
+    mpthread_set_name("ipc");
+
+    // We don't use MSG_NOSIGNAL because the moldy fruit OS doesn't support it.
+    struct sigaction sa = { .sa_handler = SIG_IGN, .sa_flags = SA_RESTART };
+    sigfillset(&sa.sa_mask);
+    sigaction(SIGPIPE, &sa, NULL);
+
+    MP_VERBOSE(arg, "Starting IPC master\n");
+
+    int ipc_fd = -1;
+    if (arg->path && arg->path[0])
+        ipc_fd = ipc_listen(arg);
 
     int client_num = 0;
 
-    struct pollfd fds[2] = {
-        {.events = POLLIN, .fd = arg->death_pipe[0]},
-        {.events = POLLIN, .fd = ipc_fd},
-    };
+    struct pollfd *fds = NULL;
+    int num_fds = 0;
 
     while (1) {
-        rc = poll(fds, 2, -1);
+        // fds[0]: death pipe, fds[1]: listening socket, then a pair of
+        // (wakeup pipe, connection) for each client.
+        int num_clients = arg->num_clients;
+        num_fds = 2 + num_clients * 2;
+        MP_TARRAY_GROW(NULL, fds, num_fds);
+        fds[0] = (struct pollfd){.events = POLLIN, .fd = arg->death_pipe[0]};
+        fds[1] = (struct pollfd){.events = POLLIN, .fd = ipc_fd};
+        for (int n = 0; n < num_clients; n++) {
+            struct client_arg *client = arg->clients[n];
+            short events = 0;
+            // Backpressure: don't take new requests while replies pile up.
+            if (ipc_pending(client) < OUT_SOFT_LIMIT)
+                events |= POLLIN;
+            if (ipc_pending(client))
+                events |= POLLOUT;
+            fds[2 + n * 2 + 0] =
+                (struct pollfd){.events = POLLIN, .fd = client->wakeup_fd};
+            fds[2 + n * 2 + 1] =
+                (struct pollfd){.events = events, .fd = client->client_fd};
+        }
+
+        rc = poll(fds, num_fds, -1);
         if (rc < 0) {
-            MP_ERR(arg, "Poll error\n");
+            if (errno != EINTR)
+                MP_ERR(arg, "Poll error\n");
             continue;
         }
 
         if (fds[0].revents & POLLIN)
             goto done;
 
+        for (int n = num_clients - 1; n >= 0; n--) {
+            struct client_arg *client = arg->clients[n];
+            if (!client_process(client, &fds[2 + n * 2])) {
+                client_destroy(client);
+                MP_TARRAY_REMOVE_AT(arg->clients, arg->num_clients, n);
+            }
+        }
+
         if (fds[1].revents & POLLIN) {
             int client_fd = accept(ipc_fd, NULL, NULL);
             if (client_fd < 0) {
                 MP_ERR(arg, "Could not accept IPC client\n");
-                goto done;
+                close(ipc_fd);
+                ipc_fd = -1;
+            } else {
+                ipc_start_client_json(arg, client_num++, client_fd);
             }
-
-            ipc_start_client_json(arg, client_num++, client_fd);
         }
     }
 
 done:
+    for (int n = 0; n < arg->num_clients; n++)
+        client_destroy(arg->clients[n]);
+    arg->num_clients = 0;
+    talloc_free(fds);
+
     if (ipc_fd >= 0)
         close(ipc_fd);
 
@@ -390,7 +525,7 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
     if (input_file && *input_file)
         ipc_start_client_text(arg, input_file);
 
-    if (!opts->ipc_path || !*opts->ipc_path)
+    if (!arg->num_clients && (!opts->ipc_path || !*opts->ipc_path))
         goto out;
 
     if (mp_make_wakeup_pipe(arg->death_pipe) < 0)
@@ -402,6 +537,8 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
     return arg;
 
 out:
+    for (int n = 0; n < arg->num_clients; n++)
+        client_destroy(arg->clients[n]);
     if (arg->death_pipe[0] >= 0) {
         close(arg->death_pipe[0]);
         close(arg->death_pipe[1]);
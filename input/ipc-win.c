@@ -20,6 +20,7 @@
 
 #include "config.h"
 
+#include "osdep/atomic.h"
 #include "osdep/io.h"
 #include "osdep/threads.h"
 #include "osdep/windows_utils.h"
@@ -32,23 +33,49 @@
 #include "options/options.h"
 #include "player/client.h"
 
+// Once this much output is pending for a client, stop reading its requests.
+#define OUT_SOFT_LIMIT (1024 * 1024)
+// A client with this much pending output is not reading, and is disconnected.
+#define OUT_HARD_LIMIT (64 * 1024 * 1024)
+
+// All pipe instances are associated to the IPC thread's completion port. The
+// completion key identifies the pipe instance (IDs are never reused, so stale
+// packets for destroyed clients can be recognized). Key 0 is the death signal.
 struct mp_ipc_ctx {
     struct mp_log *log;
     struct mp_client_api *client_api;
     const wchar_t *path;
 
     pthread_t thread;
-    HANDLE death_event;
+    HANDLE iocp;
+
+    // Owned by the IPC thread.
+    struct client_arg **clients;
+    int num_clients;
+    ULONG_PTR next_id;
 };
 
 struct client_arg {
     struct mp_log *log;
     struct mpv_handle *client;
+    struct mp_ipc_ctx *ctx;
 
     char *client_name;
     HANDLE client_h;
+    ULONG_PTR id;
     bool writable;
+
+    atomic_int wakeup_posted;
+
+    OVERLAPPED read_ol;
+    bool reading;
+    char read_buf[4096];
+    bstr client_msg;        // unprocessed input
+
     OVERLAPPED write_ol;
+    bool write_pending;
+    bstr writing;           // data of the pending write
+    bstr out;               // data queued after that
 };
 
 // Get a string SID representing the current user. Must be freed by LocalFree.
@@ -135,8 +162,10 @@ static PSECURITY_DESCRIPTOR create_restricted_sd(void)
 
 static void wakeup_cb(void *d)
 {
-    HANDLE event = d;
-    SetEvent(event);
+    struct client_arg *arg = d;
+    // Coalesce wakeups until the IPC thread handles the packet.
+    if (!atomic_fetch_or(&arg->wakeup_posted, 1))
+        PostQueuedCompletionStatus(arg->ctx->iocp, 0, arg->id, NULL);
 }
 
 // Wrapper for ReadFile that treats ERROR_IO_PENDING as success
@@ -166,26 +195,16 @@ static bool pipe_error_is_fatal(DWORD error)
     return true;
 }
 
-static DWORD ipc_write_str(struct client_arg *arg, const char *buf)
+static void report_write_error(struct client_arg *arg, DWORD error)
 {
-    DWORD error = 0;
-
-    if ((error = async_write(arg->client_h, buf, strlen(buf), &arg->write_ol)))
-        goto done;
-    if (!GetOverlappedResult(arg->client_h, &arg->write_ol, &(DWORD){0}, TRUE)) {
-        error = GetLastError();
-        goto done;
-    }
-
-done:
     if (pipe_error_is_fatal(error)) {
         MP_VERBOSE(arg, "Error writing to pipe: %s\n",
             mp_HRESULT_to_str(HRESULT_FROM_WIN32(error)));
     }
 
-    if (error)
-        arg->writable = false;
-    return error;
+    // Drop the output; a disconnect is noticed by the read operation.
+    arg->writable = false;
+    arg->out.len = 0;
 }
 
 static void report_read_error(struct client_arg *arg, DWORD error)
@@ -199,210 +218,236 @@ static void report_read_error(struct client_arg *arg, DWORD error)
     }
 }
 
-static void *client_thread(void *p)
+static void ipc_write_str(struct client_arg *arg, const char *buf)
 {
-    pthread_detach(pthread_self());
-
-    struct client_arg *arg = p;
-    char buf[4096];
-    HANDLE wakeup_event = CreateEventW(NULL, TRUE, FALSE, NULL);
-    OVERLAPPED ol = { .hEvent = CreateEventW(NULL, TRUE, TRUE, NULL) };
-    bstr client_msg = { talloc_strdup(NULL, ""), 0 };
-    DWORD ioerr = 0;
-    DWORD r;
-
-    mpthread_set_name(arg->client_name);
+    if (arg->writable)
+        bstr_xappend(arg, &arg->out, bstr0(buf));
+}
 
-    arg->write_ol.hEvent = CreateEventW(NULL, TRUE, TRUE, NULL);
-    if (!wakeup_event || !ol.hEvent || !arg->write_ol.hEvent) {
-        MP_ERR(arg, "Couldn't create events\n");
-        goto done;
-    }
+static size_t ipc_pending(struct client_arg *arg)
+{
+    return arg->writing.len + arg->out.len;
+}
 
-    MP_VERBOSE(arg, "Client connected\n");
+// Start writing the queued output, if no write operation is pending.
+static void start_write(struct client_arg *arg)
+{
+    if (arg->write_pending || !arg->out.len || !arg->writable)
+        return;
 
-    mpv_set_wakeup_callback(arg->client, wakeup_cb, wakeup_event);
+    MPSWAP(bstr, arg->writing, arg->out);
+    arg->out.len = 0;
 
-    // Do the first read operation on the pipe
-    if ((ioerr = async_read(arg->client_h, buf, 4096, &ol))) {
-        report_read_error(arg, ioerr);
-        goto done;
+    arg->write_ol = (OVERLAPPED){0};
+    DWORD error = async_write(arg->client_h, arg->writing.start,
+                              arg->writing.len, &arg->write_ol);
+    if (error) {
+        arg->writing.len = 0;
+        report_write_error(arg, error);
+        return;
     }
+    arg->write_pending = true;
+}
 
-    while (1) {
-        HANDLE handles[] = { wakeup_event, ol.hEvent };
-        int n = WaitForMultipleObjects(2, handles, FALSE, 0);
-        if (n == WAIT_TIMEOUT)
-            n = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
-
-        switch (n) {
-        case WAIT_OBJECT_0: // wakeup_event
-            ResetEvent(wakeup_event);
+// Start the next read operation, unless the client is throttled.
+static bool start_read(struct client_arg *arg)
+{
+    if (arg->reading || ipc_pending(arg) >= OUT_SOFT_LIMIT)
+        return true;
+
+    arg->read_ol = (OVERLAPPED){0};
+    DWORD error = async_read(arg->client_h, arg->read_buf,
+                             sizeof(arg->read_buf), &arg->read_ol);
+    if (error) {
+        report_read_error(arg, error);
+        return false;
+    }
+    arg->reading = true;
+    return true;
+}
 
-            while (1) {
-                mpv_event *event = mpv_wait_event(arg->client, 0);
+// Returns false if the client should be destroyed.
+static bool client_handle_events(struct client_arg *arg)
+{
+    atomic_store(&arg->wakeup_posted, 0);
 
-                if (event->event_id == MPV_EVENT_NONE)
-                    break;
+    while (1) {
+        mpv_event *event = mpv_wait_event(arg->client, 0);
 
-                if (event->event_id == MPV_EVENT_SHUTDOWN)
-                    goto done;
+        if (event->event_id == MPV_EVENT_NONE)
+            return true;
 
-                if (!arg->writable)
-                    continue;
+        if (event->event_id == MPV_EVENT_SHUTDOWN)
+            return false;
 
-                char *event_msg = mp_json_encode_event(event);
-                if (!event_msg) {
-                    MP_ERR(arg, "Encoding error\n");
-                    goto done;
-                }
+        if (!arg->writable)
+            continue;
 
-                ipc_write_str(arg, event_msg);
-                talloc_free(event_msg);
-            }
+        char *event_msg = mp_json_encode_event(event);
+        if (!event_msg) {
+            MP_ERR(arg, "Encoding error\n");
+            return false;
+        }
 
-            break;
-        case WAIT_OBJECT_0 + 1: // ol.hEvent
-            // Complete the read operation on the pipe
-            if (!GetOverlappedResult(arg->client_h, &ol, &r, TRUE)) {
-                report_read_error(arg, GetLastError());
-                goto done;
-            }
+        ipc_write_str(arg, event_msg);
+        talloc_free(event_msg);
+    }
+}
 
-            bstr_xappend(NULL, &client_msg, (bstr){buf, r});
-            while (bstrchr(client_msg, '\n') != -1) {
-                char *reply_msg = mp_ipc_consume_next_command(arg->client,
-                    NULL, &client_msg);
-                if (reply_msg && arg->writable)
-                    ipc_write_str(arg, reply_msg);
-                talloc_free(reply_msg);
-            }
+static void client_handle_input(struct client_arg *arg, DWORD size)
+{
+    bstr_xappend(NULL, &arg->client_msg, (bstr){arg->read_buf, size});
+    while (bstrchr(arg->client_msg, '\n') != -1) {
+        char *reply_msg = mp_ipc_consume_next_command(arg->client,
+            NULL, &arg->client_msg);
+        if (reply_msg)
+            ipc_write_str(arg, reply_msg);
+        talloc_free(reply_msg);
+    }
+}
 
-            // Begin the next read operation on the pipe
-            if ((ioerr = async_read(arg->client_h, buf, 4096, &ol))) {
-                report_read_error(arg, ioerr);
-                goto done;
-            }
-            break;
-        default:
-            MP_ERR(arg, "WaitForMultipleObjects failed\n");
-            goto done;
+// Handle a completion packet for the client. ol is NULL for wakeups. Returns
+// false if the client should be destroyed.
+static bool client_process(struct client_arg *arg, OVERLAPPED *ol, BOOL ok,
+                           DWORD size)
+{
+    if (!ol) {
+        if (!client_handle_events(arg))
+            return false;
+    } else if (ol == &arg->read_ol) {
+        arg->reading = false;
+        if (!ok) {
+            report_read_error(arg, GetLastError());
+            return false;
         }
+        client_handle_input(arg, size);
+    } else if (ol == &arg->write_ol) {
+        arg->write_pending = false;
+        arg->writing.len = 0;
+        if (!ok)
+            report_write_error(arg, GetLastError());
     }
 
-done:
-    if (client_msg.len > 0)
+    if (ipc_pending(arg) >= OUT_HARD_LIMIT) {
+        MP_ERR(arg, "Client is not reading its data, disconnecting.\n");
+        return false;
+    }
+
+    start_write(arg);
+    return start_read(arg);
+}
+
+static void client_destroy(struct client_arg *arg)
+{
+    if (arg->client_msg.len > 0)
         MP_WARN(arg, "Ignoring unterminated command on disconnect.\n");
 
-    if (CancelIoEx(arg->client_h, &ol) || GetLastError() != ERROR_NOT_FOUND)
-        GetOverlappedResult(arg->client_h, &ol, &(DWORD){0}, TRUE);
-    if (wakeup_event)
-        CloseHandle(wakeup_event);
-    if (ol.hEvent)
-        CloseHandle(ol.hEvent);
-    if (arg->write_ol.hEvent)
-        CloseHandle(arg->write_ol.hEvent);
+    // The completion packets of cancelled operations are still queued, but
+    // are ignored, because the ID is not found anymore.
+    CancelIoEx(arg->client_h, NULL);
+    if (arg->reading)
+        GetOverlappedResult(arg->client_h, &arg->read_ol, &(DWORD){0}, TRUE);
+    if (arg->write_pending)
+        GetOverlappedResult(arg->client_h, &arg->write_ol, &(DWORD){0}, TRUE);
 
     CloseHandle(arg->client_h);
-    mpv_detach_destroy(arg->client);
+    if (arg->client)
+        mpv_detach_destroy(arg->client);
+    talloc_free(arg->client_msg.start);
     talloc_free(arg);
-    return NULL;
 }
 
 static void ipc_start_client(struct mp_ipc_ctx *ctx, struct client_arg *client)
 {
     client->client = mp_new_client(ctx->client_api, client->client_name),
     client->log    = mp_client_get_log(client->client);
+    client->client_msg = (bstr){ talloc_strdup(NULL, ""), 0 };
+
+    MP_VERBOSE(client, "Client connected\n");
 
-    pthread_t client_thr;
-    if (pthread_create(&client_thr, NULL, client_thread, client)) {
-        mpv_detach_destroy(client->client);
-        CloseHandle(client->client_h);
-        talloc_free(client);
+    MP_TARRAY_APPEND(ctx, ctx->clients, ctx->num_clients, client);
+
+    // This also posts the first wakeup packet.
+    mpv_set_wakeup_callback(client->client, wakeup_cb, client);
+
+    if (!start_read(client)) {
+        ctx->num_clients--;
+        client_destroy(client);
     }
 }
 
-static void ipc_start_client_json(struct mp_ipc_ctx *ctx, int id, HANDLE h)
+static void ipc_start_client_json(struct mp_ipc_ctx *ctx, int id, HANDLE h,
+                                  ULONG_PTR key)
 {
     struct client_arg *client = talloc_ptrtype(NULL, client);
     *client = (struct client_arg){
+        .ctx = ctx,
         .client_name = talloc_asprintf(client, "ipc-%d", id),
         .client_h = h,
+        .id = key,
         .writable = true,
     };
 
     ipc_start_client(ctx, client);
 }
 
-static void *ipc_thread(void *p)
+static int find_client(struct mp_ipc_ctx *ctx, ULONG_PTR key)
 {
-    // Use PIPE_TYPE_MESSAGE | PIPE_READMODE_BYTE so message framing is
-    // maintained for message-mode clients, but byte-mode clients can still
-    // connect, send and receive data. This is the most compatible mode.
-    static const DWORD state =
-        PIPE_TYPE_MESSAGE | PIPE_READMODE_BYTE | PIPE_WAIT |
-        PIPE_REJECT_REMOTE_CLIENTS;
-    static const DWORD mode =
-        PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED;
-    static const DWORD bufsiz = 4096;
-
-    struct mp_ipc_ctx *arg = p;
-    HANDLE server = INVALID_HANDLE_VALUE;
-    HANDLE client = INVALID_HANDLE_VALUE;
-    int client_num = 0;
-
-    mpthread_set_name("ipc named pipe listener");
-    MP_VERBOSE(arg, "Starting IPC master\n");
-
-    SECURITY_ATTRIBUTES sa = {
-        .nLength = sizeof sa,
-        .lpSecurityDescriptor = create_restricted_sd(),
-    };
-    if (!sa.lpSecurityDescriptor) {
-        MP_ERR(arg, "Couldn't create security descriptor");
-        goto done;
-    }
-
-    OVERLAPPED ol = { .hEvent = CreateEventW(NULL, TRUE, TRUE, NULL) };
-    if (!ol.hEvent) {
-        MP_ERR(arg, "Couldn't create event");
-        goto done;
-    }
-
-    server = CreateNamedPipeW(arg->path, mode | FILE_FLAG_FIRST_PIPE_INSTANCE,
-        state, PIPE_UNLIMITED_INSTANCES, bufsiz, bufsiz, 0, &sa);
-    if (server == INVALID_HANDLE_VALUE) {
-        MP_ERR(arg, "Couldn't create first pipe instance: %s\n",
-            mp_LastError_to_str());
-        goto done;
+    for (int n = 0; n < ctx->num_clients; n++) {
+        if (ctx->clients[n]->id == key)
+            return n;
     }
+    return -1;
+}
 
-    MP_VERBOSE(arg, "Listening to IPC pipe.\n");
+// Use PIPE_TYPE_MESSAGE | PIPE_READMODE_BYTE so message framing is
+// maintained for message-mode clients, but byte-mode clients can still
+// connect, send and receive data. This is the most compatible mode.
+static const DWORD pipe_state =
+    PIPE_TYPE_MESSAGE | PIPE_READMODE_BYTE | PIPE_WAIT |
+    PIPE_REJECT_REMOTE_CLIENTS;
+static const DWORD pipe_mode =
+    PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED;
+static const DWORD pipe_bufsiz = 4096;
+
+struct listener {
+    HANDLE server;
+    ULONG_PTR id;
+    OVERLAPPED ol;
+    bool connect_pending;
+    SECURITY_ATTRIBUTES sa;
+    int client_num;
+};
 
+// Create pipe instances and hand connected ones to new clients, until a
+// ConnectNamedPipe operation is pending. Returns false on fatal errors.
+static bool listen_next(struct mp_ipc_ctx *arg, struct listener *l)
+{
     while (1) {
-        DWORD err = ConnectNamedPipe(server, &ol) ? 0 : GetLastError();
+        if (l->server == INVALID_HANDLE_VALUE) {
+            DWORD mode = pipe_mode;
+            if (!l->client_num)
+                mode |= FILE_FLAG_FIRST_PIPE_INSTANCE;
+            l->server = CreateNamedPipeW(arg->path, mode, pipe_state,
+                PIPE_UNLIMITED_INSTANCES, pipe_bufsiz, pipe_bufsiz, 0, &l->sa);
+            if (l->server == INVALID_HANDLE_VALUE) {
+                MP_ERR(arg, "Couldn't create pipe instance: %s\n",
+                    mp_LastError_to_str());
+                return false;
+            }
+            l->id = arg->next_id++;
+            if (!CreateIoCompletionPort(l->server, arg->iocp, l->id, 0)) {
+                MP_ERR(arg, "Couldn't associate pipe: %s\n",
+                    mp_LastError_to_str());
+                return false;
+            }
+        }
 
+        l->ol = (OVERLAPPED){0};
+        DWORD err = ConnectNamedPipe(l->server, &l->ol) ? 0 : GetLastError();
         if (err == ERROR_IO_PENDING) {
-            int n = WaitForMultipleObjects(2, (HANDLE[]) {
-                arg->death_event,
-                ol.hEvent,
-            }, FALSE, INFINITE) - WAIT_OBJECT_0;
-
-            switch (n) {
-            case 0:
-                // Stop waiting for new clients
-                CancelIo(server);
-                GetOverlappedResult(server, &ol, &(DWORD){0}, TRUE);
-                goto done;
-            case 1:
-                // Complete the ConnectNamedPipe request
-                err = GetOverlappedResult(server, &ol, &(DWORD){0}, TRUE)
-                    ? 0 : GetLastError();
-                break;
-            default:
-                MP_ERR(arg, "WaitForMultipleObjects failed\n");
-                goto done;
-            }
+            l->connect_pending = true;
+            return true;
         }
 
         // ERROR_PIPE_CONNECTED is returned if a client connects before
@@ -415,34 +460,95 @@ static void *ipc_thread(void *p)
         if (err) {
             MP_ERR(arg, "ConnectNamedPipe failed: %s\n",
                 mp_HRESULT_to_str(HRESULT_FROM_WIN32(err)));
-            goto done;
+            return false;
         }
 
-        // Create the next pipe instance before the client thread to avoid the
-        // theoretical race condition where the client thread immediately
-        // closes the handle and there are no active instances of the pipe
-        client = server;
-        server = CreateNamedPipeW(arg->path, mode, state,
-            PIPE_UNLIMITED_INSTANCES, bufsiz, bufsiz, 0, &sa);
-        if (server == INVALID_HANDLE_VALUE) {
-            MP_ERR(arg, "Couldn't create additional pipe instance: %s\n",
-                mp_LastError_to_str());
+        HANDLE client = l->server;
+        l->server = INVALID_HANDLE_VALUE;
+        ipc_start_client_json(arg, l->client_num++, client, l->id);
+    }
+}
+
+// Serves the named pipe and all clients from a single completion port.
+static void *ipc_thread(void *p)
+{
+    struct mp_ipc_ctx *arg = p;
+    struct listener l = {
+        .server = INVALID_HANDLE_VALUE,
+        .sa = { .nLength = sizeof(l.sa) },
+    };
+
+    mpthread_set_name("ipc");
+    MP_VERBOSE(arg, "Starting IPC master\n");
+
+    l.sa.lpSecurityDescriptor = create_restricted_sd();
+    if (!l.sa.lpSecurityDescriptor) {
+        MP_ERR(arg, "Couldn't create security descriptor");
+        goto done;
+    }
+
+    if (!listen_next(arg, &l))
+        goto done;
+
+    MP_VERBOSE(arg, "Listening to IPC pipe.\n");
+
+    while (1) {
+        DWORD size = 0;
+        ULONG_PTR key = 0;
+        OVERLAPPED *ol = NULL;
+        BOOL ok = GetQueuedCompletionStatus(arg->iocp, &size, &key, &ol,
+                                            INFINITE);
+        if (!ok && !ol) {
+            MP_ERR(arg, "GetQueuedCompletionStatus failed\n");
             goto done;
         }
 
-        ipc_start_client_json(arg, client_num++, client);
-        client = NULL;
+        if (key == 0)
+            goto done; // death signal
+
+        if (l.connect_pending && key == l.id && ol == &l.ol) {
+            // Complete the ConnectNamedPipe request
+            l.connect_pending = false;
+            DWORD err = ok ? 0 : GetLastError();
+            if (err == ERROR_NO_DATA)
+                err = 0;
+            if (err) {
+                MP_ERR(arg, "ConnectNamedPipe failed: %s\n",
+                    mp_HRESULT_to_str(HRESULT_FROM_WIN32(err)));
+                goto done;
+            }
+            HANDLE client = l.server;
+            l.server = INVALID_HANDLE_VALUE;
+            ipc_start_client_json(arg, l.client_num++, client, l.id);
+            if (!listen_next(arg, &l))
+                goto done;
+            continue;
+        }
+
+        int n = find_client(arg, key);
+        if (n < 0)
+            continue; // packet for a destroyed client
+
+        struct client_arg *client = arg->clients[n];
+        if (!client_process(client, ol, ok, size)) {
+            MP_TARRAY_REMOVE_AT(arg->clients, arg->num_clients, n);
+            client_destroy(client);
+        }
     }
 
 done:
-    if (sa.lpSecurityDescriptor)
-        LocalFree(sa.lpSecurityDescriptor);
-    if (client != INVALID_HANDLE_VALUE)
-        CloseHandle(client);
-    if (server != INVALID_HANDLE_VALUE)
-        CloseHandle(server);
-    if (ol.hEvent)
-        CloseHandle(ol.hEvent);
+    for (int n = 0; n < arg->num_clients; n++)
+        client_destroy(arg->clients[n]);
+    arg->num_clients = 0;
+
+    if (l.server != INVALID_HANDLE_VALUE) {
+        // Stop waiting for new clients
+        if (l.connect_pending && CancelIoEx(l.server, &l.ol))
+            GetOverlappedResult(l.server, &l.ol, &(DWORD){0}, TRUE);
+        CloseHandle(l.server);
+    }
+    if (l.sa.lpSecurityDescriptor)
+        LocalFree(l.sa.lpSecurityDescriptor);
     return NULL;
 }
 
@@ -455,6 +561,7 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
     *arg = (struct mp_ipc_ctx){
         .log = mp_log_new(arg, global->log, "ipc"),
         .client_api = client_api,
+        .next_id = 1,
     };
 
     if (!opts->ipc_path || !*opts->ipc_path)
@@ -472,7 +579,8 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
         talloc_free(path);
     }
 
-    if (!(arg->death_event = CreateEventW(NULL, TRUE, FALSE, NULL)))
+    arg->iocp = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    if (!arg->iocp)
         goto out;
 
     if (pthread_create(&arg->thread, NULL, ipc_thread, arg))
@@ -481,8 +589,8 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
     return arg;
 
 out:
-    if (arg->death_event)
-        CloseHandle(arg->death_event);
+    if (arg->iocp)
+        CloseHandle(arg->iocp);
     talloc_free(arg);
     return NULL;
 }
@@ -492,9 +600,9 @@ void mp_uninit_ipc(struct mp_ipc_ctx *arg)
     if (!arg)
         return;
 
-    SetEvent(arg->death_event);
+    PostQueuedCompletionStatus(arg->iocp, 0, 0, NULL);
     pthread_join(arg->thread, NULL);
 
-    CloseHandle(arg->death_event);
+    CloseHandle(arg->iocp);
     talloc_free(arg);
 }
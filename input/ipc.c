@@ -20,6 +20,7 @@
 #include "common/msg.h"
 #include "input/input.h"
 #include "misc/json.h"
+#include "misc/msgpack.h"
 #include "options/m_option.h"
 #include "options/options.h"
 #include "options/path.h"
@@ -193,33 +194,24 @@ char *mp_json_encode_event(mpv_event *event)
     return output;
 }
 
-// Function is allowed to modify src[n].
-static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
-                                  char *src)
+// Run the command in msg_node (a parsed request of either protocol), and
+// add the reply fields to reply_node (a map).
+static void execute_command(struct mpv_handle *client, void *ta_parent,
+                            mpv_node *msg_node, mpv_node *reply_node)
 {
     int rc;
     const char *cmd = NULL;
-    struct mp_log *log = mp_client_get_log(client);
 
-    mpv_node msg_node;
-    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
     mpv_node *reqid_node = NULL;
 
-    rc = json_parse(ta_parent, &msg_node, &src, 50);
-    if (rc < 0) {
-        mp_err(log, "malformed JSON received: '%s'\n", src);
-        rc = MPV_ERROR_INVALID_PARAMETER;
-        goto error;
-    }
-
-    if (msg_node.format != MPV_FORMAT_NODE_MAP) {
+    if (msg_node->format != MPV_FORMAT_NODE_MAP) {
         rc = MPV_ERROR_INVALID_PARAMETER;
         goto error;
     }
 
-    reqid_node = mpv_node_map_get(&msg_node, "request_id");
+    reqid_node = mpv_node_map_get(msg_node, "request_id");
 
-    mpv_node *cmd_node = mpv_node_map_get(&msg_node, "command");
+    mpv_node *cmd_node = mpv_node_map_get(msg_node, "command");
     if (!cmd_node ||
         (cmd_node->format != MPV_FORMAT_NODE_ARRAY) ||
         !cmd_node->u.list->num)
@@ -238,16 +230,40 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
 
     if (!strcmp("client_name", cmd)) {
         const char *client_name = mpv_client_name(client);
-        mpv_node_map_add_string(ta_parent, &reply_node, "data", client_name);
+        mpv_node_map_add_string(ta_parent, reply_node, "data", client_name);
         rc = MPV_ERROR_SUCCESS;
     } else if (!strcmp("get_time_us", cmd)) {
         int64_t time_us = mpv_get_time_us(client);
-        mpv_node_map_add_int64(ta_parent, &reply_node, "data", time_us);
+        mpv_node_map_add_int64(ta_parent, reply_node, "data", time_us);
         rc = MPV_ERROR_SUCCESS;
     } else if (!strcmp("get_version", cmd)) {
         int64_t ver = mpv_client_api_version();
-        mpv_node_map_add_int64(ta_parent, &reply_node, "data", ver);
+        mpv_node_map_add_int64(ta_parent, reply_node, "data", ver);
         rc = MPV_ERROR_SUCCESS;
+    } else if (!strcmp("batch", cmd)) {
+        mpv_node result_node;
+        mpv_node cmds_node = {
+            .format = MPV_FORMAT_NODE_ARRAY,
+            .u.list = &(mpv_node_list){
+                .num = cmd_node->u.list->num - 1,
+                .values = cmd_node->u.list->values + 1,
+            },
+        };
+
+        rc = mpv_command_batch(client, &cmds_node, &result_node);
+        if (rc != MPV_ERROR_INVALID_PARAMETER) {
+            // Report the per-command errors as strings, like the reply itself.
+            for (int n = 0; n < result_node.u.list->num; n++) {
+                mpv_node *err = mpv_node_map_get(&result_node.u.list->values[n],
+                                                 "error");
+                if (err && err->format == MPV_FORMAT_INT64) {
+                    err->format = MPV_FORMAT_STRING;
+                    err->u.string = (char *)mpv_error_string(err->u.int64);
+                }
+            }
+            mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
+            mpv_free_node_contents(&result_node);
+        }
     } else if (!strcmp("get_property", cmd)) {
         mpv_node result_node;
 
@@ -264,7 +280,7 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         rc = mpv_get_property(client, cmd_node->u.list->values[1].u.string,
                               MPV_FORMAT_NODE, &result_node);
         if (rc >= 0) {
-            mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
+            mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
             mpv_free_node_contents(&result_node);
         }
     } else if (!strcmp("get_property_string", cmd)) {
@@ -281,9 +297,9 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         char *result = mpv_get_property_string(client,
                                         cmd_node->u.list->values[1].u.string);
         if (!result) {
-            mpv_node_map_add_null(ta_parent, &reply_node, "data");
+            mpv_node_map_add_null(ta_parent, reply_node, "data");
         } else {
-            mpv_node_map_add_string(ta_parent, &reply_node, "data", result);
+            mpv_node_map_add_string(ta_parent, reply_node, "data", result);
             mpv_free(result);
         }
     } else if (!strcmp("set_property", cmd)) {
@@ -318,8 +334,10 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         rc = mpv_set_property_string(client,
                                      cmd_node->u.list->values[1].u.string,
                                      cmd_node->u.list->values[2].u.string);
-    } else if (!strcmp("observe_property", cmd)) {
-        if (cmd_node->u.list->num != 3) {
+    } else if (!strcmp("observe_property", cmd) ||
+               !strcmp("observe_property_string", cmd)) {
+        int num = cmd_node->u.list->num;
+        if (num != 3 && num != 4) {
             rc = MPV_ERROR_INVALID_PARAMETER;
             goto error;
         }
@@ -334,30 +352,25 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
             goto error;
         }
 
-        rc = mpv_observe_property(client,
-                                  cmd_node->u.list->values[1].u.int64,
-                                  cmd_node->u.list->values[2].u.string,
-                                  MPV_FORMAT_NODE);
-    } else if (!strcmp("observe_property_string", cmd)) {
-        if (cmd_node->u.list->num != 3) {
-            rc = MPV_ERROR_INVALID_PARAMETER;
-            goto error;
-        }
-
-        if (cmd_node->u.list->values[1].format != MPV_FORMAT_INT64) {
-            rc = MPV_ERROR_INVALID_PARAMETER;
-            goto error;
-        }
-
-        if (cmd_node->u.list->values[2].format != MPV_FORMAT_STRING) {
-            rc = MPV_ERROR_INVALID_PARAMETER;
-            goto error;
+        double interval = 0;
+        if (num == 4) {
+            mpv_node *interval_node = &cmd_node->u.list->values[3];
+            if (interval_node->format == MPV_FORMAT_DOUBLE) {
+                interval = interval_node->u.double_;
+            } else if (interval_node->format == MPV_FORMAT_INT64) {
+                interval = interval_node->u.int64;
+            } else {
+                rc = MPV_ERROR_INVALID_PARAMETER;
+                goto error;
+            }
         }
 
-        rc = mpv_observe_property(client,
+        bool as_string = !strcmp("observe_property_string", cmd);
+        rc = mpv_observe_property_interval(client,
                                   cmd_node->u.list->values[1].u.int64,
                                   cmd_node->u.list->values[2].u.string,
-                                  MPV_FORMAT_STRING);
+                                  as_string ? MPV_FORMAT_STRING : MPV_FORMAT_NODE,
+                                  interval);
     } else if (!strcmp("unobserve_property", cmd)) {
         if (cmd_node->u.list->num != 2) {
             rc = MPV_ERROR_INVALID_PARAMETER;
@@ -422,7 +435,7 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
 
         rc = mpv_command_node(client, cmd_node, &result_node);
         if (rc >= 0)
-            mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
+            mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
     }
 
 error:
@@ -431,10 +444,94 @@ error:
      * the original requests.
      */
     if (reqid_node) {
-        mpv_node_map_add(ta_parent, &reply_node, "request_id", reqid_node);
+        mpv_node_map_add(ta_parent, reply_node, "request_id", reqid_node);
+    }
+
+    mpv_node_map_add_string(ta_parent, reply_node, "error", mpv_error_string(rc));
+}
+
+// Append a binary protocol frame: 4 byte big endian length, then the value.
+static bool write_frame(bstr *dst, void *ta_parent, mpv_node *node)
+{
+    bstr payload = {0};
+    if (msgpack_write(&payload, ta_parent, node) < 0 ||
+        payload.len > MP_IPC_MAX_FRAME)
+        return false;
+    uint8_t len[4] = {payload.len >> 24, payload.len >> 16, payload.len >> 8,
+                      payload.len};
+    bstr_xappend(ta_parent, dst, (bstr){len, 4});
+    bstr_xappend(ta_parent, dst, payload);
+    return true;
+}
+
+bstr mp_msgpack_encode_event(void *ta_parent, mpv_event *event)
+{
+    void *tmp = talloc_new(NULL);
+    mpv_node event_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+
+    mpv_event_to_node(tmp, event, &event_node);
+
+    bstr output = {0};
+    if (!write_frame(&output, ta_parent, &event_node)) {
+        talloc_free(output.start);
+        output = (bstr){0};
+    }
+
+    talloc_free(tmp);
+    return output;
+}
+
+int mp_ipc_consume_next_frame(struct mpv_handle *client, void *ctx, bstr *buf,
+                              bstr *out)
+{
+    *out = (bstr){0};
+
+    if (buf->len < 4)
+        return 0;
+    uint8_t *p = buf->start;
+    uint32_t len = ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    if (len > MP_IPC_MAX_FRAME)
+        return -1;
+    if (buf->len < 4 + len)
+        return 0;
+
+    void *tmp = talloc_new(NULL);
+
+    bstr data = bstr_splice(*buf, 4, 4 + len);
+    mpv_node msg_node;
+    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+    if (msgpack_parse(tmp, &msg_node, &data, 50) < 0 || data.len) {
+        mp_err(mp_client_get_log(client), "malformed binary request\n");
+        msg_node = (mpv_node){.format = MPV_FORMAT_NONE};
+    }
+
+    execute_command(client, tmp, &msg_node, &reply_node);
+
+    bool ok = write_frame(out, ctx, &reply_node);
+
+    // Remove the frame from the buffer.
+    talloc_steal(tmp, buf->start);
+    *buf = bstrdup(NULL, bstr_cut(*buf, 4 + len));
+
+    talloc_free(tmp);
+    return ok ? 1 : -1;
+}
+
+// Function is allowed to modify src[n].
+static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
+                                  char *src)
+{
+    struct mp_log *log = mp_client_get_log(client);
+
+    mpv_node msg_node;
+    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+
+    if (json_parse(ta_parent, &msg_node, &src, 50) < 0) {
+        mp_err(log, "malformed JSON received: '%s'\n", src);
+        msg_node = (mpv_node){.format = MPV_FORMAT_NONE};
     }
 
-    mpv_node_map_add_string(ta_parent, &reply_node, "error", mpv_error_string(rc));
+    execute_command(client, ta_parent, &msg_node, &reply_node);
 
     char *output = talloc_strdup(ta_parent, "");
     json_write(&output, &reply_node);
@@ -205,7 +205,7 @@ extern "C" {
  * relational operators (<, >, <=, >=).
  */
 #define MPV_MAKE_VERSION(major, minor) (((major) << 16) | (minor) | 0UL)
-#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(1, 26)
+#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(1, 30)
 
 /**
  * The API user is allowed to "#define MPV_ENABLE_DEPRECATED 0" before
@@ -882,6 +882,33 @@ int mpv_command(mpv_handle *ctx, const char **args);
  */
 int mpv_command_node(mpv_handle *ctx, mpv_node *args, mpv_node *result);
 
+/**
+ * Run a list of commands as a single operation. All commands are parsed
+ * first, and then executed in order while the core is locked, without the
+ * playback loop running in between. This means that e.g. setting several
+ * properties with a batch has their effects applied together (video or
+ * audio output reconfiguration triggered by them happens only once), and no
+ * other client or input source can interleave its own commands.
+ *
+ * Note that this is not a transaction: if a command fails, the following
+ * commands are still run, and the effects of the preceding ones are not
+ * reverted.
+ *
+ * @param[in] cmds mpv_node with format set to MPV_FORMAT_NODE_ARRAY; each
+ *                 entry is a command as accepted by mpv_command_node()
+ * @param[out] result Optional, pass NULL if unused. If not NULL, and if the
+ *                    commands could be parsed, this is set to a
+ *                    MPV_FORMAT_NODE_ARRAY with an entry for each command.
+ *                    Each entry is a MPV_FORMAT_NODE_MAP with the error code
+ *                    of the command in "error" (MPV_FORMAT_INT64), and its
+ *                    return data, if any, in "data". You must call
+ *                    mpv_free_node_contents() to free it.
+ * @return MPV_ERROR_INVALID_PARAMETER if any command could not be parsed (in
+ *         this case nothing is run, and result is not set), otherwise the
+ *         error code of the first failed command, or 0
+ */
+int mpv_command_batch(mpv_handle *ctx, mpv_node *cmds, mpv_node *result);
+
 /**
  * Same as mpv_command, but use input.conf parsing for splitting arguments.
  * This is slightly simpler, but also more error prone, since arguments may
@@ -992,6 +1019,14 @@ int mpv_set_property_async(mpv_handle *ctx, uint64_t reply_userdata,
  * is always converted to MPV_FORMAT_DOUBLE, and access using MPV_FORMAT_STRING
  * usually invokes a string formatter.
  *
+ * Some frequently polled properties ("time-pos", "playback-time",
+ * "percent-pos", "time-remaining", "playtime-remaining", "duration",
+ * "demuxer-cache-duration", "demuxer-cache-time") are read from a snapshot
+ * the player updates on every playloop iteration, if they are accessed with
+ * MPV_FORMAT_DOUBLE, MPV_FORMAT_INT64 or MPV_FORMAT_NODE. This doesn't wait
+ * for the player core, but the value may be slightly older than the value
+ * the core would return.
+ *
  * @param name The property name.
  * @param format see enum mpv_format.
  * @param[out] data Pointer to the variable holding the option value. On
@@ -1091,6 +1126,24 @@ int mpv_get_property_async(mpv_handle *ctx, uint64_t reply_userdata,
 int mpv_observe_property(mpv_handle *mpv, uint64_t reply_userdata,
                          const char *name, mpv_format format);
 
+/**
+ * Like mpv_observe_property(), but deliver change events at most every
+ * min_interval seconds. If the property changes more often, the changes are
+ * delayed until the interval has passed, and then the current value is sent.
+ * (So the last change is never lost.) Since the new value is not retrieved
+ * until then, this also saves work in the player core, unlike filtering the
+ * events on the client side.
+ *
+ * This is meant for properties which change very often, like "time-pos".
+ *
+ * @param min_interval minimum time between two change events in seconds; 0
+ *                     is the same as mpv_observe_property()
+ * @return error code
+ */
+int mpv_observe_property_interval(mpv_handle *mpv, uint64_t reply_userdata,
+                                  const char *name, mpv_format format,
+                                  double min_interval);
+
 /**
  * Undo mpv_observe_property(). This will remove all observed properties for
  * which the given number was passed as reply_userdata to mpv_observe_property.
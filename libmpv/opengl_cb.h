@@ -350,12 +350,64 @@ int mpv_opengl_cb_render(mpv_opengl_cb_context *ctx, int fbo, int vp[4]);
  * If this is called while no video or no OpenGL is initialized, it is ignored.
  *
  * @param time The mpv time (using mpv_get_time_us()) at which the flip call
- *             returned. If 0 is passed, mpv_get_time_us() is used instead.
- *             Currently, this parameter is ignored.
+ *             returned, or better, at which the frame will be visible on the
+ *             display. If 0 is passed, mpv_get_time_us() is used instead.
+ *             With --video-sync=display-*, this is used as presentation
+ *             feedback to keep the frame timing locked to the display.
  * @return error code
  */
 int mpv_opengl_cb_report_flip(mpv_opengl_cb_context *ctx, int64_t time);
 
+/**
+ * Flags for mpv_opengl_cb_frame_info.flags.
+ */
+typedef enum mpv_opengl_cb_frame_info_flag {
+    /**
+     * A new video frame is waiting to be rendered. mpv_opengl_cb_draw() will
+     * render it (and block until mpv lets it proceed to the next frame).
+     */
+    MPV_OPENGL_CB_FRAME_NEW = 1 << 0,
+    /**
+     * The current frame needs to be redrawn (e.g. after an OSD change or
+     * seeking while paused). If neither this nor MPV_OPENGL_CB_FRAME_NEW is
+     * set, calling mpv_opengl_cb_draw() would render the same image as the
+     * last call, and can be skipped.
+     */
+    MPV_OPENGL_CB_FRAME_REDRAW = 1 << 1,
+} mpv_opengl_cb_frame_info_flag;
+
+typedef struct mpv_opengl_cb_frame_info {
+    /**
+     * A combination of mpv_opengl_cb_frame_info_flag values.
+     */
+    uint64_t flags;
+    /**
+     * The mpv time (as in mpv_get_time_us()) at which the pending frame is
+     * supposed to be displayed, or 0 if it should be displayed immediately or
+     * if no frame is pending. The API user can use this to schedule rendering
+     * and presentation of the frame.
+     */
+    int64_t target_time;
+    /**
+     * Approximate duration of the pending frame in microseconds, or -1 if
+     * unknown.
+     */
+    int64_t duration;
+} mpv_opengl_cb_frame_info;
+
+/**
+ * Return information about the frame mpv_opengl_cb_draw() would render if it
+ * were called now. This is typically called after the update callback was
+ * invoked, to avoid unnecessary redraws and to know when the frame is due.
+ * Unlike mpv_opengl_cb_draw(), this can be called from any thread, and never
+ * blocks on the player.
+ *
+ * @param info Set to the current state. All fields are always written.
+ * @return error code
+ */
+int mpv_opengl_cb_get_frame_info(mpv_opengl_cb_context *ctx,
+                                 mpv_opengl_cb_frame_info *info);
+
 /**
  * Destroy the mpv OpenGL state.
  *
@@ -147,6 +147,57 @@ typedef int64_t (*mpv_stream_cb_size_fn)(void *cookie);
  */
 typedef void (*mpv_stream_cb_close_fn)(void *cookie);
 
+/**
+ * Minimum number of readable bytes that must follow the data returned by
+ * mpv_stream_cb_read_ref_fn. (Decoders may read slightly past the end of the
+ * data for performance reasons.) The padding should be zeroed.
+ */
+#define MPV_STREAM_CB_PADDING 64
+
+/**
+ * Optional callback for letting mpv reference stream data in memory owned by
+ * the client, instead of copying it with mpv_stream_cb_read_fn. This is useful
+ * if the data is already in memory (e.g. because the client decrypted it), and
+ * avoids the copies into mpv's buffers. Demuxers which support it (currently
+ * the Matroska and raw demuxers) then create packets which point directly to
+ * the client memory.
+ *
+ * mpv calls this with the absolute position and size of the data it wants to
+ * read. The client returns a pointer to exactly this data, and an opaque
+ * pointer identifying the buffer, which is passed to release_fn once mpv doesn't
+ * need the data anymore. The memory must remain valid and unchanged until then.
+ * The stream position is not changed by this callback; mpv will use seek_fn
+ * to skip the data afterwards, so seek_fn must be cheap.
+ *
+ * The data must be followed by MPV_STREAM_CB_PADDING readable bytes.
+ *
+ * This callback is used only for seekable streams, and only if the stream
+ * cache is disabled (the cache copies all data into its own buffer).
+ *
+ * @param cookie opaque cookie identifying the stream,
+ *               returned from mpv_stream_cb_open_fn
+ * @param pos absolute stream position of the first byte requested
+ * @param nbytes number of bytes requested
+ * @param out_data set this to the start of the data
+ * @param out_buf set this to a value that identifies the buffer for release_fn
+ * @return 0 on success. If the data can't be provided this way (e.g. because
+ *         the range is not in memory, or is beyond EOF), return a negative
+ *         value; mpv will then read the data with read_fn.
+ */
+typedef int (*mpv_stream_cb_read_ref_fn)(void *cookie, int64_t pos,
+                                         uint64_t nbytes, const char **out_data,
+                                         void **out_buf);
+
+/**
+ * Release a buffer returned by mpv_stream_cb_read_ref_fn.
+ *
+ * Demuxed packets can outlive the stream, so this can be called after the
+ * close_fn callback was called. It can be called from any thread.
+ *
+ * @param buf the out_buf value returned by mpv_stream_cb_read_ref_fn
+ */
+typedef void (*mpv_stream_cb_release_fn)(void *buf);
+
 /**
  * See mpv_stream_cb_open_ro_fn callback.
  */
@@ -170,6 +221,13 @@ typedef struct mpv_stream_cb_info {
     mpv_stream_cb_seek_fn seek_fn;
     mpv_stream_cb_size_fn size_fn;
     mpv_stream_cb_close_fn close_fn;
+
+    /**
+     * Optional zero-copy reading (since API version 1.27). Both must be set to
+     * enable it.
+     */
+    mpv_stream_cb_read_ref_fn read_ref_fn;
+    mpv_stream_cb_release_fn release_fn;
 } mpv_stream_cb_info;
 
 /**
@@ -66,10 +66,9 @@ int bstrcasecmp(struct bstr str1, struct bstr str2)
 
 int bstrchr(struct bstr str, int c)
 {
-    for (int i = 0; i < str.len; i++)
-        if (str.start[i] == c)
-            return i;
-    return -1;
+    // libc's memchr() is vectorized on all relevant platforms.
+    unsigned char *pos = str.len ? memchr(str.start, c, str.len) : NULL;
+    return pos ? pos - str.start : -1;
 }
 
 int bstrrchr(struct bstr str, int c)
@@ -80,29 +79,64 @@ int bstrrchr(struct bstr str, int c)
     return -1;
 }
 
+// Set the bits for all bytes in chars in the 256 bit table. Like strchr(), the
+// terminating 0 is considered part of the set.
+static void make_byte_set(uint32_t set[8], const char *chars)
+{
+    memset(set, 0, sizeof(uint32_t) * 8);
+    set[0] = 1;
+    for (const unsigned char *c = (const unsigned char *)chars; *c; c++)
+        set[*c >> 5] |= 1u << (*c & 31);
+}
+
+#define IN_BYTE_SET(set, c) ((set)[(c) >> 5] & (1u << ((c) & 31)))
+
 int bstrcspn(struct bstr str, const char *reject)
 {
+    if (reject[0] && !reject[1]) {
+        // Single char (plus the implicit 0, which is rare in practice).
+        int pos = bstrchr(str, reject[0]);
+        str.len = pos < 0 ? str.len : pos;
+        pos = bstrchr(str, 0);
+        return pos < 0 ? str.len : pos;
+    }
+    uint32_t set[8];
+    make_byte_set(set, reject);
     int i;
     for (i = 0; i < str.len; i++)
-        if (strchr(reject, str.start[i]))
+        if (IN_BYTE_SET(set, str.start[i]))
             break;
     return i;
 }
 
 int bstrspn(struct bstr str, const char *accept)
 {
+    uint32_t set[8];
+    make_byte_set(set, accept);
     int i;
     for (i = 0; i < str.len; i++)
-        if (!strchr(accept, str.start[i]))
+        if (!IN_BYTE_SET(set, str.start[i]))
             break;
     return i;
 }
 
 int bstr_find(struct bstr haystack, struct bstr needle)
 {
-    for (int i = 0; i < haystack.len; i++)
-        if (bstr_startswith(bstr_splice(haystack, i, haystack.len), needle))
-            return i;
+    if (!haystack.len || needle.len > haystack.len)
+        return -1;
+    if (!needle.len)
+        return 0;
+    // Search the first byte with memchr(), and compare the rest.
+    unsigned char *cur = haystack.start;
+    unsigned char *end = haystack.start + haystack.len - needle.len + 1;
+    while (cur < end) {
+        cur = memchr(cur, needle.start[0], end - cur);
+        if (!cur)
+            break;
+        if (!memcmp(cur + 1, needle.start + 1, needle.len - 1))
+            return cur - haystack.start;
+        cur++;
+    }
     return -1;
 }
 
@@ -125,11 +159,7 @@ struct bstr bstr_strip(struct bstr str)
 
 struct bstr bstr_split(struct bstr str, const char *sep, struct bstr *rest)
 {
-    int start;
-    for (start = 0; start < str.len; start++)
-        if (!strchr(sep, str.start[start]))
-            break;
-    str = bstr_cut(str, start);
+    str = bstr_cut(str, bstrspn(str, sep));
     int end = bstrcspn(str, sep);
     if (rest) {
         *rest = bstr_cut(str, end);
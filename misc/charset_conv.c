@@ -63,15 +63,43 @@ static const char *ms_bom_guess(bstr buf)
     return NULL;
 }
 
+// Cut buf to whole lines. If at_start is false, the data before the first
+// line break is removed, and if at_end is false, the data after the last one.
+// This is meant to take samples from a larger buffer without cutting through
+// multibyte characters (this doesn't work for UTF-16).
+bstr mp_charset_sample_lines(bstr buf, bool at_start, bool at_end)
+{
+    if (!at_start) {
+        int pos = bstrchr(buf, '\n');
+        buf = pos < 0 ? (bstr){0} : bstr_cut(buf, pos + 1);
+    }
+    if (!at_end) {
+        int pos = bstrrchr(buf, '\n');
+        buf = pos < 0 ? (bstr){0} : bstr_splice(buf, 0, pos + 1);
+    }
+    return buf;
+}
+
 #if HAVE_UCHARDET
 static const char *mp_uchardet(void *talloc_ctx, struct mp_log *log, bstr buf)
 {
     uchardet_t det = uchardet_new();
     if (!det)
         return NULL;
-    if (uchardet_handle_data(det, buf.start, buf.len) != 0) {
-        uchardet_delete(det);
-        return NULL;
+    // On large inputs, look only at the start, middle, and end. This is much
+    // faster, and representative enough for text files.
+    int num_samples = buf.len > 3 * MP_CHARSET_SAMPLE_SIZE ? 3 : 1;
+    for (int n = 0; n < num_samples; n++) {
+        bstr sample = buf;
+        if (num_samples > 1) {
+            int pos = n * (buf.len - MP_CHARSET_SAMPLE_SIZE) / 2;
+            sample = bstr_splice(buf, pos, pos + MP_CHARSET_SAMPLE_SIZE);
+            sample = mp_charset_sample_lines(sample, n == 0, n == 2);
+        }
+        if (uchardet_handle_data(det, sample.start, sample.len) != 0) {
+            uchardet_delete(det);
+            return NULL;
+        }
     }
     uchardet_data_end(det);
     char *res = talloc_strdup(talloc_ctx, uchardet_get_charset(det));
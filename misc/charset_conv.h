@@ -13,10 +13,14 @@ enum {
     MP_NO_LATIN1_FALLBACK = 8,  // fall back to input buffer instead of latin1
 };
 
+// Size of each of the samples charset detection uses on large inputs.
+#define MP_CHARSET_SAMPLE_SIZE (64 * 1024)
+
 bool mp_charset_is_utf8(const char *user_cp);
 bool mp_charset_is_utf16(const char *user_cp);
 const char *mp_charset_guess(void *talloc_ctx, struct mp_log *log, bstr buf,
                              const char *user_cp, int flags);
+bstr mp_charset_sample_lines(bstr buf, bool at_start, bool at_end);
 bstr mp_iconv_to_utf8(struct mp_log *log, bstr buf, const char *cp, int flags);
 
 #endif
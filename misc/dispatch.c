@@ -19,6 +19,7 @@
 #include <assert.h>
 
 #include "common/common.h"
+#include "osdep/atomic.h"
 #include "osdep/threads.h"
 #include "osdep/timer.h"
 
@@ -26,6 +27,14 @@
 
 struct mp_dispatch_queue {
     struct mp_dispatch_item *head, *tail;
+#if HAVE_STDATOMIC
+    // Asynchronous items pushed without taking the lock, newest first. They
+    // are moved to head/tail under the lock (see drain_incoming()).
+    _Atomic(struct mp_dispatch_item *) incoming;
+#endif
+    // Set while the target thread waits on cond in mp_dispatch_queue_process()
+    // (written under lock). Lock-free senders need the lock only then.
+    atomic_bool sleeping;
     pthread_mutex_t lock;
     pthread_cond_t cond;
     void (*wakeup_fn)(void *wakeup_ctx);
@@ -68,6 +77,9 @@ static void queue_dtor(void *p)
 {
     struct mp_dispatch_queue *queue = p;
     assert(!queue->head);
+#if HAVE_STDATOMIC
+    assert(!atomic_load(&queue->incoming));
+#endif
     assert(!queue->idling);
     assert(!queue->lock_request);
     assert(!queue->frame);
@@ -110,10 +122,42 @@ void mp_dispatch_set_wakeup_fn(struct mp_dispatch_queue *queue,
     queue->wakeup_ctx = wakeup_ctx;
 }
 
+// Move items pushed by mp_dispatch_push() to the locked list, keeping their
+// order. Called with lock held.
+static void drain_incoming(struct mp_dispatch_queue *queue)
+{
+#if HAVE_STDATOMIC
+    if (!atomic_load_explicit(&queue->incoming, memory_order_relaxed))
+        return;
+    struct mp_dispatch_item *list = atomic_exchange(&queue->incoming, NULL);
+    // The list is LIFO; reverse it.
+    struct mp_dispatch_item *fifo = NULL, *last = list;
+    while (list) {
+        struct mp_dispatch_item *next = list->next;
+        list->next = fifo;
+        fifo = list;
+        list = next;
+    }
+    if (!fifo)
+        return;
+    if (queue->tail) {
+        queue->tail->next = fifo;
+    } else {
+        queue->head = fifo;
+    }
+    queue->tail = last;
+    // Same as in mp_dispatch_append().
+    if (!queue->wakeup_fn)
+        queue->interrupted = true;
+#endif
+}
+
 static void mp_dispatch_append(struct mp_dispatch_queue *queue,
                                struct mp_dispatch_item *item)
 {
     pthread_mutex_lock(&queue->lock);
+    // Keep the order relative to items pushed without lock.
+    drain_incoming(queue);
     if (item->mergeable) {
         for (struct mp_dispatch_item *cur = queue->head; cur; cur = cur->next) {
             if (cur->mergeable && cur->fn == item->fn &&
@@ -146,6 +190,35 @@ static void mp_dispatch_append(struct mp_dispatch_queue *queue,
         queue->wakeup_fn(queue->wakeup_ctx);
 }
 
+// Append an asynchronous item without taking the lock in the common case. The
+// lock is taken only to wake up the target thread if it's blocked on cond.
+static void mp_dispatch_push(struct mp_dispatch_queue *queue,
+                             struct mp_dispatch_item *item)
+{
+#if HAVE_STDATOMIC
+    assert(item->asynchronous && !item->mergeable);
+    struct mp_dispatch_item *head = atomic_load(&queue->incoming);
+    do {
+        item->next = head;
+    } while (!atomic_compare_exchange_weak(&queue->incoming, &head, item));
+
+    // Pairs with the sleeping store and incoming check before waiting in
+    // mp_dispatch_queue_process(): either it sees the new item, or we see
+    // that it's sleeping. Other waiters on cond (mp_dispatch_run(),
+    // mp_dispatch_lock()) don't care about asynchronous items.
+    if (atomic_load(&queue->sleeping)) {
+        pthread_mutex_lock(&queue->lock);
+        pthread_cond_broadcast(&queue->cond);
+        pthread_mutex_unlock(&queue->lock);
+    }
+
+    if (queue->wakeup_fn)
+        queue->wakeup_fn(queue->wakeup_ctx);
+#else
+    mp_dispatch_append(queue, item);
+#endif
+}
+
 // Enqueue a callback to run it on the target thread asynchronously. The target
 // thread will run fn(fn_data) as soon as it enter mp_dispatch_queue_process.
 // Note that mp_dispatch_enqueue() will usually return long before that happens.
@@ -161,7 +234,7 @@ void mp_dispatch_enqueue(struct mp_dispatch_queue *queue,
         .fn_data = fn_data,
         .asynchronous = true,
     };
-    mp_dispatch_append(queue, item);
+    mp_dispatch_push(queue, item);
 }
 
 // Like mp_dispatch_enqueue(), but the queue code will call talloc_free(fn_data)
@@ -177,7 +250,7 @@ void mp_dispatch_enqueue_autofree(struct mp_dispatch_queue *queue,
         .fn_data = talloc_steal(item, fn_data),
         .asynchronous = true,
     };
-    mp_dispatch_append(queue, item);
+    mp_dispatch_push(queue, item);
 }
 
 // Like mp_dispatch_enqueue(), but
@@ -206,6 +279,7 @@ void mp_dispatch_cancel_fn(struct mp_dispatch_queue *queue,
                            mp_dispatch_fn fn, void *fn_data)
 {
     pthread_mutex_lock(&queue->lock);
+    drain_incoming(queue);
     struct mp_dispatch_item **pcur = &queue->head;
     queue->tail = NULL;
     while (*pcur) {
@@ -252,8 +326,10 @@ void mp_dispatch_run(struct mp_dispatch_queue *queue,
 //      - all queue items were processed,
 //      - the possibly acquired lock has been released
 // It's possible to cancel the timeout by calling mp_dispatch_interrupt().
-void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
+// Returns a bitset of MP_DISPATCH_* flags describing what happened.
+int mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
 {
+    int res = 0;
     int64_t wait = timeout > 0 ? mp_add_timeout(mp_time_us(), timeout) : 0;
     struct lock_frame frame = {
         .thread = pthread_self(),
@@ -271,6 +347,7 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
     if (queue->lock_request)
         pthread_cond_broadcast(&queue->cond);
     while (1) {
+        drain_incoming(queue);
         if (queue->lock_request || queue->frame != &frame || frame.locked) {
             // Block due to something having called mp_dispatch_lock(). This
             // is either a lock "acquire" (lock_request=true), or a lock in
@@ -278,6 +355,7 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
             // mp_dispatch_lock() is now calling mp_dispatch_queue_process()
             // (the latter means we must ignore any queue state changes,
             // until it has been unlocked again).
+            res |= MP_DISPATCH_LOCKED;
             pthread_cond_wait(&queue->cond, &queue->lock);
             if (queue->frame == &frame && !frame.locked)
                 assert(queue->idling);
@@ -294,6 +372,7 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
             queue->idling = false;
             pthread_mutex_unlock(&queue->lock);
 
+            res |= MP_DISPATCH_ITEMS;
             item->fn(item->fn_data);
 
             pthread_mutex_lock(&queue->lock);
@@ -307,10 +386,22 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
                 item->completed = true;
             }
         } else if (wait > 0 && !queue->interrupted) {
+            atomic_store(&queue->sleeping, true);
+#if HAVE_STDATOMIC
+            if (atomic_load(&queue->incoming)) {
+                atomic_store(&queue->sleeping, false);
+                continue;
+            }
+#endif
             struct timespec ts = mp_time_us_to_timespec(wait);
-            if (pthread_cond_timedwait(&queue->cond, &queue->lock, &ts))
+            if (pthread_cond_timedwait(&queue->cond, &queue->lock, &ts)) {
+                res |= MP_DISPATCH_TIMEOUT;
                 wait = 0;
+            }
+            atomic_store(&queue->sleeping, false);
         } else {
+            if (queue->interrupted)
+                res |= MP_DISPATCH_INTERRUPTED;
             break;
         }
     }
@@ -320,6 +411,7 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
     queue->frame = frame.prev;
     queue->interrupted = false;
     pthread_mutex_unlock(&queue->lock);
+    return res;
 }
 
 // If the queue is inside of mp_dispatch_queue_process(), make it return as
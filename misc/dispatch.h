@@ -18,7 +18,15 @@ void mp_dispatch_cancel_fn(struct mp_dispatch_queue *queue,
                            mp_dispatch_fn fn, void *fn_data);
 void mp_dispatch_run(struct mp_dispatch_queue *queue,
                      mp_dispatch_fn fn, void *fn_data);
-void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout);
+// Flags returned by mp_dispatch_queue_process().
+enum {
+    MP_DISPATCH_ITEMS       = 1 << 0, // dispatch items were run
+    MP_DISPATCH_LOCKED      = 1 << 1, // mp_dispatch_lock() was used
+    MP_DISPATCH_TIMEOUT     = 1 << 2, // the timeout was reached
+    MP_DISPATCH_INTERRUPTED = 1 << 3, // returned due to mp_dispatch_interrupt()
+};
+
+int mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout);
 void mp_dispatch_interrupt(struct mp_dispatch_queue *queue);
 void mp_dispatch_lock(struct mp_dispatch_queue *queue);
 void mp_dispatch_unlock(struct mp_dispatch_queue *queue);
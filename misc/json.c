@@ -24,6 +24,10 @@
  *
  * Does not support extensions like unquoted string literals.
  *
+ * Strings without escapes point directly into the (mutated) input string. All
+ * node lists are bump-allocated from a few large blocks, so the result must be
+ * treated as read-only (don't extend it with the misc/node.c functions).
+ *
  * Also see: http://tools.ietf.org/html/rfc4627
  *
  * JSON writer:
@@ -36,7 +40,8 @@
  * invalid UTF-8 sequences to replacement characters.
  *
  * Currently, will insert \u literals for characters 0-31, '"', '\', and write
- * everything else literally.
+ * everything else literally. The scan for these characters checks a machine
+ * word at a time, since most strings need no escaping at all.
  */
 
 #include <stdlib.h>
@@ -75,6 +80,41 @@ void json_skip_whitespace(char **src)
     eat_ws(src);
 }
 
+struct parse_ctx {
+    void *ta_parent;
+    // Current arena block (allocated under ta_parent).
+    char *pool;
+    size_t pool_left;
+    size_t pool_block;
+    // Scratch stack for the members of the lists currently being parsed.
+    struct mpv_node *values;
+    char **keys;
+    int num_values, num_keys;
+};
+
+#define POOL_ALIGN 16
+#define POOL_MIN_BLOCK 4096
+#define POOL_MAX_BLOCK (256 * 1024)
+
+static void *pool_alloc(struct parse_ctx *ctx, size_t size)
+{
+    size = MP_ALIGN_UP(size, POOL_ALIGN);
+    if (size > ctx->pool_left) {
+        ctx->pool_block = MPCLAMP(ctx->pool_block * 2, POOL_MIN_BLOCK,
+                                  POOL_MAX_BLOCK);
+        size_t block = MPMAX(size, ctx->pool_block);
+        ctx->pool = talloc_size(ctx->ta_parent, block);
+        ctx->pool_left = block;
+    }
+    void *res = ctx->pool;
+    ctx->pool += size;
+    ctx->pool_left -= size;
+    return res;
+}
+
+static int parse_value(struct parse_ctx *ctx, struct mpv_node *dst, char **src,
+                       int max_depth);
+
 static int read_str(void *ta_parent, struct mpv_node *dst, char **src)
 {
     if (!eat_c(src, '"'))
@@ -109,7 +149,7 @@ static int read_str(void *ta_parent, struct mpv_node *dst, char **src)
     return 0;
 }
 
-static int read_sub(void *ta_parent, struct mpv_node *dst, char **src,
+static int read_sub(struct parse_ctx *ctx, struct mpv_node *dst, char **src,
                     int max_depth)
 {
     bool is_arr = eat_c(src, '[');
@@ -117,30 +157,46 @@ static int read_sub(void *ta_parent, struct mpv_node *dst, char **src,
     if (!is_arr && !is_obj)
         return -1; // not an array or object
     char term = is_obj ? '}' : ']';
-    struct mpv_node_list *list = talloc_zero(ta_parent, struct mpv_node_list);
+    // Members are collected on the scratch stack, and copied to the arena in
+    // one go when the list is complete; nested lists push above them.
+    int base_values = ctx->num_values, base_keys = ctx->num_keys;
+    int num = 0;
     while (1) {
         eat_ws(src);
         if (eat_c(src, term))
             break;
-        if (list->num > 0 && !eat_c(src, ','))
+        if (num > 0 && !eat_c(src, ','))
             return -1; // missing ','
         eat_ws(src);
         if (is_obj) {
             struct mpv_node keynode;
-            if (read_str(list, &keynode, src) < 0)
+            if (read_str(ctx->ta_parent, &keynode, src) < 0)
                 return -1; // key is not a string
             eat_ws(src);
             if (!eat_c(src, ':'))
                 return -1; // ':' missing
             eat_ws(src);
-            MP_TARRAY_GROW(list, list->keys, list->num);
-            list->keys[list->num] = keynode.u.string;
+            MP_TARRAY_APPEND(NULL, ctx->keys, ctx->num_keys, keynode.u.string);
         }
-        MP_TARRAY_GROW(list, list->values, list->num);
-        if (json_parse(ta_parent, &list->values[list->num], src, max_depth) < 0)
+        struct mpv_node value;
+        if (parse_value(ctx, &value, src, max_depth) < 0)
             return -1;
-        list->num++;
+        MP_TARRAY_APPEND(NULL, ctx->values, ctx->num_values, value);
+        num++;
+    }
+    struct mpv_node_list *list = pool_alloc(ctx, sizeof(*list));
+    *list = (struct mpv_node_list){ .num = num };
+    if (num) {
+        list->values = pool_alloc(ctx, num * sizeof(list->values[0]));
+        memcpy(list->values, ctx->values + base_values,
+               num * sizeof(list->values[0]));
+    }
+    if (num && is_obj) {
+        list->keys = pool_alloc(ctx, num * sizeof(list->keys[0]));
+        memcpy(list->keys, ctx->keys + base_keys, num * sizeof(list->keys[0]));
     }
+    ctx->num_values = base_values;
+    ctx->num_keys = base_keys;
     dst->format = is_obj ? MPV_FORMAT_NODE_MAP : MPV_FORMAT_NODE_ARRAY;
     dst->u.list = list;
     return 0;
@@ -158,6 +214,16 @@ static int read_sub(void *ta_parent, struct mpv_node *dst, char **src,
  * elements, which point into the (mutated) input string.
  */
 int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
+{
+    struct parse_ctx ctx = { .ta_parent = ta_parent };
+    int r = parse_value(&ctx, dst, src, max_depth);
+    talloc_free(ctx.values);
+    talloc_free(ctx.keys);
+    return r;
+}
+
+static int parse_value(struct parse_ctx *ctx, struct mpv_node *dst, char **src,
+                       int max_depth)
 {
     max_depth -= 1;
     if (max_depth < 0)
@@ -183,9 +249,9 @@ int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
         dst->u.flag = 0;
         return 0;
     } else if (c == '"') {
-        return read_str(ta_parent, dst, src);
+        return read_str(ctx->ta_parent, dst, src);
     } else if (c == '[' || c == '{') {
-        return read_sub(ta_parent, dst, src, max_depth);
+        return read_sub(ctx, dst, src, max_depth);
     } else if (c == '-' || (c >= '0' && c <= '9')) {
         // The number could be either a float or an int. JSON doesn't make a
         // difference, but the client API does.
@@ -218,20 +284,48 @@ int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
 
 #define APPEND(b, s) bstr_xappend(NULL, (b), bstr0(s))
 
+#define WORD_ONES (~(uintptr_t)0 / 255)
+#define WORD_HIGHS (WORD_ONES * 0x80)
+
+// Whether any byte in w is < 32 (including 0), '"' or '\'.
+static inline bool word_needs_escape(uintptr_t w)
+{
+    uintptr_t quote = w ^ (WORD_ONES * '"');
+    uintptr_t bslash = w ^ (WORD_ONES * '\\');
+    uintptr_t t = (w - WORD_ONES * 32) |
+                  (quote - WORD_ONES) | (bslash - WORD_ONES);
+    return t & ~w & WORD_HIGHS;
+}
+
+// Return the first character that must be escaped, or end.
+static unsigned char *find_escape(unsigned char *cur, unsigned char *end)
+{
+    while (end - cur >= sizeof(uintptr_t)) {
+        uintptr_t w;
+        memcpy(&w, cur, sizeof(w));
+        if (word_needs_escape(w))
+            break;
+        cur += sizeof(w);
+    }
+    while (cur < end && cur[0] >= 32 && cur[0] != '"' && cur[0] != '\\')
+        cur++;
+    return cur;
+}
+
 static void write_json_str(bstr *b, unsigned char *str)
 {
+    static const char hex[] = "0123456789abcdef";
+    unsigned char *end = str + strlen((char *)str);
     APPEND(b, "\"");
     while (1) {
-        unsigned char *cur = str;
-        while (cur[0] >= 32 && cur[0] != '"' && cur[0] != '\\')
-            cur++;
-        if (!cur[0])
-            break;
+        unsigned char *cur = find_escape(str, end);
         bstr_xappend(NULL, b, (bstr){str, cur - str});
-        bstr_xappend_asprintf(NULL, b, "\\u%04x", (unsigned char)cur[0]);
+        if (cur == end)
+            break;
+        char esc[6] = {'\\', 'u', '0', '0', hex[cur[0] >> 4], hex[cur[0] & 15]};
+        bstr_xappend(NULL, b, (bstr){esc, 6});
         str = cur + 1;
     }
-    APPEND(b, str);
     APPEND(b, "\"");
 }
 
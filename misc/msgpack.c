@@ -0,0 +1,313 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* MessagePack parser and writer for mpv_node.
+ *
+ * The writer always uses the smallest encoding for integers, strings and
+ * containers. Strings are written as str, byte arrays as bin.
+ *
+ * The parser accepts all types except ext and timestamps. Map keys must be
+ * strings. Unsigned integers that don't fit into int64_t are rejected, bin is
+ * returned as MPV_FORMAT_BYTE_ARRAY, and float32 is converted to double.
+ *
+ * Also see: https://github.com/msgpack/msgpack/blob/master/spec.md
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "common/common.h"
+#include "misc/bstr.h"
+#include "mpv_talloc.h"
+
+#include "msgpack.h"
+
+static void write_be(bstr *s, void *ta_parent, int bytes, uint64_t v)
+{
+    uint8_t buf[8];
+    for (int n = 0; n < bytes; n++)
+        buf[n] = v >> ((bytes - n - 1) * 8);
+    bstr_xappend(ta_parent, s, (bstr){buf, bytes});
+}
+
+static void write_byte(bstr *s, void *ta_parent, uint8_t v)
+{
+    bstr_xappend(ta_parent, s, (bstr){&v, 1});
+}
+
+// Write a length prefixed type: fix is the fixed-size variant (or -1), and
+// t8/t16/t32 the tags for 8, 16 and 32 bit lengths (t8 can be 0).
+static void write_len(bstr *s, void *ta_parent, size_t len, int fix, int fix_max,
+                      uint8_t t8, uint8_t t16, uint8_t t32)
+{
+    if (fix >= 0 && len <= fix_max) {
+        write_byte(s, ta_parent, fix | len);
+    } else if (t8 && len <= UINT8_MAX) {
+        write_byte(s, ta_parent, t8);
+        write_be(s, ta_parent, 1, len);
+    } else if (len <= UINT16_MAX) {
+        write_byte(s, ta_parent, t16);
+        write_be(s, ta_parent, 2, len);
+    } else {
+        write_byte(s, ta_parent, t32);
+        write_be(s, ta_parent, 4, len);
+    }
+}
+
+static void write_str(bstr *s, void *ta_parent, bstr str)
+{
+    write_len(s, ta_parent, str.len, 0xa0, 31, 0xd9, 0xda, 0xdb);
+    bstr_xappend(ta_parent, s, str);
+}
+
+static int write_rec(bstr *s, void *ta_parent, struct mpv_node *src)
+{
+    switch (src->format) {
+    case MPV_FORMAT_NONE:
+        write_byte(s, ta_parent, 0xc0);
+        return 0;
+    case MPV_FORMAT_FLAG:
+        write_byte(s, ta_parent, src->u.flag ? 0xc3 : 0xc2);
+        return 0;
+    case MPV_FORMAT_INT64: {
+        int64_t v = src->u.int64;
+        if (v >= -32 && v <= 127) {
+            write_byte(s, ta_parent, (uint8_t)v);
+        } else if (v >= INT8_MIN && v <= INT8_MAX) {
+            write_byte(s, ta_parent, 0xd0);
+            write_be(s, ta_parent, 1, v);
+        } else if (v >= INT16_MIN && v <= INT16_MAX) {
+            write_byte(s, ta_parent, 0xd1);
+            write_be(s, ta_parent, 2, v);
+        } else if (v >= INT32_MIN && v <= INT32_MAX) {
+            write_byte(s, ta_parent, 0xd2);
+            write_be(s, ta_parent, 4, v);
+        } else {
+            write_byte(s, ta_parent, 0xd3);
+            write_be(s, ta_parent, 8, v);
+        }
+        return 0;
+    }
+    case MPV_FORMAT_DOUBLE: {
+        uint64_t v;
+        memcpy(&v, &src->u.double_, sizeof(v));
+        write_byte(s, ta_parent, 0xcb);
+        write_be(s, ta_parent, 8, v);
+        return 0;
+    }
+    case MPV_FORMAT_STRING:
+        write_str(s, ta_parent, bstr0(src->u.string));
+        return 0;
+    case MPV_FORMAT_BYTE_ARRAY: {
+        struct mpv_byte_array *ba = src->u.ba;
+        write_len(s, ta_parent, ba->size, -1, 0, 0xc4, 0xc5, 0xc6);
+        bstr_xappend(ta_parent, s, (bstr){ba->data, ba->size});
+        return 0;
+    }
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+        struct mpv_node_list *list = src->u.list;
+        int num = list ? list->num : 0;
+        bool is_map = src->format == MPV_FORMAT_NODE_MAP;
+        if (is_map) {
+            write_len(s, ta_parent, num, 0x80, 15, 0, 0xde, 0xdf);
+        } else {
+            write_len(s, ta_parent, num, 0x90, 15, 0, 0xdc, 0xdd);
+        }
+        for (int n = 0; n < num; n++) {
+            if (is_map)
+                write_str(s, ta_parent, bstr0(list->keys[n]));
+            if (write_rec(s, ta_parent, &list->values[n]) < 0)
+                return -1;
+        }
+        return 0;
+    }
+    }
+    return -1;
+}
+
+// Append the MessagePack encoding of src to *s (allocated under ta_parent).
+// Returns -1 for unsupported node types.
+int msgpack_write(bstr *s, void *ta_parent, struct mpv_node *src)
+{
+    return write_rec(s, ta_parent, src);
+}
+
+static bool read_be(bstr *src, int bytes, uint64_t *out)
+{
+    if (src->len < bytes)
+        return false;
+    uint64_t v = 0;
+    for (int n = 0; n < bytes; n++)
+        v = (v << 8) | src->start[n];
+    *src = bstr_cut(*src, bytes);
+    *out = v;
+    return true;
+}
+
+static bool read_data(bstr *src, uint64_t len, bstr *out)
+{
+    if (src->len < len)
+        return false;
+    *out = bstr_splice(*src, 0, len);
+    *src = bstr_cut(*src, len);
+    return true;
+}
+
+static int read_rec(void *ta_parent, struct mpv_node *dst, bstr *src,
+                    int max_depth);
+
+static int read_list(void *ta_parent, struct mpv_node *dst, bstr *src,
+                     int max_depth, uint64_t num, bool is_map)
+{
+    if (max_depth <= 0)
+        return -1;
+    // Every element takes at least 1 byte (2 for map pairs).
+    if (num > src->len)
+        return -1;
+
+    struct mpv_node_list *list = talloc_zero(ta_parent, struct mpv_node_list);
+    *dst = (struct mpv_node){
+        .format = is_map ? MPV_FORMAT_NODE_MAP : MPV_FORMAT_NODE_ARRAY,
+        .u.list = list,
+    };
+    list->values = talloc_array(list, struct mpv_node, num);
+    if (is_map)
+        list->keys = talloc_array(list, char *, num);
+    for (uint64_t n = 0; n < num; n++) {
+        if (is_map) {
+            struct mpv_node key;
+            if (read_rec(list, &key, src, 0) < 0 ||
+                key.format != MPV_FORMAT_STRING)
+                return -1;
+            list->keys[n] = key.u.string;
+        }
+        if (read_rec(list, &list->values[n], src, max_depth - 1) < 0)
+            return -1;
+        list->num++;
+    }
+    return 0;
+}
+
+static int read_rec(void *ta_parent, struct mpv_node *dst, bstr *src,
+                    int max_depth)
+{
+    if (!src->len)
+        return -1;
+    uint8_t tag = src->start[0];
+    *src = bstr_cut(*src, 1);
+
+    uint64_t v = 0;
+    bstr data;
+
+    if (tag <= 0x7f || tag >= 0xe0) {
+        *dst = (struct mpv_node){.format = MPV_FORMAT_INT64,
+                                 .u.int64 = (int8_t)tag};
+        return 0;
+    }
+    if ((tag & 0xe0) == 0xa0) {
+        v = tag & 0x1f;
+        goto str;
+    }
+    if ((tag & 0xf0) == 0x90)
+        return read_list(ta_parent, dst, src, max_depth, tag & 0x0f, false);
+    if ((tag & 0xf0) == 0x80)
+        return read_list(ta_parent, dst, src, max_depth, tag & 0x0f, true);
+
+    switch (tag) {
+    case 0xc0:
+        *dst = (struct mpv_node){.format = MPV_FORMAT_NONE};
+        return 0;
+    case 0xc2:
+    case 0xc3:
+        *dst = (struct mpv_node){.format = MPV_FORMAT_FLAG,
+                                 .u.flag = tag == 0xc3};
+        return 0;
+    case 0xc4: case 0xc5: case 0xc6: {
+        if (!read_be(src, 1 << (tag - 0xc4), &v) || !read_data(src, v, &data))
+            return -1;
+        struct mpv_byte_array *ba = talloc_zero(ta_parent, struct mpv_byte_array);
+        ba->data = talloc_memdup(ba, data.start, data.len);
+        ba->size = data.len;
+        *dst = (struct mpv_node){.format = MPV_FORMAT_BYTE_ARRAY, .u.ba = ba};
+        return 0;
+    }
+    case 0xca: {
+        if (!read_be(src, 4, &v))
+            return -1;
+        uint32_t v32 = v;
+        float f;
+        memcpy(&f, &v32, sizeof(f));
+        *dst = (struct mpv_node){.format = MPV_FORMAT_DOUBLE, .u.double_ = f};
+        return 0;
+    }
+    case 0xcb: {
+        if (!read_be(src, 8, &v))
+            return -1;
+        double d;
+        memcpy(&d, &v, sizeof(d));
+        *dst = (struct mpv_node){.format = MPV_FORMAT_DOUBLE, .u.double_ = d};
+        return 0;
+    }
+    case 0xcc: case 0xcd: case 0xce: case 0xcf:
+        if (!read_be(src, 1 << (tag - 0xcc), &v) || v > INT64_MAX)
+            return -1;
+        *dst = (struct mpv_node){.format = MPV_FORMAT_INT64, .u.int64 = v};
+        return 0;
+    case 0xd0: case 0xd1: case 0xd2: case 0xd3: {
+        int bytes = 1 << (tag - 0xd0);
+        if (!read_be(src, bytes, &v))
+            return -1;
+        // Sign extend.
+        int64_t i = bytes < 8 && (v >> (bytes * 8 - 1)) ?
+                    (int64_t)(v | ~((UINT64_C(1) << (bytes * 8)) - 1)) :
+                    (int64_t)v;
+        *dst = (struct mpv_node){.format = MPV_FORMAT_INT64, .u.int64 = i};
+        return 0;
+    }
+    case 0xd9: case 0xda: case 0xdb:
+        if (!read_be(src, 1 << (tag - 0xd9), &v))
+            return -1;
+        goto str;
+    case 0xdc: case 0xdd:
+        if (!read_be(src, 2 << (tag - 0xdc), &v))
+            return -1;
+        return read_list(ta_parent, dst, src, max_depth, v, false);
+    case 0xde: case 0xdf:
+        if (!read_be(src, 2 << (tag - 0xde), &v))
+            return -1;
+        return read_list(ta_parent, dst, src, max_depth, v, true);
+    }
+    return -1;
+
+str:
+    if (!read_data(src, v, &data))
+        return -1;
+    *dst = (struct mpv_node){.format = MPV_FORMAT_STRING,
+                             .u.string = bstrto0(ta_parent, data)};
+    return 0;
+}
+
+// Parse one MessagePack value from the start of *src, and advance *src past
+// it. All memory is allocated under ta_parent. max_depth limits the nesting of
+// arrays and maps. Returns -1 on error (then dst is undefined).
+int msgpack_parse(void *ta_parent, struct mpv_node *dst, bstr *src,
+                  int max_depth)
+{
+    return read_rec(ta_parent, dst, src, max_depth);
+}
@@ -1,7 +1,13 @@
 #include "common/common.h"
+#include "osdep/atomic.h"
 
 #include "node.h"
 
+struct mp_shared_node {
+    atomic_int refcount;
+    struct mpv_node node;
+};
+
 // Init a node with the given format. If parent is not NULL, it is set as
 // parent allocation according to m_option_type_node rules (which means
 // the mpv_node_list allocs are used for chaining the TA allocations).
@@ -21,8 +27,12 @@ void node_init(struct mpv_node *dst, int format, struct mpv_node *parent)
     }
 
     *dst = (struct mpv_node){ .format = format };
-    if (format == MPV_FORMAT_NODE_MAP || format == MPV_FORMAT_NODE_ARRAY)
+    if (format == MPV_FORMAT_NODE_MAP || format == MPV_FORMAT_NODE_ARRAY) {
         dst->u.list = talloc_zero(ta_parent, struct mpv_node_list);
+        // Node trees are built and freed as a whole.
+        if (!ta_parent)
+            talloc_make_arena(dst->u.list);
+    }
 }
 
 // Add an entry to a MPV_FORMAT_NODE_ARRAY.
@@ -78,3 +88,49 @@ void node_map_add_flag(struct mpv_node *dst, const char *key, bool v)
 {
     node_map_add(dst, key, MPV_FORMAT_FLAG)->u.flag = v;
 }
+
+// Create a reference counted node, which takes over the allocations of *node
+// (as returned by property getters, or built with node_init() with a NULL
+// parent). *node is cleared. The tree must not be changed afterwards, which
+// makes it safe to share it between threads. Free it with
+// mp_shared_node_unref().
+struct mp_shared_node *mp_shared_node_new(struct mpv_node *node)
+{
+    struct mp_shared_node *s = talloc_ptrtype(NULL, s);
+    *s = (struct mp_shared_node){
+        .refcount = ATOMIC_VAR_INIT(1),
+        .node = *node,
+    };
+    *node = (struct mpv_node){0};
+    return s;
+}
+
+// Return the node. It is valid as long as the caller holds a reference.
+const struct mpv_node *mp_shared_node_get(struct mp_shared_node *s)
+{
+    return &s->node;
+}
+
+struct mp_shared_node *mp_shared_node_ref(struct mp_shared_node *s)
+{
+    atomic_fetch_add(&s->refcount, 1);
+    return s;
+}
+
+// s can be NULL.
+void mp_shared_node_unref(struct mp_shared_node *s)
+{
+    if (!s || atomic_fetch_add(&s->refcount, -1) > 1)
+        return;
+    // Same as m_option_type_node's free.
+    switch (s->node.format) {
+    case MPV_FORMAT_STRING:
+        talloc_free(s->node.u.string);
+        break;
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP:
+        talloc_free(s->node.u.list);
+        break;
+    }
+    talloc_free(s);
+}
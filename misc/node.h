@@ -11,4 +11,10 @@ void node_map_add_int64(struct mpv_node *dst, const char *key, int64_t v);
 void node_map_add_double(struct mpv_node *dst, const char *key, double v);
 void node_map_add_flag(struct mpv_node *dst, const char *key, bool v);
 
+struct mp_shared_node;
+struct mp_shared_node *mp_shared_node_new(struct mpv_node *node);
+const struct mpv_node *mp_shared_node_get(struct mp_shared_node *s);
+struct mp_shared_node *mp_shared_node_ref(struct mp_shared_node *s);
+void mp_shared_node_unref(struct mp_shared_node *s);
+
 #endif
@@ -18,12 +18,35 @@
 #include <pthread.h>
 
 #include "common/common.h"
+#include "misc/dispatch.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
+#include "stream/stream.h"
 
 #include "thread_pool.h"
 
-struct work {
-    void (*fn)(void *ctx);
-    void *fn_ctx;
+struct thread_pool_opts {
+    int threads;
+    int weight;
+};
+
+#define OPT_BASE_STRUCT struct thread_pool_opts
+const struct m_sub_options thread_pool_conf = {
+    .opts = (const struct m_option[]){
+        OPT_INTRANGE("shared-thread-pool", threads, 0, 0, 64),
+        OPT_INTRANGE("shared-thread-pool-weight", weight, 0, 1, 1000),
+        {0}
+    },
+    .size = sizeof(struct thread_pool_opts),
+    .defaults = &(const struct thread_pool_opts){
+        .weight = 100,
+    },
+};
+
+// FIFO ring buffer of jobs.
+struct work_queue {
+    struct mp_thread_pool_job *items;
+    int alloc, head, num;
 };
 
 struct mp_thread_pool {
@@ -33,12 +56,81 @@ struct mp_thread_pool {
     pthread_mutex_t lock;
     pthread_cond_t wakeup;
 
-    // --- the following fields are protected by lock
+    // --- the following fields are protected by lock (or shared_lock, if
+    //     shared is set)
     bool terminate;
-    struct work *work;
-    int num_work;
+    struct work_queue queues[MP_THREAD_POOL_PRIO_COUNT];
+    int num_work;       // sum of all queues[].num
+
+    // If set, this is a client of the process-wide pool. It has no threads,
+    // and lock/wakeup are unused.
+    bool shared;
+    int weight;
+    double pass;        // work items run, scaled by 1/weight
+    int num_running;    // work items currently being run
 };
 
+// Process-wide pool, shared by all mp_thread_pool_create_shared() users. The
+// worker threads are never destroyed.
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t shared_wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t shared_done = PTHREAD_COND_INITIALIZER;
+static struct mp_thread_pool **shared_clients;
+static int num_shared_clients;
+static int num_shared_threads;
+
+static void push_work(struct mp_thread_pool *pool,
+                      const struct mp_thread_pool_job *job)
+{
+    assert(job->prio >= 0 && job->prio < MP_THREAD_POOL_PRIO_COUNT);
+    struct work_queue *q = &pool->queues[job->prio];
+    if (q->num == q->alloc) {
+        int alloc = q->alloc * 2 + 4;
+        struct mp_thread_pool_job *items =
+            talloc_array(pool, struct mp_thread_pool_job, alloc);
+        for (int n = 0; n < q->num; n++)
+            items[n] = q->items[(q->head + n) % q->alloc];
+        talloc_free(q->items);
+        q->items = items;
+        q->alloc = alloc;
+        q->head = 0;
+    }
+    q->items[(q->head + q->num) % q->alloc] = *job;
+    q->num += 1;
+    pool->num_work += 1;
+}
+
+// Return the priority of the most important queued job, or -1 if none.
+static int top_prio(struct mp_thread_pool *pool)
+{
+    for (int n = 0; n < MP_THREAD_POOL_PRIO_COUNT; n++) {
+        if (pool->queues[n].num)
+            return n;
+    }
+    return -1;
+}
+
+static struct mp_thread_pool_job pop_work(struct mp_thread_pool *pool)
+{
+    int prio = top_prio(pool);
+    assert(prio >= 0);
+    struct work_queue *q = &pool->queues[prio];
+    struct mp_thread_pool_job job = q->items[q->head];
+    q->head = (q->head + 1) % q->alloc;
+    q->num -= 1;
+    pool->num_work -= 1;
+    return job;
+}
+
+// Called without lock.
+static void run_job(struct mp_thread_pool_job *job)
+{
+    if (!job->cancel || !mp_cancel_test(job->cancel))
+        job->fn(job->fn_ctx);
+    if (job->done_queue)
+        mp_dispatch_enqueue(job->done_queue, job->done_fn, job->done_ctx);
+}
+
 static void *worker_thread(void *arg)
 {
     struct mp_thread_pool *pool = arg;
@@ -51,12 +143,10 @@ static void *worker_thread(void *arg)
         if (!pool->num_work && pool->terminate)
             break;
 
-        assert(pool->num_work > 0);
-        struct work work = pool->work[pool->num_work - 1];
-        pool->num_work -= 1;
+        struct mp_thread_pool_job job = pop_work(pool);
 
         pthread_mutex_unlock(&pool->lock);
-        work.fn(work.fn_ctx);
+        run_job(&job);
         pthread_mutex_lock(&pool->lock);
     }
     assert(pool->num_work == 0);
@@ -82,6 +172,68 @@ static void thread_pool_dtor(void *ctx)
     pthread_mutex_destroy(&pool->lock);
 }
 
+// Called with shared_lock held. Picks the client with the most important
+// pending work, and among those the one that got the least share of the worker
+// threads relative to its weight.
+static struct mp_thread_pool *pick_shared_client(void)
+{
+    struct mp_thread_pool *best = NULL;
+    int best_prio = -1;
+    for (int n = 0; n < num_shared_clients; n++) {
+        struct mp_thread_pool *pool = shared_clients[n];
+        int prio = top_prio(pool);
+        if (prio < 0)
+            continue;
+        if (!best || prio < best_prio ||
+            (prio == best_prio && pool->pass < best->pass))
+        {
+            best = pool;
+            best_prio = prio;
+        }
+    }
+    return best;
+}
+
+static void *shared_worker_thread(void *arg)
+{
+    pthread_mutex_lock(&shared_lock);
+    while (1) {
+        struct mp_thread_pool *pool = pick_shared_client();
+        if (!pool) {
+            pthread_cond_wait(&shared_wakeup, &shared_lock);
+            continue;
+        }
+
+        struct mp_thread_pool_job job = pop_work(pool);
+        pool->num_running += 1;
+        pool->pass += 1.0 / pool->weight;
+
+        pthread_mutex_unlock(&shared_lock);
+        run_job(&job);
+        pthread_mutex_lock(&shared_lock);
+
+        pool->num_running -= 1;
+        pthread_cond_broadcast(&shared_done);
+    }
+    return NULL;
+}
+
+static void shared_pool_dtor(void *ctx)
+{
+    struct mp_thread_pool *pool = ctx;
+
+    pthread_mutex_lock(&shared_lock);
+    while (pool->num_work || pool->num_running)
+        pthread_cond_wait(&shared_done, &shared_lock);
+    for (int n = 0; n < num_shared_clients; n++) {
+        if (shared_clients[n] == pool) {
+            MP_TARRAY_REMOVE_AT(shared_clients, num_shared_clients, n);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&shared_lock);
+}
+
 // Create a thread pool with the given number of worker threads. This can return
 // NULL if the worker threads could not be created. The thread pool can be
 // destroyed with talloc_free(pool), or indirectly with talloc_free(ta_parent).
@@ -109,6 +261,50 @@ struct mp_thread_pool *mp_thread_pool_create(void *ta_parent, int threads)
     return pool;
 }
 
+// Like mp_thread_pool_create(), but if --shared-thread-pool is enabled, use
+// the process-wide pool instead of creating new threads. This is meant for
+// applications which run many mpv instances in the same process. Work items
+// of all instances are then run by the same threads, and each instance gets
+// a share of them according to --shared-thread-pool-weight.
+// The process-wide pool grows to the largest --shared-thread-pool value used
+// by any instance. Only use this for work items which don't wait on other
+// work items, since a shared pool can be fully occupied by other instances.
+struct mp_thread_pool *mp_thread_pool_create_shared(void *ta_parent,
+                                                    struct mpv_global *global,
+                                                    int threads)
+{
+    struct thread_pool_opts *opts =
+        mp_get_config_group(NULL, global, &thread_pool_conf);
+    int shared_threads = opts->threads;
+    int weight = opts->weight;
+    talloc_free(opts);
+
+    if (shared_threads < 1)
+        return mp_thread_pool_create(ta_parent, threads);
+
+    pthread_mutex_lock(&shared_lock);
+    while (num_shared_threads < shared_threads) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, shared_worker_thread, NULL))
+            break;
+        pthread_detach(thread);
+        num_shared_threads++;
+    }
+    if (!num_shared_threads) {
+        pthread_mutex_unlock(&shared_lock);
+        return NULL;
+    }
+
+    struct mp_thread_pool *pool = talloc_zero(ta_parent, struct mp_thread_pool);
+    pool->shared = true;
+    pool->weight = weight;
+    MP_TARRAY_APPEND(NULL, shared_clients, num_shared_clients, pool);
+    talloc_set_destructor(pool, shared_pool_dtor);
+    pthread_mutex_unlock(&shared_lock);
+
+    return pool;
+}
+
 // Queue a function to be run on a worker thread: fn(fn_ctx)
 // If no worker thread is currently available, it's appended to a list in memory
 // with unbounded size. This function always returns immediately.
@@ -117,9 +313,44 @@ struct mp_thread_pool *mp_thread_pool_create(void *ta_parent, int threads)
 void mp_thread_pool_queue(struct mp_thread_pool *pool, void (*fn)(void *ctx),
                           void *fn_ctx)
 {
+    mp_thread_pool_queue_job(pool, &(struct mp_thread_pool_job){
+        .fn = fn,
+        .fn_ctx = fn_ctx,
+        .prio = MP_THREAD_POOL_PRIO_NORMAL,
+    });
+}
+
+// Like mp_thread_pool_queue(), but with the additional parameters in job (see
+// struct mp_thread_pool_job). The job struct is copied.
+void mp_thread_pool_queue_job(struct mp_thread_pool *pool,
+                              const struct mp_thread_pool_job *job)
+{
+    if (pool->shared) {
+        pthread_mutex_lock(&shared_lock);
+        if (!pool->num_work && !pool->num_running) {
+            // Idle clients don't accumulate credit, which would let them
+            // starve the busy clients when they become active again.
+            bool found = false;
+            double min_pass = 0;
+            for (int n = 0; n < num_shared_clients; n++) {
+                struct mp_thread_pool *other = shared_clients[n];
+                if (other->num_work || other->num_running) {
+                    if (!found || other->pass < min_pass)
+                        min_pass = other->pass;
+                    found = true;
+                }
+            }
+            if (found)
+                pool->pass = MPMAX(pool->pass, min_pass);
+        }
+        push_work(pool, job);
+        pthread_cond_signal(&shared_wakeup);
+        pthread_mutex_unlock(&shared_lock);
+        return;
+    }
+
     pthread_mutex_lock(&pool->lock);
-    struct work work = {fn, fn_ctx};
-    MP_TARRAY_INSERT_AT(pool, pool->work, pool->num_work, 0, work);
+    push_work(pool, job);
     pthread_cond_signal(&pool->wakeup);
     pthread_mutex_unlock(&pool->lock);
 }
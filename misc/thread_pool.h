@@ -2,9 +2,41 @@
 #define MPV_MP_THREAD_POOL_H
 
 struct mp_thread_pool;
+struct mpv_global;
+struct mp_dispatch_queue;
+struct mp_cancel;
+
+// Priority classes. Queued jobs of a more important class are always started
+// before jobs of a less important one (with the shared pool, across all
+// instances). Jobs of the same class are started in FIFO order.
+enum mp_thread_pool_prio {
+    MP_THREAD_POOL_PRIO_HIGH,       // something is waiting for the result
+    MP_THREAD_POOL_PRIO_NORMAL,     // default
+    MP_THREAD_POOL_PRIO_BACKGROUND, // e.g. writing files, prefetching
+    MP_THREAD_POOL_PRIO_COUNT,
+};
+
+struct mp_thread_pool_job {
+    void (*fn)(void *ctx);
+    void *fn_ctx;
+    enum mp_thread_pool_prio prio;
+    // If set, and the token was triggered before the job started, fn is not
+    // run. fn can use it to stop early as well.
+    struct mp_cancel *cancel;
+    // If set, done_fn(done_ctx) is queued with mp_dispatch_enqueue() after fn
+    // returned (or was skipped due to cancel).
+    struct mp_dispatch_queue *done_queue;
+    void (*done_fn)(void *ctx);
+    void *done_ctx;
+};
 
 struct mp_thread_pool *mp_thread_pool_create(void *ta_parent, int threads);
+struct mp_thread_pool *mp_thread_pool_create_shared(void *ta_parent,
+                                                    struct mpv_global *global,
+                                                    int threads);
 void mp_thread_pool_queue(struct mp_thread_pool *pool, void (*fn)(void *ctx),
                           void *fn_ctx);
+void mp_thread_pool_queue_job(struct mp_thread_pool *pool,
+                              const struct mp_thread_pool_job *job);
 
 #endif
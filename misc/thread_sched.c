@@ -0,0 +1,157 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/bstr.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
+#include "osdep/threads.h"
+
+#include "thread_sched.h"
+
+struct thread_sched_opts {
+    char **priority;
+    char **affinity;
+};
+
+#define OPT_BASE_STRUCT struct thread_sched_opts
+const struct m_sub_options thread_sched_conf = {
+    .opts = (const struct m_option[]){
+        OPT_KEYVALUELIST("thread-priority", priority, 0),
+        OPT_KEYVALUELIST("thread-affinity", affinity, 0),
+        {0}
+    },
+    .size = sizeof(struct thread_sched_opts),
+};
+
+static const char *const role_names[] = {
+    [MP_THREAD_ROLE_CORE]   = "core",
+    [MP_THREAD_ROLE_AUDIO]  = "audio",
+    [MP_THREAD_ROLE_VIDEO]  = "video",
+    [MP_THREAD_ROLE_DEMUX]  = "demux",
+    [MP_THREAD_ROLE_CACHE]  = "cache",
+};
+
+static const char *find_value(char **list, const char *role)
+{
+    for (int n = 0; list && list[n] && list[n + 1]; n += 2) {
+        if (strcmp(list[n], role) == 0)
+            return list[n + 1];
+    }
+    return NULL;
+}
+
+// Parse "default", "low", "high", or "realtime[:<level>]".
+static bool parse_priority(const char *s, enum mp_thread_priority *prio,
+                           int *rt_level)
+{
+    bstr rest, val = bstr_split(bstr0(s), ":", &rest);
+    *rt_level = 10;
+    if (bstr_equals0(val, "realtime")) {
+        *prio = MP_THREAD_PRIO_REALTIME;
+        if (bstr_eatstart0(&rest, ":")) {
+            long long level = bstrtoll(rest, &rest, 10);
+            if (rest.len || level < 1 || level > 99)
+                return false;
+            *rt_level = level;
+        }
+        return true;
+    }
+    if (rest.len)
+        return false;
+    if (bstr_equals0(val, "default")) {
+        *prio = MP_THREAD_PRIO_DEFAULT;
+    } else if (bstr_equals0(val, "low")) {
+        *prio = MP_THREAD_PRIO_LOW;
+    } else if (bstr_equals0(val, "high")) {
+        *prio = MP_THREAD_PRIO_HIGH;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Parse a list of CPU numbers and ranges, like "0,2,4-7".
+static bool parse_cpus(const char *s, uint64_t *mask)
+{
+    bstr str = bstr0(s);
+    *mask = 0;
+    while (str.len) {
+        bstr rest;
+        long long a = bstrtoll(str, &rest, 10), b = a;
+        if (rest.len == str.len)
+            return false;
+        if (bstr_eatstart0(&rest, "-")) {
+            bstr end = rest;
+            b = bstrtoll(end, &rest, 10);
+            if (rest.len == end.len)
+                return false;
+        }
+        if (a < 0 || b < a || b > 63)
+            return false;
+        for (long long n = a; n <= b; n++)
+            *mask |= 1ULL << n;
+        str = rest;
+        if (str.len && (!bstr_eatstart0(&str, ",") || !str.len))
+            return false;
+    }
+    return *mask != 0;
+}
+
+void mp_thread_set_role(struct mpv_global *global, struct mp_log *log,
+                        enum mp_thread_role role)
+{
+    struct thread_sched_opts *opts =
+        mp_get_config_group(NULL, global, &thread_sched_conf);
+    const char *name = role_names[role];
+
+    const char *prio_s = find_value(opts->priority, name);
+    if (prio_s) {
+        enum mp_thread_priority prio;
+        int rt_level;
+        if (!parse_priority(prio_s, &prio, &rt_level)) {
+            mp_warn(log, "Invalid --thread-priority value for %s: '%s'\n",
+                    name, prio_s);
+        } else {
+            int err = mpthread_set_priority(prio, rt_level);
+            if (err) {
+                mp_warn(log, "Could not set the priority of the %s thread: %s\n",
+                        name, mp_strerror(err));
+            }
+        }
+    }
+
+    const char *cpus_s = find_value(opts->affinity, name);
+    if (cpus_s) {
+        uint64_t mask;
+        if (!parse_cpus(cpus_s, &mask)) {
+            mp_warn(log, "Invalid --thread-affinity value for %s: '%s'\n",
+                    name, cpus_s);
+        } else {
+            int err = mpthread_set_affinity(mask);
+            if (err) {
+                mp_warn(log, "Could not set the CPU affinity of the %s thread: "
+                        "%s\n", name, mp_strerror(err));
+            }
+        }
+    }
+
+    talloc_free(opts);
+}
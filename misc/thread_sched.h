@@ -0,0 +1,22 @@
+#ifndef MPV_MP_THREAD_SCHED_H
+#define MPV_MP_THREAD_SCHED_H
+
+struct mpv_global;
+struct mp_log;
+
+// Thread roles, as named by the --thread-priority and --thread-affinity
+// options.
+enum mp_thread_role {
+    MP_THREAD_ROLE_CORE,    // playloop and decoding
+    MP_THREAD_ROLE_AUDIO,   // AO feeding thread
+    MP_THREAD_ROLE_VIDEO,   // VO thread
+    MP_THREAD_ROLE_DEMUX,   // demuxer thread
+    MP_THREAD_ROLE_CACHE,   // stream cache thread
+};
+
+// Apply the scheduling options for the role to the calling thread. Failures
+// are logged, but are not fatal.
+void mp_thread_set_role(struct mpv_global *global, struct mp_log *log,
+                        enum mp_thread_role role);
+
+#endif
@@ -58,6 +58,10 @@ struct m_config_shadow {
     pthread_mutex_t lock;
     struct m_config *root;
     char *data;
+    // Incremented on every option write. opt_ts[n] is the value it had when
+    // root->opts[n] was last written. Lets caches copy changed options only.
+    long long change_ts;
+    long long *opt_ts;
     struct m_config_cache **listeners;
     int num_listeners;
 };
@@ -533,16 +537,51 @@ static void m_config_add_option(struct m_config *config,
     }
 }
 
+static int compare_opt_ptr(const void *pa, const void *pb)
+{
+    const struct m_config_option *a = *(struct m_config_option **)pa;
+    const struct m_config_option *b = *(struct m_config_option **)pb;
+    int r = strcmp(a->name, b->name);
+    // Keep the first option if names are duplicated.
+    return r ? r : (a > b) - (a < b);
+}
+
+static void build_sorted_index(struct m_config *config)
+{
+    config->sorted_opts = talloc_realloc(config, config->sorted_opts,
+                                         struct m_config_option *,
+                                         MPMAX(config->num_opts, 1));
+    for (int n = 0; n < config->num_opts; n++)
+        config->sorted_opts[n] = &config->opts[n];
+    qsort(config->sorted_opts, config->num_opts, sizeof(config->sorted_opts[0]),
+          compare_opt_ptr);
+    config->num_sorted_opts = config->num_opts;
+}
+
 struct m_config_option *m_config_get_co_raw(const struct m_config *config,
                                             struct bstr name)
 {
     if (!name.len)
         return NULL;
 
-    for (int n = 0; n < config->num_opts; n++) {
-        struct m_config_option *co = &config->opts[n];
-        struct bstr coname = bstr0(co->name);
-        if (bstrcmp(coname, name) == 0)
+    // The index is built on demand. (The root config's index is built before
+    // it's accessed from other threads, see m_config_create_shadow().)
+    if (config->num_sorted_opts != config->num_opts)
+        build_sorted_index((struct m_config *)config);
+
+    int lo = 0, hi = config->num_opts;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        struct m_config_option *co = config->sorted_opts[mid];
+        if (bstrcmp(bstr0(co->name), name) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < config->num_opts) {
+        struct m_config_option *co = config->sorted_opts[lo];
+        if (bstrcmp(bstr0(co->name), name) == 0)
             return co;
     }
 
@@ -1184,10 +1223,15 @@ void m_config_create_shadow(struct m_config *config)
 
     config->shadow = talloc_zero(config, struct m_config_shadow);
     config->shadow->data = talloc_zero_size(config->shadow, config->shadow_size);
+    config->shadow->opt_ts =
+        talloc_zero_array(config->shadow, long long, config->num_opts);
 
     config->shadow->root = config;
     pthread_mutex_init(&config->shadow->lock, NULL);
 
+    // mp_read_option_raw() looks up options from any thread.
+    build_sorted_index(config);
+
     config->global->config = config->shadow;
 
     for (int n = 0; n < config->num_opts; n++) {
@@ -1243,6 +1287,7 @@ struct m_config_cache *m_config_cache_alloc(void *ta_parent,
     }
 
     cache->ts = -1;
+    cache->change_ts = -1;
     cache->group = -1;
 
     for (int n = 0; n < config->num_groups; n++) {
@@ -1259,12 +1304,16 @@ struct m_config_cache *m_config_cache_alloc(void *ta_parent,
     // If we're not on the top-level, restrict set of options to the sub-group
     // to reduce update costs. (It would be better not to add them in the first
     // place.)
+    cache->opt_index = talloc_array(cache, int, config->num_opts);
+    for (int n = 0; n < config->num_opts; n++)
+        cache->opt_index[n] = n;
     if (cache->group > 0) {
         int num_opts = config->num_opts;
         config->num_opts = 0;
         for (int n = 0; n < num_opts; n++) {
             struct m_config_option *co = &config->opts[n];
             if (is_group_included(config, co->group, cache->group)) {
+                cache->opt_index[config->num_opts] = n;
                 config->opts[config->num_opts++] = *co;
             } else {
                 m_option_free(co->opt, co->data);
@@ -1274,6 +1323,7 @@ struct m_config_cache *m_config_cache_alloc(void *ta_parent,
             if (!is_group_included(config, n, cache->group))
                 TA_FREEP(&config->groups[n].opts);
         }
+        config->num_sorted_opts = -1; // opts were moved
     }
 
     m_config_cache_update(cache);
@@ -1292,11 +1342,15 @@ bool m_config_cache_update(struct m_config_cache *cache)
 
     pthread_mutex_lock(&shadow->lock);
     cache->ts = atomic_load(&shadow->root->groups[cache->group].ts);
+    // Copy only the options written since the last update. Copying e.g. a
+    // string list option on every unrelated change can be expensive.
     for (int n = 0; n < cache->shadow_config->num_opts; n++) {
         struct m_config_option *co = &cache->shadow_config->opts[n];
-        if (co->shadow_offset >= 0)
+        if (co->shadow_offset >= 0 &&
+            shadow->opt_ts[cache->opt_index[n]] > cache->change_ts)
             m_option_copy(co->opt, co->data, shadow->data + co->shadow_offset);
     }
+    cache->change_ts = shadow->change_ts;
     pthread_mutex_unlock(&shadow->lock);
     return true;
 }
@@ -1310,6 +1364,8 @@ void m_config_notify_change_co(struct m_config *config,
         pthread_mutex_lock(&shadow->lock);
         if (co->shadow_offset >= 0)
             m_option_copy(co->opt, shadow->data + co->shadow_offset, co->data);
+        shadow->change_ts += 1;
+        shadow->opt_ts[co - config->opts] = shadow->change_ts;
         pthread_mutex_unlock(&shadow->lock);
     }
 
@@ -1328,7 +1384,9 @@ void m_config_notify_change_co(struct m_config *config,
         pthread_mutex_lock(&shadow->lock);
         for (int n = 0; n < shadow->num_listeners; n++) {
             struct m_config_cache *cache = shadow->listeners[n];
-            if (cache->wakeup_cb)
+            // Don't wake up caches for groups that don't contain the option.
+            if (cache->wakeup_cb && is_group_included(config, co->group,
+                                                      cache->group))
                 cache->wakeup_cb(cache->wakeup_cb_ctx);
         }
         pthread_mutex_unlock(&shadow->lock);
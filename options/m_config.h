@@ -61,6 +61,10 @@ typedef struct m_config {
     struct m_config_option *opts; // all options, even suboptions
     int num_opts;
 
+    // Pointers into opts, sorted by name. Rebuilt when num_opts changes.
+    struct m_config_option **sorted_opts;
+    int num_sorted_opts;
+
     // Creation parameters
     size_t size;
     const void *defaults;
@@ -274,6 +278,8 @@ struct m_config_cache {
     struct m_config_shadow *shadow;
     struct m_config *shadow_config;
     long long ts;
+    long long change_ts;    // last seen m_config_shadow.change_ts
+    int *opt_index;         // shadow_config->opts[n] => index in root opts
     int group;
     bool in_list;
     // --- Implicitly synchronized by setting/unsetting wakeup_cb.
@@ -3270,6 +3270,9 @@ static void dup_node(void *ta_parent, struct mpv_node *node)
         struct mpv_node_list *oldlist = node->u.list;
         struct mpv_node_list *new = talloc_zero(ta_parent, struct mpv_node_list);
         node->u.list = new;
+        // Allocate the copied tree from a single arena (see node_init()).
+        if (!ta_parent)
+            talloc_make_arena(new);
         if (oldlist->num > 0) {
             *new = *oldlist;
             new->values = talloc_array(new, struct mpv_node, new->num);
@@ -141,6 +141,16 @@ struct m_property *m_property_list_find(const struct m_property *list,
 int m_property_do(struct mp_log *log, const struct m_property* prop_list,
                   const char* property_name, int action, void* arg, void *ctx);
 
+// Like m_property_do(), but with the property already looked up. prop must be
+// the entry for m_property_base_name(property_name).
+int m_property_do_prop(struct mp_log *log, struct m_property *prop,
+                       const char *property_name, int action, void *arg,
+                       void *ctx);
+
+// Return the part of the property path that names the top-level property,
+// e.g. "a" for "a/b/c". (A trailing "/" is not treated as separator.)
+bstr m_property_base_name(const char *property_name);
+
 // Given a path of the form "a/b/c", this function will set *prefix to "a",
 // and rem to "b/c", and return true.
 // If there is no '/' in the path, set prefix to path, and rem to "", and
@@ -73,6 +73,8 @@ extern const struct m_sub_options demux_rawaudio_conf;
 extern const struct m_sub_options demux_rawvideo_conf;
 extern const struct m_sub_options demux_lavf_conf;
 extern const struct m_sub_options demux_mkv_conf;
+extern const struct m_sub_options demux_timeline_conf;
+extern const struct m_sub_options demux_edl_conf;
 extern const struct m_sub_options vd_lavc_conf;
 extern const struct m_sub_options ad_lavc_conf;
 extern const struct m_sub_options input_config;
@@ -81,6 +83,9 @@ extern const struct m_sub_options gl_video_conf;
 extern const struct m_sub_options ao_alsa_conf;
 
 extern const struct m_sub_options demux_conf;
+extern const struct m_sub_options thread_pool_conf;
+extern const struct m_sub_options lavfi_threads_conf;
+extern const struct m_sub_options thread_sched_conf;
 
 extern const struct m_obj_list vf_obj_list;
 extern const struct m_obj_list af_obj_list;
@@ -172,6 +177,7 @@ static const m_option_t mp_vo_opt_list[] = {
     OPT_FLAG("keepaspect-window", keepaspect_window, 0),
     OPT_FLAG("hidpi-window-scale", hidpi_window_scale, 0),
     OPT_FLAG("native-fs", native_fs, 0),
+    OPT_DOUBLE("video-timing-spin", timing_spin, CONF_RANGE, .min = 0, .max = 0.01),
 #if HAVE_X11
     OPT_CHOICE("x11-netwm", x11_netwm, 0,
                ({"auto", 0}, {"no", -1}, {"yes", 1})),
@@ -276,6 +282,9 @@ const m_option_t mp_opts[] = {
     OPT_GENERAL(char**, "msg-level", msg_levels, CONF_PRE_PARSE | UPDATE_TERM,
                 .type = &m_option_type_msglevels),
     OPT_STRING("dump-stats", dump_stats, UPDATE_TERM | CONF_PRE_PARSE),
+    OPT_STRING("dump-trace", dump_trace, UPDATE_TERM | CONF_PRE_PARSE |
+                                         M_OPT_FILE),
+    OPT_FLAG("dump-startup-timings", dump_startup_timings, 0),
     OPT_FLAG("msg-color", msg_color, CONF_PRE_PARSE | UPDATE_TERM),
     OPT_STRING("log-file", log_file, CONF_PRE_PARSE | M_OPT_FILE | UPDATE_TERM),
     OPT_FLAG("msg-module", msg_module, UPDATE_TERM),
@@ -322,6 +331,7 @@ const m_option_t mp_opts[] = {
                       ({"auto", -1})),
 #if HAVE_LIBBLURAY
     OPT_STRING("bluray-device", bluray_device, M_OPT_FILE),
+    OPT_STRING("bluray-scan-cache-dir", bluray_scan_cache_dir, M_OPT_FILE),
 #endif /* HAVE_LIBBLURAY */
 
 // ------------------------- demuxer options --------------------
@@ -373,7 +383,8 @@ const m_option_t mp_opts[] = {
                ({"no", 0}, {"attachment", 1})),
 
     OPT_CHOICE_OR_INT("hls-bitrate", hls_bitrate, 0, 0, INT_MAX,
-                      ({"no", -1}, {"min", 0}, {"max", INT_MAX})),
+                      ({"no", -1}, {"min", 0}, {"max", INT_MAX},
+                       {"auto", -2})),
 
     OPT_STRINGLIST("display-tags", display_tags, 0),
 
@@ -390,10 +401,13 @@ const m_option_t mp_opts[] = {
     OPT_STRING("sub-demuxer", sub_demuxer_name, 0),
     OPT_FLAG("demuxer-thread", demuxer_thread, 0),
     OPT_FLAG("prefetch-playlist", prefetch_open, 0),
+    OPT_DOUBLE("prefetch-playlist-secs", prefetch_secs, M_OPT_MIN, .min = 0),
     OPT_FLAG("cache-pause", cache_pausing, 0),
 
     OPT_DOUBLE("mf-fps", mf_fps, 0),
     OPT_STRING("mf-type", mf_type, 0),
+    OPT_INTRANGE("mf-readahead", mf_readahead, 0, 0, 64),
+    OPT_INTRANGE("mf-readahead-bytes", mf_readahead_bytes, 0, 0, INT_MAX),
 #if HAVE_TV
     OPT_SUBSTRUCT("tv", tv_params, tv_params_conf, 0),
 #endif /* HAVE_TV */
@@ -428,6 +442,7 @@ const m_option_t mp_opts[] = {
 #endif
     OPT_SETTINGSLIST("vf-defaults", vf_defs, 0, &vf_obj_list, ),
     OPT_SETTINGSLIST("vf", vf_settings, 0, &vf_obj_list, ),
+    OPT_FLAG("vf-async", vf_async, 0),
 
     OPT_FLAG("deinterlace", deinterlace, UPDATE_DEINT),
 
@@ -460,6 +475,8 @@ const m_option_t mp_opts[] = {
     OPT_SUBSTRUCT("demuxer-rawaudio", demux_rawaudio, demux_rawaudio_conf, 0),
     OPT_SUBSTRUCT("demuxer-rawvideo", demux_rawvideo, demux_rawvideo_conf, 0),
     OPT_SUBSTRUCT("demuxer-mkv", demux_mkv, demux_mkv_conf, 0),
+    OPT_SUBSTRUCT("demuxer-timeline", demux_timeline, demux_timeline_conf, 0),
+    OPT_SUBSTRUCT("demuxer-edl", demux_edl, demux_edl_conf, 0),
 
 // ------------------------- subtitles options --------------------
 
@@ -479,6 +496,7 @@ const m_option_t mp_opts[] = {
     OPT_FLAG("stretch-image-subs-to-screen", stretch_image_subs, UPDATE_OSD),
     OPT_FLAG("image-subs-video-resolution", image_subs_video_res, UPDATE_OSD),
     OPT_FLAG("sub-fix-timing", sub_fix_timing, 0),
+    OPT_DOUBLE("sub-preload-window", sub_preload_window, M_OPT_MIN, .min = 0),
     OPT_CHOICE("sub-auto", sub_auto, 0,
                ({"no", -1}, {"exact", 0}, {"fuzzy", 1}, {"all", 2})),
     OPT_CHOICE("audio-file-auto", audiofile_auto, 0,
@@ -505,6 +523,7 @@ const m_option_t mp_opts[] = {
     OPT_CHOICE("sub-ass-shaper", ass_shaper, UPDATE_OSD,
                ({"simple", 0}, {"complex", 1})),
     OPT_FLAG("sub-ass-justify", ass_justify, 0),
+    OPT_FLAG("sub-ass-prerender", ass_prerender, UPDATE_OSD),
     OPT_CHOICE("sub-ass-override", ass_style_override, UPDATE_OSD,
                ({"no", 0}, {"yes", 1}, {"force", 3}, {"scale", 4}, {"strip", 5})),
     OPT_FLAG("sub-scale-by-window", sub_scale_by_window, UPDATE_OSD),
@@ -557,6 +576,7 @@ const m_option_t mp_opts[] = {
                 {"weak", -1})),
     OPT_DOUBLE("audio-buffer", audio_buffer, M_OPT_MIN | M_OPT_MAX,
                .min = 0, .max = 10),
+    OPT_FLAG("audio-decoder-thread", audio_decoder_thread, 0),
     OPT_FLOATRANGE("balance", balance, 0, -1, 1),
 
     OPT_STRING("title", wintitle, 0),
@@ -589,13 +609,17 @@ const m_option_t mp_opts[] = {
                ({"no", 0},
                 {"vo", 1},
                 {"decoder", 2},
-                {"decoder+vo", 3})),
+                {"decoder+vo", 3},
+                {"decoder-tiered", 4},
+                {"decoder-tiered+vo", 5})),
 
     OPT_DOUBLE("display-fps", frame_drop_fps, M_OPT_MIN, .min = 0),
 
     OPT_FLAG("untimed", untimed, 0),
 
     OPT_STRING("stream-dump", stream_dump, M_OPT_FILE),
+    OPT_FLAG("stream-mmap", stream_mmap, 0),
+    OPT_INTRANGE("stream-async-reads", stream_async_reads, 0, 0, 16),
 
     OPT_FLAG("stop-playback-on-init-failure", stop_playback_on_init_failure, 0),
 
@@ -614,6 +638,8 @@ const m_option_t mp_opts[] = {
     OPT_FLAG("write-filename-in-watch-later-config", write_filename_in_watch_later_config, 0),
     OPT_FLAG("ignore-path-in-watch-later-config", ignore_path_in_watch_later_config, 0),
     OPT_STRING("watch-later-directory", watch_later_directory, M_OPT_FILE),
+    OPT_CHOICE("watch-later-store", watch_later_store, 0,
+               ({"files", 0}, {"log", 1})),
 
     OPT_FLAG("ordered-chapters", ordered_chapters, 0),
     OPT_STRING("ordered-chapters-files", ordered_chapters_files, M_OPT_FILE),
@@ -648,6 +674,11 @@ const m_option_t mp_opts[] = {
                ({"no", -1}, {"absolute", 0}, {"yes", 1}, {"always", 1})),
     OPT_FLOAT("hr-seek-demuxer-offset", hr_seek_demuxer_offset, 0),
     OPT_FLAG("hr-seek-framedrop", hr_seek_framedrop, 0),
+    OPT_INTRANGE("frame-step-cache", frame_step_cache, 0, 0, 16384),
+    OPT_CHOICE_OR_INT("video-lookahead", video_lookahead, 0, 0,
+                      16, ({"auto", -1})),
+    OPT_INTRANGE("video-lookahead-max-size", video_lookahead_max_size, 0,
+                 0, 16384),
     OPT_CHOICE_OR_INT("autosync", autosync, 0, 0, 10000,
                       ({"no", -1})),
 
@@ -662,6 +693,7 @@ const m_option_t mp_opts[] = {
     OPT_STRING("term-playing-msg", playing_msg, 0),
     OPT_STRING("osd-playing-msg", osd_playing_msg, 0),
     OPT_STRING("term-status-msg", status_msg, 0),
+    OPT_DOUBLE("term-status-rate", term_status_rate, M_OPT_MIN, .min = 0),
     OPT_STRING("osd-status-msg", osd_status_msg, 0),
     OPT_STRING("osd-msg1", osd_msg[0], 0),
     OPT_STRING("osd-msg2", osd_msg[1], 0),
@@ -678,17 +710,24 @@ const m_option_t mp_opts[] = {
 
     OPT_STRING("input-file", input_file, M_OPT_FILE | UPDATE_INPUT),
     OPT_STRING("input-ipc-server", ipc_path, M_OPT_FILE | UPDATE_INPUT),
+    OPT_INTRANGE("client-event-queue-size", client_event_queue_size, 0,
+                 16, 1000000),
 
     OPT_SUBSTRUCT("screenshot", screenshot_image_opts, screenshot_conf, 0),
     OPT_STRING("screenshot-template", screenshot_template, 0),
     OPT_STRING("screenshot-directory", screenshot_directory, M_OPT_FILE),
+    OPT_FLAG("screenshot-async", screenshot_async, 0),
 
     OPT_STRING("record-file", record_file, M_OPT_FILE),
+    OPT_DOUBLE("record-backlog", record_backlog, M_OPT_MIN, .min = 0),
 
     OPT_SUBSTRUCT("", input_opts, input_config, 0),
 
     OPT_SUBSTRUCT("", vo, vo_sub_opts, 0),
     OPT_SUBSTRUCT("", demux_opts, demux_conf, 0),
+    OPT_SUBSTRUCT("", thread_pool_opts, thread_pool_conf, 0),
+    OPT_SUBSTRUCT("", lavfi_threads_opts, lavfi_threads_conf, 0),
+    OPT_SUBSTRUCT("", thread_sched_opts, thread_sched_conf, 0),
 
     OPT_SUBSTRUCT("", gl_video_opts, gl_video_conf, 0),
     OPT_SUBSTRUCT("", spirv_opts, spirv_conf, 0),
@@ -884,11 +923,14 @@ const struct MPOpts mp_default_opts = {
     .lua_load_stats = 1,
 #endif
     .auto_load_scripts = 1,
+    .client_event_queue_size = 1000,
     .loop_times = 1,
     .ordered_chapters = 1,
     .chapter_merge_threshold = 100,
     .chapter_seek_threshold = 5.0,
     .hr_seek_framedrop = 1,
+    .video_lookahead = -1,
+    .video_lookahead_max_size = 128,
     .sync_max_video_change = 1,
     .sync_max_audio_change = 0.125,
     .sync_audio_drop_size = 0.020,
@@ -907,6 +949,7 @@ const struct MPOpts mp_default_opts = {
     .frame_dropping = 1,
     .term_osd = 2,
     .term_osd_bar_chars = "[-+-]",
+    .term_status_rate = 20,
     .consolecontrols = 1,
     .playlist_pos = -1,
     .play_frames = -1,
@@ -960,6 +1003,8 @@ const struct MPOpts mp_default_opts = {
     .index_mode = 1,
 
     .mf_fps = 1.0,
+    .mf_readahead = 4,
+    .mf_readahead_bytes = 256 * 1024 * 1024,
 
     .display_tags = (char **)(const char*[]){
         "Artist", "Album", "Album_Artist", "Comment", "Composer", "Genre",
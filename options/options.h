@@ -50,6 +50,8 @@ typedef struct mp_vo_opts {
 
     char *mmcss_profile;
 
+    double timing_spin;
+
     // vo_wayland, vo_drm
     struct sws_opts *sws_opts;
     // vo_opengl, vo_opengl_cb
@@ -64,14 +66,19 @@ struct mp_cache_opts {
     int initial;
     int seek_min;
     int back_buffer;
+    int keep_ranges;
     char *file;
     int file_max;
+    char *file_dir;
+    double readahead_secs;
 };
 
 typedef struct MPOpts {
     int property_print_help;
     int use_terminal;
     char *dump_stats;
+    char *dump_trace;
+    int dump_startup_timings;
     int verbose;
     int msg_really_quiet;
     char **msg_levels;
@@ -112,6 +119,7 @@ typedef struct MPOpts {
     float softvol_max;
     int gapless_audio;
     double audio_buffer;
+    int audio_decoder_thread;
 
     mp_vo_opts *vo;
 
@@ -139,7 +147,10 @@ typedef struct MPOpts {
 
     int untimed;
     char *stream_dump;
+    int stream_mmap;
+    int stream_async_reads;
     char *record_file;
+    double record_backlog;
     int stop_playback_on_init_failure;
     int loop_times;
     int loop_file;
@@ -168,6 +179,9 @@ typedef struct MPOpts {
     int hr_seek;
     float hr_seek_demuxer_offset;
     int hr_seek_framedrop;
+    int frame_step_cache;
+    int video_lookahead;
+    int video_lookahead_max_size;
     float audio_delay;
     float default_max_pts_correction;
     int autosync;
@@ -179,6 +193,7 @@ typedef struct MPOpts {
     char *playing_msg;
     char *osd_playing_msg;
     char *status_msg;
+    double term_status_rate;
     char *osd_status_msg;
     char *osd_msg[3];
     int player_idle_mode;
@@ -196,6 +211,7 @@ typedef struct MPOpts {
     int write_filename_in_watch_later_config;
     int ignore_path_in_watch_later_config;
     char *watch_later_directory;
+    int watch_later_store;
     int pause;
     int keep_open;
     int keep_open_pause;
@@ -218,11 +234,13 @@ typedef struct MPOpts {
     int image_subs_video_res;
 
     int sub_fix_timing;
+    double sub_preload_window;
 
     char **audio_files;
     char *demuxer_name;
     int demuxer_thread;
     int prefetch_open;
+    double prefetch_secs;
     char *audio_demuxer_name;
     char *sub_demuxer_name;
 
@@ -231,6 +249,7 @@ typedef struct MPOpts {
     struct image_writer_opts *screenshot_image_opts;
     char *screenshot_template;
     char *screenshot_directory;
+    int screenshot_async;
 
     double force_fps;
     int index_mode;
@@ -243,6 +262,7 @@ typedef struct MPOpts {
     double playback_speed;
     int pitch_correction;
     struct m_obj_settings *vf_settings, *vf_defs;
+    int vf_async;
     struct m_obj_settings *af_settings, *af_defs;
     int deinterlace;
     float movie_aspect;
@@ -285,6 +305,7 @@ typedef struct MPOpts {
     int ass_hinting;
     int ass_shaper;
     int ass_justify;
+    int ass_prerender;
     int sub_clear_on_seek;
     int teletext_page;
 
@@ -303,16 +324,24 @@ typedef struct MPOpts {
 
     char *cdrom_device;
     char *bluray_device;
+    char *bluray_scan_cache_dir;
 
     double mf_fps;
     char *mf_type;
+    int mf_readahead;
+    int mf_readahead_bytes;
 
     struct demux_rawaudio_opts *demux_rawaudio;
     struct demux_rawvideo_opts *demux_rawvideo;
     struct demux_lavf_opts *demux_lavf;
     struct demux_mkv_opts *demux_mkv;
+    struct demux_timeline_opts *demux_timeline;
+    struct demux_edl_opts *demux_edl;
 
     struct demux_opts *demux_opts;
+    struct thread_pool_opts *thread_pool_opts;
+    struct lavfi_threads_opts *lavfi_threads_opts;
+    struct thread_sched_opts *thread_sched_opts;
 
     struct vd_lavc_params *vd_lavc_params;
     struct ad_lavc_params *ad_lavc_params;
@@ -324,6 +353,7 @@ typedef struct MPOpts {
 
     char *ipc_path;
     char *input_file;
+    int client_event_queue_size;
 
     int wingl_dwm_flush;
 
@@ -7,3 +7,14 @@ int mp_subprocess(char **args, struct mp_cancel *cancel, void *ctx,
     *error = "unsupported";
     return -1;
 }
+
+int mp_subprocess_spawn_pipe(char **args, int64_t *pid)
+{
+    return -1;
+}
+
+int mp_subprocess_wait(int64_t pid, bool kill_it, char **error)
+{
+    *error = "unsupported";
+    return -1;
+}
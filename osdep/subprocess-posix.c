@@ -32,6 +32,9 @@
 
 extern char **environ;
 
+// Size of the buffer the output of the process is read into.
+#define SUBPROCESS_READ_SIZE (64 * 1024)
+
 #define SAFE_CLOSE(fd) do { if ((fd) >= 0) close((fd)); (fd) = -1; } while (0)
 
 // A silly helper: automatically skips entries with negative FDs
@@ -55,49 +58,88 @@ static int sparse_poll(struct pollfd *fds, int num_fds, int timeout)
     return r;
 }
 
+// Start the process with stdin redirected to /dev/null, and stdout/stderr to
+// the given FDs (or inherited if they're negative). Returns -1 on error.
+static pid_t spawn(char **args, int fd_stdout, int fd_stderr)
+{
+    posix_spawn_file_actions_t fa;
+    pid_t pid = -1;
+
+    int devnull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (devnull < 0)
+        return -1;
+
+    if (posix_spawn_file_actions_init(&fa)) {
+        close(devnull);
+        return -1;
+    }
+    // redirect stdin/stdout/stderr
+    if (posix_spawn_file_actions_adddup2(&fa, devnull, 0))
+        goto done;
+    if (fd_stdout >= 0 && posix_spawn_file_actions_adddup2(&fa, fd_stdout, 1))
+        goto done;
+    if (fd_stderr >= 0 && posix_spawn_file_actions_adddup2(&fa, fd_stderr, 2))
+        goto done;
+
+    // posix_spawn() uses vfork() (or clone(CLONE_VM)) semantics with most
+    // libcs, so spawning doesn't copy the page tables of the player process.
+    if (posix_spawnp(&pid, args[0], &fa, NULL, args, environ))
+        pid = -1;
+
+done:
+    posix_spawn_file_actions_destroy(&fa);
+    close(devnull);
+    return pid;
+}
+
+static int get_status(int status, bool killed_by_us, char **error)
+{
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 127) {
+        *error = "init";
+        status = -1;
+    } else if (WIFEXITED(status)) {
+        *error = NULL;
+        status = WEXITSTATUS(status);
+    } else {
+        *error = "killed";
+        status = killed_by_us ? MP_SUBPROCESS_EKILLED_BY_US : -1;
+    }
+    return status;
+}
+
+static int wait_status(pid_t pid, bool killed_by_us, char **error)
+{
+    int status = -1;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    return get_status(status, killed_by_us, error);
+}
+
 int mp_subprocess(char **args, struct mp_cancel *cancel, void *ctx,
                   subprocess_read_cb on_stdout, subprocess_read_cb on_stderr,
                   char **error)
 {
-    posix_spawn_file_actions_t fa;
-    bool fa_destroy = false;
     int status = -1;
     int p_stdout[2] = {-1, -1};
     int p_stderr[2] = {-1, -1};
-    int devnull = -1;
     pid_t pid = -1;
-    bool spawned = false;
     bool killed_by_us = false;
+    char *buf = NULL;
 
     if (on_stdout && mp_make_cloexec_pipe(p_stdout) < 0)
         goto done;
     if (on_stderr && mp_make_cloexec_pipe(p_stderr) < 0)
         goto done;
 
-    devnull = open("/dev/null", O_RDONLY | O_CLOEXEC);
-    if (devnull < 0)
-        goto done;
-
-    if (posix_spawn_file_actions_init(&fa))
-        goto done;
-    fa_destroy = true;
-    // redirect stdin/stdout/stderr
-    if (posix_spawn_file_actions_adddup2(&fa, devnull, 0))
-        goto done;
-    if (p_stdout[1] >= 0 && posix_spawn_file_actions_adddup2(&fa, p_stdout[1], 1))
-        goto done;
-    if (p_stderr[1] >= 0 && posix_spawn_file_actions_adddup2(&fa, p_stderr[1], 2))
-        goto done;
-
-    if (posix_spawnp(&pid, args[0], &fa, NULL, args, environ)) {
-        pid = -1;
+    pid = spawn(args, p_stdout[1], p_stderr[1]);
+    if (pid < 0)
         goto done;
-    }
-    spawned = true;
 
     SAFE_CLOSE(p_stdout[1]);
     SAFE_CLOSE(p_stderr[1]);
-    SAFE_CLOSE(devnull);
+
+    // Large reads, so that big outputs (like youtube-dl's JSON for long
+    // playlists) need few syscalls and callback invocations.
+    buf = talloc_size(NULL, SUBPROCESS_READ_SIZE);
 
     int *read_fds[2] = {&p_stdout[0], &p_stderr[0]};
     subprocess_read_cb read_cbs[2] = {on_stdout, on_stderr};
@@ -112,8 +154,7 @@ int mp_subprocess(char **args, struct mp_cancel *cancel, void *ctx,
             break;
         for (int n = 0; n < 2; n++) {
             if (fds[n].revents) {
-                char buf[4096];
-                ssize_t r = read(*read_fds[n], buf, sizeof(buf));
+                ssize_t r = read(*read_fds[n], buf, SUBPROCESS_READ_SIZE);
                 if (r < 0 && errno == EINTR)
                     continue;
                 if (r > 0 && read_cbs[n])
@@ -133,27 +174,45 @@ int mp_subprocess(char **args, struct mp_cancel *cancel, void *ctx,
     //       terminate yet. In this case, we would have to run waitpid() in
     //       a separate thread and use pthread_cancel(), or use other weird
     //       and laborious tricks. So this isn't handled yet.
-    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    status = wait_status(pid, killed_by_us, error);
 
 done:
-    if (fa_destroy)
-        posix_spawn_file_actions_destroy(&fa);
+    talloc_free(buf);
     SAFE_CLOSE(p_stdout[0]);
     SAFE_CLOSE(p_stdout[1]);
     SAFE_CLOSE(p_stderr[0]);
     SAFE_CLOSE(p_stderr[1]);
-    SAFE_CLOSE(devnull);
 
-    if (!spawned || (WIFEXITED(status) && WEXITSTATUS(status) == 127)) {
+    if (pid < 0)
         *error = "init";
-        status = -1;
-    } else if (WIFEXITED(status)) {
-        *error = NULL;
-        status = WEXITSTATUS(status);
-    } else {
-        *error = "killed";
-        status = killed_by_us ? MP_SUBPROCESS_EKILLED_BY_US : -1;
-    }
 
     return status;
 }
+
+int mp_subprocess_spawn_pipe(char **args, int64_t *pid)
+{
+    int p[2];
+    if (mp_make_cloexec_pipe(p) < 0)
+        return -1;
+    pid_t r = spawn(args, p[1], -1);
+    close(p[1]);
+    if (r < 0) {
+        close(p[0]);
+        return -1;
+    }
+    *pid = r;
+    return p[0];
+}
+
+int mp_subprocess_wait(int64_t pid, bool kill_it, char **error)
+{
+    if (kill_it) {
+        // Don't report processes that exited on their own as killed.
+        int status;
+        if (waitpid(pid, &status, WNOHANG) == pid)
+            return get_status(status, false, error);
+        // Not reaped yet, so this can't hit a reused PID.
+        kill(pid, SIGKILL);
+    }
+    return wait_status(pid, kill_it, error);
+}
@@ -357,3 +357,15 @@ done:
     talloc_free(tmp);
     return status;
 }
+
+// Not implemented: file descriptors of pipes are not inheritable handles.
+int mp_subprocess_spawn_pipe(char **args, int64_t *pid)
+{
+    return -1;
+}
+
+int mp_subprocess_wait(int64_t pid, bool kill_it, char **error)
+{
+    *error = "unsupported";
+    return -1;
+}
@@ -18,7 +18,9 @@
 #ifndef MP_SUBPROCESS_H_
 #define MP_SUBPROCESS_H_
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 struct mp_cancel;
 
@@ -33,6 +35,14 @@ int mp_subprocess(char **args, struct mp_cancel *cancel, void *ctx,
 // mp_subprocess return values. -1 is a generic error code.
 #define MP_SUBPROCESS_EKILLED_BY_US -2
 
+// Start a subprocess with stdout redirected to a pipe, and return the read end
+// of the pipe (or -1 on error). stdin is /dev/null, and stderr is inherited.
+// The caller must close the FD and call mp_subprocess_wait(*pid, ...).
+int mp_subprocess_spawn_pipe(char **args, int64_t *pid);
+// Wait until the process started with mp_subprocess_spawn_pipe() exits, and
+// return its status like mp_subprocess(). If kill_it is set, kill it first.
+int mp_subprocess_wait(int64_t pid, bool kill_it, char **error);
+
 struct mp_log;
 void mp_subprocess_detached(struct mp_log *log, char **args);
 
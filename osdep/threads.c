@@ -18,9 +18,23 @@
 #include <stdio.h>
 #include <errno.h>
 #include <pthread.h>
+#include <sched.h>
 
 #include "config.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#if HAVE_WIN32_DESKTOP
+#include <avrt.h>
+#endif
+#endif
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
 #include "threads.h"
 #include "timer.h"
 
@@ -49,3 +63,58 @@ void mpthread_set_name(const char *name)
     pthread_setname_np(tname);
 #endif
 }
+
+int mpthread_set_priority(enum mp_thread_priority prio, int rt_level)
+{
+    if (prio == MP_THREAD_PRIO_DEFAULT)
+        return 0;
+#ifdef _WIN32
+    int level = THREAD_PRIORITY_NORMAL;
+    switch (prio) {
+    case MP_THREAD_PRIO_LOW:        level = THREAD_PRIORITY_BELOW_NORMAL; break;
+    case MP_THREAD_PRIO_HIGH:       level = THREAD_PRIORITY_HIGHEST; break;
+    case MP_THREAD_PRIO_REALTIME:
+#if HAVE_WIN32_DESKTOP
+        // MMCSS boosts the thread without requiring special privileges.
+        if (AvSetMmThreadCharacteristicsW(L"Pro Audio", &(DWORD){0}))
+            return 0;
+#endif
+        level = THREAD_PRIORITY_TIME_CRITICAL;
+        break;
+    }
+    return SetThreadPriority(GetCurrentThread(), level) ? 0 : EPERM;
+#else
+    if (prio == MP_THREAD_PRIO_REALTIME) {
+        // Requires CAP_SYS_NICE or a sufficient RLIMIT_RTPRIO on Linux.
+        struct sched_param param = {.sched_priority = rt_level};
+        return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    }
+#ifdef __linux__
+    // Linux applies nice values per thread. Negative values require
+    // CAP_SYS_NICE or a sufficient RLIMIT_NICE.
+    int nice = prio == MP_THREAD_PRIO_LOW ? 10 : -10;
+    if (setpriority(PRIO_PROCESS, syscall(SYS_gettid), nice) < 0)
+        return errno;
+    return 0;
+#else
+    return ENOSYS;
+#endif
+#endif
+}
+
+int mpthread_set_affinity(uint64_t mask)
+{
+#if HAVE_PTHREAD_SETAFFINITY
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int n = 0; n < 64 && n < CPU_SETSIZE; n++) {
+        if (mask & (1ULL << n))
+            CPU_SET(n, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#elif defined(_WIN32)
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)mask) ? 0 : EINVAL;
+#else
+    return ENOSYS;
+#endif
+}
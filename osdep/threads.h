@@ -10,4 +10,20 @@ int mpthread_mutex_init_recursive(pthread_mutex_t *mutex);
 // Set thread name (for debuggers).
 void mpthread_set_name(const char *name);
 
+enum mp_thread_priority {
+    MP_THREAD_PRIO_DEFAULT,
+    MP_THREAD_PRIO_LOW,
+    MP_THREAD_PRIO_HIGH,
+    MP_THREAD_PRIO_REALTIME,
+};
+
+// Set the scheduling priority of the calling thread. rt_level is the priority
+// for MP_THREAD_PRIO_REALTIME (1-99, like SCHED_FIFO). Returns 0 on success,
+// or an errno value.
+int mpthread_set_priority(enum mp_thread_priority prio, int rt_level);
+
+// Restrict the calling thread to the CPUs with the bits set in mask (bit 0 is
+// the first CPU). Returns 0 on success, or an errno value.
+int mpthread_set_affinity(uint64_t mask);
+
 #endif
@@ -41,6 +41,11 @@ uint64_t mp_raw_time_us(void)
     return mach_absolute_time() * timebase_ratio * 1e6;
 }
 
+void mp_raw_sleep_until_us(uint64_t deadline)
+{
+    mach_wait_until(deadline / 1e6 / timebase_ratio);
+}
+
 void mp_raw_time_init(void)
 {
     struct mach_timebase_info timebase;
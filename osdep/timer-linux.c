@@ -20,6 +20,7 @@
 
 #include <unistd.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <time.h>
 #include <sys/time.h>
 #include "config.h"
@@ -52,6 +53,17 @@ uint64_t mp_raw_time_us(void)
         abort();
     return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
 }
+
+void mp_raw_sleep_until_us(uint64_t deadline)
+{
+    struct timespec ts = {
+        .tv_sec = deadline / 1000000,
+        .tv_nsec = (deadline % 1000000) * 1000,
+    };
+    // Restarting after a signal is fine, since the deadline is absolute.
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
 #else
 uint64_t mp_raw_time_us(void)
 {
@@ -59,6 +71,13 @@ uint64_t mp_raw_time_us(void)
     gettimeofday(&tv,NULL);
     return tv.tv_sec * 1000000LL + tv.tv_usec;
 }
+
+void mp_raw_sleep_until_us(uint64_t deadline)
+{
+    int64_t now = mp_raw_time_us();
+    if (deadline > now)
+        mp_sleep_us(deadline - now);
+}
 #endif
 
 void mp_raw_time_init(void)
@@ -23,6 +23,10 @@
 
 #include "config.h"
 
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
 static LARGE_INTEGER perf_freq;
 
 void mp_sleep_us(int64_t us)
@@ -49,6 +53,29 @@ uint64_t mp_raw_time_us(void)
         perf_count.QuadPart % perf_freq.QuadPart * 1000000 / perf_freq.QuadPart;
 }
 
+void mp_raw_sleep_until_us(uint64_t deadline)
+{
+    uint64_t now = mp_raw_time_us();
+    if (deadline <= now)
+        return;
+    // High resolution timers are supported since Windows 10 1803. Waitable
+    // timers don't take QPC deadlines, so the deadline is made relative here.
+    HANDLE timer = CreateWaitableTimerExW(NULL, NULL,
+                        CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (!timer)
+        timer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+    if (!timer) {
+        mp_sleep_us(deadline - now);
+        return;
+    }
+    // Negative values are relative, in 100 ns units.
+    int64_t remaining = (int64_t)(deadline - mp_raw_time_us());
+    LARGE_INTEGER due = {.QuadPart = -remaining * 10};
+    if (remaining > 0 && SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE))
+        WaitForSingleObject(timer, INFINITE);
+    CloseHandle(timer);
+}
+
 void mp_raw_time_init(void)
 {
     QueryPerformanceFrequency(&perf_freq);
@@ -54,6 +54,33 @@ int64_t mp_time_us(void)
     return r;
 }
 
+int64_t mp_time_from_raw_us(uint64_t raw)
+{
+    return (int64_t)(raw - raw_time_offset);
+}
+
+void mp_sleep_until_us(int64_t deadline)
+{
+    if (deadline > mp_time_us())
+        mp_raw_sleep_until_us(deadline + raw_time_offset);
+}
+
+static inline void cpu_relax(void)
+{
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    __asm__ volatile("pause");
+#elif defined(__GNUC__) && defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+void mp_sleep_until_spin_us(int64_t deadline, int64_t spin_us)
+{
+    mp_sleep_until_us(deadline - MPMAX(spin_us, 0));
+    while (mp_time_us() < deadline)
+        cpu_relax();
+}
+
 double mp_time_sec(void)
 {
     return mp_time_us() / (double)(1000 * 1000);
@@ -33,10 +33,27 @@ double mp_time_sec(void);
 // Provided by OS specific functions (timer-linux.c)
 void mp_raw_time_init(void);
 uint64_t mp_raw_time_us(void);
+// Sleep until the given mp_raw_time_us() time. Uses an absolute deadline if
+// the OS supports it.
+void mp_raw_sleep_until_us(uint64_t deadline);
+
+// Convert a timestamp on the mp_raw_time_us() clock (e.g. as reported by
+// the OS or the graphics driver, if they use the same clock) to mp_time_us().
+int64_t mp_time_from_raw_us(uint64_t raw);
 
 // Sleep in microseconds.
 void mp_sleep_us(int64_t us);
 
+// Sleep until the given mp_time_us() time. Unlike mp_sleep_us() with a
+// relative time, the wakeup time doesn't shift if the thread is preempted
+// before going to sleep, and the OS's high resolution timers are used.
+void mp_sleep_until_us(int64_t deadline);
+
+// Like mp_sleep_until_us(), but sleep only until spin_us before the deadline,
+// and busy-wait for the rest. This avoids most of the wakeup latency of the
+// OS scheduler, at the cost of burning CPU time.
+void mp_sleep_until_spin_us(int64_t deadline, int64_t spin_us);
+
 #define MP_START_TIME 10000000
 
 // Return the amount of time that has passed since the last call, in
@@ -55,6 +55,9 @@ enum {
     AD_STARVE = -6,
 };
 
+// How much audio of the next playlist entry is decoded ahead.
+#define PRELOAD_AUDIO_SECS 2.0
+
 #if HAVE_LIBAF
 
 #include "audio/audio.h"
@@ -601,23 +604,63 @@ init_error:
     error_on_track(mpctx, track);
 }
 
-int init_audio_decoder(struct MPContext *mpctx, struct track *track)
+static struct dec_audio *create_audio_decoder(struct MPContext *mpctx,
+                                              struct sh_stream *sh,
+                                              double max_buffered)
 {
-    assert(!track->d_audio);
-    if (!track->stream)
-        goto init_error;
-
-    track->d_audio = talloc_zero(NULL, struct dec_audio);
-    struct dec_audio *d_audio = track->d_audio;
+    struct dec_audio *d_audio = talloc_zero(NULL, struct dec_audio);
+    ta_set_account(d_audio, MP_MEM_DECODER);
     d_audio->log = mp_log_new(d_audio, mpctx->log, "!ad");
     d_audio->global = mpctx->global;
     d_audio->opts = mpctx->opts;
-    d_audio->header = track->stream;
-    d_audio->codec = track->stream->codec;
+    d_audio->header = sh;
+    d_audio->codec = sh->codec;
 
     d_audio->try_spdif = true;
 
-    if (!audio_init_best_codec(d_audio))
+    if (!audio_init_best_codec(d_audio)) {
+        audio_uninit(d_audio);
+        return NULL;
+    }
+
+    // Decoding on a thread needs a thread-safe packet source.
+    if (mpctx->opts->audio_decoder_thread && mpctx->opts->demuxer_thread)
+        audio_start_thread(d_audio, max_buffered, mp_wakeup_core_cb, mpctx);
+
+    return d_audio;
+}
+
+// Open a decoder for sh (a stream of a demuxer that is not playing yet), and
+// with --audio-decoder-thread, start decoding it ahead, so that the audio of
+// the next playlist entry is available right when the current one ends.
+struct dec_audio *preload_audio_decoder(struct MPContext *mpctx,
+                                        struct sh_stream *sh)
+{
+    return create_audio_decoder(mpctx, sh, PRELOAD_AUDIO_SECS);
+}
+
+void uninit_preloaded_audio_decoder(struct MPContext *mpctx)
+{
+    audio_uninit(mpctx->preloaded_audio_decoder);
+    mpctx->preloaded_audio_decoder = NULL;
+}
+
+int init_audio_decoder(struct MPContext *mpctx, struct track *track)
+{
+    assert(!track->d_audio);
+    if (!track->stream)
+        goto init_error;
+
+    struct dec_audio *preloaded = mpctx->preloaded_audio_decoder;
+    if (preloaded && preloaded->header == track->stream) {
+        MP_VERBOSE(mpctx, "Using preloaded audio decoder.\n");
+        mpctx->preloaded_audio_decoder = NULL;
+        track->d_audio = preloaded;
+        return 1;
+    }
+
+    track->d_audio = create_audio_decoder(mpctx, track->stream, 0.5);
+    if (!track->d_audio)
         goto init_error;
 
     return 1;
@@ -1311,6 +1354,13 @@ void fill_audio_out_buffers(struct MPContext *mpctx)
     assert(played >= 0 && played <= samples);
     mp_audio_buffer_skip(ao_c->ao_buffer, played);
 
+    if (played > 0) {
+        int bucket = 0;
+        for (int ms = ao_get_delay(mpctx->ao) * 1000; ms > 1; ms >>= 1)
+            bucket++;
+        ao_c->latency_hist[MPMIN(bucket, AUDIO_LATENCY_HIST_BUCKETS - 1)]++;
+    }
+
     mpctx->audio_drop_throttle =
         MPMAX(0, mpctx->audio_drop_throttle - played / play_samplerate);
 
@@ -31,6 +31,7 @@
 #include "input/cmd_list.h"
 #include "misc/ctype.h"
 #include "misc/dispatch.h"
+#include "misc/node.h"
 #include "misc/rendezvous.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
@@ -60,9 +61,34 @@
  *
  */
 
+// Simple numeric properties, which clients typically poll. If they're used,
+// the playloop publishes their values once per iteration, and
+// mpv_get_property() reads them without locking the core.
+static const char *const snapshot_props[] = {
+    "time-pos",
+    "playback-time",
+    "percent-pos",
+    "time-remaining",
+    "playtime-remaining",
+    "duration",
+    "demuxer-cache-duration",
+    "demuxer-cache-time",
+};
+
+#define NUM_SNAPSHOT_PROPS MP_ARRAY_SIZE(snapshot_props)
+
 struct mp_client_api {
     struct MPContext *mpctx;
 
+    // -- lock-free snapshot of snapshot_props[] (written by the core only)
+    atomic_bool snapshot_used;      // a client read a snapshot property
+    atomic_uint snapshot_seq;       // odd while updating, 0 if never updated
+    atomic_int snapshot_status[NUM_SNAPSHOT_PROPS];     // M_PROPERTY_* code
+    atomic_ullong snapshot_values[NUM_SNAPSHOT_PROPS];  // double bit pattern
+
+    // A client has a rate limited property change waiting (property_deadline).
+    atomic_bool have_property_deadlines;
+
     pthread_mutex_t lock;
 
     // -- protected by lock
@@ -74,6 +100,21 @@ struct mp_client_api {
 
     struct mp_custom_protocol *custom_protocols;
     int num_custom_protocols;
+
+    // -- protected by shared_lock (must not be held while calling out)
+    // Values of properties observed with MPV_FORMAT_NODE, shared by all
+    // clients observing them, until the property is notified as changed.
+    pthread_mutex_t shared_lock;
+    struct shared_value *shared_values;
+    int num_shared_values;
+    uint64_t shared_gen;        // incremented on each invalidation
+};
+
+struct shared_value {
+    char *name;
+    int id;                     // ==mp_get_property_id(name)
+    uint64_t event_mask;        // ==mp_get_property_event_mask(name)
+    struct mp_shared_node *node;
 };
 
 struct observe_property {
@@ -86,8 +127,12 @@ struct observe_property {
     bool need_new_value;    // a new value should be retrieved
     bool updating;          // a new value is being retrieved
     bool dead;              // property unobserved while retrieving value
+    int64_t min_interval;   // in microseconds, 0 if not rate limited
+    int64_t last_update;    // mp_time_us() when the last update was started
     bool new_value_valid, user_value_valid;
+    // With MPV_FORMAT_NODE, these are shallow copies of new/user_node.
     union m_option_value new_value, user_value;
+    struct mp_shared_node *new_node, *user_node;
     struct mpv_handle *client;
 };
 
@@ -121,17 +166,27 @@ struct mpv_handle {
     int suspend_count;
 
     mpv_event *events;      // ringbuffer of max_events entries
+    int64_t *event_times;   // mp_time_us() at which each entry was queued
     int max_events;         // allocated number of entries in events
+    int event_limit;        // max_events can grow up to this
     int first_event;        // events[first_event] is the first readable event
     int num_events;         // number of readable events
     int reserved_events;    // number of entries reserved for replies
     bool choked;            // recovering from queue overflow
 
+    // Event queue statistics (client-event-stats property)
+    int max_queued;
+    int64_t dropped_events;
+    int64_t coalesced_events;
+    int64_t wait_time_total, wait_time_max; // in microseconds
+    int64_t num_read_events;
+
     struct observe_property **properties;
     int num_properties;
     int lowest_changed;     // attempt at making change processing incremental
     int properties_updating;
     uint64_t property_event_masks; // or-ed together event masks of all properties
+    int64_t property_deadline; // earliest deferred rate limited change, or 0
 
     bool fuzzy_initialized; // see scripting.c wait_loaded()
     struct mp_log_buffer *messages;
@@ -149,6 +204,31 @@ void mp_clients_init(struct MPContext *mpctx)
     };
     mpctx->global->client_api = mpctx->clients;
     pthread_mutex_init(&mpctx->clients->lock, NULL);
+    pthread_mutex_init(&mpctx->clients->shared_lock, NULL);
+}
+
+static void free_shared_value(struct shared_value *v)
+{
+    talloc_free(v->name);
+    mp_shared_node_unref(v->node);
+}
+
+// Drop the shared values of properties with the given ID (if >= 0), or with
+// any of the events in event_mask.
+static void invalidate_shared_values(struct mp_client_api *clients, int id,
+                                     uint64_t event_mask)
+{
+    pthread_mutex_lock(&clients->shared_lock);
+    clients->shared_gen++;
+    for (int n = clients->num_shared_values - 1; n >= 0; n--) {
+        struct shared_value *v = &clients->shared_values[n];
+        if ((id >= 0 && v->id == id) || (v->event_mask & event_mask)) {
+            free_shared_value(v);
+            MP_TARRAY_REMOVE_AT(clients->shared_values,
+                                clients->num_shared_values, n);
+        }
+    }
+    pthread_mutex_unlock(&clients->shared_lock);
 }
 
 void mp_clients_destroy(struct MPContext *mpctx)
@@ -156,6 +236,10 @@ void mp_clients_destroy(struct MPContext *mpctx)
     if (!mpctx->clients)
         return;
     assert(mpctx->clients->num_clients == 0);
+    for (int n = 0; n < mpctx->clients->num_shared_values; n++)
+        free_shared_value(&mpctx->clients->shared_values[n]);
+    talloc_free(mpctx->clients->shared_values);
+    pthread_mutex_destroy(&mpctx->clients->shared_lock);
     pthread_mutex_destroy(&mpctx->clients->lock);
     talloc_free(mpctx->clients);
     mpctx->clients = NULL;
@@ -240,16 +324,22 @@ struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name
         return NULL;
     }
 
-    int num_events = 1000;
+    int event_limit = 1000;
+    mp_read_option_raw(clients->mpctx->global, "client-event-queue-size",
+                       &m_option_type_int, &event_limit);
+    int num_events = MPMIN(event_limit, 16); // grows on demand
 
     struct mpv_handle *client = talloc_ptrtype(NULL, client);
+    ta_set_account(client, MP_MEM_CLIENT);
     *client = (struct mpv_handle){
         .log = mp_log_new(client, clients->mpctx->log, nname),
         .mpctx = clients->mpctx,
         .clients = clients,
         .cur_event = talloc_zero(client, struct mpv_event),
         .events = talloc_array(client, mpv_event, num_events),
+        .event_times = talloc_array(client, int64_t, num_events),
         .max_events = num_events,
+        .event_limit = event_limit,
         .event_mask = (1ULL << INTERNAL_EVENT_BASE) - 1, // exclude internal events
         .wakeup_pipe = {-1, -1},
     };
@@ -555,6 +645,34 @@ static void dup_event_data(struct mpv_event *ev)
     }
 }
 
+// Make sure there is room for at least 1 more entry in the ring buffer,
+// growing it up to ctx->event_limit entries.
+// Called with ctx->lock held.
+static bool make_event_room(struct mpv_handle *ctx)
+{
+    int used = ctx->num_events + ctx->reserved_events;
+    if (used < ctx->max_events)
+        return true;
+    if (ctx->max_events >= ctx->event_limit)
+        return false;
+
+    int new_max = MPMIN(ctx->max_events * 2LL, ctx->event_limit);
+    mpv_event *events = talloc_array(ctx, mpv_event, new_max);
+    int64_t *times = talloc_array(ctx, int64_t, new_max);
+    for (int n = 0; n < ctx->num_events; n++) {
+        int i = (ctx->first_event + n) % ctx->max_events;
+        events[n] = ctx->events[i];
+        times[n] = ctx->event_times[i];
+    }
+    talloc_free(ctx->events);
+    talloc_free(ctx->event_times);
+    ctx->events = events;
+    ctx->event_times = times;
+    ctx->max_events = new_max;
+    ctx->first_event = 0;
+    return true;
+}
+
 // Reserve an entry in the ring buffer. This can be used to guarantee that the
 // reply can be made, even if the buffer becomes congested _after_ sending
 // the request.
@@ -563,8 +681,7 @@ static int reserve_reply(struct mpv_handle *ctx)
 {
     int res = MPV_ERROR_EVENT_QUEUE_FULL;
     pthread_mutex_lock(&ctx->lock);
-    if (ctx->reserved_events + ctx->num_events < ctx->max_events && !ctx->choked)
-    {
+    if (!ctx->choked && make_event_room(ctx)) {
         ctx->reserved_events++;
         res = 0;
     }
@@ -572,14 +689,46 @@ static int reserve_reply(struct mpv_handle *ctx)
     return res;
 }
 
+// Events without data that can be merged with an identical event which is
+// still queued (the client can't tell the difference).
+static bool can_coalesce_event(struct mpv_handle *ctx, struct mpv_event *event)
+{
+    switch (event->event_id) {
+    case MPV_EVENT_TICK:
+    case MPV_EVENT_VIDEO_RECONFIG:
+    case MPV_EVENT_AUDIO_RECONFIG:
+    case MPV_EVENT_METADATA_UPDATE:
+    case MPV_EVENT_CHAPTER_CHANGE:
+    case MPV_EVENT_TRACKS_CHANGED:
+    case MPV_EVENT_TRACK_SWITCHED:
+        break;
+    default:
+        return false;
+    }
+    if (!ctx->num_events || event->data || event->reply_userdata || event->error)
+        return false;
+    int last = (ctx->first_event + ctx->num_events - 1) % ctx->max_events;
+    struct mpv_event *prev = &ctx->events[last];
+    return prev->event_id == event->event_id && !prev->data &&
+           !prev->reply_userdata && !prev->error;
+}
+
 static int append_event(struct mpv_handle *ctx, struct mpv_event event, bool copy)
 {
-    if (ctx->num_events + ctx->reserved_events >= ctx->max_events)
+    if (can_coalesce_event(ctx, &event)) {
+        ctx->coalesced_events++;
+        wakeup_client(ctx);
+        return 0;
+    }
+    if (!make_event_room(ctx))
         return -1;
     if (copy)
         dup_event_data(&event);
-    ctx->events[(ctx->first_event + ctx->num_events) % ctx->max_events] = event;
+    int i = (ctx->first_event + ctx->num_events) % ctx->max_events;
+    ctx->events[i] = event;
+    ctx->event_times[i] = mp_time_us();
     ctx->num_events++;
+    ctx->max_queued = MPMAX(ctx->max_queued, ctx->num_events);
     wakeup_client(ctx);
     return 0;
 }
@@ -594,11 +743,13 @@ static int send_event(struct mpv_handle *ctx, struct mpv_event *event, bool copy
     if (!(ctx->event_mask & mask)) {
         r = 0;
     } else if (ctx->choked) {
+        ctx->dropped_events++;
         r = -1;
     } else {
         r = append_event(ctx, *event, copy);
         if (r < 0) {
             MP_ERR(ctx, "Too many events queued.\n");
+            ctx->dropped_events++;
             ctx->choked = true;
         }
     }
@@ -658,6 +809,8 @@ void mp_client_broadcast_event(struct MPContext *mpctx, int event, void *data)
 {
     struct mp_client_api *clients = mpctx->clients;
 
+    invalidate_shared_values(clients, -1, 1ULL << event);
+
     pthread_mutex_lock(&clients->lock);
 
     for (int n = 0; n < clients->num_clients; n++) {
@@ -689,6 +842,8 @@ int mp_client_send_event(struct MPContext *mpctx, const char *client_name,
         .data = data,
     };
 
+    invalidate_shared_values(clients, -1, 1ULL << event);
+
     pthread_mutex_lock(&clients->lock);
 
     struct mpv_handle *ctx = find_client(clients, client_name);
@@ -770,6 +925,10 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
         }
         if (ctx->num_events) {
             *event = ctx->events[ctx->first_event];
+            int64_t wait = mp_time_us() - ctx->event_times[ctx->first_event];
+            ctx->wait_time_total += wait;
+            ctx->wait_time_max = MPMAX(ctx->wait_time_max, wait);
+            ctx->num_read_events++;
             ctx->first_event = (ctx->first_event + 1) % ctx->max_events;
             ctx->num_events--;
             talloc_steal(event, event->data);
@@ -996,6 +1155,8 @@ static int run_client_command(mpv_handle *ctx, struct mp_cmd *cmd, mpv_node *res
         mp_abort_playback_async(ctx->mpctx);
 
     cmd->sender = ctx->name;
+    if (!cmd->arrival_time)
+        cmd->arrival_time = mp_time_us();
 
     struct cmd_request req = {
         .mpctx = ctx->mpctx,
@@ -1020,10 +1181,89 @@ int mpv_command_node(mpv_handle *ctx, mpv_node *args, mpv_node *result)
     return r;
 }
 
+struct batch_request {
+    struct MPContext *mpctx;
+    struct mp_cmd **cmds;
+    int num_cmds;
+    struct mpv_node *res;
+    int *status;
+};
+
+static void batch_fn(void *data)
+{
+    struct batch_request *req = data;
+    for (int n = 0; n < req->num_cmds; n++) {
+        int r = run_command(req->mpctx, req->cmds[n], &req->res[n]);
+        req->status[n] = r >= 0 ? 0 : MPV_ERROR_COMMAND;
+    }
+}
+
+int mpv_command_batch(mpv_handle *ctx, mpv_node *cmds, mpv_node *result)
+{
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (cmds->format != MPV_FORMAT_NODE_ARRAY)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    void *tmp = talloc_new(NULL);
+    int num = cmds->u.list->num;
+    struct batch_request req = {
+        .mpctx = ctx->mpctx,
+        .cmds = talloc_zero_array(tmp, struct mp_cmd *, num),
+        .num_cmds = num,
+        .res = talloc_zero_array(tmp, struct mpv_node, num),
+        .status = talloc_zero_array(tmp, int, num),
+    };
+
+    // Parse everything first, so that a malformed entry doesn't leave the
+    // batch half-applied.
+    bool abort = false;
+    for (int n = 0; n < num; n++) {
+        struct mp_cmd *cmd =
+            mp_input_parse_cmd_node(ctx->log, &cmds->u.list->values[n]);
+        if (!cmd) {
+            talloc_free(tmp);
+            return MPV_ERROR_INVALID_PARAMETER;
+        }
+        talloc_steal(tmp, cmd);
+        cmd->sender = ctx->name;
+        abort |= mp_input_is_abort_cmd(cmd);
+        req.cmds[n] = cmd;
+    }
+
+    if (abort)
+        mp_abort_playback_async(ctx->mpctx);
+
+    run_locked(ctx, batch_fn, &req);
+
+    int err = 0;
+    struct mpv_node rn;
+    node_init(&rn, MPV_FORMAT_NODE_ARRAY, NULL);
+    for (int n = 0; n < num; n++) {
+        struct mpv_node *entry = node_array_add(&rn, MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(entry, "error", req.status[n]);
+        if (req.res[n].format != MPV_FORMAT_NONE) {
+            talloc_steal(entry->u.list, node_get_alloc(&req.res[n]));
+            *node_map_add(entry, "data", MPV_FORMAT_NONE) = req.res[n];
+        }
+        if (!err)
+            err = req.status[n];
+    }
+    talloc_free(tmp);
+
+    if (result) {
+        *result = rn;
+    } else {
+        mpv_free_node_contents(&rn);
+    }
+    return err;
+}
+
 int mpv_command_string(mpv_handle *ctx, const char *args)
 {
     return run_client_command(ctx,
-        mp_input_parse_cmd(ctx->mpctx->input, bstr0((char*)args), ctx->name), NULL);
+        mp_input_parse_cmd_cached(ctx->mpctx->input, bstr0((char*)args),
+                                  ctx->name), NULL);
 }
 
 static int run_cmd_async(mpv_handle *ctx, uint64_t ud, struct mp_cmd *cmd)
@@ -1259,6 +1499,84 @@ static void getproperty_fn(void *arg)
     }
 }
 
+union snapshot_value {
+    double d;
+    unsigned long long i;
+};
+
+// Called by the playloop once per iteration.
+void mp_client_update_snapshot(struct MPContext *mpctx)
+{
+    struct mp_client_api *clients = mpctx->clients;
+    if (!atomic_load(&clients->snapshot_used))
+        return;
+
+    int status[NUM_SNAPSHOT_PROPS];
+    union snapshot_value values[NUM_SNAPSHOT_PROPS] = {{0}};
+    for (int n = 0; n < NUM_SNAPSHOT_PROPS; n++) {
+        status[n] = mp_property_do(snapshot_props[n], M_PROPERTY_GET,
+                                   &values[n].d, mpctx);
+    }
+
+    // Seqlock: readers retry if the counter is odd or changed.
+    atomic_fetch_add(&clients->snapshot_seq, 1);
+    for (int n = 0; n < NUM_SNAPSHOT_PROPS; n++) {
+        atomic_store(&clients->snapshot_status[n], status[n]);
+        atomic_store(&clients->snapshot_values[n], values[n].i);
+    }
+    atomic_fetch_add(&clients->snapshot_seq, 1);
+}
+
+// If name is a snapshot property, read it without locking the core, and
+// return true (with *status set to the mpv_get_property() return value).
+static bool get_snapshot_property(struct mp_client_api *clients,
+                                  const char *name, mpv_format format,
+                                  void *data, int *status)
+{
+    if (format != MPV_FORMAT_DOUBLE && format != MPV_FORMAT_INT64 &&
+        format != MPV_FORMAT_NODE)
+        return false;
+
+    int index = -1;
+    for (int n = 0; n < NUM_SNAPSHOT_PROPS; n++) {
+        if (strcmp(snapshot_props[n], name) == 0)
+            index = n;
+    }
+    if (index < 0)
+        return false;
+
+    if (!atomic_load(&clients->snapshot_used)) {
+        // Start publishing; until then, read it the normal way.
+        atomic_store(&clients->snapshot_used, true);
+        return false;
+    }
+
+    int err;
+    union snapshot_value v;
+    while (1) {
+        unsigned int seq = atomic_load(&clients->snapshot_seq);
+        if (!seq)
+            return false;
+        if (seq & 1)
+            continue;
+        err = atomic_load(&clients->snapshot_status[index]);
+        v.i = atomic_load(&clients->snapshot_values[index]);
+        if (atomic_load(&clients->snapshot_seq) == seq)
+            break;
+    }
+
+    if (err == M_PROPERTY_OK) {
+        mpv_node node = {.format = MPV_FORMAT_DOUBLE, .u.double_ = v.d};
+        if (format == MPV_FORMAT_NODE) {
+            *(mpv_node *)data = node;
+        } else if (!conv_node_to_format(data, format, &node)) {
+            err = M_PROPERTY_INVALID_FORMAT;
+        }
+    }
+    *status = translate_property_error(err);
+    return true;
+}
+
 int mpv_get_property(mpv_handle *ctx, const char *name, mpv_format format,
                      void *data)
 {
@@ -1269,6 +1587,10 @@ int mpv_get_property(mpv_handle *ctx, const char *name, mpv_format format,
     if (!get_mp_type_get(format))
         return MPV_ERROR_PROPERTY_FORMAT;
 
+    int status;
+    if (get_snapshot_property(ctx->clients, name, format, data, &status))
+        return status;
+
     struct getproperty_request req = {
         .mpctx = ctx->mpctx,
         .name = name,
@@ -1316,7 +1638,10 @@ static void property_free(void *p)
 {
     struct observe_property *prop = p;
     const struct m_option *type = get_mp_type_get(prop->format);
-    if (type) {
+    if (prop->format == MPV_FORMAT_NODE) {
+        mp_shared_node_unref(prop->new_node);
+        mp_shared_node_unref(prop->user_node);
+    } else if (type) {
         m_option_free(type, &prop->new_value);
         m_option_free(type, &prop->user_value);
     }
@@ -1325,6 +1650,15 @@ static void property_free(void *p)
 int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
                          const char *name, mpv_format format)
 {
+    return mpv_observe_property_interval(ctx, userdata, name, format, 0);
+}
+
+int mpv_observe_property_interval(mpv_handle *ctx, uint64_t userdata,
+                                  const char *name, mpv_format format,
+                                  double min_interval)
+{
+    if (!(min_interval >= 0) || min_interval > 3600)
+        return MPV_ERROR_INVALID_PARAMETER;
     if (format != MPV_FORMAT_NONE && !get_mp_type_get(format))
         return MPV_ERROR_PROPERTY_FORMAT;
     // Explicitly disallow this, because it would require a special code path.
@@ -1343,6 +1677,7 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
         .format = format,
         .changed = true,
         .need_new_value = true,
+        .min_interval = min_interval * 1e6,
     };
     MP_TARRAY_APPEND(ctx, ctx->properties, ctx->num_properties, prop);
     ctx->property_event_masks |= prop->event_mask;
@@ -1395,6 +1730,8 @@ void mp_client_property_change(struct MPContext *mpctx, const char *name)
     struct mp_client_api *clients = mpctx->clients;
     int id = mp_get_property_id(mpctx, name);
 
+    invalidate_shared_values(clients, id, 0);
+
     pthread_mutex_lock(&clients->lock);
 
     for (int n = 0; n < clients->num_clients; n++) {
@@ -1412,6 +1749,67 @@ void mp_client_property_change(struct MPContext *mpctx, const char *name)
     pthread_mutex_unlock(&clients->lock);
 }
 
+// Wake up clients whose rate limited property changes are due. Called by the
+// playloop; arranges that it runs again when the next one is due.
+void mp_client_wakeup_deferred(struct MPContext *mpctx)
+{
+    struct mp_client_api *clients = mpctx->clients;
+    if (!atomic_load(&clients->have_property_deadlines))
+        return;
+    atomic_store(&clients->have_property_deadlines, false);
+
+    int64_t now = mp_time_us();
+    int64_t next = INT64_MAX;
+
+    pthread_mutex_lock(&clients->lock);
+    for (int n = 0; n < clients->num_clients; n++) {
+        struct mpv_handle *client = clients->clients[n];
+        pthread_mutex_lock(&client->lock);
+        if (client->property_deadline) {
+            if (client->property_deadline <= now) {
+                client->property_deadline = 0;
+                wakeup_client(client);
+            } else {
+                next = MPMIN(next, client->property_deadline);
+            }
+        }
+        pthread_mutex_unlock(&client->lock);
+    }
+    pthread_mutex_unlock(&clients->lock);
+
+    if (next != INT64_MAX) {
+        atomic_store(&clients->have_property_deadlines, true);
+        mp_set_timeout(mpctx, (next - now) / 1e6);
+    }
+}
+
+void mp_client_get_event_stats(struct MPContext *mpctx, struct mpv_node *res)
+{
+    struct mp_client_api *clients = mpctx->clients;
+
+    node_init(res, MPV_FORMAT_NODE_ARRAY, NULL);
+
+    pthread_mutex_lock(&clients->lock);
+    for (int n = 0; n < clients->num_clients; n++) {
+        struct mpv_handle *ctx = clients->clients[n];
+        struct mpv_node *e = node_array_add(res, MPV_FORMAT_NODE_MAP);
+        pthread_mutex_lock(&ctx->lock);
+        node_map_add_string(e, "name", ctx->name);
+        node_map_add_int64(e, "queued", ctx->num_events);
+        node_map_add_int64(e, "queue-size", ctx->max_events);
+        node_map_add_int64(e, "queue-limit", ctx->event_limit);
+        node_map_add_int64(e, "max-queued", ctx->max_queued);
+        node_map_add_int64(e, "dropped", ctx->dropped_events);
+        node_map_add_int64(e, "coalesced", ctx->coalesced_events);
+        double avg = ctx->num_read_events ?
+                     ctx->wait_time_total / (double)ctx->num_read_events : 0;
+        node_map_add_double(e, "wait-avg", avg / 1e6);
+        node_map_add_double(e, "wait-max", ctx->wait_time_max / 1e6);
+        pthread_mutex_unlock(&ctx->lock);
+    }
+    pthread_mutex_unlock(&clients->lock);
+}
+
 // Mark properties as changed in reaction to specific events.
 // Called with ctx->lock held.
 static void notify_property_events(struct mpv_handle *ctx, uint64_t event_mask)
@@ -1424,6 +1822,57 @@ static void notify_property_events(struct mpv_handle *ctx, uint64_t event_mask)
         wakeup_client(ctx);
 }
 
+// Get the value of a property observed with MPV_FORMAT_NODE. The value is
+// reused for all observers of the property, until a change of the property is
+// notified. (Observers fetch new values only on notifications anyway.)
+// Returns NULL on failure.
+static struct mp_shared_node *get_shared_node(struct mpv_handle *ctx,
+                                              struct observe_property *prop)
+{
+    struct mp_client_api *clients = ctx->clients;
+
+    pthread_mutex_lock(&clients->shared_lock);
+    for (int n = 0; n < clients->num_shared_values; n++) {
+        struct shared_value *v = &clients->shared_values[n];
+        if (strcmp(v->name, prop->name) == 0) {
+            struct mp_shared_node *node = mp_shared_node_ref(v->node);
+            pthread_mutex_unlock(&clients->shared_lock);
+            return node;
+        }
+    }
+    uint64_t gen = clients->shared_gen;
+    pthread_mutex_unlock(&clients->shared_lock);
+
+    struct mpv_node val = {0};
+    struct getproperty_request req = {
+        .mpctx = ctx->mpctx,
+        .name = prop->name,
+        .format = MPV_FORMAT_NODE,
+        .data = &val,
+    };
+    getproperty_fn(&req);
+    if (req.status < 0)
+        return NULL;
+
+    struct mp_shared_node *node = mp_shared_node_new(&val);
+
+    pthread_mutex_lock(&clients->shared_lock);
+    // Don't cache values that might predate a change notification.
+    if (gen == clients->shared_gen && prop->id >= 0) {
+        struct shared_value v = {
+            .name = talloc_strdup(NULL, prop->name),
+            .id = prop->id,
+            .event_mask = prop->event_mask,
+            .node = mp_shared_node_ref(node),
+        };
+        MP_TARRAY_APPEND(NULL, clients->shared_values,
+                         clients->num_shared_values, v);
+    }
+    pthread_mutex_unlock(&clients->shared_lock);
+
+    return node;
+}
+
 static void update_prop(void *p)
 {
     struct observe_property *prop = p;
@@ -1431,6 +1880,7 @@ static void update_prop(void *p)
 
     const struct m_option *type = get_mp_type_get(prop->format);
     union m_option_value val = {0};
+    struct mp_shared_node *node = NULL;
 
     struct getproperty_request req = {
         .mpctx = ctx->mpctx,
@@ -1439,19 +1889,34 @@ static void update_prop(void *p)
         .data = &val,
     };
 
-    getproperty_fn(&req);
+    if (prop->format == MPV_FORMAT_NODE) {
+        node = get_shared_node(ctx, prop);
+        req.status = node ? 0 : -1;
+        if (node)
+            memcpy(&val, mp_shared_node_get(node), sizeof(struct mpv_node));
+    } else {
+        getproperty_fn(&req);
+    }
 
     pthread_mutex_lock(&ctx->lock);
     ctx->properties_updating--;
     prop->updating = false;
-    m_option_free(type, &prop->new_value);
+    if (prop->format == MPV_FORMAT_NODE) {
+        mp_shared_node_unref(prop->new_node);
+        prop->new_node = node;
+        prop->new_value = (union m_option_value){0};
+    } else {
+        m_option_free(type, &prop->new_value);
+    }
     prop->new_value_valid = req.status >= 0;
     if (prop->new_value_valid)
         memcpy(&prop->new_value, &val, type->type->size);
     if (prop->user_value_valid != prop->new_value_valid) {
         prop->changed = true;
     } else if (prop->user_value_valid && prop->new_value_valid) {
-        if (!compare_value(&prop->user_value, &prop->new_value, prop->format))
+        // (Shared values are compared only if they are different trees.)
+        if (!(prop->user_node && prop->user_node == prop->new_node) &&
+            !compare_value(&prop->user_value, &prop->new_value, prop->format))
             prop->changed = true;
     }
     if (prop->dead)
@@ -1468,10 +1933,29 @@ static bool gen_property_change_event(struct mpv_handle *ctx)
         return false;
     int start = ctx->lowest_changed;
     ctx->lowest_changed = ctx->num_properties;
+    int64_t now = 0;
     for (int n = start; n < ctx->num_properties; n++) {
         struct observe_property *prop = ctx->properties[n];
         if ((prop->changed || prop->updating) && n < ctx->lowest_changed)
             ctx->lowest_changed = n;
+        // Rate limiting is applied before the new value is retrieved (or the
+        // value-less change is signaled), so deferred changes cost nothing.
+        if (prop->changed && prop->min_interval &&
+            (prop->need_new_value || !prop->format))
+        {
+            if (!now)
+                now = mp_time_us();
+            int64_t due = prop->last_update + prop->min_interval;
+            if (now < due) {
+                if (!ctx->property_deadline || due < ctx->property_deadline) {
+                    ctx->property_deadline = due;
+                    atomic_store(&ctx->clients->have_property_deadlines, true);
+                    mp_wakeup_core(ctx->mpctx);
+                }
+                continue;
+            }
+            prop->last_update = now;
+        }
         if (prop->changed) {
             bool get_value = prop->need_new_value;
             prop->need_new_value = false;
@@ -1483,8 +1967,16 @@ static bool gen_property_change_event(struct mpv_handle *ctx)
             } else {
                 const struct m_option *type = get_mp_type_get(prop->format);
                 prop->user_value_valid = prop->new_value_valid;
-                if (prop->new_value_valid)
+                if (prop->format == MPV_FORMAT_NODE) {
+                    // Share the immutable tree instead of copying it.
+                    mp_shared_node_unref(prop->user_node);
+                    prop->user_node = NULL;
+                    prop->user_value = prop->new_value;
+                    if (prop->new_value_valid)
+                        prop->user_node = mp_shared_node_ref(prop->new_node);
+                } else if (prop->new_value_valid) {
                     m_option_copy(type, &prop->user_value, &prop->new_value);
+                }
                 ctx->cur_property_event = (struct mpv_event_property){
                     .name = prop->name,
                     .format = prop->user_value_valid ? prop->format : 0,
@@ -1722,6 +2214,11 @@ int mpv_opengl_cb_report_flip(mpv_opengl_cb_context *ctx, int64_t time)
 {
     return MPV_ERROR_NOT_IMPLEMENTED;
 }
+int mpv_opengl_cb_get_frame_info(mpv_opengl_cb_context *ctx,
+                                 mpv_opengl_cb_frame_info *info)
+{
+    return MPV_ERROR_NOT_IMPLEMENTED;
+}
 int mpv_opengl_cb_uninit_gl(mpv_opengl_cb_context *ctx)
 {
     return MPV_ERROR_NOT_IMPLEMENTED;
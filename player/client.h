@@ -29,6 +29,10 @@ int mp_client_send_event_dup(struct MPContext *mpctx, const char *client_name,
                              int event, void *data);
 bool mp_client_event_is_registered(struct MPContext *mpctx, int event);
 void mp_client_property_change(struct MPContext *mpctx, const char *name);
+void mp_client_update_snapshot(struct MPContext *mpctx);
+void mp_client_wakeup_deferred(struct MPContext *mpctx);
+struct mpv_node;
+void mp_client_get_event_stats(struct MPContext *mpctx, struct mpv_node *res);
 
 struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name);
 struct mp_log *mp_client_get_log(struct mpv_handle *ctx);
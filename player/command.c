@@ -56,7 +56,9 @@
 #include "video/decode/vd.h"
 #include "video/out/vo.h"
 #include "video/csputils.h"
+#include "audio/aconverter.h"
 #include "audio/aframe.h"
+#include "audio/audio_buffer.h"
 #include "audio/format.h"
 #include "audio/out/ao.h"
 #include "video/decode/dec_video.h"
@@ -64,6 +66,7 @@
 #include "video/out/bitmap_packer.h"
 #include "options/path.h"
 #include "screenshot.h"
+#include "misc/dispatch.h"
 #include "misc/node.h"
 
 #include "osdep/io.h"
@@ -82,6 +85,9 @@
 struct command_ctx {
     // All properties, terminated with a {0} item.
     struct m_property *properties;
+    // The same, sorted by name for find_property().
+    struct m_property **sorted_properties;
+    int num_properties;
 
     bool is_idle;
 
@@ -345,6 +351,48 @@ static char *format_delay(double time)
     return talloc_asprintf(NULL, "%d ms", (int)lrint(time * 1000));
 }
 
+static int compare_property(const void *pa, const void *pb)
+{
+    const struct m_property *a = *(const struct m_property **)pa;
+    const struct m_property *b = *(const struct m_property **)pb;
+    int r = strcmp(a->name, b->name);
+    // Keep list order for duplicates, so that the first entry wins.
+    return r ? r : (a > b) - (a < b);
+}
+
+static void sort_properties(struct command_ctx *cmd)
+{
+    int num = 0;
+    while (cmd->properties[num].name)
+        num++;
+    talloc_free(cmd->sorted_properties);
+    cmd->sorted_properties =
+        talloc_array(cmd, struct m_property *, MPMAX(num, 1));
+    for (int n = 0; n < num; n++)
+        cmd->sorted_properties[n] = &cmd->properties[n];
+    qsort(cmd->sorted_properties, num, sizeof(cmd->sorted_properties[0]),
+          compare_property);
+    cmd->num_properties = num;
+}
+
+// Binary search for a top-level property (without sub-path).
+static struct m_property *find_property(struct command_ctx *cmd, bstr name)
+{
+    int lo = 0, hi = cmd->num_properties;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (bstrcmp(bstr0(cmd->sorted_properties[mid]->name), name) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < cmd->num_properties &&
+        bstrcmp(bstr0(cmd->sorted_properties[lo]->name), name) == 0)
+        return cmd->sorted_properties[lo];
+    return NULL;
+}
+
 // Option-property bridge. This is used so that setting options via various
 // mechanisms (including command line parsing, config files, per-file options)
 // updates state associated with them. For that, they have to go through the
@@ -362,7 +410,7 @@ int mp_on_set_option(void *ctx, struct m_config_option *co, void *data, int flag
     // property implementation is trivial, and can break some obscure features
     // like --profile and --include if non-trivial flags are involved (which
     // the bridge would drop).
-    struct m_property *prop = m_property_list_find(cmd->properties, name);
+    struct m_property *prop = find_property(cmd, bstr0(name));
     if (prop && prop->is_option)
         goto direct_option;
 
@@ -706,6 +754,63 @@ static int mp_property_frame_drop_dec(void *ctx, struct m_property *prop,
     return m_property_int_ro(action, arg, mpctx->vo_chain->video_src->dropped_frames);
 }
 
+static int mp_property_framedrop_level(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->vo_chain || !mpctx->vo_chain->video_src)
+        return M_PROPERTY_UNAVAILABLE;
+    struct dec_video *vd = mpctx->vo_chain->video_src;
+
+    struct m_sub_property props[] = {
+        {"level",           SUB_PROP_INT(vd->framedrop_level)},
+        {"nonref-dropped",  SUB_PROP_INT(vd->framedrop_stats.nonref_dropped)},
+        {"deblock-skipped", SUB_PROP_INT(vd->framedrop_stats.deblock_skipped)},
+        {"nonkey-dropped",  SUB_PROP_INT(vd->framedrop_stats.nonkey_dropped)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
+static int mp_property_hr_seek_stats(void *ctx, struct m_property *prop,
+                                     int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->last_hrseek.valid)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct m_sub_property props[] = {
+        {"skipped-frames",  SUB_PROP_INT(mpctx->last_hrseek.skipped)},
+        {"dropped-frames",  SUB_PROP_INT(mpctx->last_hrseek.dropped)},
+        {"preroll",         SUB_PROP_DOUBLE(mpctx->last_hrseek.preroll)},
+        {"time",            SUB_PROP_DOUBLE(mpctx->last_hrseek.time)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
+static int mp_property_video_decoder_stats(void *ctx, struct m_property *prop,
+                                           int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct dec_video *vd = mpctx->vo_chain ? mpctx->vo_chain->video_src : NULL;
+    if (!vd || !vd->stats.threads)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct m_sub_property props[] = {
+        {"frame-time",      SUB_PROP_DOUBLE(vd->stats.frame_time_avg)},
+        {"frame-time-max",  SUB_PROP_DOUBLE(vd->stats.frame_time_max)},
+        {"frame-time-dev",  SUB_PROP_DOUBLE(vd->stats.frame_time_dev)},
+        {"threads",         SUB_PROP_INT(vd->stats.threads)},
+        {"frame-threads",   SUB_PROP_FLAG(vd->stats.frame_threads)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
 static int mp_property_mistimed_frame_count(void *ctx, struct m_property *prop,
                                             int action, void *arg)
 {
@@ -1757,6 +1862,174 @@ static int mp_property_demuxer_cache_state(void *ctx, struct m_property *prop,
     node_map_add_flag(r, "idle", s.idle);
     node_map_add_int64(r, "total-bytes", s.total_bytes);
     node_map_add_int64(r, "fw-bytes", s.fw_bytes);
+    node_map_add_int64(r, "spilled-bytes", s.spilled_bytes);
+
+    struct mpv_node *pool = node_map_add(r, "packet-pool", MPV_FORMAT_NODE_MAP);
+    struct demux_packet_pool_stats *ps = &s.packet_pool;
+    node_map_add_int64(pool, "packets-allocated", ps->packets_allocated);
+    node_map_add_int64(pool, "packets-reused", ps->packets_reused);
+    node_map_add_int64(pool, "buffers-allocated", ps->buffers_allocated);
+    node_map_add_int64(pool, "buffers-reused", ps->buffers_reused);
+    node_map_add_int64(pool, "cached-bytes", ps->cached_bytes);
+
+    return M_PROPERTY_OK;
+}
+
+static int mp_property_demuxer_stats(void *ctx, struct m_property *prop,
+                                     int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->demuxer)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    void *tmp = talloc_new(NULL);
+    struct demux_ctrl_stats s = {.ta_parent = tmp};
+    if (demux_control(mpctx->demuxer, DEMUXER_CTRL_GET_STATS, &s) < 1) {
+        talloc_free(tmp);
+        return M_PROPERTY_UNAVAILABLE;
+    }
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add_int64(r, "reads", s.reads);
+    node_map_add_double(r, "read-time", s.read_time);
+    node_map_add_double(r, "read-time-max", s.read_time_max);
+    node_map_add_int64(r, "thread-wakeups", s.thread_wakeups);
+
+    struct mpv_node *streams = node_map_add(r, "streams", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < s.num_streams; n++) {
+        struct demux_stream_stats *st = &s.streams[n];
+        struct mpv_node *sub = node_array_add(streams, MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(sub, "index", st->index);
+        node_map_add_string(sub, "type", stream_type_name(st->type));
+        node_map_add_flag(sub, "selected", st->selected);
+        node_map_add_int64(sub, "packets", st->fw_packets);
+        node_map_add_int64(sub, "bytes", st->fw_bytes);
+        if (st->fw_secs >= 0)
+            node_map_add_double(sub, "secs", st->fw_secs);
+        node_map_add_int64(sub, "packets-read", st->packets_read);
+        node_map_add_double(sub, "wait-avg", st->wait_avg);
+        node_map_add_double(sub, "wait-max", st->wait_max);
+    }
+
+    talloc_free(tmp);
+    return M_PROPERTY_OK;
+}
+
+static void add_connection_info(struct mpv_node *r,
+                                struct stream_connection_info *info)
+{
+    for (int n = 0; n < info->num_connections; n++) {
+        struct mpv_node *sub = node_array_add(r, MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(sub, "bytes", info->connections[n].bytes);
+        node_map_add_int64(sub, "requests", info->connections[n].requests);
+        node_map_add_flag(sub, "active", info->connections[n].active);
+    }
+}
+
+// Memory attributed to the subsystems (see enum mp_mem_account). This is
+// process-wide, and includes ta allocations only, plus some large buffers
+// that are accounted manually (stream cache, demuxer packet data).
+static int mp_property_memory_usage(void *ctx, struct m_property *prop,
+                                    int action, void *arg)
+{
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+    long long total = 0;
+    for (int n = 0; n < MP_MEM_ACCOUNT_COUNT; n++) {
+        struct ta_account_stats st = ta_get_account_stats(n);
+        struct mpv_node *sub =
+            node_map_add(r, mp_mem_account_names[n], MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(sub, "bytes", st.bytes + st.external);
+        node_map_add_int64(sub, "ta-bytes", st.bytes);
+        node_map_add_int64(sub, "ta-allocations", st.blocks);
+        node_map_add_int64(sub, "external-bytes", st.external);
+        total += st.bytes + st.external;
+    }
+    node_map_add_int64(r, "total-bytes", total);
+
+    return M_PROPERTY_OK;
+}
+
+static int mp_property_stream_connections(void *ctx, struct m_property *prop,
+                                          int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->demuxer)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct stream_connection_info info = {0};
+    demux_stream_control(mpctx->demuxer, STREAM_CTRL_GET_CONNECTION_INFO, &info);
+    if (info.num_connections <= 0)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_ARRAY, NULL);
+    add_connection_info(r, &info);
+
+    return M_PROPERTY_OK;
+}
+
+static int mp_property_stream_io_stats(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->demuxer)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct stream_io_stats s;
+    if (demux_stream_control(mpctx->demuxer, STREAM_CTRL_GET_IO_STATS, &s) < 1)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add_int64(r, "bytes-read", s.bytes_read);
+    node_map_add_int64(r, "reads", s.reads);
+    node_map_add_int64(r, "seeks", s.seeks);
+    node_map_add_int64(r, "reconnects", s.reconnects);
+
+    struct mpv_node *lat = node_map_add(r, "read-latency", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < STREAM_LATENCY_BUCKETS; n++)
+        node_array_add(lat, MPV_FORMAT_INT64)->u.int64 = s.read_latency[n];
+
+    if (s.cache_hits || s.cache_misses) {
+        node_map_add_int64(r, "cache-hits", s.cache_hits);
+        node_map_add_int64(r, "cache-misses", s.cache_misses);
+    }
+
+    struct stream_connection_info info = {0};
+    demux_stream_control(mpctx->demuxer, STREAM_CTRL_GET_CONNECTION_INFO, &info);
+    if (info.num_connections > 0)
+        add_connection_info(node_map_add(r, "connections", MPV_FORMAT_NODE_ARRAY),
+                            &info);
 
     return M_PROPERTY_OK;
 }
@@ -1790,6 +2063,33 @@ static int mp_property_cache_buffering(void *ctx, struct m_property *prop,
     return m_property_int_ro(action, arg, state);
 }
 
+static int mp_property_cache_fill_rate(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->demuxer || mpctx->cache_fill_rate < 0)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_double_ro(action, arg, mpctx->cache_fill_rate);
+}
+
+static int mp_property_cache_underrun_time(void *ctx, struct m_property *prop,
+                                           int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->demuxer || mpctx->cache_underrun_time < 0)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_double_ro(action, arg, mpctx->cache_underrun_time);
+}
+
+static int mp_property_cache_needed(void *ctx, struct m_property *prop,
+                                    int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->demuxer || mpctx->cache_needed_time < 0)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_double_ro(action, arg, mpctx->cache_needed_time);
+}
+
 static int mp_property_demuxer_is_network(void *ctx, struct m_property *prop,
                                           int action, void *arg)
 {
@@ -2014,6 +2314,87 @@ static int mp_property_ao(void *ctx, struct m_property *p, int action, void *arg
                                     mpctx->ao ? ao_get_name(mpctx->ao) : NULL);
 }
 
+static int mp_property_ao_device_stats(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->ao)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct ao_device_stats s = {0};
+    if (ao_control(mpctx->ao, AOCONTROL_GET_DEVICE_STATS, &s) != CONTROL_OK)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add_int64(r, "underruns", s.underruns);
+    node_map_add_double(r, "buffer-time", s.buffer_time);
+    node_map_add_double(r, "period-time", s.period_time);
+    if (s.latency > 0)
+        node_map_add_double(r, "latency", s.latency);
+    return M_PROPERTY_OK;
+}
+
+static int mp_property_audio_pipeline_stats(void *ctx, struct m_property *prop,
+                                            int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct ao_chain *ao_c = mpctx->ao_chain;
+    if (!ao_c || !mpctx->ao)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    double filters = 0;
+#if HAVE_LIBAF
+    if (ao_c->af->initialized > 0)
+        filters += af_calc_delay(ao_c->af);
+#endif
+    if (ao_c->conv)
+        filters += mp_aconverter_get_latency(ao_c->conv);
+    if (ao_c->output_frame)
+        filters += mp_aframe_duration(ao_c->output_frame);
+
+    struct ao_latency_stats s;
+    ao_get_latency_stats(mpctx->ao, &s);
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add_double(r, "decoder",
+                        ao_c->audio_src ? audio_get_buffered(ao_c->audio_src) : 0);
+    node_map_add_double(r, "filters", filters);
+    node_map_add_double(r, "buffer", mp_audio_buffer_seconds(ao_c->ao_buffer));
+    node_map_add_double(r, "ao-buffer", s.buffered);
+    node_map_add_double(r, "device", s.device);
+
+    struct mpv_node *hist =
+        node_map_add(r, "output-latency-histogram", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < AUDIO_LATENCY_HIST_BUCKETS; n++)
+        node_array_add(hist, MPV_FORMAT_INT64)->u.int64 = ao_c->latency_hist[n];
+
+    node_map_add_int64(r, "underruns", s.underruns);
+    struct mpv_node *times =
+        node_map_add(r, "underrun-ago", MPV_FORMAT_NODE_ARRAY);
+    int64_t now = mp_time_us();
+    for (int n = 0; n < s.num_underrun_times; n++) {
+        node_array_add(times, MPV_FORMAT_DOUBLE)->u.double_ =
+            (now - s.underrun_times[n]) / 1e6;
+    }
+    return M_PROPERTY_OK;
+}
+
 /// Audio delay (RW)
 static int mp_property_audio_delay(void *ctx, struct m_property *prop,
                                    int action, void *arg)
@@ -2908,20 +3289,29 @@ static int mp_property_vo_configured(void *ctx, struct m_property *prop,
                         mpctx->video_out && mpctx->video_out->config_ok);
 }
 
+static void get_pass_perf(struct mpv_node *pass, struct mp_pass_perf *data)
+{
+    node_map_add(pass, "last", MPV_FORMAT_INT64)->u.int64 = data->last;
+    node_map_add(pass, "avg", MPV_FORMAT_INT64)->u.int64 = data->avg;
+    node_map_add(pass, "peak", MPV_FORMAT_INT64)->u.int64 = data->peak;
+    node_map_add(pass, "p50", MPV_FORMAT_INT64)->u.int64 = data->p50;
+    node_map_add(pass, "p95", MPV_FORMAT_INT64)->u.int64 = data->p95;
+    node_map_add(pass, "p99", MPV_FORMAT_INT64)->u.int64 = data->p99;
+    node_map_add(pass, "count", MPV_FORMAT_INT64)->u.int64 = data->count;
+    struct mpv_node *samples = node_map_add(pass, "samples", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < data->count; n++)
+        node_array_add(samples, MPV_FORMAT_INT64)->u.int64 = data->samples[n];
+    struct mpv_node *hist = node_map_add(pass, "histogram", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < VO_PERF_HIST_BUCKETS; n++)
+        node_array_add(hist, MPV_FORMAT_INT64)->u.int64 = data->histogram[n];
+}
+
 static void get_frame_perf(struct mpv_node *node, struct mp_frame_perf *perf)
 {
     for (int i = 0; i < perf->count; i++) {
-        struct mp_pass_perf *data = &perf->perf[i];
         struct mpv_node *pass = node_array_add(node, MPV_FORMAT_NODE_MAP);
-
         node_map_add_string(pass, "desc", perf->desc[i]);
-        node_map_add(pass, "last", MPV_FORMAT_INT64)->u.int64 = data->last;
-        node_map_add(pass, "avg", MPV_FORMAT_INT64)->u.int64 = data->avg;
-        node_map_add(pass, "peak", MPV_FORMAT_INT64)->u.int64 = data->peak;
-        node_map_add(pass, "count", MPV_FORMAT_INT64)->u.int64 = data->count;
-        struct mpv_node *samples = node_map_add(pass, "samples", MPV_FORMAT_NODE_ARRAY);
-        for (int n = 0; n < data->count; n++)
-            node_array_add(samples, MPV_FORMAT_INT64)->u.int64 = data->samples[n];
+        get_pass_perf(pass, &perf->perf[i]);
     }
 }
 
@@ -2930,8 +3320,9 @@ static char *asprint_perf(char *res, struct mp_frame_perf *perf)
     for (int i = 0; i < perf->count; i++) {
         struct mp_pass_perf *pass = &perf->perf[i];
         res = talloc_asprintf_append(res,
-                  "- %s: last %dus avg %dus peak %dus\n", perf->desc[i],
-                  (int)pass->last/1000, (int)pass->avg/1000, (int)pass->peak/1000);
+                  "- %s: last %dus avg %dus peak %dus p95 %dus\n", perf->desc[i],
+                  (int)pass->last/1000, (int)pass->avg/1000, (int)pass->peak/1000,
+                  (int)pass->p95/1000);
     }
 
     return res;
@@ -2988,6 +3379,201 @@ out:
     return ret;
 }
 
+static char *asprint_frame_time(char *res, struct mp_pass_perf *t)
+{
+    return talloc_asprintf_append(res,
+              "last %dus avg %dus p50 %dus p95 %dus p99 %dus peak %dus\n",
+              (int)t->last/1000, (int)t->avg/1000, (int)t->p50/1000,
+              (int)t->p95/1000, (int)t->p99/1000, (int)t->peak/1000);
+}
+
+static int mp_property_vo_frame_times(void *ctx, struct m_property *prop,
+                                      int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->video_out)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+
+    int ret = M_PROPERTY_UNAVAILABLE;
+    struct voctrl_performance_data *data = talloc_ptrtype(NULL, data);
+    if (vo_control(mpctx->video_out, VOCTRL_PERFORMANCE_DATA, data) <= 0)
+        goto out;
+
+    switch (action) {
+    case M_PROPERTY_PRINT: {
+        char *res = talloc_strdup(NULL, "fresh: ");
+        res = asprint_frame_time(res, &data->fresh.total);
+        res = talloc_asprintf_append(res, "redraw: ");
+        res = asprint_frame_time(res, &data->redraw.total);
+        *(char **)arg = res;
+        ret = M_PROPERTY_OK;
+        goto out;
+    }
+
+    case M_PROPERTY_GET: {
+        struct mpv_node node;
+        node_init(&node, MPV_FORMAT_NODE_MAP, NULL);
+        get_pass_perf(node_map_add(&node, "fresh", MPV_FORMAT_NODE_MAP),
+                      &data->fresh.total);
+        get_pass_perf(node_map_add(&node, "redraw", MPV_FORMAT_NODE_MAP),
+                      &data->redraw.total);
+        *(struct mpv_node *)arg = node;
+        ret = M_PROPERTY_OK;
+        goto out;
+    }
+    }
+
+    ret = M_PROPERTY_NOT_IMPLEMENTED;
+
+out:
+    talloc_free(data);
+    return ret;
+}
+
+static int mp_property_vo_shader_cache(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->video_out)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+
+    struct voctrl_shader_cache_stats st;
+    if (vo_control(mpctx->video_out, VOCTRL_SHADER_CACHE_STATS, &st) <= 0)
+        return M_PROPERTY_UNAVAILABLE;
+
+    switch (action) {
+    case M_PROPERTY_PRINT:
+        *(char **)arg = talloc_asprintf(NULL,
+            "hits: %"PRId64", misses: %"PRId64", compiled: %"PRId64
+            " (%.3fs), disk: %d files, %"PRId64" bytes",
+            st.hits, st.misses, st.compiles, st.compile_time / 1e6,
+            st.disk_entries, st.disk_size);
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET: {
+        struct mpv_node node;
+        node_init(&node, MPV_FORMAT_NODE_MAP, NULL);
+        node_map_add_int64(&node, "hits", st.hits);
+        node_map_add_int64(&node, "misses", st.misses);
+        node_map_add_int64(&node, "compiles", st.compiles);
+        node_map_add_double(&node, "compile-time", st.compile_time / 1e6);
+        node_map_add_int64(&node, "disk-entries", st.disk_entries);
+        node_map_add_int64(&node, "disk-size", st.disk_size);
+        *(struct mpv_node *)arg = node;
+        return M_PROPERTY_OK;
+    }
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
+static int mp_property_vo_gpu_memory(void *ctx, struct m_property *prop,
+                                     int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->video_out)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+
+    struct voctrl_gpu_memory_stats st;
+    if (vo_control(mpctx->video_out, VOCTRL_GPU_MEMORY_STATS, &st) <= 0)
+        return M_PROPERTY_UNAVAILABLE;
+
+    switch (action) {
+    case M_PROPERTY_PRINT: {
+        char *res = talloc_strdup(NULL, "");
+        for (int n = 0; n < st.num_heaps; n++) {
+            struct mp_gpu_memory_heap *h = &st.heaps[n];
+            res = talloc_asprintf_append(res, "%s%d%s: %"PRId64"/%"PRId64
+                                         " MB in %d allocations", n ? ", " : "",
+                                         n, h->device_local ? " (local)" : "",
+                                         h->used >> 20, h->allocated >> 20,
+                                         h->num_slabs);
+            if (h->budget) {
+                res = talloc_asprintf_append(res, ", budget %"PRId64" MB",
+                                             h->budget >> 20);
+            }
+        }
+        *(char **)arg = res;
+        return M_PROPERTY_OK;
+    }
+    case M_PROPERTY_GET: {
+        struct mpv_node node;
+        node_init(&node, MPV_FORMAT_NODE_ARRAY, NULL);
+        for (int n = 0; n < st.num_heaps; n++) {
+            struct mp_gpu_memory_heap *h = &st.heaps[n];
+            struct mpv_node *sub = node_array_add(&node, MPV_FORMAT_NODE_MAP);
+            node_map_add_int64(sub, "size", h->size);
+            node_map_add_flag(sub, "device-local", h->device_local);
+            if (h->budget) {
+                node_map_add_int64(sub, "budget", h->budget);
+                node_map_add_int64(sub, "usage", h->usage);
+            }
+            node_map_add_int64(sub, "allocated", h->allocated);
+            node_map_add_int64(sub, "used", h->used);
+            node_map_add_int64(sub, "allocations", h->num_slabs);
+        }
+        *(struct mpv_node *)arg = node;
+        return M_PROPERTY_OK;
+    }
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
+static int mp_property_vo_upload_stats(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->video_out)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+
+    struct voctrl_upload_stats st;
+    if (vo_control(mpctx->video_out, VOCTRL_UPLOAD_STATS, &st) <= 0)
+        return M_PROPERTY_UNAVAILABLE;
+
+    switch (action) {
+    case M_PROPERTY_PRINT: {
+        double secs = st.time / 1e6;
+        *(char **)arg = talloc_asprintf(NULL,
+            "%"PRId64" uploads, %"PRId64" MB in %.3fs (%.1f MB/s), "
+            "%"PRId64" stalls (%.3fs)", st.uploads, st.bytes >> 20, secs,
+            secs > 0 ? st.bytes / secs / (1 << 20) : 0, st.stalls,
+            st.stall_time / 1e6);
+        return M_PROPERTY_OK;
+    }
+    case M_PROPERTY_GET: {
+        struct mpv_node node;
+        node_init(&node, MPV_FORMAT_NODE_MAP, NULL);
+        node_map_add_int64(&node, "uploads", st.uploads);
+        node_map_add_int64(&node, "bytes", st.bytes);
+        node_map_add_double(&node, "time", st.time / 1e6);
+        node_map_add_int64(&node, "stalls", st.stalls);
+        node_map_add_double(&node, "stall-time", st.stall_time / 1e6);
+        node_map_add_int64(&node, "ring-size", st.ring_size);
+        *(struct mpv_node *)arg = node;
+        return M_PROPERTY_OK;
+    }
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
 static int mp_property_vo(void *ctx, struct m_property *p, int action, void *arg)
 {
     MPContext *mpctx = ctx;
@@ -3062,6 +3648,15 @@ static int mp_property_vf_fps(void *ctx, struct m_property *prop,
     return m_property_double_ro(action, arg, 1.0 / avg);
 }
 
+static int mp_property_vf_format_plan(void *ctx, struct m_property *prop,
+                                      int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->vo_chain || !mpctx->vo_chain->vf->format_plan)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_strdup_ro(action, arg, mpctx->vo_chain->vf->format_plan);
+}
+
 /// Video aspect (RO)
 static int mp_property_aspect(void *ctx, struct m_property *prop,
                               int action, void *arg)
@@ -3286,24 +3881,71 @@ static int mp_property_tv_channel(void *ctx, struct m_property *prop,
     return M_PROPERTY_NOT_IMPLEMENTED;
 }
 
+// Channel switches run asynchronously, because tuning can take seconds. The
+// file is reloaded once the switch succeeded.
+struct dvb_switch {
+    struct MPContext *mpctx;
+    struct demuxer *demuxer;
+    int res;
+    union {
+        int channel[2];
+        int dir;
+        char *name;
+    } arg;
+};
+
+// Runs on the playback thread.
+static void dvb_switch_done_core(void *p)
+{
+    struct dvb_switch *sw = p;
+    struct MPContext *mpctx = sw->mpctx;
+    if (sw->demuxer == mpctx->demuxer) {
+        if (sw->res == STREAM_OK) {
+            if (!mpctx->stop_play)
+                mpctx->stop_play = PT_RELOAD_FILE;
+        } else {
+            MP_ERR(mpctx, "Switching the DVB channel failed.\n");
+        }
+    }
+    talloc_free(sw);
+}
+
+// Runs on the demuxer thread.
+static void dvb_switch_done(void *p, int res)
+{
+    struct dvb_switch *sw = p;
+    sw->res = res;
+    mp_dispatch_enqueue(sw->mpctx->dispatch, dvb_switch_done_core, sw);
+}
+
+static int dvb_switch(struct MPContext *mpctx, int ctrl, struct dvb_switch *sw)
+{
+    if (!mpctx->demuxer) {
+        talloc_free(sw);
+        return M_PROPERTY_UNAVAILABLE;
+    }
+    sw->mpctx = mpctx;
+    sw->demuxer = mpctx->demuxer;
+    demux_stream_control_async(mpctx->demuxer, ctrl, &sw->arg,
+                               dvb_switch_done, sw);
+    return M_PROPERTY_OK;
+}
+
 static int mp_property_dvb_channel(void *ctx, struct m_property *prop,
                                    int action, void *arg)
 {
     MPContext *mpctx = ctx;
-    int r;
     switch (action) {
-    case M_PROPERTY_SET:
-        r = prop_stream_ctrl(mpctx, STREAM_CTRL_DVB_SET_CHANNEL, arg);
-        if (r == M_PROPERTY_OK && !mpctx->stop_play)
-            mpctx->stop_play = PT_RELOAD_FILE;
-        return r;
+    case M_PROPERTY_SET: {
+        struct dvb_switch *sw = talloc_zero(NULL, struct dvb_switch);
+        memcpy(sw->arg.channel, arg, sizeof(sw->arg.channel));
+        return dvb_switch(mpctx, STREAM_CTRL_DVB_SET_CHANNEL, sw);
+    }
     case M_PROPERTY_SWITCH: {
         struct m_property_switch_arg *sa = arg;
-        int dir = sa->inc >= 0 ? 1 : -1;
-        r = prop_stream_ctrl(mpctx, STREAM_CTRL_DVB_STEP_CHANNEL, &dir);
-        if (r == M_PROPERTY_OK && !mpctx->stop_play)
-            mpctx->stop_play = PT_RELOAD_FILE;
-        return r;
+        struct dvb_switch *sw = talloc_zero(NULL, struct dvb_switch);
+        sw->arg.dir = sa->inc >= 0 ? 1 : -1;
+        return dvb_switch(mpctx, STREAM_CTRL_DVB_STEP_CHANNEL, sw);
     }
     case M_PROPERTY_GET_TYPE:
         *(struct m_option *)arg = (struct m_option){.type = &m_option_type_intpair};
@@ -3316,20 +3958,17 @@ static int mp_property_dvb_channel_name(void *ctx, struct m_property *prop,
                                         int action, void *arg)
 {
     MPContext *mpctx = ctx;
-    int r;
     switch (action) {
-    case M_PROPERTY_SET:
-        r = prop_stream_ctrl(mpctx, STREAM_CTRL_DVB_SET_CHANNEL_NAME, arg);
-        if (r == M_PROPERTY_OK && !mpctx->stop_play)
-            mpctx->stop_play = PT_RELOAD_FILE;
-        return r;
+    case M_PROPERTY_SET: {
+        struct dvb_switch *sw = talloc_zero(NULL, struct dvb_switch);
+        sw->arg.name = talloc_strdup(sw, *(char **)arg);
+        return dvb_switch(mpctx, STREAM_CTRL_DVB_SET_CHANNEL_NAME, sw);
+    }
     case M_PROPERTY_SWITCH: {
         struct m_property_switch_arg *sa = arg;
-        int dir = sa->inc >= 0 ? 1 : -1;
-        r = prop_stream_ctrl(mpctx, STREAM_CTRL_DVB_STEP_CHANNEL, &dir);
-        if (r == M_PROPERTY_OK && !mpctx->stop_play)
-            mpctx->stop_play = PT_RELOAD_FILE;
-        return r;
+        struct dvb_switch *sw = talloc_zero(NULL, struct dvb_switch);
+        sw->arg.dir = sa->inc >= 0 ? 1 : -1;
+        return dvb_switch(mpctx, STREAM_CTRL_DVB_STEP_CHANNEL, sw);
     }
     case M_PROPERTY_GET: {
         return prop_stream_ctrl(mpctx, STREAM_CTRL_DVB_GET_CHANNEL_NAME, arg);
@@ -3391,30 +4030,11 @@ static int mp_property_playlist_pos_1(void *ctx, struct m_property *prop,
     return mp_property_playlist_pos_x(ctx, prop, action, arg, 1);
 }
 
-struct get_playlist_ctx {
-    struct MPContext *mpctx;
-    int last_index;
-    struct playlist_entry *last_entry;
-};
-
 static int get_playlist_entry(int item, int action, void *arg, void *ctx)
 {
-    struct get_playlist_ctx *p = ctx;
-    struct MPContext *mpctx = p->mpctx;
-
-    struct playlist_entry *e;
-    // This is an optimization that prevents O(n^2) behaviour when the entire
-    // playlist is requested. If a request is made for the last requested entry
-    // or the entry immediately following it, it can be found without a full
-    // traversal of the linked list.
-    if (p->last_entry && item == p->last_index)
-        e = p->last_entry;
-    else if (p->last_entry && item == p->last_index + 1)
-        e = p->last_entry->next;
-    else
-        e = playlist_entry_from_index(mpctx->playlist, item);
-    p->last_index = item;
-    p->last_entry = e;
+    struct MPContext *mpctx = ctx;
+
+    struct playlist_entry *e = playlist_entry_from_index(mpctx->playlist, item);
     if (!e)
         return M_PROPERTY_ERROR;
 
@@ -3456,9 +4076,8 @@ static int mp_property_playlist(void *ctx, struct m_property *prop,
         return M_PROPERTY_OK;
     }
 
-    struct get_playlist_ctx p = { .mpctx = mpctx };
     return m_property_read_list(action, arg, playlist_entry_count(mpctx->playlist),
-                                get_playlist_entry, &p);
+                                get_playlist_entry, mpctx);
 }
 
 static char *print_obj_osd_list(struct m_obj_settings *list)
@@ -3916,6 +4535,131 @@ static int mp_profile_list(void *ctx, struct m_property *prop,
     return M_PROPERTY_NOT_IMPLEMENTED;
 }
 
+static int mp_property_client_event_stats(void *ctx, struct m_property *prop,
+                                          int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET:
+        mp_client_get_event_stats(mpctx, arg);
+        return M_PROPERTY_OK;
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
+static int mp_property_playloop_stats(void *ctx, struct m_property *prop,
+                                      int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct mp_playloop_stats *st = &mpctx->playloop_stats;
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET: {
+        struct mpv_node *r = arg;
+        node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+        node_map_add_int64(r, "iterations", st->iterations);
+        node_map_add_int64(r, "wakeup-immediate", st->wakeup_immediate);
+        node_map_add_int64(r, "wakeup-timeout", st->wakeup_timeout);
+        node_map_add_int64(r, "wakeup-interrupt", st->wakeup_interrupt);
+        node_map_add_int64(r, "dispatch-runs", st->dispatch_runs);
+        node_map_add_int64(r, "core-locks", st->core_locks);
+        node_map_add_double(r, "busy-time", st->busy_time / 1e6);
+        node_map_add_double(r, "busy-time-max", st->busy_time_max / 1e6);
+        return M_PROPERTY_OK;
+    }
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
+static int mp_property_input_latency(void *ctx, struct m_property *prop,
+                                     int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->video_out)
+        return M_PROPERTY_UNAVAILABLE;
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET: {
+        struct vo_input_latency l;
+        vo_get_input_latency(mpctx->video_out, &l);
+        struct mpv_node *r = arg;
+        node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+        node_map_add_int64(r, "count", l.count);
+        node_map_add_double(r, "last", l.last / 1e6);
+        node_map_add_double(r, "avg", l.avg / 1e6);
+        node_map_add_double(r, "peak", l.peak / 1e6);
+        struct mpv_node *hist =
+            node_map_add(r, "histogram", MPV_FORMAT_NODE_ARRAY);
+        for (int n = 0; n < VO_INPUT_LATENCY_HIST_BUCKETS; n++)
+            node_array_add(hist, MPV_FORMAT_INT64)->u.int64 = l.histogram[n];
+        return M_PROPERTY_OK;
+    }
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
+static int mp_property_thumbnail_cache(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET:
+        thumbnail_get_cache(mpctx, arg);
+        return M_PROPERTY_OK;
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
+static int mp_property_startup_timings(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET: {
+        struct mpv_node *r = arg;
+        node_init(r, MPV_FORMAT_NODE_ARRAY, NULL);
+        for (int n = 1; n < mpctx->num_startup_marks; n++) {
+            struct mp_startup_mark *m = &mpctx->startup_marks[n];
+            struct mpv_node *e = node_array_add(r, MPV_FORMAT_NODE_MAP);
+            node_map_add_string(e, "name", m->name);
+            node_map_add_double(e, "time",
+                                (m->time - mpctx->startup_marks[0].time) / 1e6);
+            node_map_add_double(e, "duration", (m->time - m[-1].time) / 1e6);
+        }
+        return M_PROPERTY_OK;
+    }
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
+static int mp_property_last_screenshot(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET:
+        screenshot_get_info(mpctx, arg);
+        return M_PROPERTY_OK;
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
 // Redirect a property name to another
 #define M_PROPERTY_ALIAS(name, real_property) \
     {(name), mp_property_alias, .priv = (real_property)}
@@ -3947,6 +4691,9 @@ static const struct m_property mp_properties_base[] = {
     {"vsync-ratio", mp_property_vsync_ratio},
     {"decoder-frame-drop-count", mp_property_frame_drop_dec},
     {"frame-drop-count", mp_property_frame_drop_vo},
+    {"decoder-framedrop-level", mp_property_framedrop_level},
+    {"hr-seek-stats", mp_property_hr_seek_stats},
+    {"video-decoder-stats", mp_property_video_decoder_stats},
     {"vo-delayed-frame-count", mp_property_vo_delayed_frame_count},
     {"percent-pos", mp_property_percent_pos},
     {"time-start", mp_property_time_start},
@@ -3983,7 +4730,14 @@ static const struct m_property mp_properties_base[] = {
     {"demuxer-cache-idle", mp_property_demuxer_cache_idle},
     {"demuxer-start-time", mp_property_demuxer_start_time},
     {"demuxer-cache-state", mp_property_demuxer_cache_state},
+    {"demuxer-stats", mp_property_demuxer_stats},
+    {"stream-connections", mp_property_stream_connections},
+    {"stream-io-stats", mp_property_stream_io_stats},
+    {"memory-usage", mp_property_memory_usage},
     {"cache-buffering-state", mp_property_cache_buffering},
+    {"cache-fill-rate", mp_property_cache_fill_rate},
+    {"cache-underrun-time", mp_property_cache_underrun_time},
+    {"cache-needed-duration", mp_property_cache_needed},
     {"paused-for-cache", mp_property_paused_for_cache},
     {"demuxer-via-network", mp_property_demuxer_is_network},
     {"clock", mp_property_clock},
@@ -4017,6 +4771,8 @@ static const struct m_property mp_properties_base[] = {
     {"audio-device", mp_property_audio_device},
     {"audio-device-list", mp_property_audio_devices},
     {"current-ao", mp_property_ao},
+    {"ao-device-stats", mp_property_ao_device_stats},
+    {"audio-pipeline-stats", mp_property_audio_pipeline_stats},
 
     // Video
     {"fullscreen", mp_property_fullscreen},
@@ -4037,9 +4793,14 @@ static const struct m_property mp_properties_base[] = {
     {"window-scale", mp_property_window_scale},
     {"vo-configured", mp_property_vo_configured},
     {"vo-passes", mp_property_vo_passes},
+    {"vo-frame-times", mp_property_vo_frame_times},
+    {"vo-shader-cache", mp_property_vo_shader_cache},
+    {"vo-gpu-memory", mp_property_vo_gpu_memory},
+    {"vo-upload-stats", mp_property_vo_upload_stats},
     {"current-vo", mp_property_vo},
     {"container-fps", mp_property_fps},
     {"estimated-vf-fps", mp_property_vf_fps},
+    {"vf-format-plan", mp_property_vf_format_plan},
     {"video-aspect", mp_property_aspect},
     {"vid", mp_property_video},
     {"program", mp_property_program},
@@ -4126,6 +4887,12 @@ static const struct m_property mp_properties_base[] = {
     {"option-info", mp_property_option_info},
     {"property-list", mp_property_list},
     {"profile-list", mp_profile_list},
+    {"client-event-stats", mp_property_client_event_stats},
+    {"last-screenshot", mp_property_last_screenshot},
+    {"startup-timings", mp_property_startup_timings},
+    {"playloop-stats", mp_property_playloop_stats},
+    {"input-latency", mp_property_input_latency},
+    {"thumbnail-cache", mp_property_thumbnail_cache},
 
     M_PROPERTY_ALIAS("video", "vid"),
     M_PROPERTY_ALIAS("audio", "aid"),
@@ -4141,17 +4908,29 @@ static const struct m_property mp_properties_base[] = {
     M_PROPERTY_DEPRECATED_ALIAS("vo-drop-frame-count", "frame-drop-count"),
 };
 
+// Properties which are not affected by "*" in mp_event_property_change[].
+// They are expensive to regenerate and compare, so they list exactly the
+// events that change them (or use mp_notify_property()), and observing them
+// costs nothing on unrelated events.
+static const char *const mp_precise_change_properties[] = {
+    "playlist", "playlist-count", "playlist-pos", "playlist-pos-1",
+    "track-list", NULL
+};
+
+#define PLAYLIST_PROPS "playlist", "playlist-count", "playlist-pos", \
+                       "playlist-pos-1"
+
 // Each entry describes which properties an event (possibly) changes.
 #define E(x, ...) [x] = (const char*const[]){__VA_ARGS__, NULL}
 static const char *const *const mp_event_property_change[] = {
-    E(MPV_EVENT_START_FILE, "*"),
-    E(MPV_EVENT_END_FILE, "*"),
-    E(MPV_EVENT_FILE_LOADED, "*"),
+    E(MPV_EVENT_START_FILE, "*", PLAYLIST_PROPS, "track-list"),
+    E(MPV_EVENT_END_FILE, "*", PLAYLIST_PROPS, "track-list"),
+    E(MPV_EVENT_FILE_LOADED, "*", "track-list"),
     E(MP_EVENT_CHANGE_ALL, "*"),
     E(MPV_EVENT_TRACKS_CHANGED, "track-list"),
     E(MPV_EVENT_TRACK_SWITCHED, "vid", "video", "aid", "audio", "sid", "sub",
-      "secondary-sid"),
-    E(MPV_EVENT_IDLE, "*"),
+      "secondary-sid", "track-list"),
+    E(MPV_EVENT_IDLE, "*", PLAYLIST_PROPS),
     E(MPV_EVENT_PAUSE,   "pause"),
     E(MPV_EVENT_UNPAUSE, "pause"),
     E(MPV_EVENT_TICK, "time-pos", "audio-pts", "stream-pos", "avsync",
@@ -4179,15 +4958,16 @@ static const char *const *const mp_event_property_change[] = {
     E(MP_EVENT_CACHE_UPDATE, "cache", "cache-free", "cache-used", "cache-idle",
       "demuxer-cache-duration", "demuxer-cache-idle", "paused-for-cache",
       "demuxer-cache-time", "cache-buffering-state", "cache-speed",
-      "cache-percent"),
+      "cache-percent", "cache-fill-rate", "cache-underrun-time",
+      "cache-needed-duration"),
     E(MP_EVENT_WIN_RESIZE, "window-scale", "osd-width", "osd-height", "osd-par"),
     E(MP_EVENT_WIN_STATE, "window-minimized", "display-names", "display-fps",
       "fullscreen"),
-    E(MP_EVENT_CHANGE_PLAYLIST, "playlist", "playlist-pos", "playlist-pos-1",
-      "playlist-count", "playlist/count"),
+    E(MP_EVENT_CHANGE_PLAYLIST, PLAYLIST_PROPS, "playlist/count"),
     E(MP_EVENT_CORE_IDLE, "core-idle", "eof-reached"),
 };
 #undef E
+#undef PLAYLIST_PROPS
 
 // If there is no prefix, return length+1 (avoids matching full name as prefix).
 static int prefix_len(const char *p)
@@ -4214,10 +4994,16 @@ static bool match_property(const char *a, const char *b)
 // Return a bitset of events which change the property.
 uint64_t mp_get_property_event_mask(const char *name)
 {
+    bool precise = false;
+    for (int n = 0; mp_precise_change_properties[n]; n++)
+        precise |= match_property(mp_precise_change_properties[n], name);
+
     uint64_t mask = 0;
     for (int n = 0; n < MP_ARRAY_SIZE(mp_event_property_change); n++) {
         const char *const *const list = mp_event_property_change[n];
         for (int i = 0; list && list[i]; i++) {
+            if (precise && strcmp(list[i], "*") == 0)
+                continue;
             if (match_property(list[i], name))
                 mask |= 1ULL << n;
         }
@@ -4258,8 +5044,11 @@ static int mp_property_do_silent(const char *name, int action, void *val,
                                  struct MPContext *ctx)
 {
     struct command_ctx *cmd = ctx->command_ctx;
+    struct m_property *prop = find_property(cmd, m_property_base_name(name));
+    if (!prop)
+        return M_PROPERTY_UNKNOWN;
     cmd->silence_option_deprecations += 1;
-    int r = m_property_do(ctx->log, cmd->properties, name, action, val, ctx);
+    int r = m_property_do_prop(ctx->log, prop, name, action, val, ctx);
     cmd->silence_option_deprecations -= 1;
     if (r == M_PROPERTY_OK && is_property_set(action, val))
         mp_notify_property(ctx, (char *)name);
@@ -4896,6 +5685,11 @@ int run_command(struct MPContext *mpctx, struct mp_cmd *cmd, struct mpv_node *re
     mp_cmd_dump(mpctx->log, cmd->id == MP_CMD_IGNORE ? MSGL_DEBUG : MSGL_V,
                 "Run command:", cmd);
 
+    // Mouse movement is too frequent and usually has no visible effect.
+    if (cmd->arrival_time && cmd->id != MP_CMD_IGNORE && !cmd->mouse_move &&
+        (!mpctx->input_time || cmd->arrival_time < mpctx->input_time))
+        mpctx->input_time = cmd->arrival_time;
+
     if (cmd->flags & MP_EXPAND_PROPERTIES) {
         for (int n = 0; n < cmd->nargs; n++) {
             if (cmd->args[n].type->type == CONF_TYPE_STRING) {
@@ -5261,14 +6055,13 @@ int run_command(struct MPContext *mpctx, struct mp_cmd *cmd, struct mpv_node *re
         // Supposed to clear the playlist, except the currently played item.
         if (mpctx->playlist->current_was_replaced)
             mpctx->playlist->current = NULL;
-        while (mpctx->playlist->first) {
-            struct playlist_entry *e = mpctx->playlist->first;
-            if (e == mpctx->playlist->current) {
-                e = e->next;
-                if (!e)
-                    break;
-            }
-            playlist_remove(mpctx->playlist, e);
+        // Remove from the end, so the remaining entries don't need to move.
+        struct playlist_entry *e = mpctx->playlist->last;
+        while (e) {
+            struct playlist_entry *prev = e->prev;
+            if (e != mpctx->playlist->current)
+                playlist_remove(mpctx->playlist, e);
+            e = prev;
         }
         mp_notify(mpctx, MP_EVENT_CHANGE_PLAYLIST, NULL);
         mp_wakeup_core(mpctx);
@@ -5327,7 +6120,8 @@ int run_command(struct MPContext *mpctx, struct mp_cmd *cmd, struct mpv_node *re
     case MP_CMD_TV_LAST_CHANNEL: {
         if (!mpctx->demuxer)
             return -1;
-        demux_stream_control(mpctx->demuxer, STREAM_CTRL_TV_LAST_CHAN, NULL);
+        demux_stream_control_async(mpctx->demuxer, STREAM_CTRL_TV_LAST_CHAN,
+                                   NULL, NULL, NULL);
         break;
     }
 
@@ -5462,6 +6256,33 @@ int run_command(struct MPContext *mpctx, struct mp_cmd *cmd, struct mpv_node *re
         break;
     }
 
+    case MP_CMD_THUMBNAIL: {
+        if (!res)
+            return -1;
+        struct mp_image *img = NULL;
+        double pts = 0;
+        if (!thumbnail_get(mpctx, cmd->args[0].v.d, cmd->args[1].v.i,
+                           &img, &pts))
+            return -1;
+        struct mpv_node_list *info = talloc_zero(NULL, struct mpv_node_list);
+        talloc_steal(info, img);
+        *res = (mpv_node){ .format = MPV_FORMAT_NODE_MAP, .u.list = info };
+        ADD_MAP_INT(res, "w", img->w);
+        ADD_MAP_INT(res, "h", img->h);
+        ADD_MAP_INT(res, "stride", img->stride[0]);
+        ADD_MAP_CSTR(res, "format", "bgr0");
+        *add_map_entry(res, "time") =
+            (struct mpv_node){.format = MPV_FORMAT_DOUBLE, .u.double_ = pts};
+        struct mpv_byte_array *ba = talloc_ptrtype(info, ba);
+        *ba = (struct mpv_byte_array){
+            .data = img->planes[0],
+            .size = img->stride[0] * img->h,
+        };
+        *add_map_entry(res, "data") =
+            (struct mpv_node){.format = MPV_FORMAT_BYTE_ARRAY, .u.ba = ba,};
+        break;
+    }
+
     case MP_CMD_RUN: {
         char *args[MP_CMD_MAX_ARGS + 1] = {0};
         for (int n = 0; n < cmd->nargs; n++)
@@ -5511,6 +6332,33 @@ int run_command(struct MPContext *mpctx, struct mp_cmd *cmd, struct mpv_node *re
         break;
     }
 
+    case MP_CMD_DUMP_CACHE: {
+        if (!mpctx->demuxer)
+            return -1;
+        char *file = mp_get_user_path(NULL, mpctx->global, cmd->args[0].v.s);
+        bool ok = demux_cache_dump(mpctx->demuxer, file);
+        talloc_free(file);
+        if (!ok) {
+            MP_ERR(mpctx, "Dumping the demuxer cache failed.\n");
+            return -1;
+        }
+        break;
+    }
+
+    case MP_CMD_DUMP_TRACE: {
+        char *file = cmd->args[0].v.s[0] ? cmd->args[0].v.s : opts->dump_trace;
+        if (!file || !file[0]) {
+            MP_ERR(mpctx, "No trace file given.\n");
+            return -1;
+        }
+        file = mp_get_user_path(NULL, mpctx->global, file);
+        bool ok = mp_msg_dump_trace(mpctx->global, file);
+        talloc_free(file);
+        if (!ok)
+            return -1;
+        break;
+    }
+
     case MP_CMD_AO_RELOAD:
         reload_audio_output(mpctx);
         break;
@@ -5728,6 +6576,9 @@ void command_init(struct MPContext *mpctx)
         talloc_zero_array(ctx, struct m_property, num_base + num_opts + 1);
     memcpy(ctx->properties, mp_properties_base, sizeof(mp_properties_base));
 
+    // Index the manual properties, for checking option properties against.
+    sort_properties(ctx);
+
     int count = num_base;
     for (int n = 0; n < num_opts; n++) {
         struct m_config_option *co = m_config_get_co_index(mpctx->mconfig, n);
@@ -5773,12 +6624,14 @@ void command_init(struct MPContext *mpctx)
 
         if (prop.name) {
             // The option might be covered by a manual property already.
-            if (m_property_list_find(ctx->properties, prop.name))
+            if (find_property(ctx, bstr0(prop.name)))
                 continue;
 
             ctx->properties[count++] = prop;
         }
     }
+
+    sort_properties(ctx);
 }
 
 static void command_event(struct MPContext *mpctx, int event, void *arg)
@@ -5808,6 +6661,8 @@ void handle_command_updates(struct MPContext *mpctx)
     // to recheck the state. Then the client(s) will read the property.
     if (ctx->hotplug && ao_hotplug_check_update(ctx->hotplug))
         mp_notify_property(mpctx, "audio-device-list");
+
+    thumbnail_update(mpctx);
 }
 
 void mp_notify(struct MPContext *mpctx, int event, void *arg)
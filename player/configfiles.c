@@ -163,9 +163,15 @@ void mp_load_auto_profiles(struct MPContext *mpctx)
 }
 
 #define MP_WATCH_LATER_CONF "watch_later"
+#define MP_WATCH_LATER_LOG "resume.log"
 
-static char *mp_get_playback_resume_config_filename(struct MPContext *mpctx,
-                                                    const char *fname)
+// Don't bother compacting the log below this size.
+#define RESUME_LOG_COMPACT_SIZE (1024 * 1024)
+
+// Returns the hash identifying the resume entry of fname (as hex string), or
+// NULL on failure.
+static char *get_resume_key(struct MPContext *mpctx, void *ta_parent,
+                            const char *fname)
 {
     struct MPOpts *opts = mpctx->opts;
     char *res = NULL;
@@ -189,10 +195,17 @@ static char *mp_get_playback_resume_config_filename(struct MPContext *mpctx,
         realpath = talloc_asprintf(tmp, "%s - %s", realpath, opts->bluray_device);
     uint8_t md5[16];
     av_md5_sum(md5, realpath, strlen(realpath));
-    char *conf = talloc_strdup(tmp, "");
+    res = talloc_strdup(ta_parent, "");
     for (int i = 0; i < 16; i++)
-        conf = talloc_asprintf_append(conf, "%02X", md5[i]);
+        res = talloc_asprintf_append(res, "%02X", md5[i]);
+
+exit:
+    talloc_free(tmp);
+    return res;
+}
 
+static char *get_watch_later_dir(struct MPContext *mpctx)
+{
     if (!mpctx->cached_watch_later_configdir) {
         char *wl_dir = mpctx->opts->watch_later_directory;
         if (wl_dir && wl_dir[0]) {
@@ -206,14 +219,231 @@ static char *mp_get_playback_resume_config_filename(struct MPContext *mpctx,
             mp_find_user_config_file(mpctx, mpctx->global, MP_WATCH_LATER_CONF);
     }
 
-    if (mpctx->cached_watch_later_configdir)
-        res = mp_path_join(NULL, mpctx->cached_watch_later_configdir, conf);
+    return mpctx->cached_watch_later_configdir;
+}
 
-exit:
-    talloc_free(tmp);
+static char *mp_get_playback_resume_config_filename(struct MPContext *mpctx,
+                                                    const char *fname)
+{
+    char *res = NULL;
+    char *key = get_resume_key(mpctx, NULL, fname);
+    char *dir = get_watch_later_dir(mpctx);
+    if (key && dir)
+        res = mp_path_join(NULL, dir, key);
+    talloc_free(key);
     return res;
 }
 
+// With --watch-later-store=log, all resume entries are appended to a single
+// log file instead of writing one file per entry. Each record is a header line
+// "#<key> <length>" followed by <length> bytes of config file data. Length 0
+// deletes the entry. The index of the latest record per key is built by
+// scanning the record headers once, and is updated incrementally if the log
+// grew (e.g. because another instance appended to it).
+struct resume_record {
+    char key[33];
+    int64_t offset;     // position of the data in the log
+    int len;
+};
+
+struct resume_store {
+    char *filename;
+    int64_t scanned;    // size of the log covered by the index
+    int64_t live_bytes; // size of the records in the index
+    struct resume_record *records; // sorted by key
+    int num_records;
+};
+
+static int cmp_resume_record(const void *a, const void *b)
+{
+    const struct resume_record *r1 = a, *r2 = b;
+    int c = strcmp(r1->key, r2->key);
+    if (c)
+        return c;
+    return r1->offset > r2->offset ? 1 : (r1->offset < r2->offset ? -1 : 0);
+}
+
+static struct resume_record *store_find(struct resume_store *st,
+                                        const char *key)
+{
+    struct resume_record ref = {0};
+    snprintf(ref.key, sizeof(ref.key), "%s", key);
+    int lo = 0, hi = st->num_records;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int c = strcmp(st->records[mid].key, ref.key);
+        if (c == 0)
+            return &st->records[mid];
+        if (c < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+// Index the records appended since the last scan.
+static void store_scan(struct resume_store *st)
+{
+    struct stat s;
+    if (stat(st->filename, &s) || s.st_size == st->scanned)
+        return;
+    if (s.st_size < st->scanned) {
+        // Replaced (compacted by another instance).
+        st->scanned = 0;
+        st->num_records = 0;
+    }
+
+    FILE *f = fopen(st->filename, "rb");
+    if (!f)
+        return;
+
+    int old_num = st->num_records;
+    if (fseeko(f, st->scanned, SEEK_SET) == 0) {
+        char line[80];
+        while (fgets(line, sizeof(line), f)) {
+            struct resume_record r = {0};
+            if (sscanf(line, "#%32s %d", r.key, &r.len) != 2 || r.len < 0)
+                break;
+            r.offset = ftello(f);
+            if (r.offset < 0 || r.offset + r.len > s.st_size)
+                break; // truncated by a concurrent writer
+            if (fseeko(f, r.len, SEEK_CUR))
+                break;
+            MP_TARRAY_APPEND(st, st->records, st->num_records, r);
+            st->scanned = r.offset + r.len;
+        }
+    }
+    fclose(f);
+
+    if (st->num_records == old_num)
+        return;
+
+    // Keep only the latest record per key (records appended later have a
+    // higher offset), and drop deleted entries.
+    qsort(st->records, st->num_records, sizeof(st->records[0]),
+          cmp_resume_record);
+    int num = 0;
+    st->live_bytes = 0;
+    for (int n = 0; n < st->num_records; n++) {
+        struct resume_record *r = &st->records[n];
+        if (n + 1 < st->num_records && !strcmp(r->key, r[1].key))
+            continue;
+        if (r->len) {
+            st->records[num++] = *r;
+            st->live_bytes += r->len;
+        }
+    }
+    st->num_records = num;
+}
+
+static struct resume_store *get_store(struct MPContext *mpctx)
+{
+    if (!mpctx->opts->watch_later_store)
+        return NULL;
+
+    if (!mpctx->resume_store) {
+        char *dir = get_watch_later_dir(mpctx);
+        if (!dir)
+            return NULL;
+        struct resume_store *st = talloc_zero(mpctx, struct resume_store);
+        st->filename = mp_path_join(st, dir, MP_WATCH_LATER_LOG);
+        mpctx->resume_store = st;
+    }
+
+    store_scan(mpctx->resume_store);
+    return mpctx->resume_store;
+}
+
+static char *store_read(struct resume_store *st, void *ta_parent,
+                        const char *key)
+{
+    struct resume_record *r = store_find(st, key);
+    if (!r)
+        return NULL;
+
+    char *data = NULL;
+    FILE *f = fopen(st->filename, "rb");
+    if (f) {
+        data = talloc_size(ta_parent, r->len + 1);
+        if (fseeko(f, r->offset, SEEK_SET) ||
+            fread(data, r->len, 1, f) != 1)
+        {
+            TA_FREEP(&data);
+        } else {
+            data[r->len] = '\0';
+        }
+        fclose(f);
+    }
+    return data;
+}
+
+// Rewrite the log with only the live records, if most of it is garbage.
+static void store_compact(struct MPContext *mpctx, struct resume_store *st)
+{
+    if (st->scanned < RESUME_LOG_COMPACT_SIZE ||
+        st->live_bytes * 2 > st->scanned)
+        return;
+
+    void *tmp = talloc_new(NULL);
+    char *tmpname = talloc_asprintf(tmp, "%s.tmp", st->filename);
+    FILE *in = fopen(st->filename, "rb");
+    FILE *out = fopen(tmpname, "wb");
+    bool ok = in && out;
+    for (int n = 0; ok && n < st->num_records; n++) {
+        struct resume_record *r = &st->records[n];
+        char *data = talloc_size(tmp, r->len);
+        ok = fseeko(in, r->offset, SEEK_SET) == 0 &&
+             fread(data, r->len, 1, in) == 1 &&
+             fprintf(out, "#%s %d\n", r->key, r->len) > 0 &&
+             fwrite(data, r->len, 1, out) == 1;
+        talloc_free(data);
+    }
+    if (in)
+        fclose(in);
+    if (out && fclose(out))
+        ok = false;
+
+    // Don't lose records another instance appended in the meantime.
+    struct stat s;
+    if (ok && (stat(st->filename, &s) || s.st_size != st->scanned))
+        ok = false;
+
+    if (ok && rename(tmpname, st->filename) == 0) {
+        MP_VERBOSE(mpctx, "Compacted %s.\n", st->filename);
+        st->scanned = 0;
+        st->num_records = 0;
+        store_scan(st);
+    } else {
+        unlink(tmpname);
+    }
+    talloc_free(tmp);
+}
+
+// Append a record; an empty data string deletes the entry.
+static void store_write(struct MPContext *mpctx, struct resume_store *st,
+                        const char *key, const char *data)
+{
+    if (!data[0] && !store_find(st, key))
+        return;
+
+    char *rec = talloc_asprintf(NULL, "#%s %d\n%s", key, (int)strlen(data),
+                                data);
+    // Write the record with a single call, so concurrent appends by other
+    // instances don't interleave.
+    int fd = open(st->filename, O_WRONLY | O_CREAT | O_APPEND | O_BINARY, 0666);
+    if (fd >= 0) {
+        if (write(fd, rec, strlen(rec)) != strlen(rec))
+            MP_ERR(mpctx, "Could not write to %s.\n", st->filename);
+        close(fd);
+    }
+    talloc_free(rec);
+
+    store_scan(st);
+    store_compact(mpctx, st);
+}
+
 static const char *const backup_properties[] = {
     "osd-level",
     //"loop",
@@ -284,34 +514,51 @@ static bool needs_config_quoting(const char *s)
     return false;
 }
 
-static void write_filename(struct MPContext *mpctx, FILE *file, char *filename)
+static void write_filename(struct MPContext *mpctx, char **data, char *filename)
 {
     if (mpctx->opts->write_filename_in_watch_later_config) {
         char write_name[1024] = {0};
         for (int n = 0; filename[n] && n < sizeof(write_name) - 1; n++)
             write_name[n] = (unsigned char)filename[n] < 32 ? '_' : filename[n];
-        fprintf(file, "# %s\n", write_name);
+        *data = talloc_asprintf_append(*data, "# %s\n", write_name);
     }
 }
 
-static void write_redirect(struct MPContext *mpctx, char *path)
+// Store the resume entry for path, either in the log or as separate file.
+static void write_resume_entry(struct MPContext *mpctx, char *path, char *data)
 {
+    struct resume_store *st = get_store(mpctx);
+    if (st) {
+        char *key = get_resume_key(mpctx, NULL, path);
+        if (key)
+            store_write(mpctx, st, key, data);
+        talloc_free(key);
+        return;
+    }
+
     char *conffile = mp_get_playback_resume_config_filename(mpctx, path);
     if (conffile) {
         FILE *file = fopen(conffile, "wb");
         if (file) {
-            fprintf(file, "# redirect entry\n");
-            write_filename(mpctx, file, path);
+            fputs(data, file);
             fclose(file);
         }
         talloc_free(conffile);
     }
 }
 
+static void write_redirect(struct MPContext *mpctx, char *path)
+{
+    char *data = talloc_strdup(NULL, "# redirect entry\n");
+    write_filename(mpctx, &data, path);
+    write_resume_entry(mpctx, path, data);
+    talloc_free(data);
+}
+
 void mp_write_watch_later_conf(struct MPContext *mpctx)
 {
     struct playlist_entry *cur = mpctx->playing;
-    char *conffile = NULL;
+    char *data = NULL;
     if (!cur)
         goto exit;
 
@@ -321,23 +568,20 @@ void mp_write_watch_later_conf(struct MPContext *mpctx)
         goto exit;
     }
 
-    conffile = mp_get_playback_resume_config_filename(mpctx, cur->filename);
-    if (!conffile)
+    char *dir = get_watch_later_dir(mpctx);
+    if (!dir)
         goto exit;
 
-    mp_mk_config_dir(mpctx->global, mpctx->cached_watch_later_configdir);
+    mp_mk_config_dir(mpctx->global, dir);
 
     MP_INFO(mpctx, "Saving state.\n");
 
-    FILE *file = fopen(conffile, "wb");
-    if (!file)
-        goto exit;
-
-    write_filename(mpctx, file, cur->filename);
+    data = talloc_strdup(NULL, "");
+    write_filename(mpctx, &data, cur->filename);
 
     double pos = get_current_time(mpctx);
     if (pos != MP_NOPTS_VALUE)
-        fprintf(file, "start=%f\n", pos);
+        data = talloc_asprintf_append(data, "start=%f\n", pos);
     for (int i = 0; backup_properties[i]; i++) {
         const char *pname = backup_properties[i];
         char *val = NULL;
@@ -350,15 +594,16 @@ void mp_write_watch_later_conf(struct MPContext *mpctx)
             if (!prev || strcmp(prev, val) != 0) {
                 if (needs_config_quoting(val)) {
                     // e.g. '%6%STRING'
-                    fprintf(file, "%s=%%%d%%%s\n", pname, (int)strlen(val), val);
+                    data = talloc_asprintf_append(data, "%s=%%%d%%%s\n", pname,
+                                                  (int)strlen(val), val);
                 } else {
-                    fprintf(file, "%s=%s\n", pname, val);
+                    data = talloc_asprintf_append(data, "%s=%s\n", pname, val);
                 }
             }
         }
         talloc_free(val);
     }
-    fclose(file);
+    write_resume_entry(mpctx, cur->filename, data);
 
     // This allows us to recursively resume directories etc., whose entries are
     // expanded the first time it's "played". For example, if "/a/b/c.mkv" is
@@ -392,13 +637,33 @@ void mp_write_watch_later_conf(struct MPContext *mpctx)
     }
 
 exit:
-    talloc_free(conffile);
+    talloc_free(data);
 }
 
 void mp_load_playback_resume(struct MPContext *mpctx, const char *file)
 {
     if (!mpctx->opts->position_resume)
         return;
+
+    struct resume_store *st = get_store(mpctx);
+    if (st) {
+        char *key = get_resume_key(mpctx, NULL, file);
+        char *data = key ? store_read(st, key, key) : NULL;
+        bool found = !!data;
+        if (found) {
+            m_config_backup_opt(mpctx->mconfig, "start");
+            MP_INFO(mpctx, "Resuming playback. This behavior can "
+                   "be disabled with --no-resume-playback.\n");
+            m_config_parse(mpctx->mconfig, st->filename, bstr0(data), NULL,
+                           M_SETOPT_PRESERVE_CMDLINE);
+            store_write(mpctx, st, key, "");
+        }
+        talloc_free(key);
+        if (found)
+            return;
+        // Fall back to entries written without the log.
+    }
+
     char *fname = mp_get_playback_resume_config_filename(mpctx, file);
     if (fname && mp_path_exists(fname)) {
         // Never apply the saved start position to following files
@@ -421,7 +686,15 @@ struct playlist_entry *mp_check_playlist_resume(struct MPContext *mpctx,
 {
     if (!mpctx->opts->position_resume)
         return NULL;
+    struct resume_store *st = get_store(mpctx);
     for (struct playlist_entry *e = playlist->first; e; e = e->next) {
+        if (st) {
+            char *key = get_resume_key(mpctx, NULL, e->filename);
+            bool exists = key && store_find(st, key);
+            talloc_free(key);
+            if (exists)
+                return e;
+        }
         char *conf = mp_get_playback_resume_config_filename(mpctx, e->filename);
         bool exists = conf && mp_path_exists(conf);
         talloc_free(conf);
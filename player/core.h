@@ -83,6 +83,7 @@ enum seek_precision {
 enum seek_flags {
     MPSEEK_FLAG_DELAY = 1 << 0, // give player chance to coalesce multiple seeks
     MPSEEK_FLAG_NOFLUSH = 1 << 1, // keeping remaining data for seamless loops
+    MPSEEK_FLAG_STEP_CACHE = 1 << 2, // target may be in the frame step cache
 };
 
 struct seek_params {
@@ -165,6 +166,13 @@ struct track {
 };
 
 // Summarizes video filtering and output.
+// Entry in vo_chain.step_cache.
+struct step_cache_frame {
+    struct mp_image *img;
+    // pts of the directly preceding frame, or MP_NOPTS_VALUE if unknown.
+    double prev_pts;
+};
+
 struct vo_chain {
     struct mp_log *log;
 
@@ -189,6 +197,20 @@ struct vo_chain {
     bool is_coverart;
     // Just to avoid decoding the coverart picture again after a seek.
     struct mp_image *cached_coverart;
+
+    // Last time the --framedrop=decoder-tiered level was changed.
+    double framedrop_level_time;
+
+    // Recently filtered frames for --frame-step-cache, sorted by pts.
+    struct step_cache_frame *step_cache;
+    int num_step_cache;
+    int64_t step_cache_bytes;
+    // pts of the last frame added since the last seek.
+    double step_cache_prev_pts;
+    int step_cache_drops;   // decoder frame drop count at the last frame
+    // Frames up to this pts were shown from the cache after a seek, and are
+    // dropped when they're decoded again.
+    double step_cache_skip_pts;
 };
 
 // Like vo_chain, for audio.
@@ -219,6 +241,12 @@ struct ao_chain {
     struct track *track;
     struct lavfi_pad *filter_src;
     struct dec_audio *audio_src;
+
+    // Output latency (ao_get_delay()) after each write to the AO. Bucket 0
+    // counts latencies below 2 ms, bucket n latencies in [2^n, 2^(n+1)) ms,
+    // and the last bucket all latencies above that.
+#define AUDIO_LATENCY_HIST_BUCKETS 12
+    uint64_t latency_hist[AUDIO_LATENCY_HIST_BUCKETS];
 };
 
 /* Note that playback can be paused, stopped, etc. at any time. While paused,
@@ -239,6 +267,9 @@ enum playback_status {
 
 #define NUM_PTRACKS 2
 
+// Upper limit for --video-lookahead.
+#define MAX_VIDEO_LOOKAHEAD 16
+
 typedef struct MPContext {
     bool initialized;
     bool autodetach;
@@ -264,6 +295,7 @@ typedef struct MPContext {
     char *term_osd_status;
     char *term_osd_subs;
     char *term_osd_contents;
+    double term_osd_last_update;
     char *last_window_title;
     struct voctrl_playback_state vo_playback_state;
 
@@ -321,13 +353,19 @@ typedef struct MPContext {
     struct ao *ao;
     struct mp_aframe *ao_decoder_fmt; // for weak gapless audio check
     struct ao_chain *ao_chain;
+    // Decoder started on the prefetched file (see preload_audio_decoder()),
+    // kept until the audio chain of the new file takes it.
+    struct dec_audio *preloaded_audio_decoder;
 
     struct vo_chain *vo_chain;
+    // Decoder of the previous vo_chain, kept for reuse (see video_reuse()).
+    struct dec_video *spare_video_decoder;
 
     struct vo *video_out;
     // next_frame[0] is the next frame, next_frame[1] the one after that.
-    // The +1 is for adding 1 additional frame in backstep mode.
-    struct mp_image *next_frames[VO_MAX_REQ_FRAMES + 1];
+    // The +1 is for adding 1 additional frame in backstep mode. Frames beyond
+    // what the VO requests are decoded ahead (--video-lookahead).
+    struct mp_image *next_frames[VO_MAX_REQ_FRAMES + 1 + MAX_VIDEO_LOOKAHEAD];
     int num_next_frames;
     struct mp_image *saved_frame;   // for hrseek_lastframe and hrseek_backstep
 
@@ -351,7 +389,18 @@ typedef struct MPContext {
     bool hrseek_framedrop;  // allow decoder to drop frames before hrseek_pts
     bool hrseek_lastframe;  // drop everything until last frame reached
     bool hrseek_backstep;   // go to frame before seek target
+    bool hrseek_cached;     // seek target may be in the frame step cache
     double hrseek_pts;
+    int hrseek_skipped;     // frames decoded and discarded before hrseek_pts
+    double hrseek_first_pts; // pts of the first discarded frame
+    // Preroll cost of the last completed hr-seek (hr-seek-stats property)
+    struct {
+        bool valid;
+        int skipped;        // frames decoded and discarded
+        int dropped;        // frames the decoder skipped without output
+        double preroll;     // media time between first frame and target
+        double time;        // wall time from seek to playback restart
+    } last_hrseek;
     struct seek_params current_seek;
     bool ab_loop_clip;      // clip to the "b" part of an A-B loop if available
     // AV sync: the next frame should be shown when the audio out has this
@@ -397,6 +446,19 @@ typedef struct MPContext {
 
     double sleeptime;      // number of seconds to sleep before next iteration
 
+    // Playloop statistics, for the playloop-stats property.
+    struct mp_playloop_stats {
+        int64_t iterations;
+        int64_t wakeup_immediate;   // didn't sleep (timeout was 0)
+        int64_t wakeup_timeout;     // timeout elapsed
+        int64_t wakeup_interrupt;   // mp_wakeup_core() or similar
+        int64_t dispatch_runs;      // sleeps during which dispatch items ran
+        int64_t core_locks;         // sleeps during which a client locked us
+        int64_t busy_time;          // time spent outside of sleeping (us)
+        int64_t busy_time_max;      // maximum busy time per iteration (us)
+        int64_t last_wakeup;        // mp_time_us() when sleeping ended
+    } playloop_stats;
+
     double mouse_timer;
     unsigned int mouse_event_ts;
     bool mouse_cursor_visible;
@@ -411,6 +473,10 @@ typedef struct MPContext {
 
     struct seek_params seek;
 
+    // mp_time_us() arrival time of the oldest user command whose effect has
+    // not been sent to the VO yet (0 if none). See vo_frame.input_time.
+    int64_t input_time;
+
     // Allow audio to issue a second seek if audio is too far ahead (for non-hr
     // seeks with external audio tracks).
     bool audio_allow_second_chance_seek;
@@ -435,6 +501,18 @@ typedef struct MPContext {
     double cache_stop_time, cache_wait_time;
     int cache_buffer;
 
+    // Buffering model (see update_cache_model()). Rates are in media seconds
+    // per second. The estimates are -1 if unknown or not applicable.
+    double cache_fill_rate;         // smoothed demuxer fill rate
+    double cache_last_duration, cache_last_time, cache_last_speed;
+    double cache_underrun_time;     // time until the buffer runs empty
+    double cache_needed_time;       // buffer needed for uninterrupted playback
+
+    // --hls-bitrate=auto state. hls_throughput is the last download rate
+    // reported by the demuxer (bits/s), and is kept across files.
+    double hls_throughput;
+    double next_hls_check, last_hls_switch;
+
     // Set after showing warning about decoding being too slow for realtime
     // playback rate. Used to avoid showing it multiple times.
     bool drop_message_shown;
@@ -442,8 +520,19 @@ typedef struct MPContext {
     struct mp_recorder *recorder;
 
     char *cached_watch_later_configdir;
+    struct resume_store *resume_store;
+
+    // Timestamps of the startup phases, up to playback start of the first
+    // file (see mp_startup_mark()).
+    struct mp_startup_mark {
+        const char *name;
+        int64_t time;
+    } *startup_marks;
+    int num_startup_marks;
+    bool startup_done;
 
     struct screenshot_ctx *screenshot_ctx;
+    struct thumbnail_ctx *thumbnail_ctx;
     struct command_ctx *command_ctx;
     struct encode_lavc_context *encode_lavc_ctx;
 
@@ -470,12 +559,18 @@ typedef struct MPContext {
     //     to true.
     struct demuxer *open_res_demuxer;
     int open_res_error;
+    // --- Owned by MPContext, only valid if open_done is true
+    struct dec_audio *open_res_audio; // decoding ahead from open_res_demuxer
+    bool open_audio_tried;
 } MPContext;
 
 // audio.c
 void reset_audio_state(struct MPContext *mpctx);
 void reinit_audio_chain(struct MPContext *mpctx);
 int init_audio_decoder(struct MPContext *mpctx, struct track *track);
+struct dec_audio *preload_audio_decoder(struct MPContext *mpctx,
+                                        struct sh_stream *sh);
+void uninit_preloaded_audio_decoder(struct MPContext *mpctx);
 int reinit_audio_filters(struct MPContext *mpctx);
 double playing_audio_pts(struct MPContext *mpctx);
 void fill_audio_out_buffers(struct MPContext *mpctx);
@@ -538,6 +633,8 @@ void mp_destroy(struct MPContext *mpctx);
 void mp_print_version(struct mp_log *log, int always);
 void mp_update_logging(struct MPContext *mpctx, bool preinit);
 void issue_refresh_seek(struct MPContext *mpctx, enum seek_precision min_prec);
+void mp_startup_mark(struct MPContext *mpctx, const char *name);
+void mp_startup_done(struct MPContext *mpctx);
 
 // misc.c
 double rel_time_to_abs(struct MPContext *mpctx, struct m_rel_time t);
@@ -614,10 +711,19 @@ void uninit_sub_all(struct MPContext *mpctx);
 void update_osd_msg(struct MPContext *mpctx);
 bool update_subtitles(struct MPContext *mpctx, double video_pts);
 
+// thumbnail.c
+struct mpv_node;
+bool thumbnail_get(struct MPContext *mpctx, double time, int width,
+                   struct mp_image **out_img, double *out_pts);
+void thumbnail_get_cache(struct MPContext *mpctx, struct mpv_node *dst);
+void thumbnail_update(struct MPContext *mpctx);
+void thumbnail_uninit(struct MPContext *mpctx);
+
 // video.c
 int video_get_colors(struct vo_chain *vo_c, const char *item, int *value);
 int video_set_colors(struct vo_chain *vo_c, const char *item, int value);
 void reset_video_state(struct MPContext *mpctx);
+bool video_step_cache_seek(struct MPContext *mpctx, int dir);
 int init_video_decoder(struct MPContext *mpctx, struct track *track);
 void reinit_video_chain(struct MPContext *mpctx);
 void reinit_video_chain_src(struct MPContext *mpctx, struct track *track);
@@ -626,6 +732,7 @@ void write_video(struct MPContext *mpctx);
 void mp_force_video_refresh(struct MPContext *mpctx);
 void uninit_video_out(struct MPContext *mpctx);
 void uninit_video_chain(struct MPContext *mpctx);
+void uninit_spare_video_decoder(struct MPContext *mpctx);
 double calc_average_frame_duration(struct MPContext *mpctx);
 int init_video_decoder(struct MPContext *mpctx, struct track *track);
 void recreate_auto_filters(struct MPContext *mpctx);
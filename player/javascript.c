@@ -675,7 +675,7 @@ static void script_get_property_osd(js_State *J, void *af)
         js_pushstring(J, res);
 }
 
-// args: id, name, type
+// args: id, name, type, interval
 static void script__observe_property(js_State *J)
 {
     const char *fmts[] = {"none", "native", "bool", "string", "number", NULL};
@@ -683,9 +683,10 @@ static void script__observe_property(js_State *J)
                              MPV_FORMAT_STRING, MPV_FORMAT_DOUBLE};
 
     mpv_format f = mf[checkopt(J, 3, "none", fmts, "observe type")];
-    int e = mpv_observe_property(jclient(J), js_tonumber(J, 1),
-                                             js_tostring(J, 2),
-                                             f);
+    double interval = js_isundefined(J, 4) ? 0 : js_tonumber(J, 4);
+    int e = mpv_observe_property_interval(jclient(J), js_tonumber(J, 1),
+                                                      js_tostring(J, 2),
+                                                      f, interval);
     push_status(J, e);
 }
 
@@ -1237,7 +1238,7 @@ static const struct fn_entry main_fns[] = {
     FN_ENTRY(set_property_bool, 2),
     FN_ENTRY(set_property_number, 2),
     AF_ENTRY(set_property_native, 2),
-    FN_ENTRY(_observe_property, 3),
+    FN_ENTRY(_observe_property, 4),
     FN_ENTRY(_unobserve_property, 1),
     FN_ENTRY(get_time_ms, 0),
     AF_ENTRY(format_time, 2),
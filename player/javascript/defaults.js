@@ -58,10 +58,10 @@ function dispatch_event(e) {
 var next_oid = 1,
     observers = new_cache();  // items of id: fn
 
-mp.observe_property = function(name, format, fn) {
+mp.observe_property = function(name, format, fn, interval) {
     var id = next_oid++;
     observers[id] = fn;
-    return mp._observe_property(id, name, format || undefined);  // allow null
+    return mp._observe_property(id, name, format || undefined, interval);
 }
 
 mp.unobserve_property = function(fn) {
@@ -210,6 +210,7 @@ var next_tid = 1,
     timers = [],  // while in process_timers, just insertion-ordered (push)
     tset_is_push = false,  // signal set_timer that we're in process_timers
     tcanceled = false,  // or object of items timer-id: true
+    timer_slack = 1,  // ms. timers due within it fire in the same wakeup
     now = mp.get_time_ms;  // just an alias
 
 function insert_sorted(arr, t) {
@@ -251,7 +252,10 @@ g.clearTimeout = g.clearInterval = function(id) {
 
 // arr: ordered timers array. ret: -1: no timers, 0: due, positive: ms to wait
 function peek_wait(arr) {
-    return arr.length ? Math.max(0, arr[arr.length - 1].when - now()) : -1;
+    if (!arr.length)
+        return -1;
+    var wait = arr[arr.length - 1].when - now();
+    return wait > timer_slack ? wait : 0;
 }
 
 // Callback all due non-canceled timers which were inserted before calling us.
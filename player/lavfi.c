@@ -35,6 +35,7 @@
 
 #include "common/common.h"
 #include "common/av_common.h"
+#include "common/lavfi_threads.h"
 #include "common/msg.h"
 
 #include "audio/format.h"
@@ -49,6 +50,7 @@
 struct lavfi {
     struct mp_log *log;
     char *graph_string;
+    struct mp_lavfi_threads *threads;
 
     struct mp_hwdec_devices *hwdec_devs;
 
@@ -165,6 +167,7 @@ static void precreate_graph(struct lavfi *c)
     c->graph = avfilter_graph_alloc();
     if (!c->graph)
         abort();
+    mp_lavfi_threads_setup(c->threads, c->graph);
     AVFilterInOut *in = NULL, *out = NULL;
     if (avfilter_graph_parse2(c->graph, c->graph_string, &in, &out) < 0) {
         c->graph = NULL;
@@ -231,10 +234,12 @@ void lavfi_seek_reset(struct lavfi *c)
     precreate_graph(c);
 }
 
-struct lavfi *lavfi_create(struct mp_log *log, char *graph_string)
+struct lavfi *lavfi_create(struct mpv_global *global, struct mp_log *log,
+                          char *graph_string)
 {
     struct lavfi *c = talloc_zero(NULL, struct lavfi);
     c->log = log;
+    c->threads = mp_lavfi_threads_create(c, global, log);
     c->graph_string = graph_string;
     c->tmp_frame = av_frame_alloc();
     if (!c->tmp_frame)
@@ -2,6 +2,7 @@
 #define MP_LAVFI
 
 struct mp_log;
+struct mpv_global;
 struct lavfi;
 struct lavfi_pad;
 struct mp_image;
@@ -12,7 +13,8 @@ enum lavfi_direction {
     LAVFI_OUT,
 };
 
-struct lavfi *lavfi_create(struct mp_log *log, char *graph_string);
+struct lavfi *lavfi_create(struct mpv_global *global, struct mp_log *log,
+                          char *graph_string);
 const char *lavfi_get_graph(struct lavfi *c);
 void lavfi_destroy(struct lavfi *c);
 struct lavfi_pad *lavfi_find_pad(struct lavfi *c, char *name);
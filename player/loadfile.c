@@ -41,6 +41,7 @@
 #include "common/common.h"
 #include "common/encode.h"
 #include "common/recorder.h"
+#include "misc/thread_sched.h"
 #include "input/input.h"
 
 #include "audio/decode/dec_audio.h"
@@ -54,6 +55,7 @@
 
 #include "core.h"
 #include "command.h"
+#include "client.h"
 #include "libmpv/client.h"
 
 // Called by foreign threads when playback should be stopped and such.
@@ -321,7 +323,7 @@ static int match_lang(char **langs, char *lang)
  */
 // Return whether t1 is preferred over t2
 static bool compare_track(struct track *t1, struct track *t2, char **langs,
-                          struct MPOpts *opts)
+                          int hls_bitrate, struct MPOpts *opts)
 {
     if (!opts->autoload_files && t1->is_external != t2->is_external)
         return !t1->is_external;
@@ -340,11 +342,11 @@ static bool compare_track(struct track *t1, struct track *t2, char **langs,
         return t1->default_track;
     if (t1->attached_picture != t2->attached_picture)
         return !t1->attached_picture;
-    if (t1->stream && t2->stream && opts->hls_bitrate >= 0 &&
+    if (t1->stream && t2->stream && hls_bitrate >= 0 &&
         t1->stream->hls_bitrate != t2->stream->hls_bitrate)
     {
-        bool t1_ok = t1->stream->hls_bitrate <= opts->hls_bitrate;
-        bool t2_ok = t2->stream->hls_bitrate <= opts->hls_bitrate;
+        bool t1_ok = t1->stream->hls_bitrate <= hls_bitrate;
+        bool t2_ok = t2->stream->hls_bitrate <= hls_bitrate;
         if (t1_ok != t2_ok)
             return t1_ok;
         if (t1_ok && t2_ok)
@@ -365,6 +367,12 @@ struct track *select_default_track(struct MPContext *mpctx, int order,
     if (tid == -2 || ffid == -2)
         return NULL;
     bool select_fallback = type == STREAM_VIDEO || type == STREAM_AUDIO;
+    int hls_bitrate = opts->hls_bitrate;
+    if (hls_bitrate == -2) {
+        // auto: leave some headroom, and start with the lowest variant until
+        // the demuxer has measured anything.
+        hls_bitrate = MPMIN(mpctx->hls_throughput * 0.7, INT_MAX);
+    }
     struct track *pick = NULL;
     for (int n = 0; n < mpctx->num_tracks; n++) {
         struct track *track = mpctx->tracks[n];
@@ -374,7 +382,7 @@ struct track *select_default_track(struct MPContext *mpctx, int order,
             return track;
         if (track->ff_index == ffid)
             return track;
-        if (!pick || compare_track(track, pick, langs, mpctx->opts))
+        if (!pick || compare_track(track, pick, langs, hls_bitrate, opts))
             pick = track;
     }
     if (pick && !select_fallback && !(pick->is_external && !pick->no_default)
@@ -568,10 +576,63 @@ bool mp_remove_track(struct MPContext *mpctx, struct track *track)
     return true;
 }
 
-// Add the given file as additional track. Only tracks of type "filter" are
-// included; pass STREAM_TYPE_COUNT to disable filtering.
-struct track *mp_add_external_file(struct MPContext *mpctx, char *filename,
-                                   enum stream_type filter)
+// How an external file added with the given filter is opened.
+static void get_external_params(struct MPOpts *opts, enum stream_type filter,
+                                char **force_format, bool *rebase)
+{
+    *force_format = NULL;
+    switch (filter) {
+    case STREAM_SUB:
+        *force_format = opts->sub_demuxer_name;
+        break;
+    case STREAM_AUDIO:
+        *force_format = opts->audio_demuxer_name;
+        break;
+    }
+    *rebase = filter != STREAM_SUB && opts->rebase_start_time;
+}
+
+// Return the demuxer of an already added external file, if it was opened the
+// same way as it would be opened for the given filter.
+static struct demuxer *find_external_demuxer(struct MPContext *mpctx,
+                                             char *filename,
+                                             enum stream_type filter)
+{
+    char *format, *t_format;
+    bool rebase, t_rebase;
+    get_external_params(mpctx->opts, filter, &format, &rebase);
+
+    for (int n = 0; n < mpctx->num_tracks; n++) {
+        struct track *t = mpctx->tracks[n];
+        if (!t->is_external || !t->external_filename ||
+            strcmp(t->external_filename, filename) != 0)
+            continue;
+        // (Inverse of what mp_add_external_file() does.)
+        enum stream_type t_filter = t->no_default ? STREAM_TYPE_COUNT : t->type;
+        get_external_params(mpctx->opts, t_filter, &t_format, &t_rebase);
+        if (rebase == t_rebase &&
+            (format == t_format || (format && t_format &&
+                                    strcmp(format, t_format) == 0)))
+            return t->demuxer;
+    }
+    return NULL;
+}
+
+static struct track *find_track_by_stream(struct MPContext *mpctx,
+                                          struct sh_stream *sh)
+{
+    for (int n = 0; n < mpctx->num_tracks; n++) {
+        if (mpctx->tracks[n]->stream == sh)
+            return mpctx->tracks[n];
+    }
+    return NULL;
+}
+
+// If share is set and the file was already added, its demuxer is reused, so
+// that e.g. audio and subtitle tracks from the same file share a connection
+// and packet cache.
+static struct track *add_external_file(struct MPContext *mpctx, char *filename,
+                                       enum stream_type filter, bool share)
 {
     struct MPOpts *opts = mpctx->opts;
     if (!filename)
@@ -582,29 +643,35 @@ struct track *mp_add_external_file(struct MPContext *mpctx, char *filename,
         disp_filename = "memory://"; // avoid noise
 
     struct demuxer_params params = {0};
-
-    switch (filter) {
-    case STREAM_SUB:
-        params.force_format = opts->sub_demuxer_name;
-        break;
-    case STREAM_AUDIO:
-        params.force_format = opts->audio_demuxer_name;
-        break;
-    }
+    bool rebase;
+    get_external_params(opts, filter, &params.force_format, &rebase);
 
     struct demuxer *demuxer =
-        demux_open_url(filename, &params, mpctx->playback_abort, mpctx->global);
-    if (!demuxer)
-        goto err_out;
-    enable_demux_thread(mpctx, demuxer);
+        share ? find_external_demuxer(mpctx, filename, filter) : NULL;
+    bool shared = !!demuxer;
+    if (shared) {
+        MP_VERBOSE(mpctx, "Reusing demuxer of external file %s.\n",
+                   disp_filename);
+    } else {
+        demuxer = demux_open_url(filename, &params, mpctx->playback_abort,
+                                 mpctx->global);
+        if (!demuxer)
+            goto err_out;
+        enable_demux_thread(mpctx, demuxer);
 
-    if (filter != STREAM_SUB && opts->rebase_start_time)
-        demux_set_ts_offset(demuxer, -demuxer->start_time);
+        if (rebase)
+            demux_set_ts_offset(demuxer, -demuxer->start_time);
+    }
 
     struct track *first = NULL;
     for (int n = 0; n < demux_get_num_stream(demuxer); n++) {
         struct sh_stream *sh = demux_get_stream(demuxer, n);
         if (filter == STREAM_TYPE_COUNT || sh->type == filter) {
+            struct track *existing = shared ? find_track_by_stream(mpctx, sh) : NULL;
+            if (existing) {
+                first = existing;
+                continue;
+            }
             struct track *t = add_stream_track(mpctx, demuxer, sh);
             t->is_external = true;
             t->title = talloc_strdup(t, mp_basename(disp_filename));
@@ -615,7 +682,8 @@ struct track *mp_add_external_file(struct MPContext *mpctx, char *filename,
         }
     }
     if (!first) {
-        free_demuxer_and_stream(demuxer);
+        if (!shared)
+            free_demuxer_and_stream(demuxer);
         MP_WARN(mpctx, "No streams added from file %s.\n", disp_filename);
         goto err_out;
     }
@@ -627,11 +695,19 @@ err_out:
     return false;
 }
 
+// Add the given file as additional track. Only tracks of type "filter" are
+// included; pass STREAM_TYPE_COUNT to disable filtering.
+struct track *mp_add_external_file(struct MPContext *mpctx, char *filename,
+                                   enum stream_type filter)
+{
+    return add_external_file(mpctx, filename, filter, false);
+}
+
 static void open_external_files(struct MPContext *mpctx, char **files,
                                 enum stream_type filter)
 {
     for (int n = 0; files && files[n]; n++)
-        mp_add_external_file(mpctx, files[n], filter);
+        add_external_file(mpctx, files[n], filter, true);
 }
 
 void autoload_external_files(struct MPContext *mpctx)
@@ -670,7 +746,8 @@ void autoload_external_files(struct MPContext *mpctx)
             goto skip;
         if (list[i].type == STREAM_AUDIO && !sc[STREAM_VIDEO])
             goto skip;
-        struct track *track = mp_add_external_file(mpctx, filename, list[i].type);
+        struct track *track = add_external_file(mpctx, filename, list[i].type,
+                                                true);
         if (track) {
             track->auto_loaded = true;
             if (!track->lang)
@@ -845,6 +922,10 @@ static void cancel_open(struct MPContext *mpctx)
     TA_FREEP(&mpctx->open_url);
     TA_FREEP(&mpctx->open_format);
 
+    audio_uninit(mpctx->open_res_audio);
+    mpctx->open_res_audio = NULL;
+    mpctx->open_audio_tried = false;
+
     if (mpctx->open_res_demuxer)
         free_demuxer_and_stream(mpctx->open_res_demuxer);
     mpctx->open_res_demuxer = NULL;
@@ -921,6 +1002,8 @@ static void open_demux_reentrant(struct MPContext *mpctx)
         mpctx->demuxer = mpctx->open_res_demuxer;
         mpctx->open_res_demuxer = NULL;
         mpctx->open_cancel = NULL;
+        mpctx->preloaded_audio_decoder = mpctx->open_res_audio;
+        mpctx->open_res_audio = NULL;
     } else {
         mpctx->error_playing = mpctx->open_res_error;
         pthread_mutex_lock(&mpctx->lock);
@@ -931,6 +1014,38 @@ static void open_demux_reentrant(struct MPContext *mpctx)
     cancel_open(mpctx); // cleanup
 }
 
+// With gapless audio, start decoding the default audio stream of the
+// prefetched file, so the decoder start-up doesn't delay the transition.
+// The decoder is used only if the new file really selects this stream.
+static void preload_audio(struct MPContext *mpctx)
+{
+    struct demuxer *demuxer = mpctx->open_res_demuxer;
+    if (mpctx->open_audio_tried || !demuxer || !mpctx->opts->gapless_audio ||
+        mpctx->encode_lavc_ctx)
+        return;
+    mpctx->open_audio_tried = true;
+
+    struct sh_stream *sh = NULL;
+    for (int n = 0; n < demux_get_num_stream(demuxer); n++) {
+        struct sh_stream *s = demux_get_stream(demuxer, n);
+        if (s->type == STREAM_AUDIO && (!sh || (s->default_track &&
+                                                !sh->default_track)))
+            sh = s;
+    }
+    if (!sh)
+        return;
+
+    MP_VERBOSE(mpctx, "Preloading audio of: %s\n", mpctx->open_url);
+
+    // Must be the same as what play_current_file() will set.
+    if (mpctx->opts->rebase_start_time)
+        demux_set_ts_offset(demuxer, -demuxer->start_time);
+    demuxer_select_track(demuxer, sh, MP_NOPTS_VALUE, true);
+    enable_demux_thread(mpctx, demuxer);
+
+    mpctx->open_res_audio = preload_audio_decoder(mpctx, sh);
+}
+
 void prefetch_next(struct MPContext *mpctx)
 {
     if (!mpctx->opts->prefetch_open)
@@ -941,6 +1056,9 @@ void prefetch_next(struct MPContext *mpctx)
         MP_VERBOSE(mpctx, "Prefetching: %s\n", new_entry->filename);
         start_open(mpctx, new_entry->filename, new_entry->stream_flags);
     }
+
+    if (mpctx->open_active && atomic_load(&mpctx->open_done))
+        preload_audio(mpctx);
 }
 
 // Destroy the complex filter, and remove the references to the filter pads.
@@ -1014,7 +1132,7 @@ static int reinit_complex_filters(struct MPContext *mpctx, bool force_uninit)
         goto done;
     }
 
-    mpctx->lavfi = lavfi_create(mpctx->log, graph);
+    mpctx->lavfi = lavfi_create(mpctx->global, mpctx->log, graph);
     if (!mpctx->lavfi)
         goto done;
 
@@ -1095,8 +1213,17 @@ static int reinit_complex_filters(struct MPContext *mpctx, bool force_uninit)
     for (int n = 0; n < mpctx->num_tracks; n++) {
         struct track *track = mpctx->tracks[n];
         if (track->sink && track->type == STREAM_VIDEO) {
-            if (!track->d_video && !init_video_decoder(mpctx, track))
-                goto done;
+            if (!track->d_video) {
+                if (!init_video_decoder(mpctx, track))
+                    goto done;
+                // Decode each input on its own thread, so that filter graphs
+                // with multiple video inputs don't decode all of them on the
+                // playloop thread. This needs a thread-safe packet source.
+                if (mpctx->opts->demuxer_thread) {
+                    video_start_thread(track->d_video, 4, mp_wakeup_core_cb,
+                                       mpctx);
+                }
+            }
         }
         if (track->sink && track->type == STREAM_AUDIO) {
             if (!track->d_audio && !init_audio_decoder(mpctx, track))
@@ -1154,6 +1281,7 @@ static void play_current_file(struct MPContext *mpctx)
     mpctx->paused_for_cache = false;
     mpctx->cache_buffer = -1;
     mpctx->playing_msg_shown = false;
+    mpctx->last_hrseek.valid = false;
     mpctx->max_frames = -1;
     mpctx->video_speed = mpctx->audio_speed = opts->playback_speed;
     mpctx->speed_factor_a = mpctx->speed_factor_v = 1.0;
@@ -1213,6 +1341,7 @@ reopen_file:
     }
 
     open_demux_reentrant(mpctx);
+    mp_startup_mark(mpctx, "demux-open");
     if (!mpctx->demuxer || mpctx->stop_play)
         goto terminate_playback;
 
@@ -1297,7 +1426,11 @@ reopen_file:
     update_playback_speed(mpctx);
 
     reinit_video_chain(mpctx);
+    uninit_spare_video_decoder(mpctx); // if the new file didn't take it
+    mp_startup_mark(mpctx, "video-init");
     reinit_audio_chain(mpctx);
+    uninit_preloaded_audio_decoder(mpctx); // if the new file didn't take it
+    mp_startup_mark(mpctx, "audio-init");
     reinit_sub_all(mpctx);
 
     if (!mpctx->vo_chain && !mpctx->ao_chain && opts->stream_auto_sel) {
@@ -1373,9 +1506,12 @@ terminate_playback:
 
     close_recorder(mpctx);
 
+    thumbnail_uninit(mpctx);
+
     // time to uninit all, except global stuff:
     reinit_complex_filters(mpctx, true);
     uninit_audio_chain(mpctx);
+    uninit_preloaded_audio_decoder(mpctx);
     uninit_video_chain(mpctx);
     uninit_sub_all(mpctx);
     uninit_demuxer(mpctx);
@@ -1384,6 +1520,8 @@ terminate_playback:
 
     mpctx->playback_initialized = false;
 
+    mp_client_update_snapshot(mpctx);
+
     if (mpctx->stop_play == PT_RELOAD_FILE) {
         mpctx->stop_play = KEEP_PLAYING;
         mp_cancel_reset(mpctx->playback_abort);
@@ -1503,6 +1641,8 @@ struct playlist_entry *mp_next_file(struct MPContext *mpctx, int direction,
 // Return if all done.
 void mp_play_files(struct MPContext *mpctx)
 {
+    mp_thread_set_role(mpctx->global, mpctx->log, MP_THREAD_ROLE_CORE);
+
     prepare_playlist(mpctx, mpctx->playlist);
 
     for (;;) {
@@ -1550,9 +1690,9 @@ static void set_track_recorder_sink(struct track *track,
     if (track->d_sub)
         sub_set_recorder_sink(track->d_sub, sink);
     if (track->d_video)
-        track->d_video->recorder_sink = sink;
+        video_set_recorder_sink(track->d_video, sink);
     if (track->d_audio)
-        track->d_audio->recorder_sink = sink;
+        audio_set_recorder_sink(track->d_audio, sink);
     track->remux_sink = sink;
 }
 
@@ -1610,8 +1750,15 @@ void open_recorder(struct MPContext *mpctx, bool on_init)
         return;
     }
 
-    if (!on_init)
+    if (!on_init) {
         mp_recorder_mark_discontinuity(mpctx->recorder);
+        // Start with the already played packets still in the demuxer cache.
+        // This must happen before the decoders feed new packets.
+        if (mpctx->opts->record_backlog > 0 && mpctx->demuxer) {
+            demux_cache_dump_backlog(mpctx->demuxer, mpctx->opts->record_backlog,
+                                     mpctx->recorder, streams, num_streams);
+        }
+    }
 
     int n_stream = 0;
     for (int n = 0; n < mpctx->num_tracks; n++) {
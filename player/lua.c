@@ -473,7 +473,7 @@ static int script_wait_event(lua_State *L)
 
     mpv_event *event = mpv_wait_event(ctx->client, luaL_optnumber(L, 1, 1e20));
 
-    lua_newtable(L); // event
+    lua_createtable(L, 0, 4); // event
     lua_pushstring(L, mpv_event_name(event->event_id)); // event name
     lua_setfield(L, -2, "event"); // event
 
@@ -502,11 +502,10 @@ static int script_wait_event(lua_State *L)
     case MPV_EVENT_CLIENT_MESSAGE: {
         mpv_event_client_message *msg = event->data;
 
-        lua_newtable(L); // event args
+        lua_createtable(L, msg->num_args, 0); // event args
         for (int n = 0; n < msg->num_args; n++) {
-            lua_pushinteger(L, n + 1); // event args N
-            lua_pushstring(L, msg->args[n]); // event args N val
-            lua_settable(L, -3); // event args
+            lua_pushstring(L, msg->args[n]); // event args val
+            lua_rawseti(L, -2, n + 1); // event args
         }
         lua_setfield(L, -2, "args"); // event
         break;
@@ -835,7 +834,9 @@ static int script_get_property_number(lua_State *L)
     }
 }
 
-static void pushnode(lua_State *L, mpv_node *node)
+// mt_array/mt_map are the absolute stack indexes of the ARRAY and MAP
+// metatables, so that they don't have to be looked up for each table.
+static void pushnode_rec(lua_State *L, mpv_node *node, int mt_array, int mt_map)
 {
     luaL_checkstack(L, 6, "stack overflow");
 
@@ -856,21 +857,22 @@ static void pushnode(lua_State *L, mpv_node *node)
         lua_pushboolean(L, node->u.flag);
         break;
     case MPV_FORMAT_NODE_ARRAY:
-        lua_newtable(L); // table
-        lua_getfield(L, LUA_REGISTRYINDEX, "ARRAY"); // table mt
+        // Preallocating avoids rehashing the table while it's filled.
+        lua_createtable(L, node->u.list->num, 0); // table
+        lua_pushvalue(L, mt_array); // table mt
         lua_setmetatable(L, -2); // table
         for (int n = 0; n < node->u.list->num; n++) {
-            pushnode(L, &node->u.list->values[n]); // table value
+            pushnode_rec(L, &node->u.list->values[n], mt_array, mt_map);
             lua_rawseti(L, -2, n + 1); // table
         }
         break;
     case MPV_FORMAT_NODE_MAP:
-        lua_newtable(L); // table
-        lua_getfield(L, LUA_REGISTRYINDEX, "MAP"); // table mt
+        lua_createtable(L, 0, node->u.list->num); // table
+        lua_pushvalue(L, mt_map); // table mt
         lua_setmetatable(L, -2); // table
         for (int n = 0; n < node->u.list->num; n++) {
             lua_pushstring(L, node->u.list->keys[n]); // table key
-            pushnode(L, &node->u.list->values[n]); // table key value
+            pushnode_rec(L, &node->u.list->values[n], mt_array, mt_map);
             lua_rawset(L, -3);
         }
         break;
@@ -887,6 +889,23 @@ static void pushnode(lua_State *L, mpv_node *node)
     }
 }
 
+static void pushnode(lua_State *L, mpv_node *node)
+{
+    if (node->format != MPV_FORMAT_NODE_ARRAY &&
+        node->format != MPV_FORMAT_NODE_MAP)
+    {
+        pushnode_rec(L, node, 0, 0);
+        return;
+    }
+    luaL_checkstack(L, 2, "stack overflow");
+    lua_getfield(L, LUA_REGISTRYINDEX, "ARRAY"); // mt_array
+    lua_getfield(L, LUA_REGISTRYINDEX, "MAP"); // mt_array mt_map
+    int top = lua_gettop(L);
+    pushnode_rec(L, node, top - 1, top); // mt_array mt_map value
+    lua_replace(L, -3); // value mt_map
+    lua_pop(L, 1); // value
+}
+
 static int script_get_property_native(lua_State *L)
 {
     struct script_ctx *ctx = get_ctx(L);
@@ -929,7 +948,9 @@ static int script_raw_observe_property(lua_State *L)
     uint64_t id = luaL_checknumber(L, 1);
     const char *name = luaL_checkstring(L, 2);
     mpv_format format = check_property_format(L, 3);
-    return check_error(L, mpv_observe_property(ctx->client, id, name, format));
+    double interval = luaL_optnumber(L, 4, 0);
+    return check_error(L, mpv_observe_property_interval(ctx->client, id, name,
+                                                        format, interval));
 }
 
 static int script_raw_unobserve_property(lua_State *L)
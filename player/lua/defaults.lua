@@ -229,8 +229,75 @@ function mp.remove_key_binding(name)
     mp.unregister_script_message(name)
 end
 
+-- Enabled timers, as binary min-heap ordered by next_deadline. Each timer
+-- stores its position in heap_index (nil if not enabled).
 local timers = {}
 
+-- Timers expiring within this many seconds of each other are run in the same
+-- wakeup, instead of sleeping again for a very short time.
+local timer_slack = 0.001
+
+local function timer_less(a, b)
+    return timers[a].next_deadline < timers[b].next_deadline
+end
+
+local function timer_swap(a, b)
+    timers[a], timers[b] = timers[b], timers[a]
+    timers[a].heap_index = a
+    timers[b].heap_index = b
+end
+
+local function timer_sift_up(i)
+    while i > 1 do
+        local parent = math.floor(i / 2)
+        if not timer_less(i, parent) then
+            break
+        end
+        timer_swap(i, parent)
+        i = parent
+    end
+end
+
+local function timer_sift_down(i)
+    local n = #timers
+    while true do
+        local best = i
+        local l, r = i * 2, i * 2 + 1
+        if l <= n and timer_less(l, best) then
+            best = l
+        end
+        if r <= n and timer_less(r, best) then
+            best = r
+        end
+        if best == i then
+            break
+        end
+        timer_swap(i, best)
+        i = best
+    end
+end
+
+local function timer_insert(t)
+    timers[#timers + 1] = t
+    t.heap_index = #timers
+    timer_sift_up(t.heap_index)
+end
+
+local function timer_remove(t)
+    local i = t.heap_index
+    local n = #timers
+    t.heap_index = nil
+    if i ~= n then
+        timers[i] = timers[n]
+        timers[i].heap_index = i
+    end
+    timers[n] = nil
+    if i < n then
+        timer_sift_up(i)
+        timer_sift_down(i)
+    end
+end
+
 local timer_mt = {}
 timer_mt.__index = timer_mt
 
@@ -252,42 +319,38 @@ function mp.add_periodic_timer(seconds, cb)
 end
 
 function timer_mt.stop(t)
-    if timers[t] then
-        timers[t] = nil
+    if t.heap_index then
+        timer_remove(t)
         t.next_deadline = t.next_deadline - mp.get_time()
     end
 end
 
 function timer_mt.kill(t)
-    timers[t] = nil
+    if t.heap_index then
+        timer_remove(t)
+    end
     t.next_deadline = nil
 end
 mp.cancel_timer = timer_mt.kill
 
 function timer_mt.resume(t)
-    if not timers[t] then
+    if not t.heap_index then
         local timeout = t.next_deadline
         if timeout == nil then
             timeout = t.timeout
         end
         t.next_deadline = mp.get_time() + timeout
-        timers[t] = t
+        timer_insert(t)
     end
 end
 
 function timer_mt.is_enabled(t)
-    return timers[t] ~= nil
+    return t.heap_index ~= nil
 end
 
 -- Return the timer that expires next.
 local function get_next_timer()
-    local best = nil
-    for t, _ in pairs(timers) do
-        if (best == nil) or (t.next_deadline < best.next_deadline) then
-            best = t
-        end
-    end
-    return best
+    return timers[1]
 end
 
 function mp.get_next_timeout()
@@ -309,13 +372,14 @@ local function process_timers()
         end
         local now = mp.get_time()
         local wait = timer.next_deadline - now
-        if wait > 0 then
+        if wait > timer_slack then
             return wait
         else
             if timer.oneshot then
                 timer:kill()
             else
                 timer.next_deadline = now + timer.timeout
+                timer_sift_down(timer.heap_index)
             end
             timer.cb()
         end
@@ -344,11 +408,11 @@ end
 local property_id = 0
 local properties = {}
 
-function mp.observe_property(name, t, cb)
+function mp.observe_property(name, t, cb, interval)
     local id = property_id + 1
     property_id = id
     properties[id] = cb
-    mp.raw_observe_property(id, name, t)
+    mp.raw_observe_property(id, name, t, interval)
 end
 
 function mp.unobserve_property(cb)
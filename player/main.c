@@ -174,6 +174,9 @@ void mp_destroy(struct MPContext *mpctx)
     uninit_audio_out(mpctx);
     uninit_video_out(mpctx);
 
+    // Write async window screenshots that completed during VO destruction.
+    mp_dispatch_queue_process(mpctx->dispatch, 0);
+
 #if HAVE_ENCODING
     encode_lavc_finish(mpctx->encode_lavc_ctx);
     encode_lavc_free(mpctx->encode_lavc_ctx);
@@ -310,6 +313,34 @@ static void abort_playback_cb(void *ctx)
     mp_abort_playback_async(mpctx);
 }
 
+// Record the end of a startup phase. name must be a static string.
+void mp_startup_mark(struct MPContext *mpctx, const char *name)
+{
+    if (mpctx->startup_done)
+        return;
+    struct mp_startup_mark mark = {name, mp_time_us()};
+    MP_TARRAY_APPEND(mpctx, mpctx->startup_marks, mpctx->num_startup_marks,
+                     mark);
+}
+
+// Called when playback of the first file starts.
+void mp_startup_done(struct MPContext *mpctx)
+{
+    if (mpctx->startup_done)
+        return;
+    mp_startup_mark(mpctx, "playback-start");
+    mpctx->startup_done = true;
+
+    int msgl = mpctx->opts->dump_startup_timings ? MSGL_INFO : MSGL_DEBUG;
+    MP_MSG(mpctx, msgl, "Startup timings:\n");
+    for (int n = 1; n < mpctx->num_startup_marks; n++) {
+        struct mp_startup_mark *m = &mpctx->startup_marks[n];
+        MP_MSG(mpctx, msgl, " %-16s %9.3f ms (+%.3f ms)\n", m->name,
+               (m->time - mpctx->startup_marks[0].time) / 1000.0,
+               (m->time - m[-1].time) / 1000.0);
+    }
+}
+
 struct MPContext *mp_create(void)
 {
     char *enable_talloc = getenv("MPV_LEAK_REPORT");
@@ -328,6 +359,8 @@ struct MPContext *mp_create(void)
         .playback_abort = mp_cancel_new(mpctx),
     };
 
+    mp_startup_mark(mpctx, "start");
+
     pthread_mutex_init(&mpctx->lock, NULL);
 
     mpctx->global = talloc_zero(mpctx, struct mpv_global);
@@ -364,6 +397,8 @@ struct MPContext *mp_create(void)
 
     mp_input_set_cancel(mpctx->input, abort_playback_cb, mpctx);
 
+    mp_startup_mark(mpctx, "create");
+
     char *verbose_env = getenv("MPV_VERBOSE");
     if (verbose_env)
         mpctx->opts->verbose = atoi(verbose_env);
@@ -398,6 +433,7 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     mp_print_version(mpctx->log, false);
 
     mp_parse_cfgfiles(mpctx);
+    mp_startup_mark(mpctx, "config-files");
 
     if (options) {
         int r = m_config_parse_mp_command_line(mpctx->mconfig, mpctx->playlist,
@@ -415,6 +451,7 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     mp_get_resume_defaults(mpctx);
 
     mp_input_load_config(mpctx->input);
+    mp_startup_mark(mpctx, "input-config");
 
     // From this point on, all mpctx members are initialized.
     mpctx->initialized = true;
@@ -424,6 +461,7 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     mpctx->mconfig->option_change_callback_ctx = mpctx;
     // Run all update handlers.
     mp_option_change_callback(mpctx, NULL, UPDATE_OPTS_MASK);
+    mp_startup_mark(mpctx, "option-init");
 
     if (handle_help_options(mpctx))
         return -2;
@@ -469,11 +507,13 @@ int mp_initialize(struct MPContext *mpctx, char **options)
 #endif
 
     mp_load_scripts(mpctx);
+    mp_startup_mark(mpctx, "scripts");
 
     if (opts->force_vo == 2 && handle_force_window(mpctx, false) < 0)
         return -1;
 
     MP_STATS(mpctx, "end init");
+    mp_startup_mark(mpctx, "init");
 
     return 0;
 }
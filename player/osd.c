@@ -170,13 +170,11 @@ static void term_osd_print_status_lazy(struct MPContext *mpctx)
 {
     struct MPOpts *opts = mpctx->opts;
 
-    update_window_title(mpctx, false);
-    update_vo_playback_state(mpctx);
-
     if (!opts->use_terminal)
         return;
 
-    if (opts->quiet || !mpctx->playback_initialized || !mpctx->playing_msg_shown)
+    if (opts->quiet || !mp_msg_test(mpctx->statusline, MSGL_STATUS) ||
+        !mpctx->playback_initialized || !mpctx->playing_msg_shown)
     {
         term_osd_set_status_lazy(mpctx, "");
         return;
@@ -564,9 +562,21 @@ void update_osd_msg(struct MPContext *mpctx)
         update_osd_bar(mpctx, OSD_BAR_SEEK, 0, 1, MPCLAMP(pos, 0, 1));
     }
 
-    term_osd_set_text_lazy(mpctx, mpctx->osd_msg_text);
-    term_osd_print_status_lazy(mpctx);
-    term_osd_update(mpctx);
+    update_window_title(mpctx, false);
+    update_vo_playback_state(mpctx);
+
+    // Don't even format the terminal status if it's not going to be written.
+    double rate = opts->term_status_rate;
+    double wait = rate > 0 ? mpctx->term_osd_last_update + 1 / rate - now : 0;
+    if (wait > 0) {
+        mp_set_timeout(mpctx, wait);
+        mpctx->osd_idle_update = true;
+    } else {
+        mpctx->term_osd_last_update = now;
+        term_osd_set_text_lazy(mpctx, mpctx->osd_msg_text);
+        term_osd_print_status_lazy(mpctx);
+        term_osd_update(mpctx);
+    }
 
     if (!opts->video_osd)
         return;
@@ -55,17 +55,41 @@
 // mp_wait_events() was called.
 void mp_wait_events(struct MPContext *mpctx)
 {
+    mp_client_wakeup_deferred(mpctx);
+
+    struct mp_playloop_stats *st = &mpctx->playloop_stats;
+    int64_t now = mp_time_us();
+    if (st->last_wakeup) {
+        int64_t busy = now - st->last_wakeup;
+        st->busy_time += busy;
+        st->busy_time_max = MPMAX(st->busy_time_max, busy);
+    }
+    st->iterations++;
+
     bool sleeping = mpctx->sleeptime > 0;
     if (sleeping)
         MP_STATS(mpctx, "start sleep");
 
     mpctx->in_dispatch = true;
 
-    mp_dispatch_queue_process(mpctx->dispatch, mpctx->sleeptime);
+    int res = mp_dispatch_queue_process(mpctx->dispatch, mpctx->sleeptime);
 
     mpctx->in_dispatch = false;
     mpctx->sleeptime = INFINITY;
 
+    if (!sleeping) {
+        st->wakeup_immediate++;
+    } else if (res & MP_DISPATCH_INTERRUPTED) {
+        st->wakeup_interrupt++;
+    } else {
+        st->wakeup_timeout++;
+    }
+    if (res & MP_DISPATCH_ITEMS)
+        st->dispatch_runs++;
+    if (res & MP_DISPATCH_LOCKED)
+        st->core_locks++;
+    st->last_wakeup = mp_time_us();
+
     if (sleeping)
         MP_STATS(mpctx, "end sleep");
 }
@@ -200,11 +224,15 @@ void add_step_frame(struct MPContext *mpctx, int dir)
     if (!mpctx->vo_chain)
         return;
     if (dir > 0) {
+        if (mpctx->paused && !mpctx->hrseek_active &&
+            video_step_cache_seek(mpctx, 1))
+            return;
         mpctx->step_frames += 1;
         set_pause_state(mpctx, false);
     } else if (dir < 0) {
         if (!mpctx->hrseek_active) {
-            queue_seek(mpctx, MPSEEK_BACKSTEP, 0, MPSEEK_VERY_EXACT, 0);
+            if (!video_step_cache_seek(mpctx, -1))
+                queue_seek(mpctx, MPSEEK_BACKSTEP, 0, MPSEEK_VERY_EXACT, 0);
             set_pause_state(mpctx, true);
         }
     }
@@ -231,10 +259,14 @@ void reset_playback_state(struct MPContext *mpctx)
     mpctx->hrseek_framedrop = false;
     mpctx->hrseek_lastframe = false;
     mpctx->hrseek_backstep = false;
+    mpctx->hrseek_cached = false;
     mpctx->current_seek = (struct seek_params){0};
     mpctx->playback_pts = MP_NOPTS_VALUE;
     mpctx->last_seek_pts = MP_NOPTS_VALUE;
     mpctx->cache_wait_time = 0;
+    mpctx->cache_fill_rate = -1;
+    mpctx->cache_last_time = 0;
+    mpctx->cache_underrun_time = mpctx->cache_needed_time = -1;
     mpctx->step_frames = 0;
     mpctx->ab_loop_clip = true;
     mpctx->restart_complete = false;
@@ -355,7 +387,10 @@ static void mp_seek(MPContext *mpctx, struct seek_params seek)
         mpctx->hrseek_active = true;
         mpctx->hrseek_framedrop = !hr_seek_very_exact && opts->hr_seek_framedrop;
         mpctx->hrseek_backstep = seek.type == MPSEEK_BACKSTEP;
+        mpctx->hrseek_cached = seek.flags & MPSEEK_FLAG_STEP_CACHE;
         mpctx->hrseek_pts = seek_pts;
+        mpctx->hrseek_skipped = 0;
+        mpctx->hrseek_first_pts = MP_NOPTS_VALUE;
 
         MP_VERBOSE(mpctx, "hr-seek, skipping to %f%s%s\n", mpctx->hrseek_pts,
                    mpctx->hrseek_framedrop ? "" : " (no framedrop)",
@@ -593,9 +628,85 @@ static void handle_osd_redraw(struct MPContext *mpctx)
                        vo_want_redraw(mpctx->video_out);
     if (!want_redraw)
         return;
+    // While paused, no new frame will carry the input time, unless a seek is
+    // pending.
+    if (mpctx->input_time && mpctx->paused && !mpctx->seek.type) {
+        vo_set_input_time(mpctx->video_out, mpctx->input_time);
+        mpctx->input_time = 0;
+    }
     vo_redraw(mpctx->video_out);
 }
 
+// Whether playback is close enough to the end of the file to start opening
+// the next playlist entry (--prefetch-playlist-secs).
+static bool prefetch_time_reached(struct MPContext *mpctx)
+{
+    double secs = mpctx->opts->prefetch_secs;
+    if (secs <= 0 || !mpctx->restart_complete)
+        return false;
+
+    double len = get_time_length(mpctx);
+    double playback = get_playback_time(mpctx);
+    return len >= 0 && playback != MP_NOPTS_VALUE && len - playback <= secs;
+}
+
+// Playback time that is assumed to be left if the duration is unknown.
+#define CACHE_MODEL_HORIZON 60.0
+
+// Estimate how fast the demuxer fills the cache (in media time per second)
+// compared to how fast playback consumes it, and derive from that the time
+// until the next underrun, and how much needs to be buffered to play to the
+// end without further interruptions.
+static void update_cache_model(struct MPContext *mpctx,
+                               struct demux_ctrl_reader_state *s, double now)
+{
+    double speed = mpctx->paused ? 0 : mpctx->opts->playback_speed;
+
+    // Samples from an idle demuxer (cache full, or EOF) say nothing about
+    // the network.
+    if (s->idle || s->ts_duration < 0) {
+        mpctx->cache_last_time = 0;
+        mpctx->cache_underrun_time = -1;
+        mpctx->cache_needed_time = s->idle ? 0 : -1;
+        return;
+    }
+
+    if (mpctx->cache_last_time <= 0) {
+        mpctx->cache_last_time = now;
+        mpctx->cache_last_duration = s->ts_duration;
+        mpctx->cache_last_speed = speed;
+    }
+
+    double dt = now - mpctx->cache_last_time;
+    if (dt >= 0.5) {
+        double fill = (s->ts_duration - mpctx->cache_last_duration) / dt +
+                      mpctx->cache_last_speed;
+        fill = MPMAX(fill, 0);
+        mpctx->cache_fill_rate = mpctx->cache_fill_rate < 0 ? fill :
+                                 mpctx->cache_fill_rate * 0.7 + fill * 0.3;
+        mpctx->cache_last_time = now;
+        mpctx->cache_last_duration = s->ts_duration;
+        mpctx->cache_last_speed = speed;
+    }
+
+    double fill = mpctx->cache_fill_rate;
+    double rate = mpctx->opts->playback_speed;
+    if (fill < 0 || rate <= 0) {
+        mpctx->cache_underrun_time = mpctx->cache_needed_time = -1;
+        return;
+    }
+
+    double drain = rate - fill;
+    mpctx->cache_underrun_time = drain > 0 ? s->ts_duration / drain : -1;
+
+    double left = CACHE_MODEL_HORIZON;
+    double len = get_time_length(mpctx);
+    double pos = get_current_time(mpctx);
+    if (len >= 0 && pos != MP_NOPTS_VALUE)
+        left = MPMAX(len - pos, 0);
+    mpctx->cache_needed_time = drain > 0 ? left * drain / rate : 0;
+}
+
 static void handle_pause_on_low_cache(struct MPContext *mpctx)
 {
     bool force_update = false;
@@ -614,10 +725,17 @@ static void handle_pause_on_low_cache(struct MPContext *mpctx)
     int cache_buffer = 100;
     bool use_pause_on_low_cache = c.size > 0 || mpctx->demuxer->is_network;
 
+    if (use_pause_on_low_cache)
+        update_cache_model(mpctx, &s, now);
+
     if (mpctx->restart_complete && use_pause_on_low_cache) {
+        // Wait until enough is buffered to play to the end if the link is
+        // too slow, rather than resuming only to pause again shortly after.
+        // The adaptive wait time is the lower bound.
+        double wait = MPMAX(mpctx->cache_wait_time, mpctx->cache_needed_time);
         if (mpctx->paused && mpctx->paused_for_cache) {
             if (!s.underrun && (!opts->cache_pausing || s.idle ||
-                                s.ts_duration >= mpctx->cache_wait_time))
+                                s.ts_duration >= wait))
             {
                 double elapsed_time = now - mpctx->cache_stop_time;
                 if (elapsed_time > mpctx->cache_wait_time) {
@@ -639,10 +757,9 @@ static void handle_pause_on_low_cache(struct MPContext *mpctx)
             }
         }
         mpctx->cache_wait_time = MPCLAMP(mpctx->cache_wait_time, 1, 10);
-        if (mpctx->paused_for_cache) {
-            cache_buffer =
-                100 * MPCLAMP(s.ts_duration / mpctx->cache_wait_time, 0, 0.99);
-        }
+        wait = MPMAX(mpctx->cache_wait_time, mpctx->cache_needed_time);
+        if (mpctx->paused_for_cache)
+            cache_buffer = 100 * MPCLAMP(s.ts_duration / wait, 0, 0.99);
     }
 
     // Also update cache properties.
@@ -671,7 +788,7 @@ static void handle_pause_on_low_cache(struct MPContext *mpctx)
         force_update = true;
     }
 
-    if (s.eof && !busy)
+    if ((s.eof && !busy) || prefetch_time_reached(mpctx))
         prefetch_next(mpctx);
 
     if (force_update)
@@ -683,6 +800,61 @@ int get_cache_buffering_percentage(struct MPContext *mpctx)
     return mpctx->demuxer ? mpctx->cache_buffer : -1;
 }
 
+// --hls-bitrate=auto: switch HLS variants along with the download rate.
+static void handle_hls_auto_bitrate(struct MPContext *mpctx)
+{
+    if (mpctx->opts->hls_bitrate != -2 || !mpctx->demuxer ||
+        !mpctx->restart_complete)
+        return;
+
+    struct track *cur = mpctx->current_track[0][STREAM_VIDEO];
+    if (!cur || !cur->stream || cur->stream->hls_bitrate <= 0)
+        return;
+
+    double now = mp_time_sec();
+    if (now < mpctx->next_hls_check) {
+        mp_set_timeout(mpctx, mpctx->next_hls_check - now);
+        return;
+    }
+    mpctx->next_hls_check = now + 1;
+
+    struct demux_ctrl_reader_state s = {.ts_duration = -1};
+    demux_control(mpctx->demuxer, DEMUXER_CTRL_GET_READER_STATE, &s);
+    if (s.net_throughput <= 0)
+        return;
+    mpctx->hls_throughput = s.net_throughput;
+
+    struct track *want = select_default_track(mpctx, 0, STREAM_VIDEO);
+    if (!want || want == cur || !want->stream)
+        return;
+
+    // Go up only with a healthy buffer and not too often; go down as soon as
+    // the current variant can't be sustained. The 0.7 headroom applied by the
+    // selection leaves a band in which neither happens.
+    int cur_rate = cur->stream->hls_bitrate;
+    int want_rate = want->stream->hls_bitrate;
+    if (want_rate > cur_rate) {
+        if (s.underrun || s.ts_duration < 10 ||
+            now - mpctx->last_hls_switch < 10)
+            return;
+    } else {
+        if (!s.underrun && cur_rate <= s.net_throughput)
+            return;
+    }
+
+    MP_VERBOSE(mpctx, "Switching HLS variant %d -> %d bits/s "
+               "(measured %.0f).\n", cur_rate, want_rate, s.net_throughput);
+    mpctx->last_hls_switch = now;
+    mp_switch_track(mpctx, STREAM_VIDEO, want, 0);
+
+    struct track *a_cur = mpctx->current_track[0][STREAM_AUDIO];
+    if (a_cur && a_cur->stream && a_cur->stream->hls_bitrate > 0) {
+        struct track *a_want = select_default_track(mpctx, 0, STREAM_AUDIO);
+        if (a_want && a_want != a_cur)
+            mp_switch_track(mpctx, STREAM_AUDIO, a_want, 0);
+    }
+}
+
 static void handle_cursor_autohide(struct MPContext *mpctx)
 {
     struct MPOpts *opts = mpctx->opts;
@@ -946,6 +1118,25 @@ static void handle_playback_time(struct MPContext *mpctx)
 
 // We always make sure audio and video buffers are filled before actually
 // starting playback. This code handles starting them at the same time.
+static void report_hrseek_stats(struct MPContext *mpctx)
+{
+    struct vo_chain *vo_c = mpctx->vo_chain;
+
+    mpctx->last_hrseek.valid = true;
+    mpctx->last_hrseek.skipped = mpctx->hrseek_skipped;
+    mpctx->last_hrseek.dropped =
+        vo_c && vo_c->video_src ? vo_c->video_src->hrseek_dropped_frames : 0;
+    mpctx->last_hrseek.preroll = 0;
+    if (mpctx->hrseek_first_pts != MP_NOPTS_VALUE)
+        mpctx->last_hrseek.preroll = mpctx->hrseek_pts - mpctx->hrseek_first_pts;
+    mpctx->last_hrseek.time = mp_time_sec() - mpctx->start_timestamp;
+
+    MP_VERBOSE(mpctx, "hr-seek preroll: %f s, %d frames skipped, %d dropped "
+               "by decoder, took %f s\n", mpctx->last_hrseek.preroll,
+               mpctx->last_hrseek.skipped, mpctx->last_hrseek.dropped,
+               mpctx->last_hrseek.time);
+}
+
 static void handle_playback_restart(struct MPContext *mpctx)
 {
     struct MPOpts *opts = mpctx->opts;
@@ -973,12 +1164,15 @@ static void handle_playback_restart(struct MPContext *mpctx)
     }
 
     if (!mpctx->restart_complete) {
+        if (mpctx->hrseek_active)
+            report_hrseek_stats(mpctx);
         mpctx->hrseek_active = false;
         mpctx->restart_complete = true;
         mpctx->current_seek = (struct seek_params){0};
         mpctx->audio_allow_second_chance_seek = false;
         handle_playback_time(mpctx);
         mp_notify(mpctx, MPV_EVENT_PLAYBACK_RESTART, NULL);
+        mp_startup_done(mpctx);
         update_core_idle_state(mpctx);
         if (!mpctx->playing_msg_shown) {
             if (opts->playing_msg && opts->playing_msg[0]) {
@@ -1109,10 +1303,14 @@ void run_playloop(struct MPContext *mpctx)
 
     handle_osd_redraw(mpctx);
 
+    mp_client_update_snapshot(mpctx);
+
     mp_wait_events(mpctx);
 
     handle_pause_on_low_cache(mpctx);
 
+    handle_hls_auto_bitrate(mpctx);
+
     mp_process_input(mpctx);
 
     handle_chapter_change(mpctx);
@@ -29,6 +29,7 @@
 #include "command.h"
 #include "misc/bstr.h"
 #include "misc/dispatch.h"
+#include "misc/node.h"
 #include "misc/thread_pool.h"
 #include "common/msg.h"
 #include "options/path.h"
@@ -44,6 +45,12 @@
 #define MODE_FULL_WINDOW 1
 #define MODE_SUBTITLES 2
 
+// Number of threads encoding screenshots in the background.
+#define WRITER_THREADS 2
+// Above this number of queued screenshots, write synchronously. This bounds
+// memory usage if screenshots are requested faster than they can be encoded.
+#define MAX_PENDING 8
+
 typedef struct screenshot_ctx {
     struct MPContext *mpctx;
 
@@ -54,6 +61,11 @@ typedef struct screenshot_ctx {
     int frameno;
 
     struct mp_thread_pool *thread_pool;
+    int pending; // screenshots queued on thread_pool
+
+    // Result of the last written screenshot, for the last-screenshot property.
+    char *last_filename;
+    bool last_ok;
 } screenshot_ctx;
 
 void screenshot_init(struct MPContext *mpctx)
@@ -113,21 +125,23 @@ static void write_screenshot_thread(void *arg)
     screenshot_msg(ctx, MSGL_INFO, "Screenshot: '%s'", item->filename);
     UNLOCK(item)
 
-    if (!item->img || !write_image(item->img, &item->opts, item->filename,
-                                   item->mpctx->log))
-    {
-        LOCK(item)
-        screenshot_msg(ctx, MSGL_ERR, "Error writing screenshot!");
-        UNLOCK(item)
-    }
+    bool ok = item->img && write_image(item->img, &item->opts, item->filename,
+                                       item->mpctx->log);
 
+    LOCK(item)
+    if (!ok)
+        screenshot_msg(ctx, MSGL_ERR, "Error writing screenshot!");
+    talloc_free(ctx->last_filename);
+    ctx->last_filename = talloc_strdup(ctx, item->filename);
+    ctx->last_ok = ok;
     if (item->on_thread) {
-        mp_dispatch_lock(item->mpctx->dispatch);
         screenshot_msg(ctx, MSGL_V, "Screenshot writing done.");
+        ctx->pending -= 1;
         item->mpctx->outstanding_async -= 1;
         mp_wakeup_core(item->mpctx);
-        mp_dispatch_unlock(item->mpctx->dispatch);
     }
+    mp_notify_property(item->mpctx, "last-screenshot");
+    UNLOCK(item)
 
     talloc_free(item);
 }
@@ -147,13 +161,24 @@ static void write_screenshot(struct MPContext *mpctx, struct mp_image *img,
         .opts = opts ? *opts : *gopts,
     };
 
+    if (async && ctx->pending >= MAX_PENDING) {
+        MP_VERBOSE(mpctx, "Too many screenshots queued, writing synchronously.\n");
+        async = false;
+    }
+
     if (async) {
         if (!ctx->thread_pool)
-            ctx->thread_pool = mp_thread_pool_create(ctx, 1);
+            ctx->thread_pool = mp_thread_pool_create_shared(ctx, mpctx->global,
+                                                            WRITER_THREADS);
         if (ctx->thread_pool) {
             item->on_thread = true;
+            ctx->pending += 1;
             mpctx->outstanding_async += 1;
-            mp_thread_pool_queue(ctx->thread_pool, write_screenshot_thread, item);
+            mp_thread_pool_queue_job(ctx->thread_pool, &(struct mp_thread_pool_job){
+                .fn = write_screenshot_thread,
+                .fn_ctx = item,
+                .prio = MP_THREAD_POOL_PRIO_BACKGROUND,
+            });
             item = NULL;
         }
     }
@@ -419,6 +444,70 @@ static struct mp_image *screenshot_get(struct MPContext *mpctx, int mode)
     return image;
 }
 
+struct async_window_item {
+    struct MPContext *mpctx;
+    struct mp_log *log;
+    const char *filename;
+    struct image_writer_opts opts;
+    struct mp_image *img;
+};
+
+// Runs on the core thread.
+static void async_window_write(void *arg)
+{
+    struct async_window_item *item = arg;
+    // Without VO, this may be called from mp_destroy(), which doesn't wait
+    // for the writer thread anymore.
+    bool async = !!item->mpctx->video_out;
+    write_screenshot(item->mpctx, item->img, item->filename, &item->opts, async);
+    talloc_free(item);
+}
+
+// Runs on the VO thread.
+static void async_window_cb(void *arg, struct mp_image *img)
+{
+    struct async_window_item *item = arg;
+    if (!img) {
+        // Don't touch the core; this may happen while the VO is destroyed.
+        mp_err(item->log, "Taking screenshot failed.\n");
+        talloc_free(item);
+        return;
+    }
+    item->img = talloc_steal(item, img);
+    mp_dispatch_enqueue(item->mpctx->dispatch, async_window_write, item);
+}
+
+// Request a window screenshot that is read back from the GPU without
+// stalling. Returns false if the VO doesn't support it.
+static bool screenshot_window_async(struct MPContext *mpctx,
+                                    const char *filename,
+                                    struct image_writer_opts *opts)
+{
+    struct vo *vo = mpctx->video_out;
+    if (!vo || !vo->config_ok)
+        return false;
+
+    struct async_window_item *item = talloc_ptrtype(NULL, item);
+    *item = (struct async_window_item){
+        .mpctx = mpctx,
+        .log = mpctx->log,
+        .filename = talloc_strdup(item, filename),
+        .opts = *opts,
+    };
+    struct voctrl_screenshot_async req = {
+        .cb = async_window_cb,
+        .ctx = item,
+    };
+    if (vo_control(vo, VOCTRL_SCREENSHOT_WIN_ASYNC, &req) != VO_TRUE) {
+        talloc_free(item);
+        return false;
+    }
+    // The next rendered frame is captured.
+    if (mpctx->paused)
+        vo_redraw(vo);
+    return true;
+}
+
 struct mp_image *screenshot_get_rgb(struct MPContext *mpctx, int mode)
 {
     struct mp_image *mpi = screenshot_get(mpctx, mode);
@@ -436,11 +525,15 @@ void screenshot_to_file(struct MPContext *mpctx, const char *filename, int mode,
     struct image_writer_opts opts = *mpctx->opts->screenshot_image_opts;
     bool old_osd = ctx->osd;
     ctx->osd = osd;
+    async |= mpctx->opts->screenshot_async;
 
     char *ext = mp_splitext(filename, NULL);
     int format = image_writer_format_from_ext(ext);
     if (format)
         opts.format = format;
+    if (async && mode == MODE_FULL_WINDOW &&
+        screenshot_window_async(mpctx, filename, &opts))
+        goto end;
     struct mp_image *image = screenshot_get(mpctx, mode);
     if (!image) {
         screenshot_msg(ctx, MSGL_ERR, "Taking screenshot failed.");
@@ -471,6 +564,16 @@ void screenshot_request(struct MPContext *mpctx, int mode, bool each_frame,
 
     ctx->mode = mode;
     ctx->osd = osd;
+    async |= mpctx->opts->screenshot_async;
+
+    if (async && !each_frame && mode == MODE_FULL_WINDOW) {
+        struct image_writer_opts *opts = mpctx->opts->screenshot_image_opts;
+        char *filename = gen_fname(ctx, image_writer_file_ext(opts));
+        bool ok = filename && screenshot_window_async(mpctx, filename, opts);
+        talloc_free(filename);
+        if (ok || !filename)
+            return;
+    }
 
     struct mp_image *image = screenshot_get(mpctx, mode);
 
@@ -487,6 +590,18 @@ void screenshot_request(struct MPContext *mpctx, int mode, bool each_frame,
     talloc_free(image);
 }
 
+void screenshot_get_info(struct MPContext *mpctx, struct mpv_node *dst)
+{
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+
+    node_init(dst, MPV_FORMAT_NODE_MAP, NULL);
+    if (ctx->last_filename) {
+        node_map_add_string(dst, "filename", ctx->last_filename);
+        node_map_add_flag(dst, "success", ctx->last_ok);
+    }
+    node_map_add_int64(dst, "pending", ctx->pending);
+}
+
 void screenshot_flip(struct MPContext *mpctx)
 {
     screenshot_ctx *ctx = mpctx->screenshot_ctx;
@@ -21,6 +21,7 @@
 #include <stdbool.h>
 
 struct MPContext;
+struct mpv_node;
 
 // One time initialization at program start.
 void screenshot_init(struct MPContext *mpctx);
@@ -42,6 +43,10 @@ void screenshot_to_file(struct MPContext *mpctx, const char *filename, int mode,
 // mode is the same as in screenshot_request()
 struct mp_image *screenshot_get_rgb(struct MPContext *mpctx, int mode);
 
+// Return the result of the last written screenshot as a node map (for the
+// last-screenshot property).
+void screenshot_get_info(struct MPContext *mpctx, struct mpv_node *dst);
+
 // Called by the playback core code when a new frame is displayed.
 void screenshot_flip(struct MPContext *mpctx);
 
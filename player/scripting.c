@@ -27,6 +27,7 @@
 
 #include "osdep/io.h"
 #include "osdep/threads.h"
+#include "osdep/timer.h"
 
 #include "common/common.h"
 #include "common/msg.h"
@@ -91,6 +92,7 @@ static void *script_thread(void *p)
     snprintf(name, sizeof(name), "%s (%s)", arg->backend->name,
              mpv_client_name(arg->client));
     mpthread_set_name(name);
+    ta_set_thread_account(MP_MEM_CLIENT);
 
     if (arg->backend->load(arg->client, arg->fname) < 0)
         MP_ERR(arg, "Could not load %s %s\n", arg->backend->name, arg->fname);
@@ -107,7 +109,10 @@ static void wait_loaded(struct MPContext *mpctx)
     mp_wakeup_core(mpctx); // avoid lost wakeups during waiting
 }
 
-int mp_load_script(struct MPContext *mpctx, const char *fname)
+// Start loading the script. If wait is false, the caller has to call
+// wait_loaded() before continuing with playback; this lets several scripts
+// initialize concurrently.
+static int load_script(struct MPContext *mpctx, const char *fname, bool wait)
 {
     char *ext = mp_splitext(fname, NULL);
     const struct mp_scripting *backend = NULL;
@@ -149,20 +154,33 @@ int mp_load_script(struct MPContext *mpctx, const char *fname)
         return -1;
     }
 
-    wait_loaded(mpctx);
-    MP_VERBOSE(mpctx, "Done loading %s.\n", fname);
+    if (wait) {
+        wait_loaded(mpctx);
+        MP_VERBOSE(mpctx, "Done loading %s.\n", fname);
+    }
 
     return 0;
 }
 
-int mp_load_user_script(struct MPContext *mpctx, const char *fname)
+int mp_load_script(struct MPContext *mpctx, const char *fname)
+{
+    return load_script(mpctx, fname, true);
+}
+
+static int load_user_script(struct MPContext *mpctx, const char *fname,
+                            bool wait)
 {
     char *path = mp_get_user_path(NULL, mpctx->global, fname);
-    int ret = mp_load_script(mpctx, path);
+    int ret = load_script(mpctx, path, wait);
     talloc_free(path);
     return ret;
 }
 
+int mp_load_user_script(struct MPContext *mpctx, const char *fname)
+{
+    return load_user_script(mpctx, fname, true);
+}
+
 static int compare_filename(const void *pa, const void *pb)
 {
     char *a = (char *)pa;
@@ -200,7 +218,7 @@ static void load_builtin_script(struct MPContext *mpctx, bool enable,
     char *name = script_name_from_filename(tmp, fname);
     if (enable != mp_client_exists(mpctx, name)) {
         if (enable) {
-            mp_load_script(mpctx, fname);
+            load_script(mpctx, fname, false);
         } else {
             // Try to unload it by sending a shutdown event. Wait until it has
             // terminated, or re-enabling the script could be racy (because it'd
@@ -221,28 +239,38 @@ void mp_load_builtin_scripts(struct MPContext *mpctx)
     load_builtin_script(mpctx, mpctx->opts->lua_load_osc, "@osc.lua");
     load_builtin_script(mpctx, mpctx->opts->lua_load_ytdl, "@ytdl_hook.lua");
     load_builtin_script(mpctx, mpctx->opts->lua_load_stats, "@stats.lua");
+    wait_loaded(mpctx);
 }
 
 void mp_load_scripts(struct MPContext *mpctx)
 {
+    // All scripts are started first, and then initialize concurrently. The
+    // clients are created in order, so script names are still deterministic.
+
     // Load scripts from options
     char **files = mpctx->opts->script_files;
     for (int n = 0; files && files[n]; n++) {
         if (files[n][0])
-            mp_load_user_script(mpctx, files[n]);
+            load_user_script(mpctx, files[n], false);
     }
-    if (!mpctx->opts->auto_load_scripts)
-        return;
 
-    // Load all scripts
-    void *tmp = talloc_new(NULL);
-    char **scriptsdir = mp_find_all_config_files(tmp, mpctx->global, "scripts");
-    for (int i = 0; scriptsdir && scriptsdir[i]; i++) {
-        files = list_script_files(tmp, scriptsdir[i]);
-        for (int n = 0; files && files[n]; n++)
-            mp_load_script(mpctx, files[n]);
+    if (mpctx->opts->auto_load_scripts) {
+        // Load all scripts
+        void *tmp = talloc_new(NULL);
+        char **scriptsdir =
+            mp_find_all_config_files(tmp, mpctx->global, "scripts");
+        for (int i = 0; scriptsdir && scriptsdir[i]; i++) {
+            files = list_script_files(tmp, scriptsdir[i]);
+            for (int n = 0; files && files[n]; n++)
+                load_script(mpctx, files[n], false);
+        }
+        talloc_free(tmp);
     }
-    talloc_free(tmp);
+
+    int64_t start = mp_time_us();
+    wait_loaded(mpctx);
+    MP_VERBOSE(mpctx, "Done loading scripts (waited %.1f ms).\n",
+               (mp_time_us() - start) / 1000.0);
 }
 
 #if HAVE_CPLUGINS
@@ -108,6 +108,9 @@ static bool update_subtitle(struct MPContext *mpctx, double video_pts,
     if (!sub_read_packets(dec_sub, video_pts))
         return false;
 
+    if (opts->ass_prerender && mpctx->video_out)
+        sub_control(dec_sub, SD_CTRL_PRERENDER, &video_pts);
+
     // Handle displaying subtitles on terminal; never done for secondary subs
     if (mpctx->current_track[0][STREAM_SUB] == track && !mpctx->video_out)
         term_osd_set_subs(mpctx, sub_get_text(dec_sub, video_pts));
@@ -173,6 +176,9 @@ static bool init_subdec(struct MPContext *mpctx, struct track *track)
     if (!track->d_sub)
         return false;
 
+    if (track->demuxer->fully_read)
+        sub_set_read_ahead(track->d_sub, mpctx->opts->sub_preload_window);
+
     struct track *vtrack = mpctx->current_track[0][STREAM_VIDEO];
     struct mp_codec_params *v_c =
         vtrack && vtrack->stream ? vtrack->stream->codec : NULL;
@@ -0,0 +1,442 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <pthread.h>
+
+#include <libavcodec/avcodec.h>
+
+#include "mpv_talloc.h"
+
+#include "common/av_common.h"
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "demux/demux.h"
+#include "demux/packet.h"
+#include "demux/stheader.h"
+#include "libmpv/client.h"
+#include "misc/node.h"
+#include "osdep/threads.h"
+#include "stream/stream.h"
+#include "video/mp_image.h"
+#include "video/sws_utils.h"
+
+#include "core.h"
+#include "command.h"
+
+// Seek preview thumbnails. These are generated by a separate thread, which
+// opens the current file a second time, and decodes only the key frame before
+// the requested position at reduced resolution. This keeps it independent
+// from the playback demuxer and decoder state.
+
+#define MAX_ENTRIES 64  // number of cached thumbnails
+#define MAX_QUEUED 4    // pending requests; older requests are dropped
+#define MAX_PACKETS 500 // give up if no key frame is found after this
+
+struct thumb_entry {
+    double req_time;    // position the thumbnail was requested for
+    double pts;         // exact time of the decoded key frame
+    int width;          // requested width
+    struct mp_image *img;
+    int64_t last_use;
+};
+
+struct thumb_request {
+    double time;
+    int width;
+};
+
+struct thumbnail_ctx {
+    struct mp_log *log;
+    struct mpv_global *global;
+    struct MPContext *mpctx;    // only for mp_wakeup_core()
+    char *filename;
+    struct mp_cancel *cancel;
+    pthread_t thread;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // --- protected by lock
+    bool terminate;
+    bool changed;               // new entries (for the property notification)
+    struct thumb_entry *entries;
+    int num_entries;
+    struct thumb_request queue[MAX_QUEUED];
+    int num_queued;
+    int64_t use_counter;
+
+    // --- owned by the worker thread
+    bool failed;
+    struct demuxer *demuxer;
+    struct sh_stream *sh;
+    AVCodecContext *avctx;
+    AVFrame *frame;
+    AVRational tb;
+    int lowres;
+};
+
+static bool entry_matches(struct thumb_entry *e, double time, int width)
+{
+    // The key frame found for req_time is also the key frame preceding any
+    // position between the two.
+    double a = MPMIN(e->pts, e->req_time), b = MPMAX(e->pts, e->req_time);
+    return e->width == width && time >= a - 0.001 && time <= b + 0.001;
+}
+
+// Called locked.
+static struct thumb_entry *find_entry(struct thumbnail_ctx *ctx, double time,
+                                      int width)
+{
+    for (int n = 0; n < ctx->num_entries; n++) {
+        struct thumb_entry *e = &ctx->entries[n];
+        if (entry_matches(e, time, width))
+            return e;
+    }
+    return NULL;
+}
+
+// Called locked.
+static void add_entry(struct thumbnail_ctx *ctx, struct thumb_entry e)
+{
+    if (ctx->num_entries >= MAX_ENTRIES) {
+        int lru = 0;
+        for (int n = 1; n < ctx->num_entries; n++) {
+            if (ctx->entries[n].last_use < ctx->entries[lru].last_use)
+                lru = n;
+        }
+        talloc_free(ctx->entries[lru].img);
+        MP_TARRAY_REMOVE_AT(ctx->entries, ctx->num_entries, lru);
+    }
+    e.last_use = ++ctx->use_counter;
+    MP_TARRAY_APPEND(ctx, ctx->entries, ctx->num_entries, e);
+    ctx->changed = true;
+}
+
+static void close_decoder(struct thumbnail_ctx *ctx)
+{
+    avcodec_free_context(&ctx->avctx);
+}
+
+// Open the decoder so that it outputs images at least width pixels wide.
+static bool open_decoder(struct thumbnail_ctx *ctx, int width)
+{
+    struct mp_codec_params *c = ctx->sh->codec;
+    AVCodec *codec = avcodec_find_decoder(mp_codec_to_av_codec_id(c->codec));
+    if (!codec) {
+        MP_VERBOSE(ctx, "No decoder for codec '%s'.\n", c->codec);
+        return false;
+    }
+
+    int lowres = 0;
+    while (lowres < codec->max_lowres && (c->disp_w >> (lowres + 1)) >= width)
+        lowres++;
+
+    if (ctx->avctx && ctx->lowres == lowres)
+        return true;
+    close_decoder(ctx);
+
+    AVCodecContext *avctx = avcodec_alloc_context3(codec);
+    if (!avctx)
+        return false;
+    ctx->avctx = avctx;
+    ctx->lowres = lowres;
+    ctx->tb = mp_get_codec_timebase(c);
+
+    if (mp_set_avctx_codec_headers(avctx, c) < 0)
+        goto error;
+    avctx->pkt_timebase = ctx->tb;
+    avctx->lowres = lowres;
+    avctx->skip_frame = AVDISCARD_NONKEY;
+    avctx->skip_loop_filter = AVDISCARD_ALL;
+    avctx->flags2 |= AV_CODEC_FLAG2_FAST;
+    // Frame threading would only add latency for single frames.
+    mp_set_avcodec_threads(ctx->log, avctx, 1);
+
+    if (avcodec_open2(avctx, codec, NULL) < 0)
+        goto error;
+    return true;
+
+error:
+    MP_ERR(ctx, "Could not open decoder.\n");
+    close_decoder(ctx);
+    return false;
+}
+
+static bool open_file(struct thumbnail_ctx *ctx)
+{
+    struct demuxer_params params = {
+        .disable_cache = true,
+    };
+    ctx->demuxer = demux_open_url(ctx->filename, &params, ctx->cancel,
+                                  ctx->global);
+    if (!ctx->demuxer)
+        return false;
+
+    if (!ctx->demuxer->seekable) {
+        MP_VERBOSE(ctx, "File is not seekable.\n");
+        return false;
+    }
+
+    for (int n = 0; n < demux_get_num_stream(ctx->demuxer); n++) {
+        struct sh_stream *sh = demux_get_stream(ctx->demuxer, n);
+        if (sh->type == STREAM_VIDEO && !sh->attached_picture) {
+            ctx->sh = sh;
+            break;
+        }
+    }
+    if (!ctx->sh) {
+        MP_VERBOSE(ctx, "No video stream.\n");
+        return false;
+    }
+    demuxer_select_track(ctx->demuxer, ctx->sh, MP_NOPTS_VALUE, true);
+
+    ctx->frame = av_frame_alloc();
+    return !!ctx->frame;
+}
+
+// Decode the key frame at or before time.
+static struct mp_image *decode_keyframe(struct thumbnail_ctx *ctx, double time,
+                                        double *out_pts)
+{
+    demux_seek(ctx->demuxer, time, 0);
+    avcodec_flush_buffers(ctx->avctx);
+
+    bool draining = false;
+    for (int n = 0; n < MAX_PACKETS; n++) {
+        if (mp_cancel_test(ctx->cancel))
+            return NULL;
+
+        if (!draining) {
+            struct demux_packet *pkt = demux_read_packet(ctx->sh);
+            if (pkt && !pkt->keyframe) {
+                talloc_free(pkt);
+                continue;
+            }
+            AVPacket avpkt;
+            mp_set_av_packet(&avpkt, pkt, &ctx->tb);
+            avcodec_send_packet(ctx->avctx, pkt ? &avpkt : NULL);
+            draining = !pkt;
+            talloc_free(pkt);
+        }
+
+        int ret = avcodec_receive_frame(ctx->avctx, ctx->frame);
+        if (ret >= 0) {
+            struct mp_image *img = mp_image_from_av_frame(ctx->frame);
+            double pts = mp_pts_from_av(ctx->frame->pts, &ctx->tb);
+            *out_pts = pts == MP_NOPTS_VALUE ? time : pts;
+            av_frame_unref(ctx->frame);
+            return img;
+        }
+        if (ret != AVERROR(EAGAIN))
+            break;
+    }
+    return NULL;
+}
+
+static struct mp_image *scale_image(struct mp_image *src, int width)
+{
+    int d_w, d_h;
+    mp_image_params_get_dsize(&src->params, &d_w, &d_h);
+    if (d_w < 1 || d_h < 1)
+        return NULL;
+    int w = width;
+    int h = MPMAX(lrint(width * (double)d_h / d_w), 1);
+    struct mp_image *dst = mp_image_alloc(IMGFMT_BGR0, w, h);
+    if (dst && mp_image_swscale(dst, src, mp_sws_fast_flags) < 0)
+        TA_FREEP(&dst);
+    return dst;
+}
+
+static void generate(struct thumbnail_ctx *ctx, struct thumb_request req)
+{
+    if (ctx->failed)
+        return;
+    if (!ctx->demuxer && !open_file(ctx)) {
+        ctx->failed = true;
+        return;
+    }
+    if (!open_decoder(ctx, req.width)) {
+        ctx->failed = true;
+        return;
+    }
+
+    double pts = MP_NOPTS_VALUE;
+    struct mp_image *frame = decode_keyframe(ctx, req.time, &pts);
+    struct mp_image *img = frame ? scale_image(frame, req.width) : NULL;
+    talloc_free(frame);
+    if (!img) {
+        MP_VERBOSE(ctx, "No thumbnail for %f.\n", req.time);
+        return;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    add_entry(ctx, (struct thumb_entry){
+        .req_time = req.time,
+        .pts = pts,
+        .width = req.width,
+        .img = talloc_steal(ctx, img),
+    });
+    pthread_mutex_unlock(&ctx->lock);
+
+    mp_wakeup_core(ctx->mpctx);
+}
+
+static void *thumbnail_thread(void *p)
+{
+    struct thumbnail_ctx *ctx = p;
+    mpthread_set_name("thumbnail");
+
+    pthread_mutex_lock(&ctx->lock);
+    while (!ctx->terminate) {
+        if (!ctx->num_queued) {
+            pthread_cond_wait(&ctx->wakeup, &ctx->lock);
+            continue;
+        }
+        // The newest request is the most interesting one, e.g. when the user
+        // moves the mouse across the seek bar.
+        struct thumb_request req = ctx->queue[--ctx->num_queued];
+        if (find_entry(ctx, req.time, req.width))
+            continue;
+        pthread_mutex_unlock(&ctx->lock);
+        generate(ctx, req);
+        pthread_mutex_lock(&ctx->lock);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    close_decoder(ctx);
+    av_frame_free(&ctx->frame);
+    free_demuxer_and_stream(ctx->demuxer);
+    ctx->demuxer = NULL;
+    return NULL;
+}
+
+static struct thumbnail_ctx *get_ctx(struct MPContext *mpctx)
+{
+    if (mpctx->thumbnail_ctx)
+        return mpctx->thumbnail_ctx;
+    if (!mpctx->playback_initialized || !mpctx->filename)
+        return NULL;
+
+    struct thumbnail_ctx *ctx = talloc_zero(NULL, struct thumbnail_ctx);
+    *ctx = (struct thumbnail_ctx){
+        .log = mp_log_new(ctx, mpctx->log, "thumbnail"),
+        .global = mpctx->global,
+        .mpctx = mpctx,
+        .filename = talloc_strdup(ctx, mpctx->filename),
+        .cancel = mp_cancel_new(ctx),
+    };
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_cond_init(&ctx->wakeup, NULL);
+
+    if (pthread_create(&ctx->thread, NULL, thumbnail_thread, ctx)) {
+        pthread_cond_destroy(&ctx->wakeup);
+        pthread_mutex_destroy(&ctx->lock);
+        talloc_free(ctx);
+        return NULL;
+    }
+
+    mpctx->thumbnail_ctx = ctx;
+    return ctx;
+}
+
+bool thumbnail_get(struct MPContext *mpctx, double time, int width,
+                   struct mp_image **out_img, double *out_pts)
+{
+    struct thumbnail_ctx *ctx = get_ctx(mpctx);
+    if (!ctx || width < 1)
+        return false;
+
+    pthread_mutex_lock(&ctx->lock);
+    struct thumb_entry *e = find_entry(ctx, time, width);
+    if (e) {
+        e->last_use = ++ctx->use_counter;
+        *out_img = mp_image_new_ref(e->img);
+        *out_pts = e->pts;
+    } else {
+        bool queued = false;
+        for (int n = 0; n < ctx->num_queued; n++) {
+            struct thumb_request *r = &ctx->queue[n];
+            queued |= r->width == width && fabs(r->time - time) < 0.001;
+        }
+        if (!queued) {
+            if (ctx->num_queued == MAX_QUEUED)
+                MP_TARRAY_REMOVE_AT(ctx->queue, ctx->num_queued, 0);
+            ctx->queue[ctx->num_queued++] =
+                (struct thumb_request){ .time = time, .width = width };
+            pthread_cond_signal(&ctx->wakeup);
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    return e && *out_img;
+}
+
+void thumbnail_get_cache(struct MPContext *mpctx, struct mpv_node *dst)
+{
+    struct thumbnail_ctx *ctx = mpctx->thumbnail_ctx;
+    node_init(dst, MPV_FORMAT_NODE_ARRAY, NULL);
+    if (!ctx)
+        return;
+
+    pthread_mutex_lock(&ctx->lock);
+    for (int n = 0; n < ctx->num_entries; n++) {
+        struct thumb_entry *e = &ctx->entries[n];
+        struct mpv_node *sub = node_array_add(dst, MPV_FORMAT_NODE_MAP);
+        node_map_add_double(sub, "time", e->pts);
+        node_map_add_double(sub, "request-time", e->req_time);
+        node_map_add_int64(sub, "w", e->img->w);
+        node_map_add_int64(sub, "h", e->img->h);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+void thumbnail_update(struct MPContext *mpctx)
+{
+    struct thumbnail_ctx *ctx = mpctx->thumbnail_ctx;
+    if (!ctx)
+        return;
+
+    pthread_mutex_lock(&ctx->lock);
+    bool changed = ctx->changed;
+    ctx->changed = false;
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (changed)
+        mp_notify_property(mpctx, "thumbnail-cache");
+}
+
+void thumbnail_uninit(struct MPContext *mpctx)
+{
+    struct thumbnail_ctx *ctx = mpctx->thumbnail_ctx;
+    if (!ctx)
+        return;
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->terminate = true;
+    pthread_cond_signal(&ctx->wakeup);
+    pthread_mutex_unlock(&ctx->lock);
+    mp_cancel_trigger(ctx->cancel);
+    pthread_join(ctx->thread, NULL);
+
+    pthread_cond_destroy(&ctx->wakeup);
+    pthread_mutex_destroy(&ctx->lock);
+    talloc_free(ctx);
+    mpctx->thumbnail_ctx = NULL;
+
+    mp_notify_property(mpctx, "thumbnail-cache");
+}
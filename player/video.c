@@ -177,12 +177,25 @@ void recreate_auto_filters(struct MPContext *mpctx)
     mp_notify(mpctx, MPV_EVENT_VIDEO_RECONFIG, NULL);
 }
 
+static void step_cache_clear(struct vo_chain *vo_c)
+{
+    for (int n = 0; n < vo_c->num_step_cache; n++)
+        talloc_free(vo_c->step_cache[n].img);
+    vo_c->num_step_cache = 0;
+    vo_c->step_cache_bytes = 0;
+    vo_c->step_cache_prev_pts = MP_NOPTS_VALUE;
+    vo_c->step_cache_skip_pts = MP_NOPTS_VALUE;
+}
+
 static void recreate_video_filters(struct MPContext *mpctx)
 {
     struct MPOpts *opts = mpctx->opts;
     struct vo_chain *vo_c = mpctx->vo_chain;
     assert(vo_c);
 
+    // Cached frames were filtered with the old chain.
+    step_cache_clear(vo_c);
+
     vf_destroy(vo_c->vf);
     vo_c->vf = vf_new(mpctx->global);
     vo_c->vf->hwdec_devs = vo_c->hwdec_devs;
@@ -220,6 +233,108 @@ int reinit_video_filters(struct MPContext *mpctx)
     return vo_c->vf->initialized;
 }
 
+static struct step_cache_frame *step_cache_find(struct vo_chain *vo_c,
+                                                double pts)
+{
+    for (int n = 0; n < vo_c->num_step_cache; n++) {
+        struct step_cache_frame *f = &vo_c->step_cache[n];
+        if (fabs(f->img->pts - pts) < 1e-6)
+            return f;
+    }
+    return NULL;
+}
+
+// Remember a filtered frame for --frame-step-cache. Frames are linked to
+// their predecessor only if both were decoded since the same seek, so a
+// backstep never skips frames that were never seen.
+static void step_cache_add(struct MPContext *mpctx, struct mp_image *img)
+{
+    struct vo_chain *vo_c = mpctx->vo_chain;
+    int64_t limit = mpctx->opts->frame_step_cache * (int64_t)(1024 * 1024);
+    // Hardware surfaces come from a fixed size pool; holding them would
+    // starve the decoder.
+    if (!limit || img->pts == MP_NOPTS_VALUE || vo_c->is_coverart ||
+        IMGFMT_IS_HWACCEL(img->imgfmt))
+        return;
+
+    double prev = vo_c->step_cache_prev_pts;
+    if (prev != MP_NOPTS_VALUE && prev >= img->pts)
+        prev = MP_NOPTS_VALUE;
+    vo_c->step_cache_prev_pts = img->pts;
+
+    // Frames dropped by the decoder would leave a gap.
+    struct dec_video *d_video = vo_c->video_src;
+    int drops = d_video ? d_video->dropped_frames +
+                          d_video->hrseek_dropped_frames : 0;
+    if (drops != vo_c->step_cache_drops)
+        prev = MP_NOPTS_VALUE;
+    vo_c->step_cache_drops = drops;
+
+    struct step_cache_frame *f = step_cache_find(vo_c, img->pts);
+    if (f) {
+        if (prev != MP_NOPTS_VALUE)
+            f->prev_pts = prev;
+        return;
+    }
+
+    int pos = 0;
+    while (pos < vo_c->num_step_cache &&
+           vo_c->step_cache[pos].img->pts < img->pts)
+        pos++;
+    struct step_cache_frame nf = {
+        .img = mp_image_new_ref(img),
+        .prev_pts = prev,
+    };
+    MP_TARRAY_INSERT_AT(vo_c, vo_c->step_cache, vo_c->num_step_cache, pos, nf);
+    vo_c->step_cache_bytes +=
+        mp_image_get_alloc_size(img->imgfmt, img->w, img->h, 1);
+
+    // Drop the frames farthest away from the new one.
+    while (vo_c->step_cache_bytes > limit && vo_c->num_step_cache > 1) {
+        int first = 0, last = vo_c->num_step_cache - 1;
+        double d0 = img->pts - vo_c->step_cache[first].img->pts;
+        double d1 = vo_c->step_cache[last].img->pts - img->pts;
+        int drop = d0 > d1 ? first : last;
+        struct mp_image *old = vo_c->step_cache[drop].img;
+        vo_c->step_cache_bytes -=
+            mp_image_get_alloc_size(old->imgfmt, old->w, old->h, 1);
+        talloc_free(old);
+        MP_TARRAY_REMOVE_AT(vo_c->step_cache, vo_c->num_step_cache, drop);
+    }
+}
+
+// Queue a seek to the frame before (dir<0) or after (dir>0) the currently
+// displayed one, if the frame step cache has it. The frame is then shown
+// without decoding anything. Forward steps are served only if the decoder
+// would have to decode the already shown frames again.
+bool video_step_cache_seek(struct MPContext *mpctx, int dir)
+{
+    struct vo_chain *vo_c = mpctx->vo_chain;
+    if (!vo_c || !vo_c->num_step_cache || mpctx->video_pts == MP_NOPTS_VALUE)
+        return false;
+
+    double target = MP_NOPTS_VALUE;
+    if (dir < 0) {
+        struct step_cache_frame *cur = step_cache_find(vo_c, mpctx->video_pts);
+        if (cur)
+            target = cur->prev_pts;
+    } else if (vo_c->step_cache_skip_pts != MP_NOPTS_VALUE) {
+        for (int n = 0; n < vo_c->num_step_cache; n++) {
+            struct step_cache_frame *f = &vo_c->step_cache[n];
+            if (f->prev_pts != MP_NOPTS_VALUE &&
+                fabs(f->prev_pts - mpctx->video_pts) < 1e-6)
+                target = f->img->pts;
+        }
+    }
+    if (target == MP_NOPTS_VALUE || !step_cache_find(vo_c, target))
+        return false;
+
+    MP_VERBOSE(mpctx, "Stepping to cached frame at %f.\n", target);
+    queue_seek(mpctx, MPSEEK_ABSOLUTE, target, MPSEEK_VERY_EXACT,
+               MPSEEK_FLAG_STEP_CACHE);
+    return true;
+}
+
 static void vo_chain_reset_state(struct vo_chain *vo_c)
 {
     mp_image_unrefp(&vo_c->input_mpi);
@@ -230,6 +345,9 @@ static void vo_chain_reset_state(struct vo_chain *vo_c)
     if (vo_c->video_src)
         video_reset(vo_c->video_src);
 
+    vo_c->step_cache_prev_pts = MP_NOPTS_VALUE;
+    vo_c->step_cache_skip_pts = MP_NOPTS_VALUE;
+
     // Prepare for continued playback after a seek.
     if (!vo_c->input_mpi && vo_c->cached_coverart)
         vo_c->input_mpi = mp_image_new_ref(vo_c->cached_coverart);
@@ -264,6 +382,7 @@ void reset_video_state(struct MPContext *mpctx)
 void uninit_video_out(struct MPContext *mpctx)
 {
     uninit_video_chain(mpctx);
+    uninit_spare_video_decoder(mpctx);
     if (mpctx->video_out) {
         vo_destroy(mpctx->video_out);
         mp_notify(mpctx, MPV_EVENT_VIDEO_RECONFIG, NULL);
@@ -271,7 +390,13 @@ void uninit_video_out(struct MPContext *mpctx)
     mpctx->video_out = NULL;
 }
 
-static void vo_chain_uninit(struct vo_chain *vo_c)
+void uninit_spare_video_decoder(struct MPContext *mpctx)
+{
+    video_uninit(mpctx->spare_video_decoder);
+    mpctx->spare_video_decoder = NULL;
+}
+
+static void vo_chain_uninit(struct MPContext *mpctx, struct vo_chain *vo_c)
 {
     struct track *track = vo_c->track;
     if (track) {
@@ -279,7 +404,12 @@ static void vo_chain_uninit(struct vo_chain *vo_c)
         track->vo_c = NULL;
         assert(track->d_video == vo_c->video_src);
         track->d_video = NULL;
-        video_uninit(vo_c->video_src);
+        struct dec_video *d_video = vo_c->video_src;
+        if (!mpctx->spare_video_decoder && video_can_reuse(d_video)) {
+            mpctx->spare_video_decoder = d_video;
+        } else {
+            video_uninit(d_video);
+        }
     }
 
     if (vo_c->filter_src)
@@ -287,6 +417,7 @@ static void vo_chain_uninit(struct vo_chain *vo_c)
 
     mp_image_unrefp(&vo_c->input_mpi);
     mp_image_unrefp(&vo_c->cached_coverart);
+    step_cache_clear(vo_c);
     vf_destroy(vo_c->vf);
     talloc_free(vo_c);
     // this does not free the VO
@@ -296,7 +427,7 @@ void uninit_video_chain(struct MPContext *mpctx)
 {
     if (mpctx->vo_chain) {
         reset_video_state(mpctx);
-        vo_chain_uninit(mpctx->vo_chain);
+        vo_chain_uninit(mpctx, mpctx->vo_chain);
         mpctx->vo_chain = NULL;
 
         mpctx->video_status = STATUS_EOF;
@@ -305,13 +436,38 @@ void uninit_video_chain(struct MPContext *mpctx)
     }
 }
 
+// Try to take over the previous decoder, instead of opening a new one.
+static bool reuse_video_decoder(struct MPContext *mpctx, struct track *track)
+{
+    struct dec_video *d_video = mpctx->spare_video_decoder;
+    // Decoders not connected to the VO (lavfi-complex) never take it.
+    if (!d_video || !mpctx->vo_chain || track->vo_c != mpctx->vo_chain)
+        return false;
+    mpctx->spare_video_decoder = NULL;
+
+    if (d_video->vo == mpctx->vo_chain->vo &&
+        d_video->hwdec_devs == mpctx->vo_chain->hwdec_devs &&
+        video_reuse(d_video, track->stream))
+    {
+        track->d_video = d_video;
+        return true;
+    }
+
+    video_uninit(d_video);
+    return false;
+}
+
 int init_video_decoder(struct MPContext *mpctx, struct track *track)
 {
     assert(!track->d_video);
     if (!track->stream)
         goto err_out;
 
+    if (reuse_video_decoder(mpctx, track))
+        return 1;
+
     track->d_video = talloc_zero(NULL, struct dec_video);
+    ta_set_account(track->d_video, MP_MEM_DECODER);
     struct dec_video *d_video = track->d_video;
     d_video->global = mpctx->global;
     d_video->log = mp_log_new(d_video, mpctx->log, "!vd");
@@ -392,6 +548,8 @@ void reinit_video_chain_src(struct MPContext *mpctx, struct track *track)
     vo_c->log = mpctx->log;
     vo_c->vo = mpctx->video_out;
     vo_c->vf = vf_new(mpctx->global);
+    vo_c->step_cache_prev_pts = MP_NOPTS_VALUE;
+    vo_c->step_cache_skip_pts = MP_NOPTS_VALUE;
 
     vo_c->hwdec_devs = vo_c->vo->hwdec_devs;
 
@@ -473,6 +631,53 @@ static bool check_framedrop(struct MPContext *mpctx, struct vo_chain *vo_c)
     return false;
 }
 
+// Adjust the decoder's --framedrop=decoder-tiered level. Go up a level if video
+// is late or decoding is slower than realtime, and go back down after video
+// has caught up, with some hysteresis to avoid toggling all the time.
+static void update_framedrop_level(struct MPContext *mpctx,
+                                   struct vo_chain *vo_c)
+{
+    struct MPOpts *opts = mpctx->opts;
+    struct dec_video *d_video = vo_c->video_src;
+    if (!d_video)
+        return;
+
+    if (!(opts->frame_dropping & 4)) {
+        video_set_framedrop_level(d_video, 0);
+        return;
+    }
+
+    if (mpctx->video_status != STATUS_PLAYING || mpctx->paused ||
+        mpctx->audio_status != STATUS_PLAYING || ao_untimed(mpctx->ao))
+        return;
+
+    double now = mp_time_sec();
+    double since_change = now - vo_c->framedrop_level_time;
+    float fps = vo_c->container_fps;
+    double frame_time = fps > 0 ? 1.0 / fps : 0;
+    double late = mpctx->last_av_difference;
+    // Only known with software decoding; 0 otherwise.
+    double decode_time = d_video->stats.frame_time_avg;
+
+    int level = d_video->framedrop_level;
+    if ((late > 0.100 || (frame_time > 0 && decode_time > frame_time * 0.9)) &&
+        since_change > 0.5)
+    {
+        level += 1;
+    } else if (late < 0.020 && since_change > 3 &&
+               (frame_time <= 0 || decode_time < frame_time * 0.6))
+    {
+        level -= 1;
+    }
+    level = MPCLAMP(level, 0, 3);
+
+    if (level != d_video->framedrop_level) {
+        MP_VERBOSE(mpctx, "Setting decoder framedrop level to %d.\n", level);
+        video_set_framedrop_level(d_video, level);
+        vo_c->framedrop_level_time = now;
+    }
+}
+
 // Read a packet, store decoded image into d_video->waiting_decoded_mpi
 // returns VD_* code
 static int decode_image(struct MPContext *mpctx)
@@ -491,6 +696,7 @@ static int decode_image(struct MPContext *mpctx)
         video_set_start(d_video, hrseek ? mpctx->hrseek_pts : MP_NOPTS_VALUE);
 
         video_set_framedrop(d_video, check_framedrop(mpctx, vo_c));
+        update_framedrop_level(mpctx, vo_c);
 
         video_work(d_video);
         res = video_get_frame(d_video, &vo_c->input_mpi);
@@ -708,13 +914,52 @@ static int get_req_frames(struct MPContext *mpctx, bool eof)
         return mpctx->opts->video_sync == VS_DEFAULT ? 1 : 2;
 
     int req = vo_get_num_req_frames(mpctx->video_out);
-    return MPCLAMP(req, 2, MP_ARRAY_SIZE(mpctx->next_frames) - 1);
+    return MPCLAMP(req, 2, VO_MAX_REQ_FRAMES);
+}
+
+// Number of frames to decode in addition to what the VO needs. With
+// --video-lookahead=auto, this is enough to cover the decode time spikes seen
+// recently, so that a slow frame (like a key frame) doesn't cause a drop.
+static int get_lookahead(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    struct vo_chain *vo_c = mpctx->vo_chain;
+
+    if (!opts->video_lookahead || vo_c->is_coverart ||
+        mpctx->video_status != STATUS_PLAYING || mpctx->num_next_frames < 1)
+        return 0;
+
+    int n = opts->video_lookahead;
+    if (n < 0) {
+        struct dec_video *d_video = vo_c->video_src;
+        float fps = vo_c->container_fps;
+        double frame_time = fps > 0 ? 1.0 / fps / mpctx->video_speed : 0;
+        if (!d_video || frame_time <= 0 || d_video->stats.frame_time_avg <= 0)
+            return 0;
+        struct dec_video_stats *st = &d_video->stats;
+        double spike = MPMAX(st->frame_time_avg + 3 * st->frame_time_dev,
+                             st->frame_time_max);
+        n = MPMIN(ceil(spike / frame_time), MAX_VIDEO_LOOKAHEAD);
+    }
+
+    struct mp_image *img = mpctx->next_frames[0];
+    if (IMGFMT_IS_HWACCEL(img->imgfmt)) {
+        // Limited by the surfaces the decoder reserved for this.
+        n = MPMIN(n, MAX_VIDEO_LOOKAHEAD_HW);
+    } else {
+        int64_t limit = opts->video_lookahead_max_size * (int64_t)(1024 * 1024);
+        int64_t size = mp_image_get_alloc_size(img->imgfmt, img->w, img->h, 1);
+        if (size > 0)
+            n = MPMIN(n, limit / size);
+    }
+    return n;
 }
 
 // Whether it's fine to call add_new_frame() now.
 static bool needs_new_frame(struct MPContext *mpctx)
 {
-    return mpctx->num_next_frames < get_req_frames(mpctx, false);
+    int max = get_req_frames(mpctx, false) + get_lookahead(mpctx);
+    return mpctx->num_next_frames < MPMIN(max, MP_ARRAY_SIZE(mpctx->next_frames));
 }
 
 // Queue a frame to mpctx->next_frames[]. Call only if needs_new_frame() signals ok.
@@ -735,8 +980,10 @@ static bool have_new_frame(struct MPContext *mpctx, bool eof)
 }
 
 // Fill mpctx->next_frames[] with a newly filtered or decoded image.
+// If ahead is set, decode a frame beyond what the VO needs (if there's room),
+// and return the decoding result instead of whether a frame can be shown.
 // returns VD_* code
-static int video_output_image(struct MPContext *mpctx)
+static int video_output_image(struct MPContext *mpctx, bool ahead)
 {
     struct vo_chain *vo_c = mpctx->vo_chain;
     bool hrseek = mpctx->hrseek_active && mpctx->video_status == STATUS_SYNCING;
@@ -747,9 +994,20 @@ static int video_output_image(struct MPContext *mpctx)
         hrseek = false;
     }
 
-    if (have_new_frame(mpctx, false))
+    if (!ahead && have_new_frame(mpctx, false))
         return VD_NEW_FRAME;
 
+    // Stepping to a frame in the step cache: show it without decoding.
+    if (hrseek && mpctx->hrseek_cached && !mpctx->num_next_frames) {
+        mpctx->hrseek_cached = false;
+        struct step_cache_frame *f = step_cache_find(vo_c, mpctx->hrseek_pts);
+        if (f) {
+            vo_c->step_cache_skip_pts = f->img->pts;
+            add_new_frame(mpctx, mp_image_new_ref(f->img));
+            return VD_NEW_FRAME;
+        }
+    }
+
     // Get a new frame if we need one.
     int r = VD_PROGRESS;
     if (needs_new_frame(mpctx)) {
@@ -759,6 +1017,7 @@ static int video_output_image(struct MPContext *mpctx)
             return r; // error
         struct mp_image *img = vf_read_output_frame(vo_c->vf);
         if (img) {
+            step_cache_add(mpctx, img);
             double endpts = get_play_end_pts(mpctx);
             if ((endpts != MP_NOPTS_VALUE && img->pts >= endpts) ||
                 mpctx->max_frames == 0)
@@ -770,6 +1029,9 @@ static int video_output_image(struct MPContext *mpctx)
                 mp_image_setrefp(&mpctx->saved_frame, img);
             } else if (hrseek && img->pts < mpctx->hrseek_pts - .005) {
                 /* just skip - but save if backstep active */
+                if (mpctx->hrseek_first_pts == MP_NOPTS_VALUE)
+                    mpctx->hrseek_first_pts = img->pts;
+                mpctx->hrseek_skipped += 1;
                 if (mpctx->hrseek_backstep)
                     mp_image_setrefp(&mpctx->saved_frame, img);
             } else if (mpctx->video_status == STATUS_SYNCING &&
@@ -777,7 +1039,12 @@ static int video_output_image(struct MPContext *mpctx)
                        img->pts < mpctx->playback_pts && !vo_c->is_coverart)
             {
                 /* skip after stream-switching */
+            } else if (vo_c->step_cache_skip_pts != MP_NOPTS_VALUE &&
+                       img->pts <= vo_c->step_cache_skip_pts + 1e-6)
+            {
+                /* already shown from the frame step cache */
             } else {
+                vo_c->step_cache_skip_pts = MP_NOPTS_VALUE;
                 if (hrseek && mpctx->hrseek_backstep) {
                     if (mpctx->saved_frame) {
                         add_new_frame(mpctx, mpctx->saved_frame);
@@ -801,9 +1068,22 @@ static int video_output_image(struct MPContext *mpctx)
         r = VD_PROGRESS;
     }
 
+    if (ahead)
+        return r;
     return have_new_frame(mpctx, r <= 0) ? VD_NEW_FRAME : r;
 }
 
+// Use the time until the VO wants the next frame to decode ahead.
+static int video_decode_ahead(struct MPContext *mpctx)
+{
+    if (!get_lookahead(mpctx) || !needs_new_frame(mpctx))
+        return VD_WAIT;
+    int r = video_output_image(mpctx, true);
+    if (r == VD_PROGRESS || r == VD_RECONFIG)
+        mp_wakeup_core(mpctx); // more until the queue is full
+    return r;
+}
+
 /* Update avsync before a new video frame is displayed. Actually, this can be
  * called arbitrarily often before the actual display.
  * This adjusts the time of the next video frame */
@@ -1230,8 +1510,10 @@ void write_video(struct MPContext *mpctx)
 {
     struct MPOpts *opts = mpctx->opts;
 
-    if (!mpctx->vo_chain)
+    if (!mpctx->vo_chain) {
+        mpctx->input_time = 0;
         return;
+    }
     struct track *track = mpctx->vo_chain->track;
     struct vo *vo = mpctx->vo_chain->vo;
 
@@ -1242,7 +1524,7 @@ void write_video(struct MPContext *mpctx)
     if (mpctx->paused && mpctx->video_status >= STATUS_READY)
         return;
 
-    int r = video_output_image(mpctx);
+    int r = video_output_image(mpctx, false);
     MP_TRACE(mpctx, "video_output_image: %d\n", r);
 
     if (r < 0)
@@ -1341,6 +1623,8 @@ void write_video(struct MPContext *mpctx)
     if (!vo_is_ready_for_frame(vo, mpctx->display_sync_active ? -1 : pts)) {
         if (video_feed_async_filter(mpctx) < 0)
             goto error;
+        if (video_decode_ahead(mpctx) < 0)
+            goto error;
         return;
     }
 
@@ -1364,7 +1648,9 @@ void write_video(struct MPContext *mpctx)
         .still = mpctx->step_frames > 0,
         .num_frames = MPMIN(mpctx->num_next_frames, req),
         .num_vsyncs = 1,
+        .input_time = mpctx->input_time,
     };
+    mpctx->input_time = 0;
     for (int n = 0; n < dummy.num_frames; n++)
         dummy.frames[n] = mpctx->next_frames[n];
     struct vo_frame *frame = vo_frame_ref(&dummy);
@@ -49,8 +49,10 @@
 
 #include "config.h"
 
+#include "osdep/atomic.h"
 #include "osdep/timer.h"
 #include "osdep/threads.h"
+#include "misc/thread_sched.h"
 
 #include "common/msg.h"
 #include "common/tags.h"
@@ -72,8 +74,11 @@ const struct m_sub_options stream_cache_conf = {
         OPT_INTRANGE("cache-initial", initial, 0, 0, 0x7fffffff),
         OPT_INTRANGE("cache-seek-min", seek_min, 0, 0, 0x7fffffff),
         OPT_INTRANGE("cache-backbuffer", back_buffer, 0, 0, 0x7fffffff),
+        OPT_INTRANGE("cache-keep-ranges", keep_ranges, 0, 0, 0x7fffffff),
         OPT_STRING("cache-file", file, M_OPT_FILE),
         OPT_INTRANGE("cache-file-size", file_max, 0, 0, 0x7fffffff),
+        OPT_STRING("cache-file-dir", file_dir, M_OPT_FILE),
+        OPT_DOUBLE("cache-readahead-secs", readahead_secs, M_OPT_MIN, .min = 0),
         {0}
     },
     .size = sizeof(struct mp_cache_opts),
@@ -83,12 +88,27 @@ const struct m_sub_options stream_cache_conf = {
         .initial = 0,
         .seek_min = 500,
         .back_buffer = 75000,
+        .keep_ranges = 16 * 1024,
         .file_max = 1024 * 1024,
     },
 };
 
+// Maximum number of byte ranges kept in addition to the ringbuffer.
+#define MAX_KEPT_RANGES 16
+
+// A range of previously cached data, which was copied out of the ringbuffer
+// when the cache was dropped due to a seek. This allows serving seeks which
+// jump back and forth between distant file positions (e.g. index data at the
+// end of the file) without reading the data again.
+struct byte_range {
+    int64_t start, end;     // file positions covered by data[]
+    unsigned char *data;
+    int64_t last_use;       // for LRU eviction (compared to use_counter)
+};
+
 // Note: (struct priv*)(cache->priv)->cache == cache
 struct priv {
+    struct mpv_global *global;
     pthread_t cache_thread;
     bool cache_thread_running;
     pthread_mutex_t mutex;
@@ -101,15 +121,25 @@ struct priv {
     int64_t back_size;      // keep back_size amount of old bytes for backward seek
     int64_t seek_limit;     // keep filling cache if distance is less that seek limit
     bool seekable;          // underlying stream is seekable
+    int64_t keep_ranges_size; // max. total size of ranges[]
 
     struct mp_log *log;
 
     // Owned by the main thread
     stream_t *cache;        // wrapper stream, used by demuxer etc.
+    int64_t bytes_until_wakeup; // wakeup cache thread after this many bytes
 
     // Owned by the cache thread
     stream_t *stream;       // "real" stream, used to read from the source media
-    int64_t bytes_until_wakeup; // wakeup cache thread after this many bytes
+
+    // For reading buffered data without locking (see read_lockfree()).
+    // Written by the cache thread with the mutex held.
+    atomic_llong ring_start, ring_end; // min_filepos/max_filepos
+    atomic_uint ring_gen;   // incremented before and after the buffer
+                            // contents are dropped or moved (odd: changing)
+    // Client read position (mirrors cache->pos). Changed by the main thread
+    // only, with the mutex held unless it's in the ringbuffer.
+    atomic_llong read_filepos;
 
     // All the following members are shared between the threads.
     // You must lock the mutex to access them.
@@ -118,18 +148,29 @@ struct priv {
     int64_t min_filepos;    // range of file that is cached in the buffer
     int64_t max_filepos;    // ... max_filepos being the last read position
     bool eof;               // true if max_filepos = EOF
-    int64_t offset;         // buffer[WRAP(s->max_filepos - offset)] corresponds
-                            // to the byte at max_filepos (must be wrapped by
-                            // buffer_size)
+    int64_t offset;         // buffer[buffer_pos(pos)] is the byte at file
+                            // position pos; changed only when the buffer
+                            // contents are dropped or moved
+
+    // Kept ranges outside of the ringbuffer (unsorted)
+    struct byte_range *ranges[MAX_KEPT_RANGES];
+    int num_ranges;
+    int64_t ranges_size;    // sum of all range sizes
+    int64_t use_counter;
 
     bool idle;              // cache thread has stopped reading
     int64_t reads;          // number of actual read attempts performed
     int64_t speed_start;    // start time (us) for calculating download speed
     int64_t speed_amount;   // bytes read since speed_start
     double speed;
+    double speed_avg;       // smoothed speed (only while not throttled)
+    double speed_dev;       // smoothed absolute deviation from speed_avg
+    bool speed_throttled;   // readahead target was hit since speed_start
+
+    double readahead_secs;  // 0 to disable adaptive readahead
+    double bitrate;         // bytes/second consumed by the demuxer (or 0)
 
     bool enable_readahead;  // actively read beyond read() position
-    int64_t read_filepos;   // client read position (mirrors cache->pos)
     int64_t read_min;       // file position until which the thread should
                             // read even if readahead is disabled
 
@@ -146,6 +187,12 @@ struct priv {
     struct mp_tags *stream_metadata;
     double start_pts;
     bool has_avseek;
+    struct stream_connection_info stream_conn_info;
+    struct stream_io_stats stream_io_stats; // copy of stream->io_stats
+    struct stream_snapshot stream_snapshot;
+
+    int64_t cache_hits;
+    int64_t cache_misses;
 };
 
 enum {
@@ -158,6 +205,33 @@ enum {
     FILL_LIMIT = 16 * 1024,
 };
 
+// Map a file position within [min_filepos, max_filepos] to buffer memory.
+static int64_t buffer_pos(struct priv *s, int64_t pos)
+{
+    int64_t bpos = (pos - s->offset) % s->buffer_size;
+    return bpos < 0 ? bpos + s->buffer_size : bpos;
+}
+
+// Make changes to min_filepos/max_filepos visible to read_lockfree(). If the
+// buffer contents were not just extended, this must be surrounded by
+// begin_ring_change() and end_ring_change().
+static void publish_ring(struct priv *s)
+{
+    atomic_store(&s->ring_end, s->max_filepos);
+    atomic_store(&s->ring_start, s->min_filepos);
+}
+
+static void begin_ring_change(struct priv *s)
+{
+    atomic_fetch_add(&s->ring_gen, 1);
+}
+
+static void end_ring_change(struct priv *s)
+{
+    publish_ring(s);
+    atomic_fetch_add(&s->ring_gen, 1);
+}
+
 // Used by the main thread to wakeup the cache thread, and to wait for the
 // cache thread. The cache mutex has to be locked when calling this function.
 // *retry_time should be set to 0 on the first call.
@@ -180,10 +254,103 @@ static bool cache_wakeup_and_wait(struct priv *s, double *retry_time)
     return !mp_cancel_test(s->cache->cancel);
 }
 
+static struct byte_range *find_range(struct priv *s, int64_t pos)
+{
+    for (int n = 0; n < s->num_ranges; n++) {
+        struct byte_range *r = s->ranges[n];
+        if (pos >= r->start && pos < r->end)
+            return r;
+    }
+    return NULL;
+}
+
+static void remove_range(struct priv *s, int index)
+{
+    struct byte_range *r = s->ranges[index];
+    s->ranges_size -= r->end - r->start;
+    ta_account_add_external(MP_MEM_STREAM, -(r->end - r->start));
+    free(r->data);
+    free(r);
+    MP_TARRAY_REMOVE_AT(s->ranges, s->num_ranges, index);
+}
+
+static void drop_ranges(struct priv *s)
+{
+    while (s->num_ranges)
+        remove_range(s, s->num_ranges - 1);
+}
+
+// Remove least recently used ranges until there's enough space for size bytes.
+static void evict_ranges(struct priv *s, int64_t size)
+{
+    while (s->num_ranges && (s->num_ranges >= MAX_KEPT_RANGES ||
+                             s->ranges_size + size > s->keep_ranges_size))
+    {
+        int oldest = 0;
+        for (int n = 1; n < s->num_ranges; n++) {
+            if (s->ranges[n]->last_use < s->ranges[oldest]->last_use)
+                oldest = n;
+        }
+        remove_range(s, oldest);
+    }
+}
+
+static size_t read_buffer(struct priv *s, unsigned char *dst,
+                          size_t dst_size, int64_t pos);
+
+// Copy the most recently read part of the ringbuffer into a new kept range.
+// Runs in the cache thread.
+static void keep_current_range(struct priv *s)
+{
+    if (!s->seekable || !s->keep_ranges_size)
+        return;
+    int64_t start = MPMAX(s->min_filepos, s->max_filepos - s->keep_ranges_size);
+    int64_t size = s->max_filepos - start;
+    if (size < FILL_LIMIT)
+        return;
+
+    // Ranges completely covered by the new one are redundant.
+    for (int n = s->num_ranges - 1; n >= 0; n--) {
+        struct byte_range *r = s->ranges[n];
+        if (r->start >= start && r->end <= s->max_filepos)
+            remove_range(s, n);
+    }
+    evict_ranges(s, size);
+
+    struct byte_range *r = malloc(sizeof(*r));
+    unsigned char *data = malloc(size);
+    if (!r || !data) {
+        free(r);
+        free(data);
+        return;
+    }
+    *r = (struct byte_range){
+        .start = start,
+        .end = s->max_filepos,
+        .data = data,
+        .last_use = ++s->use_counter,
+    };
+    size_t copied = read_buffer(s, data, size, start);
+    assert(copied == size);
+    s->ranges[s->num_ranges++] = r;
+    s->ranges_size += size;
+    ta_account_add_external(MP_MEM_STREAM, size);
+    MP_VERBOSE(s, "Keeping range %"PRId64"-%"PRId64" (%d ranges, %"PRId64
+               " KiB).\n", r->start, r->end, s->num_ranges,
+               s->ranges_size / 1024);
+}
+
 // Runs in the cache thread
 static void cache_drop_contents(struct priv *s)
 {
-    s->offset = s->min_filepos = s->max_filepos = s->read_filepos;
+    // If the read position is in a kept range, continue reading after it.
+    int64_t pos = atomic_load(&s->read_filepos);
+    struct byte_range *r = find_range(s, pos);
+    if (r)
+        pos = r->end;
+    begin_ring_change(s);
+    s->offset = s->min_filepos = s->max_filepos = pos;
+    end_ring_change(s);
     s->eof = false;
     s->start_pts = MP_NOPTS_VALUE;
 }
@@ -193,11 +360,37 @@ static void update_speed(struct priv *s)
     int64_t now = mp_time_us();
     if (s->speed_start + 1000000 <= now) {
         s->speed = s->speed_amount * 1e6 / (now - s->speed_start);
+        // Periods in which we stopped reading on purpose say nothing about
+        // the link, so they're excluded from the statistics.
+        if (!s->speed_throttled && !s->eof && s->speed_amount > 0) {
+            if (s->speed_avg <= 0) {
+                s->speed_avg = s->speed;
+            } else {
+                s->speed_dev += (fabs(s->speed - s->speed_avg) - s->speed_dev) / 4;
+                s->speed_avg += (s->speed - s->speed_avg) / 4;
+            }
+        }
         s->speed_amount = 0;
         s->speed_start = now;
+        s->speed_throttled = false;
     }
 }
 
+// Number of bytes the cache should try to keep buffered ahead of the read
+// position, or -1 for no limit (fill the whole cache).
+static int64_t readahead_target(struct priv *s)
+{
+    if (s->readahead_secs <= 0 || s->bitrate <= 0 || s->speed_avg <= 0)
+        return -1;
+    double jitter = MPMIN(s->speed_dev / s->speed_avg, 1.0);
+    // Buffer up to 3 times as much if the throughput varies a lot.
+    double secs = s->readahead_secs * (1 + 2 * jitter);
+    // A fast and stable link can refill the cache quickly if needed.
+    if (jitter < 0.1 && s->speed_avg > s->bitrate * 4)
+        secs /= 2;
+    return MPMAX(secs * s->bitrate, FILL_LIMIT * 4);
+}
+
 // Copy at most dst_size from the cache at the given absolute file position pos.
 // Return number of bytes that could actually be read.
 // Does not advance the file position, or change anything else.
@@ -211,12 +404,7 @@ static size_t read_buffer(struct priv *s, unsigned char *dst,
             break;
         int64_t newb = s->max_filepos - pos; // new bytes in the buffer
 
-        int64_t bpos = pos - s->offset; // file pos to buffer memory pos
-        if (bpos < 0) {
-            bpos += s->buffer_size;
-        } else if (bpos >= s->buffer_size) {
-            bpos -= s->buffer_size;
-        }
+        int64_t bpos = buffer_pos(s, pos);
 
         if (newb > s->buffer_size - bpos)
             newb = s->buffer_size - bpos; // handle wrap...
@@ -232,6 +420,22 @@ static size_t read_buffer(struct priv *s, unsigned char *dst,
     return read;
 }
 
+// Like read_buffer(), but also consider the kept ranges.
+static size_t read_cached(struct priv *s, unsigned char *dst,
+                          size_t dst_size, int64_t pos)
+{
+    size_t read = read_buffer(s, dst, dst_size, pos);
+    if (read)
+        return read;
+    struct byte_range *r = find_range(s, pos);
+    if (!r)
+        return 0;
+    read = MPMIN(dst_size, r->end - pos);
+    memcpy(dst, r->data + (pos - r->start), read);
+    r->last_use = ++s->use_counter;
+    return read;
+}
+
 // Whether a seek will be needed to get to the position. This honors seek_limit,
 // which is a heuristic to prevent dropping the cache with small forward seeks.
 // This helps in situations where waiting for network a bit longer would quickly
@@ -239,17 +443,22 @@ static size_t read_buffer(struct priv *s, unsigned char *dst,
 // not dropping the backwards cache will be a major performance win.
 static bool needs_seek(struct priv *s, int64_t pos)
 {
+    // Data from a kept range can be read until its end.
+    struct byte_range *r = find_range(s, pos);
+    if (r && r->end >= s->min_filepos)
+        pos = MPMAX(pos, MPMIN(r->end, s->max_filepos));
     return pos < s->min_filepos || pos > s->max_filepos + s->seek_limit;
 }
 
 static bool cache_update_stream_position(struct priv *s)
 {
-    int64_t read = s->read_filepos;
+    int64_t read = atomic_load(&s->read_filepos);
 
     if (needs_seek(s, read)) {
         MP_VERBOSE(s, "Dropping cache at pos %"PRId64", "
                    "cached range: %"PRId64"-%"PRId64".\n", read,
                    s->min_filepos, s->max_filepos);
+        keep_current_range(s);
         cache_drop_contents(s);
     }
 
@@ -266,13 +475,16 @@ static bool cache_update_stream_position(struct priv *s)
 // Runs in the cache thread.
 static void cache_fill(struct priv *s)
 {
-    int64_t read = s->read_filepos;
+    int64_t read = atomic_load(&s->read_filepos);
     bool read_attempted = false;
     int len = 0;
 
     if (!cache_update_stream_position(s))
         goto done;
 
+    // The reader might be in a kept range just before the ringbuffer.
+    read = MPMAX(read, s->min_filepos);
+
     if (!s->enable_readahead && s->read_min <= s->max_filepos)
         goto done;
 
@@ -292,13 +504,17 @@ static void cache_fill(struct priv *s)
     // number of buffer bytes that are valid and can be read
     int64_t newb = FFMAX(s->max_filepos - read, 0);
 
+    int64_t target = readahead_target(s);
+    if (target >= 0 && newb >= target && s->read_min <= s->max_filepos) {
+        s->speed_throttled = true;
+        goto done;
+    }
+
     // max. number of bytes that can be written (starting from max_filepos)
     int64_t space = s->buffer_size - (newb + back);
 
     // offset into the buffer that maps to max_filepos
-    int64_t pos = s->max_filepos - s->offset;
-    if (pos >= s->buffer_size)
-        pos -= s->buffer_size; // wrap-around
+    int64_t pos = buffer_pos(s, s->max_filepos);
 
     if (space < FILL_LIMIT)
         goto done;
@@ -311,6 +527,8 @@ static void cache_fill(struct priv *s)
     space = FFMIN(space, s->stream->read_chunk);
 
     // back+newb+space <= buffer_size
+    // The reader might advance read_filepos concurrently, but this never
+    // overwrites data at or after the position read above.
     int64_t back2 = s->buffer_size - (space + newb); // max back size
     if (s->min_filepos < (read - back2))
         s->min_filepos = read - back2;
@@ -329,8 +547,7 @@ static void cache_fill(struct priv *s)
     }
 
     s->max_filepos += len;
-    if (pos + len == s->buffer_size)
-        s->offset += s->buffer_size; // wrap...
+    publish_ring(s);
     s->speed_amount += len;
 
     read_attempted = true;
@@ -346,6 +563,7 @@ done: ;
     }
     s->idle = s->eof || !read_attempted;
     s->reads++;
+    s->stream_io_stats = s->stream->io_stats;
 
     update_speed(s);
 
@@ -375,36 +593,43 @@ static int resize_cache(struct priv *s, int64_t size)
     if (!buffer)
         return STREAM_ERROR;
 
+    if (!s->buffer)
+        cache_drop_contents(s);
+
+    begin_ring_change(s);
+
     if (s->buffer) {
+        int64_t read = atomic_load(&s->read_filepos);
         // Copy & free the old ringbuffer data.
         // If the buffer is too small, prefer to copy these regions:
         // 1. Data starting from read_filepos, until cache end
-        size_t read_1 = read_buffer(s, buffer, buffer_size, s->read_filepos);
+        size_t read_1 = read_buffer(s, buffer, buffer_size, read);
         // 2. then data from before read_filepos until cache start
         //    (this one needs to be copied to the end of the ringbuffer)
         size_t read_2 = 0;
-        if (s->min_filepos < s->read_filepos) {
+        if (s->min_filepos < read) {
             size_t copy_len = buffer_size - read_1;
-            copy_len = MPMIN(copy_len, s->read_filepos - s->min_filepos);
+            copy_len = MPMIN(copy_len, read - s->min_filepos);
             assert(copy_len + read_1 <= buffer_size);
             read_2 = read_buffer(s, buffer + buffer_size - copy_len, copy_len,
-                                 s->read_filepos - copy_len);
+                                 read - copy_len);
             // This shouldn't happen, unless copy_len was computed incorrectly.
             assert(read_2 == copy_len);
         }
         // Set it up such that read_1 is at buffer pos 0, and read_2 wraps
         // around below it, so that it is located at the end of the buffer.
-        s->min_filepos = s->read_filepos - read_2;
-        s->max_filepos = s->read_filepos + read_1;
+        s->min_filepos = read - read_2;
+        s->max_filepos = read + read_1;
         s->offset = s->max_filepos - read_1;
-    } else {
-        cache_drop_contents(s);
     }
 
     free(s->buffer);
+    ta_account_add_external(MP_MEM_STREAM, buffer_size - s->buffer_size);
 
     s->buffer_size = buffer_size;
     s->buffer = buffer;
+
+    end_ring_change(s);
     s->idle = false;
     s->eof = false;
 
@@ -439,6 +664,10 @@ static void update_cached_controls(struct priv *s)
     if (i64 >= 0)
         s->stream_size = i64;
     s->has_avseek = stream_control(s->stream, STREAM_CTRL_HAS_AVSEEK, NULL) > 0;
+    s->stream_conn_info = (struct stream_connection_info){0};
+    stream_control(s->stream, STREAM_CTRL_GET_CONNECTION_INFO,
+                   &s->stream_conn_info);
+    stream_update_snapshot(s->stream, s, &s->stream_snapshot);
 }
 
 // the core might call these every frame, so cache them...
@@ -449,7 +678,7 @@ static int cache_get_cached_control(stream_t *cache, int cmd, void *arg)
     case STREAM_CTRL_GET_CACHE_INFO:
         *(struct stream_cache_info *)arg = (struct stream_cache_info) {
             .size = s->buffer_size - s->back_size,
-            .fill = s->max_filepos - s->read_filepos,
+            .fill = s->max_filepos - atomic_load(&s->read_filepos),
             .idle = s->idle,
             .speed = llrint(s->speed),
         };
@@ -458,6 +687,10 @@ static int cache_get_cached_control(stream_t *cache, int cmd, void *arg)
         s->enable_readahead = *(int *)arg;
         pthread_cond_signal(&s->wakeup);
         return STREAM_OK;
+    case STREAM_CTRL_SET_BITRATE:
+        s->bitrate = *(double *)arg;
+        pthread_cond_signal(&s->wakeup);
+        return STREAM_OK;
     case STREAM_CTRL_GET_TIME_LENGTH:
         *(double *)arg = s->stream_time_length;
         return s->stream_time_length ? STREAM_OK : STREAM_UNSUPPORTED;
@@ -474,6 +707,18 @@ static int cache_get_cached_control(stream_t *cache, int cmd, void *arg)
     }
     case STREAM_CTRL_HAS_AVSEEK:
         return s->has_avseek ? STREAM_OK : STREAM_UNSUPPORTED;
+    case STREAM_CTRL_GET_IO_STATS: {
+        struct stream_io_stats *stats = arg;
+        *stats = s->stream_io_stats;
+        stats->cache_hits = s->cache_hits;
+        stats->cache_misses = s->cache_misses;
+        return STREAM_OK;
+    }
+    case STREAM_CTRL_GET_CONNECTION_INFO:
+        if (!s->stream_conn_info.num_connections)
+            return STREAM_UNSUPPORTED;
+        *(struct stream_connection_info *)arg = s->stream_conn_info;
+        return STREAM_OK;
     case STREAM_CTRL_GET_METADATA: {
         if (s->stream_metadata) {
             ta_set_parent(s->stream_metadata, NULL);
@@ -486,9 +731,9 @@ static int cache_get_cached_control(stream_t *cache, int cmd, void *arg)
     case STREAM_CTRL_AVSEEK:
         if (!s->has_avseek)
             return STREAM_UNSUPPORTED;
-        break;
+        return STREAM_ERROR;
     }
-    return STREAM_ERROR;
+    return stream_snapshot_control(&s->stream_snapshot, cmd, arg);
 }
 
 static bool control_needs_flush(int stream_ctrl)
@@ -528,9 +773,11 @@ static void cache_execute_control(struct priv *s)
                "returned error, this is not allowed!\n");
     } else if (pos_changed || (ok && control_needs_flush(s->control))) {
         MP_VERBOSE(s, "Dropping cache due to control()\n");
-        s->read_filepos = stream_tell(s->stream);
-        s->read_min = s->read_filepos;
+        s->read_min = stream_tell(s->stream);
+        atomic_store(&s->read_filepos, s->read_min);
         s->control_flush = true;
+        // Byte positions might refer to different data now.
+        drop_ranges(s);
         cache_drop_contents(s);
     }
 
@@ -543,6 +790,8 @@ static void *cache_thread(void *arg)
 {
     struct priv *s = arg;
     mpthread_set_name("cache");
+    ta_set_thread_account(MP_MEM_STREAM);
+    mp_thread_set_role(s->global, s->log, MP_THREAD_ROLE_CACHE);
     pthread_mutex_lock(&s->mutex);
     update_cached_controls(s);
     double last = mp_time_sec();
@@ -575,45 +824,104 @@ static void *cache_thread(void *arg)
     return NULL;
 }
 
+// Copy buffered data at read_filepos without locking the mutex. The cache
+// thread only appends to the ringbuffer while it's running normally, and never
+// overwrites data at or after read_filepos. Anything else (dropping or moving
+// the buffer contents) is detected with ring_gen, and makes this fail.
+// Runs in the main thread. Returns the number of bytes read (0 if none).
+static int read_lockfree(struct priv *s, char *dst, int dst_size)
+{
+    unsigned int gen = atomic_load(&s->ring_gen);
+    if (gen & 1)
+        return 0;
+
+    int64_t pos = atomic_load(&s->read_filepos);
+    if (pos < atomic_load(&s->ring_start))
+        return 0;
+    int64_t avail = atomic_load(&s->ring_end) - pos;
+    int len = MPMIN(dst_size, avail);
+    if (len <= 0)
+        return 0;
+
+    int64_t bpos = buffer_pos(s, pos);
+    int len1 = MPMIN(len, s->buffer_size - bpos);
+    memcpy(dst, &s->buffer[bpos], len1);
+    memcpy(dst + len1, s->buffer, len - len1);
+
+    if (atomic_load(&s->ring_gen) != gen)
+        return 0;
+
+    atomic_store(&s->read_filepos, pos + len);
+    return len;
+}
+
+// Wakeup the cache thread, possibly make it read more data ahead. This is
+// throttled to reduce excessive wakeups during normal reading (using the
+// amount of bytes after which the cache thread most likely can actually read
+// new data). Set locked if the caller holds the mutex.
+static void wakeup_after_read(struct priv *s, int readb, int max_len, bool locked)
+{
+    s->bytes_until_wakeup -= readb;
+    if (s->bytes_until_wakeup > 0)
+        return;
+    s->bytes_until_wakeup = MPMAX(FILL_LIMIT, s->stream->read_chunk);
+
+    if (!locked)
+        pthread_mutex_lock(&s->mutex);
+    if (!s->eof) {
+        s->read_min = atomic_load(&s->read_filepos) + max_len + 64 * 1024;
+        pthread_cond_signal(&s->wakeup);
+    }
+    if (!locked)
+        pthread_mutex_unlock(&s->mutex);
+}
+
 static int cache_fill_buffer(struct stream *cache, char *buffer, int max_len)
 {
     struct priv *s = cache->priv;
     assert(s->cache_thread_running);
 
-    pthread_mutex_lock(&s->mutex);
-
-    if (cache->pos != s->read_filepos)
+    if (cache->pos != atomic_load(&s->read_filepos))
         MP_ERR(s, "!!! read_filepos differs !!! report this bug...\n");
 
-    int readb = 0;
+    // Most reads are served from already buffered data, without touching the
+    // mutex at all.
+    int readb = read_lockfree(s, buffer, max_len);
+    if (readb > 0) {
+        s->cache_hits++;
+        wakeup_after_read(s, readb, max_len, false);
+        return readb;
+    }
+
+    pthread_mutex_lock(&s->mutex);
+
     if (max_len > 0) {
         double retry_time = 0;
         int64_t retry = s->reads - 1; // try at least 1 read on EOF
+        bool waited = false;
         while (1) {
-            s->read_min = s->read_filepos + max_len + 64 * 1024;
-            readb = read_buffer(s, buffer, max_len, s->read_filepos);
-            s->read_filepos += readb;
-            if (readb > 0)
+            int64_t pos = atomic_load(&s->read_filepos);
+            s->read_min = pos + max_len + 64 * 1024;
+            readb = read_cached(s, buffer, max_len, pos);
+            atomic_store(&s->read_filepos, pos + readb);
+            if (readb > 0) {
+                if (waited) {
+                    s->cache_misses++;
+                } else {
+                    s->cache_hits++;
+                }
                 break;
-            if (s->eof && s->read_filepos >= s->max_filepos && s->reads >= retry)
+            }
+            if (s->eof && pos >= s->max_filepos && s->reads >= retry)
                 break;
             s->idle = false;
+            waited = true;
             if (!cache_wakeup_and_wait(s, &retry_time))
                 break;
         }
     }
 
-    if (!s->eof) {
-        // wakeup the cache thread, possibly make it read more data ahead
-        // this is throttled to reduce excessive wakeups during normal reading
-        // (using the amount of bytes after which the cache thread most likely
-        // can actually read new data)
-        s->bytes_until_wakeup -= readb;
-        if (s->bytes_until_wakeup <= 0) {
-            s->bytes_until_wakeup = MPMAX(FILL_LIMIT, s->stream->read_chunk);
-            pthread_cond_signal(&s->wakeup);
-        }
-    }
+    wakeup_after_read(s, readb, max_len, true);
     pthread_mutex_unlock(&s->mutex);
     return readb;
 }
@@ -628,7 +936,7 @@ static int cache_seek(stream_t *cache, int64_t pos)
 
     MP_DBG(s, "request seek: %" PRId64 " <= to=%" PRId64
            " (cur=%" PRId64 ") <= %" PRId64 "  \n",
-           s->min_filepos, pos, s->read_filepos, s->max_filepos);
+           s->min_filepos, pos, atomic_load(&s->read_filepos), s->max_filepos);
 
     if (!s->seekable && pos > s->max_filepos) {
         MP_ERR(s, "Attempting to seek past cached data in unseekable stream.\n");
@@ -637,7 +945,8 @@ static int cache_seek(stream_t *cache, int64_t pos)
         MP_ERR(s, "Attempting to seek before cached data in unseekable stream.\n");
         r = 0;
     } else {
-        cache->pos = s->read_filepos = s->read_min = pos;
+        cache->pos = s->read_min = pos;
+        atomic_store(&s->read_filepos, pos);
         // Is this seek likely to cause a stream-level seek?
         // If it is, wait until that is complete and return its result.
         // This check is not quite exact - if the reader thread is blocked in
@@ -694,7 +1003,7 @@ static int cache_control(stream_t *cache, int cmd, void *arg)
     r = s->control_res;
     if (s->control_flush) {
         stream_drop_buffers(cache);
-        cache->pos = s->read_filepos;
+        cache->pos = atomic_load(&s->read_filepos);
     }
 
 done:
@@ -715,7 +1024,9 @@ static void cache_uninit(stream_t *cache)
     }
     pthread_mutex_destroy(&s->mutex);
     pthread_cond_destroy(&s->wakeup);
+    drop_ranges(s);
     free(s->buffer);
+    ta_account_add_external(MP_MEM_STREAM, -s->buffer_size);
     talloc_free(s);
 }
 
@@ -729,6 +1040,7 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
 
     struct priv *s = talloc_zero(NULL, struct priv);
     s->log = cache->log;
+    s->global = cache->global;
     s->eof_pos = -1;
     s->enable_readahead = true;
 
@@ -738,6 +1050,8 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
 
     s->seek_limit = opts->seek_min * 1024ULL;
     s->back_size = opts->back_buffer * 1024ULL;
+    s->keep_ranges_size = opts->keep_ranges * 1024ULL;
+    s->readahead_secs = opts->readahead_secs;
 
     s->stream_size = stream_get_size(stream);
 
@@ -17,6 +17,11 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <libavutil/mem.h>
+#include <libavutil/sha.h>
 
 #include "osdep/io.h"
 
@@ -24,18 +29,28 @@
 #include "common/msg.h"
 
 #include "options/options.h"
+#include "options/path.h"
 
 #include "stream.h"
 
 #define BLOCK_SIZE 1024LL
 #define BLOCK_ALIGN(p) ((p) & ~(BLOCK_SIZE - 1))
 
+// Header of the block map file used with --cache-file-dir. It is followed by
+// the key (see open_persistent()), and the block_bits array.
+#define BLOCKS_MAGIC "mpv-cache-blocks-1\n"
+
 struct priv {
     struct stream *original;
     FILE *cache_file;
     uint8_t *block_bits;    // 1 bit for each BLOCK_SIZE, whether block was read
+    size_t block_bits_size;
     int64_t size;           // currently known size
     int64_t max_size;       // max. size for block_bits and cache_file
+
+    // Persistent mode (--cache-file-dir)
+    char *blocks_file;      // where block_bits is saved on close
+    char *key;              // identifies the cached contents
 };
 
 static bool test_bit(struct priv *p, int64_t pos)
@@ -112,42 +127,156 @@ static int control(stream_t *s, int cmd, void *arg)
     return stream_control(p->original, cmd, arg);
 }
 
+// Write the block map, so that the next open of the same stream can reuse the
+// data in the cache file.
+static void save_blocks(stream_t *s)
+{
+    struct priv *p = s->priv;
+    char *tmp = talloc_asprintf(NULL, "%s.tmp", p->blocks_file);
+    FILE *f = fopen(tmp, "wb");
+    bool ok = f &&
+        fwrite(BLOCKS_MAGIC, strlen(BLOCKS_MAGIC), 1, f) == 1 &&
+        fwrite(p->key, strlen(p->key), 1, f) == 1 &&
+        fwrite(p->block_bits, p->block_bits_size, 1, f) == 1;
+    if (f && fclose(f))
+        ok = false;
+    if (ok && rename(tmp, p->blocks_file)) {
+        // Windows does not replace existing files with rename().
+        unlink(p->blocks_file);
+        ok = !rename(tmp, p->blocks_file);
+    }
+    if (!ok) {
+        MP_WARN(s, "could not write '%s'\n", p->blocks_file);
+        unlink(tmp);
+    }
+    talloc_free(tmp);
+}
+
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
-    if (p->cache_file)
+    if (p->cache_file) {
+        // Save the block map only if all data made it to the file.
+        if (p->blocks_file && fflush(p->cache_file) == 0)
+            save_blocks(s);
         fclose(p->cache_file);
+    }
     talloc_free(p);
 }
 
+// Load the block map saved by save_blocks(). Return false if it's missing or
+// doesn't match the stream.
+static bool load_blocks(struct priv *p)
+{
+    FILE *f = fopen(p->blocks_file, "rb");
+    if (!f)
+        return false;
+    size_t header_size = strlen(BLOCKS_MAGIC) + strlen(p->key);
+    char *header = talloc_size(NULL, header_size);
+    bool ok = fread(header, header_size, 1, f) == 1 &&
+              memcmp(header, BLOCKS_MAGIC, strlen(BLOCKS_MAGIC)) == 0 &&
+              memcmp(header + strlen(BLOCKS_MAGIC), p->key, strlen(p->key)) == 0;
+    // If --cache-file-size changed, the map size differs. Bits past the end
+    // are simply not used.
+    if (ok)
+        fread(p->block_bits, 1, p->block_bits_size, f);
+    talloc_free(header);
+    fclose(f);
+    return ok;
+}
+
+// Open (or create) the cache file for the stream in the cache directory. The
+// file name is derived from the URL and the stream size. (Ideally, this would
+// include the ETag for HTTP, but libavformat doesn't export it.) Streams of
+// unknown size can't be verified, and get an anonymous temporary file instead.
+static FILE *open_persistent(stream_t *cache, struct priv *p, stream_t *stream,
+                             struct mp_cache_opts *opts)
+{
+    int64_t size = stream_get_size(stream);
+    if (size < 0) {
+        MP_VERBOSE(cache, "unknown stream size, not using persistent cache\n");
+        return tmpfile();
+    }
+
+    p->key = talloc_asprintf(p, "url=%s\nsize=%"PRId64"\n", stream->url, size);
+
+    uint8_t hash[32];
+    struct AVSHA *sha = av_sha_alloc();
+    if (!sha)
+        abort();
+    av_sha_init(sha, 256);
+    av_sha_update(sha, p->key, strlen(p->key));
+    av_sha_final(sha, hash);
+    av_free(sha);
+
+    char *name = talloc_strdup(p, "");
+    for (int i = 0; i < sizeof(hash); i++)
+        name = talloc_asprintf_append(name, "%02X", hash[i]);
+
+    char *dir = mp_get_user_path(p, cache->global, opts->file_dir);
+    mp_mkdirp(dir);
+    char *data_file = mp_path_join(p, dir, name);
+    p->blocks_file = talloc_asprintf(p, "%s.blocks", data_file);
+
+    FILE *file = NULL;
+    if (load_blocks(p)) {
+        file = fopen(data_file, "rb+");
+        if (file) {
+            MP_VERBOSE(cache, "reusing cache file '%s'\n", data_file);
+        } else {
+            memset(p->block_bits, 0, p->block_bits_size);
+        }
+    }
+    if (!file) {
+        // Make sure a stale block map is not used with a new data file.
+        unlink(p->blocks_file);
+        file = fopen(data_file, "wb+");
+    }
+    if (!file)
+        MP_ERR(cache, "can't open cache file '%s'\n", data_file);
+    return file;
+}
+
 // return 1 on success, 0 if disabled, -1 on error
 int stream_file_cache_init(stream_t *cache, stream_t *stream,
                            struct mp_cache_opts *opts)
 {
-    if (!opts->file || !opts->file[0] || opts->file_max < 1)
+    bool use_file = opts->file && opts->file[0];
+    bool use_dir = !use_file && opts->file_dir && opts->file_dir[0];
+    if ((!use_file && !use_dir) || opts->file_max < 1)
         return 0;
 
     if (!stream->seekable) {
+        if (use_dir)
+            return 0;
         MP_ERR(cache, "can't cache unseekable stream\n");
         return -1;
     }
 
-    bool use_anon_file = strcmp(opts->file, "TMP") == 0;
-    FILE *file = use_anon_file ? tmpfile() : fopen(opts->file, "wb+");
+    struct priv *p = talloc_zero(NULL, struct priv);
+    p->original = stream;
+    p->max_size = opts->file_max * 1024LL;
+
+    // file_max can be INT_MAX, so this is at most about 256MB
+    p->block_bits_size = (p->max_size / BLOCK_SIZE + 1) / 8 + 1;
+    p->block_bits = talloc_zero_size(p, p->block_bits_size);
+
+    FILE *file = NULL;
+    if (use_dir) {
+        file = open_persistent(cache, p, stream, opts);
+    } else {
+        bool use_anon_file = strcmp(opts->file, "TMP") == 0;
+        file = use_anon_file ? tmpfile() : fopen(opts->file, "wb+");
+        if (!file)
+            MP_ERR(cache, "can't open cache file '%s'\n", opts->file);
+    }
     if (!file) {
-        MP_ERR(cache, "can't open cache file '%s'\n", opts->file);
+        talloc_free(p);
         return -1;
     }
 
-    struct priv *p = talloc_zero(NULL, struct priv);
-
     cache->priv = p;
-    p->original = stream;
     p->cache_file = file;
-    p->max_size = opts->file_max * 1024LL;
-
-    // file_max can be INT_MAX, so this is at most about 256MB
-    p->block_bits = talloc_zero_size(p, (p->max_size / BLOCK_SIZE + 1) / 8 + 1);
 
     cache->seek = seek;
     cache->fill_buffer = fill_buffer;
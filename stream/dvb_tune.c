@@ -39,6 +39,7 @@
 #include "osdep/io.h"
 #include "dvbin.h"
 #include "dvb_tune.h"
+#include "common/common.h"
 #include "common/msg.h"
 
 /* Keep in sync with enum fe_delivery_system. */
@@ -207,6 +208,15 @@ int dvb_open_devices(dvb_priv_t *priv, unsigned int n, unsigned int demux_cnt)
         return 0;
     }
 
+    // The default DVR ring buffer of the kernel (about 2 MB) holds only a
+    // fraction of a second of a full transponder.
+    if (priv->cfg_buffer_size &&
+        ioctl(state->dvr_fd, DMX_SET_BUFFER_SIZE, priv->cfg_buffer_size) < 0)
+    {
+        MP_WARN(priv, "Could not set DVR buffer size to %d bytes: %s\n",
+                priv->cfg_buffer_size, mp_strerror(errno));
+    }
+
     return 1;
 }
 
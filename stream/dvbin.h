@@ -109,6 +109,7 @@ typedef struct {
     unsigned int last_freq;
     bool switching_channel;
     bool stream_used;
+    int overflows;
 } dvb_state_t;
 
 typedef struct {
@@ -122,6 +123,7 @@ typedef struct {
     char *cfg_file;
 
     int cfg_full_transponder;
+    int cfg_buffer_size;
 } dvb_priv_t;
 
 
@@ -26,6 +26,8 @@
 #include <assert.h>
 
 #include <libavutil/common.h>
+#include <libavutil/buffer.h>
+#include <libavcodec/avcodec.h>
 #include "osdep/atomic.h"
 #include "osdep/io.h"
 
@@ -60,6 +62,7 @@ extern const stream_info_t stream_info_tv;
 extern const stream_info_t stream_info_smb;
 extern const stream_info_t stream_info_null;
 extern const stream_info_t stream_info_memory;
+extern const stream_info_t stream_info_subprocess;
 extern const stream_info_t stream_info_mf;
 extern const stream_info_t stream_info_ffmpeg;
 extern const stream_info_t stream_info_ffmpeg_unsafe;
@@ -112,6 +115,7 @@ static const stream_info_t *const stream_list[] = {
 
     &stream_info_memory,
     &stream_info_null,
+    &stream_info_subprocess,
     &stream_info_mf,
     &stream_info_edl,
     &stream_info_rar,
@@ -197,7 +201,9 @@ char *mp_url_escape(void *talloc_ctx, const char *url, const char *ok)
 
 static stream_t *new_stream(void)
 {
-    return talloc_zero_size(NULL, sizeof(stream_t) + TOTAL_BUFFER_SIZE);
+    stream_t *s = talloc_zero_size(NULL, sizeof(stream_t) + TOTAL_BUFFER_SIZE);
+    ta_set_account(s, MP_MEM_STREAM);
+    return s;
 }
 
 static const char *match_proto(const char *url, const char *proto)
@@ -350,6 +356,7 @@ static bool stream_reconnect(stream_t *s)
         int r = stream_control(s, STREAM_CTRL_RECONNECT, NULL);
         if (r == STREAM_UNSUPPORTED)
             break;
+        s->io_stats.reconnects++;
         if (r == STREAM_OK && stream_seek_unbuffered(s, pos) && s->pos == pos) {
             MP_WARN(s, "Reconnected successfully.\n");
             return true;
@@ -372,8 +379,17 @@ static int stream_read_unbuffered(stream_t *s, void *buf, int len)
     int res = 0;
     s->buf_pos = s->buf_len = 0;
     // we will retry even if we already reached EOF previously.
-    if (s->fill_buffer && !mp_cancel_test(s->cancel))
+    if (s->fill_buffer && !mp_cancel_test(s->cancel)) {
+        int64_t start = mp_time_us();
         res = s->fill_buffer(s, buf, len);
+        int64_t ms = (mp_time_us() - start) / 1000;
+        int bucket = 0;
+        while (bucket < STREAM_LATENCY_BUCKETS - 1 && ms >= (1LL << (2 * bucket)))
+            bucket++;
+        s->io_stats.read_latency[bucket]++;
+        s->io_stats.reads++;
+        s->io_stats.bytes_read += MPMAX(res, 0);
+    }
     if (res <= 0) {
         // just in case this is an error e.g. due to network
         // timeout reset and retry
@@ -397,6 +413,7 @@ static int stream_fill_buffer_by(stream_t *s, int64_t len)
 {
     len = MPMIN(len, s->read_chunk);
     len = MPMAX(len, STREAM_BUFFER_SIZE);
+    len = MPMIN(len, STREAM_MAX_BUFFER_SIZE);
     if (s->sector_size)
         len = s->sector_size;
     len = stream_read_unbuffered(s, s->buffer, len);
@@ -407,7 +424,10 @@ static int stream_fill_buffer_by(stream_t *s, int64_t len)
 
 int stream_fill_buffer(stream_t *s)
 {
-    return stream_fill_buffer_by(s, STREAM_BUFFER_SIZE);
+    // Fill as much as the stream prefers to return per call, so that a
+    // sequence of small reads (like parsing headers) doesn't end up calling
+    // fill_buffer() every STREAM_BUFFER_SIZE bytes.
+    return stream_fill_buffer_by(s, s->read_chunk);
 }
 
 // Read between 1..buf_size bytes of data, return how much data has been read.
@@ -418,6 +438,15 @@ int stream_read_partial(stream_t *s, char *buf, int buf_size)
     assert(buf_size >= 0);
     if (s->buf_pos == s->buf_len && buf_size > 0) {
         s->buf_pos = s->buf_len = 0;
+        // Memory mapped data can be copied directly to the caller.
+        if (s->mapped && s->pos >= 0 && s->pos < s->mapped_size) {
+            int len = MPMIN(buf_size, s->mapped_size - s->pos);
+            memcpy(buf, s->mapped + s->pos, len);
+            s->pos += len;
+            s->io_stats.bytes_read += len;
+            s->eof = 0;
+            return len;
+        }
         // Do a direct read, but only if there's no sector alignment requirement
         // Also, small reads will be more efficient with buffering & copying
         if (!s->sector_size && buf_size >= STREAM_BUFFER_SIZE)
@@ -433,6 +462,9 @@ int stream_read_partial(stream_t *s, char *buf, int buf_size)
     return len;
 }
 
+// Read exactly total bytes, unless EOF is reached. Return how much data has been
+// read. If the local buffer is empty, requests of STREAM_BUFFER_SIZE or more
+// are read directly into mem, so large reads don't go through the buffer.
 int stream_read(stream_t *s, char *mem, int total)
 {
     int len = total;
@@ -458,6 +490,16 @@ struct bstr stream_peek(stream_t *s, int len)
 {
     assert(len >= 0);
     assert(len <= STREAM_MAX_BUFFER_SIZE);
+    if (s->mapped) {
+        // Point directly into the mapping if possible. Seeking back is cheap
+        // in this case, so there is no need to fill the buffer.
+        int64_t pos = stream_tell(s);
+        if (pos >= 0 && len <= s->mapped_size - pos) {
+            if (len > 0)
+                s->eof = 0;
+            return (bstr){.start = s->mapped + pos, .len = len};
+        }
+    }
     if (s->buf_len - s->buf_pos < len) {
         // Move to front to guarantee we really can read up to max size.
         int buf_valid = s->buf_len - s->buf_pos;
@@ -482,6 +524,34 @@ struct bstr stream_peek(stream_t *s, int len)
                   .len = FFMIN(len, s->buf_len - s->buf_pos)};
 }
 
+// Return a reference to the next len bytes of the stream, and skip them. This
+// avoids copying the data, but works only if the stream provides direct access
+// to its contents (see stream.ref_data), e.g. if the file is mapped and the
+// mapping contains the requested data plus AV_INPUT_BUFFER_PADDING_SIZE bytes.
+// Otherwise, return NULL, and leave the stream position unchanged.
+// The returned buffer is read-only. The padding memory following it is
+// accessible, but is not necessarily zeroed.
+struct AVBufferRef *stream_read_ref(stream_t *s, int len)
+{
+    if (!s->ref_data || len < 0)
+        return NULL;
+    int64_t pos = stream_tell(s);
+    if (pos < 0)
+        return NULL;
+    if (s->mapped) {
+        if (len + (int64_t)AV_INPUT_BUFFER_PADDING_SIZE > s->mapped_size - pos)
+            return NULL;
+    } else if (!s->seekable) {
+        return NULL; // skipping the data would copy it anyway
+    }
+    struct AVBufferRef *ref = s->ref_data(s, pos, len);
+    if (ref && !stream_seek(s, pos + len)) {
+        av_buffer_unref(&ref);
+        stream_seek(s, pos);
+    }
+    return ref;
+}
+
 int stream_write_buffer(stream_t *s, unsigned char *buf, int len)
 {
     int rd;
@@ -536,6 +606,7 @@ static bool stream_seek_unbuffered(stream_t *s, int64_t newpos)
             MP_ERR(s, "Cannot seek backward in linear streams!\n");
             return false;
         }
+        s->io_stats.seeks++;
         if (s->seek(s, newpos) <= 0) {
             MP_ERR(s, "Seek failed\n");
             return false;
@@ -606,7 +677,60 @@ bool stream_skip(stream_t *s, int64_t len)
 
 int stream_control(stream_t *s, int cmd, void *arg)
 {
-    return s->control ? s->control(s, cmd, arg) : STREAM_UNSUPPORTED;
+    int r = s->control ? s->control(s, cmd, arg) : STREAM_UNSUPPORTED;
+    if (r == STREAM_UNSUPPORTED && cmd == STREAM_CTRL_GET_IO_STATS) {
+        *(struct stream_io_stats *)arg = s->io_stats;
+        r = STREAM_OK;
+    }
+    return r;
+}
+
+static const int snapshot_ctrls[STREAM_SNAPSHOT_CTRLS] = {
+    STREAM_CTRL_GET_NUM_TITLES,
+    STREAM_CTRL_GET_CURRENT_TITLE,
+    STREAM_CTRL_GET_NUM_ANGLES,
+    STREAM_CTRL_GET_ANGLE,
+};
+
+// Query the controls in struct stream_snapshot (channel_name is allocated
+// under ta_parent, and the old value is freed).
+void stream_update_snapshot(stream_t *s, void *ta_parent,
+                            struct stream_snapshot *snap)
+{
+    for (int n = 0; n < STREAM_SNAPSHOT_CTRLS; n++) {
+        int v = -1;
+        snap->res[n] = stream_control(s, snapshot_ctrls[n], &v);
+        snap->value[n] = v;
+    }
+    char *name = NULL;
+    snap->channel_name_res =
+        stream_control(s, STREAM_CTRL_DVB_GET_CHANNEL_NAME, &name);
+    if (snap->channel_name_res != STREAM_OK) {
+        talloc_free(name);
+        name = NULL;
+    }
+    talloc_free(snap->channel_name);
+    snap->channel_name = talloc_strdup(ta_parent, name);
+    talloc_free(name);
+}
+
+// Answer cmd from the snapshot. Returns STREAM_ERROR if it can't, in which
+// case the control has to be passed to the stream.
+int stream_snapshot_control(struct stream_snapshot *snap, int cmd, void *arg)
+{
+    for (int n = 0; n < STREAM_SNAPSHOT_CTRLS; n++) {
+        if (cmd == snapshot_ctrls[n]) {
+            if (snap->res[n] == STREAM_OK)
+                *(int *)arg = snap->value[n];
+            return snap->res[n];
+        }
+    }
+    if (cmd == STREAM_CTRL_DVB_GET_CHANNEL_NAME) {
+        if (snap->channel_name_res == STREAM_OK)
+            *(char **)arg = talloc_strdup(NULL, snap->channel_name);
+        return snap->channel_name_res;
+    }
+    return STREAM_ERROR;
 }
 
 // Return the current size of the stream, or a negative value if unknown.
@@ -641,6 +765,84 @@ stream_t *open_memory_stream(void *data, int len)
     return s;
 }
 
+struct prefix_priv {
+    bstr data;
+    int64_t size;
+    bool incomplete;
+};
+
+static int prefix_fill_buffer(stream_t *s, char *buffer, int len)
+{
+    struct prefix_priv *p = s->priv;
+    if (s->pos < 0 || s->pos >= p->data.len) {
+        p->incomplete |= p->size < 0 || s->pos < p->size;
+        return 0;
+    }
+    len = MPMIN(len, p->data.len - s->pos);
+    memcpy(buffer, p->data.start + s->pos, len);
+    return len;
+}
+
+static int prefix_seek(stream_t *s, int64_t newpos)
+{
+    return 1;
+}
+
+static int prefix_control(stream_t *s, int cmd, void *arg)
+{
+    struct prefix_priv *p = s->priv;
+    if (cmd == STREAM_CTRL_GET_SIZE && p->size >= 0) {
+        *(int64_t *)arg = p->size;
+        return STREAM_OK;
+    }
+    // The real stream might have answered this.
+    p->incomplete = true;
+    return STREAM_UNSUPPORTED;
+}
+
+// Create a read-only stream that contains data, which must be the start of
+// orig (of total size size, or -1 if unknown). It copies the metadata of orig,
+// but never accesses orig itself, so it can be used from another thread.
+// data is not copied and must stay valid until the stream is freed.
+stream_t *open_prefix_stream(stream_t *orig, bstr data, int64_t size)
+{
+    stream_t *s = new_stream();
+    struct prefix_priv *p = talloc_zero(s, struct prefix_priv);
+    p->data = data;
+    p->size = size;
+    s->priv = p;
+    s->fill_buffer = prefix_fill_buffer;
+    s->seek = prefix_seek;
+    s->control = prefix_control;
+    s->mode = STREAM_READ;
+    s->read_chunk = orig->read_chunk;
+    s->seekable = orig->seekable;
+    s->fast_skip = orig->fast_skip;
+
+    s->url = talloc_strdup(s, orig->url);
+    s->path = talloc_strdup(s, orig->path);
+    s->mime_type = talloc_strdup(s, orig->mime_type);
+    s->demuxer = talloc_strdup(s, orig->demuxer);
+    s->lavf_type = talloc_strdup(s, orig->lavf_type);
+    s->streaming = orig->streaming;
+    s->is_network = orig->is_network;
+    s->is_local_file = orig->is_local_file;
+    s->is_directory = orig->is_directory;
+    s->access_references = orig->access_references;
+    s->cancel = orig->cancel;
+    s->global = orig->global;
+    s->log = mp_log_new(s, orig->log, "prefix");
+    return s;
+}
+
+// Whether s (created with open_prefix_stream()) was asked for something that
+// only the original stream could have provided.
+bool prefix_stream_incomplete(stream_t *s)
+{
+    struct prefix_priv *p = s->priv;
+    return p->incomplete;
+}
+
 static stream_t *open_cache(stream_t *orig, const char *name)
 {
     stream_t *cache = new_stream();
@@ -56,6 +56,7 @@ enum stream_ctrl {
     STREAM_CTRL_GET_CACHE_INFO,
     STREAM_CTRL_SET_CACHE_SIZE,
     STREAM_CTRL_SET_READAHEAD,
+    STREAM_CTRL_SET_BITRATE,            // double* (bytes/second)
 
     // stream_memory.c
     STREAM_CTRL_SET_CONTENTS,
@@ -68,6 +69,8 @@ enum stream_ctrl {
     STREAM_CTRL_AVSEEK,
     STREAM_CTRL_HAS_AVSEEK,
     STREAM_CTRL_GET_METADATA,
+    STREAM_CTRL_GET_CONNECTION_INFO,
+    STREAM_CTRL_GET_IO_STATS,
 
     // TV
     STREAM_CTRL_TV_SET_SCAN,
@@ -113,6 +116,52 @@ struct stream_cache_info {
     int64_t speed;
 };
 
+#define STREAM_LATENCY_BUCKETS 7
+
+// for STREAM_CTRL_GET_IO_STATS
+// This is implemented by stream_control() for all streams. The cache returns
+// the stats of the underlying stream, plus its own hit/miss counters.
+struct stream_io_stats {
+    int64_t bytes_read;
+    int64_t reads;          // number of fill_buffer() calls
+    int64_t seeks;          // number of seek() calls
+    int64_t reconnects;
+    // fill_buffer() calls by time taken, with bucket n covering reads taking
+    // less than 4^n milliseconds (the last bucket includes all slower ones)
+    int64_t read_latency[STREAM_LATENCY_BUCKETS];
+    // Reads from the cache, which could be served immediately (hits), or had
+    // to wait for the cache to read more data (misses).
+    int64_t cache_hits;
+    int64_t cache_misses;
+};
+
+#define STREAM_MAX_CONNECTIONS 16
+
+// for STREAM_CTRL_GET_CONNECTION_INFO
+struct stream_connection_info {
+    int num_connections;
+    struct {
+        int64_t bytes;      // total bytes delivered by this connection
+        int64_t requests;   // number of byte range requests issued
+        bool active;        // currently transferring data
+    } connections[STREAM_MAX_CONNECTIONS];
+};
+
+// Controls that change rarely (normally only as a result of other controls),
+// and which the cache and demuxer layers answer from a snapshot, so that
+// querying them does not block on the stream. See stream_update_snapshot().
+#define STREAM_SNAPSHOT_CTRLS 4
+
+struct stream_snapshot {
+    // STREAM_CTRL_GET_NUM_TITLES, _GET_CURRENT_TITLE, _GET_NUM_ANGLES and
+    // _GET_ANGLE, with the result code of each.
+    int res[STREAM_SNAPSHOT_CTRLS];
+    int value[STREAM_SNAPSHOT_CTRLS];
+    // STREAM_CTRL_DVB_GET_CHANNEL_NAME (talloc'ed, or NULL)
+    int channel_name_res;
+    char *channel_name;
+};
+
 struct stream_lang_req {
     int type;     // STREAM_AUDIO, STREAM_SUB
     int id;
@@ -192,6 +241,21 @@ typedef struct stream {
 
     struct stream *underlying;  // e.g. cache wrapper
 
+    // Updated by the generic stream code (for STREAM_CTRL_GET_IO_STATS).
+    struct stream_io_stats io_stats;
+
+    // Optional: direct read-only access to the stream contents (e.g. memory
+    // mapped files). If set, mapped[pos] is the byte at pos, for all
+    // pos < mapped_size. Data beyond mapped_size must be read normally.
+    unsigned char *mapped;
+    int64_t mapped_size;
+    // Return a new read-only reference to the len bytes at pos, which must be
+    // followed by AV_INPUT_BUFFER_PADDING_SIZE readable bytes. Does not change
+    // the stream position. Required if mapped is set, in which case the caller
+    // guarantees that the range is within mapped_size. Otherwise optional, and
+    // may return NULL if the data is not available this way.
+    struct AVBufferRef *(*ref_data)(struct stream *s, int64_t pos, int len);
+
     // Includes additional padding in case sizes get rounded up by sector size.
     unsigned char buffer[];
 } stream_t;
@@ -235,6 +299,8 @@ bool stream_seek(stream_t *s, int64_t pos);
 int stream_read(stream_t *s, char *mem, int total);
 int stream_read_partial(stream_t *s, char *buf, int buf_size);
 struct bstr stream_peek(stream_t *s, int len);
+struct AVBufferRef;
+struct AVBufferRef *stream_read_ref(stream_t *s, int len);
 void stream_drop_buffers(stream_t *s);
 int64_t stream_get_size(stream_t *s);
 
@@ -245,12 +311,17 @@ struct bstr stream_read_complete(struct stream *s, void *talloc_ctx,
 struct bstr stream_read_file(const char *filename, void *talloc_ctx,
                              struct mpv_global *global, int max_size);
 int stream_control(stream_t *s, int cmd, void *arg);
+void stream_update_snapshot(stream_t *s, void *ta_parent,
+                            struct stream_snapshot *snap);
+int stream_snapshot_control(struct stream_snapshot *snap, int cmd, void *arg);
 void free_stream(stream_t *s);
 struct stream *stream_create(const char *url, int flags,
                              struct mp_cancel *c, struct mpv_global *global);
 struct stream *stream_open(const char *filename, struct mpv_global *global);
 stream_t *open_output_stream(const char *filename, struct mpv_global *global);
 stream_t *open_memory_stream(void *data, int len);
+stream_t *open_prefix_stream(stream_t *orig, struct bstr data, int64_t size);
+bool prefix_stream_incomplete(stream_t *s);
 
 void mp_url_unescape_inplace(char *buf);
 char *mp_url_escape(void *talloc_ctx, const char *s, const char *ok);
@@ -26,9 +26,11 @@
  *
  */
 
+#include <stdio.h>
 #include <string.h>
 #include <strings.h>
 #include <assert.h>
+#include <unistd.h>
 
 #include <libbluray/bluray.h>
 #include <libbluray/meta_data.h>
@@ -36,6 +38,7 @@
 #include <libbluray/keys.h>
 #include <libbluray/bluray-version.h>
 #include <libavutil/common.h>
+#include <libavutil/sha.h>
 
 #include "config.h"
 #include "mpv_talloc.h"
@@ -72,10 +75,19 @@
 #define AACS_ERROR_MMC_FAILURE    -7 /* MMC failed */
 #define AACS_ERROR_NO_DK          -8 /* no matching device key */
 
+struct bluray_title {
+    uint32_t playlist;
+    uint64_t duration;
+};
+
 struct bluray_priv_s {
     BLURAY *bd;
     BLURAY_TITLE_INFO *title_info;
     int num_titles;
+    struct bluray_title *titles;
+    // The titles were loaded from the scan cache, and libbluray's title list
+    // was not created. Titles are selected by their playlists instead.
+    bool titles_cached;
     int current_angle;
     int current_title;
     int current_playlist;
@@ -101,9 +113,25 @@ inline static int play_playlist(struct bluray_priv_s *priv, int playlist)
 
 inline static int play_title(struct bluray_priv_s *priv, int title)
 {
+    if (priv->titles_cached) {
+        return title >= 0 && title < priv->num_titles &&
+               bd_select_playlist(priv->bd, priv->titles[title].playlist);
+    }
     return bd_select_title(priv->bd, title);
 }
 
+// Return the index of the title being played, which uses the given playlist.
+static int get_current_title(struct bluray_priv_s *priv, int playlist)
+{
+    if (!priv->titles_cached)
+        return bd_get_current_title(priv->bd);
+    for (int n = 0; n < priv->num_titles; n++) {
+        if (priv->titles[n].playlist == playlist)
+            return n;
+    }
+    return -1;
+}
+
 static void bluray_stream_close(stream_t *s)
 {
     destruct(s->priv);
@@ -124,7 +152,7 @@ static void handle_event(stream_t *s, const BD_EVENT *ev)
         break;
     case BD_EVENT_PLAYLIST:
         b->current_playlist = ev->param;
-        b->current_title = bd_get_current_title(b->bd);
+        b->current_title = get_current_title(b, b->current_playlist);
         if (b->title_info)
             bd_free_title_info(b->title_info);
         b->title_info = bd_get_playlist_info(b->bd, b->current_playlist,
@@ -132,7 +160,7 @@ static void handle_event(stream_t *s, const BD_EVENT *ev)
         break;
     case BD_EVENT_TITLE:
         if (ev->param == BLURAY_TITLE_FIRST_PLAY) {
-            b->current_title = bd_get_current_title(b->bd);
+            b->current_title = get_current_title(b, b->current_playlist);
         } else
             b->current_title = ev->param;
         if (b->title_info) {
@@ -351,7 +379,7 @@ static void select_initial_title(stream_t *s, int title_guess) {
     if (b->cfg_title == BLURAY_PLAYLIST_TITLE) {
         if (!play_playlist(b, b->cfg_playlist))
             MP_WARN(s, "Couldn't start playlist '%05d'.\n", b->cfg_playlist);
-        b->current_title = bd_get_current_title(b->bd);
+        b->current_title = get_current_title(b, b->cfg_playlist);
     } else {
         int title = -1;
         if (b->cfg_title != BLURAY_DEFAULT_TITLE )
@@ -365,11 +393,146 @@ static void select_initial_title(stream_t *s, int title_guess) {
             b->current_title = title;
         else {
             MP_WARN(s, "Couldn't start title '%d'.\n", title);
-            b->current_title = bd_get_current_title(b->bd);
+            b->current_title = get_current_title(b, b->current_playlist);
         }
     }
 }
 
+// The scan cache file starts with this, followed by the key (see
+// get_scan_cache_file()), the number of titles, the guessed main title, and
+// the raw bluray_title array.
+#define SCAN_CACHE_MAGIC "mpv-bluray-scan-1\n"
+
+// Return the scan cache file for the opened disc, or NULL if the cache is
+// disabled or the disc can't be identified. *out_key is set to the key that
+// the file has to contain.
+static char *get_scan_cache_file(stream_t *s, void *ta_ctx, const char *device,
+                                 char **out_key)
+{
+    char *res = NULL;
+#if BLURAY_VERSION >= BLURAY_VERSION_CODE(1, 0, 0)
+    struct bluray_priv_s *b = s->priv;
+    void *tmp = talloc_new(NULL);
+
+    char *dir = NULL;
+    mp_read_option_raw(s->global, "bluray-scan-cache-dir", &m_option_type_string,
+                       &dir);
+    talloc_steal(tmp, dir);
+    const BLURAY_DISC_INFO *info = bd_get_disc_info(b->bd);
+    if (!dir || !dir[0] || !info)
+        goto done;
+
+    bool have_disc_id = false;
+    char *key = talloc_asprintf(tmp, "volume=%s\ndisc_id=",
+                                info->udf_volume_id ? info->udf_volume_id : "");
+    for (int i = 0; i < sizeof(info->disc_id); i++) {
+        key = talloc_asprintf_append(key, "%02X", info->disc_id[i]);
+        have_disc_id |= info->disc_id[i];
+    }
+    // Without AACS there is no disc ID, so include the location.
+    if (!have_disc_id) {
+        char *path = (char *)device;
+        if (!mp_is_url(bstr0(path)))
+            path = mp_path_join(tmp, mp_getcwd(tmp), path);
+        key = talloc_asprintf_append(key, "\ndevice=%s", path);
+    }
+    key = talloc_asprintf_append(key, "\nentry=%zu\n",
+                                 sizeof(struct bluray_title));
+
+    uint8_t hash[32];
+    struct AVSHA *sha = av_sha_alloc();
+    if (!sha)
+        abort();
+    av_sha_init(sha, 256);
+    av_sha_update(sha, key, strlen(key));
+    av_sha_final(sha, hash);
+    av_free(sha);
+
+    char *name = talloc_strdup(tmp, "");
+    for (int i = 0; i < sizeof(hash); i++)
+        name = talloc_asprintf_append(name, "%02X", hash[i]);
+
+    res = mp_path_join(ta_ctx, mp_get_user_path(tmp, s->global, dir), name);
+    *out_key = talloc_steal(ta_ctx, key);
+
+done:
+    talloc_free(tmp);
+#endif
+    return res;
+}
+
+static bool load_scan_cache(stream_t *s, const char *file, const char *key,
+                            int *title_guess)
+{
+    struct bluray_priv_s *b = s->priv;
+
+    FILE *f = fopen(file, "rb");
+    if (!f)
+        return false;
+
+    size_t header_size = strlen(SCAN_CACHE_MAGIC) + strlen(key);
+    char *header = talloc_size(NULL, header_size);
+    int32_t num = 0, guess = 0;
+    bool ok = fread(header, header_size, 1, f) == 1 &&
+              memcmp(header, SCAN_CACHE_MAGIC, strlen(SCAN_CACHE_MAGIC)) == 0 &&
+              memcmp(header + strlen(SCAN_CACHE_MAGIC), key, strlen(key)) == 0 &&
+              fread(&num, sizeof(num), 1, f) == 1 &&
+              fread(&guess, sizeof(guess), 1, f) == 1;
+    talloc_free(header);
+    ok = ok && num > 0 && num <= 99999 && guess >= BLURAY_DEFAULT_TITLE &&
+         guess < num;
+    struct bluray_title *titles = NULL;
+    if (ok) {
+        titles = talloc_array(b, struct bluray_title, num);
+        ok = fread(titles, sizeof(titles[0]), num, f) == num;
+    }
+    fclose(f);
+
+    if (!ok) {
+        MP_WARN(s, "Ignoring invalid title scan cache '%s'.\n", file);
+        talloc_free(titles);
+        return false;
+    }
+
+    b->num_titles = num;
+    b->titles = titles;
+    *title_guess = guess;
+    return true;
+}
+
+static void save_scan_cache(stream_t *s, const char *file, const char *key,
+                            int title_guess)
+{
+    struct bluray_priv_s *b = s->priv;
+    void *tmp = talloc_new(NULL);
+
+    mp_mkdirp(bstrto0(tmp, mp_dirname(file)));
+
+    int32_t num = b->num_titles, guess = title_guess;
+    char *tmpname = talloc_asprintf(tmp, "%s.tmp", file);
+    FILE *f = fopen(tmpname, "wb");
+    bool ok = f &&
+        fwrite(SCAN_CACHE_MAGIC, strlen(SCAN_CACHE_MAGIC), 1, f) == 1 &&
+        fwrite(key, strlen(key), 1, f) == 1 &&
+        fwrite(&num, sizeof(num), 1, f) == 1 &&
+        fwrite(&guess, sizeof(guess), 1, f) == 1 &&
+        fwrite(b->titles, sizeof(b->titles[0]), num, f) == num;
+    if (f && fclose(f))
+        ok = false;
+    if (ok && rename(tmpname, file)) {
+        // Windows does not replace existing files with rename().
+        unlink(file);
+        ok = !rename(tmpname, file);
+    }
+    if (ok) {
+        MP_VERBOSE(s, "Saved title scan to '%s'.\n", file);
+    } else {
+        MP_WARN(s, "Could not write '%s'.\n", file);
+        unlink(tmpname);
+    }
+    talloc_free(tmp);
+}
+
 static int bluray_stream_open_internal(stream_t *s)
 {
     struct bluray_priv_s *b = s->priv;
@@ -406,6 +569,17 @@ static int bluray_stream_open_internal(stream_t *s)
         MP_FATAL(s, "BluRay menu support has been removed.\n");
         return STREAM_ERROR;
     } else {
+        char *cache_key = NULL;
+        char *cache_file = get_scan_cache_file(s, b, device, &cache_key);
+        if (cache_file && load_scan_cache(s, cache_file, cache_key,
+                                          &title_guess))
+        {
+            MP_VERBOSE(s, "Loaded %d titles from '%s'.\n", b->num_titles,
+                       cache_file);
+            b->titles_cached = true;
+            goto scanned;
+        }
+
         /* check for available titles on disc */
         b->num_titles = bd_get_titles(bd, TITLES_RELEVANT, 0);
         if (!b->num_titles) {
@@ -417,12 +591,18 @@ static int bluray_stream_open_internal(stream_t *s)
         MP_VERBOSE(s, "List of available titles:\n");
 
         /* parse titles information */
+        b->titles = talloc_zero_array(b, struct bluray_title, b->num_titles);
         uint64_t max_duration = 0;
         for (int i = 0; i < b->num_titles; i++) {
             BLURAY_TITLE_INFO *ti = bd_get_title_info(bd, i, 0);
             if (!ti)
                 continue;
 
+            b->titles[i] = (struct bluray_title){
+                .playlist = ti->playlist,
+                .duration = ti->duration,
+            };
+
             char *time = mp_format_time(ti->duration / 90000, false);
             MP_VERBOSE(s, "idx: %3d duration: %s (playlist: %05d.mpls)\n",
                        i, time, ti->playlist);
@@ -436,7 +616,11 @@ static int bluray_stream_open_internal(stream_t *s)
 
             bd_free_title_info(ti);
         }
+
+        if (cache_file)
+            save_scan_cache(s, cache_file, cache_key, title_guess);
     }
+scanned:
 
     // these should be set before any callback
     b->current_angle = -1;
@@ -7,6 +7,9 @@
 #include <unistd.h>
 #include <errno.h>
 
+#include <libavutil/buffer.h>
+#include <libavcodec/avcodec.h>
+
 #include "osdep/io.h"
 
 #include "common/common.h"
@@ -28,6 +31,40 @@ static int fill_buffer(stream_t *s, char *buffer, int max_len)
     return (int)p->info.read_fn(p->info.cookie, buffer, (size_t)max_len);
 }
 
+// Buffers lent by the client can outlive the stream, so this must not
+// reference struct priv.
+struct lent_buffer {
+    mpv_stream_cb_release_fn release_fn;
+    void *buf;
+};
+
+static void release_buffer(void *opaque, uint8_t *data)
+{
+    struct lent_buffer *lb = opaque;
+    lb->release_fn(lb->buf);
+    talloc_free(lb);
+}
+
+static struct AVBufferRef *ref_data(stream_t *s, int64_t pos, int len)
+{
+    struct priv *p = s->priv;
+    const char *data = NULL;
+    void *buf = NULL;
+    if (p->info.read_ref_fn(p->info.cookie, pos, len, &data, &buf) < 0 || !data)
+        return NULL;
+
+    struct lent_buffer *lb = talloc_ptrtype(NULL, lb);
+    *lb = (struct lent_buffer){p->info.release_fn, buf};
+
+    AVBufferRef *ref = av_buffer_create((uint8_t *)data, len, release_buffer,
+                                        lb, AV_BUFFER_FLAG_READONLY);
+    if (!ref) {
+        p->info.release_fn(buf);
+        talloc_free(lb);
+    }
+    return ref;
+}
+
 static int seek(stream_t *s, int64_t newpos)
 {
     struct priv *p = s->priv;
@@ -98,6 +135,10 @@ static int open_cb(stream_t *stream)
     stream->read_chunk = 64 * 1024;
     stream->close = s_close;
 
+    if (p->info.read_ref_fn && p->info.release_fn &&
+        AV_INPUT_BUFFER_PADDING_SIZE <= MPV_STREAM_CB_PADDING)
+        stream->ref_data = ref_data;
+
     return STREAM_OK;
 }
 
@@ -78,6 +78,7 @@ const struct m_sub_options stream_dvb_conf = {
         OPT_INTRANGE("timeout", cfg_timeout, 0, 1, 30),
         OPT_STRING("file", cfg_file, M_OPT_FILE),
         OPT_FLAG("full-transponder", cfg_full_transponder, 0),
+        OPT_INTRANGE("buffer-size", cfg_buffer_size, 0, 0, 256 * 1024 * 1024),
         {0}
     },
     .size = sizeof(dvb_priv_t),
@@ -85,6 +86,7 @@ const struct m_sub_options stream_dvb_conf = {
         .cfg_prog = NULL,
         .cfg_devno = 0,
         .cfg_timeout = 30,
+        .cfg_buffer_size = 8 * 1024 * 1024,
     },
 };
 
@@ -724,34 +726,51 @@ void dvb_free_state(dvb_state_t *state)
 
 static int dvb_streaming_read(stream_t *stream, char *buffer, int size)
 {
-    struct pollfd pfds[1];
     int pos = 0, tries, rk, fd;
     dvb_priv_t *priv  = (dvb_priv_t *) stream->priv;
     dvb_state_t *state = priv->state;
 
     MP_TRACE(stream, "dvb_streaming_read(%d)\n", size);
 
+    // Drain as much of the DVR buffer as fits with as few syscalls as
+    // possible, and wait only if nothing could be read at all.
     tries = state->retry;
     fd = state->dvr_fd;
     while (pos < size) {
         rk = read(fd, &buffer[pos], (size - pos));
-        if (rk <= 0) {
-            if (pos || tries == 0)
-                break;
-            tries --;
-            pfds[0].fd = fd;
-            pfds[0].events = POLLIN | POLLPRI;
-            if (poll(pfds, 1, 500) <= 0) {
-                MP_ERR(stream, "dvb_streaming_read, failed with "
-                        "errno %d when reading %d bytes\n", errno, size - pos);
-                errno = 0;
-                break;
-            }
+        if (rk > 0) {
+            pos += rk;
             continue;
         }
-        pos += rk;
-        MP_TRACE(stream, "ret (%d) bytes\n", pos);
+        if (rk < 0 && errno == EINTR)
+            continue;
+        if (rk < 0 && errno == EOVERFLOW) {
+            // The driver dropped data because the DVR buffer was full. The
+            // error is reported once per overflow, so just read on.
+            state->overflows++;
+            MP_MSG(stream, state->overflows == 1 ? MSGL_WARN : MSGL_V,
+                   "DVR buffer overflow, data was lost (%d times). Consider "
+                   "increasing --dvbin-buffer-size.\n", state->overflows);
+            continue;
+        }
+        if (pos || tries == 0)
+            break;
+        tries --;
+        int c = stream->cancel ? mp_cancel_get_fd(stream->cancel) : -1;
+        struct pollfd pfds[2] = {
+            {.fd = fd, .events = POLLIN | POLLPRI},
+            {.fd = c, .events = POLLIN},
+        };
+        if (poll(pfds, c >= 0 ? 2 : 1, 500) <= 0) {
+            MP_ERR(stream, "dvb_streaming_read, failed with "
+                    "errno %d when reading %d bytes\n", errno, size - pos);
+            errno = 0;
+            break;
+        }
+        if (pfds[1].revents & POLLIN)
+            break;
     }
+    MP_TRACE(stream, "ret (%d) bytes\n", pos);
 
     if (!pos)
         MP_ERR(stream, "dvb_streaming_read, return 0 bytes\n");
@@ -1110,6 +1129,8 @@ static int dvb_open(stream_t *stream)
     }
 
     stream->fill_buffer = dvb_streaming_read;
+    // Read in large batches of whole TS packets.
+    stream->read_chunk = 188 * 1024;
     stream->close = dvbin_close;
     stream->control = dvbin_stream_control;
     stream->streaming = true;
@@ -25,16 +25,25 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <libavutil/buffer.h>
 
 #ifndef __MINGW32__
 #include <poll.h>
 #endif
 
+#include "osdep/atomic.h"
 #include "osdep/io.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
 
 #include "common/common.h"
+#include "common/global.h"
 #include "common/msg.h"
 #include "stream.h"
+#include "options/m_config.h"
 #include "options/m_option.h"
 #include "options/path.h"
 
@@ -57,15 +66,85 @@
 #endif
 #endif
 
+// Memory mapping of the file contents. This is refcounted, because packets
+// created with stream_read_ref() can outlive the stream.
+struct file_mapping {
+    atomic_int refcount;
+    void *data;
+    size_t size;
+};
+
+// Size of the blocks read by the async reader threads.
+#define ASYNC_BLOCK_SIZE (256 * 1024)
+
+struct async_block {
+    int64_t pos;            // file position (block aligned), -1 if unused
+    int len;                // bytes read (< 0 on error)
+    bool busy;              // a reader thread is filling it
+    bool done;
+    unsigned char *data;
+};
+
+// Keeps a number of pread() calls in flight ahead of the read position, so
+// that slow file systems don't block the caller on every read.
+struct async_reader {
+    int fd;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    pthread_t threads[16];
+    int num_threads;
+    struct async_block *blocks;
+    int num_blocks;
+    int64_t read_pos;       // position of the consumer
+    bool terminate;
+};
+
 struct priv {
     int fd;
     bool close;
     bool use_poll;
+    struct file_mapping *map;
+    struct async_reader *async;
 };
 
+static void mapping_unref(struct file_mapping *map)
+{
+    if (map && atomic_fetch_add(&map->refcount, -1) == 1) {
+        munmap(map->data, map->size);
+        free(map);
+    }
+}
+
+static void free_mapped_buffer(void *opaque, uint8_t *data)
+{
+    mapping_unref(opaque);
+}
+
+static struct AVBufferRef *ref_data(stream_t *s, int64_t pos, int len)
+{
+    struct priv *p = s->priv;
+    atomic_fetch_add(&p->map->refcount, 1);
+    AVBufferRef *ref = av_buffer_create(s->mapped + pos, len, free_mapped_buffer,
+                                        p->map, AV_BUFFER_FLAG_READONLY);
+    if (!ref)
+        mapping_unref(p->map);
+    return ref;
+}
+
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
 {
     struct priv *p = s->priv;
+    if (p->map) {
+        if (s->pos < s->mapped_size) {
+            int len = MPMIN(max_len, s->mapped_size - s->pos);
+            memcpy(buffer, s->mapped + s->pos, len);
+            return len;
+        }
+        // The file might have grown since it was mapped. The file position
+        // is not updated by reading from the mapping.
+        if (lseek(p->fd, s->pos, SEEK_SET) == (off_t)-1)
+            return -1;
+    }
 #ifndef __MINGW32__
     if (p->use_poll) {
         int c = s->cancel ? mp_cancel_get_fd(s->cancel) : -1;
@@ -82,6 +161,156 @@ static int fill_buffer(stream_t *s, char *buffer, int max_len)
     return (r <= 0) ? -1 : r;
 }
 
+#ifndef __MINGW32__
+// Return the block for pos, or NULL. Must be called locked.
+static struct async_block *async_find(struct async_reader *a, int64_t pos)
+{
+    for (int n = 0; n < a->num_blocks; n++) {
+        if (a->blocks[n].pos == pos)
+            return &a->blocks[n];
+    }
+    return NULL;
+}
+
+// Pick the next block to read, or return NULL if all blocks in the window
+// ahead of the read position are read or in flight. Must be called locked.
+static struct async_block *async_claim(struct async_reader *a)
+{
+    int64_t start = a->read_pos - a->read_pos % ASYNC_BLOCK_SIZE;
+    int64_t end = start + a->num_blocks * (int64_t)ASYNC_BLOCK_SIZE;
+    for (int64_t pos = start; pos < end; pos += ASYNC_BLOCK_SIZE) {
+        if (async_find(a, pos))
+            continue;
+        // Reuse a block that is outside of the window.
+        for (int n = 0; n < a->num_blocks; n++) {
+            struct async_block *b = &a->blocks[n];
+            if (!b->busy && (b->pos < start || b->pos >= end)) {
+                *b = (struct async_block){
+                    .pos = pos,
+                    .busy = true,
+                    .data = b->data,
+                };
+                return b;
+            }
+        }
+        break;
+    }
+    return NULL;
+}
+
+static void *async_thread(void *arg)
+{
+    struct async_reader *a = arg;
+    mpthread_set_name("file-read");
+    pthread_mutex_lock(&a->lock);
+    while (!a->terminate) {
+        struct async_block *b = async_claim(a);
+        if (!b) {
+            pthread_cond_wait(&a->wakeup, &a->lock);
+            continue;
+        }
+        int64_t pos = b->pos;
+        pthread_mutex_unlock(&a->lock);
+        ssize_t r = pread(a->fd, b->data, ASYNC_BLOCK_SIZE, pos);
+        pthread_mutex_lock(&a->lock);
+        b->len = r;
+        b->busy = false;
+        b->done = true;
+        pthread_cond_broadcast(&a->wakeup);
+    }
+    pthread_mutex_unlock(&a->lock);
+    return NULL;
+}
+
+static void async_destroy(struct async_reader *a)
+{
+    if (!a)
+        return;
+    pthread_mutex_lock(&a->lock);
+    a->terminate = true;
+    pthread_cond_broadcast(&a->wakeup);
+    pthread_mutex_unlock(&a->lock);
+    for (int n = 0; n < a->num_threads; n++)
+        pthread_join(a->threads[n], NULL);
+    for (int n = 0; n < a->num_blocks; n++)
+        free(a->blocks[n].data);
+    free(a->blocks);
+    pthread_cond_destroy(&a->wakeup);
+    pthread_mutex_destroy(&a->lock);
+    free(a);
+}
+
+static struct async_reader *async_create(int fd, int num_threads)
+{
+    struct async_reader *a = calloc(1, sizeof(*a));
+    if (!a)
+        return NULL;
+    a->fd = fd;
+    pthread_mutex_init(&a->lock, NULL);
+    pthread_cond_init(&a->wakeup, NULL);
+    // Twice as many blocks as reads in flight, so that the consumer can read
+    // from a block while the following ones are being filled.
+    a->num_blocks = MPCLAMP(num_threads, 1, MP_ARRAY_SIZE(a->threads)) * 2;
+    a->blocks = calloc(a->num_blocks, sizeof(a->blocks[0]));
+    if (!a->blocks)
+        goto fail;
+    for (int n = 0; n < a->num_blocks; n++) {
+        a->blocks[n].pos = -1;
+        a->blocks[n].data = malloc(ASYNC_BLOCK_SIZE);
+        if (!a->blocks[n].data)
+            goto fail;
+    }
+    for (int n = 0; n < a->num_blocks / 2; n++) {
+        if (pthread_create(&a->threads[n], NULL, async_thread, a))
+            break;
+        a->num_threads++;
+    }
+    if (!a->num_threads)
+        goto fail;
+    return a;
+fail:
+    async_destroy(a);
+    return NULL;
+}
+
+static int async_fill_buffer(stream_t *s, char *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+    struct async_reader *a = p->async;
+    int64_t block_pos = s->pos - s->pos % ASYNC_BLOCK_SIZE;
+    int res = -1;
+
+    pthread_mutex_lock(&a->lock);
+    if (a->read_pos != s->pos) {
+        a->read_pos = s->pos;
+        pthread_cond_broadcast(&a->wakeup);
+    }
+    while (1) {
+        struct async_block *b = async_find(a, block_pos);
+        if (b && b->done) {
+            int offset = s->pos - block_pos;
+            if (b->len > offset) {
+                res = MPMIN(max_len, b->len - offset);
+                memcpy(buffer, b->data + offset, res);
+                a->read_pos = s->pos + res;
+                pthread_cond_broadcast(&a->wakeup);
+            } else {
+                // EOF or error. Read the block again next time, in case the
+                // file was appended to.
+                b->pos = -1;
+            }
+            break;
+        }
+        if (mp_cancel_test(s->cancel))
+            break;
+        struct timespec ts = mp_rel_time_to_timespec(0.1);
+        pthread_cond_timedwait(&a->wakeup, &a->lock, &ts);
+    }
+    pthread_mutex_unlock(&a->lock);
+    return res;
+}
+#endif
+
 static int write_buffer(stream_t *s, char *buffer, int len)
 {
     struct priv *p = s->priv;
@@ -123,10 +352,42 @@ static int control(stream_t *s, int cmd, void *arg)
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
+#ifndef __MINGW32__
+    async_destroy(p->async);
+#endif
+    mapping_unref(p->map);
     if (p->close)
         close(p->fd);
 }
 
+// Map the whole file into memory. If this fails, normal read() calls are used.
+static void map_file(stream_t *stream, int64_t size)
+{
+    struct priv *p = stream->priv;
+    if (size <= 0 || (uint64_t)size > SIZE_MAX)
+        return;
+    void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, p->fd, 0);
+    if (data == MAP_FAILED) {
+        MP_VERBOSE(stream, "Could not map file: %s\n", mp_strerror(errno));
+        return;
+    }
+    struct file_mapping *map = malloc(sizeof(*map));
+    if (!map) {
+        munmap(data, size);
+        return;
+    }
+    *map = (struct file_mapping){
+        .refcount = ATOMIC_VAR_INIT(1),
+        .data = data,
+        .size = size,
+    };
+    p->map = map;
+    stream->mapped = data;
+    stream->mapped_size = size;
+    stream->ref_data = ref_data;
+    MP_VERBOSE(stream, "Using memory mapped file I/O.\n");
+}
+
 // If url is a file:// URL, return the local filename, otherwise return NULL.
 char *mp_file_url_to_filename(void *talloc_ctx, bstr url)
 {
@@ -246,6 +507,8 @@ static int open_f(stream_t *stream)
         filename = stream->path;
     }
 
+    bool is_regular = false;
+    bool is_blockdev = false;
     bool is_fdclose = strncmp(stream->url, "fdclose://", 10) == 0;
     if (strncmp(stream->url, "fd://", 5) == 0 || is_fdclose) {
         char *begin = strstr(stream->url, "://") + 3, *end = NULL;
@@ -280,6 +543,10 @@ static int open_f(stream_t *stream)
         }
         struct stat st;
         if (fstat(p->fd, &st) == 0) {
+            is_regular = S_ISREG(st.st_mode);
+#ifndef __MINGW32__
+            is_blockdev = S_ISBLK(st.st_mode);
+#endif
             if (S_ISDIR(st.st_mode)) {
                 p->use_poll = false;
                 stream->is_directory = true;
@@ -319,6 +586,29 @@ static int open_f(stream_t *stream)
     if (check_stream_network(p->fd))
         stream->streaming = true;
 
+    int use_mmap = 0, async_reads = 0;
+    if (stream->global->config) {
+        mp_read_option_raw(stream->global, "stream-mmap", &m_option_type_flag,
+                           &use_mmap);
+        mp_read_option_raw(stream->global, "stream-async-reads",
+                           &m_option_type_int, &async_reads);
+    }
+    // Don't map files on network filesystems: I/O errors (or a truncated file)
+    // would raise SIGBUS instead of failing the read.
+    if (use_mmap && !write && is_regular && !stream->streaming)
+        map_file(stream, len);
+
+#ifndef __MINGW32__
+    if (async_reads > 0 && !write && !p->map && (is_regular || is_blockdev)) {
+        p->async = async_create(p->fd, async_reads);
+        if (p->async) {
+            stream->fill_buffer = async_fill_buffer;
+            stream->read_chunk = ASYNC_BLOCK_SIZE;
+            MP_VERBOSE(stream, "Using %d async reads.\n", p->async->num_threads);
+        }
+    }
+#endif
+
     return STREAM_OK;
 }
 
@@ -19,6 +19,9 @@
 #include <libavformat/avio.h>
 #include <libavutil/opt.h>
 
+#include "osdep/atomic.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
 #include "options/path.h"
 #include "common/common.h"
 #include "common/msg.h"
@@ -46,6 +49,8 @@ struct stream_lavf_params {
     char *tls_cert_file;
     char *tls_key_file;
     double timeout;
+    int http_connections;
+    int http_chunk_size;
 };
 
 const struct m_sub_options stream_lavf_conf = {
@@ -61,11 +66,16 @@ const struct m_sub_options stream_lavf_conf = {
         OPT_STRING("tls-cert-file", tls_cert_file, M_OPT_FILE),
         OPT_STRING("tls-key-file", tls_key_file, M_OPT_FILE),
         OPT_DOUBLE("network-timeout", timeout, M_OPT_MIN, .min = 0),
+        OPT_INTRANGE("http-connections", http_connections, 0, 1,
+                     STREAM_MAX_CONNECTIONS),
+        OPT_INTRANGE("http-chunk-size", http_chunk_size, 0, 16, 64 * 1024),
         {0}
     },
     .size = sizeof(struct stream_lavf_params),
     .defaults = &(const struct stream_lavf_params){
         .useragent = (char *)mpv_version,
+        .http_connections = 1,
+        .http_chunk_size = 1024,
     },
 };
 
@@ -74,20 +84,346 @@ static const char *const http_like[];
 static int open_f(stream_t *stream);
 static struct mp_tags *read_icy(stream_t *stream);
 
+// Number of chunks each prefetch connection may work ahead on.
+#define CHUNKS_PER_CONNECTION 2
+#define MAX_CHUNKS (STREAM_MAX_CONNECTIONS * CHUNKS_PER_CONNECTION)
+
+struct prefetch_chunk {
+    int64_t start;          // file position of the first byte
+    int size;               // bytes wanted (0 if past EOF)
+    int filled;             // bytes received so far
+    unsigned char *data;
+    int conn;               // index of connection filling it, or -1
+    bool failed;
+    uint64_t gen;           // incremented each time the chunk is reused
+};
+
+struct prefetch_conn {
+    struct prefetch *pf;
+    int index;
+    pthread_t thread;
+    AVIOContext *avio;
+    // protected by prefetch.lock
+    int64_t bytes;
+    int64_t requests;
+    bool active;
+};
+
+// Reading ahead with several parallel HTTP range requests. Each connection
+// thread takes the first unclaimed chunk in the window ahead of the read
+// position, and fetches it with its own request. The reader consumes the
+// chunks in order, and the window slides forward as chunks are consumed.
+struct prefetch {
+    struct mp_log *log;
+    struct stream *stream;
+    char *url;
+    AVDictionary *avopts;
+    int64_t size;
+    int chunk_size;
+    atomic_bool terminate;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    struct prefetch_chunk chunks[MAX_CHUNKS];
+    int num_chunks;
+    int first;              // index of the chunk containing read_pos
+    int64_t read_pos;
+    struct prefetch_conn conns[STREAM_MAX_CONNECTIONS];
+    int num_conns;
+};
+
+struct priv {
+    AVIOContext *avio;
+    struct prefetch *pf;
+};
+
+static void prefetch_reset_chunk(struct prefetch *pf, struct prefetch_chunk *c,
+                                 int64_t start)
+{
+    c->start = start;
+    c->size = MPCLAMP(pf->size - start, 0, pf->chunk_size);
+    c->filled = 0;
+    c->conn = -1;
+    c->failed = false;
+    c->gen++;
+}
+
+// Make pf->first the chunk containing pos. Must be called locked.
+static void prefetch_set_pos(struct prefetch *pf, int64_t pos)
+{
+    struct prefetch_chunk *first = &pf->chunks[pf->first];
+    int64_t window_end = first->start + pf->num_chunks * (int64_t)pf->chunk_size;
+    if (pos < first->start || pos >= window_end) {
+        for (int n = 0; n < pf->num_chunks; n++) {
+            prefetch_reset_chunk(pf, &pf->chunks[n],
+                                 pos + n * (int64_t)pf->chunk_size);
+        }
+        pf->first = 0;
+    } else {
+        while (pos >= pf->chunks[pf->first].start + pf->chunk_size) {
+            int last = (pf->first + pf->num_chunks - 1) % pf->num_chunks;
+            int64_t next = pf->chunks[last].start + pf->chunk_size;
+            prefetch_reset_chunk(pf, &pf->chunks[pf->first], next);
+            pf->first = (pf->first + 1) % pf->num_chunks;
+        }
+    }
+    pf->read_pos = pos;
+    pthread_cond_broadcast(&pf->wakeup);
+}
+
+// Return the index of the nearest chunk which needs data and which no
+// connection is working on, or -1. Must be called locked.
+static int prefetch_claim_chunk(struct prefetch *pf)
+{
+    for (int n = 0; n < pf->num_chunks; n++) {
+        int i = (pf->first + n) % pf->num_chunks;
+        struct prefetch_chunk *c = &pf->chunks[i];
+        if (c->conn < 0 && !c->failed && c->filled < c->size)
+            return i;
+    }
+    return -1;
+}
+
+static int prefetch_interrupt_cb(void *ctx)
+{
+    struct prefetch *pf = ctx;
+    return atomic_load(&pf->terminate) || mp_cancel_test(pf->stream->cancel);
+}
+
+static void *prefetch_thread(void *arg)
+{
+    struct prefetch_conn *conn = arg;
+    struct prefetch *pf = conn->pf;
+    mpthread_set_name("http-prefetch");
+
+    unsigned char buf[64 * 1024];
+    int failures = 0;
+
+    pthread_mutex_lock(&pf->lock);
+    while (!atomic_load(&pf->terminate) && failures < 3) {
+        int i = prefetch_claim_chunk(pf);
+        if (i < 0) {
+            conn->active = false;
+            pthread_cond_wait(&pf->wakeup, &pf->lock);
+            continue;
+        }
+        struct prefetch_chunk *c = &pf->chunks[i];
+        c->conn = conn->index;
+        conn->active = true;
+        conn->requests++;
+        uint64_t gen = c->gen;
+        int64_t pos = c->start + c->filled;
+        int64_t end = c->start + c->size;
+        pthread_mutex_unlock(&pf->lock);
+
+        bool ok = true;
+        if (!conn->avio) {
+            AVIOInterruptCB cb = {
+                .callback = prefetch_interrupt_cb,
+                .opaque = pf,
+            };
+            AVDictionary *dict = NULL;
+            av_dict_copy(&dict, pf->avopts, 0);
+            ok = avio_open2(&conn->avio, pf->url, AVIO_FLAG_READ, &cb, &dict) >= 0;
+            av_dict_free(&dict);
+        }
+        if (ok) {
+            // Limit the request to the chunk, so that the server doesn't send
+            // data which is going to be requested by other connections.
+            av_opt_set_int(conn->avio, "end_offset", end, AV_OPT_SEARCH_CHILDREN);
+            ok = avio_seek(conn->avio, pos, SEEK_SET) >= 0;
+        }
+
+        pthread_mutex_lock(&pf->lock);
+        while (ok && c->gen == gen && pos < end) {
+            pthread_mutex_unlock(&pf->lock);
+            int r = avio_read_partial(conn->avio, buf, MPMIN(sizeof(buf), end - pos));
+            pthread_mutex_lock(&pf->lock);
+            if (c->gen != gen)
+                break; // chunk was dropped (seek) while reading
+            if (r <= 0) {
+                ok = false;
+                break;
+            }
+            memcpy(c->data + c->filled, buf, r);
+            c->filled += r;
+            pos += r;
+            conn->bytes += r;
+            pthread_cond_broadcast(&pf->wakeup);
+        }
+        if (c->gen == gen) {
+            c->conn = -1;
+            c->failed = !ok;
+        }
+        if (ok) {
+            failures = 0;
+        } else {
+            MP_VERBOSE(pf, "Connection %d failed at %"PRId64".\n",
+                       conn->index, pos);
+            if (conn->avio)
+                avio_closep(&conn->avio);
+            // Possibly the server limits the number of connections.
+            failures++;
+        }
+        pthread_cond_broadcast(&pf->wakeup);
+    }
+    conn->active = false;
+    pthread_mutex_unlock(&pf->lock);
+
+    if (conn->avio)
+        avio_closep(&conn->avio);
+    return NULL;
+}
+
+static void prefetch_destroy(struct prefetch *pf)
+{
+    if (!pf)
+        return;
+    pthread_mutex_lock(&pf->lock);
+    atomic_store(&pf->terminate, true);
+    pthread_cond_broadcast(&pf->wakeup);
+    pthread_mutex_unlock(&pf->lock);
+    for (int n = 0; n < pf->num_conns; n++) {
+        struct prefetch_conn *conn = &pf->conns[n];
+        pthread_join(conn->thread, NULL);
+        MP_VERBOSE(pf, "Connection %d: %"PRId64" bytes in %"PRId64" requests.\n",
+                   n, conn->bytes, conn->requests);
+    }
+    av_dict_free(&pf->avopts);
+    pthread_cond_destroy(&pf->wakeup);
+    pthread_mutex_destroy(&pf->lock);
+    talloc_free(pf);
+}
+
+static struct prefetch *prefetch_create(struct stream *stream, const char *url,
+                                        AVDictionary *avopts, int64_t size,
+                                        int num_conns, int chunk_size)
+{
+    struct prefetch *pf = talloc_zero(NULL, struct prefetch);
+    *pf = (struct prefetch){
+        .log = stream->log,
+        .stream = stream,
+        .url = talloc_strdup(pf, url),
+        .size = size,
+        .chunk_size = chunk_size,
+        .terminate = ATOMIC_VAR_INIT(false),
+        .num_chunks = num_conns * CHUNKS_PER_CONNECTION,
+    };
+    av_dict_copy(&pf->avopts, avopts, 0);
+    // Reuse the connection for consecutive chunks if the server allows it.
+    av_dict_set(&pf->avopts, "multiple_requests", "1", 0);
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->wakeup, NULL);
+
+    for (int n = 0; n < pf->num_chunks; n++) {
+        struct prefetch_chunk *c = &pf->chunks[n];
+        c->data = talloc_size(pf, chunk_size);
+        prefetch_reset_chunk(pf, c, n * (int64_t)chunk_size);
+    }
+
+    for (int n = 0; n < num_conns; n++) {
+        struct prefetch_conn *conn = &pf->conns[n];
+        *conn = (struct prefetch_conn){.pf = pf, .index = n};
+        if (pthread_create(&conn->thread, NULL, prefetch_thread, conn))
+            break;
+        pf->num_conns++;
+    }
+    if (!pf->num_conns) {
+        prefetch_destroy(pf);
+        return NULL;
+    }
+
+    MP_VERBOSE(pf, "Prefetching with %d connections, %d byte chunks.\n",
+               pf->num_conns, chunk_size);
+    return pf;
+}
+
+static int prefetch_fill_buffer(stream_t *s, char *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+    struct prefetch *pf = p->pf;
+    int res = -1;
+
+    pthread_mutex_lock(&pf->lock);
+    prefetch_set_pos(pf, s->pos);
+    while (pf->read_pos < pf->size) {
+        struct prefetch_chunk *c = &pf->chunks[pf->first];
+        int offset = pf->read_pos - c->start;
+        if (offset < c->filled) {
+            res = MPMIN(max_len, c->filled - offset);
+            memcpy(buffer, c->data + offset, res);
+            prefetch_set_pos(pf, pf->read_pos + res);
+            break;
+        }
+        if (c->failed) {
+            // The prefetch connection gave up on this chunk; read the missing
+            // part with the main connection instead.
+            int64_t pos = pf->read_pos;
+            int len = MPMIN(max_len, c->size - offset);
+            pthread_mutex_unlock(&pf->lock);
+            res = -1;
+            if (avio_seek(p->avio, pos, SEEK_SET) >= 0)
+                res = avio_read_partial(p->avio, buffer, len);
+            pthread_mutex_lock(&pf->lock);
+            if (res <= 0) {
+                res = -1;
+                break;
+            }
+            if (c == &pf->chunks[pf->first] && pf->read_pos == pos &&
+                offset == c->filled)
+            {
+                memcpy(c->data + c->filled, buffer, res);
+                c->filled += res;
+            }
+            prefetch_set_pos(pf, pos + res);
+            break;
+        }
+        if (mp_cancel_test(s->cancel))
+            break;
+        struct timespec ts = mp_rel_time_to_timespec(0.1);
+        pthread_cond_timedwait(&pf->wakeup, &pf->lock, &ts);
+    }
+    pthread_mutex_unlock(&pf->lock);
+    return res;
+}
+
+static int prefetch_seek(stream_t *s, int64_t newpos)
+{
+    struct priv *p = s->priv;
+    pthread_mutex_lock(&p->pf->lock);
+    prefetch_set_pos(p->pf, newpos);
+    pthread_mutex_unlock(&p->pf->lock);
+    return 1;
+}
+
+static void prefetch_get_info(struct prefetch *pf,
+                              struct stream_connection_info *info)
+{
+    pthread_mutex_lock(&pf->lock);
+    *info = (struct stream_connection_info){.num_connections = pf->num_conns};
+    for (int n = 0; n < pf->num_conns; n++) {
+        info->connections[n].bytes = pf->conns[n].bytes;
+        info->connections[n].requests = pf->conns[n].requests;
+        info->connections[n].active = pf->conns[n].active;
+    }
+    pthread_mutex_unlock(&pf->lock);
+}
+
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
 {
-    AVIOContext *avio = s->priv;
-    if (!avio)
+    struct priv *p = s->priv;
+    if (!p)
         return -1;
-    int r = avio_read_partial(avio, buffer, max_len);
+    int r = avio_read_partial(p->avio, buffer, max_len);
     return (r <= 0) ? -1 : r;
 }
 
 static int write_buffer(stream_t *s, char *buffer, int len)
 {
-    AVIOContext *avio = s->priv;
-    if (!avio)
+    struct priv *p = s->priv;
+    if (!p)
         return -1;
+    AVIOContext *avio = p->avio;
     avio_write(avio, buffer, len);
     avio_flush(avio);
     if (avio->error)
@@ -97,10 +433,10 @@ static int write_buffer(stream_t *s, char *buffer, int len)
 
 static int seek(stream_t *s, int64_t newpos)
 {
-    AVIOContext *avio = s->priv;
-    if (!avio)
+    struct priv *p = s->priv;
+    if (!p)
         return -1;
-    if (avio_seek(avio, newpos, SEEK_SET) < 0) {
+    if (avio_seek(p->avio, newpos, SEEK_SET) < 0) {
         return 0;
     }
     return 1;
@@ -108,21 +444,26 @@ static int seek(stream_t *s, int64_t newpos)
 
 static void close_f(stream_t *stream)
 {
-    AVIOContext *avio = stream->priv;
+    struct priv *p = stream->priv;
+    if (!p)
+        return;
+    prefetch_destroy(p->pf);
     /* NOTE: As of 2011 write streams must be manually flushed before close.
      * Currently write_buffer() always flushes them after writing.
      * avio_close() could return an error, but we have no way to return that
      * with the current stream API.
      */
-    if (avio)
-        avio_close(avio);
+    avio_close(p->avio);
+    talloc_free(p);
+    stream->priv = NULL;
 }
 
 static int control(stream_t *s, int cmd, void *arg)
 {
-    AVIOContext *avio = s->priv;
-    if (!avio && cmd != STREAM_CTRL_RECONNECT)
+    struct priv *p = s->priv;
+    if (!p && cmd != STREAM_CTRL_RECONNECT)
         return -1;
+    AVIOContext *avio = p ? p->avio : NULL;
     int64_t size;
     switch(cmd) {
     case STREAM_CTRL_GET_SIZE:
@@ -134,6 +475,8 @@ static int control(stream_t *s, int cmd, void *arg)
         break;
     case STREAM_CTRL_AVSEEK: {
         struct stream_avseek *c = arg;
+        if (p->pf)
+            break;
         int64_t r = avio_seek_time(avio, c->stream_index, c->timestamp, c->flags);
         if (r >= 0) {
             stream_drop_buffers(s);
@@ -171,12 +514,16 @@ static int control(stream_t *s, int cmd, void *arg)
             break;
         return 1;
     }
+    case STREAM_CTRL_GET_CONNECTION_INFO:
+        if (!p->pf)
+            break;
+        prefetch_get_info(p->pf, arg);
+        return 1;
     case STREAM_CTRL_RECONNECT: {
         if (avio && avio->write_flag)
             break; // don't bother with this
         // avio doesn't seem to support this - emulate it by reopening
         close_f(s);
-        s->priv = NULL;
         stream_drop_buffers(s);
         s->pos = 0;
         return open_f(s);
@@ -264,7 +611,10 @@ static int open_f(stream_t *stream)
     AVIOContext *avio = NULL;
     int res = STREAM_ERROR;
     AVDictionary *dict = NULL;
+    AVDictionary *prefetch_dict = NULL;
     void *temp = talloc_new(NULL);
+    struct stream_lavf_params *opts =
+        mp_get_config_group(temp, stream->global, &stream_lavf_conf);
 
     stream->seek = NULL;
     stream->seekable = false;
@@ -316,6 +666,9 @@ static int open_f(stream_t *stream)
         av_dict_set(&dict, "timeout", "0", 0);
     }
 
+    // Keep a copy of the options for opening prefetch connections.
+    av_dict_copy(&prefetch_dict, dict, 0);
+
     int err = avio_open2(&avio, filename, flags, &cb, &dict);
     if (err < 0) {
         if (err == AVERROR_PROTOCOL_NOT_FOUND)
@@ -334,10 +687,28 @@ static int open_f(stream_t *stream)
         }
     }
 
-    stream->priv = avio;
+    struct priv *p = talloc_zero(NULL, struct priv);
+    p->avio = avio;
+    stream->priv = p;
     stream->seekable = avio->seekable & AVIO_SEEKABLE_NORMAL;
     stream->seek = stream->seekable ? seek : NULL;
     stream->fill_buffer = fill_buffer;
+
+    bstr proto = mp_split_proto(bstr0(filename), NULL);
+    int64_t size = avio_size(avio);
+    if (opts->http_connections > 1 && !(flags & AVIO_FLAG_WRITE) &&
+        stream->seekable && size > 0 &&
+        (bstr_equals0(proto, "http") || bstr_equals0(proto, "https")))
+    {
+        p->pf = prefetch_create(stream, filename, prefetch_dict, size,
+                                opts->http_connections,
+                                opts->http_chunk_size * 1024);
+        if (p->pf) {
+            stream->seek = prefetch_seek;
+            stream->fill_buffer = prefetch_fill_buffer;
+        }
+    }
+
     stream->write_buffer = write_buffer;
     stream->control = control;
     stream->close = close_f;
@@ -347,13 +718,15 @@ static int open_f(stream_t *stream)
 
 out:
     av_dict_free(&dict);
+    av_dict_free(&prefetch_dict);
     talloc_free(temp);
     return res;
 }
 
 static struct mp_tags *read_icy(stream_t *s)
 {
-    AVIOContext *avio = s->priv;
+    struct priv *p = s->priv;
+    AVIOContext *avio = p->avio;
 
     if (!avio->av_class)
         return NULL;
@@ -18,6 +18,8 @@
 #include <archive.h>
 #include <archive_entry.h>
 
+#include <libavutil/intreadwrite.h>
+
 #include "misc/bstr.h"
 #include "common/common.h"
 #include "stream.h"
@@ -234,6 +236,7 @@ static bool add_volume(struct mp_log *log, struct mp_archive *mpa,
     locale_t oldlocale = uselocale(mpa->locale);
     bool res = archive_read_append_callback_data(mpa->arch, vol) == ARCHIVE_OK;
     uselocale(oldlocale);
+    mpa->num_volumes += res;
     return res;
 }
 
@@ -350,6 +353,9 @@ struct priv {
     struct stream *src;
     int64_t entry_size;
     char *entry_name;
+    // If >= 0, the entry is stored uncompressed at this offset in src, and
+    // is read directly instead of going through libarchive.
+    int64_t direct_offset;
 };
 
 static int reopen_archive(stream_t *s)
@@ -379,9 +385,100 @@ static int reopen_archive(stream_t *s)
     return STREAM_ERROR;
 }
 
+// Return the offset of the uncompressed entry data in the source stream for
+// formats which store data as-is (uncompressed tar, stored zip members), or -1.
+// The header position reported by libarchive is the start of the entry's
+// headers, which are parsed here to find the data.
+static int64_t find_entry_data(struct mp_archive *mpa, struct stream *src)
+{
+    int64_t pos = archive_read_header_position(mpa->arch);
+    int format = archive_format(mpa->arch) & ARCHIVE_FORMAT_BASE_MASK;
+    unsigned char hdr[512];
+
+    if (format == ARCHIVE_FORMAT_ZIP) {
+        if (!stream_seek(src, pos) || stream_read(src, (char *)hdr, 30) != 30)
+            return -1;
+        if (memcmp(hdr, "PK\3\4", 4) != 0)
+            return -1;
+        int flags = AV_RL16(hdr + 6);
+        int method = AV_RL16(hdr + 8);
+        if (method != 0 || (flags & 1)) // compressed or encrypted
+            return -1;
+        return pos + 30 + AV_RL16(hdr + 26) + AV_RL16(hdr + 28);
+    }
+
+    if (format == ARCHIVE_FORMAT_TAR) {
+        // Skip extended headers (pax, GNU long names) preceding the entry.
+        for (int n = 0; n < 16; n++) {
+            if (!stream_seek(src, pos) || stream_read(src, (char *)hdr, 512) != 512)
+                return -1;
+            char type = hdr[156];
+            if (type != 'x' && type != 'g' && type != 'L' && type != 'K')
+                return pos + 512;
+            char size_str[13] = {0};
+            memcpy(size_str, hdr + 124, 12);
+            int64_t size = strtoll(size_str, NULL, 8);
+            if (size < 0)
+                return -1;
+            pos += 512 + (size + 511) / 512 * 512;
+        }
+    }
+
+    return -1;
+}
+
+// Try to switch to reading the entry directly from the source stream. The
+// archive must have just been opened at the entry (read position 0).
+static void map_entry(stream_t *s)
+{
+    struct priv *p = s->priv;
+    struct mp_archive *mpa = p->mpa;
+    if (!p->src->seekable || p->entry_size <= 0 || mpa->num_volumes != 1)
+        return;
+
+    locale_t oldlocale = uselocale(mpa->locale);
+    int64_t offset = -1;
+    if (archive_filter_code(mpa->arch, 0) == ARCHIVE_FILTER_NONE) {
+        // libarchive expects the source position to be unchanged.
+        int64_t src_pos = stream_tell(p->src);
+        offset = find_entry_data(mpa, p->src);
+        if (!stream_seek(p->src, src_pos))
+            offset = -1;
+    }
+    // Compare some data with what libarchive returns, in case the header
+    // parsing above was fooled by something.
+    bool ok = false;
+    if (offset >= 0) {
+        char a[4096], b[4096];
+        int len = MPMIN(p->entry_size, sizeof(a));
+        ok = archive_read_data(mpa->arch, a, len) == len &&
+             stream_seek(p->src, offset) &&
+             stream_read(p->src, b, len) == len &&
+             memcmp(a, b, len) == 0;
+    }
+    uselocale(oldlocale);
+
+    if (ok) {
+        MP_VERBOSE(s, "Reading stored entry directly at %"PRId64".\n", offset);
+        p->direct_offset = offset;
+        mp_archive_free(p->mpa);
+        p->mpa = NULL;
+    } else if (offset >= 0) {
+        // libarchive's position was changed.
+        reopen_archive(s);
+    }
+}
+
 static int archive_entry_fill_buffer(stream_t *s, char *buffer, int max_len)
 {
     struct priv *p = s->priv;
+    if (p->direct_offset >= 0) {
+        int64_t pos = p->direct_offset + s->pos;
+        if (stream_tell(p->src) != pos && !stream_seek(p->src, pos))
+            return -1;
+        max_len = MPMIN(max_len, p->entry_size - s->pos);
+        return max_len > 0 ? stream_read_partial(p->src, buffer, max_len) : 0;
+    }
     if (!p->mpa)
         return 0;
     locale_t oldlocale = uselocale(p->mpa->locale);
@@ -400,6 +497,8 @@ static int archive_entry_fill_buffer(stream_t *s, char *buffer, int max_len)
 static int archive_entry_seek(stream_t *s, int64_t newpos)
 {
     struct priv *p = s->priv;
+    if (p->direct_offset >= 0)
+        return 1; // fill_buffer seeks the source stream
     if (!p->mpa)
         return -1;
     locale_t oldlocale = uselocale(p->mpa->locale);
@@ -424,7 +523,7 @@ static int archive_entry_seek(stream_t *s, int64_t newpos)
     if (newpos > s->pos) {
         // For seeking forwards, just keep reading data (there's no libarchive
         // skip function either).
-        char buffer[4096];
+        char buffer[64 * 1024];
         while (newpos > s->pos) {
             if (mp_cancel_test(s->cancel))
                 return -1;
@@ -474,6 +573,7 @@ static int archive_entry_control(stream_t *s, int cmd, void *arg)
 static int archive_entry_open(stream_t *stream)
 {
     struct priv *p = talloc_zero(stream, struct priv);
+    p->direct_offset = -1;
     stream->priv = p;
 
     if (!strchr(stream->path, '|'))
@@ -498,6 +598,8 @@ static int archive_entry_open(stream_t *stream)
         return r;
     }
 
+    map_entry(stream);
+
     stream->fill_buffer = archive_entry_fill_buffer;
     if (p->src->seekable) {
         stream->seek = archive_entry_seek;
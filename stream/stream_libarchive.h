@@ -8,6 +8,7 @@ struct mp_archive {
     struct mp_log *log;
     struct archive *arch;
     struct stream *primary_src;
+    int num_volumes;
     char buffer[4096];
 
     // Current entry, as set by mp_archive_next_entry().
@@ -0,0 +1,107 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <unistd.h>
+
+#ifndef __MINGW32__
+#include <poll.h>
+#endif
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "osdep/io.h"
+#include "osdep/subprocess.h"
+#include "stream.h"
+
+// Plays the stdout of a shell command, e.g.
+//  subprocess://youtube-dl -o - URL
+// The pipe is read directly into the stream buffer, so there are no temporary
+// files and no copies between the process and the demuxer.
+
+struct priv {
+    int fd;
+    int64_t pid;
+};
+
+static int fill_buffer(stream_t *s, char *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+#ifndef __MINGW32__
+    int c = s->cancel ? mp_cancel_get_fd(s->cancel) : -1;
+    struct pollfd fds[2] = {
+        {.fd = p->fd, .events = POLLIN},
+        {.fd = c, .events = POLLIN},
+    };
+    poll(fds, c >= 0 ? 2 : 1, -1);
+    if (fds[1].revents & POLLIN)
+        return -1;
+#endif
+    int r;
+    do {
+        r = read(p->fd, buffer, max_len);
+    } while (r < 0 && errno == EINTR);
+    return r <= 0 ? -1 : r;
+}
+
+static void s_close(stream_t *s)
+{
+    struct priv *p = s->priv;
+    close(p->fd);
+    // The process is normally done at this point, unless playback was stopped
+    // before the end.
+    char *error = NULL;
+    int status = mp_subprocess_wait(p->pid, true, &error);
+    MP_VERBOSE(s, "Process exited with status %d (%s).\n", status,
+               error ? error : "ok");
+}
+
+static int open_f(stream_t *stream)
+{
+    struct priv *p = talloc_zero(stream, struct priv);
+    stream->priv = p;
+
+    bstr cmd = bstr0(stream->url);
+    bstr_eatstart0(&cmd, "subprocess://");
+    if (!cmd.len) {
+        MP_ERR(stream, "No command given.\n");
+        return STREAM_ERROR;
+    }
+
+    char *args[] = {"/bin/sh", "-c", bstrto0(stream, cmd), NULL};
+    p->fd = mp_subprocess_spawn_pipe(args, &p->pid);
+    if (p->fd < 0) {
+        MP_ERR(stream, "Could not start '%s'.\n", args[2]);
+        return STREAM_ERROR;
+    }
+    MP_VERBOSE(stream, "Reading from '%s'.\n", args[2]);
+
+    stream->fill_buffer = fill_buffer;
+    stream->close = s_close;
+    stream->read_chunk = 64 * 1024;
+    stream->streaming = true;
+
+    return STREAM_OK;
+}
+
+// Not marked as safe: this runs arbitrary commands, so it must not be opened
+// from playlists or other untrusted sources.
+const stream_info_t stream_info_subprocess = {
+    .name = "subprocess",
+    .open = open_f,
+    .protocols = (const char*const[]){ "subprocess", NULL },
+};
@@ -30,7 +30,9 @@
 #include "common/common.h"
 #include "common/global.h"
 #include "common/msg.h"
+#include "misc/bstr.h"
 #include "options/path.h"
+#include "osdep/atomic.h"
 #include "ass_mp.h"
 #include "img_convert.h"
 #include "osd.h"
@@ -139,6 +141,123 @@ ASS_Library *mp_ass_init(struct mpv_global *global, struct mp_log *log)
     return priv;
 }
 
+static unsigned rb16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static uint32_t rb32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void add_font_name(void *ta_parent, char ***names, int *num_names,
+                          struct bstr name)
+{
+    name = bstr_strip(name);
+    if (!name.len)
+        return;
+    for (int n = 0; n < *num_names; n++) {
+        if (bstrcasecmp0(name, (*names)[n]) == 0)
+            return;
+    }
+    MP_TARRAY_APPEND(ta_parent, *names, *num_names, bstrdup0(ta_parent, name));
+}
+
+// Add the names from the "name" table of the font at off.
+static bool read_sfnt_names(void *ta_parent, const uint8_t *d, size_t size,
+                            size_t off, char ***names, int *num_names)
+{
+    if (off > size || size - off < 12)
+        return false;
+    unsigned num_tables = rb16(d + off + 4);
+    if ((size - off - 12) / 16 < num_tables)
+        return false;
+    for (unsigned n = 0; n < num_tables; n++) {
+        const uint8_t *rec = d + off + 12 + n * 16;
+        if (memcmp(rec, "name", 4) != 0)
+            continue;
+        size_t t = rb32(rec + 8), t_len = rb32(rec + 12);
+        if (t > size || size - t < t_len || t_len < 6)
+            return false;
+        const uint8_t *tab = d + t;
+        unsigned count = rb16(tab + 2), str_off = rb16(tab + 4);
+        if ((t_len - 6) / 12 < count || str_off > t_len)
+            return false;
+        for (unsigned i = 0; i < count; i++) {
+            const uint8_t *r = tab + 6 + i * 12;
+            unsigned platform = rb16(r), id = rb16(r + 6);
+            size_t len = rb16(r + 8), s = str_off + rb16(r + 10);
+            // Family, full, PostScript, and typographic family names, which
+            // is what libass matches font names against.
+            if ((id != 1 && id != 4 && id != 6 && id != 16) || s > t_len ||
+                t_len - s < len)
+                continue;
+            const uint8_t *str = tab + s;
+            struct bstr name = {0};
+            if (platform == 0 || platform == 3) {
+                // UTF-16BE
+                for (size_t c = 0; c + 1 < len; c += 2) {
+                    uint32_t cp = rb16(str + c);
+                    if (cp >= 0xD800 && cp < 0xDC00 && c + 3 < len) {
+                        uint32_t lo = rb16(str + c + 2);
+                        if (lo >= 0xDC00 && lo < 0xE000) {
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                            c += 2;
+                        }
+                    }
+                    mp_append_utf8_bstr(ta_parent, &name, cp);
+                }
+            } else if (platform == 1) {
+                // Mac Roman; only used if it's plain ASCII
+                name = (struct bstr){(unsigned char *)str, len};
+                for (size_t c = 0; c < len; c++) {
+                    if (str[c] >= 0x80)
+                        name.len = 0;
+                }
+            }
+            add_font_name(ta_parent, names, num_names, name);
+        }
+        return true;
+    }
+    return false;
+}
+
+// Return the names a TrueType/OpenType file or collection can be selected
+// with, as NULL-terminated list. Returns NULL if the file can't be parsed.
+// This is much cheaper than loading the font with libass/FreeType.
+char **mp_ass_font_names(void *ta_parent, const void *data, size_t size)
+{
+    const uint8_t *d = data;
+    char **names = NULL;
+    int num_names = 0;
+    void *tmp = talloc_new(NULL);
+    bool ok = false;
+
+    if (size >= 12 && memcmp(d, "ttcf", 4) == 0) {
+        uint32_t num_fonts = rb32(d + 8);
+        if ((size - 12) / 4 >= num_fonts) {
+            ok = num_fonts > 0;
+            for (uint32_t n = 0; n < num_fonts; n++) {
+                ok &= read_sfnt_names(tmp, d, size, rb32(d + 12 + n * 4),
+                                      &names, &num_names);
+            }
+        }
+    } else {
+        ok = read_sfnt_names(tmp, d, size, 0, &names, &num_names);
+    }
+
+    char **res = NULL;
+    if (ok && num_names) {
+        res = talloc_array(ta_parent, char *, num_names + 1);
+        for (int n = 0; n < num_names; n++)
+            res[n] = talloc_strdup(res, names[n]);
+        res[num_names] = NULL;
+    }
+    talloc_free(tmp);
+    return res;
+}
+
 void mp_ass_flush_old_events(ASS_Track *track, long long ts)
 {
     int n = 0;
@@ -186,6 +305,21 @@ static void draw_ass_rgba(unsigned char *src, int src_w, int src_h,
     }
 }
 
+// Maximum number of dirty rectangles reported for an incremental update.
+// If there are more, they are merged into a single bounding box.
+#define MAX_DIRTY_RECTS 64
+
+// Unique across all packers, so VO state can't confuse different packers.
+static atomic_ullong packed_id_counter = ATOMIC_VAR_INIT(1);
+
+// A libass bitmap copied into cached_img.
+struct ass_slot {
+    const void *src;        // libass bitmap pointer it was copied from
+    int stride;             // libass bitmap stride
+    int x, y, w, h;         // position in cached_img
+    bool used;              // temporary in pack_libass_incremental()
+};
+
 struct mp_ass_packer {
     struct sub_bitmap *cached_parts; // only for the array memory
     struct mp_image *cached_img;
@@ -193,6 +327,17 @@ struct mp_ass_packer {
     bool cached_subs_valid;
     struct sub_bitmap rgba_imgs[MP_SUB_BB_LIST_MAX];
     struct bitmap_packer *packer;
+    // For incremental updates of cached_img (libass format only).
+    uint64_t packed_id;     // cached_img contents; 0 if not reusable
+    struct ass_slot *slots; // parts as placed by the previous pack
+    int num_slots;
+    struct ass_slot *new_slots;
+    struct mp_rect *free_rects; // unused rectangles in cached_img
+    int num_free_rects;
+    int shelf_x, shelf_y, shelf_h; // where new parts are appended
+    int full_h;             // packed_h of the last full repack
+    bool *placed;           // temporary, per part
+    struct mp_rect dirty[MAX_DIRTY_RECTS];
 };
 
 // Free with talloc_free().
@@ -243,23 +388,186 @@ static bool pack(struct mp_ass_packer *p, struct sub_bitmaps *res, int imgfmt)
     return true;
 }
 
-static bool pack_libass(struct mp_ass_packer *p, struct sub_bitmaps *res)
+static void add_dirty(struct mp_ass_packer *p, struct sub_bitmaps *res,
+                      struct mp_rect rc)
+{
+    if (res->num_packed_dirty < MAX_DIRTY_RECTS) {
+        p->dirty[res->num_packed_dirty++] = rc;
+    } else {
+        mp_rect_union(&p->dirty[0], &rc);
+        for (int n = 1; n < res->num_packed_dirty; n++)
+            mp_rect_union(&p->dirty[0], &p->dirty[n]);
+        res->num_packed_dirty = 1;
+    }
+}
+
+static bool slot_matches(struct mp_ass_packer *p, struct ass_slot *s,
+                         struct sub_bitmap *b)
+{
+    if (s->used || s->src != b->bitmap || s->stride != b->stride ||
+        s->w != b->w || s->h != b->h)
+        return false;
+    // libass might have reused the memory for a different bitmap.
+    struct mp_image *img = p->cached_img;
+    for (int y = 0; y < b->h; y++) {
+        uint8_t *dst = img->planes[0] + (s->y + y) * img->stride[0] + s->x;
+        if (memcmp(dst, (uint8_t *)b->bitmap + y * b->stride, b->w))
+            return false;
+    }
+    return true;
+}
+
+// Find a place for a part that wasn't in the previous image. Free space left
+// by parts that went away is reused first, then new parts are appended in
+// rows ("shelves") below the existing contents.
+static bool place_part(struct mp_ass_packer *p, struct sub_bitmap *b)
+{
+    for (int n = 0; n < p->num_free_rects; n++) {
+        struct mp_rect *rc = &p->free_rects[n];
+        if (rc->x1 - rc->x0 >= b->w && rc->y1 - rc->y0 >= b->h) {
+            b->src_x = rc->x0;
+            b->src_y = rc->y0;
+            MP_TARRAY_REMOVE_AT(p->free_rects, p->num_free_rects, n);
+            return true;
+        }
+    }
+
+    struct mp_image *img = p->cached_img;
+    if (b->w > img->w)
+        return false;
+    if (p->shelf_x + b->w > img->w) {
+        p->shelf_x = 0;
+        p->shelf_y += p->shelf_h;
+        p->shelf_h = 0;
+    }
+    if (p->shelf_y + b->h > img->h) {
+        // Grow the image, keeping the positions of the existing parts.
+        int new_h = img->h;
+        while (p->shelf_y + b->h > new_h)
+            new_h *= 2;
+        struct mp_image *nimg = mp_image_alloc(IMGFMT_Y8, img->w, new_h);
+        if (!nimg)
+            return false;
+        talloc_steal(p, nimg);
+        memcpy_pic(nimg->planes[0], img->planes[0], img->w, img->h,
+                   nimg->stride[0], img->stride[0]);
+        talloc_free(img);
+        p->cached_img = img = nimg;
+    }
+    b->src_x = p->shelf_x;
+    b->src_y = p->shelf_y;
+    p->shelf_x += b->w;
+    p->shelf_h = MPMAX(p->shelf_h, b->h);
+    return true;
+}
+
+// Try to update the previously packed image in place. Parts which are still
+// the same keep their positions; only new parts are copied and reported as
+// dirty. Returns false if a full repack should be done instead.
+static bool pack_libass_incremental(struct mp_ass_packer *p,
+                                    struct sub_bitmaps *res)
 {
-    if (!pack(p, res, IMGFMT_Y8))
+    if (!p->packed_id || !p->cached_img || res->num_parts == 0)
         return false;
 
+    MP_TARRAY_GROW(p, p->placed, res->num_parts);
+    for (int n = 0; n < p->num_slots; n++)
+        p->slots[n].used = false;
+
+    // libass mostly returns the bitmaps in the same order as before.
+    int hint = 0;
+    int area = 0;
+    for (int n = 0; n < res->num_parts; n++) {
+        struct sub_bitmap *b = &res->parts[n];
+        p->placed[n] = false;
+        for (int i = 0; i < p->num_slots; i++) {
+            struct ass_slot *s = &p->slots[(hint + i) % p->num_slots];
+            if (slot_matches(p, s, b)) {
+                s->used = true;
+                b->src_x = s->x;
+                b->src_y = s->y;
+                p->placed[n] = true;
+                hint = (hint + i + 1) % p->num_slots;
+                break;
+            }
+        }
+        area += b->w * b->h;
+    }
+
+    // Too fragmented: a full repack gives a much smaller image.
+    int used_h = p->shelf_y + p->shelf_h;
+    if (used_h > p->full_h * 2 && area < p->cached_img->w * used_h / 4)
+        return false;
+
+    for (int n = 0; n < p->num_slots; n++) {
+        struct ass_slot *s = &p->slots[n];
+        if (!s->used) {
+            MP_TARRAY_APPEND(p, p->free_rects, p->num_free_rects,
+                (struct mp_rect){s->x, s->y, s->x + s->w, s->y + s->h});
+        }
+    }
+
+    res->packed_dirty = p->dirty;
+    res->num_packed_dirty = 0;
+    res->packed_w = res->packed_h = 0;
+
+    for (int n = 0; n < res->num_parts; n++) {
+        struct sub_bitmap *b = &res->parts[n];
+        if (!p->placed[n]) {
+            if (!place_part(p, b))
+                return false;
+            add_dirty(p, res, (struct mp_rect){b->src_x, b->src_y,
+                                               b->src_x + b->w,
+                                               b->src_y + b->h});
+        }
+        res->packed_w = MPMAX(res->packed_w, b->src_x + b->w);
+        res->packed_h = MPMAX(res->packed_h, b->src_y + b->h);
+    }
+
+    res->packed = p->cached_img;
+    res->packed_base = p->packed_id;
+    return true;
+}
+
+static bool pack_libass(struct mp_ass_packer *p, struct sub_bitmaps *res)
+{
+    bool incremental = pack_libass_incremental(p, res);
+    if (!incremental) {
+        p->packed_id = 0;
+        res->packed_base = 0;
+        res->num_packed_dirty = 0;
+        if (!pack(p, res, IMGFMT_Y8))
+            return false;
+        p->num_free_rects = 0;
+        p->shelf_x = 0;
+        p->shelf_y = p->full_h = res->packed_h;
+        p->shelf_h = 0;
+    }
+
+    p->num_slots = 0;
+    MP_TARRAY_GROW(p, p->new_slots, res->num_parts);
+
     for (int n = 0; n < res->num_parts; n++) {
         struct sub_bitmap *b = &res->parts[n];
 
+        p->new_slots[p->num_slots++] = (struct ass_slot){
+            .src = b->bitmap, .stride = b->stride,
+            .x = b->src_x, .y = b->src_y, .w = b->w, .h = b->h,
+        };
+
         int stride = res->packed->stride[0];
         void *pdata =
             (uint8_t *)res->packed->planes[0] + b->src_y * stride + b->src_x;
-        memcpy_pic(pdata, b->bitmap, b->w, b->h, stride, b->stride);
+        if (!incremental || !p->placed[n])
+            memcpy_pic(pdata, b->bitmap, b->w, b->h, stride, b->stride);
 
         b->bitmap = pdata;
         b->stride = stride;
     }
 
+    MPSWAP(struct ass_slot *, p->slots, p->new_slots);
+    p->packed_id = atomic_fetch_add(&packed_id_counter, 1);
+    res->packed_id = p->packed_id;
     return true;
 }
 
@@ -317,13 +625,39 @@ static bool pack_rgba(struct mp_ass_packer *p, struct sub_bitmaps *res)
     return true;
 }
 
+// Update only the positions of the previously packed parts. Returns false if
+// the images don't correspond to them.
+static bool update_positions(struct mp_ass_packer *p, ASS_Image **image_lists,
+                             int num_image_lists)
+{
+    struct sub_bitmaps *res = &p->cached_subs;
+    int n = 0;
+    for (int i = 0; i < num_image_lists; i++) {
+        for (struct ass_image *img = image_lists[i]; img; img = img->next) {
+            if (img->w == 0 || img->h == 0)
+                continue;
+            if (n >= res->num_parts || n >= p->num_slots ||
+                p->slots[n].src != img->bitmap ||
+                res->parts[n].w != img->w || res->parts[n].h != img->h)
+                return false;
+            res->parts[n].x = img->dst_x;
+            res->parts[n].y = img->dst_y;
+            n++;
+        }
+    }
+    return n == res->num_parts;
+}
+
 // Pack the contents of image_lists[0] to image_lists[num_image_lists-1] into
 // a single image, and make *out point to it. *out is completely overwritten.
-// If libass reported any change, image_lists_changed must be set (it then
-// repacks all images). preferred_osd_format can be set to a desired
+// image_lists_changed is the libass change detection result (or'ed over all
+// lists): 0 for no change, 1 if only positions changed, anything else if the
+// contents changed. preferred_osd_format can be set to a desired
 // sub_bitmap_format. Currently, only SUBBITMAP_LIBASS is supported.
+// If only the positions changed, the packed image is kept as it is (same
+// packed_id), so the VO doesn't need to upload anything.
 void mp_ass_packer_pack(struct mp_ass_packer *p, ASS_Image **image_lists,
-                        int num_image_lists, bool image_lists_changed,
+                        int num_image_lists, int image_lists_changed,
                         int preferred_osd_format, struct sub_bitmaps *out)
 {
     int format = preferred_osd_format == SUBBITMAP_RGBA ? SUBBITMAP_RGBA
@@ -336,6 +670,17 @@ void mp_ass_packer_pack(struct mp_ass_packer *p, ASS_Image **image_lists,
         return;
     }
 
+    if (p->cached_subs_valid && image_lists_changed == 1 &&
+        format == SUBBITMAP_LIBASS && p->cached_subs.format == format &&
+        p->packed_id && update_positions(p, image_lists, num_image_lists))
+    {
+        p->cached_subs.packed_base = p->packed_id;
+        p->cached_subs.num_packed_dirty = 0;
+        *out = p->cached_subs;
+        out->change_id = 1;
+        return;
+    }
+
     *out = (struct sub_bitmaps){.change_id = 1};
     p->cached_subs_valid = false;
 
@@ -365,6 +710,7 @@ void mp_ass_packer_pack(struct mp_ass_packer *p, ASS_Image **image_lists,
 
     bool r = false;
     if (format == SUBBITMAP_RGBA) {
+        p->packed_id = 0;
         r = pack_rgba(p, &res);
     } else {
         r = pack_libass(p, &res);
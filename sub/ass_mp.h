@@ -48,12 +48,13 @@ void mp_ass_set_style(ASS_Style *style, double res_y,
 void mp_ass_configure_fonts(ASS_Renderer *priv, struct osd_style_opts *opts,
                             struct mpv_global *global, struct mp_log *log);
 ASS_Library *mp_ass_init(struct mpv_global *global, struct mp_log *log);
+char **mp_ass_font_names(void *ta_parent, const void *data, size_t size);
 
 struct sub_bitmaps;
 struct mp_ass_packer;
 struct mp_ass_packer *mp_ass_packer_alloc(void *ta_parent);
 void mp_ass_packer_pack(struct mp_ass_packer *p, ASS_Image **image_lists,
-                        int num_image_lists, bool changed,
+                        int num_image_lists, int changed,
                         int preferred_osd_format, struct sub_bitmaps *out);
 
 #endif                          /* MPLAYER_ASS_MP_H */
@@ -57,6 +57,7 @@ struct dec_sub {
     struct sh_stream *sh;
     double last_pkt_pts;
     bool preload_attempted;
+    double read_ahead;
 
     struct mp_codec_params *codec;
     double start, end;
@@ -93,6 +94,7 @@ static struct sd *init_decoder(struct dec_sub *sub)
     for (int n = 0; sd_list[n]; n++) {
         const struct sd_functions *driver = sd_list[n];
         struct sd *sd = talloc(NULL, struct sd);
+        ta_set_account(sd, MP_MEM_OSD);
         *sd = (struct sd){
             .global = sub->global,
             .log = mp_log_new(sd, sub->log, driver->name),
@@ -125,6 +127,7 @@ struct dec_sub *sub_create(struct mpv_global *global, struct sh_stream *sh,
     assert(sh && sh->type == STREAM_SUB);
 
     struct dec_sub *sub = talloc(NULL, struct dec_sub);
+    ta_set_account(sub, MP_MEM_OSD);
     *sub = (struct dec_sub){
         .log = mp_log_new(sub, global->log, "sub"),
         .global = global,
@@ -179,11 +182,24 @@ bool sub_can_preload(struct dec_sub *sub)
 {
     bool r;
     pthread_mutex_lock(&sub->lock);
-    r = sub->sd->driver->accept_packets_in_advance && !sub->preload_attempted;
+    r = sub->sd->driver->accept_packets_in_advance && !sub->preload_attempted &&
+        !(sub->read_ahead > 0);
     pthread_mutex_unlock(&sub->lock);
     return r;
 }
 
+// Instead of preloading, read only packets up to the given number of seconds
+// ahead of the playback position. Meant for fully read external subtitle
+// files, where the demuxer has all packets indexed by timestamp anyway, and
+// decoding them all would make loading huge files slow. 0 disables this.
+// Must be set before the first sub_read_packets() call.
+void sub_set_read_ahead(struct dec_sub *sub, double seconds)
+{
+    pthread_mutex_lock(&sub->lock);
+    sub->read_ahead = seconds;
+    pthread_mutex_unlock(&sub->lock);
+}
+
 void sub_preload(struct dec_sub *sub)
 {
     pthread_mutex_lock(&sub->lock);
@@ -222,6 +238,10 @@ bool sub_read_packets(struct dec_sub *sub, double video_pts)
         if (!read_more)
             break;
 
+        if (sub->read_ahead > 0 && sub->last_pkt_pts != MP_NOPTS_VALUE &&
+            sub->last_pkt_pts > video_pts + sub->read_ahead)
+            break;
+
         if (sub->new_segment && sub->new_segment->start < video_pts) {
             sub->last_vo_pts = video_pts;
             update_segment(sub);
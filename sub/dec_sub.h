@@ -20,6 +20,7 @@ enum sd_ctrl {
     SD_CTRL_SET_TOP,
     SD_CTRL_SET_VIDEO_DEF_FPS,
     SD_CTRL_UPDATE_SPEED,
+    SD_CTRL_PRERENDER,
 };
 
 struct attachment_list {
@@ -35,6 +36,7 @@ void sub_unlock(struct dec_sub *sub);
 
 bool sub_can_preload(struct dec_sub *sub);
 void sub_preload(struct dec_sub *sub);
+void sub_set_read_ahead(struct dec_sub *sub, double seconds);
 bool sub_read_packets(struct dec_sub *sub, double video_pts);
 void sub_get_bitmaps(struct dec_sub *sub, struct mp_osd_res dim, int format,
                      double pts, struct sub_bitmaps *res);
@@ -20,12 +20,17 @@
 #include <assert.h>
 #include <math.h>
 #include <inttypes.h>
+#include <pthread.h>
 
 #include <libswscale/swscale.h>
 #include <libavutil/common.h>
+#include <libavutil/cpu.h>
 
+#include "config.h"
 #include "common/common.h"
+#include "misc/thread_pool.h"
 #include "draw_bmp.h"
+#include "draw_bmp_x86.h"
 #include "img_convert.h"
 #include "video/mp_image.h"
 #include "video/sws_utils.h"
@@ -55,8 +60,58 @@ struct mp_draw_sub_cache
     struct part *parts[MAX_OSD_PARTS];
     struct mp_image *upsample_img;
     struct mp_image upsample_temp;
+    struct mp_thread_pool *pool;
+    int pool_threads;
 };
 
+// Parameters for blending one band of a region (see blend_region()).
+struct blend_job {
+    struct mp_rect bb;
+    struct mp_image temp;
+    int bits;
+    struct sub_bitmaps *sbs;
+    struct part *part;          // SUBBITMAP_RGBA only
+    bool need_conv;             // SUBBITMAP_LIBASS only
+    struct mp_cmat rgb2yuv;
+    int texture_bits;
+
+    pthread_mutex_t *lock;
+    pthread_cond_t *wakeup;
+    int *pending;
+};
+
+// Regions with fewer pixels are not worth distributing to threads.
+#define MIN_THREADED_PIXELS (512 * 512)
+// Minimum height of a band. Also limits the number of threads.
+#define MIN_BAND_HEIGHT 64
+#define MAX_BANDS 16
+
+// Vectorized 8 bit row loops (see draw_bmp_x86.h), or NULL.
+static int (*blend_src_alpha8)(uint8_t *dst, const uint8_t *src,
+                               const uint8_t *srca, int w);
+static int (*blend_const_alpha8)(uint8_t *dst, int srcp, const uint8_t *srca,
+                                 int srcamul, int w);
+
+static pthread_once_t blend_init_once = PTHREAD_ONCE_INIT;
+
+static void blend_init(void)
+{
+    int flags = av_get_cpu_flags();
+    (void)flags;
+#if HAVE_SSE2_INTRINSICS
+    if (flags & AV_CPU_FLAG_SSE2) {
+        blend_src_alpha8 = mp_blend_src_alpha8_sse2;
+        blend_const_alpha8 = mp_blend_const_alpha8_sse2;
+    }
+#endif
+#if HAVE_AVX2_INTRINSICS
+    if (flags & AV_CPU_FLAG_AVX2) {
+        blend_src_alpha8 = mp_blend_src_alpha8_avx2;
+        blend_const_alpha8 = mp_blend_const_alpha8_avx2;
+    }
+#endif
+}
+
 
 static struct part *get_cache(struct mp_draw_sub_cache *cache,
                               struct sub_bitmaps *sbs, struct mp_image *format);
@@ -68,7 +123,7 @@ static bool get_sub_area(struct mp_rect bb, struct mp_image *temp,
 
 #define BLEND_CONST_ALPHA(TYPE)                                                 \
     TYPE *dst_r = dst_rp;                                                       \
-    for (int x = 0; x < w; x++) {                                               \
+    for (int x = x0; x < w; x++) {                                              \
         uint32_t srcap = srca_r[x];                                             \
         if (CONDITIONAL && !srcap) continue;                                    \
         srcap *= srcamul; /* now 0..65025 */                                    \
@@ -85,9 +140,12 @@ static void blend_const_alpha(void *dst, int dst_stride, int srcp,
     for (int y = 0; y < h; y++) {
         void *dst_rp = (uint8_t *)dst + dst_stride * y;
         uint8_t *srca_r = srca + srca_stride * y;
+        int x0 = 0;
         if (bytes == 2) {
             BLEND_CONST_ALPHA(uint16_t)
         } else if (bytes == 1) {
+            if (blend_const_alpha8)
+                x0 = blend_const_alpha8(dst_rp, srcp, srca_r, srcamul, w);
             BLEND_CONST_ALPHA(uint8_t)
         }
     }
@@ -95,7 +153,7 @@ static void blend_const_alpha(void *dst, int dst_stride, int srcp,
 
 #define BLEND_SRC_ALPHA(TYPE)                                                   \
     TYPE *dst_r = dst_rp, *src_r = src_rp;                                      \
-    for (int x = 0; x < w; x++) {                                               \
+    for (int x = x0; x < w; x++) {                                              \
         uint32_t srcap = srca_r[x];                                             \
         if (CONDITIONAL && !srcap) continue;                                    \
         dst_r[x] = (src_r[x] * srcap + dst_r[x] * (255 - srcap) + 127) / 255;   \
@@ -110,9 +168,12 @@ static void blend_src_alpha(void *dst, int dst_stride, void *src,
         void *dst_rp = (uint8_t *)dst + dst_stride * y;
         void *src_rp = (uint8_t *)src + src_stride * y;
         uint8_t *srca_r = srca + srca_stride * y;
+        int x0 = 0;
         if (bytes == 2) {
             BLEND_SRC_ALPHA(uint16_t)
         } else if (bytes == 1) {
+            if (blend_src_alpha8)
+                x0 = blend_src_alpha8(dst_rp, src_rp, srca_r, w);
             BLEND_SRC_ALPHA(uint8_t)
         }
     }
@@ -120,7 +181,7 @@ static void blend_src_alpha(void *dst, int dst_stride, void *src,
 
 #define BLEND_SRC_DST_MUL(TYPE, MAX)                                            \
     TYPE *dst_r = dst_rp;                                                       \
-    for (int x = 0; x < w; x++) {                                               \
+    for (int x = x0; x < w; x++) {                                              \
         uint16_t srcp = src_r[x] * srcmul; /* now 0..65025 */                   \
         dst_r[x] = (srcp * (MAX) + dst_r[x] * (65025 - srcp) + 32512) / 65025;  \
     }
@@ -133,9 +194,13 @@ static void blend_src_dst_mul(void *dst, int dst_stride,
     for (int y = 0; y < h; y++) {
         void *dst_rp = (uint8_t *)dst + dst_stride * y;
         uint8_t *src_r = (uint8_t *)src + src_stride * y;
+        int x0 = 0;
         if (dst_bytes == 2) {
             BLEND_SRC_DST_MUL(uint16_t, 65025)
         } else if (dst_bytes == 1) {
+            // Same as blend_const_alpha() with srcp = 255.
+            if (blend_const_alpha8)
+                x0 = blend_const_alpha8(dst_rp, 255, src_r, srcmul, w);
             BLEND_SRC_DST_MUL(uint8_t, 255)
         }
     }
@@ -202,9 +267,10 @@ static void scale_sb_rgba(struct sub_bitmap *sb, struct mp_image *dst_format,
     *out_sba = sba;
 }
 
-static void draw_rgba(struct mp_draw_sub_cache *cache, struct mp_rect bb,
-                      struct mp_image *temp, int bits,
-                      struct sub_bitmaps *sbs)
+// Scale all sub-bitmaps that intersect with the region, and cache them.
+static struct part *prepare_rgba(struct mp_draw_sub_cache *cache,
+                                 struct mp_rect bb, struct mp_image *temp,
+                                 struct sub_bitmaps *sbs)
 {
     struct part *part = get_cache(cache, sbs, temp);
     assert(part);
@@ -220,16 +286,39 @@ static void draw_rgba(struct mp_draw_sub_cache *cache, struct mp_rect bb,
         if (!get_sub_area(bb, temp, sb, &dst, &src_x, &src_y))
             continue;
 
-        struct mp_image *sbi = part->imgs[i].i;
-        struct mp_image *sba = part->imgs[i].a;
-
-        if (!(sbi && sba))
+        if (!(part->imgs[i].i && part->imgs[i].a)) {
+            struct mp_image *sbi = NULL, *sba = NULL;
             scale_sb_rgba(sb, temp, &sbi, &sba);
-        // on OOM, skip drawing
+            // on OOM, skip drawing
+            if (!(sbi && sba))
+                continue;
+            part->imgs[i].i = talloc_steal(part, sbi);
+            part->imgs[i].a = talloc_steal(part, sba);
+        }
+    }
+
+    return part;
+}
+
+static void draw_rgba(struct blend_job *job)
+{
+    struct mp_image *temp = &job->temp;
+    struct sub_bitmaps *sbs = job->sbs;
+
+    for (int i = 0; i < sbs->num_parts; ++i) {
+        struct sub_bitmap *sb = &sbs->parts[i];
+
+        struct mp_image *sbi = job->part->imgs[i].i;
+        struct mp_image *sba = job->part->imgs[i].a;
         if (!(sbi && sba))
             continue;
 
-        int bytes = (bits + 7) / 8;
+        struct mp_image dst;
+        int src_x, src_y;
+        if (!get_sub_area(job->bb, temp, sb, &dst, &src_x, &src_y))
+            continue;
+
+        int bytes = (job->bits + 7) / 8;
         uint8_t *alpha_p = sba->planes[0] + src_y * sba->stride[0] + src_x;
         for (int p = 0; p < (temp->num_planes > 2 ? 3 : 1); p++) {
             void *src = sbi->planes[p] + src_y * sbi->stride[p] + src_x * bytes;
@@ -240,34 +329,39 @@ static void draw_rgba(struct mp_draw_sub_cache *cache, struct mp_rect bb,
             blend_src_dst_mul(dst.planes[3], dst.stride[3], alpha_p,
                               sba->stride[0], 255, dst.w, dst.h, bytes);
         }
-
-        part->imgs[i].i = talloc_steal(part, sbi);
-        part->imgs[i].a = talloc_steal(part, sba);
     }
 }
 
-static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
-                     struct mp_image *temp, int bits, struct sub_bitmaps *sbs)
+static void prepare_ass(struct blend_job *job)
 {
+    struct mp_image *temp = &job->temp;
+
     struct mp_csp_params cspar = MP_CSP_PARAMS_DEFAULTS;
     mp_csp_set_image_params(&cspar, &temp->params);
     cspar.levels_out = MP_CSP_LEVELS_PC; // RGB (libass.color)
-    cspar.input_bits = bits;
-    cspar.texture_bits = (bits + 7) / 8 * 8;
+    cspar.input_bits = job->bits;
+    cspar.texture_bits = (job->bits + 7) / 8 * 8;
+    job->texture_bits = cspar.texture_bits;
 
-    struct mp_cmat yuv2rgb, rgb2yuv;
-    bool need_conv = temp->fmt.flags & MP_IMGFLAG_YUV;
-    if (need_conv) {
+    job->need_conv = temp->fmt.flags & MP_IMGFLAG_YUV;
+    if (job->need_conv) {
+        struct mp_cmat yuv2rgb;
         mp_get_csp_matrix(&cspar, &yuv2rgb);
-        mp_invert_cmat(&rgb2yuv, &yuv2rgb);
+        mp_invert_cmat(&job->rgb2yuv, &yuv2rgb);
     }
+}
+
+static void draw_ass(struct blend_job *job)
+{
+    struct mp_image *temp = &job->temp;
+    struct sub_bitmaps *sbs = job->sbs;
 
     for (int i = 0; i < sbs->num_parts; ++i) {
         struct sub_bitmap *sb = &sbs->parts[i];
 
         struct mp_image dst;
         int src_x, src_y;
-        if (!get_sub_area(bb, temp, sb, &dst, &src_x, &src_y))
+        if (!get_sub_area(job->bb, temp, sb, &dst, &src_x, &src_y))
             continue;
 
         int r = (sb->libass.color >> 24) & 0xFF;
@@ -275,16 +369,17 @@ static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
         int b = (sb->libass.color >> 8) & 0xFF;
         int a = 255 - (sb->libass.color & 0xFF);
         int color_yuv[3];
-        if (need_conv) {
+        if (job->need_conv) {
             int rgb[3] = {r, g, b};
-            mp_map_fixp_color(&rgb2yuv, 8, rgb, cspar.texture_bits, color_yuv);
+            mp_map_fixp_color(&job->rgb2yuv, 8, rgb, job->texture_bits,
+                              color_yuv);
         } else {
             color_yuv[0] = g;
             color_yuv[1] = b;
             color_yuv[2] = r;
         }
 
-        int bytes = (bits + 7) / 8;
+        int bytes = (job->bits + 7) / 8;
         uint8_t *alpha_p = (uint8_t *)sb->bitmap + src_y * sb->stride + src_x;
         for (int p = 0; p < (temp->num_planes > 2 ? 3 : 1); p++) {
             blend_const_alpha(dst.planes[p], dst.stride[p], color_yuv[p],
@@ -297,6 +392,78 @@ static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
     }
 }
 
+static void blend_band(void *p)
+{
+    struct blend_job *job = p;
+
+    if (job->part) {
+        draw_rgba(job);
+    } else {
+        draw_ass(job);
+    }
+
+    if (job->lock) {
+        pthread_mutex_lock(job->lock);
+        *job->pending -= 1;
+        pthread_cond_broadcast(job->wakeup);
+        pthread_mutex_unlock(job->lock);
+    }
+}
+
+// Blend all sub-bitmaps onto the region. Large regions are split into
+// horizontal bands, which are blended on a thread pool. Each band blends the
+// sub-bitmaps in the usual order, so overlapping sub-bitmaps are fine.
+static void blend_region(struct mp_draw_sub_cache *cache, bool threaded,
+                         struct blend_job *job)
+{
+    int h = job->temp.h;
+    int num = 1;
+    if (threaded && job->temp.w * h >= MIN_THREADED_PIXELS)
+        num = MPMIN(MPMIN(av_cpu_count(), MAX_BANDS), h / MIN_BAND_HEIGHT);
+
+    if (num > 1 && (!cache->pool || cache->pool_threads != num - 1)) {
+        talloc_free(cache->pool);
+        cache->pool_threads = num - 1;
+        cache->pool = mp_thread_pool_create(cache, cache->pool_threads);
+    }
+
+    if (num < 2 || !cache->pool) {
+        blend_band(job);
+        return;
+    }
+
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t wakeup = PTHREAD_COND_INITIALIZER;
+    int pending = num;
+    struct blend_job jobs[MAX_BANDS];
+
+    for (int n = 0; n < num; n++) {
+        int y0 = h * n / num;
+        int y1 = h * (n + 1) / num;
+        jobs[n] = *job;
+        jobs[n].lock = &lock;
+        jobs[n].wakeup = &wakeup;
+        jobs[n].pending = &pending;
+        // The temp image is never subsampled, so any row can start a band.
+        mp_image_crop(&jobs[n].temp, 0, y0, job->temp.w, y1);
+        jobs[n].bb.y0 += y0;
+        jobs[n].bb.y1 = jobs[n].bb.y0 + (y1 - y0);
+    }
+
+    // The last band runs on the calling thread.
+    for (int n = 0; n < num - 1; n++)
+        mp_thread_pool_queue(cache->pool, blend_band, &jobs[n]);
+    blend_band(&jobs[num - 1]);
+
+    pthread_mutex_lock(&lock);
+    while (pending)
+        pthread_cond_wait(&wakeup, &lock);
+    pthread_mutex_unlock(&lock);
+
+    pthread_cond_destroy(&wakeup);
+    pthread_mutex_destroy(&lock);
+}
+
 static void get_swscale_alignment(const struct mp_image *img, int *out_xstep,
                                   int *out_ystep)
 {
@@ -500,6 +667,8 @@ void mp_draw_sub_bitmaps(struct mp_draw_sub_cache **cache, struct mp_image *dst,
     if (!mp_sws_supported_format(dst->imgfmt))
         return;
 
+    pthread_once(&blend_init_once, blend_init);
+
     struct mp_draw_sub_cache *cache_ = cache ? *cache : NULL;
     if (!cache_)
         cache_ = talloc_zero(NULL, struct mp_draw_sub_cache);
@@ -522,11 +691,18 @@ void mp_draw_sub_bitmaps(struct mp_draw_sub_cache **cache, struct mp_image *dst,
         if (!temp)
             continue; // on OOM, skip region
 
+        struct blend_job job = {
+            .bb = bb,
+            .temp = *temp,
+            .bits = bits,
+            .sbs = sbs,
+        };
         if (sbs->format == SUBBITMAP_RGBA) {
-            draw_rgba(cache_, bb, temp, bits, sbs);
-        } else if (sbs->format == SUBBITMAP_LIBASS) {
-            draw_ass(cache_, bb, temp, bits, sbs);
+            job.part = prepare_rgba(cache_, bb, temp, sbs);
+        } else {
+            prepare_ass(&job);
         }
+        blend_region(cache_, !!cache, &job);
 
         chroma_down(&dst_region, temp);
     }
@@ -0,0 +1,108 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "draw_bmp_x86.h"
+
+// See draw_bmp_sse2.c for the arithmetic.
+static inline __m256i blend_src_alpha16(__m256i s, __m256i d, __m256i a)
+{
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(s, a),
+            _mm256_mullo_epi16(d, _mm256_sub_epi16(_mm256_set1_epi16(255), a)));
+    t = _mm256_add_epi16(t, _mm256_set1_epi16(127));
+    t = _mm256_add_epi16(_mm256_add_epi16(t, _mm256_set1_epi16(1)),
+                         _mm256_srli_epi16(t, 8));
+    return _mm256_srli_epi16(t, 8);
+}
+
+int mp_blend_src_alpha8_avx2(uint8_t *dst, const uint8_t *src,
+                             const uint8_t *srca, int w)
+{
+    int x = 0;
+    for (; x + 32 <= w; x += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(srca + x));
+        if (_mm256_testz_si256(a, a))
+            continue;
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + x));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + x));
+        __m256i lo = blend_src_alpha16(
+            _mm256_cvtepu8_epi16(_mm256_castsi256_si128(s)),
+            _mm256_cvtepu8_epi16(_mm256_castsi256_si128(d)),
+            _mm256_cvtepu8_epi16(_mm256_castsi256_si128(a)));
+        __m256i hi = blend_src_alpha16(
+            _mm256_cvtepu8_epi16(_mm256_extracti128_si256(s, 1)),
+            _mm256_cvtepu8_epi16(_mm256_extracti128_si256(d, 1)),
+            _mm256_cvtepu8_epi16(_mm256_extracti128_si256(a, 1)));
+        // packus works per 128 bit lane; restore the pixel order.
+        __m256i r = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+        _mm256_storeu_si256((__m256i *)(dst + x), r);
+    }
+    return x;
+}
+
+static inline __m256 div65025(__m256 x)
+{
+    const __m256 m = _mm256_set1_ps(65025.0f);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 q = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(
+                    _mm256_mul_ps(x, _mm256_set1_ps(1.0f / 65025.0f))));
+    __m256 r = _mm256_sub_ps(x, _mm256_mul_ps(q, m));
+    q = _mm256_add_ps(q, _mm256_and_ps(_mm256_cmp_ps(r, m, _CMP_GE_OQ), one));
+    q = _mm256_sub_ps(q, _mm256_and_ps(
+                _mm256_cmp_ps(r, _mm256_setzero_ps(), _CMP_LT_OQ), one));
+    return q;
+}
+
+static inline __m256i blend_const_alpha32(__m128i d8, __m128i a8, __m256 srcp,
+                                          __m256 mul)
+{
+    __m256 t = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(a8)), mul);
+    __m256 df = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(d8));
+    __m256 x = _mm256_add_ps(_mm256_mul_ps(srcp, t),
+               _mm256_mul_ps(df, _mm256_sub_ps(_mm256_set1_ps(65025.0f), t)));
+    x = _mm256_add_ps(x, _mm256_set1_ps(32512.0f));
+    return _mm256_cvttps_epi32(div65025(x));
+}
+
+int mp_blend_const_alpha8_avx2(uint8_t *dst, int srcp, const uint8_t *srca,
+                               int srcamul, int w)
+{
+    const __m256 srcp_f = _mm256_set1_ps(srcp);
+    const __m256 mul_f = _mm256_set1_ps(srcamul);
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(srca + x));
+        if (_mm_testz_si128(a, a))
+            continue;
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + x));
+        __m256i lo = blend_const_alpha32(d, a, srcp_f, mul_f);
+        __m256i hi = blend_const_alpha32(_mm_srli_si128(d, 8),
+                                         _mm_srli_si128(a, 8), srcp_f, mul_f);
+        // Both packs work per 128 bit lane; restore the pixel order.
+        __m256i r16 = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+        __m256i r8 = _mm256_permute4x64_epi64(_mm256_packus_epi16(r16, r16), 0xD8);
+        _mm_storeu_si128((__m128i *)(dst + x), _mm256_castsi256_si128(r8));
+    }
+    return x;
+}
+
+#pragma GCC pop_options
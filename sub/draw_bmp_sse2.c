@@ -0,0 +1,114 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+
+#include <stdint.h>
+#include <emmintrin.h>
+
+#include "draw_bmp_x86.h"
+
+// (s * a + d * (255 - a) + 127) / 255 on 16 bit lanes. The sum is at most
+// 65152, and x / 255 == (x + 1 + (x >> 8)) >> 8 for all such x.
+static inline __m128i blend_src_alpha16(__m128i s, __m128i d, __m128i a)
+{
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(s, a),
+                    _mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(255), a)));
+    t = _mm_add_epi16(t, _mm_set1_epi16(127));
+    t = _mm_add_epi16(_mm_add_epi16(t, _mm_set1_epi16(1)), _mm_srli_epi16(t, 8));
+    return _mm_srli_epi16(t, 8);
+}
+
+int mp_blend_src_alpha8_sse2(uint8_t *dst, const uint8_t *src,
+                             const uint8_t *srca, int w)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(srca + x));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, zero)) == 0xFFFF)
+            continue;
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + x));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + x));
+        __m128i lo = blend_src_alpha16(_mm_unpacklo_epi8(s, zero),
+                                       _mm_unpacklo_epi8(d, zero),
+                                       _mm_unpacklo_epi8(a, zero));
+        __m128i hi = blend_src_alpha16(_mm_unpackhi_epi8(s, zero),
+                                       _mm_unpackhi_epi8(d, zero),
+                                       _mm_unpackhi_epi8(a, zero));
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(lo, hi));
+    }
+    return x;
+}
+
+// x / 65025 for integral x in [0, 2^24). All intermediate values are exact
+// in single precision, so the estimate is off by at most one and can be
+// corrected with the remainder.
+static inline __m128 div65025(__m128 x)
+{
+    const __m128 m = _mm_set1_ps(65025.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 q = _mm_cvtepi32_ps(_mm_cvttps_epi32(
+                    _mm_mul_ps(x, _mm_set1_ps(1.0f / 65025.0f))));
+    __m128 r = _mm_sub_ps(x, _mm_mul_ps(q, m));
+    q = _mm_add_ps(q, _mm_and_ps(_mm_cmpge_ps(r, m), one));
+    q = _mm_sub_ps(q, _mm_and_ps(_mm_cmplt_ps(r, _mm_setzero_ps()), one));
+    return q;
+}
+
+static inline __m128i blend_const_alpha32(__m128i d, __m128i a, __m128 srcp,
+                                          __m128 mul)
+{
+    __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(a), mul);
+    __m128 df = _mm_cvtepi32_ps(d);
+    __m128 x = _mm_add_ps(_mm_mul_ps(srcp, t),
+                          _mm_mul_ps(df, _mm_sub_ps(_mm_set1_ps(65025.0f), t)));
+    x = _mm_add_ps(x, _mm_set1_ps(32512.0f));
+    return _mm_cvttps_epi32(div65025(x));
+}
+
+int mp_blend_const_alpha8_sse2(uint8_t *dst, int srcp, const uint8_t *srca,
+                               int srcamul, int w)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 srcp_f = _mm_set1_ps(srcp);
+    const __m128 mul_f = _mm_set1_ps(srcamul);
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(srca + x));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, zero)) == 0xFFFF)
+            continue;
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + x));
+        __m128i a16[2] = {_mm_unpacklo_epi8(a, zero), _mm_unpackhi_epi8(a, zero)};
+        __m128i d16[2] = {_mm_unpacklo_epi8(d, zero), _mm_unpackhi_epi8(d, zero)};
+        __m128i r16[2];
+        for (int n = 0; n < 2; n++) {
+            __m128i lo = blend_const_alpha32(_mm_unpacklo_epi16(d16[n], zero),
+                                             _mm_unpacklo_epi16(a16[n], zero),
+                                             srcp_f, mul_f);
+            __m128i hi = blend_const_alpha32(_mm_unpackhi_epi16(d16[n], zero),
+                                             _mm_unpackhi_epi16(a16[n], zero),
+                                             srcp_f, mul_f);
+            r16[n] = _mm_packs_epi32(lo, hi);
+        }
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(r16[0], r16[1]));
+    }
+    return x;
+}
+
+#pragma GCC pop_options
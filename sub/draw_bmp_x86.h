@@ -0,0 +1,41 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_DRAW_BMP_X86_H_
+#define MP_DRAW_BMP_X86_H_
+
+#include <stdint.h>
+
+// Vectorized versions of the 8 bit row loops in draw_bmp.c. They produce
+// exactly the same results as the C code. Each function processes a multiple
+// of the vector width, and returns the number of pixels it processed; the
+// caller does the rest. The caller must check the CPU flags at runtime.
+
+// dst = (src * srca + dst * (255 - srca) + 127) / 255
+int mp_blend_src_alpha8_sse2(uint8_t *dst, const uint8_t *src,
+                             const uint8_t *srca, int w);
+int mp_blend_src_alpha8_avx2(uint8_t *dst, const uint8_t *src,
+                             const uint8_t *srca, int w);
+
+// With t = srca * srcamul:
+// dst = (srcp * t + dst * (65025 - t) + 32512) / 65025
+int mp_blend_const_alpha8_sse2(uint8_t *dst, int srcp, const uint8_t *srca,
+                               int srcamul, int w);
+int mp_blend_const_alpha8_avx2(uint8_t *dst, int srcp, const uint8_t *srca,
+                               int srcamul, int w);
+
+#endif
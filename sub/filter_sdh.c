@@ -36,9 +36,10 @@ struct buffer {
     int pos;
 };
 
-static void init_buf(struct buffer *buf, int length)
+static void init_buf(struct sd *sd, struct buffer *buf, char **mem, int length)
 {
-    buf->string = talloc_size(NULL, length);
+    MP_TARRAY_GROW(sd, *mem, length);
+    buf->string = *mem;
     buf->pos = 0;
     buf->length = length;
 }
@@ -321,27 +322,35 @@ static void remove_leading_hyphen_space(struct sd *sd, int start_pos, struct buf
 // Filter ASS formatted string for SDH
 //
 // Parameters:
+//     bufs         buffers reused between calls
 //     format       format line from ASS configuration
 //     n_ignored    number of comma to skip as preprocessing have removed them
 //     data         ASS line. null terminated string if length == 0
 //     length       length of ASS input if not null terminated, 0 otherwise
 //
-// Returns  a talloc allocated string with filtered ASS data (may be the same
-// content as original if no SDH was found) which must be released
-// by caller using talloc_free.
+// Returns a string with filtered ASS data (may be the same content as
+// original if no SDH was found). It is either data itself, or points into
+// bufs, and is valid until the next call.
 //
 // Returns NULL if filtering resulted in all of ASS data being removed so no
 // subtitle should be output
-char *filter_SDH(struct sd *sd, char *format, int n_ignored, char *data, int length)
+char *filter_SDH(struct sd *sd, struct sdh_buffers *bufs, char *format,
+                 int n_ignored, char *data, int length)
 {
+    // need null terminated string
+    char *ass = data;
+    if (length) {
+        MP_TARRAY_GROW(sd, bufs->in, length);
+        memcpy(bufs->in, data, length);
+        bufs->in[length] = '\0';
+        ass = bufs->in;
+    }
+
     if (!format) {
         MP_VERBOSE(sd, "SDH filtering not possible - format missing\n");
-        return length ? talloc_strndup(NULL, data, length) : talloc_strdup(NULL, data);
+        return ass;
     }
 
-    // need null terminated string
-    char *ass = length ? talloc_strndup(NULL, data, length) : data;
-
     int comma = 0;
     // scan format line to find the number of the field where the text is
     for (char *c = format; *c; c++) {
@@ -357,7 +366,7 @@ char *filter_SDH(struct sd *sd, char *format, int n_ignored, char *data, int len
     struct buffer writebuf;
     struct buffer *buf = &writebuf;
 
-    init_buf(buf, strlen(ass) + 1); // with room for terminating '\0'
+    init_buf(sd, buf, &bufs->out, strlen(ass) + 1); // with room for '\0'
 
     char *rp = ass;
 
@@ -371,9 +380,8 @@ char *filter_SDH(struct sd *sd, char *format, int n_ignored, char *data, int len
         }
     }
     if (!*rp) {
-        talloc_free(buf->string);
         MP_VERBOSE(sd, "SDH filtering not possible - cannot find text field\n");
-        return length ? ass : talloc_strdup(NULL, ass);
+        return ass;
     }
 
     bool contains_text = false;  // true if non SDH text was found
@@ -439,15 +447,12 @@ char *filter_SDH(struct sd *sd, char *format, int n_ignored, char *data, int len
     } else {
         contains_text = true;
     }
-    if (length)
-        talloc_free(ass);
     if (contains_text) {
         // the ASS data contained normal text after filtering
         append(sd, buf, '\0'); // '\0' terminate
         return buf->string;
     } else {
         // all data removed by filtering
-        talloc_free(buf->string);
         return NULL;
     }
 }
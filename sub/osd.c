@@ -116,6 +116,7 @@ struct osd_state *osd_create(struct mpv_global *global)
     assert(MAX_OSD_PARTS >= OSDTYPE_COUNT);
 
     struct osd_state *osd = talloc_zero(NULL, struct osd_state);
+    ta_set_account(osd, MP_MEM_OSD);
     *osd = (struct osd_state) {
         .opts = global->opts,
         .global = global,
@@ -211,6 +212,15 @@ void osd_set_progbar(struct osd_state *osd, struct osd_progbar_state *s)
 {
     pthread_mutex_lock(&osd->lock);
     struct osd_object *osd_obj = osd->objs[OSDTYPE_OSD];
+    struct osd_progbar_state *cur = &osd_obj->progbar_state;
+    if (cur->type == s->type && cur->value == s->value &&
+        cur->num_stops == s->num_stops && (!s->num_stops ||
+        memcmp(cur->stops, s->stops, sizeof(s->stops[0]) * s->num_stops) == 0))
+    {
+        // Nothing to re-render.
+        pthread_mutex_unlock(&osd->lock);
+        return;
+    }
     osd_obj->progbar_state.type = s->type;
     osd_obj->progbar_state.value = s->value;
     osd_obj->progbar_state.num_stops = s->num_stops;
@@ -74,6 +74,19 @@ struct sub_bitmaps {
     int packed_w, packed_h;
 
     int change_id;  // Incremented on each change
+
+    // Incremental updates of the packed image. packed_id identifies the
+    // current contents of the packed image (0 if unknown). If packed_base is
+    // not 0, the contents are equal to those with packed_id==packed_base,
+    // except for the packed_dirty[] rectangles. (The packed pointer can be
+    // different, but the positions of existing data are preserved.) If the
+    // VO doesn't have the packed_base contents, it must upload everything.
+    // If change_id changed, but packed_id is the same, only the positions of
+    // the parts changed.
+    uint64_t packed_id;
+    uint64_t packed_base;
+    struct mp_rect *packed_dirty;
+    int num_packed_dirty;
 };
 
 struct mp_osd_res {
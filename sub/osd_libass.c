@@ -37,20 +37,14 @@ static const char osd_font_pfb[] =
 
 #include "sub/ass_mp.h"
 #include "options/options.h"
+#include "osdep/threads.h"
 
 
 #define ASS_USE_OSD_FONT "{\\fnmpv-osd-symbols}"
 
-void osd_init_backend(struct osd_state *osd)
+static void init_ass_renderer(struct osd_state *osd, struct ass_state *ass,
+                              char *font)
 {
-}
-
-static void create_ass_renderer(struct osd_state *osd, struct ass_state *ass)
-{
-    if (ass->render)
-        return;
-
-    ass->log = mp_log_new(NULL, osd->log, "libass");
     ass->library = mp_ass_init(osd->global, ass->log);
     ass_add_font(ass->library, "mpv-osd-symbols", (void *)osd_font_pfb,
                  sizeof(osd_font_pfb) - 1);
@@ -59,11 +53,59 @@ static void create_ass_renderer(struct osd_state *osd, struct ass_state *ass)
     if (!ass->render)
         abort();
 
-    mp_ass_configure_fonts(ass->render, osd->opts->osd_style,
-                           osd->global, ass->log);
+    struct osd_style_opts style = {.font = font};
+    mp_ass_configure_fonts(ass->render, &style, osd->global, ass->log);
     ass_set_aspect_ratio(ass->render, 1.0, 1.0);
 }
 
+// Loading the fonts (fontconfig in particular) can take seconds with a cold
+// font cache, so do it while the player is starting up anyway. Only this
+// thread touches preinit_ass until it is joined.
+static void *preinit_thread(void *arg)
+{
+    struct osd_state *osd = arg;
+    mpthread_set_name("osd/fonts");
+    init_ass_renderer(osd, &osd->preinit_ass, osd->preinit_font);
+    return NULL;
+}
+
+void osd_init_backend(struct osd_state *osd)
+{
+    // The thread must not access the options, which can change concurrently.
+    osd->preinit_font = talloc_strdup(osd, osd->opts->osd_style->font);
+    osd->preinit_ass.log = mp_log_new(NULL, osd->log, "libass");
+    osd->preinit_running =
+        !pthread_create(&osd->preinit_thread, NULL, preinit_thread, osd);
+}
+
+static void join_preinit(struct osd_state *osd)
+{
+    if (osd->preinit_running)
+        pthread_join(osd->preinit_thread, NULL);
+    osd->preinit_running = false;
+}
+
+static void create_ass_renderer(struct osd_state *osd, struct ass_state *ass)
+{
+    if (ass->render)
+        return;
+
+    join_preinit(osd);
+    if (osd->preinit_ass.render) {
+        *ass = osd->preinit_ass;
+        osd->preinit_ass = (struct ass_state){0};
+        // Cheap now that the font caches are loaded.
+        struct osd_style_opts *style = osd->opts->osd_style;
+        if (!bstr_equals0(bstr0(osd->preinit_font), style->font)) {
+            mp_ass_configure_fonts(ass->render, style, osd->global, ass->log);
+        }
+        return;
+    }
+
+    ass->log = mp_log_new(NULL, osd->log, "libass");
+    init_ass_renderer(osd, ass, osd->opts->osd_style->font);
+}
+
 static void destroy_ass_renderer(struct ass_state *ass)
 {
     if (ass->track)
@@ -87,6 +129,8 @@ static void destroy_external(struct osd_external *ext)
 
 void osd_destroy_backend(struct osd_state *osd)
 {
+    join_preinit(osd);
+    destroy_ass_renderer(&osd->preinit_ass);
     for (int n = 0; n < MAX_OSD_PARTS; n++) {
         struct osd_object *obj = osd->objs[n];
         destroy_ass_renderer(&obj->ass);
@@ -222,6 +266,29 @@ static void mangle_ass(bstr *dst, const char *in)
     }
 }
 
+// Event texts of the OSDTYPE_OSD object that usually stay the same over many
+// updates (e.g. the time text changes while the bar is shown, or vice versa).
+struct osd_ass_cache {
+    // Mangled OSD text
+    char *text;
+    char *mangled;
+
+    // Static parts of the progress bar
+    float px, py, width, height, border;
+    int type;
+    float *stops;
+    int num_stops;
+    char *bar_sym;
+    char *bar_box;
+};
+
+static struct osd_ass_cache *get_ass_cache(struct osd_object *obj)
+{
+    if (!obj->ass_cache)
+        obj->ass_cache = talloc_zero(obj, struct osd_ass_cache);
+    return obj->ass_cache;
+}
+
 static ASS_Event *add_osd_ass_event_escaped(ASS_Track *track, const char *style,
                                             const char *text)
 {
@@ -258,7 +325,17 @@ static void update_osd_text(struct osd_state *osd, struct osd_object *obj)
         return;
 
     prepare_osd_ass(osd, obj);
-    add_osd_ass_event_escaped(obj->ass.track, "OSD", obj->text);
+
+    struct osd_ass_cache *c = get_ass_cache(obj);
+    if (!c->text || strcmp(c->text, obj->text) != 0) {
+        talloc_free(c->text);
+        c->text = talloc_strdup(c, obj->text);
+        bstr buf = {0};
+        mangle_ass(&buf, obj->text);
+        talloc_free(c->mangled);
+        c->mangled = talloc_steal(c, buf.start);
+    }
+    add_osd_ass_event(obj->ass.track, "OSD", c->mangled);
 }
 
 void osd_get_text_size(struct osd_state *osd, int *out_screen_h, int *out_font_h)
@@ -382,16 +459,10 @@ static void get_osd_bar_box(struct osd_state *osd, struct osd_object *obj,
     *o_y = get_align(opts->osd_bar_align_y, track->PlayResY, *o_h, *o_border);
 }
 
-static void update_progbar(struct osd_state *osd, struct osd_object *obj)
+// The symbol in front of the bar.
+static char *get_progbar_sym(struct osd_object *obj, float px, float py,
+                             float border, float height)
 {
-    if (obj->progbar_state.type < 0)
-        return;
-
-    float px, py, width, height, border;
-    get_osd_bar_box(osd, obj, &px, &py, &width, &height, &border);
-
-    ASS_Track *track = obj->ass.track;
-
     float sx = px - border * 2 - height / 4; // includes additional spacing
     float sy = py + height / 2;
 
@@ -407,29 +478,14 @@ static void update_progbar(struct osd_state *osd, struct osd_object *obj)
         bstr_xappend(NULL, &buf, bstr0("{\\r}"));
     }
 
-    add_osd_ass_event(track, "progbar", buf.start);
-    talloc_free(buf.start);
+    return buf.start;
+}
 
+// The box and the chapter marks.
+static char *get_progbar_box(struct osd_object *obj, float px, float py,
+                             float width, float height, float border)
+{
     struct ass_draw *d = &(struct ass_draw) { .scale = 4 };
-    // filled area
-    d->text = talloc_asprintf_append(d->text, "{\\bord0\\pos(%f,%f)}", px, py);
-    ass_draw_start(d);
-    float pos = obj->progbar_state.value * width - border / 2;
-    ass_draw_rect_cw(d, 0, 0, pos, height);
-    ass_draw_stop(d);
-    add_osd_ass_event(track, "progbar", d->text);
-    ass_draw_reset(d);
-
-    // position marker
-    d->text = talloc_asprintf_append(d->text, "{\\bord%f\\pos(%f,%f)}",
-                                     border / 2, px, py);
-    ass_draw_start(d);
-    ass_draw_move_to(d, pos + border / 2, 0);
-    ass_draw_line_to(d, pos + border / 2, height);
-    ass_draw_stop(d);
-    add_osd_ass_event(track, "progbar", d->text);
-    ass_draw_reset(d);
-
     d->text = talloc_asprintf_append(d->text, "{\\pos(%f,%f)}", px, py);
     ass_draw_start(d);
 
@@ -455,9 +511,67 @@ static void update_progbar(struct osd_state *osd, struct osd_object *obj)
         }
     }
 
+    ass_draw_stop(d);
+    return d->text;
+}
+
+static void update_progbar(struct osd_state *osd, struct osd_object *obj)
+{
+    if (obj->progbar_state.type < 0)
+        return;
+
+    float px, py, width, height, border;
+    get_osd_bar_box(osd, obj, &px, &py, &width, &height, &border);
+
+    ASS_Track *track = obj->ass.track;
+
+    struct osd_ass_cache *c = get_ass_cache(obj);
+    struct osd_progbar_state *s = &obj->progbar_state;
+    if (!c->bar_sym || c->px != px || c->py != py || c->width != width ||
+        c->height != height || c->border != border || c->type != s->type ||
+        c->num_stops != s->num_stops || (s->num_stops &&
+        memcmp(c->stops, s->stops, sizeof(s->stops[0]) * s->num_stops) != 0))
+    {
+        c->px = px;
+        c->py = py;
+        c->width = width;
+        c->height = height;
+        c->border = border;
+        c->type = s->type;
+        c->num_stops = s->num_stops;
+        MP_TARRAY_GROW(c, c->stops, s->num_stops);
+        memcpy(c->stops, s->stops, sizeof(s->stops[0]) * s->num_stops);
+        talloc_free(c->bar_sym);
+        talloc_free(c->bar_box);
+        c->bar_sym = talloc_steal(c, get_progbar_sym(obj, px, py, border, height));
+        c->bar_box = talloc_steal(c, get_progbar_box(obj, px, py, width, height,
+                                                     border));
+    }
+
+    add_osd_ass_event(track, "progbar", c->bar_sym);
+
+    // Only the fill position changes with the value.
+    struct ass_draw *d = &(struct ass_draw) { .scale = 4 };
+    // filled area
+    d->text = talloc_asprintf_append(d->text, "{\\bord0\\pos(%f,%f)}", px, py);
+    ass_draw_start(d);
+    float pos = obj->progbar_state.value * width - border / 2;
+    ass_draw_rect_cw(d, 0, 0, pos, height);
     ass_draw_stop(d);
     add_osd_ass_event(track, "progbar", d->text);
     ass_draw_reset(d);
+
+    // position marker
+    d->text = talloc_asprintf_append(d->text, "{\\bord%f\\pos(%f,%f)}",
+                                     border / 2, px, py);
+    ass_draw_start(d);
+    ass_draw_move_to(d, pos + border / 2, 0);
+    ass_draw_line_to(d, pos + border / 2, height);
+    ass_draw_stop(d);
+    add_osd_ass_event(track, "progbar", d->text);
+    ass_draw_reset(d);
+
+    add_osd_ass_event(track, "progbar", c->bar_box);
 }
 
 static void update_osd(struct osd_state *osd, struct osd_object *obj)
@@ -580,7 +694,7 @@ void osd_object_get_bitmaps(struct osd_state *osd, struct osd_object *obj,
     }
 
     mp_ass_packer_pack(obj->ass_packer, obj->ass_imgs, obj->num_externals + 1,
-                       obj->changed, format, out_imgs);
+                       obj->changed ? 2 : 0, format, out_imgs);
 
     obj->changed = false;
 }
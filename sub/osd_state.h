@@ -53,6 +53,7 @@ struct osd_object {
     struct ass_state ass;
     struct mp_ass_packer *ass_packer;
     struct ass_image **ass_imgs;
+    struct osd_ass_cache *ass_cache;
 };
 
 struct osd_external {
@@ -78,6 +79,13 @@ struct osd_state {
     struct mp_log *log;
 
     struct mp_draw_sub_cache *draw_cache;
+
+    // Internally used by osd_libass.c: a renderer set up in the background
+    // at init, which is handed to the first OSD object that needs one.
+    pthread_t preinit_thread;
+    bool preinit_running;
+    struct ass_state preinit_ass;
+    char *preinit_font;
 };
 
 // defined in osd_libass.c and osd_dummy.c
@@ -50,6 +50,13 @@ char **lavc_conv_decode(struct lavc_conv *priv, struct demux_packet *packet);
 void lavc_conv_reset(struct lavc_conv *priv);
 void lavc_conv_uninit(struct lavc_conv *priv);
 
-char *filter_SDH(struct sd *sd, char *format, int n_ignored, char *data, int length);
+// Buffers reused by filter_SDH() across calls. Start zero-initialized; they
+// are allocated as talloc children of the sd.
+struct sdh_buffers {
+    char *in, *out;
+};
+
+char *filter_SDH(struct sd *sd, struct sdh_buffers *bufs, char *format,
+                 int n_ignored, char *data, int length);
 
 #endif
@@ -20,6 +20,7 @@
 #include <string.h>
 #include <math.h>
 #include <limits.h>
+#include <pthread.h>
 
 #include <libavutil/common.h>
 #include <ass/ass.h>
@@ -30,12 +31,44 @@
 #include "common/common.h"
 #include "common/msg.h"
 #include "demux/demux.h"
+#include "osdep/threads.h"
 #include "video/csputils.h"
 #include "video/mp_image.h"
 #include "dec_sub.h"
 #include "ass_mp.h"
 #include "sd.h"
 
+// Number of pre-rendered frames kept around (for --sub-ass-prerender).
+#define MAX_FRAMES 8
+// Number of frames rendered ahead of the last timestamp hint.
+#define PRERENDER_AHEAD 2
+// Maximum number of timestamps a frame with unchanged contents is reused for.
+#define MAX_FRAME_TS 16
+
+// A pre-rendered frame. Owns its packed bitmaps, so it stays valid across
+// further ass_render_frame() calls.
+struct ass_frame {
+    long long *ts;      // libass timestamps this frame was rendered for
+    int num_ts;
+    struct mp_osd_res dim;
+    int format;
+    struct mp_ass_packer *packer;
+    struct sub_bitmaps subs;
+};
+
+// Range of packet file positions. All packets of the stream in this range
+// were seen.
+struct seen_range {
+    int64_t start, end;
+};
+
+// A font attachment, which is given to libass only once it is referenced.
+struct embedded_font {
+    struct demux_attachment *f;
+    char **names;               // names libass would match it with
+    bool added;
+};
+
 struct sd_ass_priv {
     struct ass_library *ass_library;
     struct ass_renderer *ass_renderer;
@@ -50,9 +83,32 @@ struct sd_ass_priv {
     struct mp_image_params video_params;
     struct mp_image_params last_params;
     double sub_speed, video_fps, frame_fps;
-    int64_t *seen_packets;
+    struct seen_range *seen_packets; // sorted, non-overlapping
     int num_seen_packets;
+    int64_t last_seen_pos; // position of the previous packet, or -1
     bool duration_unknown;
+    struct sdh_buffers sdh;
+    struct embedded_font *fonts;
+    int num_fonts;
+    bool fonts_changed; // fonts were added after the renderer was set up
+
+    // Protects everything accessed by the pre-render thread (renderer, tracks,
+    // frames). Taken after the dec_sub lock.
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    pthread_t prerender_thread;
+    bool prerender_running;
+    bool prerender_exit;
+    // Set if get_bitmaps() returns pre-rendered frames.
+    bool prerender_active;
+    struct mp_osd_res prerender_dim;
+    int prerender_format;
+    double prerender_pts, prerender_step;
+    int prerender_next;
+    struct ass_frame **frames; // oldest first
+    int num_frames;
+    struct ass_frame *cur_frame;    // last returned by get_bitmaps()
+    struct ass_frame *last_frame;   // last rendered by libass
 };
 
 static void mangle_colors(struct sd *sd, struct sub_bitmaps *parts);
@@ -114,6 +170,10 @@ static bool attachment_is_font(struct mp_log *log, struct demux_attachment *f)
     return false;
 }
 
+// Loading all fonts with libass is slow with many attachments, and libass
+// keeps a copy of each. So only the names are read here, and fonts are added
+// when a style or \fn tag references them. Fonts whose names can't be read
+// are added right away.
 static void add_subtitle_fonts(struct sd *sd)
 {
     struct sd_ass_priv *ctx = sd->priv;
@@ -122,25 +182,121 @@ static void add_subtitle_fonts(struct sd *sd)
         return;
     for (int i = 0; i < sd->attachments->num_entries; i++) {
         struct demux_attachment *f = &sd->attachments->entries[i];
-        if (attachment_is_font(sd->log, f))
+        if (!attachment_is_font(sd->log, f))
+            continue;
+        char **names = mp_ass_font_names(ctx, f->data, f->data_size);
+        if (!names) {
             ass_add_font(ctx->ass_library, f->name, f->data, f->data_size);
+            continue;
+        }
+        MP_TARRAY_APPEND(ctx, ctx->fonts, ctx->num_fonts,
+                         (struct embedded_font){ .f = f, .names = names });
     }
 }
 
-static void enable_output(struct sd *sd, bool enable)
+static void use_font(struct sd *sd, struct bstr family)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    family = bstr_strip(family);
+    bstr_eatstart0(&family, "@"); // vertical variant
+    for (int i = 0; i < ctx->num_fonts; i++) {
+        struct embedded_font *font = &ctx->fonts[i];
+        for (int n = 0; !font->added && font->names[n]; n++) {
+            if (bstrcasecmp0(family, font->names[n]) == 0) {
+                MP_VERBOSE(sd, "Loading font attachment '%s' for '%.*s'.\n",
+                           font->f->name, BSTR_P(family));
+                ass_add_font(ctx->ass_library, font->f->name, font->f->data,
+                             font->f->data_size);
+                font->added = true;
+                ctx->fonts_changed = !!ctx->ass_renderer;
+            }
+        }
+    }
+}
+
+static void use_track_fonts(struct sd *sd, ASS_Track *track)
+{
+    for (int n = 0; n < track->n_styles; n++)
+        use_font(sd, bstr0(track->styles[n].FontName));
+}
+
+// Find \fn override tags in event text.
+static void use_text_fonts(struct sd *sd, struct bstr text)
 {
     struct sd_ass_priv *ctx = sd->priv;
-    if (enable == !!ctx->ass_renderer)
+    if (!ctx->num_fonts)
         return;
-    if (ctx->ass_renderer) {
-        ass_renderer_done(ctx->ass_renderer);
-        ctx->ass_renderer = NULL;
-    } else {
-        ctx->ass_renderer = ass_renderer_init(ctx->ass_library);
+    int pos;
+    while ((pos = bstr_find0(text, "\\fn")) >= 0) {
+        text = bstr_cut(text, pos + 3);
+        use_font(sd, bstr_splice(text, 0, bstrcspn(text, "\\}")));
+    }
+}
+
+static void free_frame(struct sd_ass_priv *ctx, struct ass_frame *f)
+{
+    if (ctx->last_frame == f)
+        ctx->last_frame = NULL;
+    if (ctx->cur_frame == f)
+        ctx->cur_frame = NULL;
+    talloc_free(f);
+}
 
-        mp_ass_configure_fonts(ctx->ass_renderer, sd->opts->sub_style,
-                               sd->global, sd->log);
+static void remove_frame(struct sd_ass_priv *ctx, int index)
+{
+    struct ass_frame *f = ctx->frames[index];
+    MP_TARRAY_REMOVE_AT(ctx->frames, ctx->num_frames, index);
+    free_frame(ctx, f);
+}
+
+// Drop all pre-rendered frames which contain anything in the given time range
+// (in ms). The frame currently in use by the caller of get_bitmaps() is only
+// unlisted, as its bitmaps must remain valid until the next call.
+static void invalidate_frames(struct sd *sd, long long start, long long end)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    for (int n = ctx->num_frames - 1; n >= 0; n--) {
+        struct ass_frame *f = ctx->frames[n];
+        bool hit = false;
+        for (int i = 0; i < f->num_ts; i++)
+            hit |= f->ts[i] >= start && f->ts[i] <= end;
+        if (!hit)
+            continue;
+        if (f == ctx->cur_frame) {
+            f->num_ts = 0;
+            if (ctx->last_frame == f)
+                ctx->last_frame = NULL;
+        } else {
+            remove_frame(ctx, n);
+        }
     }
+    ctx->prerender_next = 0;
+    pthread_cond_signal(&ctx->wakeup);
+}
+
+static void flush_frames(struct sd *sd)
+{
+    invalidate_frames(sd, LLONG_MIN, LLONG_MAX);
+}
+
+static void enable_output(struct sd *sd, bool enable)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    pthread_mutex_lock(&ctx->lock);
+    if (enable != !!ctx->ass_renderer) {
+        if (ctx->ass_renderer) {
+            ass_renderer_done(ctx->ass_renderer);
+            ctx->ass_renderer = NULL;
+        } else {
+            ctx->ass_renderer = ass_renderer_init(ctx->ass_library);
+
+            mp_ass_configure_fonts(ctx->ass_renderer, sd->opts->sub_style,
+                                   sd->global, sd->log);
+            ctx->fonts_changed = false;
+        }
+        flush_frames(sd);
+    }
+    pthread_mutex_unlock(&ctx->lock);
 }
 
 static void update_subtitle_speed(struct sd *sd)
@@ -167,6 +323,11 @@ static int init(struct sd *sd)
     struct sd_ass_priv *ctx = talloc_zero(sd, struct sd_ass_priv);
     sd->priv = ctx;
 
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_cond_init(&ctx->wakeup, NULL);
+    ctx->prerender_pts = MP_NOPTS_VALUE;
+    ctx->last_seen_pos = -1;
+
     char *extradata = sd->codec->extradata;
     int extradata_size = sd->codec->extradata_size;
 
@@ -204,6 +365,9 @@ static int init(struct sd *sd)
 
     mp_ass_add_default_styles(ctx->ass_track, opts);
 
+    use_track_fonts(sd, ctx->shadow_track);
+    use_track_fonts(sd, ctx->ass_track);
+
 #if LIBASS_VERSION >= 0x01302000
     ass_set_check_readorder(ctx->ass_track, sd->opts->sub_clear_on_seek ? 0 : 1);
 #endif
@@ -221,29 +385,51 @@ static int init(struct sd *sd)
 // Test if the packet with the given file position (used as unique ID) was
 // already consumed. Return false if the packet is new (and add it to the
 // internal list), and return true if it was already seen.
+// Packets are read in file order, so if a packet directly follows the last
+// packet of a range, it can extend that range (the same for two ranges which
+// are read across). This keeps the list short even on huge files.
 static bool check_packet_seen(struct sd *sd, int64_t pos)
 {
     struct sd_ass_priv *priv = sd->priv;
+    struct seen_range *r = priv->seen_packets;
+    int64_t prev = priv->last_seen_pos;
+    priv->last_seen_pos = pos;
+
+    // Find the first range that starts after pos.
     int a = 0;
     int b = priv->num_seen_packets;
     while (a < b) {
         int mid = a + (b - a) / 2;
-        int64_t val = priv->seen_packets[mid];
-        if (pos == val)
-            return true;
-        if (pos > val) {
+        if (pos >= r[mid].start) {
             a = mid + 1;
         } else {
             b = mid;
         }
     }
-    MP_TARRAY_INSERT_AT(priv, priv->seen_packets, priv->num_seen_packets, a, pos);
+
+    if (a > 0 && pos <= r[a - 1].end) {
+        // Read from the end of the previous range into this one.
+        if (a > 1 && prev >= 0 && prev == r[a - 2].end &&
+            pos == r[a - 1].start)
+        {
+            r[a - 2].end = r[a - 1].end;
+            MP_TARRAY_REMOVE_AT(r, priv->num_seen_packets, a - 1);
+        }
+        return true;
+    }
+
+    if (a > 0 && prev >= 0 && prev == r[a - 1].end) {
+        r[a - 1].end = pos;
+    } else {
+        MP_TARRAY_INSERT_AT(priv, priv->seen_packets, priv->num_seen_packets,
+                            a, (struct seen_range){pos, pos});
+    }
     return false;
 }
 
 #define UNKNOWN_DURATION (INT_MAX / 1000)
 
-static void decode(struct sd *sd, struct demux_packet *packet)
+static void decode_packet(struct sd *sd, struct demux_packet *packet)
 {
     struct sd_ass_priv *ctx = sd->priv;
     ASS_Track *track = ctx->ass_track;
@@ -261,12 +447,14 @@ static void decode(struct sd *sd, struct demux_packet *packet)
         char **r = lavc_conv_decode(ctx->converter, packet);
         for (int n = 0; r && r[n]; n++) {
             char *ass_line = r[n];
-            if (sd->opts->sub_filter_SDH)
-                ass_line = filter_SDH(sd, track->event_format, 0, ass_line, 0);
-            if (ass_line)
+            if (sd->opts->sub_filter_SDH) {
+                ass_line = filter_SDH(sd, &ctx->sdh, track->event_format, 0,
+                                      ass_line, 0);
+            }
+            if (ass_line) {
+                use_text_fonts(sd, bstr0(ass_line));
                 ass_process_data(track, ass_line, strlen(ass_line));
-            if (sd->opts->sub_filter_SDH)
-                talloc_free(ass_line);
+            }
         }
         if (ctx->duration_unknown) {
             for (int n = 0; n < track->n_events - 1; n++) {
@@ -282,18 +470,35 @@ static void decode(struct sd *sd, struct demux_packet *packet)
         char *ass_line = packet->buffer;
         int ass_len = packet->len;
         if (sd->opts->sub_filter_SDH) {
-            ass_line = filter_SDH(sd, track->event_format, 1, ass_line, ass_len);
+            ass_line = filter_SDH(sd, &ctx->sdh, track->event_format, 1,
+                                  ass_line, ass_len);
             ass_len = ass_line ? strlen(ass_line) : 0;
         }
-        if (ass_line)
+        if (ass_line) {
+            use_text_fonts(sd, (struct bstr){ass_line, ass_len});
             ass_process_chunk(track, ass_line, ass_len,
                               llrint(packet->pts * 1000),
                               llrint(packet->duration * 1000));
-        if (sd->opts->sub_filter_SDH)
-            talloc_free(ass_line);
+        }
     }
 }
 
+static void decode(struct sd *sd, struct demux_packet *packet)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    pthread_mutex_lock(&ctx->lock);
+    decode_packet(sd, packet);
+    if (ctx->num_frames) {
+        if (packet->pts == MP_NOPTS_VALUE || packet->duration < 0) {
+            flush_frames(sd);
+        } else {
+            invalidate_frames(sd, llrint(packet->pts * 1000),
+                    llrint((packet->pts + packet->duration) * 1000));
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+}
+
 static void configure_ass(struct sd *sd, struct mp_osd_res *dim,
                           bool converted, ASS_Track *track)
 {
@@ -444,19 +649,20 @@ static long long find_timestamp(struct sd *sd, double pts)
 
 #undef END
 
-static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
-                        double pts, struct sub_bitmaps *res)
+static void setup_renderer(struct sd *sd, struct mp_osd_res dim,
+                           bool converted, ASS_Track *track)
 {
     struct sd_ass_priv *ctx = sd->priv;
     struct MPOpts *opts = sd->opts;
-    bool no_ass = !opts->ass_enabled || ctx->on_top ||
-                  opts->ass_style_override == 5;
-    bool converted = ctx->is_converted || no_ass;
-    ASS_Track *track = no_ass ? ctx->shadow_track : ctx->ass_track;
     ASS_Renderer *renderer = ctx->ass_renderer;
 
-    if (pts == MP_NOPTS_VALUE || !renderer)
-        return;
+    if (ctx->fonts_changed) {
+        // Newer libass picks up fonts added with ass_add_font() by itself.
+#if LIBASS_VERSION < 0x01500000
+        mp_ass_configure_fonts(renderer, opts->sub_style, sd->global, sd->log);
+#endif
+        ctx->fonts_changed = false;
+    }
 
     double scale = dim.display_par;
     if (!converted && (!opts->ass_style_override ||
@@ -476,6 +682,159 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
     } else {
         ass_set_storage_size(renderer, 0, 0);
     }
+}
+
+static struct ass_frame *find_frame(struct sd *sd, long long ts,
+                                    struct mp_osd_res dim, int format)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    for (int n = 0; n < ctx->num_frames; n++) {
+        struct ass_frame *f = ctx->frames[n];
+        if (f->format != format || !osd_res_equals(f->dim, dim))
+            continue;
+        for (int i = 0; i < f->num_ts; i++) {
+            if (f->ts[i] == ts)
+                return f;
+        }
+    }
+    return NULL;
+}
+
+// Render the normal track at ts into a new or existing cached frame.
+static struct ass_frame *render_frame(struct sd *sd, long long ts,
+                                      struct mp_osd_res dim, int format)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    ASS_Track *track = ctx->ass_track;
+
+    setup_renderer(sd, dim, ctx->is_converted, track);
+
+    int changed;
+    ASS_Image *imgs = ass_render_frame(ctx->ass_renderer, track, ts, &changed);
+
+    // libass compares against the previous ass_render_frame() call. If nothing
+    // changed, share the bitmaps of that frame.
+    struct ass_frame *f = ctx->last_frame;
+    if (changed || !f || f->format != format || !osd_res_equals(f->dim, dim)) {
+        f = talloc_zero(ctx, struct ass_frame);
+        f->dim = dim;
+        f->format = format;
+        f->packer = mp_ass_packer_alloc(f);
+        mp_ass_packer_pack(f->packer, &imgs, 1, 2, format, &f->subs);
+        if (!ctx->is_converted && f->subs.num_parts > 0)
+            mangle_colors(sd, &f->subs);
+
+        // Evict the oldest frames, but never the one in use.
+        for (int n = 0; ctx->num_frames >= MAX_FRAMES && n < ctx->num_frames;) {
+            if (ctx->frames[n] == ctx->cur_frame) {
+                n++;
+            } else {
+                remove_frame(ctx, n);
+            }
+        }
+        MP_TARRAY_APPEND(ctx, ctx->frames, ctx->num_frames, f);
+    }
+    if (f->num_ts >= MAX_FRAME_TS)
+        MP_TARRAY_REMOVE_AT(f->ts, f->num_ts, 0);
+    MP_TARRAY_APPEND(f, f->ts, f->num_ts, ts);
+    ctx->last_frame = f;
+    return f;
+}
+
+static void *prerender_thread(void *arg)
+{
+    struct sd *sd = arg;
+    struct sd_ass_priv *ctx = sd->priv;
+
+    mpthread_set_name("sub/prerender");
+
+    pthread_mutex_lock(&ctx->lock);
+    while (!ctx->prerender_exit) {
+        bool work = ctx->prerender_active && ctx->ass_renderer &&
+                    ctx->prerender_pts != MP_NOPTS_VALUE &&
+                    ctx->prerender_next < PRERENDER_AHEAD &&
+                    (ctx->prerender_next == 0 || ctx->prerender_step > 0);
+        if (!work) {
+            pthread_cond_wait(&ctx->wakeup, &ctx->lock);
+            continue;
+        }
+        double pts = ctx->prerender_pts +
+                     ctx->prerender_next * ctx->prerender_step;
+        ctx->prerender_next++;
+        long long ts = find_timestamp(sd, pts);
+        if (!find_frame(sd, ts, ctx->prerender_dim, ctx->prerender_format))
+            render_frame(sd, ts, ctx->prerender_dim, ctx->prerender_format);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+static void get_prerendered(struct sd *sd, struct mp_osd_res dim, int format,
+                            double pts, struct sub_bitmaps *res)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+
+    if (!ctx->prerender_running) {
+        ctx->prerender_exit = false;
+        if (pthread_create(&ctx->prerender_thread, NULL, prerender_thread, sd))
+            return;
+        ctx->prerender_running = true;
+    }
+
+    if (!ctx->prerender_active || ctx->prerender_format != format ||
+        !osd_res_equals(ctx->prerender_dim, dim))
+    {
+        ctx->prerender_active = true;
+        ctx->prerender_dim = dim;
+        ctx->prerender_format = format;
+        ctx->prerender_next = 0;
+        pthread_cond_signal(&ctx->wakeup);
+    }
+
+    long long ts = find_timestamp(sd, pts);
+    struct ass_frame *f = find_frame(sd, ts, dim, format);
+    if (!f)
+        f = render_frame(sd, ts, dim, format);
+
+    *res = f->subs;
+    res->change_id = f != ctx->cur_frame;
+    ctx->cur_frame = f;
+}
+
+static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
+                        double pts, struct sub_bitmaps *res)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    struct MPOpts *opts = sd->opts;
+    bool no_ass = !opts->ass_enabled || ctx->on_top ||
+                  opts->ass_style_override == 5;
+    bool converted = ctx->is_converted || no_ass;
+    ASS_Track *track = no_ass ? ctx->shadow_track : ctx->ass_track;
+    ASS_Renderer *renderer = ctx->ass_renderer;
+
+    if (pts == MP_NOPTS_VALUE || !renderer)
+        return;
+
+    pthread_mutex_lock(&ctx->lock);
+
+    if (opts->ass_prerender && !no_ass && !ctx->duration_unknown) {
+        get_prerendered(sd, dim, format, pts, res);
+        if (ctx->prerender_running) {
+            pthread_mutex_unlock(&ctx->lock);
+            return;
+        }
+    }
+    // Switching back from pre-rendered frames: the packer's cached state is
+    // stale.
+    bool force_changed = ctx->prerender_active;
+    if (ctx->prerender_active) {
+        ctx->prerender_active = false;
+        ctx->cur_frame = NULL;
+        flush_frames(sd);
+    }
+    ctx->last_frame = NULL;
+
+    setup_renderer(sd, dim, converted, track);
     long long ts = find_timestamp(sd, pts);
     if (ctx->duration_unknown && pts != MP_NOPTS_VALUE) {
         mp_ass_flush_old_events(track, ts);
@@ -488,7 +847,8 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
 
     int changed;
     ASS_Image *imgs = ass_render_frame(renderer, track, ts, &changed);
-    mp_ass_packer_pack(ctx->packer, &imgs, 1, changed, format, res);
+    mp_ass_packer_pack(ctx->packer, &imgs, 1, force_changed ? 2 : changed,
+                       format, res);
 
     if (!converted && res->num_parts > 0) {
         // mangle_colors() modifies the color field, so copy the thing.
@@ -498,6 +858,8 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
 
         mangle_colors(sd, res);
     }
+
+    pthread_mutex_unlock(&ctx->lock);
 }
 
 struct buf {
@@ -606,6 +968,15 @@ static char *get_text(struct sd *sd, double pts)
     return ctx->last_text;
 }
 
+static char *get_text_locked(struct sd *sd, double pts)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    pthread_mutex_lock(&ctx->lock);
+    char *text = get_text(sd, pts);
+    pthread_mutex_unlock(&ctx->lock);
+    return text;
+}
+
 static void fill_plaintext(struct sd *sd, double pts)
 {
     struct sd_ass_priv *ctx = sd->priv;
@@ -648,25 +1019,56 @@ static void fill_plaintext(struct sd *sd, double pts)
 static void reset(struct sd *sd)
 {
     struct sd_ass_priv *ctx = sd->priv;
+    pthread_mutex_lock(&ctx->lock);
     if (sd->opts->sub_clear_on_seek || ctx->duration_unknown) {
         ass_flush_events(ctx->ass_track);
         ctx->num_seen_packets = 0;
         sd->preload_ok = false;
+        flush_frames(sd);
     }
+    ctx->last_seen_pos = -1;
     if (ctx->converter)
         lavc_conv_reset(ctx->converter);
+    ctx->prerender_pts = MP_NOPTS_VALUE;
+    pthread_mutex_unlock(&ctx->lock);
 }
 
 static void uninit(struct sd *sd)
 {
     struct sd_ass_priv *ctx = sd->priv;
 
+    if (ctx->prerender_running) {
+        pthread_mutex_lock(&ctx->lock);
+        ctx->prerender_exit = true;
+        pthread_cond_signal(&ctx->wakeup);
+        pthread_mutex_unlock(&ctx->lock);
+        pthread_join(ctx->prerender_thread, NULL);
+    }
+
     if (ctx->converter)
         lavc_conv_uninit(ctx->converter);
     ass_free_track(ctx->ass_track);
     ass_free_track(ctx->shadow_track);
     enable_output(sd, false);
     ass_library_done(ctx->ass_library);
+    pthread_cond_destroy(&ctx->wakeup);
+    pthread_mutex_destroy(&ctx->lock);
+}
+
+static void set_prerender_hint(struct sd *sd, double pts)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    double last = ctx->prerender_pts;
+    if (last != MP_NOPTS_VALUE) {
+        // Hints for the currently displayed frame come in between.
+        if (pts <= last && pts > last - 1.0)
+            return;
+        double step = pts - last;
+        ctx->prerender_step = step > 0 && step < 1.0 ? step : 0;
+    }
+    ctx->prerender_pts = pts;
+    ctx->prerender_next = 0;
+    pthread_cond_signal(&ctx->wakeup);
 }
 
 static int control(struct sd *sd, enum sd_ctrl cmd, void *arg)
@@ -682,32 +1084,53 @@ static int control(struct sd *sd, enum sd_ctrl cmd, void *arg)
         a[0] = res / (1000.0 / ctx->sub_speed);
         return true;
     }
-    case SD_CTRL_SET_VIDEO_PARAMS:
-        ctx->video_params = *(struct mp_image_params *)arg;
+    case SD_CTRL_SET_VIDEO_PARAMS: {
+        struct mp_image_params *p = arg;
+        if (!mp_image_params_equal(&ctx->video_params, p))
+            flush_frames(sd);
+        ctx->video_params = *p;
         return CONTROL_OK;
+    }
     case SD_CTRL_SET_TOP:
+        if (ctx->on_top != *(bool *)arg)
+            flush_frames(sd);
         ctx->on_top = *(bool *)arg;
         return CONTROL_OK;
     case SD_CTRL_SET_VIDEO_DEF_FPS:
         ctx->video_fps = *(double *)arg;
         update_subtitle_speed(sd);
+        flush_frames(sd);
         return CONTROL_OK;
     case SD_CTRL_UPDATE_SPEED:
+        // Also sent on all other subtitle option changes.
         update_subtitle_speed(sd);
+        flush_frames(sd);
+        return CONTROL_OK;
+    case SD_CTRL_PRERENDER:
+        set_prerender_hint(sd, *(double *)arg);
         return CONTROL_OK;
     default:
         return CONTROL_UNKNOWN;
     }
 }
 
+static int control_locked(struct sd *sd, enum sd_ctrl cmd, void *arg)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    pthread_mutex_lock(&ctx->lock);
+    int r = control(sd, cmd, arg);
+    pthread_mutex_unlock(&ctx->lock);
+    return r;
+}
+
 const struct sd_functions sd_ass = {
     .name = "ass",
     .accept_packets_in_advance = true,
     .init = init,
     .decode = decode,
     .get_bitmaps = get_bitmaps,
-    .get_text = get_text,
-    .control = control,
+    .get_text = get_text_locked,
+    .control = control_locked,
     .reset = reset,
     .select = enable_output,
     .uninit = uninit,
@@ -57,11 +57,21 @@ struct seekpoint {
     double endpts;
 };
 
+// Parameters outbitmaps were last positioned for.
+struct out_params {
+    int64_t id;
+    struct mp_osd_res dim;
+    int w, h;
+    double video_par;
+};
+
 struct sd_lavc_priv {
     AVCodecContext *avctx;
     AVRational pkt_timebase;
     struct sub subs[MAX_QUEUE]; // most recent event first
     struct sub_bitmap *outbitmaps;
+    struct out_params out_params;
+    bool out_valid;
     int64_t displayed_id;
     int64_t new_id;
     struct mp_image_params video_params;
@@ -406,20 +416,6 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res d, int format,
     if (!current)
         return;
 
-    MP_TARRAY_GROW(priv, priv->outbitmaps, current->count);
-    for (int n = 0; n < current->count; n++)
-        priv->outbitmaps[n] = current->inbitmaps[n];
-
-    res->parts = priv->outbitmaps;
-    res->num_parts = current->count;
-    if (priv->displayed_id != current->id)
-        res->change_id++;
-    priv->displayed_id = current->id;
-    res->packed = current->data;
-    res->packed_w = current->bound_w;
-    res->packed_h = current->bound_h;
-    res->format = SUBBITMAP_RGBA;
-
     double video_par = 0;
     if (priv->avctx->codec_id == AV_CODEC_ID_DVD_SUBTITLE &&
         opts->stretch_dvd_subs)
@@ -443,7 +439,35 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res d, int format,
         w = priv->video_params.w;
         h = priv->video_params.h;
     }
+
+    res->parts = priv->outbitmaps;
+    res->num_parts = current->count;
+    if (priv->displayed_id != current->id)
+        res->change_id++;
+    priv->displayed_id = current->id;
+    res->packed = current->data;
+    res->packed_w = current->bound_w;
+    res->packed_h = current->bound_h;
+    res->format = SUBBITMAP_RGBA;
+
+    // The event data is converted and packed once on decoding; only its
+    // placement depends on the output size. Scaling itself is done by the
+    // consumer (on the GPU with vo_gpu).
+    struct out_params p = {current->id, d, w, h, video_par};
+    if (priv->out_valid && p.id == priv->out_params.id &&
+        osd_res_equals(p.dim, priv->out_params.dim) &&
+        p.w == priv->out_params.w && p.h == priv->out_params.h &&
+        p.video_par == priv->out_params.video_par)
+        return;
+
+    MP_TARRAY_GROW(priv, priv->outbitmaps, current->count);
+    for (int n = 0; n < current->count; n++)
+        priv->outbitmaps[n] = current->inbitmaps[n];
+    res->parts = priv->outbitmaps;
+
     osd_rescale_bitmaps(res, w, h, d, video_par);
+    priv->out_params = p;
+    priv->out_valid = true;
 }
 
 static bool accepts_packet(struct sd *sd, double min_pts)
@@ -484,6 +508,7 @@ static void reset(struct sd *sd)
 
     for (int n = 0; n < MAX_QUEUE; n++)
         clear_sub(&priv->subs[n]);
+    priv->out_valid = false;
     // lavc might not do this right for all codecs; may need close+reopen
     avcodec_flush_buffers(priv->avctx);
 
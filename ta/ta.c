@@ -21,6 +21,14 @@
 #define TA_NO_WRAPPERS
 #include "ta.h"
 
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && \
+    !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define TA_ATOMICS 1
+#else
+#include <pthread.h>
+#endif
+
 // Note: the actual minimum alignment is dictated by malloc(). It doesn't
 //       make sense to set this value higher than malloc's alignment.
 #define MIN_ALIGN 16
@@ -57,18 +65,98 @@ union aligned_header {
 #define PTR_TO_HEADER(ptr) (&((union aligned_header *)(ptr) - 1)->ta)
 #define PTR_FROM_HEADER(h) ((void *)((union aligned_header *)(h) + 1))
 
-#define MAX_ALLOC (((size_t)-1) - sizeof(union aligned_header))
+// Set in ta_header.size if the allocation was carved from an arena (see
+// ta_make_arena()). Such allocations are preceded by an arena_prefix.
+#define ARENA_BIT ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
+// The memory account (see ta_set_account()) is stored in the bits below it.
+#define ACCOUNT_BITS 3
+#define ACCOUNT_SHIFT (sizeof(size_t) * 8 - 1 - ACCOUNT_BITS)
+#define ACCOUNT_MASK ((((size_t)1 << ACCOUNT_BITS) - 1) << ACCOUNT_SHIFT)
+#define HEADER_ACCOUNT(h) ((int)(((h)->size & ACCOUNT_MASK) >> ACCOUNT_SHIFT))
+#define HEADER_FLAGS(h) ((h)->size & (ARENA_BIT | ACCOUNT_MASK))
+#define HEADER_SIZE(h) ((h)->size & ~(ARENA_BIT | ACCOUNT_MASK))
+
+#define MAX_ALLOC (((size_t)1 << ACCOUNT_SHIFT) - 1 - sizeof(union aligned_header))
 
 // Needed for non-leaf allocations, or extended features such as destructors.
 struct ta_ext_header {
     struct ta_header *header;  // points back to normal header
     struct ta_header children; // list of children, with this as sentinel
     void (*destructor)(void *);
+    struct ta_arena *arena;    // set by ta_make_arena()
 };
 
 // ta_ext_header.children.size is set to this
 #define CHILDREN_SENTINEL ((size_t)-1)
 
+// Arena blocks start with this size, and double up to the max. size.
+#define ARENA_BLOCK_MIN (4 * 1024)
+#define ARENA_BLOCK_MAX (64 * 1024)
+// Larger allocations are always done with malloc().
+#define ARENA_MAX_ALLOC 1024
+
+struct ta_arena {
+    // Number of carved allocations not freed yet, plus 1 while the arena
+    // allocation itself exists. The blocks are freed when this reaches 0.
+    size_t refs;
+    char *cur, *end;            // unused space in the current block
+    union arena_prefix *last;   // most recent allocation (in current block)
+    union arena_block *blocks;  // list of all blocks, newest first
+    size_t block_size;          // size of the next block
+};
+
+union arena_block {
+    union arena_block *next;
+    char align_min[MIN_ALIGN];
+};
+
+union arena_prefix {
+    struct ta_arena *arena;
+    char align_min[MIN_ALIGN];
+};
+
+#define ARENA_PREFIX(h) ((union arena_prefix *)(h) - 1)
+#define ARENA_ALIGN(s) (((s) + MIN_ALIGN - 1) & ~(size_t)(MIN_ALIGN - 1))
+#define ARENA_ALLOC_SIZE(s) \
+    (sizeof(union arena_prefix) + sizeof(union aligned_header) + ARENA_ALIGN(s))
+
+#ifdef TA_ATOMICS
+typedef atomic_llong account_counter;
+#define COUNTER_ADD(c, v) atomic_fetch_add_explicit(&(c), (v), memory_order_relaxed)
+#define COUNTER_GET(c) atomic_load_explicit(&(c), memory_order_relaxed)
+#else
+typedef long long account_counter;
+static pthread_mutex_t account_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define COUNTER_ADD(c, v) do {              \
+    pthread_mutex_lock(&account_mutex);     \
+    (c) += (v);                             \
+    pthread_mutex_unlock(&account_mutex);   \
+} while (0)
+#define COUNTER_GET(c) (c)
+#endif
+
+// Padded to avoid false sharing between accounts updated by different threads.
+union ta_account_counters {
+    struct {
+        account_counter bytes;
+        account_counter blocks;
+        account_counter external;
+    } c;
+    char pad[64];
+};
+
+static union ta_account_counters accounts[TA_NUM_ACCOUNTS];
+
+// Account used for allocations without parent.
+static __thread int thread_account;
+
+static void account_add(int account, long long bytes, long long blocks)
+{
+    COUNTER_ADD(accounts[account].c.bytes, bytes);
+    COUNTER_ADD(accounts[account].c.blocks, blocks);
+}
+
 static void ta_dbg_add(struct ta_header *h);
 static void ta_dbg_check_header(struct ta_header *h);
 static void ta_dbg_remove(struct ta_header *h);
@@ -103,6 +191,94 @@ static struct ta_ext_header *get_or_alloc_ext_header(void *ptr)
     return h->ext;
 }
 
+// Return the arena new children of h should be carved from, or NULL.
+static struct ta_arena *get_arena(struct ta_header *h)
+{
+    if (!h)
+        return NULL;
+    if (h->ext && h->ext->arena)
+        return h->ext->arena;
+    if (h->size & ARENA_BIT)
+        return ARENA_PREFIX(h)->arena;
+    return NULL;
+}
+
+static void arena_unref(struct ta_arena *arena)
+{
+    assert(arena->refs > 0);
+    arena->refs--;
+    if (arena->refs)
+        return;
+    while (arena->blocks) {
+        union arena_block *next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+    free(arena);
+}
+
+// Return uninitialized memory for a header and size bytes of user data.
+static struct ta_header *arena_alloc(struct ta_arena *arena, size_t size)
+{
+    size_t need = ARENA_ALLOC_SIZE(size);
+    if (arena->end - arena->cur < need) {
+        size_t block_size = arena->block_size;
+        arena->block_size = block_size * 2 > ARENA_BLOCK_MAX
+                          ? ARENA_BLOCK_MAX : block_size * 2;
+        union arena_block *block = malloc(sizeof(*block) + block_size);
+        if (!block)
+            return NULL;
+        block->next = arena->blocks;
+        arena->blocks = block;
+        arena->cur = (char *)(block + 1);
+        arena->end = arena->cur + block_size;
+        arena->last = NULL;
+    }
+    union arena_prefix *prefix = (union arena_prefix *)arena->cur;
+    prefix->arena = arena;
+    arena->last = prefix;
+    arena->cur += need;
+    arena->refs++;
+    return (struct ta_header *)(prefix + 1);
+}
+
+// Free the memory of a carved allocation. The last allocation in a block is
+// actually returned to the arena, others only when the arena is destroyed.
+static void arena_free(struct ta_header *h)
+{
+    union arena_prefix *prefix = ARENA_PREFIX(h);
+    struct ta_arena *arena = prefix->arena;
+    if (arena->last == prefix) {
+        arena->cur = (char *)prefix;
+        arena->last = NULL;
+    }
+    arena_unref(arena);
+}
+
+// Allocate header and user data, with parent as future parent allocation.
+static struct ta_header *alloc_header(struct ta_header *parent, size_t size,
+                                      bool zero)
+{
+    struct ta_arena *arena = get_arena(parent);
+    struct ta_header *h;
+    if (arena && size <= ARENA_MAX_ALLOC) {
+        h = arena_alloc(arena, size);
+        if (h && zero)
+            memset(PTR_FROM_HEADER(h), 0, size);
+        size |= ARENA_BIT;
+    } else if (zero) {
+        h = calloc(1, sizeof(union aligned_header) + size);
+    } else {
+        h = malloc(sizeof(union aligned_header) + size);
+    }
+    if (!h)
+        return NULL;
+    int account = parent ? HEADER_ACCOUNT(parent) : thread_account;
+    *h = (struct ta_header) {.size = size | ((size_t)account << ACCOUNT_SHIFT)};
+    account_add(account, HEADER_SIZE(h), 1);
+    return h;
+}
+
 /* Set the parent allocation of ptr. If parent==NULL, remove the parent.
  * Setting parent==NULL (with ptr!=NULL) always succeeds, and unsets the
  * parent of ptr. Operations ptr==NULL always succeed and do nothing.
@@ -146,10 +322,9 @@ void *ta_alloc_size(void *ta_parent, size_t size)
 {
     if (size >= MAX_ALLOC)
         return NULL;
-    struct ta_header *h = malloc(sizeof(union aligned_header) + size);
+    struct ta_header *h = alloc_header(get_header(ta_parent), size, false);
     if (!h)
         return NULL;
-    *h = (struct ta_header) {.size = size};
     ta_dbg_add(h);
     void *ptr = PTR_FROM_HEADER(h);
     if (!ta_set_parent(ptr, ta_parent)) {
@@ -166,10 +341,9 @@ void *ta_zalloc_size(void *ta_parent, size_t size)
 {
     if (size >= MAX_ALLOC)
         return NULL;
-    struct ta_header *h = calloc(1, sizeof(union aligned_header) + size);
+    struct ta_header *h = alloc_header(get_header(ta_parent), size, true);
     if (!h)
         return NULL;
-    *h = (struct ta_header) {.size = size};
     ta_dbg_add(h);
     void *ptr = PTR_FROM_HEADER(h);
     if (!ta_set_parent(ptr, ta_parent)) {
@@ -203,14 +377,56 @@ void *ta_realloc_size(void *ta_parent, void *ptr, size_t size)
         return ta_alloc_size(ta_parent, size);
     struct ta_header *h = get_header(ptr);
     struct ta_header *old_h = h;
-    if (h->size == size)
+    if (HEADER_SIZE(h) == size)
         return ptr;
-    ta_dbg_remove(h);
-    h = realloc(h, sizeof(union aligned_header) + size);
-    ta_dbg_add(h ? h : old_h);
-    if (!h)
-        return NULL;
-    h->size = size;
+    int account = HEADER_ACCOUNT(h);
+    size_t account_bits = h->size & ACCOUNT_MASK;
+    long long delta = (long long)size - (long long)HEADER_SIZE(h);
+    if (h->size & ARENA_BIT) {
+        union arena_prefix *prefix = ARENA_PREFIX(h);
+        struct ta_arena *arena = prefix->arena;
+        size_t old_size = HEADER_SIZE(h);
+        // Shrink, or grow the most recent allocation in place.
+        if (size <= old_size) {
+            if (arena->last == prefix)
+                arena->cur = (char *)prefix + ARENA_ALLOC_SIZE(size);
+            h->size = size | ARENA_BIT | account_bits;
+            account_add(account, delta, 0);
+            return ptr;
+        }
+        if (arena->last == prefix && size <= ARENA_MAX_ALLOC &&
+            ARENA_ALLOC_SIZE(size) <= arena->end - (char *)prefix)
+        {
+            arena->cur = (char *)prefix + ARENA_ALLOC_SIZE(size);
+            h->size = size | ARENA_BIT | account_bits;
+            account_add(account, delta, 0);
+            return ptr;
+        }
+        // Move it, either to a new place in the arena, or to malloc memory.
+        // Keep a reference, so the arena can't go away while copying.
+        arena->refs++;
+        h = size <= ARENA_MAX_ALLOC ? arena_alloc(arena, size)
+                                    : malloc(sizeof(union aligned_header) + size);
+        if (!h) {
+            arena_unref(arena);
+            return NULL;
+        }
+        ta_dbg_remove(old_h);
+        *h = *old_h;
+        memcpy(PTR_FROM_HEADER(h), ptr, old_size);
+        arena_free(old_h);
+        arena_unref(arena);
+        ta_dbg_add(h);
+        h->size = size | (size <= ARENA_MAX_ALLOC ? ARENA_BIT : 0) | account_bits;
+    } else {
+        ta_dbg_remove(h);
+        h = realloc(h, sizeof(union aligned_header) + size);
+        ta_dbg_add(h ? h : old_h);
+        if (!h)
+            return NULL;
+        h->size = size | account_bits;
+    }
+    account_add(account, delta, 0);
     if (h != old_h) {
         if (h->next) {
             // Relink siblings
@@ -234,7 +450,7 @@ void *ta_realloc_size(void *ta_parent, void *ptr, size_t size)
 size_t ta_get_size(void *ptr)
 {
     struct ta_header *h = get_header(ptr);
-    return h ? h->size : 0;
+    return h ? HEADER_SIZE(h) : 0;
 }
 
 /* Free all allocations that (recursively) have ptr as parent allocation, but
@@ -266,8 +482,15 @@ void ta_free(void *ptr)
         h->prev->next = h->next;
     }
     ta_dbg_remove(h);
+    account_add(HEADER_ACCOUNT(h), -(long long)HEADER_SIZE(h), -1);
+    if (h->ext && h->ext->arena)
+        arena_unref(h->ext->arena);
     free(h->ext);
-    free(h);
+    if (h->size & ARENA_BIT) {
+        arena_free(h);
+    } else {
+        free(h);
+    }
 }
 
 /* Set a destructor that is to be called when the given allocation is freed.
@@ -291,6 +514,96 @@ bool ta_set_destructor(void *ptr, void (*destructor)(void *))
     return true;
 }
 
+/* Make ptr an arena: allocations that have ptr as parent, or whose parent is
+ * such an allocation (recursively), are carved from larger memory blocks
+ * owned by ptr, instead of being allocated with malloc() each. Large
+ * allocations are excluded. Apart from that, these allocations behave as
+ * usual, but their memory is reclaimed only when all allocations in the
+ * arena (including ptr) have been freed. It's meant for trees that are built
+ * and freed as a whole, such as temporary data structures, with a small cost
+ * at allocation time.
+ *
+ * Allocations can be moved out of the arena with ta_set_parent() (they keep
+ * the memory blocks alive), but all allocations carved from an arena must be
+ * used by a single thread at a time, even after being moved to a different
+ * parent.
+ *
+ * Existing children of ptr are not affected. Calling it again on the same ptr
+ * does nothing.
+ * Returns false if ptr==NULL, or on OOM.
+ */
+bool ta_make_arena(void *ptr)
+{
+    struct ta_ext_header *eh = get_or_alloc_ext_header(ptr);
+    if (!eh)
+        return false;
+    if (eh->arena)
+        return true;
+    eh->arena = malloc(sizeof(struct ta_arena));
+    if (!eh->arena)
+        return false;
+    *eh->arena = (struct ta_arena) {
+        .refs = 1,
+        .block_size = ARENA_BLOCK_MIN,
+    };
+    return true;
+}
+
+/* Set the memory account of ptr. Allocations made with ptr as parent later
+ * inherit the account (recursively), so it's typically set on the root
+ * context of a subsystem right after allocating it. Existing children are
+ * not affected, and moving allocations to a different parent does not change
+ * their account.
+ *
+ * account must be in the range [0, TA_NUM_ACCOUNTS). Account 0 is used for
+ * allocations that were never assigned to an account.
+ * Calling it on ptr==NULL does nothing.
+ */
+void ta_set_account(void *ptr, int account)
+{
+    struct ta_header *h = get_header(ptr);
+    if (!h || HEADER_ACCOUNT(h) == account)
+        return;
+    assert(account >= 0 && account < TA_NUM_ACCOUNTS);
+    account_add(HEADER_ACCOUNT(h), -(long long)HEADER_SIZE(h), -1);
+    h->size = (h->size & ~ACCOUNT_MASK) | ((size_t)account << ACCOUNT_SHIFT);
+    account_add(account, HEADER_SIZE(h), 1);
+}
+
+/* Set the account of allocations without parent made by the calling thread.
+ * Returns the previous value, which the caller can restore when done.
+ */
+int ta_set_thread_account(int account)
+{
+    assert(account >= 0 && account < TA_NUM_ACCOUNTS);
+    int prev = thread_account;
+    thread_account = account;
+    return prev;
+}
+
+/* Add bytes (can be negative) to the account, for memory that is allocated
+ * outside of ta, but should be reported with it.
+ */
+void ta_account_add_external(int account, long long bytes)
+{
+    assert(account >= 0 && account < TA_NUM_ACCOUNTS);
+    COUNTER_ADD(accounts[account].c.external, bytes);
+}
+
+/* Return the current totals of the account. The values are read without
+ * synchronization, so they are only approximately consistent with each other.
+ */
+struct ta_account_stats ta_get_account_stats(int account)
+{
+    assert(account >= 0 && account < TA_NUM_ACCOUNTS);
+    union ta_account_counters *c = &accounts[account];
+    return (struct ta_account_stats){
+        .bytes = COUNTER_GET(c->c.bytes),
+        .blocks = COUNTER_GET(c->c.blocks),
+        .external = COUNTER_GET(c->c.external),
+    };
+}
+
 /* Return the ptr's parent allocation, or NULL if there isn't any.
  *
  * Warning: this has O(N) runtime complexity with N sibling allocations!
@@ -354,7 +667,7 @@ static size_t get_children_size(struct ta_header *h)
     if (h->ext) {
         struct ta_header *s;
         for (s = h->ext->children.next; s != &h->ext->children; s = s->next)
-            size += s->size + get_children_size(s);
+            size += HEADER_SIZE(s) + get_children_size(s);
     }
     return size;
 }
@@ -378,16 +691,16 @@ static void print_leak_report(void)
                     snprintf(name, sizeof(name), "%s", cur->name);
                 if (cur->name == &allocation_is_string) {
                     snprintf(name, sizeof(name), "'%.*s'",
-                             (int)cur->size, (char *)PTR_FROM_HEADER(cur));
+                             (int)HEADER_SIZE(cur), (char *)PTR_FROM_HEADER(cur));
                 }
                 for (int n = 0; n < sizeof(name); n++) {
                     if (name[n] && name[n] < 0x20)
                         name[n] = '.';
                 }
                 fprintf(stderr, "  %-20p %10zu %10zu  %s\n",
-                        cur, cur->size, c_size, name);
+                        cur, HEADER_SIZE(cur), c_size, name);
             }
-            size += cur->size;
+            size += HEADER_SIZE(cur);
             num_blocks += 1;
             // Unlink, and don't confuse valgrind by leaving live pointers.
             cur->leak_next->leak_prev = cur->leak_prev;
@@ -52,8 +52,23 @@ void ta_free(void *ptr);
 void ta_free_children(void *ptr);
 bool ta_set_destructor(void *ptr, void (*destructor)(void *));
 bool ta_set_parent(void *ptr, void *ta_parent);
+bool ta_make_arena(void *ptr);
 void *ta_find_parent(void *ptr);
 
+// Memory accounting
+#define TA_NUM_ACCOUNTS 8
+
+struct ta_account_stats {
+    long long bytes;        // sum of the sizes of live ta allocations
+    long long blocks;       // number of live ta allocations
+    long long external;     // see ta_account_add_external()
+};
+
+void ta_set_account(void *ptr, int account);
+int ta_set_thread_account(int account);
+void ta_account_add_external(int account, long long bytes);
+struct ta_account_stats ta_get_account_stats(int account);
+
 // Utility functions
 size_t ta_calc_array_size(size_t element_size, size_t count);
 size_t ta_calc_prealloc_elems(size_t nextidx);
@@ -108,6 +123,7 @@ bool ta_vasprintf_append_buffer(char **str, const char *fmt, va_list ap) TA_PRF(
 #define ta_xzalloc_size(...)            ta_oom_p(ta_zalloc_size(__VA_ARGS__))
 #define ta_xset_destructor(...)         ta_oom_b(ta_set_destructor(__VA_ARGS__))
 #define ta_xset_parent(...)             ta_oom_b(ta_set_parent(__VA_ARGS__))
+#define ta_xmake_arena(...)             ta_oom_b(ta_make_arena(__VA_ARGS__))
 #define ta_xnew_context(...)            ta_oom_p(ta_new_context(__VA_ARGS__))
 #define ta_xstrdup_append(...)          ta_oom_b(ta_strdup_append(__VA_ARGS__))
 #define ta_xstrdup_append_buffer(...)   ta_oom_b(ta_strdup_append_buffer(__VA_ARGS__))
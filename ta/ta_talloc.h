@@ -38,6 +38,7 @@
 #define talloc_realloc_size             ta_xrealloc_size
 #define talloc_new                      ta_xnew_context
 #define talloc_set_destructor           ta_xset_destructor
+#define talloc_make_arena               ta_xmake_arena
 #define talloc_parent                   ta_find_parent
 #define talloc_enable_leak_report       ta_enable_leak_report
 #define talloc_size                     ta_xalloc_size
@@ -0,0 +1,702 @@
+/*
+ * Micro-benchmarks for performance sensitive code paths.
+ *
+ * Each benchmark runs its kernel in batches until at least --time seconds
+ * have passed, and prints one JSON object per line:
+ *
+ *   {"name":"json-parse","iterations":...,"seconds":...,"ns-per-op":...,
+ *    "mb-per-second":...}
+ *
+ * "mb-per-second" is present only for benchmarks that process a fixed amount
+ * of data per iteration. The output is meant to be collected and compared
+ * across builds, not to test correctness.
+ *
+ * Usage: test/bench [--time=<seconds>] [--list] [<name substring>...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include <libavutil/cpu.h>
+
+#include "config.h"
+#include "audio/audio_buffer.h"
+#include "audio/chmap.h"
+#include "audio/format.h"
+#include "audio/filter/af_scaletempo_x86.h"
+#include "common/common.h"
+#include "common/msg.h"
+#include "demux/ebml.h"
+#include "demux/packet.h"
+#include "libmpv/client.h"
+#include "misc/bstr.h"
+#include "misc/dispatch.h"
+#include "misc/json.h"
+#include "misc/node.h"
+#include "mpv_talloc.h"
+#include "osdep/timer.h"
+#include "stream/stream.h"
+#include "sub/draw_bmp.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "video/mp_image_pool.h"
+#include "video/sws_utils.h"
+
+struct bench {
+    const char *name;
+    // Allocate the benchmark state as talloc child of ta_ctx. Can set
+    // *bytes to the amount of data processed per iteration. Returns NULL if
+    // the benchmark can't run (e.g. the CPU lacks an instruction set).
+    void *(*init)(void *ta_ctx, int64_t *bytes);
+    void (*run)(void *priv, int iterations);
+    void (*uninit)(void *priv);
+};
+
+// Results are accumulated here so that the compiler can't drop the work.
+static volatile int64_t sink;
+
+static void fill_pattern(uint8_t *buf, size_t len, unsigned seed)
+{
+    for (size_t n = 0; n < len; n++) {
+        seed = seed * 1103515245 + 12345;
+        buf[n] = seed >> 16;
+    }
+}
+
+// --- EBML
+
+// A sequence of SimpleBlock elements, as in a Matroska cluster.
+#define EBML_BLOCKS 4096
+
+struct ebml_bench {
+    uint8_t *data;
+    int size;
+};
+
+static void *ebml_init(void *ta_ctx, int64_t *bytes)
+{
+    struct ebml_bench *p = talloc_zero(ta_ctx, struct ebml_bench);
+    p->data = talloc_size(p, EBML_BLOCKS * (1 + 4 + 4096));
+    for (int n = 0; n < EBML_BLOCKS; n++) {
+        int len = 16 + (n * 37) % 4000;
+        uint8_t *d = p->data + p->size;
+        d[0] = 0xA3; // SimpleBlock
+        d[1] = 0x10 | (len >> 24);
+        d[2] = len >> 16;
+        d[3] = len >> 8;
+        d[4] = len;
+        fill_pattern(d + 5, len, n);
+        p->size += 5 + len;
+    }
+    *bytes = p->size;
+    return p;
+}
+
+static void ebml_run(void *priv, int iterations)
+{
+    struct ebml_bench *p = priv;
+    stream_t *s = open_memory_stream(p->data, p->size);
+    for (int i = 0; i < iterations; i++) {
+        stream_seek(s, 0);
+        for (int n = 0; n < EBML_BLOCKS; n++) {
+            sink += ebml_read_id(s);
+            stream_skip(s, ebml_read_length(s));
+        }
+    }
+    free_stream(s);
+}
+
+static void *ebml_buf_init(void *ta_ctx, int64_t *bytes)
+{
+    return ebml_init(ta_ctx, bytes);
+}
+
+static void ebml_buf_run(void *priv, int iterations)
+{
+    struct ebml_bench *p = priv;
+    for (int i = 0; i < iterations; i++) {
+        bstr buf = {p->data, p->size};
+        while (buf.len) {
+            buf = bstr_cut(buf, 1);
+            uint64_t len = ebml_buf_read_length(&buf);
+            sink += len;
+            buf = bstr_cut(buf, len);
+        }
+    }
+}
+
+// --- demux packets
+
+#define PACKET_QUEUE 256
+
+struct packet_bench {
+    struct demux_packet_pool *pool;
+};
+
+static void *packet_init(void *ta_ctx, int64_t *bytes)
+{
+    return talloc_zero(ta_ctx, struct packet_bench);
+}
+
+static void *packet_pool_init(void *ta_ctx, int64_t *bytes)
+{
+    struct packet_bench *p = talloc_zero(ta_ctx, struct packet_bench);
+    p->pool = demux_packet_pool_create();
+    return p;
+}
+
+// Simulate the demuxer queue: append packets to a linked list, then remove
+// them from the head and free them.
+static void packet_run(void *priv, int iterations)
+{
+    struct packet_bench *p = priv;
+    struct demux_packet_pool *prev = demux_packet_pool_set_current(p->pool);
+    for (int i = 0; i < iterations; i++) {
+        struct demux_packet *head = NULL, **tail = &head;
+        for (int n = 0; n < PACKET_QUEUE; n++) {
+            struct demux_packet *dp = new_demux_packet(100 + (n * 997) % 20000);
+            dp->pts = n;
+            *tail = dp;
+            tail = &dp->next;
+        }
+        while (head) {
+            struct demux_packet *dp = head;
+            head = dp->next;
+            sink += dp->len;
+            free_demux_packet(dp);
+        }
+    }
+    demux_packet_pool_set_current(prev);
+}
+
+static void packet_uninit(void *priv)
+{
+    struct packet_bench *p = priv;
+    if (p->pool)
+        demux_packet_pool_destroy(p->pool);
+}
+
+// --- subtitle blending
+
+#define SUB_W 1920
+#define SUB_H 1080
+
+struct sub_bench {
+    struct mp_image *dst;
+    struct mp_draw_sub_cache *cache;
+    struct sub_bitmaps sbs;
+};
+
+static void *draw_bmp_init(void *ta_ctx, int64_t *bytes)
+{
+    struct sub_bench *p = talloc_zero(ta_ctx, struct sub_bench);
+    p->dst = mp_image_alloc(IMGFMT_420P, SUB_W, SUB_H);
+    if (!p->dst)
+        return NULL;
+    talloc_steal(p, p->dst);
+    mp_image_clear(p->dst, 0, 0, SUB_W, SUB_H);
+
+    // Two lines of text-like coverage bitmaps near the bottom of the screen.
+    int num = 2, w = SUB_W * 3 / 4, h = 60;
+    p->sbs.format = SUBBITMAP_LIBASS;
+    p->sbs.parts = talloc_zero_array(p, struct sub_bitmap, num);
+    p->sbs.num_parts = num;
+    p->sbs.change_id = 1;
+    for (int n = 0; n < num; n++) {
+        struct sub_bitmap *b = &p->sbs.parts[n];
+        uint8_t *data = talloc_size(p, w * h);
+        fill_pattern(data, w * h, n);
+        *b = (struct sub_bitmap){
+            .bitmap = data, .stride = w, .w = w, .h = h, .dw = w, .dh = h,
+            .x = (SUB_W - w) / 2, .y = SUB_H - (num - n) * (h + 10),
+            .libass.color = 0xFFFFFF00,
+        };
+    }
+    *bytes = (int64_t)num * w * h;
+    return p;
+}
+
+static void draw_bmp_run(void *priv, int iterations)
+{
+    struct sub_bench *p = priv;
+    for (int i = 0; i < iterations; i++)
+        mp_draw_sub_bitmaps(&p->cache, p->dst, &p->sbs);
+}
+
+static void draw_bmp_uninit(void *priv)
+{
+    struct sub_bench *p = priv;
+    talloc_free(p->cache);
+}
+
+// --- scaletempo cross correlation
+
+#define CORR_SAMPLES (2 * 1024)
+#define CORR_OFFSETS 256
+
+struct corr_bench {
+    float *a, *b;
+    int32_t *a32;
+    int16_t *b16;
+    float (*corr_float)(const float *a, const float *b, int n);
+    int64_t (*corr_s16)(const int32_t *a, const int16_t *b, int n);
+};
+
+// Same as the C fallback in af_scaletempo.c.
+static float corr_float_c(const float *a, const float *b, int n)
+{
+    float corr = 0;
+    for (int i = 0; i < n; i++)
+        corr += a[i] * b[i];
+    return corr;
+}
+
+static int64_t corr_s16_c(const int32_t *a, const int16_t *b, int n)
+{
+    int64_t corr = 0;
+    for (int i = 0; i < n; i++)
+        corr += a[i] * b[i];
+    return corr;
+}
+
+static struct corr_bench *corr_alloc(void *ta_ctx, int64_t *bytes)
+{
+    struct corr_bench *p = talloc_zero(ta_ctx, struct corr_bench);
+    int size = CORR_SAMPLES + CORR_OFFSETS;
+    p->a = talloc_array(p, float, size);
+    p->b = talloc_array(p, float, size);
+    p->a32 = talloc_array(p, int32_t, size);
+    p->b16 = talloc_array(p, int16_t, size);
+    for (int n = 0; n < size; n++) {
+        p->a[n] = sin(n * 0.01);
+        p->b[n] = cos(n * 0.013);
+        p->a32[n] = p->a[n] * 32767;
+        p->b16[n] = p->b[n] * 32767;
+    }
+    // One best_overlap_offset() search over all offsets.
+    *bytes = (int64_t)CORR_OFFSETS * CORR_SAMPLES * sizeof(float);
+    return p;
+}
+
+static void *corr_c_init(void *ta_ctx, int64_t *bytes)
+{
+    struct corr_bench *p = corr_alloc(ta_ctx, bytes);
+    p->corr_float = corr_float_c;
+    p->corr_s16 = corr_s16_c;
+    return p;
+}
+
+static void *corr_sse2_init(void *ta_ctx, int64_t *bytes)
+{
+#if HAVE_SSE2_INTRINSICS
+    if (av_get_cpu_flags() & AV_CPU_FLAG_SSE2) {
+        struct corr_bench *p = corr_alloc(ta_ctx, bytes);
+        p->corr_float = mp_scaletempo_corr_float_sse2;
+        return p;
+    }
+#endif
+    return NULL;
+}
+
+static void *corr_avx2_init(void *ta_ctx, int64_t *bytes)
+{
+#if HAVE_AVX2_INTRINSICS
+    if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2) {
+        struct corr_bench *p = corr_alloc(ta_ctx, bytes);
+        p->corr_float = mp_scaletempo_corr_float_avx2;
+        p->corr_s16 = mp_scaletempo_corr_s16_avx2;
+        return p;
+    }
+#endif
+    return NULL;
+}
+
+static void corr_float_run(void *priv, int iterations)
+{
+    struct corr_bench *p = priv;
+    for (int i = 0; i < iterations; i++) {
+        float best = 0;
+        for (int off = 0; off < CORR_OFFSETS; off++)
+            best = MPMAX(best, p->corr_float(p->a, p->b + off, CORR_SAMPLES));
+        sink += best;
+    }
+}
+
+static void corr_s16_run(void *priv, int iterations)
+{
+    struct corr_bench *p = priv;
+    for (int i = 0; i < iterations; i++) {
+        int64_t best = 0;
+        for (int off = 0; off < CORR_OFFSETS; off++)
+            best = MPMAX(best, p->corr_s16(p->a32, p->b16 + off, CORR_SAMPLES));
+        sink += best;
+    }
+}
+
+static void *corr_s16_c_init(void *ta_ctx, int64_t *bytes)
+{
+    struct corr_bench *p = corr_c_init(ta_ctx, bytes);
+    *bytes /= 2;
+    return p;
+}
+
+static void *corr_s16_avx2_init(void *ta_ctx, int64_t *bytes)
+{
+    struct corr_bench *p = corr_avx2_init(ta_ctx, bytes);
+    *bytes /= 2;
+    return p;
+}
+
+// --- audio buffer
+
+#define AB_CHUNK 1024
+
+struct ab_bench {
+    struct mp_audio_buffer *ab;
+    float *data;
+};
+
+static void *audio_buffer_init(void *ta_ctx, int64_t *bytes)
+{
+    struct ab_bench *p = talloc_zero(ta_ctx, struct ab_bench);
+    struct mp_chmap chmap;
+    mp_chmap_from_channels(&chmap, 6);
+    p->ab = mp_audio_buffer_create(p);
+    mp_audio_buffer_reinit_fmt(p->ab, AF_FORMAT_FLOAT, &chmap, 48000);
+    p->data = talloc_zero_array(p, float, AB_CHUNK * 6);
+    *bytes = AB_CHUNK * 6 * sizeof(float);
+    return p;
+}
+
+// Append a decoder sized chunk, and consume it in smaller AO sized pieces.
+static void audio_buffer_run(void *priv, int iterations)
+{
+    struct ab_bench *p = priv;
+    for (int i = 0; i < iterations; i++) {
+        void *planes[] = {p->data};
+        mp_audio_buffer_append(p->ab, planes, AB_CHUNK);
+        while (mp_audio_buffer_samples(p->ab) >= 256) {
+            uint8_t **data;
+            int samples;
+            mp_audio_buffer_peek(p->ab, &data, &samples);
+            sink += data[0][0];
+            mp_audio_buffer_skip(p->ab, 256);
+        }
+    }
+}
+
+// --- images
+
+struct image_bench {
+    struct mp_image *src, *dst;
+    struct mp_image_pool *pool;
+};
+
+static struct image_bench *image_alloc(void *ta_ctx, int64_t *bytes,
+                                       int fmt, int w, int h)
+{
+    struct image_bench *p = talloc_zero(ta_ctx, struct image_bench);
+    p->src = talloc_steal(p, mp_image_alloc(fmt, w, h));
+    if (!p->src)
+        return NULL;
+    for (int n = 0; n < p->src->num_planes; n++) {
+        int ph = mp_image_plane_h(p->src, n);
+        fill_pattern(p->src->planes[n], (size_t)p->src->stride[n] * ph, n);
+    }
+    *bytes = mp_image_get_alloc_size(fmt, w, h, 1);
+    return p;
+}
+
+static void *image_copy_init(void *ta_ctx, int64_t *bytes)
+{
+    struct image_bench *p = image_alloc(ta_ctx, bytes, IMGFMT_420P, 1920, 1080);
+    if (p)
+        p->dst = talloc_steal(p, mp_image_alloc(IMGFMT_420P, 1920, 1080));
+    return p && p->dst ? p : NULL;
+}
+
+static void image_copy_run(void *priv, int iterations)
+{
+    struct image_bench *p = priv;
+    for (int i = 0; i < iterations; i++)
+        mp_image_copy(p->dst, p->src);
+}
+
+static void *image_pool_init(void *ta_ctx, int64_t *bytes)
+{
+    struct image_bench *p = talloc_zero(ta_ctx, struct image_bench);
+    p->pool = mp_image_pool_new(4);
+    talloc_steal(p, p->pool);
+    return p;
+}
+
+// Typical decoder pattern: a few frames in flight, released out of order.
+static void image_pool_run(void *priv, int iterations)
+{
+    struct image_bench *p = priv;
+    for (int i = 0; i < iterations; i++) {
+        struct mp_image *a = mp_image_pool_get(p->pool, IMGFMT_420P, 1920, 1080);
+        struct mp_image *b = mp_image_pool_get(p->pool, IMGFMT_420P, 1920, 1080);
+        struct mp_image *c = mp_image_new_ref(a);
+        talloc_free(a);
+        talloc_free(b);
+        talloc_free(c);
+    }
+}
+
+static void *sws_init(void *ta_ctx, int64_t *bytes)
+{
+    struct image_bench *p = image_alloc(ta_ctx, bytes, IMGFMT_420P, 1920, 1080);
+    if (p)
+        p->dst = talloc_steal(p, mp_image_alloc(IMGFMT_BGR0, 1280, 720));
+    return p && p->dst ? p : NULL;
+}
+
+static void sws_run(void *priv, int iterations)
+{
+    struct image_bench *p = priv;
+    for (int i = 0; i < iterations; i++)
+        mp_image_swscale(p->dst, p->src, mp_sws_fast_flags);
+}
+
+// --- JSON
+
+struct json_bench {
+    char *text;
+    struct mpv_node node;
+};
+
+// Something resembling a track-list property value.
+static void *json_init(void *ta_ctx, int64_t *bytes)
+{
+    struct json_bench *p = talloc_zero(ta_ctx, struct json_bench);
+    node_init(&p->node, MPV_FORMAT_NODE_ARRAY, NULL);
+    for (int n = 0; n < 64; n++) {
+        struct mpv_node *e = node_array_add(&p->node, MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(e, "id", n);
+        node_map_add_string(e, "type", n % 3 ? "audio" : "sub");
+        node_map_add_string(e, "title", "Commentary track \"\\/\" \xc3\xa4");
+        node_map_add_string(e, "lang", "eng");
+        node_map_add_flag(e, "default", n == 0);
+        node_map_add_double(e, "demux-fps", 23.976);
+    }
+    talloc_steal(p, p->node.u.list);
+    p->text = talloc_strdup(p, "");
+    json_write(&p->text, &p->node);
+    *bytes = strlen(p->text);
+    return p;
+}
+
+static void json_parse_run(void *priv, int iterations)
+{
+    struct json_bench *p = priv;
+    for (int i = 0; i < iterations; i++) {
+        void *tmp = talloc_new(NULL);
+        char *text = talloc_strdup(tmp, p->text);
+        struct mpv_node node;
+        if (json_parse(tmp, &node, &text, 50) < 0)
+            abort();
+        talloc_free(tmp);
+    }
+}
+
+static void json_write_run(void *priv, int iterations)
+{
+    struct json_bench *p = priv;
+    for (int i = 0; i < iterations; i++) {
+        char *s = talloc_strdup(NULL, "");
+        json_write(&s, &p->node);
+        talloc_free(s);
+    }
+}
+
+// --- bstr
+
+struct bstr_bench {
+    bstr text;
+};
+
+static void *bstr_init(void *ta_ctx, int64_t *bytes)
+{
+    struct bstr_bench *p = talloc_zero(ta_ctx, struct bstr_bench);
+    int len = 1024 * 1024;
+    unsigned char *buf = talloc_size(p, len);
+    for (int n = 0; n < len; n++)
+        buf[n] = n % 61 == 60 ? '\n' : 'a' + n % 26;
+    p->text = (bstr){buf, len};
+    *bytes = len;
+    return p;
+}
+
+static void bstr_find_run(void *priv, int iterations)
+{
+    struct bstr_bench *p = priv;
+    for (int i = 0; i < iterations; i++)
+        sink += bstr_find0(p->text, "zz");
+}
+
+static void bstr_getline_run(void *priv, int iterations)
+{
+    struct bstr_bench *p = priv;
+    for (int i = 0; i < iterations; i++) {
+        bstr s = p->text;
+        while (s.len)
+            sink += bstr_getline(s, &s).len;
+    }
+}
+
+// --- dispatch queue
+
+struct dispatch_bench {
+    struct mp_dispatch_queue *queue;
+    pthread_t thread;
+    bool stop;
+};
+
+static void *dispatch_thread(void *arg)
+{
+    struct dispatch_bench *p = arg;
+    while (!p->stop)
+        mp_dispatch_queue_process(p->queue, INFINITY);
+    return NULL;
+}
+
+static void dispatch_nop(void *arg)
+{
+    sink++;
+}
+
+static void dispatch_stop(void *arg)
+{
+    struct dispatch_bench *p = arg;
+    p->stop = true;
+    mp_dispatch_interrupt(p->queue);
+}
+
+static void *dispatch_init(void *ta_ctx, int64_t *bytes)
+{
+    struct dispatch_bench *p = talloc_zero(ta_ctx, struct dispatch_bench);
+    p->queue = mp_dispatch_create(p);
+    if (pthread_create(&p->thread, NULL, dispatch_thread, p))
+        return NULL;
+    return p;
+}
+
+// Round trips to another thread, like the client API does for most calls.
+static void dispatch_run(void *priv, int iterations)
+{
+    struct dispatch_bench *p = priv;
+    for (int i = 0; i < iterations; i++)
+        mp_dispatch_run(p->queue, dispatch_nop, NULL);
+}
+
+static void dispatch_uninit(void *priv)
+{
+    struct dispatch_bench *p = priv;
+    mp_dispatch_run(p->queue, dispatch_stop, p);
+    pthread_join(p->thread, NULL);
+}
+
+static const struct bench benchmarks[] = {
+    {"ebml-stream", ebml_init, ebml_run},
+    {"ebml-buf", ebml_buf_init, ebml_buf_run},
+    {"demux-packet-queue", packet_init, packet_run, packet_uninit},
+    {"demux-packet-queue-pool", packet_pool_init, packet_run, packet_uninit},
+    {"draw-bmp-libass", draw_bmp_init, draw_bmp_run, draw_bmp_uninit},
+    {"scaletempo-corr-float-c", corr_c_init, corr_float_run},
+    {"scaletempo-corr-float-sse2", corr_sse2_init, corr_float_run},
+    {"scaletempo-corr-float-avx2", corr_avx2_init, corr_float_run},
+    {"scaletempo-corr-s16-c", corr_s16_c_init, corr_s16_run},
+    {"scaletempo-corr-s16-avx2", corr_s16_avx2_init, corr_s16_run},
+    {"audio-buffer", audio_buffer_init, audio_buffer_run},
+    {"image-copy-1080p", image_copy_init, image_copy_run},
+    {"image-pool-1080p", image_pool_init, image_pool_run},
+    {"sws-1080p-yuv-to-720p-rgb", sws_init, sws_run},
+    {"json-parse", json_init, json_parse_run},
+    {"json-write", json_init, json_write_run},
+    {"bstr-find", bstr_init, bstr_find_run},
+    {"bstr-getline", bstr_init, bstr_getline_run},
+    {"dispatch-round-trip", dispatch_init, dispatch_run, dispatch_uninit},
+    {0}
+};
+
+static bool selected(const char *name, int argc, char **argv)
+{
+    bool any = false;
+    for (int n = 1; n < argc; n++) {
+        if (argv[n][0] == '-')
+            continue;
+        any = true;
+        if (strstr(name, argv[n]))
+            return true;
+    }
+    return !any;
+}
+
+static void run_bench(const struct bench *b, double min_time)
+{
+    void *ta_ctx = talloc_new(NULL);
+    int64_t bytes = 0;
+    void *priv = b->init(ta_ctx, &bytes);
+    if (!priv) {
+        printf("{\"name\":\"%s\",\"skipped\":true}\n", b->name);
+        talloc_free(ta_ctx);
+        return;
+    }
+
+    b->run(priv, 1); // warmup
+
+    int64_t iterations = 0, elapsed = 0;
+    int batch = 1;
+    while (elapsed < min_time * 1e6) {
+        int64_t start = mp_time_us();
+        b->run(priv, batch);
+        elapsed += mp_time_us() - start;
+        iterations += batch;
+        if (batch < (1 << 20))
+            batch *= 2;
+    }
+
+    double secs = MPMAX(elapsed, 1) / 1e6;
+    printf("{\"name\":\"%s\",\"iterations\":%"PRId64",\"seconds\":%f,"
+           "\"ns-per-op\":%f", b->name, iterations, secs,
+           secs * 1e9 / iterations);
+    if (bytes)
+        printf(",\"mb-per-second\":%f", bytes * iterations / secs / 1e6);
+    printf("}\n");
+    fflush(stdout);
+
+    if (b->uninit)
+        b->uninit(priv);
+    talloc_free(ta_ctx);
+}
+
+int main(int argc, char **argv)
+{
+    double min_time = 0.5;
+
+    for (int n = 1; n < argc; n++) {
+        if (strncmp(argv[n], "--time=", 7) == 0) {
+            min_time = atof(argv[n] + 7);
+        } else if (strcmp(argv[n], "--list") == 0) {
+            for (int i = 0; benchmarks[i].name; i++)
+                printf("%s\n", benchmarks[i].name);
+            return 0;
+        } else if (argv[n][0] == '-') {
+            fprintf(stderr, "bench: unknown option %s\n", argv[n]);
+            return 1;
+        }
+    }
+
+    mp_time_init();
+
+    for (int n = 0; benchmarks[n].name; n++) {
+        if (selected(benchmarks[n].name, argc, argv))
+            run_bench(&benchmarks[n], min_time);
+    }
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include "test_helpers.h"
+#include "common/common.h"
+#include "video/out/bitmap_packer.h"
+
+static void fill_random(struct bitmap_packer *p, int count, int max_w,
+                        int max_h, unsigned *seed)
+{
+    packer_set_size(p, count);
+    for (int n = 0; n < count; n++) {
+        *seed = *seed * 1103515245 + 12345;
+        int w = (*seed >> 16) % max_w;
+        *seed = *seed * 1103515245 + 12345;
+        int h = (*seed >> 16) % max_h;
+        p->in[n] = (struct pos){w, h};
+    }
+}
+
+static void check_packing(struct bitmap_packer *p, const struct pos *sizes)
+{
+    for (int a = 0; a < p->count; a++) {
+        struct pos pa = p->result[a], sa = sizes[a];
+        if (!sa.x || !sa.y)
+            continue;
+        assert_true(pa.x >= p->padding && pa.y >= p->padding);
+        assert_true(pa.x + sa.x + p->padding <= p->used_width);
+        assert_true(pa.y + sa.y + p->padding <= p->used_height);
+        for (int b = a + 1; b < p->count; b++) {
+            struct pos pb = p->result[b], sb = sizes[b];
+            if (!sb.x || !sb.y)
+                continue;
+            bool overlap = pa.x - p->padding < pb.x + sb.x + p->padding &&
+                           pb.x - p->padding < pa.x + sa.x + p->padding &&
+                           pa.y - p->padding < pb.y + sb.y + p->padding &&
+                           pb.y - p->padding < pa.y + sa.y + p->padding;
+            assert_false(overlap);
+        }
+    }
+    assert_true(p->used_width <= p->w && p->used_height <= p->h);
+    assert_true(p->occupancy >= 0 && p->occupancy <= 1);
+}
+
+static void test_packer(void **state) {
+    struct bitmap_packer *p = talloc_zero(NULL, struct bitmap_packer);
+    unsigned seed = 1;
+    for (int n = 0; n < 200; n++) {
+        int count = 1 + n % 100;
+        fill_random(p, count, 1 + n % 50 * 4, 1 + n % 30 * 4, &seed);
+        p->padding = n % 3;
+        struct pos sizes[100];
+        memcpy(sizes, p->in, sizeof(sizes[0]) * count);
+        if (packer_pack(p) < 0)
+            continue;
+        check_packing(p, sizes);
+    }
+    talloc_free(p);
+}
+
+// The same input must give the same placement.
+static void test_packer_stable(void **state) {
+    struct bitmap_packer *p = talloc_zero(NULL, struct bitmap_packer);
+    struct pos first[300];
+    for (int n = 0; n < 2; n++) {
+        unsigned seed = 2;
+        fill_random(p, 300, 40, 40, &seed);
+        assert_true(packer_pack(p) >= 0);
+        if (n == 0) {
+            memcpy(first, p->result, sizeof(first));
+        } else {
+            assert_memory_equal(first, p->result, sizeof(first));
+        }
+    }
+    talloc_free(p);
+}
+
+// Glyph-like bitmaps of similar height should fill most of the area.
+static void test_packer_occupancy(void **state) {
+    struct bitmap_packer *p = talloc_zero(NULL, struct bitmap_packer);
+    unsigned seed = 3;
+    fill_random(p, 500, 30, 30, &seed);
+    for (int n = 0; n < p->count; n++) {
+        p->in[n].x += 2;
+        p->in[n].y += 10;
+    }
+    assert_true(packer_pack(p) >= 0);
+    assert_true(p->occupancy > 0.8);
+    talloc_free(p);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_packer),
+        cmocka_unit_test(test_packer_stable),
+        cmocka_unit_test(test_packer_occupancy),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
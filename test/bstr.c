@@ -0,0 +1,128 @@
+#include "test_helpers.h"
+#include "common/common.h"
+#include "misc/bstr.h"
+#include "osdep/timer.h"
+
+static int naive_find(struct bstr h, struct bstr n)
+{
+    for (int i = 0; i < h.len; i++)
+        if (bstr_startswith(bstr_splice(h, i, h.len), n))
+            return i;
+    return -1;
+}
+
+static int naive_cspn(struct bstr s, const char *reject)
+{
+    int i;
+    for (i = 0; i < s.len; i++)
+        if (strchr(reject, s.start[i]))
+            break;
+    return i;
+}
+
+static int naive_spn(struct bstr s, const char *accept)
+{
+    int i;
+    for (i = 0; i < s.len; i++)
+        if (!strchr(accept, s.start[i]))
+            break;
+    return i;
+}
+
+static void fill_random(unsigned char *buf, int len, unsigned *seed)
+{
+    // Small alphabet, so that partial matches are frequent.
+    for (int n = 0; n < len; n++) {
+        *seed = *seed * 1103515245 + 12345;
+        buf[n] = "ab\n\r \0x"[(*seed >> 16) % 7];
+    }
+}
+
+static void test_bstr_find(void **state) {
+    assert_int_equal(bstr_find0(bstr0("abc"), ""), 0);
+    assert_int_equal(bstr_find0(bstr0(""), ""), -1);
+    assert_int_equal(bstr_find0(bstr0(""), "a"), -1);
+    assert_int_equal(bstr_find0(bstr0("ab"), "abc"), -1);
+    assert_int_equal(bstr_find0(bstr0("aababc"), "abc"), 3);
+    assert_int_equal(bstr_find0(bstr0("abcab"), "ab"), 0);
+    assert_int_equal(bstr_find0(bstr0("xxab"), "ab"), 2);
+
+    unsigned seed = 1;
+    unsigned char hay[64], needle[4];
+    for (int n = 0; n < 10000; n++) {
+        int hlen = n % 64, nlen = n % 4;
+        fill_random(hay, hlen, &seed);
+        fill_random(needle, nlen, &seed);
+        struct bstr h = {hay, hlen}, ne = {needle, nlen};
+        assert_int_equal(bstr_find(h, ne), naive_find(h, ne));
+    }
+}
+
+static void test_bstr_chars(void **state) {
+    assert_int_equal(bstrchr(bstr0("abc"), 'c'), 2);
+    assert_int_equal(bstrchr(bstr0("abc"), 'd'), -1);
+    assert_int_equal(bstrchr(bstr0(""), 'a'), -1);
+
+    const char *sets[] = {"\n", "\r\n", " \t", "ab", "x"};
+    unsigned seed = 2;
+    unsigned char buf[64];
+    for (int n = 0; n < 10000; n++) {
+        int len = n % 64;
+        fill_random(buf, len, &seed);
+        struct bstr s = {buf, len};
+        const char *set = sets[n % MP_ARRAY_SIZE(sets)];
+        assert_int_equal(bstrcspn(s, set), naive_cspn(s, set));
+        assert_int_equal(bstrspn(s, set), naive_spn(s, set));
+    }
+}
+
+static void test_bstr_split(void **state) {
+    struct bstr rest;
+    struct bstr w = bstr_split(bstr0("  foo bar"), " ", &rest);
+    assert_true(bstr_equals0(w, "foo"));
+    assert_true(bstr_equals0(rest, " bar"));
+
+    struct bstr line = bstr_getline(bstr0("line1\nline2"), &rest);
+    assert_true(bstr_equals0(line, "line1\n"));
+    assert_true(bstr_equals0(rest, "line2"));
+}
+
+// Not a correctness test; prints the throughput of the line splitting and
+// search functions on a large buffer.
+static void test_bstr_bench(void **state) {
+    int len = 16 * 1024 * 1024;
+    unsigned char *buf = malloc(len);
+    assert_non_null(buf);
+    for (int n = 0; n < len; n++)
+        buf[n] = n % 97 == 96 ? '\n' : 'a' + n % 26;
+
+    int64_t t = mp_time_us();
+    int lines = 0;
+    struct bstr s = {buf, len};
+    while (s.len) {
+        bstr_getline(s, &s);
+        lines++;
+    }
+    int64_t t_lines = mp_time_us() - t;
+
+    t = mp_time_us();
+    int pos = bstr_find0((struct bstr){buf, len}, "zz");
+    int64_t t_find = mp_time_us() - t;
+
+    assert_int_equal(lines, (len + 96) / 97);
+    assert_int_equal(pos, -1);
+    printf("bstr_getline: %.1f MB/s, bstr_find: %.1f MB/s\n",
+           len / (double)MPMAX(t_lines, 1), len / (double)MPMAX(t_find, 1));
+    free(buf);
+}
+
+int main(void) {
+    mp_time_init();
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_bstr_find),
+        cmocka_unit_test(test_bstr_chars),
+        cmocka_unit_test(test_bstr_split),
+        cmocka_unit_test(test_bstr_bench),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
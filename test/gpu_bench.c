@@ -0,0 +1,307 @@
+/*
+ * Headless benchmark for the vo_gpu renderer.
+ *
+ * This renders frames with gl_video on an offscreen OpenGL context (EGL on a
+ * surfaceless or default display, through the opengl-cb API), and prints the
+ * per-pass and per-frame timings as JSON. It's meant to compare renderer
+ * performance between builds, not to test correctness.
+ *
+ * Usage: test/gpu_bench [--preset=<name>] [--frames=<n>] [--warmup=<n>]
+ *                       [--size=<w>x<h>] [--source=<file or URL>]
+ *                       [<option>=<value>...]
+ *
+ * Additional arguments are set as mpv options, e.g. glsl-shaders=<file> or
+ * tone-mapping=mobius. If no source is given, a synthetic 4K test pattern is
+ * rendered.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "config.h"
+
+#if HAVE_EGL_X11 || HAVE_EGL_DRM
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "libmpv/client.h"
+#include "libmpv/opengl_cb.h"
+#include "misc/json.h"
+#include "mpv_talloc.h"
+#include "osdep/timer.h"
+#include "video/out/opengl/common.h"
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+struct preset {
+    const char *name;
+    const char *opts[12]; // pairs of option name and value
+};
+
+static const struct preset presets[] = {
+    {"default", {0}},
+    {"hq", {"scale", "spline36", "cscale", "spline36", "dscale", "mitchell",
+            "correct-downscaling", "yes", "sigmoid-upscaling", "yes",
+            "deband", "yes"}},
+    {"ewa", {"scale", "ewa_lanczossharp", "cscale", "ewa_lanczossharp"}},
+    {"hdr", {"vf", "format=gamma=pq:primaries=bt.2020",
+             "tone-mapping", "hable", "hdr-compute-peak", "yes"}},
+    {0}
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeup = PTHREAD_COND_INITIALIZER;
+static bool frame_ready;
+
+static void update_cb(void *ctx)
+{
+    pthread_mutex_lock(&lock);
+    frame_ready = true;
+    pthread_cond_signal(&wakeup);
+    pthread_mutex_unlock(&lock);
+}
+
+static void *get_proc_address(void *ctx, const char *name)
+{
+    return (void *)eglGetProcAddress(name);
+}
+
+static void die(const char *msg)
+{
+    fprintf(stderr, "gpu_bench: %s\n", msg);
+    exit(1);
+}
+
+static bool create_egl_context(void)
+{
+    EGLDisplay display = EGL_NO_DISPLAY;
+    const char *exts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (exts && strstr(exts, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC GetPlatformDisplay =
+            (void *)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (GetPlatformDisplay) {
+            display = GetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                         EGL_DEFAULT_DISPLAY, NULL);
+        }
+    }
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+        return false;
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+        return false;
+
+    EGLint attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE,
+    };
+    EGLConfig config;
+    EGLint num_configs = 0;
+    if (!eglChooseConfig(display, attribs, &config, 1, &num_configs) ||
+        num_configs < 1)
+        return false;
+
+    EGLContext ctx = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+    if (ctx == EGL_NO_CONTEXT)
+        return false;
+
+    // Requires EGL_KHR_surfaceless_context; we only render to our own FBO.
+    return eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx);
+}
+
+static GLuint create_fbo(GL *gl, int w, int h)
+{
+    GLuint tex, fbo;
+    gl->GenTextures(1, &tex);
+    gl->BindTexture(GL_TEXTURE_2D, tex);
+    gl->TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA,
+                   GL_UNSIGNED_BYTE, NULL);
+    gl->BindTexture(GL_TEXTURE_2D, 0);
+
+    gl->GenFramebuffers(1, &fbo);
+    gl->BindFramebuffer(GL_FRAMEBUFFER, fbo);
+    gl->FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                             GL_TEXTURE_2D, tex, 0);
+    GLenum status = gl->CheckFramebufferStatus(GL_FRAMEBUFFER);
+    gl->BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    return status == GL_FRAMEBUFFER_COMPLETE ? fbo : 0;
+}
+
+static void set_option(mpv_handle *mpv, const char *name, const char *value)
+{
+    if (mpv_set_option_string(mpv, name, value) < 0) {
+        fprintf(stderr, "gpu_bench: could not set option %s=%s\n", name, value);
+        exit(1);
+    }
+}
+
+// Print the JSON representation of a property, or null.
+static void print_property(mpv_handle *mpv, const char *name)
+{
+    mpv_node node;
+    if (mpv_get_property(mpv, name, MPV_FORMAT_NODE, &node) < 0) {
+        printf("null");
+        return;
+    }
+    char *s = talloc_strdup(NULL, "");
+    json_write(&s, &node);
+    printf("%s", s);
+    talloc_free(s);
+    mpv_free_node_contents(&node);
+}
+
+int main(int argc, char **argv)
+{
+    const struct preset *preset = &presets[0];
+    int frames = 300, warmup = 30;
+    int w = 1920, h = 1080;
+    const char *source = "av://lavfi:testsrc2=size=3840x2160:rate=60";
+
+    mpv_handle *mpv = mpv_create();
+    if (!mpv)
+        die("could not create mpv instance");
+
+    set_option(mpv, "vo", "opengl-cb");
+    set_option(mpv, "audio", "no");
+    set_option(mpv, "untimed", "yes");
+    set_option(mpv, "loop-file", "inf");
+    set_option(mpv, "hwdec", "no");
+    set_option(mpv, "terminal", "yes");
+    set_option(mpv, "quiet", "yes");
+    set_option(mpv, "msg-level", "all=warn");
+
+    for (int n = 1; n < argc; n++) {
+        const char *arg = argv[n];
+        if (strncmp(arg, "--preset=", 9) == 0) {
+            preset = NULL;
+            for (int i = 0; presets[i].name; i++) {
+                if (strcmp(presets[i].name, arg + 9) == 0)
+                    preset = &presets[i];
+            }
+            if (!preset)
+                die("unknown preset");
+        } else if (strncmp(arg, "--frames=", 9) == 0) {
+            frames = atoi(arg + 9);
+        } else if (strncmp(arg, "--warmup=", 9) == 0) {
+            warmup = atoi(arg + 9);
+        } else if (strncmp(arg, "--size=", 7) == 0) {
+            if (sscanf(arg + 7, "%dx%d", &w, &h) != 2 || w < 1 || h < 1)
+                die("invalid size");
+        } else if (strncmp(arg, "--source=", 9) == 0) {
+            source = arg + 9;
+        } else {
+            const char *eq = strchr(arg, '=');
+            if (!eq)
+                die("arguments must be of the form option=value");
+            char *name = talloc_strndup(NULL, arg, eq - arg);
+            set_option(mpv, name[0] == '-' ? name + 2 : name, eq + 1);
+            talloc_free(name);
+        }
+    }
+
+    for (int n = 0; n < MP_ARRAY_SIZE(preset->opts) && preset->opts[n]; n += 2)
+        set_option(mpv, preset->opts[n], preset->opts[n + 1]);
+
+    if (mpv_initialize(mpv) < 0)
+        die("could not initialize mpv");
+
+    if (!create_egl_context())
+        die("could not create an offscreen EGL context");
+
+    GL gl = {0};
+    mpgl_load_functions2(&gl, get_proc_address, NULL, NULL, mp_null_log);
+    if (!gl.version)
+        die("could not load OpenGL functions");
+
+    GLuint fbo = create_fbo(&gl, w, h);
+    if (!fbo)
+        die("could not create the target FBO");
+
+    mpv_opengl_cb_context *cb = mpv_get_sub_api(mpv, MPV_SUB_API_OPENGL_CB);
+    if (!cb)
+        die("opengl-cb not available");
+    mpv_opengl_cb_set_update_callback(cb, update_cb, NULL);
+    if (mpv_opengl_cb_init_gl(cb, NULL, get_proc_address, NULL) < 0)
+        die("could not initialize the renderer");
+
+    const char *cmd[] = {"loadfile", source, NULL};
+    if (mpv_command(mpv, cmd) < 0)
+        die("could not load the source");
+
+    int64_t cpu_total = 0, wall_start = 0;
+    int rendered = 0;
+    bool ended = false;
+    while (rendered < warmup + frames && !ended) {
+        pthread_mutex_lock(&lock);
+        if (!frame_ready) {
+            struct timespec ts = mp_time_us_to_timespec(mp_time_us() + 100000);
+            pthread_cond_timedwait(&wakeup, &lock, &ts);
+        }
+        bool ready = frame_ready;
+        frame_ready = false;
+        pthread_mutex_unlock(&lock);
+
+        while (1) {
+            mpv_event *ev = mpv_wait_event(mpv, 0);
+            if (ev->event_id == MPV_EVENT_NONE)
+                break;
+            if (ev->event_id == MPV_EVENT_END_FILE ||
+                ev->event_id == MPV_EVENT_SHUTDOWN)
+                ended = true;
+        }
+        if (!ready)
+            continue;
+
+        if (rendered == warmup)
+            wall_start = mp_time_us();
+
+        int64_t start = mp_time_us();
+        mpv_opengl_cb_draw(cb, fbo, w, h);
+        int64_t end = mp_time_us();
+        gl.Finish();
+        mpv_opengl_cb_report_flip(cb, 0);
+
+        if (rendered >= warmup)
+            cpu_total += end - start;
+        rendered++;
+    }
+
+    int measured = rendered - warmup;
+    if (measured <= 0)
+        die("no frames were rendered");
+    double wall = (mp_time_us() - wall_start) / 1e6;
+
+    printf("{\"preset\":\"%s\",\"width\":%d,\"height\":%d,\"frames\":%d,",
+           preset->name, w, h, measured);
+    printf("\"wall-time\":%f,\"fps\":%f,\"cpu-time-per-frame\":%f,",
+           wall, measured / wall, cpu_total / 1e6 / measured);
+    printf("\"passes\":");
+    print_property(mpv, "vo-passes");
+    printf(",\"frame-times\":");
+    print_property(mpv, "vo-frame-times");
+    printf("}\n");
+
+    mpv_opengl_cb_uninit_gl(cb);
+    mpv_terminate_destroy(mpv);
+    return 0;
+}
+
+#else
+
+int main(void)
+{
+    fprintf(stderr, "gpu_bench: not compiled with EGL support\n");
+    return 77; // skipped
+}
+
+#endif
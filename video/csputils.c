@@ -24,8 +24,10 @@
 #include "config.h"
 
 #include <stdint.h>
+#include <string.h>
 #include <math.h>
 #include <assert.h>
+#include <pthread.h>
 #include <libavutil/common.h>
 #include <libavcodec/avcodec.h>
 
@@ -596,6 +598,50 @@ void mp_get_cms_matrix(struct mp_csp_primaries src, struct mp_csp_primaries dest
     mp_mul_matrix3x3(m, tmp);
 }
 
+#define NUM_INTENTS (MP_INTENT_ABSOLUTE_COLORIMETRIC + 1)
+
+// The matrices for the builtin primaries only depend on the enum values, so
+// they are computed once, instead of on every shader generation.
+static struct {
+    float rgb2xyz[MP_CSP_PRIM_COUNT][3][3];
+    float cms[NUM_INTENTS][MP_CSP_PRIM_COUNT][MP_CSP_PRIM_COUNT][3][3];
+} prim_matrices;
+static pthread_once_t prim_matrices_once = PTHREAD_ONCE_INIT;
+
+static void init_prim_matrices(void)
+{
+    // MP_CSP_PRIM_AUTO has no primaries and is left as zero matrices.
+    for (int s = 1; s < MP_CSP_PRIM_COUNT; s++) {
+        struct mp_csp_primaries src = mp_get_csp_primaries(s);
+        mp_get_rgb2xyz_matrix(src, prim_matrices.rgb2xyz[s]);
+        for (int d = 1; d < MP_CSP_PRIM_COUNT; d++) {
+            struct mp_csp_primaries dst = mp_get_csp_primaries(d);
+            for (int i = 0; i < NUM_INTENTS; i++)
+                mp_get_cms_matrix(src, dst, i, prim_matrices.cms[i][s][d]);
+        }
+    }
+}
+
+// Like mp_get_rgb2xyz_matrix(mp_get_csp_primaries(prim), m), but cached.
+void mp_get_prim_rgb2xyz_matrix(enum mp_csp_prim prim, float m[3][3])
+{
+    assert(prim >= 0 && prim < MP_CSP_PRIM_COUNT);
+    pthread_once(&prim_matrices_once, init_prim_matrices);
+    memcpy(m, prim_matrices.rgb2xyz[prim], sizeof(prim_matrices.rgb2xyz[0]));
+}
+
+// Like mp_get_cms_matrix() with the primaries of the given enum values, but
+// cached.
+void mp_get_prim_cms_matrix(enum mp_csp_prim src, enum mp_csp_prim dest,
+                            enum mp_render_intent intent, float m[3][3])
+{
+    assert(src >= 0 && src < MP_CSP_PRIM_COUNT);
+    assert(dest >= 0 && dest < MP_CSP_PRIM_COUNT);
+    assert(intent >= 0 && intent < NUM_INTENTS);
+    pthread_once(&prim_matrices_once, init_prim_matrices);
+    memcpy(m, prim_matrices.cms[intent][src][dest], sizeof(float[3][3]));
+}
+
 // get the coefficients of an SMPTE 428-1 xyz -> rgb conversion matrix
 // intent = the rendering intent used to convert to the target primaries
 static void mp_get_xyz2rgb_coeffs(struct mp_csp_params *params,
@@ -809,6 +855,21 @@ bool mp_colorspace_equal(struct mp_colorspace c1, struct mp_colorspace c2)
            c1.sig_peak == c2.sig_peak;
 }
 
+bool mp_csp_params_equal(const struct mp_csp_params *p1,
+                         const struct mp_csp_params *p2)
+{
+    return mp_colorspace_equal(p1->color, p2->color) &&
+           p1->levels_out == p2->levels_out &&
+           p1->brightness == p2->brightness &&
+           p1->contrast == p2->contrast &&
+           p1->hue == p2->hue &&
+           p1->saturation == p2->saturation &&
+           p1->gamma == p2->gamma &&
+           p1->gray == p2->gray &&
+           p1->texture_bits == p2->texture_bits &&
+           p1->input_bits == p2->input_bits;
+}
+
 #define OPT_BASE_STRUCT struct mp_csp_equalizer_opts
 
 const struct m_sub_options mp_csp_equalizer_conf = {
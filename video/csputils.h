@@ -170,6 +170,9 @@ struct mp_csp_params {
     .brightness = 0, .contrast = 1, .hue = 0, .saturation = 1,  \
     .gamma = 1, .texture_bits = 8, .input_bits = 8}
 
+bool mp_csp_params_equal(const struct mp_csp_params *p1,
+                         const struct mp_csp_params *p2);
+
 struct mp_image_params;
 void mp_csp_set_image_params(struct mp_csp_params *params,
                              const struct mp_image_params *imgparams);
@@ -272,6 +275,9 @@ struct mp_cmat {
 void mp_get_rgb2xyz_matrix(struct mp_csp_primaries space, float m[3][3]);
 void mp_get_cms_matrix(struct mp_csp_primaries src, struct mp_csp_primaries dest,
                        enum mp_render_intent intent, float cms_matrix[3][3]);
+void mp_get_prim_rgb2xyz_matrix(enum mp_csp_prim prim, float m[3][3]);
+void mp_get_prim_cms_matrix(enum mp_csp_prim src, enum mp_csp_prim dest,
+                            enum mp_render_intent intent, float m[3][3]);
 
 double mp_get_csp_mul(enum mp_csp csp, int input_bits, int texture_bits);
 void mp_get_csp_matrix(struct mp_csp_params *params, struct mp_cmat *out);
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/rational.h>
 
@@ -26,6 +27,7 @@
 #include "options/options.h"
 #include "common/msg.h"
 
+#include "osdep/threads.h"
 #include "osdep/timer.h"
 
 #include "stream/stream.h"
@@ -57,9 +59,50 @@ const vd_functions_t * const mpcodecs_vd_drivers[] = {
     NULL
 };
 
-void video_reset(struct dec_video *d_video)
+// State for decoding on a separate thread (video_start_thread()).
+struct dec_video_async {
+    pthread_t thread;
+    // Protects the decoder (i.e. all other dec_video state). The worker holds
+    // it while decoding. Lock order: dec_lock, then lock.
+    pthread_mutex_t dec_lock;
+    // Protects the fields below.
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool terminate;
+    int64_t work_gen;           // incremented on every video_work() call
+    int64_t wait_gen;           // worker got DATA_WAIT during this work_gen
+    struct mp_image **frames;   // decoded frames not yet returned
+    int num_frames, max_frames;
+    bool eof;
+    struct demux_packet **rec_packets; // to be fed to the recorder
+    int num_rec_packets;
+    void (*wakeup_cb)(void *ctx);
+    void *wakeup_ctx;
+};
+
+static void lock_dec(struct dec_video *d_video)
+{
+    if (d_video->async)
+        pthread_mutex_lock(&d_video->async->dec_lock);
+}
+
+static void unlock_dec(struct dec_video *d_video)
+{
+    if (d_video->async)
+        pthread_mutex_unlock(&d_video->async->dec_lock);
+}
+
+static int vd_control(struct dec_video *d_video, int cmd, void *arg)
 {
-    video_vd_control(d_video, VDCTRL_RESET, NULL);
+    const struct vd_functions *vd = d_video->vd_driver;
+    if (vd)
+        return vd->control(d_video, cmd, arg);
+    return CONTROL_UNKNOWN;
+}
+
+static void reset(struct dec_video *d_video)
+{
+    vd_control(d_video, VDCTRL_RESET, NULL);
     d_video->first_packet_pdts = MP_NOPTS_VALUE;
     d_video->start_pts = MP_NOPTS_VALUE;
     d_video->decoded_pts = MP_NOPTS_VALUE;
@@ -68,6 +111,7 @@ void video_reset(struct dec_video *d_video)
     d_video->has_broken_decoded_pts = 0;
     d_video->last_format = d_video->fixed_format = (struct mp_image_params){0};
     d_video->dropped_frames = 0;
+    d_video->hrseek_dropped_frames = 0;
     d_video->current_state = DATA_AGAIN;
     mp_image_unrefp(&d_video->current_mpi);
     talloc_free(d_video->packet);
@@ -77,18 +121,60 @@ void video_reset(struct dec_video *d_video)
     d_video->start = d_video->end = MP_NOPTS_VALUE;
 }
 
+void video_reset(struct dec_video *d_video)
+{
+    lock_dec(d_video);
+    reset(d_video);
+    struct dec_video_async *a = d_video->async;
+    if (a) {
+        pthread_mutex_lock(&a->lock);
+        for (int n = 0; n < a->num_frames; n++)
+            talloc_free(a->frames[n]);
+        a->num_frames = 0;
+        a->eof = false;
+        a->wait_gen = -1;
+        pthread_cond_broadcast(&a->wakeup);
+        pthread_mutex_unlock(&a->lock);
+    }
+    unlock_dec(d_video);
+}
+
 int video_vd_control(struct dec_video *d_video, int cmd, void *arg)
 {
-    const struct vd_functions *vd = d_video->vd_driver;
-    if (vd)
-        return vd->control(d_video, cmd, arg);
-    return CONTROL_UNKNOWN;
+    lock_dec(d_video);
+    int r = vd_control(d_video, cmd, arg);
+    unlock_dec(d_video);
+    return r;
+}
+
+static void stop_thread(struct dec_video *d_video)
+{
+    struct dec_video_async *a = d_video->async;
+    if (!a)
+        return;
+
+    pthread_mutex_lock(&a->lock);
+    a->terminate = true;
+    pthread_cond_broadcast(&a->wakeup);
+    pthread_mutex_unlock(&a->lock);
+    pthread_join(a->thread, NULL);
+
+    for (int n = 0; n < a->num_frames; n++)
+        talloc_free(a->frames[n]);
+    for (int n = 0; n < a->num_rec_packets; n++)
+        talloc_free(a->rec_packets[n]);
+    pthread_cond_destroy(&a->wakeup);
+    pthread_mutex_destroy(&a->lock);
+    pthread_mutex_destroy(&a->dec_lock);
+    talloc_free(a);
+    d_video->async = NULL;
 }
 
 void video_uninit(struct dec_video *d_video)
 {
     if (!d_video)
         return;
+    stop_thread(d_video);
     mp_image_unrefp(&d_video->current_mpi);
     if (d_video->vd_driver) {
         MP_VERBOSE(d_video, "Uninit video.\n");
@@ -140,7 +226,7 @@ bool video_init_best_codec(struct dec_video *d_video)
     struct MPOpts *opts = d_video->opts;
 
     assert(!d_video->vd_driver);
-    video_reset(d_video);
+    reset(d_video);
     d_video->has_broken_packet_pts = -10; // needs 10 packets to reach decision
 
     struct mp_decoder_entry *decoder = NULL;
@@ -166,6 +252,7 @@ bool video_init_best_codec(struct dec_video *d_video)
     }
 
     if (d_video->vd_driver) {
+        d_video->decoder_name = talloc_strdup(d_video, decoder->decoder);
         d_video->decoder_desc =
             talloc_asprintf(d_video, "%s (%s)", decoder->decoder, decoder->desc);
         MP_VERBOSE(d_video, "Selected video codec: %s\n", d_video->decoder_desc);
@@ -184,6 +271,55 @@ bool video_init_best_codec(struct dec_video *d_video)
     return !!d_video->vd_driver;
 }
 
+// Whether the decoder can be kept after its stream goes away, to be passed to
+// video_reuse() later. If true, the decoder is flushed, and must not be used
+// for anything else than video_reuse() or video_uninit() after this.
+bool video_can_reuse(struct dec_video *d_video)
+{
+    if (vd_control(d_video, VDCTRL_CHECK_REUSE, NULL) != CONTROL_TRUE)
+        return false;
+
+    reset(d_video);
+    d_video->recorder_sink = NULL;
+    d_video->header = NULL;
+    d_video->codec = NULL;
+    return true;
+}
+
+// Switch a decoder kept with video_can_reuse() to a new stream. This succeeds
+// only if the codec parameters are the same as the ones the decoder was opened
+// with, and the decoder selection would pick the same decoder again.
+bool video_reuse(struct dec_video *d_video, struct sh_stream *header)
+{
+    struct MPOpts *opts = d_video->opts;
+
+    struct mp_decoder_list *list = mp_select_video_decoders(d_video->log,
+                                                            header->codec->codec,
+                                                            opts->video_decoders);
+    bool ok = list->num_entries > 0 &&
+              strcmp(list->entries[0].decoder, d_video->decoder_name) == 0;
+    talloc_free(list);
+
+    if (!ok || vd_control(d_video, VDCTRL_CHECK_REUSE,
+                          header->codec) != CONTROL_TRUE)
+        return false;
+
+    d_video->header = header;
+    d_video->codec = header->codec;
+    d_video->fps = opts->force_fps ? opts->force_fps : header->codec->fps;
+    reset(d_video);
+    d_video->has_broken_packet_pts = -10;
+    d_video->num_codec_pts_problems = 0;
+    d_video->num_codec_dts_problems = 0;
+    d_video->stats.frame_time_avg = d_video->stats.frame_time_max = 0;
+    d_video->stats.frame_time_dev = 0;
+    d_video->framedrop_level = 0;
+    d_video->framedrop_stats = (struct dec_framedrop_stats){0};
+
+    MP_VERBOSE(d_video, "Reusing video decoder %s\n", d_video->decoder_desc);
+    return true;
+}
+
 static bool is_valid_peak(float sig_peak)
 {
     return !sig_peak || (sig_peak >= 1 && sig_peak <= 100);
@@ -364,7 +500,7 @@ static bool receive_frame(struct dec_video *d_video, struct mp_image **out_image
         mpi->pts != MP_NOPTS_VALUE && d_video->fps > 0)
     {
         int delay = -1;
-        video_vd_control(d_video, VDCTRL_GET_BFRAMES, &delay);
+        vd_control(d_video, VDCTRL_GET_BFRAMES, &delay);
         mpi->pts -= MPMAX(delay, 0) / d_video->fps;
     }
 
@@ -374,23 +510,67 @@ static bool receive_frame(struct dec_video *d_video, struct mp_image **out_image
 
 void video_reset_params(struct dec_video *d_video)
 {
+    lock_dec(d_video);
     d_video->last_format = (struct mp_image_params){0};
+    unlock_dec(d_video);
 }
 
 void video_get_dec_params(struct dec_video *d_video, struct mp_image_params *p)
 {
+    lock_dec(d_video);
     *p = d_video->dec_format;
+    unlock_dec(d_video);
 }
 
 void video_set_framedrop(struct dec_video *d_video, bool enabled)
 {
+    lock_dec(d_video);
     d_video->framedrop_enabled = enabled;
+    unlock_dec(d_video);
+}
+
+// Make decoding cheaper at the cost of quality, for --framedrop=decoder-tiered.
+//  0: normal decoding
+//  1: skip non-reference frames
+//  2: additionally skip the loop filter
+//  3: decode keyframes only
+void video_set_framedrop_level(struct dec_video *d_video, int level)
+{
+    lock_dec(d_video);
+    d_video->framedrop_level = MPCLAMP(level, 0, 3);
+    unlock_dec(d_video);
 }
 
 // Frames before the start timestamp can be dropped. (Used for hr-seek.)
 void video_set_start(struct dec_video *d_video, double start_pts)
 {
+    lock_dec(d_video);
     d_video->start_pts = start_pts;
+    unlock_dec(d_video);
+}
+
+void video_set_recorder_sink(struct dec_video *d_video,
+                             struct mp_recorder_sink *sink)
+{
+    lock_dec(d_video);
+    d_video->recorder_sink = sink;
+    unlock_dec(d_video);
+}
+
+static void feed_recorder(struct dec_video *d_video, struct demux_packet *pkt)
+{
+    struct dec_video_async *a = d_video->async;
+    if (!d_video->recorder_sink)
+        return;
+    if (a) {
+        // The recorder is not thread-safe; feed it from video_work().
+        pthread_mutex_lock(&a->lock);
+        MP_TARRAY_APPEND(a, a->rec_packets, a->num_rec_packets,
+                         demux_copy_packet(pkt));
+        pthread_mutex_unlock(&a->lock);
+    } else {
+        mp_recorder_feed_packet(d_video->recorder_sink, pkt);
+    }
 }
 
 static bool is_new_segment(struct dec_video *d_video, struct demux_packet *p)
@@ -400,7 +580,7 @@ static bool is_new_segment(struct dec_video *d_video, struct demux_packet *p)
          p->codec != d_video->codec);
 }
 
-void video_work(struct dec_video *d_video)
+static void work(struct dec_video *d_video)
 {
     if (d_video->current_mpi || !d_video->vd_driver)
         return;
@@ -434,8 +614,7 @@ void video_work(struct dec_video *d_video)
     d_video->vd_driver->control(d_video, VDCTRL_SET_FRAMEDROP, &framedrop_type);
 
     if (send_packet(d_video, d_video->packet)) {
-        if (d_video->recorder_sink)
-            mp_recorder_feed_packet(d_video->recorder_sink, d_video->packet);
+        feed_recorder(d_video, d_video->packet);
 
         talloc_free(d_video->packet);
         d_video->packet = NULL;
@@ -449,7 +628,16 @@ void video_work(struct dec_video *d_video)
     } else if (!d_video->current_mpi) {
         if (framedrop_type == 1)
             d_video->dropped_frames += 1;
+        if (framedrop_type == 2)
+            d_video->hrseek_dropped_frames += 1;
+        if (framedrop_type == 0 && d_video->framedrop_level >= 3) {
+            d_video->framedrop_stats.nonkey_dropped += 1;
+        } else if (framedrop_type == 0 && d_video->framedrop_level >= 1) {
+            d_video->framedrop_stats.nonref_dropped += 1;
+        }
         d_video->current_state = DATA_AGAIN;
+    } else if (d_video->framedrop_level >= 2) {
+        d_video->framedrop_stats.deblock_skipped += 1;
     }
 
     bool segment_ended = d_video->current_state == DATA_EOF;
@@ -471,7 +659,7 @@ void video_work(struct dec_video *d_video)
         d_video->new_segment = NULL;
 
         if (d_video->codec == new_segment->codec) {
-            video_reset(d_video);
+            reset(d_video);
         } else {
             d_video->codec = new_segment->codec;
             d_video->vd_driver->uninit(d_video);
@@ -487,12 +675,7 @@ void video_work(struct dec_video *d_video)
     }
 }
 
-// Fetch an image decoded with video_work(). Returns one of:
-//  DATA_OK:    *out_mpi is set to a new image
-//  DATA_WAIT:  waiting for demuxer; will receive a wakeup signal
-//  DATA_EOF:   end of file, no more frames to be expected
-//  DATA_AGAIN: dropped frame or something similar
-int video_get_frame(struct dec_video *d_video, struct mp_image **out_mpi)
+static int get_frame(struct dec_video *d_video, struct mp_image **out_mpi)
 {
     *out_mpi = NULL;
     if (d_video->current_mpi) {
@@ -504,3 +687,129 @@ int video_get_frame(struct dec_video *d_video, struct mp_image **out_mpi)
         return DATA_AGAIN;
     return d_video->current_state;
 }
+
+void video_work(struct dec_video *d_video)
+{
+    struct dec_video_async *a = d_video->async;
+    if (!a) {
+        work(d_video);
+        return;
+    }
+
+    pthread_mutex_lock(&a->lock);
+    a->work_gen++;
+    pthread_cond_broadcast(&a->wakeup);
+    struct demux_packet **pkts = a->rec_packets;
+    int num_pkts = a->num_rec_packets;
+    a->rec_packets = NULL;
+    a->num_rec_packets = 0;
+    pthread_mutex_unlock(&a->lock);
+
+    for (int n = 0; n < num_pkts; n++) {
+        if (d_video->recorder_sink)
+            mp_recorder_feed_packet(d_video->recorder_sink, pkts[n]);
+        talloc_free(pkts[n]);
+    }
+    talloc_free(pkts);
+}
+
+// Fetch an image decoded with video_work(). Returns one of:
+//  DATA_OK:    *out_mpi is set to a new image
+//  DATA_WAIT:  waiting for demuxer; will receive a wakeup signal
+//  DATA_EOF:   end of file, no more frames to be expected
+//  DATA_AGAIN: dropped frame or something similar
+int video_get_frame(struct dec_video *d_video, struct mp_image **out_mpi)
+{
+    struct dec_video_async *a = d_video->async;
+    if (!a)
+        return get_frame(d_video, out_mpi);
+
+    *out_mpi = NULL;
+    pthread_mutex_lock(&a->lock);
+    int res = a->eof ? DATA_EOF : DATA_WAIT;
+    if (a->num_frames) {
+        *out_mpi = a->frames[0];
+        MP_TARRAY_REMOVE_AT(a->frames, a->num_frames, 0);
+        pthread_cond_broadcast(&a->wakeup);
+        res = DATA_OK;
+    }
+    pthread_mutex_unlock(&a->lock);
+    return res;
+}
+
+static void *video_thread(void *ptr)
+{
+    struct dec_video *d_video = ptr;
+    struct dec_video_async *a = d_video->async;
+
+    mpthread_set_name("vdec");
+
+    while (1) {
+        pthread_mutex_lock(&a->lock);
+        while (!a->terminate && (a->eof || a->num_frames >= a->max_frames ||
+                                 a->wait_gen == a->work_gen))
+            pthread_cond_wait(&a->wakeup, &a->lock);
+        bool terminate = a->terminate;
+        int64_t gen = a->work_gen;
+        pthread_mutex_unlock(&a->lock);
+
+        if (terminate)
+            break;
+
+        pthread_mutex_lock(&a->dec_lock);
+        work(d_video);
+        struct mp_image *mpi;
+        int res = get_frame(d_video, &mpi);
+
+        pthread_mutex_lock(&a->lock);
+        if (res == DATA_OK)
+            MP_TARRAY_APPEND(a, a->frames, a->num_frames, mpi);
+        if (res == DATA_EOF)
+            a->eof = true;
+        // Wait until the demuxer wakes up the player, which calls video_work().
+        if (res == DATA_WAIT)
+            a->wait_gen = gen;
+        pthread_mutex_unlock(&a->lock);
+        pthread_mutex_unlock(&a->dec_lock);
+
+        if (res == DATA_OK || res == DATA_EOF)
+            a->wakeup_cb(a->wakeup_ctx);
+    }
+
+    return NULL;
+}
+
+// Decode on a separate thread, buffering up to max_frames decoded frames.
+// video_work() and video_get_frame() then only pass on requests and frames,
+// and wakeup_cb is called (from the decoder thread) when new output is
+// available. The packet source must be safe to read from the decoder thread,
+// i.e. the demuxer must use its own thread.
+bool video_start_thread(struct dec_video *d_video, int max_frames,
+                        void (*wakeup_cb)(void *ctx), void *wakeup_ctx)
+{
+    assert(!d_video->async);
+
+    struct dec_video_async *a = talloc_zero(NULL, struct dec_video_async);
+    *a = (struct dec_video_async){
+        .wait_gen = -1,
+        .max_frames = MPMAX(max_frames, 1),
+        .wakeup_cb = wakeup_cb,
+        .wakeup_ctx = wakeup_ctx,
+    };
+    pthread_mutex_init(&a->dec_lock, NULL);
+    pthread_mutex_init(&a->lock, NULL);
+    pthread_cond_init(&a->wakeup, NULL);
+    d_video->async = a;
+
+    if (pthread_create(&a->thread, NULL, video_thread, d_video)) {
+        pthread_cond_destroy(&a->wakeup);
+        pthread_mutex_destroy(&a->lock);
+        pthread_mutex_destroy(&a->dec_lock);
+        talloc_free(a);
+        d_video->async = NULL;
+        return false;
+    }
+
+    MP_VERBOSE(d_video, "Decoding on a separate thread.\n");
+    return true;
+}
@@ -27,6 +27,10 @@
 struct mp_decoder_list;
 struct vo;
 
+// With --video-lookahead, hardware decoders reserve this many extra surfaces
+// for the frames the player decodes ahead, and the player doesn't hold more.
+#define MAX_VIDEO_LOOKAHEAD_HW 4
+
 struct dec_video {
     struct mp_log *log;
     struct mpv_global *global;
@@ -38,11 +42,22 @@ struct dec_video {
     struct vo *vo; // required for direct rendering into video memory
 
     char *decoder_desc;
+    char *decoder_name;   // selected entry from the --vd list
 
     float fps;            // FPS from demuxer or from user override
 
     int dropped_frames;
 
+    // Updated by the decoder, if supported.
+    struct dec_video_stats {
+        double frame_time_avg;  // time spent decoding per frame (seconds)
+        double frame_time_max;
+        double frame_time_dev;  // standard deviation
+        int threads;
+        bool frame_threads;
+    } stats;
+    int hrseek_dropped_frames; // skipped by the decoder during hr-seek
+
     struct mp_recorder_sink *recorder_sink;
 
     // Internal (shared with vd_lavc.c).
@@ -77,20 +92,35 @@ struct dec_video {
     struct demux_packet *new_segment;
     struct demux_packet *packet;
     bool framedrop_enabled;
+    // --framedrop=decoder-tiered (see video_set_framedrop_level())
+    int framedrop_level;
+    struct dec_framedrop_stats {
+        int nonref_dropped;     // frames skipped at level 1 and 2
+        int deblock_skipped;    // frames decoded without loop filter
+        int nonkey_dropped;     // frames skipped at level 3
+    } framedrop_stats;
     struct mp_image *current_mpi;
     int current_state;
+    struct dec_video_async *async; // if decoding on a thread
 };
 
 struct mp_decoder_list *video_decoder_list(void);
 
 bool video_init_best_codec(struct dec_video *d_video);
 void video_uninit(struct dec_video *d_video);
+bool video_can_reuse(struct dec_video *d_video);
+bool video_reuse(struct dec_video *d_video, struct sh_stream *header);
 
 void video_work(struct dec_video *d_video);
 int video_get_frame(struct dec_video *d_video, struct mp_image **out_mpi);
 
 void video_set_framedrop(struct dec_video *d_video, bool enabled);
+void video_set_framedrop_level(struct dec_video *d_video, int level);
 void video_set_start(struct dec_video *d_video, double start_pts);
+void video_set_recorder_sink(struct dec_video *d_video,
+                             struct mp_recorder_sink *sink);
+bool video_start_thread(struct dec_video *d_video, int max_frames,
+                        void (*wakeup_cb)(void *ctx), void *wakeup_ctx);
 
 int video_vd_control(struct dec_video *d_video, int cmd, void *arg);
 void video_reset(struct dec_video *d_video);
@@ -40,6 +40,34 @@ typedef struct lavc_ctx {
     bool intra_only;
     int framedrop_flags;
 
+    // If set, rawvideo packets are wrapped as images of this format directly,
+    // instead of being passed through libavcodec (see wrap_raw_packet()).
+    int raw_imgfmt;
+    bool raw_copy_logged;
+
+    // --vd-lavc-thread-type=adaptive state
+    bool use_frame_threads;     // applied on the next init_avctx()
+    bool thread_switch_pending; // reinit with frame threads on next keyframe
+
+    // --vd-lavc-image-lowres factor, applied on the next init_avctx()
+    int lowres;
+
+    // Decode time statistics (see update_decode_stats())
+    int64_t stat_frame_us;      // time spent since the last output frame
+    int64_t stat_window_us;
+    int64_t stat_window_max_us;
+    double stat_window_sq;      // sum of squared frame times (in seconds)
+    int stat_window_frames;
+
+    // Codec parameters the decoder was opened with, for VDCTRL_CHECK_REUSE.
+    char *reuse_codec;
+    unsigned int reuse_codec_tag;
+    int reuse_w, reuse_h;
+    unsigned char *reuse_extradata;
+    int reuse_extradata_size;
+    int reuse_hwdec_api;
+    bool reuse_blocked;         // hwdec was given up on at runtime
+
     bool hw_probing;
     struct demux_packet **sent_packets;
     int num_sent_packets;
@@ -51,6 +51,10 @@ enum vd_ctrl {
     VDCTRL_GET_BFRAMES,
     // framedrop mode: 0=none, 1=standard, 2=hrseek
     VDCTRL_SET_FRAMEDROP,
+    // arg: struct mp_codec_params* (or NULL to check whether reuse is possible
+    // at all); returns CONTROL_TRUE if the decoder can decode this stream
+    // without being reopened
+    VDCTRL_CHECK_REUSE,
 };
 
 #endif /* MPLAYER_VD_H */
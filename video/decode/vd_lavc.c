@@ -17,10 +17,12 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <assert.h>
 #include <time.h>
 #include <stdbool.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include <libavutil/common.h>
 #include <libavutil/opt.h>
@@ -31,9 +33,11 @@
 #include "config.h"
 #include "common/msg.h"
 #include "options/options.h"
+#include "options/path.h"
 #include "misc/bstr.h"
 #include "common/av_common.h"
 #include "common/codecs.h"
+#include "osdep/timer.h"
 
 #include "video/fmt-conversion.h"
 
@@ -59,6 +63,7 @@
 static void init_avctx(struct dec_video *vd, const char *decoder,
                        struct vd_lavc_hwdec *hwdec);
 static void uninit_avctx(struct dec_video *vd);
+static bool decode_frame(struct dec_video *vd);
 
 static int get_buffer2_direct(AVCodecContext *avctx, AVFrame *pic, int flags);
 static enum AVPixelFormat get_format_hwdec(struct AVCodecContext *avctx,
@@ -74,11 +79,16 @@ struct vd_lavc_params {
     int skip_frame;
     int framedrop;
     int threads;
+    int thread_type;
     int bitexact;
     int check_hw_profile;
     int software_fallback;
     char **avopts;
     int dr;
+    int reuse;
+    int hwdec_cache;
+    char *hwdec_cache_file;
+    int image_lowres;
 };
 
 static const struct m_opt_choice_alternatives discard_names[] = {
@@ -103,12 +113,18 @@ const struct m_sub_options vd_lavc_conf = {
         OPT_DISCARD("skipframe", skip_frame, 0),
         OPT_DISCARD("framedrop", framedrop, 0),
         OPT_INT("threads", threads, M_OPT_MIN, .min = 0),
+        OPT_CHOICE("thread-type", thread_type, 0,
+                   ({"auto", 0}, {"slice", 1}, {"frame", 2}, {"adaptive", 3})),
         OPT_FLAG("bitexact", bitexact, 0),
         OPT_FLAG("check-hw-profile", check_hw_profile, 0),
         OPT_CHOICE_OR_INT("software-fallback", software_fallback, 0, 1, INT_MAX,
                           ({"no", INT_MAX}, {"yes", 1})),
         OPT_KEYVALUELIST("o", avopts, 0),
         OPT_FLAG("dr", dr, 0),
+        OPT_FLAG("reuse", reuse, 0),
+        OPT_FLAG("hwdec-cache", hwdec_cache, 0),
+        OPT_STRING("hwdec-cache-file", hwdec_cache_file, M_OPT_FILE),
+        OPT_FLAG("image-lowres", image_lowres, 0),
         {0}
     },
     .size = sizeof(struct vd_lavc_params),
@@ -432,6 +448,180 @@ static struct vd_lavc_hwdec *probe_hwdec(struct dec_video *vd, bool autoprobe,
     return NULL;
 }
 
+// Process-wide memory of which hwdecs worked or failed for which kind of
+// stream (--vd-lavc-hwdec-cache). This is used to skip hwdecs known not to work
+// when autoprobing, and to try the one that worked before first.
+struct hwdec_cache_entry {
+    int api;            // enum hwdec_type
+    char codec[32];
+    int profile;        // FF_PROFILE_*, as reported by the demuxer
+    int size_class;     // 0: up to 1080p, 1: up to 4K, 2: larger
+    bool ok;
+};
+
+static pthread_mutex_t hwdec_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct hwdec_cache_entry *hwdec_cache;
+static int hwdec_cache_num;
+static char *hwdec_cache_loaded; // file that was merged into hwdec_cache
+
+static bool hwdec_cache_enabled(struct dec_video *vd)
+{
+    struct vd_lavc_params *opts = vd->opts->vd_lavc_params;
+    return opts->hwdec_cache ||
+           (opts->hwdec_cache_file && opts->hwdec_cache_file[0]);
+}
+
+static void hwdec_cache_key(struct dec_video *vd, int api,
+                            struct hwdec_cache_entry *key)
+{
+    struct mp_codec_params *c = vd->codec;
+    int pixels = c->disp_w * c->disp_h;
+    *key = (struct hwdec_cache_entry){
+        .api = api,
+        .profile = c->lav_codecpar ? c->lav_codecpar->profile
+                                   : FF_PROFILE_UNKNOWN,
+        .size_class = pixels <= 1920 * 1088 ? 0 : pixels <= 4096 * 2304 ? 1 : 2,
+    };
+    snprintf(key->codec, sizeof(key->codec), "%s", c->codec);
+}
+
+static struct hwdec_cache_entry *hwdec_cache_find_locked(
+                                                struct hwdec_cache_entry *key)
+{
+    for (int n = 0; n < hwdec_cache_num; n++) {
+        struct hwdec_cache_entry *e = &hwdec_cache[n];
+        if (e->api == key->api && strcmp(e->codec, key->codec) == 0 &&
+            e->profile == key->profile && e->size_class == key->size_class)
+            return e;
+    }
+    return NULL;
+}
+
+static void hwdec_cache_add_locked(struct hwdec_cache_entry *entry)
+{
+    struct hwdec_cache_entry *e = hwdec_cache_find_locked(entry);
+    if (e) {
+        *e = *entry;
+    } else {
+        MP_TARRAY_APPEND(NULL, hwdec_cache, hwdec_cache_num, *entry);
+    }
+}
+
+// Merge the --vd-lavc-hwdec-cache-file contents into the cache (once).
+static void hwdec_cache_load_locked(struct dec_video *vd, const char *file)
+{
+    if (hwdec_cache_loaded && strcmp(hwdec_cache_loaded, file) == 0)
+        return;
+    talloc_free(hwdec_cache_loaded);
+    hwdec_cache_loaded = talloc_strdup(NULL, file);
+
+    FILE *f = fopen(file, "r");
+    if (!f)
+        return;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        char name[32], res[8];
+        struct hwdec_cache_entry e = {0};
+        if (sscanf(line, "%31s %31s %d %d %7s", name, e.codec, &e.profile,
+                   &e.size_class, res) != 5)
+            continue;
+        for (int n = 0; mp_hwdec_names[n].name; n++) {
+            if (strcmp(mp_hwdec_names[n].name, name) == 0)
+                e.api = mp_hwdec_names[n].value;
+        }
+        e.ok = strcmp(res, "ok") == 0;
+        if (e.api > 0)
+            hwdec_cache_add_locked(&e);
+    }
+    fclose(f);
+    MP_VERBOSE(vd, "Loaded hwdec cache from '%s'.\n", file);
+}
+
+static void hwdec_cache_save_locked(struct dec_video *vd, const char *file)
+{
+    void *tmp = talloc_new(NULL);
+
+    mp_mkdirp(bstrto0(tmp, mp_dirname(file)));
+
+    char *tmpname = talloc_asprintf(tmp, "%s.tmp", file);
+    FILE *f = fopen(tmpname, "w");
+    bool ok = !!f;
+    for (int n = 0; ok && n < hwdec_cache_num; n++) {
+        struct hwdec_cache_entry *e = &hwdec_cache[n];
+        ok = fprintf(f, "%s %s %d %d %s\n",
+                     m_opt_choice_str(mp_hwdec_names, e->api), e->codec,
+                     e->profile, e->size_class, e->ok ? "ok" : "fail") > 0;
+    }
+    if (f && fclose(f))
+        ok = false;
+    if (ok && rename(tmpname, file)) {
+        // Windows does not replace existing files with rename().
+        unlink(file);
+        ok = !rename(tmpname, file);
+    }
+    if (!ok) {
+        MP_WARN(vd, "Could not write '%s'.\n", file);
+        unlink(tmpname);
+    }
+    talloc_free(tmp);
+}
+
+// Return the cache path, or NULL if there is no cache file.
+static char *hwdec_cache_file(struct dec_video *vd, void *ta_ctx)
+{
+    char *file = vd->opts->vd_lavc_params->hwdec_cache_file;
+    if (!file || !file[0])
+        return NULL;
+    return mp_get_user_path(ta_ctx, vd->global, file);
+}
+
+// Returns 1 if the hwdec worked for this kind of stream, 0 if it failed, and -1
+// if it is unknown (or the cache is disabled).
+static int hwdec_cache_lookup(struct dec_video *vd, int api)
+{
+    if (!hwdec_cache_enabled(vd))
+        return -1;
+
+    struct hwdec_cache_entry key;
+    hwdec_cache_key(vd, api, &key);
+
+    char *file = hwdec_cache_file(vd, NULL);
+    pthread_mutex_lock(&hwdec_cache_lock);
+    if (file)
+        hwdec_cache_load_locked(vd, file);
+    struct hwdec_cache_entry *e = hwdec_cache_find_locked(&key);
+    int res = e ? e->ok : -1;
+    pthread_mutex_unlock(&hwdec_cache_lock);
+    talloc_free(file);
+    return res;
+}
+
+static void hwdec_cache_store(struct dec_video *vd, int api, bool ok)
+{
+    if (!hwdec_cache_enabled(vd))
+        return;
+
+    struct hwdec_cache_entry key;
+    hwdec_cache_key(vd, api, &key);
+    key.ok = ok;
+
+    char *file = hwdec_cache_file(vd, NULL);
+    pthread_mutex_lock(&hwdec_cache_lock);
+    if (file)
+        hwdec_cache_load_locked(vd, file);
+    struct hwdec_cache_entry *e = hwdec_cache_find_locked(&key);
+    if (!e || e->ok != ok) {
+        MP_VERBOSE(vd, "Remembering that '%s' %s for this stream type.\n",
+                   m_opt_choice_str(mp_hwdec_names, api),
+                   ok ? "works" : "does not work");
+        hwdec_cache_add_locked(&key);
+        if (file)
+            hwdec_cache_save_locked(vd, file);
+    }
+    pthread_mutex_unlock(&hwdec_cache_lock);
+    talloc_free(file);
+}
+
 static void uninit(struct dec_video *vd)
 {
     vd_ffmpeg_ctx *ctx = vd->priv;
@@ -447,6 +637,7 @@ static void force_fallback(struct dec_video *vd)
     vd_ffmpeg_ctx *ctx = vd->priv;
 
     uninit_avctx(vd);
+    ctx->reuse_blocked = true;
     int lev = ctx->hwdec_notified ? MSGL_WARN : MSGL_V;
     mp_msg(vd->log, lev, "Falling back to software decoding.\n");
     init_avctx(vd, ctx->decoder, NULL);
@@ -479,8 +670,32 @@ static void reinit(struct dec_video *vd)
                 if (hwdec_is_wrapper(other, decoder))
                     might_be_wrapper = true;
             }
+            // Try hwdecs that worked before for this kind of stream first, and
+            // skip the ones that failed.
+            const struct vd_lavc_hwdec *order[MP_ARRAY_SIZE(hwdec_list)];
+            int cached[MP_ARRAY_SIZE(hwdec_list)];
+            int num_order = 0;
+            for (int n = 0; hwdec_list[n]; n++) {
+                cached[n] = hwdec_cache_lookup(vd, hwdec_list[n]->type);
+                if (cached[n] == 1)
+                    order[num_order++] = hwdec_list[n];
+            }
             for (int n = 0; hwdec_list[n]; n++) {
-                hwdec = probe_hwdec(vd, true, hwdec_list[n]->type, codec);
+                if (cached[n] < 0)
+                    order[num_order++] = hwdec_list[n];
+                if (cached[n] == 0) {
+                    MP_VERBOSE(vd, "Skipping '%s', which did not work before.\n",
+                               m_opt_choice_str(mp_hwdec_names,
+                                                hwdec_list[n]->type));
+                }
+            }
+            for (int n = 0; n < num_order; n++) {
+                const struct vd_lavc_hwdec *cand = order[n];
+                hwdec = probe_hwdec(vd, true, cand->type, codec);
+                // Only hwdecs with their own device fail independently from
+                // the VO, and are expensive to probe.
+                if (!hwdec && (cand->create_dev || cand->create_standalone_dev))
+                    hwdec_cache_store(vd, cand->type, false);
                 if (hwdec) {
                     if (might_be_wrapper && !hwdec_is_wrapper(hwdec, decoder)) {
                         MP_VERBOSE(vd, "This hwaccel is not compatible.\n");
@@ -514,8 +729,15 @@ static void reinit(struct dec_video *vd)
     }
 
     init_avctx(vd, decoder, hwdec);
-    if (!ctx->avctx && hwdec)
+    if (!ctx->avctx && hwdec) {
+        hwdec_cache_store(vd, hwdec->type, false);
         force_fallback(vd);
+    }
+
+    // A fallback during init would happen again for the same codec, so it
+    // does not prevent reuse; only runtime fallbacks do.
+    ctx->reuse_hwdec_api = vd->opts->hwdec_api;
+    ctx->reuse_blocked = false;
 }
 
 static int init(struct dec_video *vd, const char *decoder)
@@ -537,9 +759,49 @@ static int init(struct dec_video *vd, const char *decoder)
         uninit(vd);
         return 0;
     }
+
+    struct mp_codec_params *c = vd->codec;
+    ctx->reuse_codec = talloc_strdup(ctx, c->codec);
+    ctx->reuse_codec_tag = c->codec_tag;
+    ctx->reuse_w = c->disp_w;
+    ctx->reuse_h = c->disp_h;
+    if (c->extradata_size) {
+        ctx->reuse_extradata =
+            talloc_memdup(ctx, c->extradata, c->extradata_size);
+        ctx->reuse_extradata_size = c->extradata_size;
+    }
     return 1;
 }
 
+static bool can_reuse(struct dec_video *vd, struct mp_codec_params *c)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+
+    if (!ctx->opts->vd_lavc_params->reuse || !ctx->avctx ||
+        ctx->reuse_blocked || ctx->hwdec_failed)
+        return false;
+
+    if (!c)
+        return true;
+
+    if (vd->opts->hwdec_api != ctx->reuse_hwdec_api)
+        return false;
+
+    // The codec timebase is set on opening, and can't be changed later.
+    AVRational tb = mp_get_codec_timebase(c);
+    if (strstr(ctx->decoder, "_mmal"))
+        tb = (AVRational){1, 1000000};
+    if (av_cmp_q(tb, ctx->codec_timebase) != 0)
+        return false;
+
+    return strcmp(c->codec, ctx->reuse_codec) == 0 &&
+           c->codec_tag == ctx->reuse_codec_tag &&
+           c->disp_w == ctx->reuse_w && c->disp_h == ctx->reuse_h &&
+           c->extradata_size == ctx->reuse_extradata_size &&
+           (!c->extradata_size ||
+            memcmp(c->extradata, ctx->reuse_extradata, c->extradata_size) == 0);
+}
+
 static void init_avctx(struct dec_video *vd, const char *decoder,
                        struct vd_lavc_hwdec *hwdec)
 {
@@ -600,6 +862,16 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
         ctx->hw_probing = true;
     } else {
         mp_set_avcodec_threads(vd->log, avctx, lavc_param->threads);
+        switch (lavc_param->thread_type) {
+        case 1: avctx->thread_type = FF_THREAD_SLICE; break;
+        case 2: avctx->thread_type = FF_THREAD_FRAME; break;
+        case 3:
+            // Start without the latency of frame threading, and switch to it
+            // only if decoding turns out to be too slow.
+            avctx->thread_type =
+                ctx->use_frame_threads ? FF_THREAD_FRAME : FF_THREAD_SLICE;
+            break;
+        }
     }
 
     if (!ctx->hwdec && vd->vo && lavc_param->dr) {
@@ -618,6 +890,9 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
     avctx->skip_idct = lavc_param->skip_idct;
     avctx->skip_frame = lavc_param->skip_frame;
 
+    if (!ctx->hwdec)
+        avctx->lowres = MPMIN(ctx->lowres, lavc_codec->max_lowres);
+
     mp_set_avopts(vd->log, avctx, lavc_param->avopts);
 
     // Do this after the above avopt handling in case it changes values
@@ -632,6 +907,29 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
     if (avcodec_open2(avctx, lavc_codec, NULL) < 0)
         goto error;
 
+    vd->stats.threads = avctx->thread_count;
+    vd->stats.frame_threads = avctx->active_thread_type & FF_THREAD_FRAME;
+
+    // Raw frames with an explicitly given pixel format and no container
+    // quirks (tags, flipping, palettes) are just the tightly packed planes,
+    // so they can reference the packet data (e.g. a mmapped file) directly.
+    ctx->raw_imgfmt = 0;
+    AVCodecParameters *par = c->lav_codecpar;
+    if (!ctx->hwdec && avctx->codec_id == AV_CODEC_ID_RAWVIDEO && par &&
+        par->format == avctx->pix_fmt && avctx->pix_fmt != AV_PIX_FMT_NONE &&
+        !par->codec_tag && !par->bits_per_coded_sample &&
+        !par->extradata_size && avctx->width > 0 && avctx->height > 0)
+    {
+        int imgfmt = pixfmt2imgfmt(avctx->pix_fmt);
+        struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(imgfmt);
+        if ((desc.flags & MP_IMGFLAG_BYTE_ALIGNED) &&
+            !(desc.flags & (MP_IMGFLAG_PAL | MP_IMGFLAG_HWACCEL)))
+        {
+            MP_VERBOSE(vd, "Using direct rawvideo frames.\n");
+            ctx->raw_imgfmt = imgfmt;
+        }
+    }
+
     return;
 
 error:
@@ -665,6 +963,8 @@ static void flush_all(struct dec_video *vd)
         talloc_free(ctx->requeue_packets[n]);
     ctx->num_requeue_packets = 0;
 
+    ctx->stat_frame_us = 0;
+
     reset_avctx(vd);
 }
 
@@ -746,8 +1046,12 @@ static int init_generic_hwaccel(struct dec_video *vd, enum AVPixelFormat hw_fmt)
 
     // 1 surface is already included by libavcodec. The field is 0 if the
     // hwaccel supports dynamic surface allocation.
-    if (new_fctx->initial_pool_size)
+    if (new_fctx->initial_pool_size) {
         new_fctx->initial_pool_size += HWDEC_EXTRA_SURFACES - 1;
+        // Room for the frames the player decodes ahead.
+        if (ctx->opts->video_lookahead)
+            new_fctx->initial_pool_size += MAX_VIDEO_LOOKAHEAD_HW;
+    }
 
     if (ctx->hwdec->hwframes_refine)
         ctx->hwdec->hwframes_refine(ctx, new_frames_ctx);
@@ -825,6 +1129,7 @@ static enum AVPixelFormat get_format_hwdec(struct AVCodecContext *avctx,
 
     if (select == AV_PIX_FMT_NONE) {
         ctx->hwdec_failed = true;
+        hwdec_cache_store(vd, ctx->hwdec->type, false);
         for (int i = 0; fmt[i] != AV_PIX_FMT_NONE; i++) {
             const AVPixFmtDescriptor *d = av_pix_fmt_desc_get(fmt[i]);
             if (d && !(d->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
@@ -939,8 +1244,18 @@ static bool prepare_decoding(struct dec_video *vd)
             avctx->skip_frame = AVDISCARD_ALL;
     } else {
         avctx->skip_frame = ctx->skip_frame;    // normal playback
+        // --framedrop=decoder-tiered
+        int level = vd->framedrop_level;
+        if (level >= 3) {
+            avctx->skip_frame = MPMAX(avctx->skip_frame, AVDISCARD_NONKEY);
+        } else if (level >= 1) {
+            avctx->skip_frame = MPMAX(avctx->skip_frame, AVDISCARD_NONREF);
+        }
     }
 
+    avctx->skip_loop_filter = vd->framedrop_level >= 2
+        ? AVDISCARD_ALL : opts->skip_loop_filter;
+
     if (ctx->hwdec_request_reinit)
         reset_avctx(vd);
 
@@ -961,9 +1276,210 @@ static void handle_err(struct dec_video *vd)
     }
 }
 
+// Account time spent in libavcodec. Every 32 output frames, the statistics are
+// updated, and --vd-lavc-thread-type=adaptive decides whether to switch to
+// frame threading.
+static void update_decode_stats(struct dec_video *vd, int64_t us, bool frame)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    struct vd_lavc_params *opts = ctx->opts->vd_lavc_params;
+
+    ctx->stat_frame_us += us;
+    if (!frame)
+        return;
+
+    ctx->stat_window_us += ctx->stat_frame_us;
+    ctx->stat_window_max_us = MPMAX(ctx->stat_window_max_us, ctx->stat_frame_us);
+    ctx->stat_window_sq += (ctx->stat_frame_us / 1e6) * (ctx->stat_frame_us / 1e6);
+    ctx->stat_frame_us = 0;
+    if (++ctx->stat_window_frames < 32)
+        return;
+
+    double avg = ctx->stat_window_us / 1e6 / ctx->stat_window_frames;
+    vd->stats.frame_time_avg = avg;
+    vd->stats.frame_time_max = ctx->stat_window_max_us / 1e6;
+    double var = ctx->stat_window_sq / ctx->stat_window_frames - avg * avg;
+    vd->stats.frame_time_dev = sqrt(MPMAX(var, 0));
+    ctx->stat_window_us = ctx->stat_window_max_us = 0;
+    ctx->stat_window_sq = 0;
+    ctx->stat_window_frames = 0;
+
+    double frame_duration = vd->fps > 0 ? 1.0 / vd->fps : 0;
+    if (opts->thread_type == 3 && !ctx->hwdec && !ctx->use_frame_threads &&
+        frame_duration > 0 && avg > frame_duration * 0.75)
+    {
+        MP_VERBOSE(vd, "Decoding takes %.1f ms per frame (frame duration "
+                   "%.1f ms), switching to frame threading.\n", avg * 1e3,
+                   frame_duration * 1e3);
+        ctx->use_frame_threads = true;
+        ctx->thread_switch_pending = true;
+    }
+}
+
+// Recreate the decoder with the new threading mode. Done on a keyframe, after
+// draining the old decoder, so no frames are lost.
+// Reopen the decoder (to apply settings that libavcodec allows to be set only
+// on init), keeping the frames it already decoded.
+static void reopen_avctx(struct dec_video *vd)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+
+    if (avcodec_send_packet(ctx->avctx, NULL) >= 0) {
+        for (int n = 0; n < 64 && ctx->avctx; n++) {
+            if (!decode_frame(vd))
+                break;
+        }
+    }
+
+    struct mp_image **queue = ctx->delay_queue;
+    int num_queue = ctx->num_delay_queue;
+    ctx->delay_queue = NULL;
+    ctx->num_delay_queue = 0;
+
+    uninit_avctx(vd);
+    init_avctx(vd, ctx->decoder, NULL);
+
+    talloc_free(ctx->delay_queue);
+    ctx->delay_queue = queue;
+    ctx->num_delay_queue = num_queue;
+}
+
+static void switch_threading(struct dec_video *vd)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+
+    ctx->thread_switch_pending = false;
+    reopen_avctx(vd);
+}
+
+// Read the image size from the SOF marker of a baseline/extended JPEG.
+// (Progressive and lossless images are not decoded with lowres.)
+static bool jpeg_get_size(uint8_t *d, int size, int *w, int *h)
+{
+    if (size < 4 || d[0] != 0xFF || d[1] != 0xD8)
+        return false;
+    int pos = 2;
+    while (pos + 4 <= size) {
+        if (d[pos] != 0xFF)
+            return false;
+        int marker = d[pos + 1];
+        if (marker == 0xFF) { // fill byte
+            pos++;
+            continue;
+        }
+        if (marker == 0xC0 || marker == 0xC1) {
+            if (pos + 9 > size)
+                return false;
+            *h = AV_RB16(d + pos + 5);
+            *w = AV_RB16(d + pos + 7);
+            return *w > 0 && *h > 0;
+        }
+        // Other SOF types, or start of scan without SOF.
+        if ((marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 &&
+             marker != 0xC8 && marker != 0xCC) || marker == 0xDA)
+            return false;
+        pos += 2 + AV_RB16(d + pos + 2);
+    }
+    return false;
+}
+
+// Pick the lowres factor for a still image, so that the decoded image is
+// as small as possible while still not being upscaled to the window size.
+static int get_image_lowres(struct dec_video *vd, struct demux_packet *pkt)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+
+    int max_lowres = ctx->avctx->codec->max_lowres;
+    if (!vd->vo || !max_lowres || ctx->avctx->codec_id != AV_CODEC_ID_MJPEG)
+        return 0;
+
+    int w, h, win_w, win_h;
+    if (!jpeg_get_size(pkt->buffer, pkt->len, &w, &h))
+        return 0;
+    vo_get_window_size(vd->vo, &win_w, &win_h);
+    if (win_w <= 0 || win_h <= 0)
+        return 0;
+    if (vd->codec->rotate % 180 == 90)
+        MPSWAP(int, win_w, win_h);
+
+    double scale = MPMIN(win_w / (double)w, win_h / (double)h);
+    int lowres = 0;
+    while (lowres < max_lowres &&
+           AV_CEIL_RSHIFT(w, lowres + 1) >= w * scale &&
+           AV_CEIL_RSHIFT(h, lowres + 1) >= h * scale)
+        lowres++;
+    return lowres;
+}
+
+// Turn a rawvideo packet into an image referencing the packet data, which
+// avoids copying for packets backed by mmapped files. Planes that are not
+// aligned for SIMD access are copied into a newly allocated image.
+static struct mp_image *wrap_raw_packet(struct dec_video *vd,
+                                        struct demux_packet *pkt)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+    struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(ctx->raw_imgfmt);
+
+    struct mp_image img = {0};
+    mp_image_setfmt(&img, ctx->raw_imgfmt);
+    mp_image_set_size(&img, ctx->avctx->width, ctx->avctx->height);
+
+    // Same layout as av_image_fill_arrays() with align=1.
+    bool aligned = true;
+    int64_t offset = 0;
+    for (int n = 0; n < desc.num_planes; n++) {
+        int w = mp_chroma_div_up(img.w, desc.xs[n]);
+        int h = mp_chroma_div_up(img.h, desc.ys[n]);
+        img.stride[n] = (w * desc.bpp[n] + 7) / 8;
+        img.planes[n] = pkt->buffer + offset;
+        offset += img.stride[n] * (int64_t)h;
+        if ((uintptr_t)img.planes[n] % SWS_MIN_BYTE_ALIGN)
+            aligned = false;
+    }
+    if (offset > pkt->len) {
+        MP_WARN(vd, "Raw frame too small (%d bytes, need %"PRId64").\n",
+                pkt->len, offset);
+        return NULL;
+    }
+
+    AVBufferRef *buf = pkt->avpacket ? pkt->avpacket->buf : NULL;
+    if (buf && aligned) {
+        struct mp_image *res = mp_image_new_dummy_ref(&img);
+        res->bufs[0] = av_buffer_ref(buf);
+        if (!res->bufs[0])
+            TA_FREEP(&res);
+        return res;
+    }
+
+    if (!ctx->raw_copy_logged) {
+        MP_VERBOSE(vd, "Copying raw frames (%s).\n",
+                   buf ? "unaligned frame size" : "packet not refcounted");
+        ctx->raw_copy_logged = true;
+    }
+    return mp_image_new_copy(&img);
+}
+
 static bool do_send_packet(struct dec_video *vd, struct demux_packet *pkt)
 {
     vd_ffmpeg_ctx *ctx = vd->priv;
+
+    if (ctx->thread_switch_pending && pkt && pkt->keyframe && ctx->avctx &&
+        !ctx->hw_probing && !ctx->num_requeue_packets)
+        switch_threading(vd);
+
+    // Decode large images only at the resolution they are displayed at. The
+    // decoder has to be reopened to change this, which is cheap for JPEG.
+    if (vd->opts->vd_lavc_params->image_lowres && vd->codec->image && pkt &&
+        ctx->avctx && !ctx->hwdec && !ctx->num_requeue_packets)
+    {
+        int lowres = get_image_lowres(vd, pkt);
+        if (lowres != ctx->lowres) {
+            MP_VERBOSE(vd, "Decoding image at 1/%d size.\n", 1 << lowres);
+            ctx->lowres = lowres;
+            reopen_avctx(vd);
+        }
+    }
+
     AVCodecContext *avctx = ctx->avctx;
 
     if (!prepare_decoding(vd))
@@ -972,10 +1488,26 @@ static bool do_send_packet(struct dec_video *vd, struct demux_packet *pkt)
     if (avctx->skip_frame == AVDISCARD_ALL)
         return true;
 
+    // EOF still goes to libavcodec, which has no frames and just signals EOF.
+    if (ctx->raw_imgfmt && pkt) {
+        struct mp_image *mpi = wrap_raw_packet(vd, pkt);
+        if (mpi) {
+            mpi->pts = pkt->pts;
+            mpi->dts = pkt->dts;
+            mpi->pkt_duration = pkt->duration;
+            MP_TARRAY_APPEND(ctx, ctx->delay_queue, ctx->num_delay_queue, mpi);
+        } else {
+            handle_err(vd);
+        }
+        return true;
+    }
+
     AVPacket avpkt;
     mp_set_av_packet(&avpkt, pkt, &ctx->codec_timebase);
 
+    int64_t t0 = mp_time_us();
     int ret = avcodec_send_packet(avctx, pkt ? &avpkt : NULL);
+    update_decode_stats(vd, mp_time_us() - t0, false);
     if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
         return false;
 
@@ -1013,7 +1545,9 @@ static bool decode_frame(struct dec_video *vd)
     if (!prepare_decoding(vd))
         return true;
 
+    int64_t t0 = mp_time_us();
     int ret = avcodec_receive_frame(avctx, ctx->pic);
+    update_decode_stats(vd, mp_time_us() - t0, ctx->pic->buf[0]);
     if (ret == AVERROR_EOF) {
         // If flushing was initialized earlier and has ended now, make it start
         // over in case we get new packets at some point in the future.
@@ -1108,6 +1642,7 @@ static bool receive_frame(struct dec_video *vd, struct mp_image **out_image)
         if (ctx->hwdec) {
             MP_INFO(vd, "Using hardware decoding (%s).\n",
                     m_opt_choice_str(mp_hwdec_names, ctx->hwdec->type));
+            hwdec_cache_store(vd, ctx->hwdec->type, true);
         } else {
             MP_VERBOSE(vd, "Using software decoding.\n");
         }
@@ -1157,6 +1692,8 @@ static int control(struct dec_video *vd, int cmd, void *arg)
     case VDCTRL_REINIT:
         reinit(vd);
         return CONTROL_TRUE;
+    case VDCTRL_CHECK_REUSE:
+        return can_reuse(vd, arg) ? CONTROL_TRUE : CONTROL_FALSE;
     }
     return CONTROL_UNKNOWN;
 }
@@ -31,13 +31,36 @@ struct mp_refqueue {
     bool eof;
 
     // Queue of input frames, used to determine past/current/future frames.
-    // queue[0] is the newest frame, queue[num_queue - 1] the oldest.
-    struct mp_image **queue;
+    // This is a ring buffer with ring[head] being the newest frame. Use
+    // queue_at() for access.
+    struct mp_image **ring;
+    int ring_size;
+    int head;
     int num_queue;
-    // queue[pos] is the current frame, unless pos is an invalid index.
+    // queue_at(pos) is the current frame, unless pos is an invalid index.
     int pos;
 };
 
+// Return the frame at the logical position i, 0 being the newest frame, and
+// num_queue - 1 the oldest.
+static struct mp_image **queue_at(struct mp_refqueue *q, int i)
+{
+    assert(i >= 0 && i < q->num_queue);
+    return &q->ring[(q->head + i) % q->ring_size];
+}
+
+static void resize_ring(struct mp_refqueue *q, int size)
+{
+    assert(size >= q->num_queue);
+    struct mp_image **ring = talloc_zero_array(q, struct mp_image *, size);
+    for (int n = 0; n < q->num_queue; n++)
+        ring[n] = *queue_at(q, n);
+    talloc_free(q->ring);
+    q->ring = ring;
+    q->ring_size = size;
+    q->head = 0;
+}
+
 struct mp_refqueue *mp_refqueue_alloc(void)
 {
     struct mp_refqueue *q = talloc_zero(NULL, struct mp_refqueue);
@@ -57,6 +80,12 @@ void mp_refqueue_set_refs(struct mp_refqueue *q, int past, int future)
     assert(past >= 0 && future >= 0);
     q->needed_past_frames = past;
     q->needed_future_frames = MPMAX(future, 1); // at least 1 for determining PTS
+
+    // Past frames, current frame, future frames, and the frame that is added
+    // before mp_refqueue_next() discards the oldest one.
+    int size = q->needed_past_frames + q->needed_future_frames + 2;
+    if (size > q->ring_size)
+        resize_ring(q, size);
 }
 
 // MP_MODE_* flags
@@ -71,7 +100,7 @@ bool mp_refqueue_should_deint(struct mp_refqueue *q)
     if (!mp_refqueue_has_output(q) || !(q->flags & MP_MODE_DEINT))
         return false;
 
-    return (q->queue[q->pos]->fields & MP_IMGFIELD_INTERLACED) ||
+    return ((*queue_at(q, q->pos))->fields & MP_IMGFIELD_INTERLACED) ||
            !(q->flags & MP_MODE_INTERLACED_ONLY);
 }
 
@@ -82,7 +111,8 @@ bool mp_refqueue_is_top_field(struct mp_refqueue *q)
     if (!mp_refqueue_has_output(q))
         return false;
 
-    return !!(q->queue[q->pos]->fields & MP_IMGFIELD_TOP_FIRST) ^ q->second_field;
+    return !!((*queue_at(q, q->pos))->fields & MP_IMGFIELD_TOP_FIRST) ^
+           q->second_field;
 }
 
 // Whether top-field-first mode is enabled.
@@ -91,15 +121,16 @@ bool mp_refqueue_top_field_first(struct mp_refqueue *q)
     if (!mp_refqueue_has_output(q))
         return false;
 
-    return q->queue[q->pos]->fields & MP_IMGFIELD_TOP_FIRST;
+    return (*queue_at(q, q->pos))->fields & MP_IMGFIELD_TOP_FIRST;
 }
 
 // Discard all state.
 void mp_refqueue_flush(struct mp_refqueue *q)
 {
     for (int n = 0; n < q->num_queue; n++)
-        talloc_free(q->queue[n]);
+        talloc_free(*queue_at(q, n));
     q->num_queue = 0;
+    q->head = 0;
     q->pos = -1;
     q->second_field = false;
     q->eof = false;
@@ -116,7 +147,13 @@ void mp_refqueue_add_input(struct mp_refqueue *q, struct mp_image *img)
     if (!img)
         return;
 
-    MP_TARRAY_INSERT_AT(q, q->queue, q->num_queue, 0, img);
+    // Only happens if the caller adds more frames than needed.
+    if (q->num_queue == q->ring_size)
+        resize_ring(q, MPMAX(q->ring_size * 2, 4));
+
+    q->head = (q->head + q->ring_size - 1) % q->ring_size;
+    q->num_queue++;
+    *queue_at(q, 0) = img;
     q->pos++;
 
     assert(q->pos >= 0 && q->pos < q->num_queue);
@@ -147,8 +184,9 @@ static bool output_next_field(struct mp_refqueue *q)
     if (q->pos == 0)
         return false;
 
-    double pts = q->queue[q->pos]->pts;
-    double next_pts = q->queue[q->pos - 1]->pts;
+    struct mp_image *cur = *queue_at(q, q->pos);
+    double pts = cur->pts;
+    double next_pts = (*queue_at(q, q->pos - 1))->pts;
     if (pts == MP_NOPTS_VALUE || next_pts == MP_NOPTS_VALUE)
         return false;
 
@@ -156,7 +194,7 @@ static bool output_next_field(struct mp_refqueue *q)
     if (frametime <= 0.0 || frametime >= 1.0)
         return false;
 
-    q->queue[q->pos]->pts = pts + frametime / 2;
+    cur->pts = pts + frametime / 2;
     q->second_field = true;
     return true;
 }
@@ -185,7 +223,7 @@ void mp_refqueue_next(struct mp_refqueue *q)
     // Discard unneeded past frames.
     while (q->num_queue - (q->pos + 1) > q->needed_past_frames) {
         assert(q->num_queue > 0);
-        talloc_free(q->queue[q->num_queue - 1]);
+        talloc_free(*queue_at(q, q->num_queue - 1));
         q->num_queue--;
     }
 
@@ -200,7 +238,7 @@ void mp_refqueue_next(struct mp_refqueue *q)
 struct mp_image *mp_refqueue_get(struct mp_refqueue *q, int pos)
 {
     int i = q->pos - pos;
-    return i >= 0 && i < q->num_queue ? q->queue[i] : NULL;
+    return i >= 0 && i < q->num_queue ? *queue_at(q, i) : NULL;
 }
 
 // Same as mp_refqueue_get(), but return the frame which contains a field
@@ -19,10 +19,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <limits.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <libavutil/buffer.h>
 #include <libavutil/common.h>
 #include <libavutil/mem.h>
+#include <libavutil/pixdesc.h>
 
 #include "config.h"
 
@@ -33,17 +36,21 @@
 #include "options/m_config.h"
 
 #include "options/options.h"
+#include "osdep/threads.h"
 
 #include "video/img_format.h"
+#include "video/fmt-conversion.h"
 #include "video/mp_image.h"
 #include "video/mp_image_pool.h"
 #include "vf.h"
 
+extern const vf_info_t vf_info_gpu;
 extern const vf_info_t vf_info_lavfi;
 extern const vf_info_t vf_info_lavfi_bridge;
 
 // list of available filters:
 static const vf_info_t *const filter_list[] = {
+    &vf_info_gpu,
     &vf_info_lavfi,
     &vf_info_lavfi_bridge,
     NULL
@@ -51,6 +58,61 @@ static const vf_info_t *const filter_list[] = {
 
 static void vf_uninit_filter(vf_instance_t *vf);
 
+// Maximum number of frames queued to/from a filter running on its own thread.
+#define VF_ASYNC_FRAMES 4
+
+// --vf-async state. The main thread feeds frames into in[], the worker thread
+// calls the filter callbacks and puts the results into out[]. While the main
+// thread calls anything else on the filter (control, reconfig, reset), the
+// worker is paused with async_pause().
+struct vf_async {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    struct mp_image **in;
+    int num_in;
+    struct mp_image **out;
+    int num_out;
+    bool busy;          // worker thread is inside the filter
+    int paused;         // >0: worker must not call the filter
+    bool terminate;
+    int error;          // error from filtering, returned on the next input
+};
+
+// Wait until the worker thread is not calling the filter, and prevent it from
+// doing so until async_resume() is called (calls can be nested).
+static void async_pause(struct vf_instance *vf)
+{
+    struct vf_async *a = vf->async;
+    if (!a)
+        return;
+    pthread_mutex_lock(&a->lock);
+    a->paused++;
+    while (a->busy)
+        pthread_cond_wait(&a->wakeup, &a->lock);
+    pthread_mutex_unlock(&a->lock);
+}
+
+static void async_resume(struct vf_instance *vf)
+{
+    struct vf_async *a = vf->async;
+    if (!a)
+        return;
+    pthread_mutex_lock(&a->lock);
+    assert(a->paused > 0);
+    a->paused--;
+    pthread_cond_broadcast(&a->wakeup);
+    pthread_mutex_unlock(&a->lock);
+}
+
+static int vf_control_one(struct vf_instance *vf, int cmd, void *arg)
+{
+    async_pause(vf);
+    int r = vf->control(vf, cmd, arg);
+    async_resume(vf);
+    return r;
+}
+
 static bool get_desc(struct m_obj_desc *dst, int index)
 {
     if (index >= MP_ARRAY_SIZE(filter_list) - 1)
@@ -82,7 +144,7 @@ int vf_control_any(struct vf_chain *c, int cmd, void *arg)
 {
     for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
         if (cur->control) {
-            int r = cur->control(cur, cmd, arg);
+            int r = vf_control_one(cur, cmd, arg);
             if (r != CONTROL_UNKNOWN)
                 return r;
         }
@@ -96,7 +158,7 @@ int vf_control_by_label(struct vf_chain *c,int cmd, void *arg, bstr label)
     struct vf_instance *cur = vf_find_by_label(c, label_str);
     talloc_free(label_str);
     if (cur) {
-        return cur->control ? cur->control(cur, cmd, arg) : CONTROL_NA;
+        return cur->control ? vf_control_one(cur, cmd, arg) : CONTROL_NA;
     } else {
         return CONTROL_UNKNOWN;
     }
@@ -106,7 +168,7 @@ static void vf_control_all(struct vf_chain *c, int cmd, void *arg)
 {
     for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
         if (cur->control)
-            cur->control(cur, cmd, arg);
+            vf_control_one(cur, cmd, arg);
     }
 }
 
@@ -325,8 +387,22 @@ void vf_add_output_frame(struct vf_instance *vf, struct mp_image *img)
     }
 }
 
+// Whether output is queued, without trying to produce any.
+static bool vf_has_queued_frame(struct vf_instance *vf)
+{
+    struct vf_async *a = vf->async;
+    if (!a)
+        return vf->num_out_queued > 0;
+    pthread_mutex_lock(&a->lock);
+    bool r = a->num_out > 0;
+    pthread_mutex_unlock(&a->lock);
+    return r;
+}
+
 static bool vf_has_output_frame(struct vf_instance *vf)
 {
+    if (vf->async)
+        return vf_has_queued_frame(vf);
     if (!vf->num_out_queued && vf->filter_out) {
         if (vf->filter_out(vf) < 0)
             MP_ERR(vf, "Error filtering frame.\n");
@@ -337,14 +413,23 @@ static bool vf_has_output_frame(struct vf_instance *vf)
 static struct mp_image *vf_dequeue_output_frame(struct vf_instance *vf)
 {
     struct mp_image *res = NULL;
-    if (vf_has_output_frame(vf)) {
+    struct vf_async *a = vf->async;
+    if (a) {
+        pthread_mutex_lock(&a->lock);
+        if (a->num_out) {
+            res = a->out[0];
+            MP_TARRAY_REMOVE_AT(a->out, a->num_out, 0);
+            pthread_cond_broadcast(&a->wakeup);
+        }
+        pthread_mutex_unlock(&a->lock);
+    } else if (vf_has_output_frame(vf)) {
         res = vf->out_queued[0];
         MP_TARRAY_REMOVE_AT(vf->out_queued, vf->num_out_queued, 0);
     }
     return res;
 }
 
-static int vf_do_filter(struct vf_instance *vf, struct mp_image *img)
+static int vf_do_filter_sync(struct vf_instance *vf, struct mp_image *img)
 {
     assert(vf->fmt_in.imgfmt);
     if (img)
@@ -365,6 +450,142 @@ static int vf_do_filter(struct vf_instance *vf, struct mp_image *img)
     }
 }
 
+// Run filter_out until it stops producing frames, and move all output to the
+// async output queue. Called with the worker thread busy or paused.
+static void async_collect_output(struct vf_instance *vf)
+{
+    struct vf_async *a = vf->async;
+    while (vf->filter_out) {
+        int num = vf->num_out_queued;
+        if (vf->filter_out(vf) < 0) {
+            MP_ERR(vf, "Error filtering frame.\n");
+            break;
+        }
+        if (vf->num_out_queued == num)
+            break;
+    }
+    pthread_mutex_lock(&a->lock);
+    for (int n = 0; n < vf->num_out_queued; n++)
+        MP_TARRAY_APPEND(a, a->out, a->num_out, vf->out_queued[n]);
+    vf->num_out_queued = 0;
+    pthread_mutex_unlock(&a->lock);
+}
+
+static void *async_thread(void *ptr)
+{
+    struct vf_instance *vf = ptr;
+    struct vf_async *a = vf->async;
+    struct vf_chain *c = vf->chain;
+
+    mpthread_set_name("vf");
+
+    pthread_mutex_lock(&a->lock);
+    while (1) {
+        while (!a->terminate && (a->paused || !a->num_in))
+            pthread_cond_wait(&a->wakeup, &a->lock);
+        if (a->terminate)
+            break;
+        struct mp_image *img = a->in[0];
+        MP_TARRAY_REMOVE_AT(a->in, a->num_in, 0);
+        a->busy = true;
+        pthread_mutex_unlock(&a->lock);
+
+        int r = vf_do_filter_sync(vf, img);
+        async_collect_output(vf);
+
+        pthread_mutex_lock(&a->lock);
+        if (r < 0)
+            a->error = r;
+        a->busy = false;
+        pthread_cond_broadcast(&a->wakeup);
+        pthread_mutex_unlock(&a->lock);
+
+        // New output, or room for new input.
+        if (c->wakeup_callback)
+            c->wakeup_callback(c->wakeup_callback_ctx);
+
+        pthread_mutex_lock(&a->lock);
+    }
+    pthread_mutex_unlock(&a->lock);
+    return NULL;
+}
+
+static void async_start(struct vf_instance *vf)
+{
+    struct vf_async *a = talloc_zero(NULL, struct vf_async);
+    pthread_mutex_init(&a->lock, NULL);
+    pthread_cond_init(&a->wakeup, NULL);
+    vf->async = a;
+    if (pthread_create(&a->thread, NULL, async_thread, vf)) {
+        MP_WARN(vf, "Could not create filter thread.\n");
+        pthread_cond_destroy(&a->wakeup);
+        pthread_mutex_destroy(&a->lock);
+        talloc_free(a);
+        vf->async = NULL;
+    }
+}
+
+static void async_stop(struct vf_instance *vf)
+{
+    struct vf_async *a = vf->async;
+    if (!a)
+        return;
+    pthread_mutex_lock(&a->lock);
+    a->terminate = true;
+    pthread_cond_broadcast(&a->wakeup);
+    pthread_mutex_unlock(&a->lock);
+    pthread_join(a->thread, NULL);
+    for (int n = 0; n < a->num_in; n++)
+        talloc_free(a->in[n]);
+    for (int n = 0; n < a->num_out; n++)
+        talloc_free(a->out[n]);
+    pthread_cond_destroy(&a->wakeup);
+    pthread_mutex_destroy(&a->lock);
+    talloc_free(a);
+    vf->async = NULL;
+}
+
+// Whether a filter running on a thread should get more input for pipelining.
+static bool async_needs_input(struct vf_instance *vf)
+{
+    struct vf_async *a = vf->async;
+    pthread_mutex_lock(&a->lock);
+    bool r = a->num_in + a->num_out + a->busy < VF_ASYNC_FRAMES;
+    pthread_mutex_unlock(&a->lock);
+    return r;
+}
+
+static int vf_do_filter(struct vf_instance *vf, struct mp_image *img)
+{
+    struct vf_async *a = vf->async;
+    if (!a)
+        return vf_do_filter_sync(vf, img);
+
+    if (!img) {
+        // EOF: let the worker filter everything that is queued, then flush
+        // the filter here, so that the caller sees all remaining output.
+        pthread_mutex_lock(&a->lock);
+        while (a->num_in || a->busy)
+            pthread_cond_wait(&a->wakeup, &a->lock);
+        a->paused++;
+        pthread_mutex_unlock(&a->lock);
+        int r = vf_do_filter_sync(vf, NULL);
+        async_collect_output(vf);
+        async_resume(vf);
+        return r;
+    }
+
+    pthread_mutex_lock(&a->lock);
+    while (a->num_in >= VF_ASYNC_FRAMES)
+        pthread_cond_wait(&a->wakeup, &a->lock);
+    MP_TARRAY_APPEND(a, a->in, a->num_in, img);
+    pthread_cond_broadcast(&a->wakeup);
+    int r = a->error;
+    a->error = 0;
+    pthread_mutex_unlock(&a->lock);
+    return r;
+}
+
 // Input a frame into the filter chain. Ownership of img is transferred.
 // Return >= 0 on success, < 0 on failure (even if output frames were produced)
 int vf_filter_frame(struct vf_chain *c, struct mp_image *img)
@@ -375,7 +596,10 @@ int vf_filter_frame(struct vf_chain *c, struct mp_image *img)
         return -1;
     }
     assert(mp_image_params_equal(&img->params, &c->input_params));
-    return vf_do_filter(c->first, img);
+    MP_STATS(c, "start filter video");
+    int r = vf_do_filter(c->first, img);
+    MP_STATS(c, "end filter video");
+    return r;
 }
 
 // Similar to vf_output_frame(), but only ensure that the filter "until" has
@@ -383,7 +607,7 @@ int vf_filter_frame(struct vf_chain *c, struct mp_image *img)
 static int vf_output_frame_until(struct vf_chain *c, struct vf_instance *until,
                                  bool eof)
 {
-    if (until->num_out_queued)
+    if (vf_has_queued_frame(until))
         return 1;
     if (c->initialized < 1)
         return -1;
@@ -449,7 +673,9 @@ int vf_needs_input(struct vf_chain *c)
 {
     struct vf_instance *prev = c->first;
     for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
-        while (cur->needs_input && cur->needs_input(cur)) {
+        while (cur->async ? async_needs_input(cur)
+                          : cur->needs_input && cur->needs_input(cur))
+        {
             // Get frames from preceding filters, or if there are none,
             // request new frames from decoder.
             int r = vf_output_frame_until(c, prev, false);
@@ -466,9 +692,24 @@ int vf_needs_input(struct vf_chain *c)
 
 static void vf_forget_frames(struct vf_instance *vf)
 {
+    async_pause(vf);
     for (int n = 0; n < vf->num_out_queued; n++)
         talloc_free(vf->out_queued[n]);
     vf->num_out_queued = 0;
+    struct vf_async *a = vf->async;
+    if (a) {
+        pthread_mutex_lock(&a->lock);
+        for (int n = 0; n < a->num_in; n++)
+            talloc_free(a->in[n]);
+        a->num_in = 0;
+        for (int n = 0; n < a->num_out; n++)
+            talloc_free(a->out[n]);
+        a->num_out = 0;
+        a->error = 0;
+        pthread_cond_broadcast(&a->wakeup);
+        pthread_mutex_unlock(&a->lock);
+    }
+    async_resume(vf);
 }
 
 static void vf_chain_forget_frames(struct vf_chain *c)
@@ -479,8 +720,13 @@ static void vf_chain_forget_frames(struct vf_chain *c)
 
 void vf_seek_reset(struct vf_chain *c)
 {
+    // Keep threaded filters from producing output between reset and flush.
+    for (struct vf_instance *cur = c->first; cur; cur = cur->next)
+        async_pause(cur);
     vf_control_all(c, VFCTRL_SEEK_RESET, NULL);
     vf_chain_forget_frames(c);
+    for (struct vf_instance *cur = c->first; cur; cur = cur->next)
+        async_resume(cur);
 }
 
 int vf_next_query_format(struct vf_instance *vf, unsigned int fmt)
@@ -503,20 +749,157 @@ static bool is_conv_filter(struct vf_instance *vf)
     return vf && (strcmp(vf->info->name, "scale") == 0 || vf->autoinserted);
 }
 
-static const char *find_conv_filter(uint8_t *fmts_in, uint8_t *fmts_out)
+static void update_formats(struct vf_chain *c, struct vf_instance *vf,
+                           uint8_t *fmts);
+
+#define NUM_FMTS (IMGFMT_END - IMGFMT_START)
+
+// Cost of a format that can't be reached with a conversion filter.
+#define CONV_IMPOSSIBLE (INT_MAX / 4)
+
+static int desc_bits(const struct mp_imgfmt_desc *d)
+{
+    return d->component_bits ? d->component_bits : d->plane_bits;
+}
+
+// Rough relative cost of converting src to dst with a single conversion
+// filter (i.e. one swscale pass). This prefers conversions which lose no
+// precision or chroma resolution, and which don't change the color class.
+static int conversion_cost(const struct mp_imgfmt_desc *src,
+                           const struct mp_imgfmt_desc *dst)
 {
-    for (int n = 0; filter_list[n]; n++) {
-        if (filter_list[n]->test_conversion) {
-            for (int a = IMGFMT_START; a < IMGFMT_END; a++) {
-                for (int b = IMGFMT_START; b < IMGFMT_END; b++) {
-                    if (fmts_in[a - IMGFMT_START] && fmts_out[b - IMGFMT_START] &&
-                        filter_list[n]->test_conversion(a, b))
-                        return filter_list[n]->name;
-                }
-            }
+    if (!src->id || !dst->id)
+        return CONV_IMPOSSIBLE;
+    if (src->id == dst->id)
+        return 0;
+    // Would require uploading/downloading (hwupload/hwdownload).
+    if ((src->flags | dst->flags) & MP_IMGFLAG_HWACCEL)
+        return CONV_IMPOSSIBLE;
+
+    int cost = 10;
+    if ((src->flags & MP_IMGFLAG_COLOR_CLASS_MASK) !=
+        (dst->flags & MP_IMGFLAG_COLOR_CLASS_MASK))
+        cost += 20;
+    int bits_src = desc_bits(src), bits_dst = desc_bits(dst);
+    if (bits_dst < bits_src) {
+        cost += (bits_src - bits_dst) * 5;
+    } else {
+        cost += bits_dst - bits_src;
+    }
+    int sub_src = src->chroma_xs + src->chroma_ys;
+    int sub_dst = dst->chroma_xs + dst->chroma_ys;
+    if (sub_dst > sub_src) {
+        cost += (sub_dst - sub_src) * 15;
+    } else {
+        cost += (sub_src - sub_dst) * 2;
+    }
+    if ((src->num_planes > 1) != (dst->num_planes > 1))
+        cost += 3;
+    if ((src->flags & MP_IMGFLAG_ALPHA) && !(dst->flags & MP_IMGFLAG_ALPHA))
+        cost += 20;
+    return cost;
+}
+
+// Compute into costs[] the cost of feeding each format to vf, and getting it
+// through all following filters, with conversion filters inserted where
+// needed. This assumes filters output the format they're fed with, which is
+// true for most filters (and can't be known before configuring them).
+static void chain_costs(struct vf_instance *vf,
+                        const struct mp_imgfmt_desc *descs, int *costs)
+{
+    if (!vf) {
+        for (int n = 0; n < NUM_FMTS; n++)
+            costs[n] = 0;
+        return;
+    }
+
+    int next_costs[NUM_FMTS];
+    chain_costs(vf->next, descs, next_costs);
+
+    // Formats the filter itself accepts, regardless of following filters.
+    uint8_t saved[NUM_FMTS];
+    memcpy(saved, vf->last_outfmts, sizeof(saved));
+    memset(vf->last_outfmts, 1, sizeof(vf->last_outfmts));
+    uint8_t accepted[NUM_FMTS];
+    query_formats(accepted, vf);
+    memcpy(vf->last_outfmts, saved, sizeof(saved));
+
+    for (int n = 0; n < NUM_FMTS; n++)
+        costs[n] = CONV_IMPOSSIBLE;
+    for (int g = 0; g < NUM_FMTS; g++) {
+        if (!accepted[g] || next_costs[g] >= CONV_IMPOSSIBLE)
+            continue;
+        for (int f = 0; f < NUM_FMTS; f++) {
+            int c = conversion_cost(&descs[f], &descs[g]);
+            if (c < CONV_IMPOSSIBLE && c + next_costs[g] < costs[f])
+                costs[f] = c + next_costs[g];
+        }
+    }
+}
+
+// Pick the format a conversion filter inserted after vf should output, with
+// src_fmt as input format (0 if unknown). Returns 0 if none is possible.
+static int find_conv_format(struct vf_instance *vf, int src_fmt, int *out_cost)
+{
+    struct mp_imgfmt_desc *descs = talloc_array(NULL, struct mp_imgfmt_desc,
+                                                NUM_FMTS);
+    for (int n = 0; n < NUM_FMTS; n++)
+        descs[n] = mp_imgfmt_get_desc(IMGFMT_START + n);
+
+    int next_costs[NUM_FMTS];
+    chain_costs(vf->next->next, descs, next_costs);
+
+    struct mp_imgfmt_desc src = {0};
+    if (src_fmt >= IMGFMT_START && src_fmt < IMGFMT_END)
+        src = descs[src_fmt - IMGFMT_START];
+
+    int best = 0, best_cost = CONV_IMPOSSIBLE;
+    for (int n = 0; n < NUM_FMTS; n++) {
+        int fmt = IMGFMT_START + n;
+        if (!vf->last_outfmts[n] || next_costs[n] >= CONV_IMPOSSIBLE ||
+            !descs[n].id || imgfmt2pixfmt(fmt) == AV_PIX_FMT_NONE)
+            continue;
+        int c = src.id ? conversion_cost(&src, &descs[n]) : 0;
+        if (c >= CONV_IMPOSSIBLE)
+            continue;
+        c += next_costs[n];
+        if (c < best_cost) {
+            best = fmt;
+            best_cost = c;
         }
     }
-    return "scale";
+    talloc_free(descs);
+    *out_cost = best_cost;
+    return best;
+}
+
+// Insert a conversion filter after vf, converting to the cheapest format the
+// rest of the chain accepts. src_fmt is the format vf outputs, or 0.
+static struct vf_instance *insert_conv_filter(struct vf_chain *c,
+                                              struct vf_instance *vf,
+                                              int src_fmt)
+{
+    int cost;
+    int fmt = find_conv_format(vf, src_fmt, &cost);
+    if (!fmt) {
+        MP_WARN(c, "No conversion to a supported format found.\n");
+        return NULL;
+    }
+    MP_INFO(c, "Using conversion filter (%s -> %s).\n",
+            src_fmt ? mp_imgfmt_to_name(src_fmt) : "any",
+            mp_imgfmt_to_name(fmt));
+    MP_VERBOSE(c, "Conversion path cost: %d\n", cost);
+
+    char *args[] = {"pix_fmts", (char *)av_get_pix_fmt_name(imgfmt2pixfmt(fmt)),
+                    NULL};
+    struct vf_instance *conv = vf_open(c, "format", args);
+    if (!conv)
+        return NULL;
+    conv->autoinserted = true;
+    conv->next = vf->next;
+    vf->next = conv;
+    update_formats(c, conv, vf->last_outfmts);
+    return conv;
 }
 
 static void update_formats(struct vf_chain *c, struct vf_instance *vf,
@@ -535,31 +918,11 @@ static void update_formats(struct vf_chain *c, struct vf_instance *vf,
     {
         // If there are output formats, but no input formats (meaning the
         // filters after vf work, but vf can't output any format the filters
-        // after it accept), try to insert a conversion filter.
-        MP_INFO(c, "Using conversion filter.\n");
-        // Determine which output formats the filter _could_ accept. For this
-        // to work after the conversion filter is inserted, it is assumed that
-        // conversion filters have a single set of in/output formats that can
-        // be converted to each other.
-        uint8_t out_formats[IMGFMT_END - IMGFMT_START];
-        for (int n = IMGFMT_START; n < IMGFMT_END; n++) {
-            out_formats[n - IMGFMT_START] = vf->last_outfmts[n - IMGFMT_START];
-            vf->last_outfmts[n - IMGFMT_START] = 1;
-        }
-        query_formats(fmts, vf);
-        const char *filter = find_conv_filter(fmts, out_formats);
-        char **args = NULL;
-        char *args_no_warn[] = {"warn", "no", NULL};
-        if (strcmp(filter, "scale") == 0)
-            args = args_no_warn;
-        struct vf_instance *conv = vf_open(c, filter, args);
-        if (conv) {
-            conv->autoinserted = true;
-            conv->next = vf->next;
-            vf->next = conv;
-            update_formats(c, conv, vf->last_outfmts);
+        // after it accept), try to insert a conversion filter. The output
+        // format of vf is known only for the "in" pseudo-filter.
+        int src_fmt = vf == c->first ? vf->fmt_in.imgfmt : 0;
+        if (insert_conv_filter(c, vf, src_fmt))
             query_formats(fmts, vf);
-        }
     }
     for (int n = IMGFMT_START; n < IMGFMT_END; n++)
         has_in |= !!fmts[n - IMGFMT_START];
@@ -583,31 +946,43 @@ static void auto_insert_conversion_filter_if_needed(struct vf_chain *c,
         is_conv_filter(vf) || is_conv_filter(vf->next))
         return;
 
-    MP_INFO(c, "Using conversion filter.\n");
-
-    uint8_t fmts[IMGFMT_END - IMGFMT_START];
-    query_formats(fmts, vf->next);
-
-    uint8_t out_formats[IMGFMT_END - IMGFMT_START];
-    for (int n = IMGFMT_START; n < IMGFMT_END; n++)
-        out_formats[n - IMGFMT_START] = n == vf->fmt_out.imgfmt;
+    insert_conv_filter(c, vf, vf->fmt_out.imgfmt);
+}
 
-    const char *filter = find_conv_filter(out_formats, fmts);
-    char **args = NULL;
-    char *args_no_warn[] = {"warn", "no", NULL};
-    if (strcmp(filter, "scale") == 0)
-        args = args_no_warn;
-    struct vf_instance *conv = vf_open(c, filter, args);
-    if (conv) {
-        conv->autoinserted = true;
-        conv->next = vf->next;
-        vf->next = conv;
-        update_formats(c, conv, vf->last_outfmts);
+// Describe the negotiated formats and conversions (for the vf-format-plan
+// property).
+static void update_format_plan(struct vf_chain *c)
+{
+    talloc_free(c->format_plan);
+    c->format_plan = talloc_strdup(c, "");
+    int total = 0;
+    for (struct vf_instance *vf = c->first; vf; vf = vf->next) {
+        int in = vf->fmt_in.imgfmt, out = vf->fmt_out.imgfmt;
+        if (!in)
+            break;
+        c->format_plan = talloc_asprintf_append(c->format_plan, "%s: %s",
+                                                vf->full_name,
+                                                mp_imgfmt_to_name(in));
+        if (vf != c->last && out != in) {
+            c->format_plan = talloc_asprintf_append(c->format_plan, " -> %s",
+                                                    mp_imgfmt_to_name(out));
+        }
+        if (vf->autoinserted) {
+            struct mp_imgfmt_desc d_in = mp_imgfmt_get_desc(in),
+                                  d_out = mp_imgfmt_get_desc(out);
+            int cost = conversion_cost(&d_in, &d_out);
+            c->format_plan = talloc_asprintf_append(c->format_plan,
+                                                    " (converted, cost %d)", cost);
+            total += cost;
+        }
+        c->format_plan = talloc_asprintf_append(c->format_plan, "\n");
     }
+    c->format_plan = talloc_asprintf_append(c->format_plan,
+                                            "conversion cost: %d\n", total);
 }
 
-static int vf_reconfig_wrapper(struct vf_instance *vf,
-                               const struct mp_image_params *p)
+static int vf_reconfig_wrapper_sync(struct vf_instance *vf,
+                                    const struct mp_image_params *p)
 {
     vf_forget_frames(vf);
     if (vf->out_pool)
@@ -638,6 +1013,22 @@ static int vf_reconfig_wrapper(struct vf_instance *vf,
     return r;
 }
 
+static int vf_reconfig_wrapper(struct vf_instance *vf,
+                               const struct mp_image_params *p)
+{
+    async_pause(vf);
+    int r = vf_reconfig_wrapper_sync(vf, p);
+    async_resume(vf);
+
+    // Filters with their own threading (needs_input) are left alone.
+    struct vf_chain *c = vf->chain;
+    if (r >= 0 && c->opts->vf_async && !vf->async && !vf->needs_input &&
+        vf != c->first && vf != c->last)
+        async_start(vf);
+
+    return r;
+}
+
 int vf_reconfig(struct vf_chain *c, const struct mp_image_params *params)
 {
     int r = 0;
@@ -673,6 +1064,7 @@ int vf_reconfig(struct vf_chain *c, const struct mp_image_params *params)
     }
     c->output_params = cur;
     c->initialized = r < 0 ? -1 : 1;
+    update_format_plan(c);
     int loglevel = r < 0 ? MSGL_WARN : MSGL_V;
     if (r == -2)
         MP_ERR(c, "Image formats incompatible or invalid.\n");
@@ -703,6 +1095,7 @@ struct vf_instance *vf_find_by_label(struct vf_chain *c, const char *label)
 
 static void vf_uninit_filter(vf_instance_t *vf)
 {
+    async_stop(vf);
     av_buffer_unref(&vf->in_hwframes_ref);
     av_buffer_unref(&vf->out_hwframes_ref);
     if (vf->uninit)
@@ -37,7 +37,6 @@ typedef struct vf_info {
     const void *priv_defaults;
     const struct m_option *options;
     void (*print_help)(struct mp_log *log);
-    bool (*test_conversion)(int in, int out);
 } vf_info_t;
 
 typedef struct vf_instance {
@@ -107,6 +106,8 @@ typedef struct vf_instance {
 
     struct vf_chain *chain;
     struct vf_instance *next;
+
+    struct vf_async *async; // if filtering on a thread (--vf-async)
 } vf_instance_t;
 
 // A chain of video filters
@@ -130,6 +131,9 @@ struct vf_chain {
     // This is a dirty hack.
     struct AVBufferRef *in_hwframes_ref;
 
+    // Human readable description of the negotiated formats (by vf_reconfig()).
+    char *format_plan;
+
     // Call when the filter chain wants new processing (for filters with
     // asynchronous behavior) - must be immutable once filters are created,
     // since they are supposed to call it from foreign threads.
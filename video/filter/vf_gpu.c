@@ -0,0 +1,103 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common/common.h"
+#include "options/m_option.h"
+#include "video/mp_image.h"
+
+#include "vf.h"
+
+// This filter doesn't touch the image data. It only sets mp_image_params
+// fields, which the VO applies when rendering (see VO_CAP_GPU_OPS). This
+// avoids copying hardware decoded frames to system memory for simple
+// operations.
+
+struct vf_priv_s {
+    int crop_w, crop_h, crop_x, crop_y;
+    int rotate;
+    int deint;
+    int brightness, contrast, saturation, gamma;
+};
+
+static int reconfig(struct vf_instance *vf, struct mp_image_params *in,
+                    struct mp_image_params *out)
+{
+    struct vf_priv_s *p = vf->priv;
+    *out = *in;
+
+    struct mp_gpu_ops *ops = &out->gpu_ops;
+
+    if (p->crop_w > 0 || p->crop_h > 0) {
+        // Crop relative to a crop set by a previous instance of this filter.
+        struct mp_rect cur = ops->crop;
+        if (cur.x1 <= cur.x0 || cur.y1 <= cur.y0)
+            cur = (struct mp_rect){0, 0, in->w, in->h};
+        int cur_w = cur.x1 - cur.x0, cur_h = cur.y1 - cur.y0;
+        int w = p->crop_w > 0 ? MPMIN(p->crop_w, cur_w) : cur_w;
+        int h = p->crop_h > 0 ? MPMIN(p->crop_h, cur_h) : cur_h;
+        int x = p->crop_x >= 0 ? p->crop_x : (cur_w - w) / 2;
+        int y = p->crop_y >= 0 ? p->crop_y : (cur_h - h) / 2;
+        x = MPCLAMP(x, 0, cur_w - w);
+        y = MPCLAMP(y, 0, cur_h - h);
+        ops->crop = (struct mp_rect){cur.x0 + x, cur.y0 + y,
+                                     cur.x0 + x + w, cur.y0 + y + h};
+    }
+
+    out->rotate = (out->rotate + p->rotate) % 360;
+    ops->deint |= p->deint;
+    ops->brightness = MPCLAMP(ops->brightness + p->brightness, -100, 100);
+    ops->contrast = MPCLAMP(ops->contrast + p->contrast, -100, 100);
+    ops->saturation = MPCLAMP(ops->saturation + p->saturation, -100, 100);
+    ops->gamma = MPCLAMP(ops->gamma + p->gamma, -100, 100);
+
+    return 0;
+}
+
+static int vf_open(vf_instance_t *vf)
+{
+    vf->reconfig = reconfig;
+    // Frames are passed through unchanged (vf_add_output_frame() sets the
+    // new parameters).
+    vf->filter = NULL;
+    return 1;
+}
+
+#define OPT_BASE_STRUCT struct vf_priv_s
+const vf_info_t vf_info_gpu = {
+    .description = "operations executed by the VO on the GPU",
+    .name = "gpu",
+    .open = vf_open,
+    .priv_size = sizeof(struct vf_priv_s),
+    .priv_defaults = &(const struct vf_priv_s){
+        .crop_x = -1,
+        .crop_y = -1,
+    },
+    .options = (const m_option_t[]) {
+        OPT_INT("crop-w", crop_w, M_OPT_MIN, .min = 0),
+        OPT_INT("crop-h", crop_h, M_OPT_MIN, .min = 0),
+        OPT_INT("crop-x", crop_x, M_OPT_MIN, .min = -1),
+        OPT_INT("crop-y", crop_y, M_OPT_MIN, .min = -1),
+        OPT_CHOICE("rotate", rotate, 0,
+                   ({"0", 0}, {"90", 90}, {"180", 180}, {"270", 270})),
+        OPT_FLAG("deint", deint, 0),
+        OPT_INTRANGE("brightness", brightness, 0, -100, 100),
+        OPT_INTRANGE("contrast", contrast, 0, -100, 100),
+        OPT_INTRANGE("saturation", saturation, 0, -100, 100),
+        OPT_INTRANGE("gamma", gamma, 0, -100, 100),
+        {0}
+    },
+};
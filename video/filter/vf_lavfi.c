@@ -40,6 +40,7 @@
 
 #include "config.h"
 #include "common/av_common.h"
+#include "common/lavfi_threads.h"
 #include "common/msg.h"
 #include "options/m_option.h"
 #include "common/tags.h"
@@ -52,6 +53,18 @@
 #include "vf.h"
 #include "vf_lavfi.h"
 
+// Number of unused graphs kept around for other input parameters.
+#define GRAPH_CACHE_SIZE 4
+
+// A configured graph, and the input parameters it was created for.
+struct graph_entry {
+    AVFilterGraph *graph;
+    AVFilterContext *in;
+    AVFilterContext *out;
+    struct mp_image_params params;
+    void *hwframes; // in_hwframes_ref->data (the graph holds a reference)
+};
+
 struct vf_priv_s {
     // Single filter bridge, instead of a graph.
     bool is_bridge;
@@ -61,6 +74,23 @@ struct vf_priv_s {
     AVFilterContext *out;
     bool eof;
 
+    // Parameters of the current graph. fresh means it was never fed any
+    // frames or commands, and is equivalent to a newly created graph.
+    struct mp_image_params graph_params;
+    void *graph_hwframes;
+    bool graph_fresh;
+
+    // Fresh graphs for other input parameters than the current ones. This
+    // avoids recreating graphs when switching back and forth between input
+    // formats (e.g. resolution changes with adaptive streaming), since
+    // vf_reconfig() resets (and so recreates) the graph with the old
+    // parameters before reconfiguring it.
+    struct graph_entry cache[GRAPH_CACHE_SIZE];
+    int num_cache;
+
+    // Shared by all graphs above; created on first use.
+    struct mp_lavfi_threads *threads;
+
     AVRational timebase_in;
     AVRational timebase_out;
     AVRational par_in;
@@ -94,11 +124,75 @@ static void destroy_graph(struct vf_instance *vf)
     }
 
     p->eof = false;
+    p->graph_fresh = false;
+}
+
+static void flush_graph_cache(struct vf_instance *vf)
+{
+    struct vf_priv_s *p = vf->priv;
+    for (int n = 0; n < p->num_cache; n++)
+        avfilter_graph_free(&p->cache[n].graph);
+    p->num_cache = 0;
+}
+
+// Only the parameters that are passed to the buffer source matter.
+static bool graph_params_equal(struct mp_image_params *a, void *hw_a,
+                               struct mp_image_params *b, void *hw_b)
+{
+    return a->imgfmt == b->imgfmt && a->w == b->w && a->h == b->h &&
+           a->p_w == b->p_w && a->p_h == b->p_h && hw_a == hw_b;
+}
+
+// Replace the current graph with a cached or the current one, if possible.
+// If the current graph can't be used, it's destroyed or put into the cache.
+static bool reuse_graph(struct vf_instance *vf, struct mp_image_params *fmt)
+{
+    struct vf_priv_s *p = vf->priv;
+    void *hwframes = vf->in_hwframes_ref ? vf->in_hwframes_ref->data : NULL;
+
+    if (p->graph && p->graph_fresh &&
+        graph_params_equal(&p->graph_params, p->graph_hwframes, fmt, hwframes))
+    {
+        MP_VERBOSE(vf, "lavfi: reusing graph\n");
+        return true;
+    }
+
+    if (p->graph && p->graph_fresh) {
+        if (p->num_cache == GRAPH_CACHE_SIZE) {
+            avfilter_graph_free(&p->cache[0].graph);
+            MP_TARRAY_REMOVE_AT(p->cache, p->num_cache, 0);
+        }
+        p->cache[p->num_cache++] = (struct graph_entry){
+            .graph = p->graph,
+            .in = p->in,
+            .out = p->out,
+            .params = p->graph_params,
+            .hwframes = p->graph_hwframes,
+        };
+        p->graph = NULL;
+    }
+    destroy_graph(vf);
+
+    for (int n = 0; n < p->num_cache; n++) {
+        struct graph_entry *e = &p->cache[n];
+        if (graph_params_equal(&e->params, e->hwframes, fmt, hwframes)) {
+            MP_VERBOSE(vf, "lavfi: using cached graph\n");
+            p->graph = e->graph;
+            p->in = e->in;
+            p->out = e->out;
+            p->graph_params = e->params;
+            p->graph_hwframes = e->hwframes;
+            p->graph_fresh = true;
+            MP_TARRAY_REMOVE_AT(p->cache, p->num_cache, n);
+            return true;
+        }
+    }
+
+    return false;
 }
 
 static bool recreate_graph(struct vf_instance *vf, struct mp_image_params *fmt)
 {
-    void *tmp = talloc_new(NULL);
     struct vf_priv_s *p = vf->priv;
     AVFilterContext *in = NULL, *out = NULL;
     int ret;
@@ -108,12 +202,19 @@ static bool recreate_graph(struct vf_instance *vf, struct mp_image_params *fmt)
         return false;
     }
 
-    destroy_graph(vf);
+    if (reuse_graph(vf, fmt))
+        return true;
+
+    void *tmp = talloc_new(NULL);
 
     AVFilterGraph *graph = avfilter_graph_alloc();
     if (!graph)
         goto error;
 
+    if (!p->threads)
+        p->threads = mp_lavfi_threads_create(p, vf->chain->global, vf->log);
+    mp_lavfi_threads_setup(p->threads, graph);
+
     if (mp_set_avopts(vf->log, graph, p->cfg_avopts) < 0)
         goto error;
 
@@ -210,6 +311,9 @@ static bool recreate_graph(struct vf_instance *vf, struct mp_image_params *fmt)
     p->in = in;
     p->out = out;
     p->graph = graph;
+    p->graph_params = *fmt;
+    p->graph_hwframes = vf->in_hwframes_ref ? vf->in_hwframes_ref->data : NULL;
+    p->graph_fresh = true;
 
     assert(out->nb_inputs == 1);
     assert(in->nb_outputs == 1);
@@ -332,6 +436,7 @@ static int filter_ext(struct vf_instance *vf, struct mp_image *mpi)
         p->eof = true;
     }
 
+    p->graph_fresh = false;
     AVFrame *frame = mp_to_av(vf, mpi);
     int r = av_buffersrc_add_frame(p->in, frame) < 0 ? -1 : 0;
     av_frame_free(&frame);
@@ -373,6 +478,9 @@ static int control(vf_instance_t *vf, int request, void *data)
     case VFCTRL_COMMAND: {
         if (!vf->priv->graph)
             break;
+        // Cached graphs wouldn't have the changed parameters.
+        flush_graph_cache(vf);
+        vf->priv->graph_fresh = false;
         char **args = data;
         return avfilter_graph_send_command(vf->priv->graph, "all",
                                            args[0], args[1], &(char){0}, 0, 0)
@@ -394,6 +502,7 @@ static void uninit(struct vf_instance *vf)
     if (!vf->priv)
         return;
     destroy_graph(vf);
+    flush_graph_cache(vf);
 }
 
 static int vf_open(vf_instance_t *vf)
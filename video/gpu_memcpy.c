@@ -0,0 +1,76 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+
+#include <stdint.h>
+#include <string.h>
+#include <smmintrin.h>
+
+#include "gpu_memcpy.h"
+
+// The source is read in chunks of this size into a buffer, which should stay
+// in L1 cache. Mixing streaming loads with stores to the (possibly uncached)
+// destination would flush the CPU's streaming load buffers all the time.
+#define BOUNCE_SIZE 4096
+
+void *gpu_memcpy(void *restrict d, const void *restrict s, size_t size)
+{
+    uint8_t *dst = d;
+    const uint8_t *src = s;
+
+    // Streaming loads require 16 byte alignment.
+    size_t head = (16 - ((uintptr_t)src & 15)) & 15;
+    if (head > size)
+        head = size;
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    size -= head;
+
+    // Make sure previous writes to the source are visible.
+    _mm_mfence();
+
+    __m128i bounce[BOUNCE_SIZE / 16];
+
+    while (size >= 64) {
+        size_t chunk = size < BOUNCE_SIZE ? size & ~(size_t)63 : BOUNCE_SIZE;
+        __m128i *in = (__m128i *)src;
+
+        for (size_t n = 0; n < chunk / 16; n += 4) {
+            __m128i x0 = _mm_stream_load_si128(in + n + 0);
+            __m128i x1 = _mm_stream_load_si128(in + n + 1);
+            __m128i x2 = _mm_stream_load_si128(in + n + 2);
+            __m128i x3 = _mm_stream_load_si128(in + n + 3);
+            _mm_store_si128(bounce + n + 0, x0);
+            _mm_store_si128(bounce + n + 1, x1);
+            _mm_store_si128(bounce + n + 2, x2);
+            _mm_store_si128(bounce + n + 3, x3);
+        }
+
+        memcpy(dst, bounce, chunk);
+        dst += chunk;
+        src += chunk;
+        size -= chunk;
+    }
+
+    memcpy(dst, src, size);
+    return d;
+}
+
+#pragma GCC pop_options
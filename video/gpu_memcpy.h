@@ -0,0 +1,28 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_GPU_MEMCPY_H_
+#define MP_GPU_MEMCPY_H_
+
+#include <stddef.h>
+
+// memcpy() replacement for reading from write-combined (USWC) memory, such as
+// mapped GPU surfaces. Normal loads from such memory are uncached and very
+// slow. Requires SSE4.1, which the caller must check at runtime.
+void *gpu_memcpy(void *restrict d, const void *restrict s, size_t size);
+
+#endif
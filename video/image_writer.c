@@ -19,8 +19,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <setjmp.h>
+#include <pthread.h>
 
 #include <libavcodec/avcodec.h>
+#include <libavutil/cpu.h>
 #include <libavutil/mem.h>
 #include <libavutil/opt.h>
 
@@ -30,6 +32,7 @@
 #include <jpeglib.h>
 #endif
 
+#include "common/common.h"
 #include "osdep/io.h"
 
 #include "image_writer.h"
@@ -68,6 +71,7 @@ const struct m_option image_writer_opts[] = {
     OPT_INTRANGE("png-filter", png_filter, 0, 0, 5),
     OPT_FLAG("high-bit-depth", high_bit_depth, 0),
     OPT_FLAG("tag-colorspace", tag_csp, 0),
+    OPT_INTRANGE("encoder-threads", encoder_threads, 0, 0, 64),
     {0},
 };
 
@@ -77,6 +81,14 @@ struct image_writer_ctx {
     struct mp_imgfmt_desc original_format;
 };
 
+static int get_threads(struct image_writer_ctx *ctx)
+{
+    int threads = ctx->opts->encoder_threads;
+    if (!threads)
+        threads = av_cpu_count();
+    return MPCLAMP(threads, 1, 64);
+}
+
 static enum AVPixelFormat replace_j_format(enum AVPixelFormat fmt)
 {
     switch (fmt) {
@@ -122,6 +134,12 @@ static bool write_lavc(struct image_writer_ctx *ctx, mp_image_t *image, FILE *fp
         av_opt_set_int(avctx, "pred", ctx->opts->png_filter,
                        AV_OPT_SEARCH_CHILDREN);
     }
+    // The mjpeg encoder uses slice threads. The png encoder supports frame
+    // threads only, which do nothing for a single image.
+    if (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) {
+        avctx->thread_count = get_threads(ctx);
+        avctx->thread_type = FF_THREAD_SLICE;
+    }
 
     if (avcodec_open2(avctx, codec, NULL) < 0) {
      print_open_fail:
@@ -177,7 +195,11 @@ static void write_jpeg_error_exit(j_common_ptr cinfo)
   longjmp(*(jmp_buf*)cinfo->client_data, 1);
 }
 
-static bool write_jpeg(struct image_writer_ctx *ctx, mp_image_t *image, FILE *fp)
+// Encode rows y0..y0+h of the image as a complete JPEG file. Either writes to
+// fp, or to a malloc'ed buffer in *out_buf.
+static bool encode_jpeg(struct image_writer_ctx *ctx, mp_image_t *image,
+                        int y0, int h, FILE *fp, unsigned char **out_buf,
+                        unsigned long *out_size)
 {
     struct jpeg_compress_struct cinfo;
     struct jpeg_error_mgr jerr;
@@ -193,10 +215,14 @@ static bool write_jpeg(struct image_writer_ctx *ctx, mp_image_t *image, FILE *fp
     }
 
     jpeg_create_compress(&cinfo);
-    jpeg_stdio_dest(&cinfo, fp);
+    if (fp) {
+        jpeg_stdio_dest(&cinfo, fp);
+    } else {
+        jpeg_mem_dest(&cinfo, out_buf, out_size);
+    }
 
     cinfo.image_width = image->w;
-    cinfo.image_height = image->h;
+    cinfo.image_height = h;
     cinfo.input_components = 3;
     cinfo.in_color_space = JCS_RGB;
 
@@ -217,7 +243,7 @@ static bool write_jpeg(struct image_writer_ctx *ctx, mp_image_t *image, FILE *fp
     while (cinfo.next_scanline < cinfo.image_height) {
         JSAMPROW row_pointer[1];
         row_pointer[0] = image->planes[0] +
-                         (ptrdiff_t)cinfo.next_scanline * image->stride[0];
+                         (ptrdiff_t)(y0 + cinfo.next_scanline) * image->stride[0];
         jpeg_write_scanlines(&cinfo, row_pointer,1);
     }
 
@@ -228,6 +254,140 @@ static bool write_jpeg(struct image_writer_ctx *ctx, mp_image_t *image, FILE *fp
     return true;
 }
 
+// Large images are split into horizontal strips, which are encoded as separate
+// JPEG files in parallel. Since all strips use the same (default) tables, the
+// entropy coded data of the strips can be joined with restart markers into a
+// single baseline JPEG, which any decoder can read.
+#define MAX_STRIPS 64
+#define MIN_STRIP_ROWS 128
+
+struct jpeg_strip {
+    struct image_writer_ctx *ctx;
+    struct mp_image *image;
+    int y0, h;
+    unsigned char *buf;
+    unsigned long size;
+    bool ok;
+};
+
+static void *jpeg_strip_thread(void *arg)
+{
+    struct jpeg_strip *s = arg;
+    s->ok = encode_jpeg(s->ctx, s->image, s->y0, s->h, NULL, &s->buf, &s->size);
+    return NULL;
+}
+
+// Find the start of the SOS segment, and the start of the entropy coded data
+// following it. Returns false if the data is not as libjpeg writes it.
+static bool find_jpeg_scan(struct jpeg_strip *s, size_t *sos, size_t *data,
+                           size_t *sof)
+{
+    unsigned char *b = s->buf;
+    size_t pos = 2;
+    *sof = 0;
+    if (s->size < 4 || b[0] != 0xFF || b[1] != 0xD8 ||
+        b[s->size - 2] != 0xFF || b[s->size - 1] != 0xD9)
+        return false;
+    while (pos + 4 <= s->size && b[pos] == 0xFF) {
+        size_t len = (b[pos + 2] << 8) | b[pos + 3];
+        if (b[pos + 1] == 0xC0 || b[pos + 1] == 0xC1)
+            *sof = pos;
+        if (b[pos + 1] == 0xDA) {
+            *sos = pos;
+            *data = pos + 2 + len;
+            return *sof && *data <= s->size - 2;
+        }
+        pos += 2 + len;
+    }
+    return false;
+}
+
+static bool write_jpeg_strips(struct jpeg_strip *strips, int num_strips,
+                              int interval, int h, FILE *fp)
+{
+    size_t sos, data, sof;
+    struct jpeg_strip *s = &strips[0];
+    if (!find_jpeg_scan(s, &sos, &data, &sof))
+        return false;
+
+    // Headers of the first strip, with the full image height and a DRI segment.
+    s->buf[sof + 5] = h >> 8;
+    s->buf[sof + 6] = h & 0xFF;
+    unsigned char dri[6] = {0xFF, 0xDD, 0, 4, interval >> 8, interval & 0xFF};
+    bool ok = fwrite(s->buf, sos, 1, fp) == 1 &&
+              fwrite(dri, sizeof(dri), 1, fp) == 1 &&
+              fwrite(s->buf + sos, data - sos, 1, fp) == 1;
+
+    for (int n = 0; n < num_strips && ok; n++) {
+        s = &strips[n];
+        size_t s_sos, s_data, s_sof;
+        if (!find_jpeg_scan(s, &s_sos, &s_data, &s_sof))
+            return false;
+        if (n > 0) {
+            unsigned char rst[2] = {0xFF, 0xD0 + (n - 1) % 8};
+            ok &= fwrite(rst, sizeof(rst), 1, fp) == 1;
+        }
+        ok &= fwrite(s->buf + s_data, s->size - 2 - s_data, 1, fp) == 1;
+    }
+
+    unsigned char eoi[2] = {0xFF, 0xD9};
+    return ok && fwrite(eoi, sizeof(eoi), 1, fp) == 1;
+}
+
+static bool write_jpeg(struct image_writer_ctx *ctx, mp_image_t *image, FILE *fp)
+{
+    // Strip heights must be a multiple of the MCU height, and the restart
+    // interval (MCUs per strip) must fit into 16 bits.
+    int mcu_w = 8, mcu_h = 8;
+    if (ctx->opts->jpeg_source_chroma) {
+        mcu_w <<= ctx->original_format.chroma_xs;
+        mcu_h <<= ctx->original_format.chroma_ys;
+    } else {
+        mcu_w = mcu_h = 16; // libjpeg default is 4:2:0
+    }
+    int mcus_x = (image->w + mcu_w - 1) / mcu_w;
+    int mcus_y = (image->h + mcu_h - 1) / mcu_h;
+    int num_strips = MPMIN(get_threads(ctx), MAX_STRIPS);
+    num_strips = MPMIN(num_strips, image->h / MIN_STRIP_ROWS);
+    int strip_mcus_y = num_strips > 1 ? (mcus_y + num_strips - 1) / num_strips : 0;
+    if (num_strips < 2 || (int64_t)strip_mcus_y * mcus_x > 0xFFFF)
+        return encode_jpeg(ctx, image, 0, image->h, fp, NULL, NULL);
+    num_strips = (mcus_y + strip_mcus_y - 1) / strip_mcus_y;
+
+    struct jpeg_strip strips[MAX_STRIPS] = {{0}};
+    pthread_t threads[MAX_STRIPS];
+    bool started[MAX_STRIPS] = {0};
+    for (int n = 0; n < num_strips; n++) {
+        struct jpeg_strip *s = &strips[n];
+        s->ctx = ctx;
+        s->image = image;
+        s->y0 = n * strip_mcus_y * mcu_h;
+        s->h = MPMIN(strip_mcus_y * mcu_h, image->h - s->y0);
+        if (n > 0)
+            started[n] = !pthread_create(&threads[n], NULL, jpeg_strip_thread, s);
+    }
+    jpeg_strip_thread(&strips[0]);
+
+    bool ok = true;
+    for (int n = 0; n < num_strips; n++) {
+        if (n > 0 && started[n]) {
+            pthread_join(threads[n], NULL);
+        } else if (n > 0) {
+            jpeg_strip_thread(&strips[n]);
+        }
+        ok &= strips[n].ok;
+    }
+
+    if (ok) {
+        ok = write_jpeg_strips(strips, num_strips, strip_mcus_y * mcus_x,
+                               image->h, fp);
+    }
+
+    for (int n = 0; n < num_strips; n++)
+        free(strips[n].buf);
+    return ok;
+}
+
 #endif
 
 static int get_encoder_format(struct AVCodec *codec, int srcfmt, bool highdepth)
@@ -33,6 +33,7 @@ struct image_writer_opts {
     int jpeg_baseline;
     int jpeg_source_chroma;
     int tag_csp;
+    int encoder_threads;
 };
 
 extern const struct image_writer_opts image_writer_opts_defaults;
@@ -22,6 +22,7 @@
 #include <libavutil/mem.h>
 #include <libavutil/common.h>
 #include <libavutil/bswap.h>
+#include <libavutil/cpu.h>
 #include <libavutil/hwcontext.h>
 #include <libavutil/rational.h>
 #include <libavcodec/avcodec.h>
@@ -36,6 +37,7 @@
 #include "mp_image.h"
 #include "sws_utils.h"
 #include "fmt-conversion.h"
+#include "gpu_memcpy.h"
 
 #include "video/filter/vf.h"
 
@@ -165,6 +167,91 @@ fail:
     return NULL;
 }
 
+// Freed image buffers are kept in a process-wide cache, so that all users of
+// mp_image_alloc() (decoder, filters, mp_image_pool, screenshots...) recycle
+// each other's allocations instead of going through malloc/free, which for
+// large buffers usually means mmap/munmap. Sizes are rounded up so that
+// slightly different image sizes can share buffers. Small images are not
+// worth caching.
+#define BUF_CACHE_MIN_SIZE      (64 * 1024)
+#define BUF_CACHE_ROUND         (64 * 1024)
+#define BUF_CACHE_MAX_BYTES     (128 * 1024 * 1024)
+#define BUF_CACHE_MAX_ENTRIES   32
+
+static pthread_mutex_t buf_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t *buf_cache_data[BUF_CACHE_MAX_ENTRIES]; // oldest first
+static size_t buf_cache_size[BUF_CACHE_MAX_ENTRIES];
+static int buf_cache_num;
+static size_t buf_cache_bytes;
+
+static void buf_cache_free(void *opaque, uint8_t *data)
+{
+    size_t size = (uintptr_t)opaque;
+    uint8_t *evict[BUF_CACHE_MAX_ENTRIES + 1];
+    int num_evict = 0;
+
+    pthread_mutex_lock(&buf_cache_lock);
+    if (size > BUF_CACHE_MAX_BYTES) {
+        evict[num_evict++] = data;
+    } else {
+        // Drop the least recently freed buffers until the new one fits.
+        while (buf_cache_num == BUF_CACHE_MAX_ENTRIES ||
+               buf_cache_bytes + size > BUF_CACHE_MAX_BYTES)
+        {
+            evict[num_evict++] = buf_cache_data[0];
+            buf_cache_bytes -= buf_cache_size[0];
+            buf_cache_num--;
+            memmove(&buf_cache_data[0], &buf_cache_data[1],
+                    buf_cache_num * sizeof(buf_cache_data[0]));
+            memmove(&buf_cache_size[0], &buf_cache_size[1],
+                    buf_cache_num * sizeof(buf_cache_size[0]));
+        }
+        buf_cache_data[buf_cache_num] = data;
+        buf_cache_size[buf_cache_num] = size;
+        buf_cache_num++;
+        buf_cache_bytes += size;
+    }
+    pthread_mutex_unlock(&buf_cache_lock);
+
+    for (int n = 0; n < num_evict; n++)
+        av_free(evict[n]);
+}
+
+static AVBufferRef *buf_cache_alloc(size_t size)
+{
+    if (size < BUF_CACHE_MIN_SIZE)
+        return av_buffer_alloc(size);
+
+    size = MP_ALIGN_UP(size, BUF_CACHE_ROUND);
+
+    uint8_t *data = NULL;
+    pthread_mutex_lock(&buf_cache_lock);
+    for (int n = buf_cache_num - 1; n >= 0; n--) {
+        if (buf_cache_size[n] == size) {
+            data = buf_cache_data[n];
+            buf_cache_bytes -= size;
+            buf_cache_num--;
+            memmove(&buf_cache_data[n], &buf_cache_data[n + 1],
+                    (buf_cache_num - n) * sizeof(buf_cache_data[0]));
+            memmove(&buf_cache_size[n], &buf_cache_size[n + 1],
+                    (buf_cache_num - n) * sizeof(buf_cache_size[0]));
+            break;
+        }
+    }
+    pthread_mutex_unlock(&buf_cache_lock);
+
+    if (!data)
+        data = av_malloc(size);
+    if (!data)
+        return NULL;
+
+    AVBufferRef *buf = av_buffer_create(data, size, buf_cache_free,
+                                        (void *)(uintptr_t)size, 0);
+    if (!buf)
+        av_free(data);
+    return buf;
+}
+
 static bool mp_image_alloc_planes(struct mp_image *mpi)
 {
     assert(!mpi->planes[0]);
@@ -177,7 +264,7 @@ static bool mp_image_alloc_planes(struct mp_image *mpi)
         return false;
 
     // Note: mp_image_pool assumes this creates only 1 AVBufferRef.
-    mpi->bufs[0] = av_buffer_alloc(size + align);
+    mpi->bufs[0] = buf_cache_alloc(size + align);
     if (!mpi->bufs[0])
         return false;
 
@@ -477,6 +564,19 @@ void mp_image_copy(struct mp_image *dst, struct mp_image *src)
     mp_image_copy_cb(dst, src, memcpy);
 }
 
+// Like mp_image_copy(), but faster if src is in uncached (write-combined)
+// memory, like mapped GPU surfaces. Slower for normal memory.
+void mp_image_copy_gpu(struct mp_image *dst, struct mp_image *src)
+{
+#if HAVE_SSE4_INTRINSICS
+    if (av_get_cpu_flags() & AV_CPU_FLAG_SSE4) {
+        mp_image_copy_cb(dst, src, gpu_memcpy);
+        return;
+    }
+#endif
+    mp_image_copy(dst, src);
+}
+
 static enum mp_csp mp_image_params_get_forced_csp(struct mp_image_params *params)
 {
     int imgfmt = params->hw_subfmt ? params->hw_subfmt : params->imgfmt;
@@ -641,6 +741,22 @@ char *mp_image_params_to_str_buf(char *b, size_t bs,
                             m_opt_choice_str(mp_spherical_names, p->spherical.type),
                             a[0], a[1], a[2]);
         }
+        const struct mp_gpu_ops *ops = &p->gpu_ops;
+        if (ops->crop.x1 > ops->crop.x0 || ops->deint ||
+            ops->brightness || ops->contrast || ops->saturation || ops->gamma)
+        {
+            mp_snprintf_cat(b, bs, " gpu=");
+            if (ops->crop.x1 > ops->crop.x0) {
+                mp_snprintf_cat(b, bs, "crop:%dx%d+%d+%d,",
+                                ops->crop.x1 - ops->crop.x0,
+                                ops->crop.y1 - ops->crop.y0,
+                                ops->crop.x0, ops->crop.y0);
+            }
+            if (ops->deint)
+                mp_snprintf_cat(b, bs, "deint,");
+            mp_snprintf_cat(b, bs, "eq:%d/%d/%d/%d", ops->brightness,
+                            ops->contrast, ops->saturation, ops->gamma);
+        }
     } else {
         snprintf(b, bs, "???");
     }
@@ -685,6 +801,18 @@ static bool mp_spherical_equal(const struct mp_spherical_params *p1,
     return p1->type == p2->type;
 }
 
+static bool mp_gpu_ops_equal(const struct mp_gpu_ops *p1,
+                             const struct mp_gpu_ops *p2)
+{
+    struct mp_rect crop1 = p1->crop, crop2 = p2->crop;
+    return mp_rect_equals(&crop1, &crop2) &&
+           p1->deint == p2->deint &&
+           p1->brightness == p2->brightness &&
+           p1->contrast == p2->contrast &&
+           p1->saturation == p2->saturation &&
+           p1->gamma == p2->gamma;
+}
+
 bool mp_image_params_equal(const struct mp_image_params *p1,
                            const struct mp_image_params *p2)
 {
@@ -698,7 +826,8 @@ bool mp_image_params_equal(const struct mp_image_params *p1,
            p1->rotate == p2->rotate &&
            p1->stereo_in == p2->stereo_in &&
            p1->stereo_out == p2->stereo_out &&
-           mp_spherical_equal(&p1->spherical, &p2->spherical);
+           mp_spherical_equal(&p1->spherical, &p2->spherical) &&
+           mp_gpu_ops_equal(&p1->gpu_ops, &p2->gpu_ops);
 }
 
 // Set most image parameters, but not image format or size.
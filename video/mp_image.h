@@ -48,6 +48,14 @@ struct mp_spherical_params {
     float ref_angles[3]; // yaw/pitch/roll, refer to AVSphericalMapping
 };
 
+// Operations applied by the VO on the GPU (vf_gpu). All 0 means none.
+struct mp_gpu_ops {
+    struct mp_rect crop;    // displayed part of the image (unset if empty)
+    bool deint;             // deinterlace (field per MP_IMGFIELD_TOP_FIRST)
+    // Added to the video equalizer (in the same units as --brightness etc.)
+    int brightness, contrast, saturation, gamma;
+};
+
 enum mp_image_hw_flags {
     MP_IMAGE_HW_FLAG_OPAQUE = 1,    // an opaque hw format is used - the exact
                                     // format is subject to hwctx internals
@@ -69,6 +77,7 @@ struct mp_image_params {
     enum mp_stereo3d_mode stereo_in;    // image is encoded with this mode
     enum mp_stereo3d_mode stereo_out;   // should be displayed with this mode
     struct mp_spherical_params spherical;
+    struct mp_gpu_ops gpu_ops;
 };
 
 /* Memory management:
@@ -133,6 +142,7 @@ struct mp_image *mp_image_from_buffer(int imgfmt, int w, int h, int stride_align
 
 struct mp_image *mp_image_alloc(int fmt, int w, int h);
 void mp_image_copy(struct mp_image *dmpi, struct mp_image *mpi);
+void mp_image_copy_gpu(struct mp_image *dst, struct mp_image *src);
 void mp_image_copy_attributes(struct mp_image *dmpi, struct mp_image *mpi);
 struct mp_image *mp_image_new_copy(struct mp_image *img);
 struct mp_image *mp_image_new_ref(struct mp_image *img);
@@ -252,6 +252,40 @@ void mp_image_pool_set_lru(struct mp_image_pool *pool)
 }
 
 
+// Map src to system memory and copy it to dst with mp_image_copy_gpu(). This
+// is faster than av_hwframe_transfer_data() if src is mapped directly as
+// write-combined memory (e.g. vaapi and dxva2), because libavutil uses plain
+// memcpy() for the copy. Returns false if mapping is not supported.
+static bool hw_download_mapped(struct mp_image *dst, struct mp_image *src)
+{
+    bool ok = false;
+    struct mp_image *mapped = NULL;
+    AVFrame *srcav = mp_image_to_av_frame(src);
+    AVFrame *dstav = av_frame_alloc();
+    if (!srcav || !dstav)
+        goto done;
+
+    dstav->format = imgfmt2pixfmt(dst->imgfmt);
+    if (av_hwframe_map(dstav, srcav, AV_HWFRAME_MAP_READ) < 0)
+        goto done;
+
+    mapped = mp_image_from_av_frame(dstav);
+    if (!mapped || mapped->imgfmt != dst->imgfmt ||
+        mapped->w < src->w || mapped->h < src->h)
+        goto done;
+
+    mp_image_set_size(mapped, src->w, src->h);
+    mp_image_set_size(dst, src->w, src->h);
+    mp_image_copy_gpu(dst, mapped);
+    ok = true;
+
+done:
+    talloc_free(mapped);
+    av_frame_free(&dstav);
+    av_frame_free(&srcav);
+    return ok;
+}
+
 // Copies the contents of the HW surface img to system memory and retuns it.
 // If swpool is not NULL, it's used to allocate the target image.
 // img must be a hw surface with a AVHWFramesContext attached.
@@ -285,6 +319,11 @@ struct mp_image *mp_image_hw_download(struct mp_image *src,
     if (!dst)
         return NULL;
 
+    if (hw_download_mapped(dst, src)) {
+        mp_image_copy_attributes(dst, src);
+        return dst;
+    }
+
     // Target image must be writable, so unref it.
     AVFrame *dstav = mp_image_to_av_frame_and_unref(dst);
     if (!dstav)
@@ -113,6 +113,18 @@ static void src_dst_split_scaling(int src_size, int dst_size,
     clamp_size(dst_size, dst_start, dst_end);
 }
 
+// Map rc (in an image of size w/h) to the image rotated clockwise by rotate
+// degrees (multiples of 90 only).
+static struct mp_rect rotate_rect(struct mp_rect rc, int w, int h, int rotate)
+{
+    switch (rotate) {
+    case 90:  return (struct mp_rect){h - rc.y1, rc.x0, h - rc.y0, rc.x1};
+    case 180: return (struct mp_rect){w - rc.x1, h - rc.y1, w - rc.x0, h - rc.y0};
+    case 270: return (struct mp_rect){rc.y0, w - rc.x1, rc.y1, w - rc.x0};
+    }
+    return rc;
+}
+
 void mp_get_src_dst_rects(struct mp_log *log, struct mp_vo_opts *opts,
                           int vo_caps, struct mp_image_params *video,
                           int window_w, int window_h, double monitor_par,
@@ -124,6 +136,17 @@ void mp_get_src_dst_rects(struct mp_log *log, struct mp_vo_opts *opts,
     int src_h = video->h;
     int src_dw, src_dh;
     mp_image_params_get_dsize(video, &src_dw, &src_dh);
+    struct mp_rect crop = {0, 0, src_w, src_h};
+    if (vo_caps & VO_CAP_GPU_OPS) {
+        struct mp_rect c = video->gpu_ops.crop;
+        if (c.x1 > c.x0 && c.y1 > c.y0) {
+            src_dw = (int64_t)src_dw * (c.x1 - c.x0) / src_w;
+            src_dh = (int64_t)src_dh * (c.y1 - c.y0) / src_h;
+            src_w = c.x1 - c.x0;
+            src_h = c.y1 - c.y0;
+            crop = c;
+        }
+    }
     if (video->rotate % 180 == 90 && (vo_caps & VO_CAP_ROTATE90)) {
         MPSWAP(int, src_w, src_h);
         MPSWAP(int, src_dw, src_dh);
@@ -152,6 +175,14 @@ void mp_get_src_dst_rects(struct mp_log *log, struct mp_vo_opts *opts,
                               &osd.mt, &osd.mb);
     }
 
+    // Move the source rect into the crop rect (in rotated coordinates).
+    if (video->rotate % 90 == 0 && (vo_caps & VO_CAP_ROTATE90))
+        crop = rotate_rect(crop, video->w, video->h, video->rotate);
+    src.x0 += crop.x0;
+    src.x1 += crop.x0;
+    src.y0 += crop.y0;
+    src.y1 += crop.y0;
+
     *out_src = src;
     *out_dst = dst;
     *out_osd = osd;
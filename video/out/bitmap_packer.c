@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 #include <limits.h>
 
 #include <libavutil/common.h>
@@ -32,6 +33,12 @@
 
 #define IS_POWER_OF_2(x) (((x) > 0) && !(((x) - 1) & (x)))
 
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
 void packer_reset(struct bitmap_packer *packer)
 {
     struct bitmap_packer old = *packer;
@@ -48,82 +55,88 @@ void packer_get_bb(struct bitmap_packer *packer, struct pos out_bb[2])
     out_bb[1] = (struct pos) {packer->used_width, packer->used_height};
 }
 
-#define HEIGHT_SORT_BITS 4
-static int size_index(int s)
-{
-    int n = av_log2_16bit(s);
-    return (n << HEIGHT_SORT_BITS)
-       + ((- 1 - (s << HEIGHT_SORT_BITS >> n)) & ((1 << HEIGHT_SORT_BITS) - 1));
-}
-
 /* Pack the given rectangles into an area of size w * h.
- * The size of each rectangle is read from in[i].x / in[i].y.
- * The height of each rectangle must be less than 65536.
- * 'scratch' must point to work memory for num_rects+16 ints.
+ * The size of each rectangle is read from in[i].x / in[i].y, and must be less
+ * than 65536.
+ * 'order' must point to work memory for num_rects items, and 'sky' for
+ * num_rects+1 items.
  * The packed position for rectangle number i is set in out[i].
- * Return 0 on success, -1 if the rectangles did not fit in w*h.
+ * Return the used height on success, -1 if the rectangles did not fit in w*h.
  *
- * The rectangles are placed in rows in order approximately sorted by
- * height (the approximate sorting is simpler than a full one would be,
- * and allows the algorithm to work in linear time). Additionally, to
- * reduce wasted space when there are a few tall rectangles, empty
- * lower-right parts of rows are filled recursively when the size of
- * rectangles in the row drops past a power-of-two threshold. So if a
- * row starts with rectangles of size 3x50, 10x40 and 5x20 then the
- * free rectangle with corners (13, 20)-(w, 50) is filled recursively.
+ * This is a skyline packer: the top edge of the packed area is kept as list
+ * of horizontal segments (sky[n].x is the start of a segment, which ends at
+ * the start of the next one, and sky[n].y is its height). Rectangles are
+ * placed in order of decreasing height, each at the position where it ends up
+ * lowest (and leftmost among these). Compared to packing rows of similar
+ * height, this wastes much less space next to tall rectangles.
+ * The result only depends on the input, so identical inputs always give the
+ * same placement.
  */
 static int pack_rectangles(struct pos *in, struct pos *out, int num_rects,
-                           int w, int h, int *scratch, int *used_width)
+                           int w, int h, uint64_t *order, struct pos *sky,
+                           int *used_width)
 {
-    int bins[16 << HEIGHT_SORT_BITS];
-    int sizes[16 << HEIGHT_SORT_BITS] = { 0 };
-    for (int i = 0; i < num_rects; i++)
-        sizes[size_index(in[i].y)]++;
-    int idx = 0;
-    for (int i = 0; i < 16 << HEIGHT_SORT_BITS; i += 1 << HEIGHT_SORT_BITS) {
-        for (int j = 0; j < 1 << HEIGHT_SORT_BITS; j++) {
-            bins[i + j] = idx;
-            idx += sizes[i + j];
+    // Sort by decreasing height, then width. The index is part of the key, so
+    // the order is the same with any qsort implementation.
+    int num_order = 0;
+    for (int i = 0; i < num_rects; i++) {
+        out[i] = (struct pos){0, 0};
+        if (in[i].x && in[i].y) {
+            order[num_order++] = ((uint64_t)(65535 - in[i].y) << 47) |
+                                 ((uint64_t)(65535 - in[i].x) << 31) | i;
         }
-        scratch[idx++] = -1;
     }
-    for (int i = 0; i < num_rects; i++)
-        scratch[bins[size_index(in[i].y)]++] = i;
-    for (int i = 0; i < 16; i++)
-        bins[i] = bins[i << HEIGHT_SORT_BITS] - sizes[i << HEIGHT_SORT_BITS];
-    struct {
-        int size, x, bottom;
-    } stack[16] = {{15, 0, h}}, s = {};
-    int stackpos = 1;
-    int y;
-    while (stackpos) {
-        y = s.bottom;
-        s = stack[--stackpos];
-        s.size++;
-        while (s.size--) {
-            int maxy = -1;
-            int obj;
-            while ((obj = scratch[bins[s.size]]) >= 0) {
-                int bottom = y + in[obj].y;
-                if (bottom > s.bottom)
-                    break;
-                int right = s.x + in[obj].x;
-                if (right > w)
+    qsort(order, num_order, sizeof(order[0]), cmp_u64);
+
+    int num_sky = 1;
+    sky[0] = (struct pos){0, 0};
+    int used_height = 0;
+
+    for (int r = 0; r < num_order; r++) {
+        int obj = order[r] & INT_MAX;
+        int rw = in[obj].x, rh = in[obj].y;
+
+        int best = -1, best_y = h - rh + 1;
+        for (int n = 0; n < num_sky && sky[n].x + rw <= w; n++) {
+            int y = 0;
+            for (int i = n; i < num_sky && sky[i].x < sky[n].x + rw; i++) {
+                y = MPMAX(y, sky[i].y);
+                if (y >= best_y)
                     break;
-                bins[s.size]++;
-                out[obj] = (struct pos){s.x, y};
-                num_rects--;
-                if (maxy < 0)
-                    stack[stackpos++] = s;
-                s.x = right;
-                maxy = FFMAX(maxy, bottom);
             }
-            *used_width = FFMAX(*used_width, s.x);
-            if (maxy > 0)
-                s.bottom = maxy;
+            if (y < best_y) {
+                best = n;
+                best_y = y;
+            }
+        }
+        if (best < 0)
+            return -1;
+
+        int x0 = sky[best].x, x1 = x0 + rw;
+        out[obj] = (struct pos){x0, best_y};
+        *used_width = MPMAX(*used_width, x1);
+        used_height = MPMAX(used_height, best_y + rh);
+
+        // Replace the covered segments sky[best..end) with the top edge of the
+        // rectangle, and the rest of the last covered segment (if any).
+        int end = best;
+        while (end < num_sky && sky[end].x < x1)
+            end++;
+        struct pos new[2] = {{x0, best_y + rh}, {x1, sky[end - 1].y}};
+        int num_new = x1 < (end < num_sky ? sky[end].x : w) ? 2 : 1;
+        memmove(&sky[best + num_new], &sky[end], (num_sky - end) * sizeof(sky[0]));
+        num_sky += num_new - (end - best);
+        memcpy(&sky[best], new, num_new * sizeof(sky[0]));
+
+        // Merge neighbouring segments of the same height.
+        int num = 1;
+        for (int n = 1; n < num_sky; n++) {
+            if (sky[n].y != sky[num - 1].y)
+                sky[num++] = sky[n];
         }
+        num_sky = num;
     }
-    return num_rects ? -1 : y;
+    return used_height;
 }
 
 int packer_pack(struct bitmap_packer *packer)
@@ -155,10 +168,15 @@ int packer_pack(struct bitmap_packer *packer)
         int used_width = 0;
         int y = pack_rectangles(in, packer->result, packer->count,
                                 packer->w, packer->h,
-                                packer->scratch, &used_width);
+                                packer->scratch, packer->sky, &used_width);
         if (y >= 0) {
             packer->used_width = FFMIN(used_width, packer->w);
             packer->used_height = FFMIN(y, packer->h);
+            int64_t area = 0;
+            for (int i = 0; i < packer->count; i++)
+                area += (int64_t)in[i].x * in[i].y;
+            int64_t bb_area = (int64_t)packer->used_width * packer->used_height;
+            packer->occupancy = bb_area > 0 ? area / (double)bb_area : 0;
             assert(packer->w == 0 || IS_POWER_OF_2(packer->w));
             assert(packer->h == 0 || IS_POWER_OF_2(packer->h));
             if (packer->padding) {
@@ -191,9 +209,11 @@ void packer_set_size(struct bitmap_packer *packer, int size)
     packer->asize = FFMAX(packer->asize * 2, size);
     talloc_free(packer->result);
     talloc_free(packer->scratch);
+    talloc_free(packer->sky);
     packer->in = talloc_realloc(packer, packer->in, struct pos, packer->asize);
     packer->result = talloc_array_ptrtype(packer, packer->result,
                                           packer->asize);
     packer->scratch = talloc_array_ptrtype(packer, packer->scratch,
-                                           packer->asize + 16);
+                                           packer->asize);
+    packer->sky = talloc_array_ptrtype(packer, packer->sky, packer->asize + 1);
 }
@@ -1,6 +1,8 @@
 #ifndef MPLAYER_PACK_RECTANGLES_H
 #define MPLAYER_PACK_RECTANGLES_H
 
+#include <stdint.h>
+
 struct pos {
     int x;
     int y;
@@ -17,9 +19,13 @@ struct bitmap_packer {
     struct pos *result;
     int used_width;
     int used_height;
+    // Fraction of the used bounding box covered by the rectangles (including
+    // padding), for statistics.
+    double occupancy;
 
     // internal
-    int *scratch;
+    uint64_t *scratch;
+    struct pos *sky;
     int asize;
 };
 
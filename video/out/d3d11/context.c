@@ -17,6 +17,7 @@
 
 #include "common/msg.h"
 #include "options/m_config.h"
+#include "osdep/timer.h"
 #include "osdep/windows_utils.h"
 
 #include "video/out/gpu/context.h"
@@ -68,6 +69,14 @@ struct priv {
     struct ra_tex *backbuffer;
     ID3D11Device *device;
     IDXGISwapChain *swapchain;
+
+    // Presentation feedback (DXGI frame statistics) from the last query
+    LARGE_INTEGER perf_freq;
+    UINT last_present_count;
+    UINT last_refresh_count;
+    UINT last_sync_refresh_count;
+    LARGE_INTEGER last_sync_qpc_time;
+    int64_t vsync_duration;
 };
 
 static struct mp_image *d3d11_screenshot(struct ra_swapchain *sw)
@@ -151,6 +160,76 @@ static void d3d11_swap_buffers(struct ra_swapchain *sw)
     IDXGISwapChain_Present(p->swapchain, p->opts->sync_interval, 0);
 }
 
+static int64_t qpc_to_us(struct priv *p, LARGE_INTEGER qpc)
+{
+    int64_t freq = p->perf_freq.QuadPart;
+    return qpc.QuadPart / freq * 1000000 +
+           qpc.QuadPart % freq * 1000000 / freq;
+}
+
+static void d3d11_get_vsync(struct ra_swapchain *sw, struct vo_vsync_info *info)
+{
+    struct priv *p = sw->priv;
+    HRESULT hr;
+
+    // The statistics only map to single vsyncs if every frame is presented
+    // for exactly one refresh.
+    if (p->opts->sync_interval != 1 || !p->perf_freq.QuadPart)
+        return;
+
+    UINT submit_count;
+    hr = IDXGISwapChain_GetLastPresentCount(p->swapchain, &submit_count);
+    if (FAILED(hr))
+        return;
+
+    // Only available with flip model swapchains or in exclusive fullscreen
+    DXGI_FRAME_STATISTICS stats;
+    hr = IDXGISwapChain_GetFrameStatistics(p->swapchain, &stats);
+    if (hr == DXGI_ERROR_FRAME_STATISTICS_DISJOINT) {
+        p->last_present_count = 0;
+        p->last_sync_refresh_count = 0;
+        p->vsync_duration = 0;
+        return;
+    }
+    if (FAILED(hr) || !stats.SyncRefreshCount)
+        return;
+
+    if (p->last_sync_refresh_count &&
+        stats.SyncRefreshCount > p->last_sync_refresh_count)
+    {
+        int64_t refreshes = stats.SyncRefreshCount - p->last_sync_refresh_count;
+        int64_t time = qpc_to_us(p, stats.SyncQPCTime) -
+                       qpc_to_us(p, p->last_sync_qpc_time);
+        p->vsync_duration = time / refreshes;
+    }
+
+    // Every refresh that didn't show a new frame was skipped
+    if (p->last_present_count &&
+        stats.PresentCount >= p->last_present_count)
+    {
+        int64_t presents = stats.PresentCount - p->last_present_count;
+        int64_t refreshes = stats.PresentRefreshCount - p->last_refresh_count;
+        info->skipped_vsyncs = MPMAX(refreshes - presents, 0);
+    }
+
+    p->last_present_count = stats.PresentCount;
+    p->last_refresh_count = stats.PresentRefreshCount;
+    p->last_sync_refresh_count = stats.SyncRefreshCount;
+    p->last_sync_qpc_time = stats.SyncQPCTime;
+
+    if (p->vsync_duration <= 0)
+        return;
+    info->vsync_duration = p->vsync_duration;
+
+    // SyncQPCTime is the time of the last vsync, at which PresentCount was the
+    // most recently shown frame. The frames submitted after that are shown on
+    // the following vsyncs.
+    int64_t queued = (int64_t)(submit_count - stats.PresentCount);
+    info->last_queue_display_time =
+        mp_time_from_raw_us(qpc_to_us(p, stats.SyncQPCTime)) +
+        queued * p->vsync_duration;
+}
+
 static int d3d11_control(struct ra_ctx *ctx, int *events, int request, void *arg)
 {
     int ret = vo_w32_control(ctx->vo, events, request, arg);
@@ -181,12 +260,14 @@ static const struct ra_swapchain_fns d3d11_swapchain = {
     .start_frame  = d3d11_start_frame,
     .submit_frame = d3d11_submit_frame,
     .swap_buffers = d3d11_swap_buffers,
+    .get_vsync    = d3d11_get_vsync,
 };
 
 static bool d3d11_init(struct ra_ctx *ctx)
 {
     struct priv *p = ctx->priv = talloc_zero(ctx, struct priv);
     p->opts = mp_get_config_group(ctx, ctx->global, &d3d11_conf);
+    QueryPerformanceFrequency(&p->perf_freq);
 
     struct ra_swapchain *sw = ctx->swapchain = talloc_zero(ctx, struct ra_swapchain);
     sw->priv = p;
@@ -27,6 +27,7 @@
 #include <string.h>
 #include <assert.h>
 #include <math.h>
+#include <pthread.h>
 
 #include <libavutil/lfg.h>
 
@@ -100,68 +101,82 @@ static void makegauss(struct ctx *k, unsigned int sizeb)
     }
 }
 
-static void setbit(struct ctx *k, index_t c)
+// Add the gaussian centered at c to gaussmat[start..end), and collect the
+// not yet set entries with the lowest value in the same pass.
+static void setbit_range(struct ctx *k, const uint64_t *g, index_t start,
+                         index_t end, uint64_t *min, index_t *resnum)
 {
-    if (k->calcmat[c])
-        return;
-    k->calcmat[c] = true;
     uint64_t *m = k->gaussmat;
-    uint64_t *me = k->gaussmat + k->size2;
-    uint64_t *g = k->gauss + WRAP_SIZE2(k, k->gauss_middle + k->size2 - c);
-    uint64_t *ge = k->gauss + k->size2;
-    while (g < ge)
-        *m++ += *g++;
-    g = k->gauss;
-    while (m < me)
-        *m++ += *g++;
+    const bool *calc = k->calcmat;
+    for (index_t i = start; i < end; i++) {
+        uint64_t total = (m[i] += g[i - start]);
+        if (total <= *min && !calc[i]) {
+            if (total != *min) {
+                *min = total;
+                *resnum = 0;
+            }
+            k->randomat[(*resnum)++] = i;
+        }
+    }
 }
 
-static index_t getmin(struct ctx *k)
+// Set the bit c, and return the next one to set. This is the innermost loop of
+// the algorithm (O(size2^2) in total), so updating the matrix and searching
+// the minimum are done in a single pass over the memory.
+static index_t setbit_getmin(struct ctx *k, index_t c)
 {
+    k->calcmat[c] = true;
     uint64_t min = UINT64_MAX;
     index_t resnum = 0;
-    unsigned int size2 = k->size2;
-    for (index_t c = 0; c < size2; c++) {
-        if (k->calcmat[c])
-            continue;
-        uint64_t total = k->gaussmat[c];
-        if (total <= min) {
-            if (total != min) {
-                min = total;
-                resnum = 0;
-            }
-            k->randomat[resnum++] = c;
-        }
-    }
+    index_t split = k->size2 - WRAP_SIZE2(k, k->gauss_middle + k->size2 - c);
+    setbit_range(k, k->gauss + k->size2 - split, 0, split, &min, &resnum);
+    setbit_range(k, k->gauss, split, k->size2, &min, &resnum);
     if (resnum == 1)
         return k->randomat[0];
-    if (resnum == size2)
-        return size2 / 2;
     return k->randomat[av_lfg_get(&k->avlfg) % resnum];
 }
 
 static void makeuniform(struct ctx *k)
 {
     unsigned int size2 = k->size2;
+    // With an empty matrix, all entries are equal.
+    index_t r = size2 / 2;
     for (index_t c = 0; c < size2; c++) {
-        index_t r = getmin(k);
-        setbit(k, r);
         k->unimat[r] = c;
+        if (c + 1 < size2)
+            r = setbit_getmin(k, r);
     }
 }
 
+// The result only depends on the size, and generating the larger ones takes a
+// noticeable amount of time, so they are kept for the lifetime of the process.
+static pthread_mutex_t fruit_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static float *fruit_cache[MAX_SIZEB + 1];
+
 // out_matrix is a reactangular tsize * tsize array, where tsize = (1 << size).
 void mp_make_fruit_dither_matrix(float *out_matrix, int size)
 {
-    struct ctx *k = talloc_zero(NULL, struct ctx);
-    makegauss(k, size);
-    makeuniform(k);
-    float invscale = k->size2;
-    for(index_t y = 0; y < k->size; y++) {
-        for(index_t x = 0; x < k->size; x++)
-            out_matrix[x + y * k->size] = k->unimat[XY(k, x, y)] / invscale;
+    assert(size >= 1 && size <= MAX_SIZEB);
+    size_t bytes = sizeof(float) << (2 * size);
+
+    pthread_mutex_lock(&fruit_cache_lock);
+    if (fruit_cache[size]) {
+        memcpy(out_matrix, fruit_cache[size], bytes);
+    } else {
+        struct ctx *k = talloc_zero(NULL, struct ctx);
+        makegauss(k, size);
+        makeuniform(k);
+        float invscale = k->size2;
+        for(index_t y = 0; y < k->size; y++) {
+            for(index_t x = 0; x < k->size; x++)
+                out_matrix[x + y * k->size] = k->unimat[XY(k, x, y)] / invscale;
+        }
+        talloc_free(k);
+        fruit_cache[size] = malloc(bytes);
+        if (fruit_cache[size])
+            memcpy(fruit_cache[size], out_matrix, bytes);
     }
-    talloc_free(k);
+    pthread_mutex_unlock(&fruit_cache_lock);
 }
 
 void mp_make_ordered_dither_matrix(unsigned char *m, int size)
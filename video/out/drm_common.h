@@ -24,6 +24,10 @@
 #include "options/m_option.h"
 #include "drm_atomic.h"
 
+// Maximum number of rendered frames queued for page flipping by the DRM EGL
+// context, in addition to the one on screen.
+#define DRM_MAX_QUEUED_FRAMES 3
+
 struct kms {
     struct mp_log *log;
     int fd;
@@ -173,6 +173,95 @@ void mp_compute_lut(struct filter_kernel *filter, int count, int stride,
     }
 }
 
+// Maximum number of LUTs kept by struct mp_lut_cache. Each scaler (including
+// the tscale and the separate chroma scaler) usually needs one at a time, so
+// this leaves room for switching back and forth between scale factors.
+#define LUT_CACHE_SIZE 16
+
+struct lut_cache_entry {
+    struct filter_kernel filter; // parameters the LUT was computed with
+    int count, stride;
+    float *weights;
+};
+
+struct mp_lut_cache {
+    // Most recently used entry first.
+    struct lut_cache_entry *entries[LUT_CACHE_SIZE];
+    int num_entries;
+};
+
+struct mp_lut_cache *mp_lut_cache_create(void *ta_parent)
+{
+    return talloc_zero(ta_parent, struct mp_lut_cache);
+}
+
+static bool window_equals(const struct filter_window *a,
+                          const struct filter_window *b)
+{
+    return a->weight == b->weight && a->radius == b->radius &&
+           a->params[0] == b->params[0] && a->params[1] == b->params[1] &&
+           a->blur == b->blur && a->taper == b->taper;
+}
+
+// Whether mp_compute_lut() would produce the same output for both filters.
+static bool lut_params_equal(const struct filter_kernel *a,
+                             const struct filter_kernel *b)
+{
+    if (!window_equals(&a->f, &b->f) || !window_equals(&a->w, &b->w) ||
+        a->clamp != b->clamp || a->polar != b->polar)
+        return false;
+    if (a->polar) {
+        // Polar LUTs are indexed by radius, independent of the scale factor.
+        return a->value_cutoff == b->value_cutoff;
+    }
+    return a->size == b->size && a->filter_scale == b->filter_scale;
+}
+
+// Like mp_compute_lut(), but return a previously computed LUT if the filter
+// parameters are the same. The returned array is owned by the cache, and is
+// valid until the next call. (This also sets filter->radius_cutoff, like
+// mp_compute_lut().)
+const float *mp_compute_lut_cached(struct mp_lut_cache *cache,
+                                   struct filter_kernel *filter, int count,
+                                   int stride)
+{
+    struct lut_cache_entry *e = NULL;
+    int n;
+    for (n = 0; n < cache->num_entries; n++) {
+        struct lut_cache_entry *cur = cache->entries[n];
+        if (cur->count == count && cur->stride == stride &&
+            lut_params_equal(&cur->filter, filter))
+        {
+            e = cur;
+            break;
+        }
+    }
+
+    if (e) {
+        filter->radius_cutoff = e->filter.radius_cutoff;
+    } else {
+        if (cache->num_entries == LUT_CACHE_SIZE) {
+            n = cache->num_entries - 1;
+            e = cache->entries[n];
+            talloc_free(e->weights);
+        } else {
+            n = cache->num_entries++;
+            e = cache->entries[n] = talloc_zero(cache, struct lut_cache_entry);
+        }
+        e->count = count;
+        e->stride = stride;
+        e->weights = talloc_array(e, float, count * stride);
+        mp_compute_lut(filter, count, stride, e->weights);
+        e->filter = *filter;
+    }
+
+    // Move to front.
+    memmove(&cache->entries[1], &cache->entries[0], n * sizeof(e));
+    cache->entries[0] = e;
+
+    return e->weights;
+}
+
 typedef struct filter_window params;
 
 static double box(params *p, double x)
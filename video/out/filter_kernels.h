@@ -53,4 +53,10 @@ bool mp_init_filter(struct filter_kernel *filter, const int *sizes,
 void mp_compute_lut(struct filter_kernel *filter, int count, int stride,
                     float *out_array);
 
+struct mp_lut_cache;
+struct mp_lut_cache *mp_lut_cache_create(void *ta_parent);
+const float *mp_compute_lut_cached(struct mp_lut_cache *cache,
+                                   struct filter_kernel *filter, int count,
+                                   int stride);
+
 #endif /* MPLAYER_FILTER_KERNELS_H */
@@ -27,6 +27,7 @@
 
 extern const struct ra_hwdec_driver ra_hwdec_vaegl;
 extern const struct ra_hwdec_driver ra_hwdec_vaglx;
+extern const struct ra_hwdec_driver ra_hwdec_vaapi_vk;
 extern const struct ra_hwdec_driver ra_hwdec_videotoolbox;
 extern const struct ra_hwdec_driver ra_hwdec_vdpau;
 extern const struct ra_hwdec_driver ra_hwdec_dxva2egl;
@@ -35,8 +36,10 @@ extern const struct ra_hwdec_driver ra_hwdec_d3d11eglrgb;
 extern const struct ra_hwdec_driver ra_hwdec_dxva2gldx;
 extern const struct ra_hwdec_driver ra_hwdec_dxva2;
 extern const struct ra_hwdec_driver ra_hwdec_d3d11va;
+extern const struct ra_hwdec_driver ra_hwdec_d3d11va_vk;
 extern const struct ra_hwdec_driver ra_hwdec_cuda;
 extern const struct ra_hwdec_driver ra_hwdec_cuda_nvdec;
+extern const struct ra_hwdec_driver ra_hwdec_cuda_vk;
 extern const struct ra_hwdec_driver ra_hwdec_rpi_overlay;
 extern const struct ra_hwdec_driver ra_hwdec_drmprime_drm;
 
@@ -47,6 +50,9 @@ static const struct ra_hwdec_driver *const mpgl_hwdec_drivers[] = {
 #if HAVE_VAAPI_GLX
     &ra_hwdec_vaglx,
 #endif
+#if HAVE_VAAPI_VULKAN
+    &ra_hwdec_vaapi_vk,
+#endif
 #if HAVE_VDPAU_GL_X11
     &ra_hwdec_vdpau,
 #endif
@@ -66,9 +72,15 @@ static const struct ra_hwdec_driver *const mpgl_hwdec_drivers[] = {
 #if HAVE_GL_DXINTEROP_D3D9
     &ra_hwdec_dxva2gldx,
 #endif
-#if HAVE_CUDA_HWACCEL
+#if HAVE_D3D11VA_VULKAN
+    &ra_hwdec_d3d11va_vk,
+#endif
+#if HAVE_CUDA_HWACCEL && HAVE_GL
     &ra_hwdec_cuda,
 #endif
+#if HAVE_CUDA_VULKAN
+    &ra_hwdec_cuda_vk,
+#endif
 #if HAVE_RPI
     &ra_hwdec_rpi_overlay,
 #endif
@@ -17,6 +17,7 @@
 
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "mpv_talloc.h"
 
@@ -32,6 +33,7 @@
 #include "lcms.h"
 
 #include "osdep/io.h"
+#include "osdep/threads.h"
 
 #if HAVE_LCMS2
 
@@ -39,6 +41,26 @@
 #include <libavutil/sha.h>
 #include <libavutil/mem.h>
 
+// Number of finished LUTs kept in memory, for quickly switching between
+// e.g. SDR and HDR content.
+#define LUT_CACHE_SIZE 4
+
+// A 3DLUT, generated (or being generated) by the worker thread. All
+// parameters are copied, so the worker doesn't need to access gl_lcms.
+struct lut_job {
+    struct mp_log *log;
+    struct mpv_global *global;
+    uint64_t generation;            // gl_lcms.generation at creation time
+    enum mp_csp_prim prim;
+    enum mp_csp_trc trc;
+    struct AVBufferRef *vid_profile;
+    struct bstr icc;                // display profile
+    int use_embedded, intent, contrast;
+    int size[3];
+    char *cache_dir;                // NULL if disabled
+    struct lut3d *lut;              // result (NULL on failure)
+};
+
 struct gl_lcms {
     void *icc_data;
     size_t icc_size;
@@ -52,6 +74,24 @@ struct gl_lcms {
     struct mp_log *log;
     struct mpv_global *global;
     struct mp_icc_opts *opts;
+    char *opts_key;                 // LUT-relevant options, to detect changes
+
+    // Incremented if the profile or options change, which invalidates all
+    // LUTs generated before.
+    uint64_t generation;
+    uint64_t prebuilt_generation;
+
+    // Protected by lock (and shared with the worker thread)
+    pthread_t thread;
+    bool thread_started;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    struct lut_job **queue;         // pending jobs, first is next
+    int num_queue;
+    struct lut_job *running;        // job the worker thread is working on
+    struct lut_job **done;          // finished jobs, most recently used first
+    int num_done;
+    bool terminate;
 };
 
 static bool parse_3dlut_size(const char *arg, int *p1, int *p2, int *p3)
@@ -101,8 +141,28 @@ const struct m_sub_options mp_icc_conf = {
 static void lcms2_error_handler(cmsContext ctx, cmsUInt32Number code,
                                 const char *msg)
 {
-    struct gl_lcms *p = cmsGetContextUserData(ctx);
-    MP_ERR(p, "lcms2: %s\n", msg);
+    struct lut_job *job = cmsGetContextUserData(ctx);
+    MP_ERR(job, "lcms2: %s\n", msg);
+}
+
+static void job_free(struct lut_job *job)
+{
+    if (!job)
+        return;
+    av_buffer_unref(&job->vid_profile);
+    talloc_free(job);
+}
+
+// Must be called with p->lock held.
+static void flush_jobs(struct gl_lcms *p)
+{
+    for (int n = 0; n < p->num_queue; n++)
+        job_free(p->queue[n]);
+    p->num_queue = 0;
+    for (int n = 0; n < p->num_done; n++)
+        job_free(p->done[n]);
+    p->num_done = 0;
+    // p->running is discarded by the worker, as its generation is outdated
 }
 
 static void load_profile(struct gl_lcms *p)
@@ -135,6 +195,18 @@ static void load_profile(struct gl_lcms *p)
 static void gl_lcms_destructor(void *ptr)
 {
     struct gl_lcms *p = ptr;
+
+    if (p->thread_started) {
+        pthread_mutex_lock(&p->lock);
+        p->terminate = true;
+        pthread_cond_broadcast(&p->wakeup);
+        pthread_mutex_unlock(&p->lock);
+        pthread_join(p->thread, NULL);
+    }
+
+    flush_jobs(p);
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
     av_buffer_unref(&p->vid_profile);
 }
 
@@ -149,6 +221,8 @@ struct gl_lcms *gl_lcms_init(void *talloc_ctx, struct mp_log *log,
         .log = log,
         .opts = opts,
     };
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
     gl_lcms_update_options(p);
     return p;
 }
@@ -159,9 +233,19 @@ void gl_lcms_update_options(struct gl_lcms *p)
         !bstr_equals(bstr0(p->opts->profile), bstr0(p->current_profile)))
     {
         load_profile(p);
+        p->changed = true;
     }
 
-    p->changed = true; // probably
+    // This is called on any change of the renderer options, so check whether
+    // it makes the generated LUTs invalid.
+    struct mp_icc_opts *o = p->opts;
+    char *key = talloc_asprintf(p, "%d %d %d %s %s", o->use_embedded,
+                                o->intent, o->contrast, o->size_str,
+                                o->cache_dir ? o->cache_dir : "");
+    if (!p->opts_key || strcmp(key, p->opts_key) != 0)
+        p->changed = true;
+    talloc_free(p->opts_key);
+    p->opts_key = key;
 }
 
 // Warning: profile.start must point to a ta allocation, and the function
@@ -222,11 +306,11 @@ bool gl_lcms_has_profile(struct gl_lcms *p)
     return p->icc_size > 0;
 }
 
-static cmsHPROFILE get_vid_profile(struct gl_lcms *p, cmsContext cms,
+static cmsHPROFILE get_vid_profile(struct lut_job *p, cmsContext cms,
                                    cmsHPROFILE disp_profile,
                                    enum mp_csp_prim prim, enum mp_csp_trc trc)
 {
-    if (p->opts->use_embedded && p->vid_profile) {
+    if (p->use_embedded && p->vid_profile) {
         // Try using the embedded ICC profile
         cmsHPROFILE prof = cmsOpenProfileFromMemTHR(cms, p->vid_profile->data,
                                                     p->vid_profile->size);
@@ -297,9 +381,9 @@ static cmsHPROFILE get_vid_profile(struct gl_lcms *p, cmsContext cms,
         cmsDeleteTransform(xyz2src);
 
         // Contrast limiting
-        if (p->opts->contrast > 0) {
+        if (p->contrast > 0) {
             for (int i = 0; i < 3; i++)
-                src_black[i] = MPMAX(src_black[i], 1.0 / p->opts->contrast);
+                src_black[i] = MPMAX(src_black[i], 1.0 / p->contrast);
         }
 
         // Built-in contrast failsafe
@@ -341,33 +425,11 @@ static cmsHPROFILE get_vid_profile(struct gl_lcms *p, cmsContext cms,
     return vid_profile;
 }
 
-bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
-                       enum mp_csp_prim prim, enum mp_csp_trc trc,
-                       struct AVBufferRef *vid_profile)
+// Generate the LUT for the job (or load it from the disk cache). This runs on
+// the worker thread.
+static struct lut3d *build_lut3d(struct lut_job *p)
 {
-    int s_r, s_g, s_b;
-    bool result = false;
-
-    p->changed = false;
-    p->current_prim = prim;
-    p->current_trc = trc;
-
-    // We need to hold on to a reference to the video's ICC profile for as long
-    // as we still need to perform equality checking, so generate a new
-    // reference here
-    av_buffer_unref(&p->vid_profile);
-    if (vid_profile) {
-        MP_VERBOSE(p, "Got an embedded ICC profile.\n");
-        p->vid_profile = av_buffer_ref(vid_profile);
-        if (!p->vid_profile)
-            abort();
-    }
-
-    if (!parse_3dlut_size(p->opts->size_str, &s_r, &s_g, &s_b))
-        return false;
-
-    if (!gl_lcms_has_profile(p))
-        return false;
+    int s_r = p->size[0], s_g = p->size[1], s_b = p->size[2];
 
     void *tmp = talloc_new(NULL);
     uint16_t *output = talloc_array(tmp, uint16_t, s_r * s_g * s_b * 4);
@@ -375,14 +437,14 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
     cmsContext cms = NULL;
 
     char *cache_file = NULL;
-    if (p->opts->cache_dir && p->opts->cache_dir[0]) {
+    if (p->cache_dir) {
         // Gamma is included in the header to help uniquely identify it,
         // because we may change the parameter in the future or make it
         // customizable, same for the primaries.
         char *cache_info = talloc_asprintf(tmp,
                 "ver=1.4, intent=%d, size=%dx%dx%d, prim=%d, trc=%d, "
                 "contrast=%d\n",
-                p->opts->intent, s_r, s_g, s_b, prim, trc, p->opts->contrast);
+                p->intent, s_r, s_g, s_b, p->prim, p->trc, p->contrast);
 
         uint8_t hash[32];
         struct AVSHA *sha = av_sha_alloc();
@@ -390,13 +452,13 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
             abort();
         av_sha_init(sha, 256);
         av_sha_update(sha, cache_info, strlen(cache_info));
-        if (vid_profile)
-            av_sha_update(sha, vid_profile->data, vid_profile->size);
-        av_sha_update(sha, p->icc_data, p->icc_size);
+        if (p->vid_profile)
+            av_sha_update(sha, p->vid_profile->data, p->vid_profile->size);
+        av_sha_update(sha, p->icc.start, p->icc.len);
         av_sha_final(sha, hash);
         av_free(sha);
 
-        char *cache_dir = mp_get_user_path(tmp, p->global, p->opts->cache_dir);
+        char *cache_dir = mp_get_user_path(tmp, p->global, p->cache_dir);
         cache_file = talloc_strdup(tmp, "");
         for (int i = 0; i < sizeof(hash); i++)
             cache_file = talloc_asprintf_append(cache_file, "%02X", hash[i]);
@@ -424,11 +486,11 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
     cmsSetLogErrorHandlerTHR(cms, lcms2_error_handler);
 
     cmsHPROFILE profile =
-        cmsOpenProfileFromMemTHR(cms, p->icc_data, p->icc_size);
+        cmsOpenProfileFromMemTHR(cms, p->icc.start, p->icc.len);
     if (!profile)
         goto error_exit;
 
-    cmsHPROFILE vid_hprofile = get_vid_profile(p, cms, profile, prim, trc);
+    cmsHPROFILE vid_hprofile = get_vid_profile(p, cms, profile, p->prim, p->trc);
     if (!vid_hprofile) {
         cmsCloseProfile(profile);
         goto error_exit;
@@ -436,7 +498,7 @@ bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
 
     cmsHTRANSFORM trafo = cmsCreateTransformTHR(cms, vid_hprofile, TYPE_RGB_16,
                                                 profile, TYPE_RGBA_16,
-                                                p->opts->intent,
+                                                p->intent,
                                                 cmsFLAGS_HIGHRESPRECALC |
                                                 cmsFLAGS_BLACKPOINTCOMPENSATION);
     cmsCloseProfile(profile);
@@ -477,9 +539,6 @@ done: ;
         .size = {s_r, s_g, s_b},
     };
 
-    *result_lut3d = lut;
-    result = true;
-
 error_exit:
 
     if (cms)
@@ -489,6 +548,193 @@ error_exit:
         MP_FATAL(p, "Error loading ICC profile.\n");
 
     talloc_free(tmp);
+    return lut;
+}
+
+static void *lut_thread(void *ptr)
+{
+    struct gl_lcms *p = ptr;
+
+    mpthread_set_name("icc 3dlut");
+
+    pthread_mutex_lock(&p->lock);
+    while (1) {
+        while (!p->terminate && !p->num_queue)
+            pthread_cond_wait(&p->wakeup, &p->lock);
+        if (p->terminate)
+            break;
+        struct lut_job *job = p->queue[0];
+        MP_TARRAY_REMOVE_AT(p->queue, p->num_queue, 0);
+        p->running = job;
+        pthread_mutex_unlock(&p->lock);
+
+        job->lut = build_lut3d(job);
+        talloc_steal(job, job->lut);
+
+        pthread_mutex_lock(&p->lock);
+        p->running = NULL;
+        if (job->generation == p->generation) {
+            MP_TARRAY_APPEND(p, p->done, p->num_done, job);
+        } else {
+            job_free(job);
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return NULL;
+}
+
+static bool job_matches(struct gl_lcms *p, struct lut_job *job,
+                        enum mp_csp_prim prim, enum mp_csp_trc trc,
+                        struct AVBufferRef *vid_profile)
+{
+    return job && job->generation == p->generation && job->prim == prim &&
+           job->trc == trc && vid_profile_eq(job->vid_profile, vid_profile);
+}
+
+// Must be called with p->lock held. Returns false if no thread is available.
+static bool queue_job(struct gl_lcms *p, enum mp_csp_prim prim,
+                      enum mp_csp_trc trc, struct AVBufferRef *vid_profile,
+                      int size[3], bool urgent)
+{
+    if (!p->thread_started) {
+        if (pthread_create(&p->thread, NULL, lut_thread, p)) {
+            MP_ERR(p, "Could not create 3DLUT thread.\n");
+            return false;
+        }
+        p->thread_started = true;
+    }
+
+    if (job_matches(p, p->running, prim, trc, vid_profile))
+        return true;
+    for (int n = 0; n < p->num_queue; n++) {
+        if (job_matches(p, p->queue[n], prim, trc, vid_profile)) {
+            if (urgent) {
+                struct lut_job *job = p->queue[n];
+                MP_TARRAY_REMOVE_AT(p->queue, p->num_queue, n);
+                MP_TARRAY_INSERT_AT(p, p->queue, p->num_queue, 0, job);
+            }
+            return true;
+        }
+    }
+    for (int n = 0; n < p->num_done; n++) {
+        if (job_matches(p, p->done[n], prim, trc, vid_profile))
+            return true;
+    }
+
+    struct lut_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct lut_job) {
+        .log = p->log,
+        .global = p->global,
+        .generation = p->generation,
+        .prim = prim,
+        .trc = trc,
+        .icc = bstrdup(job, (struct bstr){p->icc_data, p->icc_size}),
+        .use_embedded = p->opts->use_embedded,
+        .intent = p->opts->intent,
+        .contrast = p->opts->contrast,
+        .size = {size[0], size[1], size[2]},
+    };
+    if (vid_profile) {
+        job->vid_profile = av_buffer_ref(vid_profile);
+        if (!job->vid_profile)
+            abort();
+    }
+    if (p->opts->cache_dir && p->opts->cache_dir[0])
+        job->cache_dir = talloc_strdup(job, p->opts->cache_dir);
+
+    if (urgent) {
+        MP_TARRAY_INSERT_AT(p, p->queue, p->num_queue, 0, job);
+    } else {
+        MP_TARRAY_APPEND(p, p->queue, p->num_queue, job);
+    }
+    pthread_cond_signal(&p->wakeup);
+    return true;
+}
+
+// Video color spaces for which LUTs are generated in the background, after
+// the first LUT is done. GAMMA22 is what HDR content is mapped to.
+static const struct {
+    enum mp_csp_prim prim;
+    enum mp_csp_trc trc;
+} prebuild_list[] = {
+    {MP_CSP_PRIM_BT_709,  MP_CSP_TRC_BT_1886},
+    {MP_CSP_PRIM_BT_2020, MP_CSP_TRC_GAMMA22},
+    {MP_CSP_PRIM_BT_2020, MP_CSP_TRC_BT_1886},
+    {MP_CSP_PRIM_BT_709,  MP_CSP_TRC_SRGB},
+};
+
+// Returns false on errors. On success, *result_lut3d is set to the LUT, which
+// is owned by gl_lcms and valid until the next call, or to NULL if the LUT is
+// still being generated. In that case, this should be called again later.
+bool gl_lcms_get_lut3d(struct gl_lcms *p, struct lut3d **result_lut3d,
+                       enum mp_csp_prim prim, enum mp_csp_trc trc,
+                       struct AVBufferRef *vid_profile)
+{
+    int size[3];
+    bool result = false;
+    *result_lut3d = NULL;
+
+    pthread_mutex_lock(&p->lock);
+
+    if (p->changed) {
+        p->generation++;
+        flush_jobs(p);
+        p->changed = false;
+    }
+
+    if (!parse_3dlut_size(p->opts->size_str, &size[0], &size[1], &size[2]))
+        goto done;
+
+    if (!gl_lcms_has_profile(p))
+        goto done;
+
+    // Trim the cache, but keep prebuilt LUTs which were not used yet
+    int keep = MPMAX(LUT_CACHE_SIZE, MP_ARRAY_SIZE(prebuild_list) + 1);
+    while (p->num_done > keep)
+        job_free(p->done[--p->num_done]);
+
+    struct lut_job *job = NULL;
+    for (int n = 0; n < p->num_done; n++) {
+        if (job_matches(p, p->done[n], prim, trc, vid_profile)) {
+            job = p->done[n];
+            MP_TARRAY_REMOVE_AT(p->done, p->num_done, n);
+            MP_TARRAY_INSERT_AT(p, p->done, p->num_done, 0, job);
+            break;
+        }
+    }
+
+    if (!job) {
+        result = queue_job(p, prim, trc, vid_profile, size, true);
+        if (result && p->prebuilt_generation != p->generation) {
+            p->prebuilt_generation = p->generation;
+            for (int n = 0; n < MP_ARRAY_SIZE(prebuild_list); n++) {
+                queue_job(p, prebuild_list[n].prim, prebuild_list[n].trc,
+                          NULL, size, false);
+            }
+        }
+        goto done;
+    }
+
+    p->current_prim = prim;
+    p->current_trc = trc;
+
+    // We need to hold on to a reference to the video's ICC profile for as long
+    // as we still need to perform equality checking, so generate a new
+    // reference here
+    av_buffer_unref(&p->vid_profile);
+    if (vid_profile) {
+        MP_VERBOSE(p, "Got an embedded ICC profile.\n");
+        p->vid_profile = av_buffer_ref(vid_profile);
+        if (!p->vid_profile)
+            abort();
+    }
+
+    *result_lut3d = job->lut;
+    result = !!job->lut;
+
+done:
+    pthread_mutex_unlock(&p->lock);
     return result;
 }
 
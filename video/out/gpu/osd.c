@@ -52,6 +52,7 @@ static const struct ra_renderpass_input vertex_vao[] = {
 struct mpgl_osd_part {
     enum sub_bitmap_format format;
     int change_id;
+    uint64_t packed_id; // sub_bitmaps.packed_id of the texture contents
     struct ra_tex *texture;
     int w, h;
     int num_subparts;
@@ -128,6 +129,10 @@ static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
 
     assert(imgs->packed);
 
+    bool incremental = osd->texture && imgs->packed_base &&
+                       imgs->packed_base == osd->packed_id;
+    osd->packed_id = 0;
+
     int req_w = next_pow2(imgs->packed_w);
     int req_h = next_pow2(imgs->packed_h);
 
@@ -138,6 +143,7 @@ static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
         osd->format != imgs->format)
     {
         ra_tex_free(ra, &osd->texture);
+        incremental = false;
 
         osd->format = imgs->format;
         osd->w = FFMAX(32, req_w);
@@ -167,15 +173,35 @@ static bool upload_osd(struct mpgl_osd *ctx, struct mpgl_osd_part *osd,
             goto done;
     }
 
-    struct ra_tex_upload_params params = {
-        .tex = osd->texture,
-        .src = imgs->packed->planes[0],
-        .invalidate = true,
-        .rc = &(struct mp_rect){0, 0, imgs->packed_w, imgs->packed_h},
-        .stride = imgs->packed->stride[0],
-    };
+    if (incremental) {
+        // Only the changed regions; the rest of the texture is still valid.
+        ok = true;
+        for (int n = 0; n < imgs->num_packed_dirty; n++) {
+            struct mp_rect *rc = &imgs->packed_dirty[n];
+            struct ra_tex_upload_params params = {
+                .tex = osd->texture,
+                .src = (uint8_t *)imgs->packed->planes[0] +
+                       rc->y0 * imgs->packed->stride[0] +
+                       rc->x0 * imgs->packed->fmt.bytes[0],
+                .rc = rc,
+                .stride = imgs->packed->stride[0],
+            };
+            ok &= ra->fns->tex_upload(ra, &params);
+        }
+    } else {
+        struct ra_tex_upload_params params = {
+            .tex = osd->texture,
+            .src = imgs->packed->planes[0],
+            .invalidate = true,
+            .rc = &(struct mp_rect){0, 0, imgs->packed_w, imgs->packed_h},
+            .stride = imgs->packed->stride[0],
+        };
+
+        ok = ra->fns->tex_upload(ra, &params);
+    }
 
-    ok = ra->fns->tex_upload(ra, &params);
+    if (ok)
+        osd->packed_id = imgs->packed_id;
 
 done:
     return ok;
@@ -192,7 +218,10 @@ static void gen_osd_cb(void *pctx, struct sub_bitmaps *imgs)
 
     bool ok = true;
     if (imgs->change_id != osd->change_id) {
-        if (!upload_osd(ctx, osd, imgs))
+        // If only the positions changed, the texture is still up to date.
+        bool same = imgs->packed_id && imgs->packed_id == osd->packed_id &&
+                    osd->format == imgs->format && osd->texture;
+        if (!same && !upload_osd(ctx, osd, imgs))
             ok = false;
 
         osd->change_id = imgs->change_id;
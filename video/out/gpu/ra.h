@@ -14,6 +14,11 @@ struct ra {
 
     struct mp_log *log;
 
+    // Identifies the GPU and driver version, so that data cached on disk can
+    // be invalidated if it changes. Set by the RA backend at init time (can
+    // be NULL).
+    const char *driver_id;
+
     // RA_CAP_* bit field. The RA backend must set supported features at init
     // time.
     uint64_t caps;
@@ -26,6 +31,10 @@ struct ra {
     // time.
     size_t max_shmem;
 
+    // Maximum number of threads in a compute shader work group. Set by the RA
+    // backend at init time.
+    int max_compute_group_threads;
+
     // Maximum push constant size. Set by the RA backend at init time.
     size_t max_pushc_size;
 
@@ -53,6 +62,9 @@ enum {
     RA_CAP_GLOBAL_UNIFORM = 1 << 8, // supports using "naked" uniforms (not UBO)
     RA_CAP_GATHER         = 1 << 9, // supports textureGather in GLSL
     RA_CAP_FRAGCOORD      = 1 << 10, // supports reading from gl_FragCoord
+    RA_CAP_PARALLEL_COMPILE = 1 << 11, // renderpass_create can be called from
+                                       // another thread, concurrently to
+                                       // other calls
 };
 
 enum ra_ctype {
@@ -106,6 +118,7 @@ struct ra_tex_params {
     bool blit_src;          // must be usable as a blit source
     bool blit_dst;          // must be usable as a blit destination
     bool host_mutable;      // texture may be updated with tex_upload
+    bool downloadable;      // texture may be read back with tex_download
     // When used as render source texture.
     bool src_linear;        // if false, use nearest sampling (whether this can
                             // be true depends on ra_format.linear_filter)
@@ -152,6 +165,7 @@ struct ra_tex_upload_params {
 enum ra_buf_type {
     RA_BUF_TYPE_INVALID,
     RA_BUF_TYPE_TEX_UPLOAD,     // texture upload buffer (pixel buffer object)
+    RA_BUF_TYPE_TEX_DOWNLOAD,   // texture download buffer (for tex_download)
     RA_BUF_TYPE_SHADER_STORAGE, // shader buffer (SSBO), for RA_VARTYPE_BUF_RW
     RA_BUF_TYPE_UNIFORM,        // uniform buffer (UBO), for RA_VARTYPE_BUF_RO
     RA_BUF_TYPE_VERTEX,         // not publicly usable (RA-internal usage)
@@ -350,6 +364,9 @@ struct ra_renderpass_run_params {
 // least give it a saner name than void* for code readability purposes.
 typedef void ra_timer;
 
+struct voctrl_gpu_memory_stats;
+struct voctrl_upload_stats;
+
 // Rendering API entrypoints. (Note: there are some additional hidden features
 // you need to take care of. For example, hwdec mapping will be provided
 // separately from ra, but might need to call into ra private code.)
@@ -372,6 +389,16 @@ struct ra_fns {
     // Returns whether successful.
     bool (*tex_upload)(struct ra *ra, const struct ra_tex_upload_params *params);
 
+    // Read back the contents of a 2D texture (which must have downloadable
+    // set) into a host mapped RA_BUF_TYPE_TEX_DOWNLOAD buffer. This is
+    // asynchronous: the copy happens after all previously issued rendering
+    // commands, and the buffer is "in use" until buf_poll returns true, after
+    // which buf->data contains the image. The rows are tightly packed, start
+    // at y=0 in texture coordinates, and use the texture's format. Textures
+    // with an opaque format (pixel_size 0, e.g. wrapped GL framebuffers) are
+    // read as 8 bit RGBA. Returns whether successful. Optional.
+    bool (*tex_download)(struct ra *ra, struct ra_tex *tex, struct ra_buf *buf);
+
     // Create a buffer. This can be used as a persistently mapped buffer,
     // a uniform buffer, a shader storage buffer or possibly others.
     // Not all usage types must be supported; may return NULL if unavailable.
@@ -459,6 +486,12 @@ struct ra_fns {
     // Associates a marker with any past error messages, for debugging
     // purposes. Optional.
     void (*debug_marker)(struct ra *ra, const char *msg);
+
+    // Report GPU memory usage of this ra. Optional.
+    void (*memory_stats)(struct ra *ra, struct voctrl_gpu_memory_stats *out);
+
+    // Report texture upload statistics of this ra. Optional.
+    void (*upload_stats)(struct ra *ra, struct voctrl_upload_stats *out);
 };
 
 struct ra_tex *ra_tex_create(struct ra *ra, const struct ra_tex_params *params);
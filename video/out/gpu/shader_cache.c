@@ -4,11 +4,16 @@
 #include <string.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include <libavutil/sha.h>
 #include <libavutil/mem.h>
 
 #include "osdep/io.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
 
 #include "common/common.h"
 #include "options/path.h"
@@ -19,6 +24,22 @@
 // Force cache flush if more than this number of shaders is created.
 #define SC_MAX_ENTRIES 48
 
+#define SC_CACHE_HEADER "mpv shader cache v1\n"
+
+// Name and first line of the disk cache index file. The second line is the
+// ra.driver_id the cache was created with, followed by one line per cache
+// file: "<hash> <size> <last use time>".
+#define SC_INDEX_FILE "index"
+#define SC_INDEX_HEADER "mpv shader cache index v1"
+
+#define SC_HASH_LEN (256 / 8 * 2)
+
+struct sc_disk_entry {
+    char hash[SC_HASH_LEN + 1];
+    int64_t size;
+    int64_t last_used;      // time() of the last load or store
+};
+
 union uniform_val {
     float f[9];         // RA_VARTYPE_FLOAT
     int i[4];           // RA_VARTYPE_INT
@@ -57,7 +78,16 @@ struct sc_entry {
     struct timer_pool *timer;
     struct ra_buf *ubo;
     int ubo_index; // for ra_renderpass_input_val.index
+    void *ubodata; // CPU copy of the UBO contents
+    size_t ubo_dirty_start, ubo_dirty_end; // range to upload on next use
     void *pushc;
+    // For compiling on the worker thread. While pending is set, pass is NULL,
+    // and the fields below are accessed with gl_shader_cache.lock held.
+    bool pending;
+    bool done;                          // result is set
+    struct ra_renderpass_params *job;   // what to compile
+    char *job_cache_dir, *job_cache_filename;
+    struct ra_renderpass *result;
 };
 
 struct gl_shader_cache {
@@ -105,7 +135,27 @@ struct gl_shader_cache {
 
     // For the disk-cache.
     char *cache_dir;
+    int64_t cache_size;     // limit in bytes, 0 means unlimited
     struct mpv_global *global; // can be NULL
+
+    // Index of the disk cache. Protected by lock, like stats.
+    char *index_dir;        // resolved directory the index belongs to
+    bool index_dirty;
+    struct sc_disk_entry *disk_entries;
+    int num_disk_entries;
+    struct voctrl_shader_cache_stats stats;
+
+    // Asynchronous compilation (gl_sc_set_async()).
+    bool async;
+    bool skipped;               // a pass was skipped since the last check
+    bool thread_started;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    struct sc_entry **queue;    // entries waiting for the worker thread
+    int num_queue;
+    struct sc_entry *compiling; // entry the worker thread is working on
+    bool terminate;
 };
 
 struct gl_shader_cache *gl_sc_create(struct ra *ra, struct mpv_global *global,
@@ -117,10 +167,159 @@ struct gl_shader_cache *gl_sc_create(struct ra *ra, struct mpv_global *global,
         .global = global,
         .log = log,
     };
+    pthread_mutex_init(&sc->lock, NULL);
+    pthread_cond_init(&sc->wakeup, NULL);
     gl_sc_reset(sc);
     return sc;
 }
 
+// All index_* functions must be called with sc->lock held.
+
+static int index_find(struct gl_shader_cache *sc, const char *hash)
+{
+    for (int n = 0; n < sc->num_disk_entries; n++) {
+        if (strcmp(sc->disk_entries[n].hash, hash) == 0)
+            return n;
+    }
+    return -1;
+}
+
+static void index_remove(struct gl_shader_cache *sc, int n)
+{
+    char *filename = mp_path_join(NULL, sc->index_dir, sc->disk_entries[n].hash);
+    unlink(filename);
+    talloc_free(filename);
+    sc->stats.disk_size -= sc->disk_entries[n].size;
+    sc->stats.disk_entries -= 1;
+    MP_TARRAY_REMOVE_AT(sc->disk_entries, sc->num_disk_entries, n);
+    sc->index_dirty = true;
+}
+
+static void index_save(struct gl_shader_cache *sc)
+{
+    if (!sc->index_dir || !sc->index_dirty)
+        return;
+
+    mp_mkdirp(sc->index_dir);
+
+    char *filename = mp_path_join(NULL, sc->index_dir, SC_INDEX_FILE);
+    FILE *out = fopen(filename, "wb");
+    if (out) {
+        fprintf(out, "%s\n%s\n", SC_INDEX_HEADER,
+                sc->ra->driver_id ? sc->ra->driver_id : "");
+        for (int n = 0; n < sc->num_disk_entries; n++) {
+            struct sc_disk_entry *e = &sc->disk_entries[n];
+            fprintf(out, "%s %"PRId64" %"PRId64"\n", e->hash, e->size,
+                    e->last_used);
+        }
+        fclose(out);
+        sc->index_dirty = false;
+    } else {
+        MP_WARN(sc, "Could not write shader cache index %s\n", filename);
+    }
+    talloc_free(filename);
+}
+
+static void index_close(struct gl_shader_cache *sc)
+{
+    index_save(sc);
+    TA_FREEP(&sc->index_dir);
+    TA_FREEP(&sc->disk_entries);
+    sc->num_disk_entries = 0;
+    sc->stats.disk_size = 0;
+    sc->stats.disk_entries = 0;
+}
+
+// Evict least recently used entries until the cache fits into the limit.
+// The entry with the given hash is kept (can be NULL).
+static void index_evict(struct gl_shader_cache *sc, const char *keep)
+{
+    while (sc->cache_size > 0 && sc->stats.disk_size > sc->cache_size) {
+        int oldest = -1;
+        for (int n = 0; n < sc->num_disk_entries; n++) {
+            struct sc_disk_entry *e = &sc->disk_entries[n];
+            if (keep && strcmp(e->hash, keep) == 0)
+                continue;
+            if (oldest < 0 || e->last_used < sc->disk_entries[oldest].last_used)
+                oldest = n;
+        }
+        if (oldest < 0)
+            break;
+        MP_VERBOSE(sc, "Evicting shader cache file %s\n",
+                   sc->disk_entries[oldest].hash);
+        index_remove(sc, oldest);
+    }
+}
+
+// Add or update the entry, and mark it as most recently used.
+static void index_touch(struct gl_shader_cache *sc, const char *hash,
+                        int64_t size)
+{
+    int n = index_find(sc, hash);
+    if (n < 0) {
+        struct sc_disk_entry e = {.size = 0};
+        snprintf(e.hash, sizeof(e.hash), "%s", hash);
+        MP_TARRAY_APPEND(sc, sc->disk_entries, sc->num_disk_entries, e);
+        n = sc->num_disk_entries - 1;
+        sc->stats.disk_entries += 1;
+    }
+    struct sc_disk_entry *e = &sc->disk_entries[n];
+    sc->stats.disk_size += size - e->size;
+    e->size = size;
+    e->last_used = time(NULL);
+    sc->index_dirty = true;
+}
+
+// Make sure the index of the given (resolved) cache directory is loaded. If
+// the cache was created with a different GPU or driver, it's wiped.
+static void index_open(struct gl_shader_cache *sc, const char *dir)
+{
+    if (sc->index_dir && strcmp(sc->index_dir, dir) == 0)
+        return;
+
+    index_close(sc);
+    sc->index_dir = talloc_strdup(NULL, dir);
+
+    void *tmp = talloc_new(NULL);
+    char *filename = mp_path_join(tmp, dir, SC_INDEX_FILE);
+    bstr data = {0};
+    if (mp_path_exists(filename))
+        data = stream_read_file(filename, tmp, sc->global, 100000000);
+
+    const char *driver_id = sc->ra->driver_id ? sc->ra->driver_id : "";
+    bstr header = bstr_getline(data, &data);
+    bstr id = bstr_strip_linebreaks(bstr_getline(data, &data));
+    bool valid = bstr_equals0(bstr_strip_linebreaks(header), SC_INDEX_HEADER);
+    bool same_driver = valid && bstr_equals0(id, driver_id);
+
+    while (valid && data.len) {
+        bstr line = bstr_strip(bstr_getline(data, &data));
+        bstr hash, rest;
+        if (!bstr_split_tok(line, " ", &hash, &rest) || hash.len != SC_HASH_LEN)
+            continue;
+        struct sc_disk_entry e = {0};
+        snprintf(e.hash, sizeof(e.hash), "%.*s", BSTR_P(hash));
+        bstr size = bstr_split(rest, " ", &rest);
+        e.size = bstrtoll(size, NULL, 10);
+        e.last_used = bstrtoll(bstr_strip(rest), NULL, 10);
+        MP_TARRAY_APPEND(sc, sc->disk_entries, sc->num_disk_entries, e);
+        sc->stats.disk_size += e.size;
+        sc->stats.disk_entries += 1;
+    }
+
+    if (valid && !same_driver) {
+        MP_VERBOSE(sc, "GPU or driver changed, invalidating shader cache.\n");
+        while (sc->num_disk_entries)
+            index_remove(sc, sc->num_disk_entries - 1);
+    }
+    if (!same_driver)
+        sc->index_dirty = true;
+
+    index_evict(sc, NULL);
+
+    talloc_free(tmp);
+}
+
 // Reset the previous pass. This must be called after gl_sc_generate and before
 // starting a new shader. It may also be called on errors.
 void gl_sc_reset(struct gl_shader_cache *sc)
@@ -146,11 +345,20 @@ static void sc_flush_cache(struct gl_shader_cache *sc)
 {
     MP_VERBOSE(sc, "flushing shader cache\n");
 
+    // Drop queued work, and wait for the entry currently being compiled.
+    pthread_mutex_lock(&sc->lock);
+    sc->num_queue = 0;
+    while (sc->compiling)
+        pthread_cond_wait(&sc->wakeup, &sc->lock);
+    pthread_mutex_unlock(&sc->lock);
+
     for (int n = 0; n < sc->num_entries; n++) {
         struct sc_entry *e = sc->entries[n];
         ra_buf_free(sc->ra, &e->ubo);
         if (e->pass)
             sc->ra->fns->renderpass_destroy(sc->ra, e->pass);
+        if (e->result)
+            sc->ra->fns->renderpass_destroy(sc->ra, e->result);
         timer_pool_destroy(e->timer);
         talloc_free(e);
     }
@@ -163,6 +371,18 @@ void gl_sc_destroy(struct gl_shader_cache *sc)
         return;
     gl_sc_reset(sc);
     sc_flush_cache(sc);
+    if (sc->thread_started) {
+        pthread_mutex_lock(&sc->lock);
+        sc->terminate = true;
+        pthread_cond_broadcast(&sc->wakeup);
+        pthread_mutex_unlock(&sc->lock);
+        pthread_join(sc->thread, NULL);
+    }
+    pthread_mutex_lock(&sc->lock);
+    index_close(sc);
+    pthread_mutex_unlock(&sc->lock);
+    pthread_cond_destroy(&sc->wakeup);
+    pthread_mutex_destroy(&sc->lock);
     talloc_free(sc);
 }
 
@@ -176,6 +396,22 @@ void gl_sc_reset_error(struct gl_shader_cache *sc)
     sc->error_state = false;
 }
 
+// If enabled, new shaders are compiled on a worker thread (if the RA supports
+// it), and passes using them are skipped until they're ready. Shaders already
+// queued while this was enabled are waited for once it's disabled.
+void gl_sc_set_async(struct gl_shader_cache *sc, bool enable)
+{
+    sc->async = enable;
+}
+
+// Return whether passes were skipped since the last call.
+bool gl_sc_check_skipped(struct gl_shader_cache *sc)
+{
+    bool r = sc->skipped;
+    sc->skipped = false;
+    return r;
+}
+
 void gl_sc_enable_extension(struct gl_shader_cache *sc, char *name)
 {
     for (int n = 0; n < sc->num_exts; n++) {
@@ -470,7 +706,9 @@ static const char *vao_glsl_type(const struct ra_renderpass_input *e)
     }
 }
 
-static void update_ubo(struct ra *ra, struct ra_buf *ubo, struct sc_uniform *u)
+// Only writes the CPU copy. All changed uniforms of a pass are uploaded with
+// a single buf_update() call in flush_ubo().
+static void update_ubo(struct sc_entry *e, struct sc_uniform *u)
 {
     uintptr_t src = (uintptr_t) &u->v;
     size_t dst = u->offset;
@@ -478,10 +716,30 @@ static void update_ubo(struct ra *ra, struct ra_buf *ubo, struct sc_uniform *u)
     struct ra_layout dst_layout = u->layout;
 
     for (int i = 0; i < u->input.dim_m; i++) {
-        ra->fns->buf_update(ra, ubo, dst, (void *)src, src_layout.stride);
+        memcpy((char *)e->ubodata + dst, (void *)src, src_layout.stride);
         src += src_layout.stride;
         dst += dst_layout.stride;
     }
+
+    size_t end = u->offset + u->layout.size;
+    if (e->ubo_dirty_start >= e->ubo_dirty_end) {
+        e->ubo_dirty_start = u->offset;
+        e->ubo_dirty_end = end;
+    } else {
+        e->ubo_dirty_start = MPMIN(e->ubo_dirty_start, u->offset);
+        e->ubo_dirty_end = MPMAX(e->ubo_dirty_end, end);
+    }
+}
+
+static void flush_ubo(struct ra *ra, struct sc_entry *e)
+{
+    if (e->ubo_dirty_start >= e->ubo_dirty_end)
+        return;
+
+    size_t size = e->ubo_dirty_end - e->ubo_dirty_start;
+    ra->fns->buf_update(ra, e->ubo, e->ubo_dirty_start,
+                        (char *)e->ubodata + e->ubo_dirty_start, size);
+    e->ubo_dirty_start = e->ubo_dirty_end = 0;
 }
 
 static void update_pushc(struct ra *ra, void *pushc, struct sc_uniform *u)
@@ -527,7 +785,7 @@ static void update_uniform(struct gl_shader_cache *sc, struct sc_entry *e,
     }
     case SC_UNIFORM_TYPE_UBO:
         assert(e->ubo);
-        update_ubo(sc->ra, e->ubo, u);
+        update_ubo(e, u);
         break;
     case SC_UNIFORM_TYPE_PUSHC:
         assert(e->pushc);
@@ -543,6 +801,159 @@ void gl_sc_set_cache_dir(struct gl_shader_cache *sc, const char *dir)
     sc->cache_dir = talloc_strdup(sc, dir);
 }
 
+// Limit the size of the disk cache (in bytes). Least recently used files are
+// removed if it's exceeded. 0 disables the limit.
+void gl_sc_set_cache_size(struct gl_shader_cache *sc, int64_t size)
+{
+    pthread_mutex_lock(&sc->lock);
+    sc->cache_size = size;
+    if (sc->index_dir)
+        index_evict(sc, NULL);
+    pthread_mutex_unlock(&sc->lock);
+}
+
+void gl_sc_get_stats(struct gl_shader_cache *sc,
+                     struct voctrl_shader_cache_stats *out)
+{
+    pthread_mutex_lock(&sc->lock);
+    *out = sc->stats;
+    pthread_mutex_unlock(&sc->lock);
+}
+
+static struct ra_renderpass *compile_pass(struct gl_shader_cache *sc,
+                                          const struct ra_renderpass_params *params)
+{
+    int64_t start = mp_time_us();
+    struct ra_renderpass *pass = sc->ra->fns->renderpass_create(sc->ra, params);
+    int64_t duration = mp_time_us() - start;
+
+    pthread_mutex_lock(&sc->lock);
+    sc->stats.compiles += 1;
+    sc->stats.compile_time += duration;
+    pthread_mutex_unlock(&sc->lock);
+    return pass;
+}
+
+// Write the compiled program of pass to the disk cache, if it changed, and
+// update the index and hit/miss counters.
+static void save_cached_program(struct gl_shader_cache *sc,
+                                struct ra_renderpass *pass, bstr old_program,
+                                const char *cache_dir,
+                                const char *cache_filename)
+{
+    const char *hash = mp_basename(cache_filename);
+    bstr nc = pass->params.cached_program;
+    bool hit = old_program.len && bstr_equals(old_program, nc);
+    bool written = false;
+
+    if (nc.len && !hit) {
+        mp_mkdirp(cache_dir);
+
+        MP_VERBOSE(sc, "Writing shader cache file: %s\n", cache_filename);
+        FILE *out = fopen(cache_filename, "wb");
+        if (out) {
+            fwrite(SC_CACHE_HEADER, strlen(SC_CACHE_HEADER), 1, out);
+            fwrite(nc.start, nc.len, 1, out);
+            written = fclose(out) == 0;
+        }
+    }
+
+    pthread_mutex_lock(&sc->lock);
+    if (hit) {
+        sc->stats.hits += 1;
+    } else {
+        sc->stats.misses += 1;
+    }
+    if (sc->index_dir && strcmp(sc->index_dir, cache_dir) == 0) {
+        if (hit || written) {
+            index_touch(sc, hash, strlen(SC_CACHE_HEADER) + nc.len);
+            index_evict(sc, hash);
+        }
+        if (written)
+            index_save(sc);
+    }
+    pthread_mutex_unlock(&sc->lock);
+}
+
+static void *compile_thread(void *ptr)
+{
+    struct gl_shader_cache *sc = ptr;
+
+    mpthread_set_name("shader compile");
+
+    pthread_mutex_lock(&sc->lock);
+    while (1) {
+        while (!sc->terminate && !sc->num_queue)
+            pthread_cond_wait(&sc->wakeup, &sc->lock);
+        if (sc->terminate)
+            break;
+        struct sc_entry *e = sc->queue[0];
+        MP_TARRAY_REMOVE_AT(sc->queue, sc->num_queue, 0);
+        sc->compiling = e;
+        pthread_mutex_unlock(&sc->lock);
+
+        struct ra_renderpass *pass = compile_pass(sc, e->job);
+        if (pass && e->job_cache_filename) {
+            save_cached_program(sc, pass, e->job->cached_program,
+                                e->job_cache_dir, e->job_cache_filename);
+        }
+
+        pthread_mutex_lock(&sc->lock);
+        e->result = pass;
+        e->done = true;
+        sc->compiling = NULL;
+        pthread_cond_broadcast(&sc->wakeup);
+    }
+    pthread_mutex_unlock(&sc->lock);
+    return NULL;
+}
+
+// Let the worker thread compile the entry. Returns false on failure.
+static bool queue_pass(struct gl_shader_cache *sc, struct sc_entry *entry,
+                       struct ra_renderpass_params *params,
+                       const char *cache_dir, const char *cache_filename)
+{
+    if (!sc->thread_started) {
+        if (pthread_create(&sc->thread, NULL, compile_thread, sc)) {
+            MP_WARN(sc, "Could not create shader compilation thread.\n");
+            sc->async = false;
+            return false;
+        }
+        sc->thread_started = true;
+    }
+
+    entry->job = ra_renderpass_params_copy(entry, params);
+    entry->job_cache_dir = talloc_strdup(entry, cache_dir);
+    entry->job_cache_filename = talloc_strdup(entry, cache_filename);
+    entry->pending = true;
+
+    pthread_mutex_lock(&sc->lock);
+    MP_TARRAY_APPEND(sc, sc->queue, sc->num_queue, entry);
+    pthread_cond_broadcast(&sc->wakeup);
+    pthread_mutex_unlock(&sc->lock);
+    return true;
+}
+
+// Pick up the result of an entry compiled on the worker thread. If wait is
+// set, block until it's done. Returns whether the entry is not pending anymore.
+static bool finish_pending(struct gl_shader_cache *sc, struct sc_entry *entry,
+                           bool wait)
+{
+    pthread_mutex_lock(&sc->lock);
+    while (wait && !entry->done)
+        pthread_cond_wait(&sc->wakeup, &sc->lock);
+    bool done = entry->done;
+    if (done) {
+        entry->pass = entry->result;
+        entry->result = NULL;
+        entry->pending = false;
+    }
+    pthread_mutex_unlock(&sc->lock);
+    if (done && !entry->pass)
+        sc->error_state = true;
+    return done;
+}
+
 static bool create_pass(struct gl_shader_cache *sc, struct sc_entry *entry)
 {
     bool ret = false;
@@ -559,7 +970,6 @@ static bool create_pass(struct gl_shader_cache *sc, struct sc_entry *entry)
     if (sc->text.len)
         mp_log_source(sc->log, MSGL_V, sc->text.start);
 
-    const char *cache_header = "mpv shader cache v1\n";
     char *cache_filename = NULL;
     char *cache_dir = NULL;
 
@@ -567,6 +977,10 @@ static bool create_pass(struct gl_shader_cache *sc, struct sc_entry *entry)
         // Try to load it from a disk cache.
         cache_dir = mp_get_user_path(tmp, sc->global, sc->cache_dir);
 
+        pthread_mutex_lock(&sc->lock);
+        index_open(sc, cache_dir);
+        pthread_mutex_unlock(&sc->lock);
+
         struct AVSHA *sha = av_sha_alloc();
         if (!sha)
             abort();
@@ -577,7 +991,7 @@ static bool create_pass(struct gl_shader_cache *sc, struct sc_entry *entry)
         av_sha_final(sha, hash);
         av_free(sha);
 
-        char hashstr[256 / 8 * 2 + 1];
+        char hashstr[SC_HASH_LEN + 1];
         for (int n = 0; n < 256 / 8; n++)
             snprintf(hashstr + n * 2, sizeof(hashstr) - n * 2, "%02X", hash[n]);
 
@@ -586,7 +1000,7 @@ static bool create_pass(struct gl_shader_cache *sc, struct sc_entry *entry)
             MP_VERBOSE(sc, "Trying to load shader from disk...\n");
             struct bstr cachedata =
                 stream_read_file(cache_filename, tmp, sc->global, 1000000000);
-            if (bstr_eatstart0(&cachedata, cache_header))
+            if (bstr_eatstart0(&cachedata, SC_CACHE_HEADER))
                 params.cached_program = cachedata;
         }
     }
@@ -622,24 +1036,19 @@ static bool create_pass(struct gl_shader_cache *sc, struct sc_entry *entry)
             MP_ERR(sc, "Failed creating uniform buffer!\n");
             goto error;
         }
+        entry->ubodata = talloc_zero_size(entry, sc->ubo_size);
     }
 
-    entry->pass = sc->ra->fns->renderpass_create(sc->ra, &params);
-    if (!entry->pass)
-        goto error;
+    if (!(sc->async && (sc->ra->caps & RA_CAP_PARALLEL_COMPILE) &&
+          queue_pass(sc, entry, &params, cache_dir, cache_filename)))
+    {
+        entry->pass = compile_pass(sc, &params);
+        if (!entry->pass)
+            goto error;
 
-    if (entry->pass && cache_filename) {
-        bstr nc = entry->pass->params.cached_program;
-        if (nc.len && !bstr_equals(params.cached_program, nc)) {
-            mp_mkdirp(cache_dir);
-
-            MP_VERBOSE(sc, "Writing shader cache file: %s\n", cache_filename);
-            FILE *out = fopen(cache_filename, "wb");
-            if (out) {
-                fwrite(cache_header, strlen(cache_header), 1, out);
-                fwrite(nc.start, nc.len, 1, out);
-                fclose(out);
-            }
+        if (cache_filename) {
+            save_cached_program(sc, entry->pass, params.cached_program,
+                                cache_dir, cache_filename);
         }
     }
 
@@ -950,6 +1359,13 @@ static void gl_sc_generate(struct gl_shader_cache *sc,
         MP_TARRAY_APPEND(sc, sc->entries, sc->num_entries, entry);
     }
 
+    if (entry->pending && !finish_pending(sc, entry, !sc->async)) {
+        // Not compiled yet. The caller has to live without this pass.
+        sc->skipped = true;
+        sc->current_shader = NULL;
+        return;
+    }
+
     if (!entry->pass) {
         sc->current_shader = NULL;
         return;
@@ -963,6 +1379,7 @@ static void gl_sc_generate(struct gl_shader_cache *sc,
 
     // If we're using a UBO, make sure to bind it as well
     if (sc->ubo_size) {
+        flush_ubo(sc->ra, entry);
         struct ra_renderpass_input_val ubo_val = {
             .index = entry->ubo_index,
             .data = &entry->ubo,
@@ -60,3 +60,8 @@ struct mp_pass_perf gl_sc_dispatch_compute(struct gl_shader_cache *sc,
 // is normally done implicitly by gl_sc_dispatch_*
 void gl_sc_reset(struct gl_shader_cache *sc);
 void gl_sc_set_cache_dir(struct gl_shader_cache *sc, const char *dir);
+void gl_sc_set_cache_size(struct gl_shader_cache *sc, int64_t size);
+void gl_sc_get_stats(struct gl_shader_cache *sc,
+                     struct voctrl_shader_cache_stats *out);
+void gl_sc_set_async(struct gl_shader_cache *sc, bool enable);
+bool gl_sc_check_skipped(struct gl_shader_cache *sc);
@@ -16,11 +16,70 @@
  */
 
 #include <assert.h>
+#include <math.h>
+#include <string.h>
 
 #include "common/msg.h"
 #include "misc/ctype.h"
 #include "user_shaders.h"
 
+static float szexp_op1(enum szexp_op op, float val)
+{
+    switch (op) {
+    case SZEXP_OP_NOT: return !val;
+    default: abort();
+    }
+}
+
+static float szexp_op2(enum szexp_op op, float op1, float op2)
+{
+    switch (op) {
+    case SZEXP_OP_ADD: return op1 + op2;
+    case SZEXP_OP_SUB: return op1 - op2;
+    case SZEXP_OP_MUL: return op1 * op2;
+    case SZEXP_OP_DIV: return op1 / op2;
+    case SZEXP_OP_GT:  return op1 > op2;
+    case SZEXP_OP_LT:  return op1 < op2;
+    default: abort();
+    }
+}
+
+// Fold constant subexpressions, e.g. "HOOKED.w 2 3 * *" -> "HOOKED.w 6 *".
+// In RPN, an operator whose operands are all directly preceding constants can
+// be replaced by the constant result. Invalid operations are left alone, so
+// that the evaluation reports them.
+static void fold_rpn_szexpr(struct szexp expr[MAX_SZEXP_SIZE])
+{
+    struct szexp out[MAX_SZEXP_SIZE];
+    int pos = 0;
+
+    for (int i = 0; i < MAX_SZEXP_SIZE && expr[i].tag != SZEXP_END; i++) {
+        out[pos++] = expr[i];
+
+        if (expr[i].tag == SZEXP_OP1 && pos >= 2 &&
+            out[pos - 2].tag == SZEXP_CONST)
+        {
+            out[pos - 2].val.cval = szexp_op1(expr[i].val.op,
+                                              out[pos - 2].val.cval);
+            pos -= 1;
+        }
+
+        if (expr[i].tag == SZEXP_OP2 && pos >= 3 &&
+            out[pos - 2].tag == SZEXP_CONST && out[pos - 3].tag == SZEXP_CONST)
+        {
+            float res = szexp_op2(expr[i].val.op, out[pos - 3].val.cval,
+                                  out[pos - 2].val.cval);
+            if (isfinite(res)) {
+                out[pos - 3].val.cval = res;
+                pos -= 2;
+            }
+        }
+    }
+
+    for (int i = 0; i < MAX_SZEXP_SIZE; i++)
+        expr[i] = i < pos ? out[i] : (struct szexp){ .tag = SZEXP_END };
+}
+
 static bool parse_rpn_szexpr(struct bstr line, struct szexp out[MAX_SZEXP_SIZE])
 {
     int pos = 0;
@@ -68,16 +127,51 @@ static bool parse_rpn_szexpr(struct bstr line, struct szexp out[MAX_SZEXP_SIZE])
         return false;
     }
 
+    fold_rpn_szexpr(out);
     return true;
 }
 
 // Returns whether successful. 'result' is left untouched on failure
 bool eval_szexpr(struct mp_log *log, void *priv,
                  bool (*lookup)(void *priv, struct bstr var, float size[2]),
-                 struct szexp expr[MAX_SZEXP_SIZE], float *result)
+                 struct szexp expr[MAX_SZEXP_SIZE], struct szexp_cache *cache,
+                 float *result)
 {
+    // Fast path for constant expressions (very common after folding)
+    if (expr[0].tag == SZEXP_CONST && expr[1].tag == SZEXP_END) {
+        *result = expr[0].val.cval;
+        return true;
+    }
+
+    // Resolve all variables first, so the result can be reused if none of
+    // them changed
+    float vars[MAX_SZEXP_SIZE];
+    int num_vars = 0;
+    for (int i = 0; i < MAX_SZEXP_SIZE && expr[i].tag != SZEXP_END; i++) {
+        if (expr[i].tag != SZEXP_VAR_W && expr[i].tag != SZEXP_VAR_H)
+            continue;
+
+        struct bstr name = expr[i].val.varname;
+        float size[2];
+        if (!lookup(priv, name, size)) {
+            mp_warn(log, "Variable %.*s not found in RPN expression!\n",
+                    BSTR_P(name));
+            return false;
+        }
+
+        vars[num_vars++] = (expr[i].tag == SZEXP_VAR_W) ? size[0] : size[1];
+    }
+
+    if (cache && cache->valid && cache->num_vars == num_vars &&
+        memcmp(cache->vars, vars, num_vars * sizeof(vars[0])) == 0)
+    {
+        *result = cache->result;
+        return true;
+    }
+
     float stack[MAX_SZEXP_SIZE] = {0};
     int idx = 0; // points to next element to push
+    int var = 0; // next element of vars[] to use
 
     for (int i = 0; i < MAX_SZEXP_SIZE; i++) {
         switch (expr[i].tag) {
@@ -97,10 +191,7 @@ bool eval_szexpr(struct mp_log *log, void *priv,
                 return false;
             }
 
-            switch (expr[i].val.op) {
-            case SZEXP_OP_NOT: stack[idx-1] = !stack[idx-1]; break;
-            default: abort();
-            }
+            stack[idx-1] = szexp_op1(expr[i].val.op, stack[idx-1]);
             continue;
 
         case SZEXP_OP2:
@@ -112,16 +203,7 @@ bool eval_szexpr(struct mp_log *log, void *priv,
             // Pop the operands in reverse order
             float op2 = stack[--idx];
             float op1 = stack[--idx];
-            float res = 0.0;
-            switch (expr[i].val.op) {
-            case SZEXP_OP_ADD: res = op1 + op2; break;
-            case SZEXP_OP_SUB: res = op1 - op2; break;
-            case SZEXP_OP_MUL: res = op1 * op2; break;
-            case SZEXP_OP_DIV: res = op1 / op2; break;
-            case SZEXP_OP_GT:  res = op1 > op2; break;
-            case SZEXP_OP_LT:  res = op1 < op2; break;
-            default: abort();
-            }
+            float res = szexp_op2(expr[i].val.op, op1, op2);
 
             if (!isfinite(res)) {
                 mp_warn(log, "Illegal operation in RPN expression!\n");
@@ -132,19 +214,9 @@ bool eval_szexpr(struct mp_log *log, void *priv,
             continue;
 
         case SZEXP_VAR_W:
-        case SZEXP_VAR_H: {
-            struct bstr name = expr[i].val.varname;
-            float size[2];
-
-            if (!lookup(priv, name, size)) {
-                mp_warn(log, "Variable %.*s not found in RPN expression!\n",
-                        BSTR_P(name));
-                return false;
-            }
-
-            stack[idx++] = (expr[i].tag == SZEXP_VAR_W) ? size[0] : size[1];
+        case SZEXP_VAR_H:
+            stack[idx++] = vars[var++];
             continue;
-            }
         }
     }
 
@@ -155,6 +227,15 @@ done:
         return false;
     }
 
+    if (cache) {
+        *cache = (struct szexp_cache){
+            .valid = true,
+            .num_vars = num_vars,
+            .result = stack[0],
+        };
+        memcpy(cache->vars, vars, num_vars * sizeof(vars[0]));
+    }
+
     *result = stack[0];
     return true;
 }
@@ -53,6 +53,14 @@ struct szexp {
     } val;
 };
 
+// Result of a szexp for a specific set of variable values
+struct szexp_cache {
+    bool valid;
+    int num_vars;
+    float vars[MAX_SZEXP_SIZE];
+    float result;
+};
+
 struct compute_info {
     bool active;
     int block_w, block_h;     // Block size (each block corresponds to one WG)
@@ -72,6 +80,8 @@ struct gl_user_shader_hook {
     struct szexp cond[MAX_SZEXP_SIZE];
     int components;
     struct compute_info compute;
+    // for video.c
+    struct szexp_cache width_cache, height_cache, cond_cache;
 };
 
 struct gl_user_shader_tex {
@@ -88,9 +98,12 @@ void parse_user_shader(struct mp_log *log, struct ra *ra, struct bstr shader,
                        bool (*dohook)(void *p, struct gl_user_shader_hook hook),
                        bool (*dotex)(void *p, struct gl_user_shader_tex tex));
 
-// Evaluate a szexp, given a lookup function for named textures
+// Evaluate a szexp, given a lookup function for named textures. If cache is
+// not NULL, the result is reused if the variables have the same values as
+// on the previous call with the same cache.
 bool eval_szexpr(struct mp_log *log, void *priv,
                  bool (*lookup)(void *priv, struct bstr var, float size[2]),
-                 struct szexp expr[MAX_SZEXP_SIZE], float *result);
+                 struct szexp expr[MAX_SZEXP_SIZE], struct szexp_cache *cache,
+                 float *result);
 
 #endif
@@ -1,3 +1,6 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include "common/msg.h"
 #include "video/out/vo.h"
 #include "utils.h"
@@ -107,12 +110,18 @@ bool ra_tex_upload_pbo(struct ra *ra, struct ra_buf_pool *pbo,
                       tex->params.w * tex->params.format->pixel_size;
 
     int height = tex->params.h;
-    if (tex->params.dimensions == 2 && params->rc)
+    size_t size = row_size * height * tex->params.d;
+    if (tex->params.dimensions == 2 && params->rc) {
+        // Don't read past the last texel, which may be the end of the source
+        // image if the region doesn't start at x=0.
         height = mp_rect_h(*params->rc);
+        size = row_size * (height - 1) +
+               mp_rect_w(*params->rc) * tex->params.format->pixel_size;
+    }
 
     struct ra_buf_params bufparams = {
         .type = RA_BUF_TYPE_TEX_UPLOAD,
-        .size = row_size * height * tex->params.d,
+        .size = size,
         .host_mutable = true,
     };
 
@@ -209,17 +218,81 @@ bool ra_tex_resize(struct ra *ra, struct mp_log *log, struct ra_tex **tex,
     return *tex;
 }
 
+void perf_samples_add(struct perf_samples *s, uint64_t res)
+{
+    // Input res into the buffer and grab the previous value
+    uint64_t old = s->samples[s->sample_idx];
+    s->sample_count = MPMIN(s->sample_count + 1, VO_PERF_SAMPLE_COUNT);
+    s->samples[s->sample_idx++] = res;
+    s->sample_idx %= VO_PERF_SAMPLE_COUNT;
+    s->sum = s->sum + res - old;
+
+    // Update peak if necessary
+    if (res >= s->peak) {
+        s->peak = res;
+    } else if (s->peak == old) {
+        // It's possible that the last peak was the value we just removed,
+        // if so we need to scan for the new peak
+        uint64_t peak = res;
+        for (int i = 0; i < VO_PERF_SAMPLE_COUNT; i++)
+            peak = MPMAX(peak, s->samples[i]);
+        s->peak = peak;
+    }
+
+    int bucket = 0;
+    for (uint64_t us = res / 1000; us > 1; us >>= 1)
+        bucket++;
+    s->histogram[MPMIN(bucket, VO_PERF_HIST_BUCKETS - 1)]++;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t va = *(const uint64_t *)a, vb = *(const uint64_t *)b;
+    return va > vb ? 1 : va < vb ? -1 : 0;
+}
+
+struct mp_pass_perf perf_samples_measure(struct perf_samples *s)
+{
+    struct mp_pass_perf res = {
+        .peak = s->peak,
+        .count = s->sample_count,
+    };
+
+    int idx = s->sample_idx - s->sample_count + VO_PERF_SAMPLE_COUNT;
+    for (int i = 0; i < res.count; i++) {
+        idx %= VO_PERF_SAMPLE_COUNT;
+        res.samples[i] = s->samples[idx++];
+    }
+
+    memcpy(res.histogram, s->histogram, sizeof(res.histogram));
+
+    if (res.count > 0) {
+        res.last = res.samples[res.count - 1];
+        res.avg = s->sum / res.count;
+    }
+
+    return res;
+}
+
+void mp_pass_perf_percentiles(struct mp_pass_perf *perf)
+{
+    if (!perf->count)
+        return;
+
+    uint64_t sorted[VO_PERF_SAMPLE_COUNT];
+    memcpy(sorted, perf->samples, perf->count * sizeof(sorted[0]));
+    qsort(sorted, perf->count, sizeof(sorted[0]), cmp_u64);
+    perf->p50 = sorted[(perf->count - 1) * 50 / 100];
+    perf->p95 = sorted[(perf->count - 1) * 95 / 100];
+    perf->p99 = sorted[(perf->count - 1) * 99 / 100];
+}
+
 struct timer_pool {
     struct ra *ra;
     ra_timer *timer;
     bool running; // detect invalid usage
 
-    uint64_t samples[VO_PERF_SAMPLE_COUNT];
-    int sample_idx;
-    int sample_count;
-
-    uint64_t sum;
-    uint64_t peak;
+    struct perf_samples samples;
 };
 
 struct timer_pool *timer_pool_create(struct ra *ra)
@@ -269,26 +342,8 @@ void timer_pool_stop(struct timer_pool *pool)
     uint64_t res = pool->ra->fns->timer_stop(pool->ra, pool->timer);
     pool->running = false;
 
-    if (res) {
-        // Input res into the buffer and grab the previous value
-        uint64_t old = pool->samples[pool->sample_idx];
-        pool->sample_count = MPMIN(pool->sample_count + 1, VO_PERF_SAMPLE_COUNT);
-        pool->samples[pool->sample_idx++] = res;
-        pool->sample_idx %= VO_PERF_SAMPLE_COUNT;
-        pool->sum = pool->sum + res - old;
-
-        // Update peak if necessary
-        if (res >= pool->peak) {
-            pool->peak = res;
-        } else if (pool->peak == old) {
-            // It's possible that the last peak was the value we just removed,
-            // if so we need to scan for the new peak
-            uint64_t peak = res;
-            for (int i = 0; i < VO_PERF_SAMPLE_COUNT; i++)
-                peak = MPMAX(peak, pool->samples[i]);
-            pool->peak = peak;
-        }
-    }
+    if (res)
+        perf_samples_add(&pool->samples, res);
 }
 
 struct mp_pass_perf timer_pool_measure(struct timer_pool *pool)
@@ -296,23 +351,7 @@ struct mp_pass_perf timer_pool_measure(struct timer_pool *pool)
     if (!pool)
         return (struct mp_pass_perf){0};
 
-    struct mp_pass_perf res = {
-        .peak = pool->peak,
-        .count = pool->sample_count,
-    };
-
-    int idx = pool->sample_idx - pool->sample_count + VO_PERF_SAMPLE_COUNT;
-    for (int i = 0; i < res.count; i++) {
-        idx %= VO_PERF_SAMPLE_COUNT;
-        res.samples[i] = pool->samples[idx++];
-    }
-
-    if (res.count > 0) {
-        res.last = res.samples[res.count - 1];
-        res.avg = pool->sum / res.count;
-    }
-
-    return res;
+    return perf_samples_measure(&pool->samples);
 }
 
 void mp_log_source(struct mp_log *log, int lev, const char *src)
@@ -91,6 +91,24 @@ struct ra_layout std430_layout(struct ra_renderpass_input *inp);
 bool ra_tex_resize(struct ra *ra, struct mp_log *log, struct ra_tex **tex,
                    int w, int h, const struct ra_format *fmt);
 
+// History of timing samples, with running averages etc.
+struct perf_samples {
+    uint64_t samples[VO_PERF_SAMPLE_COUNT];
+    int sample_idx;
+    int sample_count;
+
+    uint64_t sum;
+    uint64_t peak;
+    uint64_t histogram[VO_PERF_HIST_BUCKETS];
+};
+
+void perf_samples_add(struct perf_samples *s, uint64_t res);
+struct mp_pass_perf perf_samples_measure(struct perf_samples *s);
+
+// Fill in the percentile fields from perf->samples. This is not done by
+// default, since it's comparatively expensive and rarely needed.
+void mp_pass_perf_percentiles(struct mp_pass_perf *perf);
+
 // A wrapper around ra_timer that does result pooling, averaging etc.
 struct timer_pool;
 
@@ -16,10 +16,14 @@
  */
 
 #include <assert.h>
+#include <limits.h>
 #include <math.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <assert.h>
 
 #include <libavutil/common.h>
@@ -31,6 +35,8 @@
 #include "options/m_config.h"
 #include "common/global.h"
 #include "options/options.h"
+#include "options/path.h"
+#include "osdep/io.h"
 #include "utils.h"
 #include "hwdec.h"
 #include "osd.h"
@@ -131,6 +137,11 @@ struct surface {
     struct ra_tex *tex;
     uint64_t id;
     double pts;
+    // Size the surface was rendered at. With source resolution interpolation,
+    // also the state needed to continue rendering from it.
+    int w, h;
+    struct gl_transform texture_offset;
+    int components;
 };
 
 #define SURFACES_MAX 10
@@ -166,6 +177,7 @@ struct gl_video {
     bool force_clear_color;
 
     struct gl_shader_cache *sc;
+    struct mp_lut_cache *lut_cache;
 
     struct osd_state *osd_state;
     struct mpgl_osd *osd;
@@ -174,6 +186,8 @@ struct gl_video {
     struct ra_tex *lut_3d_texture;
     bool use_lut_3d;
     int lut_3d_size[3];
+    enum mp_csp_prim lut_3d_prim;   // color space the 3DLUT maps from
+    enum mp_csp_trc lut_3d_trc;
 
     struct ra_tex *dither_texture;
 
@@ -205,6 +219,8 @@ struct gl_video {
     int vao_len;
 
     const struct ra_format *fbo_format;
+    const struct ra_format *out_fbo_format; // see output_fbo_format()
+    int out_fbo_key;
     struct ra_tex *merge_tex[4];
     struct ra_tex *scale_tex[4];
     struct ra_tex *integer_tex[4];
@@ -228,9 +244,14 @@ struct gl_video {
 
     int surface_idx;
     int surface_now;
+    bool surfaces_source;   // surfaces are at source instead of output size
     int frames_drawn;
     bool is_interpolated;
     bool output_tex_valid;
+    // output_tex was drawn by the interpolation code, from the surface with
+    // this ID (and nothing blended into it)
+    bool output_tex_interp;
+    uint64_t output_tex_surface;
 
     // state for configured scalers
     struct scaler scaler[SCALER_COUNT];
@@ -257,10 +278,17 @@ struct gl_video {
     bool use_linear;
     float user_gamma;
 
+    // Last result of mp_get_csp_matrix(), valid for csp_params
+    struct mp_csp_params csp_params;
+    struct mp_cmat csp_matrix;
+    bool csp_matrix_valid;
+
     // pass info / metrics
     struct pass_info pass_fresh[VO_PASS_PERF_MAX];
     struct pass_info pass_redraw[VO_PASS_PERF_MAX];
     struct pass_info *pass;
+    // sum of all passes of each frame
+    struct perf_samples frame_fresh, frame_redraw;
     int pass_idx;
     struct timer_pool *upload_timer;
     struct timer_pool *blit_timer;
@@ -283,6 +311,7 @@ struct gl_video {
 
     bool dsi_warned;
     bool broken_frame; // temporary error state
+    bool incomplete_frame; // fallback rendering while shaders/LUTs are built
 };
 
 static const struct gl_video_opts gl_video_opts_def = {
@@ -312,7 +341,9 @@ static const struct gl_video_opts gl_video_opts_def = {
     .tone_mapping = TONE_MAPPING_MOBIUS,
     .tone_mapping_param = NAN,
     .tone_mapping_desat = 1.0,
+    .hdr_scene_threshold = 0.2,
     .early_flush = -1,
+    .shader_cache_size = 64 * 1024 * 1024,
 };
 
 static int validate_scaler_opt(struct mp_log *log, const m_option_t *opt,
@@ -354,6 +385,7 @@ const struct m_sub_options gl_video_conf = {
                     {"gamma",    TONE_MAPPING_GAMMA},
                     {"linear",   TONE_MAPPING_LINEAR})),
         OPT_FLAG("hdr-compute-peak", compute_hdr_peak, 0),
+        OPT_FLOATRANGE("hdr-scene-threshold", hdr_scene_threshold, 0, 0, 10.0),
         OPT_FLOAT("tone-mapping-param", tone_mapping_param, 0),
         OPT_FLOAT("tone-mapping-desaturate", tone_mapping_desat, 0),
         OPT_FLAG("gamut-warning", gamut_warning, 0),
@@ -370,6 +402,8 @@ const struct m_sub_options gl_video_conf = {
         OPT_FLOATRANGE("sigmoid-center", sigmoid_center, 0, 0.0, 1.0),
         OPT_FLOATRANGE("sigmoid-slope", sigmoid_slope, 0, 1.0, 20.0),
         OPT_STRING("fbo-format", fbo_format, 0),
+        OPT_CHOICE("fbo-precision", fbo_precision, 0,
+                   ({"full", 0}, {"reduced", 1})),
         OPT_CHOICE_OR_INT("dither-depth", dither_depth, 0, -1, 16,
                           ({"no", -1}, {"auto", 0})),
         OPT_CHOICE("dither", dither_algo, 0,
@@ -388,6 +422,10 @@ const struct m_sub_options gl_video_conf = {
         OPT_COLOR("background", background, 0),
         OPT_FLAG("interpolation", interpolation, 0),
         OPT_FLOAT("interpolation-threshold", interpolation_threshold, 0),
+        OPT_CHOICE("interpolation-res", interpolation_res, 0,
+                   ({"output", INTERPOLATION_RES_OUTPUT},
+                    {"source", INTERPOLATION_RES_SOURCE},
+                    {"auto", INTERPOLATION_RES_AUTO})),
         OPT_CHOICE("blend-subtitles", blend_subs, 0,
                    ({"no", BLEND_SUBS_NO},
                     {"yes", BLEND_SUBS_YES},
@@ -401,6 +439,8 @@ const struct m_sub_options gl_video_conf = {
         OPT_INTRANGE("gpu-tex-pad-y", tex_pad_y, 0, 0, 4096),
         OPT_SUBSTRUCT("", icc_opts, mp_icc_conf, 0),
         OPT_STRING("gpu-shader-cache-dir", shader_cache_dir, 0),
+        OPT_INTRANGE("gpu-shader-cache-size", shader_cache_size, 0, 0, INT_MAX),
+        OPT_FLAG("gpu-async-shaders", async_shaders, 0),
         OPT_REPLACED("hdr-tone-mapping", "tone-mapping"),
         OPT_REPLACED("opengl-shaders", "glsl-shaders"),
         OPT_REPLACED("opengl-shader", "glsl-shader"),
@@ -420,6 +460,7 @@ static void uninit_rendering(struct gl_video *p);
 static void uninit_scaler(struct gl_video *p, struct scaler *scaler);
 static void check_gl_features(struct gl_video *p);
 static bool pass_upload_image(struct gl_video *p, struct mp_image *mpi, uint64_t id);
+static const struct ra_format *output_fbo_format(struct gl_video *p);
 static const char *handle_scaler_opt(const char *name, bool tscale);
 static void reinit_from_options(struct gl_video *p);
 static void get_scale_factors(struct gl_video *p, bool transpose_rot, double xy[2]);
@@ -555,8 +596,11 @@ bool gl_video_icc_auto_enabled(struct gl_video *p)
     return p->opts.icc_opts ? p->opts.icc_opts->profile_auto : false;
 }
 
-static bool gl_video_get_lut3d(struct gl_video *p, enum mp_csp_prim prim,
-                               enum mp_csp_trc trc)
+// Returns whether the 3DLUT texture can be used. While the LUT for the given
+// color space is generated, the previous LUT is used, and prim/trc are set
+// to the color space it was generated for.
+static bool gl_video_get_lut3d(struct gl_video *p, enum mp_csp_prim *prim,
+                               enum mp_csp_trc *trc)
 {
     if (!p->use_lut_3d)
         return false;
@@ -565,7 +609,7 @@ static bool gl_video_get_lut3d(struct gl_video *p, enum mp_csp_prim prim,
     if (p->image.mpi)
         icc = p->image.mpi->icc_profile;
 
-    if (p->lut_3d_texture && !gl_lcms_has_changed(p->cms, prim, trc, icc))
+    if (p->lut_3d_texture && !gl_lcms_has_changed(p->cms, *prim, *trc, icc))
         return true;
 
     // GLES3 doesn't provide filtered 16 bit integer textures
@@ -578,11 +622,21 @@ static bool gl_video_get_lut3d(struct gl_video *p, enum mp_csp_prim prim,
     }
 
     struct lut3d *lut3d = NULL;
-    if (!fmt || !gl_lcms_get_lut3d(p->cms, &lut3d, prim, trc, icc) || !lut3d) {
+    if (!fmt || !gl_lcms_get_lut3d(p->cms, &lut3d, *prim, *trc, icc)) {
         p->use_lut_3d = false;
         return false;
     }
 
+    if (!lut3d) {
+        // Still being generated, so render with what we have for now.
+        p->incomplete_frame = true;
+        if (!p->lut_3d_texture)
+            return false;
+        *prim = p->lut_3d_prim;
+        *trc = p->lut_3d_trc;
+        return true;
+    }
+
     ra_tex_free(p->ra, &p->lut_3d_texture);
 
     struct ra_tex_params params = {
@@ -601,10 +655,10 @@ static bool gl_video_get_lut3d(struct gl_video *p, enum mp_csp_prim prim,
 
     for (int i = 0; i < 3; i++)
         p->lut_3d_size[i] = lut3d->size[i];
+    p->lut_3d_prim = *prim;
+    p->lut_3d_trc = *trc;
 
-    talloc_free(lut3d);
-
-    return true;
+    return !!p->lut_3d_texture;
 }
 
 // Fill an image struct from a ra_tex + some metadata
@@ -1031,8 +1085,10 @@ static void pass_report_performance(struct gl_video *p)
     if (!p->pass)
         return;
 
+    uint64_t total = 0;
     for (int i = 0; i < VO_PASS_PERF_MAX; i++) {
         struct pass_info *pass = &p->pass[i];
+        total += pass->perf.last;
         if (pass->desc.len) {
             MP_DBG(p, "pass '%.*s': last %dus avg %dus peak %dus\n",
                    BSTR_P(pass->desc),
@@ -1041,6 +1097,11 @@ static void pass_report_performance(struct gl_video *p)
                    (int)pass->perf.peak/1000);
         }
     }
+
+    if (total) {
+        bool redraw = p->pass == p->pass_redraw;
+        perf_samples_add(redraw ? &p->frame_redraw : &p->frame_fresh, total);
+    }
 }
 
 static void pass_prepare_src_tex(struct gl_video *p)
@@ -1628,8 +1689,8 @@ static void reinit_scaler(struct gl_video *p, struct scaler *scaler,
 
     scaler->lut_size = 1 << p->opts.scaler_lut_size;
 
-    float *weights = talloc_array(NULL, float, scaler->lut_size * stride);
-    mp_compute_lut(scaler->kernel, scaler->lut_size, stride, weights);
+    const float *weights = mp_compute_lut_cached(p->lut_cache, scaler->kernel,
+                                                 scaler->lut_size, stride);
 
     bool use_1d = scaler->kernel->polar && (p->ra->caps & RA_CAP_TEX_1D);
 
@@ -1641,12 +1702,10 @@ static void reinit_scaler(struct gl_video *p, struct scaler *scaler,
         .format = fmt,
         .render_src = true,
         .src_linear = true,
-        .initial_data = weights,
+        .initial_data = (void *)weights,
     };
     scaler->lut = ra_tex_create(p->ra, &lut_params);
 
-    talloc_free(weights);
-
     debug_check_gl(p, "after initializing scaler");
 }
 
@@ -1699,18 +1758,33 @@ static void pass_dispatch_sample_polar(struct gl_video *p, struct scaler *scaler
     // For performance we want to load at least as many pixels
     // horizontally as there are threads in a warp (32 for nvidia), as
     // well as enough to take advantage of shmem parallelism
-    const int warp_size = 32, threads = 256;
-    int bw = warp_size;
-    int bh = threads / bw;
+    const int warp_size = 32, min_width = 16;
+    int threads = MPMIN(256, p->ra->max_compute_group_threads);
+    int bw = MPMIN(warp_size, threads);
+    int bh = MPMAX(threads / bw, 1);
+    if (bw < min_width)
+        goto fallback;
 
     // We need to sample everything from base_min to base_max, so make sure
-    // we have enough room in shmem
-    int iw = (int)ceil(bw / ratiox) + padding + 1,
+    // we have enough room in shmem. If we don't (large kernels, or
+    // downscaling), use smaller blocks: first fewer rows, then narrower rows.
+    int iw, ih;
+    while (1) {
+        iw = (int)ceil(bw / ratiox) + padding + 1;
         ih = (int)ceil(bh / ratioy) + padding + 1;
 
-    int shmem_req = iw * ih * img.components * sizeof(float);
-    if (shmem_req > p->ra->max_shmem)
-        goto fallback;
+        size_t shmem_req = (size_t)iw * ih * img.components * sizeof(float);
+        if (shmem_req <= p->ra->max_shmem)
+            break;
+
+        if (bh > 1) {
+            bh /= 2;
+        } else if (bw > min_width) {
+            bw /= 2;
+        } else {
+            goto fallback;
+        }
+    }
 
     pass_is_compute(p, bw, bh);
     pass_compute_polar(p->sc, scaler, img.components, bw, bh, iw, ih);
@@ -1808,6 +1882,20 @@ static void unsharp_hook(struct gl_video *p, struct image img,
     pass_sample_unsharp(p->sc, p->opts.unsharp);
 }
 
+static bool deint_hook_cond(struct gl_video *p, struct image img, void *priv)
+{
+    return p->image_params.gpu_ops.deint;
+}
+
+static void deint_hook(struct gl_video *p, struct image img,
+                       struct gl_transform *trans, void *priv)
+{
+    struct mp_image *mpi = p->image.mpi;
+    bool top = !mpi || (mpi->fields & MP_IMGFIELD_TOP_FIRST);
+    pass_describe(p, "deinterlacing (%s)", plane_names[img.type]);
+    pass_sample_field_deint(p->sc, top);
+}
+
 struct szexp_ctx {
     struct gl_video *p;
     struct image img;
@@ -1857,7 +1945,8 @@ static bool user_hook_cond(struct gl_video *p, struct image img, void *priv)
 
     float res = false;
     struct szexp_ctx ctx = {p, img};
-    eval_szexpr(p->log, &ctx, szexp_lookup, shader->cond, &res);
+    eval_szexpr(p->log, &ctx, szexp_lookup, shader->cond, &shader->cond_cache,
+                &res);
     return res;
 }
 
@@ -1882,8 +1971,11 @@ static void user_hook(struct gl_video *p, struct image img,
     // to do this and display an error message than just crash OpenGL
     float w = 1.0, h = 1.0;
 
-    eval_szexpr(p->log, &(struct szexp_ctx){p, img}, szexp_lookup, shader->width, &w);
-    eval_szexpr(p->log, &(struct szexp_ctx){p, img}, szexp_lookup, shader->height, &h);
+    struct szexp_ctx ctx = {p, img};
+    eval_szexpr(p->log, &ctx, szexp_lookup, shader->width, &shader->width_cache,
+                &w);
+    eval_szexpr(p->log, &ctx, szexp_lookup, shader->height,
+                &shader->height_cache, &h);
 
     *trans = (struct gl_transform){{{w / img.w, 0}, {0, h / img.h}}};
     gl_transform_trans(shader->offset, trans);
@@ -1941,6 +2033,15 @@ static void gl_video_setup_hooks(struct gl_video *p)
 {
     gl_video_reset_hooks(p);
 
+    // Deinterlacing requested by vf_gpu. This has to run on the native planes
+    // before anything else.
+    MP_TARRAY_APPEND(p, p->tex_hooks, p->num_tex_hooks, (struct tex_hook) {
+        .hook_tex = {"LUMA", "CHROMA", "RGB", "XYZ", "ALPHA"},
+        .bind_tex = {"HOOKED"},
+        .hook = deint_hook,
+        .cond = deint_hook_cond,
+    });
+
     if (p->opts.deband) {
         MP_TARRAY_APPEND(p, p->tex_hooks, p->num_tex_hooks, (struct tex_hook) {
             .hook_tex = {"LUMA", "CHROMA", "RGB", "XYZ"},
@@ -2161,6 +2262,47 @@ static void pass_read_tex(struct gl_video *p, struct ra_tex *tex)
     copy_image(p, &(int){0}, img);
 }
 
+#define FRUIT_CACHE_HEADER "mpv fruit dither matrix v1\n"
+
+// The larger matrices take seconds to generate on slow CPUs, so they're also
+// stored in the shader cache directory, if one is set.
+static void make_fruit_dither_matrix(struct gl_video *p, float *m, int sizeb)
+{
+    size_t bytes = sizeof(float) << (2 * sizeb);
+    char *dir = p->opts.shader_cache_dir;
+    if (sizeb < 7 || !dir || !dir[0]) {
+        mp_make_fruit_dither_matrix(m, sizeb);
+        return;
+    }
+
+    void *tmp = talloc_new(NULL);
+    dir = mp_get_user_path(tmp, p->global, dir);
+    char *name = talloc_asprintf(tmp, "fruit-dither-%d", sizeb);
+    char *filename = mp_path_join(tmp, dir, name);
+    size_t header = strlen(FRUIT_CACHE_HEADER);
+
+    struct bstr data = stream_read_file(filename, tmp, p->global,
+                                        header + bytes + 1);
+    if (data.len == header + bytes &&
+        memcmp(data.start, FRUIT_CACHE_HEADER, header) == 0)
+    {
+        MP_VERBOSE(p, "Loaded dither matrix from %s\n", filename);
+        memcpy(m, data.start + header, bytes);
+    } else {
+        mp_make_fruit_dither_matrix(m, sizeb);
+        mp_mkdirp(dir);
+        FILE *out = fopen(filename, "wb");
+        if (out) {
+            MP_VERBOSE(p, "Writing dither matrix to %s\n", filename);
+            bool ok = fwrite(FRUIT_CACHE_HEADER, header, 1, out) == 1 &&
+                      fwrite(m, bytes, 1, out) == 1;
+            if (fclose(out) || !ok)
+                unlink(filename);
+        }
+    }
+    talloc_free(tmp);
+}
+
 // yuv conversion, and any other conversions before main up/down-scaling
 static void pass_convert_yuv(struct gl_video *p)
 {
@@ -2170,6 +2312,12 @@ static void pass_convert_yuv(struct gl_video *p)
     cparams.gray = p->is_gray;
     mp_csp_set_image_params(&cparams, &p->image_params);
     mp_csp_equalizer_state_get(p->video_eq, &cparams);
+    // Adjustments from vf_gpu, on top of the user's equalizer settings.
+    const struct mp_gpu_ops *ops = &p->image_params.gpu_ops;
+    cparams.brightness += ops->brightness / 100.0;
+    cparams.contrast *= (ops->contrast + 100) / 100.0;
+    cparams.saturation *= (ops->saturation + 100) / 100.0;
+    cparams.gamma *= exp(log(8.0) * ops->gamma / 100.0);
     p->user_gamma = 1.0 / (cparams.gamma * p->opts.gamma);
 
     pass_describe(p, "color conversion");
@@ -2186,10 +2334,16 @@ static void pass_convert_yuv(struct gl_video *p)
 
     // Conversion to RGB. For RGB itself, this still applies e.g. brightness
     // and contrast controls, or expansion of e.g. LSB-packed 10 bit data.
-    struct mp_cmat m = {{{0}}};
-    mp_get_csp_matrix(&cparams, &m);
-    gl_sc_uniform_mat3(sc, "colormatrix", true, &m.m[0][0]);
-    gl_sc_uniform_vec3(sc, "colormatrix_c", m.c);
+    // This runs on every frame, but the parameters rarely change.
+    if (!p->csp_matrix_valid || !mp_csp_params_equal(&cparams, &p->csp_params)) {
+        p->csp_matrix = (struct mp_cmat){{{0}}};
+        mp_get_csp_matrix(&cparams, &p->csp_matrix);
+        p->csp_params = cparams;
+        p->csp_matrix_valid = true;
+    }
+    struct mp_cmat *m = &p->csp_matrix;
+    gl_sc_uniform_mat3(sc, "colormatrix", true, &m->m[0][0]);
+    gl_sc_uniform_vec3(sc, "colormatrix_c", m->c);
 
     GLSL(color.rgb = mat3(colormatrix) * color.rgb + colormatrix_c;)
 
@@ -2259,6 +2413,30 @@ static void compute_src_transform(struct gl_video *p, struct gl_transform *tr)
     *tr = transform;
 }
 
+// Whether the main scaler can be skipped, because it would map each source
+// texel exactly to one output pixel. xy are the scale factors, and
+// src_transform the transform from compute_src_transform().
+static bool can_fuse_main_scaling(struct gl_video *p, double xy[2],
+                                  const struct scaler_config *conf,
+                                  struct gl_transform src_transform)
+{
+    if (xy[0] != 1.0 || xy[1] != 1.0 || p->pass_compute.active)
+        return false;
+
+    // Other kernels are not necessarily interpolating, i.e. they can change
+    // the image even at exact texel positions.
+    if (strcmp(conf->kernel.name, "bilinear") != 0)
+        return false;
+
+    // Only integer texel offsets (with scaling already excluded above, the
+    // matrix can be something else only due to prescaling hooks)
+    struct gl_transform off = p->texture_offset;
+    return off.m[0][0] == 1.0 && off.m[1][1] == 1.0 &&
+           off.m[0][1] == 0.0 && off.m[1][0] == 0.0 &&
+           src_transform.t[0] == roundf(src_transform.t[0]) &&
+           src_transform.t[1] == roundf(src_transform.t[1]);
+}
+
 // Takes care of the main scaling and pre/post-conversions
 static void pass_scale_main(struct gl_video *p)
 {
@@ -2340,10 +2518,32 @@ static void pass_scale_main(struct gl_video *p)
     compute_src_transform(p, &transform);
 
     GLSLF("// main scaling\n");
-    finish_pass_tex(p, &p->indirect_tex, p->texture_w, p->texture_h);
-    struct image src = image_wrap(p->indirect_tex, PLANE_RGB, p->components);
-    gl_transform_trans(transform, &src.transform);
-    pass_sample(p, src, scaler, &scaler_conf, scale_factor, vp_w, vp_h);
+    if (can_fuse_main_scaling(p, xy, &scaler_conf, transform)) {
+        // The scaler would only copy texels 1:1. Keep the pointwise stages
+        // before and after it in the same pass, instead of rendering them to
+        // an intermediate texture first.
+        pass_describe(p, "scale=%s (unscaled, fused)", scaler_conf.kernel.name);
+        for (int n = 0; n < p->num_pass_imgs; n++) {
+            struct image *s = &p->pass_imgs[n];
+            if (!s->tex)
+                continue;
+            // Map the main texture coordinates to the coordinates of this
+            // image, then apply the src transform of the main scaler first.
+            struct gl_transform t = transform;
+            struct gl_transform to_img = {{{(float)s->w / p->texture_w, 0},
+                                           {0, (float)s->h / p->texture_h}}};
+            gl_transform_trans(to_img, &t);
+            gl_transform_trans(s->transform, &t);
+            s->transform = t;
+            s->w = p->texture_w;
+            s->h = p->texture_h;
+        }
+    } else {
+        finish_pass_tex(p, &p->indirect_tex, p->texture_w, p->texture_h);
+        struct image src = image_wrap(p->indirect_tex, PLANE_RGB, p->components);
+        gl_transform_trans(transform, &src.transform);
+        pass_sample(p, src, scaler, &scaler_conf, scale_factor, vp_w, vp_h);
+    }
 
     // Changes the texture size to display size after main scaler.
     p->texture_w = vp_w;
@@ -2375,6 +2575,7 @@ static void pass_colormanage(struct gl_video *p, struct mp_colorspace src, bool
         .light = MP_CSP_LIGHT_DISPLAY,
     };
 
+    bool use_lut_3d = false;
     if (p->use_lut_3d) {
         // The 3DLUT is always generated against the video's original source
         // space, *not* the reference space. (To avoid having to regenerate
@@ -2389,9 +2590,10 @@ static void pass_colormanage(struct gl_video *p, struct mp_colorspace src, bool
         if (mp_trc_is_hdr(trc_orig))
             trc_orig = MP_CSP_TRC_GAMMA22;
 
-        if (gl_video_get_lut3d(p, prim_orig, trc_orig)) {
+        if (gl_video_get_lut3d(p, &prim_orig, &trc_orig)) {
             dst.primaries = prim_orig;
             dst.gamma = trc_orig;
+            use_lut_3d = true;
         }
     }
 
@@ -2429,17 +2631,15 @@ static void pass_colormanage(struct gl_video *p, struct mp_colorspace src, bool
     bool detect_peak = p->opts.compute_hdr_peak && mp_trc_is_hdr(src.gamma);
     if (detect_peak && !p->hdr_peak_ssbo) {
         struct {
-            unsigned int sig_peak_raw;
-            unsigned int index;
+            unsigned int counter;
+            unsigned int frame_idx;
+            unsigned int frame_num;
             unsigned int frame_max[PEAK_DETECT_FRAMES+1];
+            unsigned int frame_avg[PEAK_DETECT_FRAMES+1];
+            unsigned int total_max;
+            unsigned int total_avg;
         } peak_ssbo = {0};
 
-        // Prefill with safe values
-        int safe = MP_REF_WHITE * mp_trc_nom_peak(p->image_params.color.gamma);
-        peak_ssbo.sig_peak_raw = PEAK_DETECT_FRAMES * safe;
-        for (int i = 0; i < PEAK_DETECT_FRAMES+1; i++)
-            peak_ssbo.frame_max[i] = safe;
-
         struct ra_buf_params params = {
             .type = RA_BUF_TYPE_SHADER_STORAGE,
             .size = sizeof(peak_ssbo),
@@ -2457,18 +2657,24 @@ static void pass_colormanage(struct gl_video *p, struct mp_colorspace src, bool
         pass_describe(p, "detect HDR peak");
         pass_is_compute(p, 8, 8); // 8x8 is good for performance
         gl_sc_ssbo(p->sc, "PeakDetect", p->hdr_peak_ssbo,
-            "uint sig_peak_raw;"
-            "uint index;"
-            "uint frame_max[%d];", PEAK_DETECT_FRAMES + 1
+            "uint counter;"
+            "uint frame_idx;"
+            "uint frame_num;"
+            "uint frame_max[%d];"
+            "uint frame_avg[%d];"
+            "uint total_max;"
+            "uint total_avg;",
+            PEAK_DETECT_FRAMES + 1, PEAK_DETECT_FRAMES + 1
         );
     }
 
     // Adapt from src to dst as necessary
     pass_color_map(p->sc, src, dst, p->opts.tone_mapping,
                    p->opts.tone_mapping_param, p->opts.tone_mapping_desat,
-                   detect_peak, p->opts.gamut_warning, p->use_linear && !osd);
+                   detect_peak, p->opts.hdr_scene_threshold,
+                   p->opts.gamut_warning, p->use_linear && !osd);
 
-    if (p->use_lut_3d) {
+    if (use_lut_3d) {
         gl_sc_uniform_texture(p->sc, "lut_3d", p->lut_3d_texture);
         GLSL(vec3 cpos;)
         for (int i = 0; i < 3; i++)
@@ -2507,7 +2713,7 @@ static void pass_dither(struct gl_video *p)
             if (p->last_dither_matrix_size != size) {
                 p->last_dither_matrix = talloc_realloc(p, p->last_dither_matrix,
                                                        float, size * size);
-                mp_make_fruit_dither_matrix(p->last_dither_matrix, sizeb);
+                make_fruit_dither_matrix(p, p->last_dither_matrix, sizeb);
                 p->last_dither_matrix_size = size;
             }
 
@@ -2661,7 +2867,10 @@ static void pass_render_frame_dumb(struct gl_video *p)
 
 // The main rendering function, takes care of everything up to and including
 // upscaling. p->image is rendered.
-static bool pass_render_frame(struct gl_video *p, struct mp_image *mpi, uint64_t id)
+// Render the frame up to (excluding) the main scaler, i.e. at the source
+// resolution. pass_render_frame_scaled() continues from there.
+static bool pass_render_frame_source(struct gl_video *p, struct mp_image *mpi,
+                                     uint64_t id)
 {
     // initialize the texture parameters and temporary variables
     p->texture_w = p->image_params.w;
@@ -2707,6 +2916,11 @@ static bool pass_render_frame(struct gl_video *p, struct mp_image *mpi, uint64_t
     }
     pass_opt_hook_point(p, "MAIN", &p->texture_offset);
 
+    return true;
+}
+
+static void pass_render_frame_scaled(struct gl_video *p, double vpts)
+{
     pass_scale_main(p);
 
     int vp_w = p->dst_rect.x1 - p->dst_rect.x0,
@@ -2737,6 +2951,19 @@ static bool pass_render_frame(struct gl_video *p, struct mp_image *mpi, uint64_t
     }
 
     pass_opt_hook_point(p, "SCALED", NULL);
+}
+
+static bool pass_render_frame(struct gl_video *p, struct mp_image *mpi, uint64_t id)
+{
+    if (!pass_render_frame_source(p, mpi, id))
+        return false;
+
+    if (!p->dumb_mode) {
+        double vpts = p->image.mpi->pts;
+        if (vpts == MP_NOPTS_VALUE)
+            vpts = p->osd_pts;
+        pass_render_frame_scaled(p, vpts);
+    }
 
     return true;
 }
@@ -2798,8 +3025,16 @@ static bool update_surface(struct gl_video *p, struct mp_image *mpi,
         vp_h = p->dst_rect.y1 - p->dst_rect.y0;
 
     pass_info_reset(p, false);
-    if (!pass_render_frame(p, mpi, id))
-        return false;
+    if (p->surfaces_source) {
+        // The rest of the pipeline is run after blending.
+        if (!pass_render_frame_source(p, mpi, id))
+            return false;
+        vp_w = p->texture_w;
+        vp_h = p->texture_h;
+    } else {
+        if (!pass_render_frame(p, mpi, id))
+            return false;
+    }
 
     // Frame blending should always be done in linear light to preserve the
     // overall brightness, otherwise this will result in flashing dark frames
@@ -2812,9 +3047,55 @@ static bool update_surface(struct gl_video *p, struct mp_image *mpi,
     finish_pass_tex(p, &surf->tex, vp_w, vp_h);
     surf->id  = id;
     surf->pts = mpi->pts;
+    surf->w = vp_w;
+    surf->h = vp_h;
+    surf->texture_offset = p->texture_offset;
+    surf->components = p->components;
     return true;
 }
 
+// Whether interpolation should blend the frames before the main scaler.
+static bool interpolate_at_source(struct gl_video *p)
+{
+    // User shaders may hook any stage after MAIN, and expect to see each
+    // video frame there.
+    if (p->num_tex_hooks || p->dumb_mode)
+        return false;
+
+    switch (p->opts.interpolation_res) {
+    case INTERPOLATION_RES_SOURCE:
+        return true;
+    case INTERPOLATION_RES_AUTO: {
+        // Only worth it if the output has many more pixels per frame, and
+        // the main scaler is cheap enough that running it on every vsync
+        // doesn't eat up the savings.
+        const char *kernel = p->opts.scaler[SCALER_SCALE].kernel.name;
+        long long src = (long long)(p->src_rect.x1 - p->src_rect.x0) *
+                        (p->src_rect.y1 - p->src_rect.y0);
+        long long dst = (long long)(p->dst_rect.x1 - p->dst_rect.x0) *
+                        (p->dst_rect.y1 - p->dst_rect.y0);
+        return src > 0 && dst >= src * 4 && kernel &&
+               strcmp(kernel, "bilinear") == 0;
+    }
+    }
+    return false;
+}
+
+// Copy the cached output_tex to the target.
+static void pass_redraw_output_tex(struct gl_video *p, struct ra_fbo fbo)
+{
+    struct mp_rect src = p->dst_rect;
+    struct mp_rect dst = src;
+    if (fbo.flip) {
+        dst.y0 = fbo.tex->params.h - src.y0;
+        dst.y1 = fbo.tex->params.h - src.y1;
+    }
+    timer_pool_start(p->blit_timer);
+    p->ra->fns->blit(p->ra, fbo.tex, p->output_tex, &dst, &src);
+    timer_pool_stop(p->blit_timer);
+    pass_record(p, timer_pool_measure(p->blit_timer));
+}
+
 // Draws an interpolate frame to fbo, based on the frame timing in t
 static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
                                        struct ra_fbo fbo)
@@ -2827,6 +3108,14 @@ static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
     if (t->still)
         gl_video_reset_surfaces(p);
 
+    bool at_source = interpolate_at_source(p);
+    if (at_source != p->surfaces_source) {
+        MP_VERBOSE(p, "Interpolating at %s resolution.\n",
+                   at_source ? "source" : "output");
+        gl_video_reset_surfaces(p);
+        p->surfaces_source = at_source;
+    }
+
     // First of all, figure out if we have a frame available at all, and draw
     // it manually + reset the queue if not
     if (p->surfaces[p->surface_now].id == 0) {
@@ -2910,22 +3199,23 @@ static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
         } else if (p->surfaces[ii].id < p->surfaces[i].id) {
             valid = false;
             MP_DBG(p, "interpolation queue underrun\n");
+        } else if (p->surfaces[ii].w != p->surfaces[i].w ||
+                   p->surfaces[ii].h != p->surfaces[i].h)
+        {
+            // Left over from before a resize; can't be blended.
+            valid = false;
         }
     }
 
     // Update OSD PTS to synchronize subtitles with the displayed frame
     p->osd_pts = p->surfaces[surface_now].pts;
 
-    // Finally, draw the right mix of frames to the screen.
-    if (!is_new)
-        pass_info_reset(p, true);
-    pass_describe(p, "interpolation");
-    if (!valid || t->still) {
-        // surface_now is guaranteed to be valid, so we can safely use it.
-        pass_read_tex(p, p->surfaces[surface_now].tex);
-        p->is_interpolated = false;
-    } else {
-        double mix = t->vsync_offset / t->ideal_frame_duration;
+    // Figure out the mix, and whether the result is just a single surface.
+    bool pure = !valid || t->still;
+    int pure_surface = surface_now; // surface_now is guaranteed to be valid
+    double mix = 0.0;
+    if (!pure) {
+        mix = t->vsync_offset / t->ideal_frame_duration;
         // The scaler code always wants the fcoord to be between 0 and 1,
         // so we try to adjust by using the previous set of N frames instead
         // (which requires some extra checking to make sure it's valid)
@@ -2954,6 +3244,60 @@ static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
             mix = 1 - mix;
         }
 
+        // With these kernels, an exact mix of 0 or 1 is a plain copy of one
+        // frame. With oversample this is the case on most vsyncs.
+        if ((oversample || linear) && (mix == 0.0 || mix == 1.0)) {
+            pure = true;
+            pure_surface = surface_wrap(surface_bse + (mix == 1.0 ? 1 : 0));
+        }
+    }
+
+    // Continue rendering with the state of the source frame.
+    if (p->surfaces_source) {
+        struct surface *surf = &p->surfaces[pure_surface];
+        p->texture_w = surf->w;
+        p->texture_h = surf->h;
+        p->texture_offset = surf->texture_offset;
+        p->components = surf->components;
+    }
+
+    // Finally, draw the right mix of frames to the screen.
+    if (!is_new)
+        pass_info_reset(p, true);
+
+    struct ra_fbo dest_fbo = fbo;
+    if (pure) {
+        uint64_t id = p->surfaces[pure_surface].id;
+        p->is_interpolated = false;
+
+        // The same surface is typically shown for several vsyncs in a row,
+        // so keep the final output around instead of redrawing it.
+        if (p->output_tex_valid && p->output_tex_interp &&
+            p->output_tex_surface == id)
+        {
+            pass_describe(p, "redraw cached frame");
+            pass_redraw_output_tex(p, fbo);
+            goto done;
+        }
+
+        p->output_tex_valid = false;
+        if (!p->dumb_mode && (p->ra->caps & RA_CAP_BLIT)) {
+            bool r = ra_tex_resize(p->ra, p->log, &p->output_tex,
+                                   fbo.tex->params.w, fbo.tex->params.h,
+                                   output_fbo_format(p));
+            if (r) {
+                dest_fbo = (struct ra_fbo) { p->output_tex };
+                p->output_tex_valid = true;
+                p->output_tex_interp = true;
+                p->output_tex_surface = id;
+            }
+        }
+
+        pass_describe(p, "interpolation");
+        pass_read_tex(p, p->surfaces[pure_surface].tex);
+    } else {
+        pass_describe(p, "interpolation");
+
         // Blend the frames together
         if (oversample || linear) {
             gl_sc_uniform_dynamic(p->sc);
@@ -2983,8 +3327,21 @@ static void gl_video_interpolate_frame(struct gl_video *p, struct vo_frame *t,
                t->ideal_frame_duration, t->vsync_interval, mix);
         p->is_interpolated = true;
     }
-    pass_draw_to_screen(p, fbo);
 
+    if (p->surfaces_source) {
+        // The surfaces are in linear light, see update_surface().
+        pass_delinearize(p->sc, p->image_params.color.gamma);
+        p->use_linear = false;
+        pass_render_frame_scaled(p, p->osd_pts);
+    }
+    pass_draw_to_screen(p, dest_fbo);
+    if (dest_fbo.tex != fbo.tex) {
+        pass_info_reset(p, true);
+        pass_describe(p, "redraw cached frame");
+        pass_redraw_output_tex(p, fbo);
+    }
+
+done:
     p->frames_drawn += 1;
 }
 
@@ -2996,6 +3353,7 @@ void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame,
     struct mp_rect target_rc = {0, 0, fbo.tex->params.w, fbo.tex->params.h};
 
     p->broken_frame = false;
+    p->incomplete_frame = false;
 
     bool has_frame = !!frame->current;
 
@@ -3022,6 +3380,10 @@ void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame,
         has_frame = false;
     }
 
+    // Compile new shaders in the background, and skip passes needing them.
+    // Dumb mode uses only a few simple shaders, so it needs no fallback.
+    gl_sc_set_async(p->sc, p->opts.async_shaders && !p->dumb_mode);
+
     if (has_frame) {
         bool interpolate = p->opts.interpolation && frame->display_synced &&
                            (p->frames_drawn || !frame->still);
@@ -3037,10 +3399,16 @@ void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame,
             bool is_new = frame->frame_id != p->image.id;
 
             // Redrawing a frame might update subtitles.
-            if (frame->still && p->opts.blend_subs)
+            bool redraw_subs = frame->still && p->opts.blend_subs;
+            if (redraw_subs)
                 is_new = true;
 
-            if (is_new || !p->output_tex_valid) {
+            // Whether the same frame is likely to be drawn again: repeated
+            // on the next vsyncs, or redrawn for OSD changes while paused.
+            bool repeated = (frame->num_vsyncs > 1 && frame->display_synced) ||
+                            ((frame->still || frame->redraw) && !redraw_subs);
+
+            if (is_new || !p->output_tex_valid || p->output_tex_interp) {
                 p->output_tex_valid = false;
 
                 pass_info_reset(p, !is_new);
@@ -3050,15 +3418,15 @@ void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame,
                 // For the non-interpolation case, we draw to a single "cache"
                 // texture to speed up subsequent re-draws (if any exist)
                 struct ra_fbo dest_fbo = fbo;
-                if (frame->num_vsyncs > 1 && frame->display_synced &&
-                    !p->dumb_mode && (p->ra->caps & RA_CAP_BLIT))
+                if (repeated && !p->dumb_mode && (p->ra->caps & RA_CAP_BLIT))
                 {
                     bool r = ra_tex_resize(p->ra, p->log, &p->output_tex,
                                            fbo.tex->params.w, fbo.tex->params.h,
-                                           p->fbo_format);
+                                           output_fbo_format(p));
                     if (r) {
                         dest_fbo = (struct ra_fbo) { p->output_tex };
                         p->output_tex_valid = true;
+                        p->output_tex_interp = false;
                     }
                 }
                 pass_draw_to_screen(p, dest_fbo);
@@ -3068,22 +3436,36 @@ void gl_video_render_frame(struct gl_video *p, struct vo_frame *frame,
             if (p->output_tex_valid) {
                 pass_info_reset(p, true);
                 pass_describe(p, "redraw cached frame");
-                struct mp_rect src = p->dst_rect;
-                struct mp_rect dst = src;
-                if (fbo.flip) {
-                    dst.y0 = fbo.tex->params.h - src.y0;
-                    dst.y1 = fbo.tex->params.h - src.y1;
-                }
-                timer_pool_start(p->blit_timer);
-                p->ra->fns->blit(p->ra, fbo.tex, p->output_tex, &dst, &src);
-                timer_pool_stop(p->blit_timer);
-                pass_record(p, timer_pool_measure(p->blit_timer));
+                pass_redraw_output_tex(p, fbo);
             }
         }
     }
 
 done:
 
+    gl_sc_set_async(p->sc, false);
+
+    if (gl_sc_check_skipped(p->sc)) {
+        // Some passes were not rendered. Render the frame again with the
+        // simple dumb mode pipeline, which is better than showing garbage.
+        MP_VERBOSE(p, "Shaders not ready yet, using fallback rendering.\n");
+        p->incomplete_frame = true;
+        p->output_tex_valid = false;
+        p->is_interpolated = false;
+        struct m_color c = p->clear_color;
+        float color[4] = {c.r / 255.0, c.g / 255.0, c.b / 255.0, c.a / 255.0};
+        p->ra->fns->clear(p->ra, fbo.tex, color, &target_rc);
+        p->dumb_mode = true;
+        pass_info_reset(p, false);
+        if (pass_render_frame(p, frame->current, frame->frame_id))
+            pass_draw_to_screen(p, fbo);
+        p->dumb_mode = false;
+    }
+
+    // Don't reuse a frame rendered without the final shaders or 3DLUT.
+    if (p->incomplete_frame)
+        p->output_tex_valid = false;
+
     debug_check_gl(p, "after video rendering");
 
     if (p->osd) {
@@ -3136,22 +3518,46 @@ void gl_video_resize(struct gl_video *p,
         osd_res_equals(p->osd_rect, *osd))
         return;
 
+    // Interpolation surfaces contain the cropped video, and possibly
+    // subtitles. In output resolution mode they're also scaled to the video
+    // rectangle, but for small size changes (like when interactively resizing
+    // the window) it's better to keep blending the old surfaces for a few
+    // frames than to drop the whole queue.
+    int old_w = p->dst_rect.x1 - p->dst_rect.x0,
+        old_h = p->dst_rect.y1 - p->dst_rect.y0,
+        new_w = dst->x1 - dst->x0,
+        new_h = dst->y1 - dst->y0;
+    bool size_changed = abs(new_w - old_w) * 8 > old_w ||
+                        abs(new_h - old_h) * 8 > old_h;
+    bool reset = !mp_rect_equals(&p->src_rect, src) ||
+                 (p->opts.blend_subs && !osd_res_equals(p->osd_rect, *osd)) ||
+                 (!p->surfaces_source && size_changed);
+
     p->src_rect = *src;
     p->dst_rect = *dst;
     p->osd_rect = *osd;
 
-    gl_video_reset_surfaces(p);
+    if (reset) {
+        gl_video_reset_surfaces(p);
+    } else {
+        p->output_tex_valid = false;
+    }
 
     if (p->osd)
         mpgl_osd_resize(p->osd, p->osd_rect, p->image_params.stereo_out);
 }
 
-static void frame_perf_data(struct pass_info pass[], struct mp_frame_perf *out)
+static void frame_perf_data(struct pass_info pass[], struct perf_samples *total,
+                            struct mp_frame_perf *out)
 {
+    out->total = perf_samples_measure(total);
+    mp_pass_perf_percentiles(&out->total);
+
     for (int i = 0; i < VO_PASS_PERF_MAX; i++) {
         if (!pass[i].desc.len)
             break;
         out->perf[out->count] = pass[i].perf;
+        mp_pass_perf_percentiles(&out->perf[out->count]);
         out->desc[out->count] = pass[i].desc.start;
         out->count++;
     }
@@ -3160,8 +3566,14 @@ static void frame_perf_data(struct pass_info pass[], struct mp_frame_perf *out)
 void gl_video_perfdata(struct gl_video *p, struct voctrl_performance_data *out)
 {
     *out = (struct voctrl_performance_data){0};
-    frame_perf_data(p->pass_fresh,  &out->fresh);
-    frame_perf_data(p->pass_redraw, &out->redraw);
+    frame_perf_data(p->pass_fresh,  &p->frame_fresh,  &out->fresh);
+    frame_perf_data(p->pass_redraw, &p->frame_redraw, &out->redraw);
+}
+
+void gl_video_shader_cache_stats(struct gl_video *p,
+                                 struct voctrl_shader_cache_stats *out)
+{
+    gl_sc_get_stats(p->sc, out);
 }
 
 // This assumes nv12, with textures set to GL_NEAREST filtering.
@@ -3321,6 +3733,42 @@ static bool test_fbo(struct gl_video *p, const struct ra_format *fmt)
     return success;
 }
 
+// Format for textures which only hold the final, dithered output. With
+// --fbo-precision=reduced, this is the smallest format that still represents
+// it exactly.
+static const struct ra_format *output_fbo_format(struct gl_video *p)
+{
+    if (!p->opts.fbo_precision)
+        return p->fbo_format;
+
+    int depth = p->fb_depth > 0 ? p->fb_depth : 8;
+    if (p->opts.dither_depth > 0 && p->opts.dither_algo != DITHER_NONE)
+        depth = MPMAX(depth, p->opts.dither_depth);
+    int alpha = p->has_alpha && p->opts.alpha_mode == ALPHA_YES ? 8 : 0;
+
+    int key = (depth << 8) | alpha | 1;
+    if (p->out_fbo_key == key)
+        return p->out_fbo_format;
+    p->out_fbo_key = key;
+    p->out_fbo_format = p->fbo_format;
+
+    for (int n = 0; n < p->ra->num_formats; n++) {
+        const struct ra_format *fmt = p->ra->formats[n];
+        if (fmt->ctype != RA_CTYPE_UNORM || fmt->num_components != 4 ||
+            !fmt->renderable || !fmt->linear_filter ||
+            fmt->pixel_size >= p->out_fbo_format->pixel_size)
+            continue;
+        bool ok = fmt->component_depth[3] >= alpha;
+        for (int c = 0; c < 3; c++)
+            ok &= fmt->component_depth[c] >= depth;
+        if (ok && test_fbo(p, fmt))
+            p->out_fbo_format = fmt;
+    }
+
+    MP_VERBOSE(p, "Using FBO format %s for output.\n", p->out_fbo_format->name);
+    return p->out_fbo_format;
+}
+
 // Return whether dumb-mode can be used without disabling any features.
 // Essentially, vo_opengl with mostly default settings will return true.
 static bool check_dumb_mode(struct gl_video *p)
@@ -3371,6 +3819,7 @@ static void check_gl_features(struct gl_video *p)
                           ? user_fbo_fmts : auto_fbo_fmts;
     bool have_fbo = false;
     p->fbo_format = NULL;
+    p->out_fbo_key = 0;
     for (int n = 0; fbo_fmts[n]; n++) {
         const char *fmt = fbo_fmts[n];
         const struct ra_format *f = ra_find_named_format(p->ra, fmt);
@@ -3543,6 +3992,13 @@ bool gl_video_showing_interpolated_frame(struct gl_video *p)
     return p->is_interpolated;
 }
 
+// Whether the last rendered frame used the fallback path, because shaders
+// were still being compiled (--gpu-async-shaders). The caller should redraw.
+bool gl_video_frame_incomplete(struct gl_video *p)
+{
+    return p->incomplete_frame;
+}
+
 static bool is_imgfmt_desc_supported(struct gl_video *p,
                                      const struct ra_imgfmt_desc *desc)
 {
@@ -3599,6 +4055,7 @@ struct gl_video *gl_video_init(struct ra *ra, struct mp_log *log,
         .global = g,
         .log = log,
         .sc = gl_sc_create(ra, g, log),
+        .lut_cache = mp_lut_cache_create(p),
         .video_eq = mp_csp_equalizer_create(p, g),
         .opts_cache = m_config_cache_alloc(p, g, &gl_video_conf),
     };
@@ -3667,6 +4124,7 @@ static void reinit_from_options(struct gl_video *p)
     check_gl_features(p);
     uninit_rendering(p);
     gl_sc_set_cache_dir(p->sc, p->opts.shader_cache_dir);
+    gl_sc_set_cache_size(p->sc, p->opts.shader_cache_size);
     p->ra->use_pbo = p->opts.pbo;
     gl_video_setup_hooks(p);
     reinit_osd(p);
@@ -80,6 +80,12 @@ enum alpha_mode {
     ALPHA_BLEND_TILES,
 };
 
+enum interpolation_res {
+    INTERPOLATION_RES_OUTPUT = 0,
+    INTERPOLATION_RES_SOURCE,
+    INTERPOLATION_RES_AUTO,
+};
+
 enum blend_subs_mode {
     BLEND_SUBS_NO = 0,
     BLEND_SUBS_YES,
@@ -109,6 +115,7 @@ struct gl_video_opts {
     int target_brightness;
     int tone_mapping;
     int compute_hdr_peak;
+    float hdr_scene_threshold;
     float tone_mapping_param;
     float tone_mapping_desat;
     int gamut_warning;
@@ -125,11 +132,13 @@ struct gl_video_opts {
     int temporal_dither;
     int temporal_dither_period;
     char *fbo_format;
+    int fbo_precision;
     int alpha_mode;
     int use_rectangle;
     struct m_color background;
     int interpolation;
     float interpolation_threshold;
+    int interpolation_res;
     int blend_subs;
     char **user_shaders;
     int deband;
@@ -139,6 +148,8 @@ struct gl_video_opts {
     struct mp_icc_opts *icc_opts;
     int early_flush;
     char *shader_cache_dir;
+    int shader_cache_size;
+    int async_shaders;
 };
 
 extern const struct m_sub_options gl_video_conf;
@@ -160,6 +171,8 @@ void gl_video_resize(struct gl_video *p,
                      struct mp_osd_res *osd);
 void gl_video_set_fb_depth(struct gl_video *p, int fb_depth);
 void gl_video_perfdata(struct gl_video *p, struct voctrl_performance_data *out);
+void gl_video_shader_cache_stats(struct gl_video *p,
+                                 struct voctrl_shader_cache_stats *out);
 void gl_video_set_clear_color(struct gl_video *p, struct m_color color);
 void gl_video_set_osd_pts(struct gl_video *p, double pts);
 bool gl_video_check_osd_change(struct gl_video *p, struct mp_osd_res *osd,
@@ -175,6 +188,7 @@ struct mp_colorspace gl_video_get_output_colorspace(struct gl_video *p);
 
 void gl_video_reset(struct gl_video *p);
 bool gl_video_showing_interpolated_frame(struct gl_video *p);
+bool gl_video_frame_incomplete(struct gl_video *p);
 
 struct ra_hwdec;
 void gl_video_set_hwdec(struct gl_video *p, struct ra_hwdec *hwdec);
@@ -557,9 +557,11 @@ void pass_inverse_ootf(struct gl_shader_cache *sc, enum mp_csp_light light, floa
     GLSLF("color.rgb *= vec3(1.0/%f);\n", peak);
 }
 
-// Tone map from a known peak brightness to the range [0,1]. If ref_peak
-// is 0, we will use peak detection instead
+// Tone map from a known peak brightness to the range [0,1]. If detect_peak
+// is true, ref_peak is only used until the first frame was measured. A
+// scene_threshold of 0 disables scene change detection.
 static void pass_tone_map(struct gl_shader_cache *sc, float ref_peak,
+                          bool detect_peak, float scene_threshold,
                           enum tone_mapping algo, float param, float desat)
 {
     GLSLF("// HDR tone mapping\n");
@@ -578,38 +580,67 @@ static void pass_tone_map(struct gl_shader_cache *sc, float ref_peak,
         GLSL(sig = mix(sig, luma, coeff);) // also make sure to update `sig`
     }
 
-    if (!ref_peak) {
-        // For performance, we want to do as few atomic operations on global
-        // memory as possible, so use an atomic in shmem for the work group.
-        // We also want slightly more stable values, so use the group average
-        // instead of the group max
-        GLSLHF("shared uint group_sum = 0;\n");
-        GLSLF("atomicAdd(group_sum, uint(sig * %f));\n", MP_REF_WHITE);
+    GLSLF("float sig_peak = %f;\n", ref_peak);
 
-        // Have one thread in each work group update the frame maximum
-        GLSL(memoryBarrierBuffer();)
-        GLSL(barrier();)
+    if (detect_peak) {
+        // For performance, we want to do as few atomic operations on global
+        // memory as possible, so reduce in shmem for the work group first,
+        // and only have one thread per group touch the SSBO.
+        GLSLH(shared uint wg_sum;)
         GLSL(if (gl_LocalInvocationIndex == 0))
-            GLSL(atomicMax(frame_max[index], group_sum /
-                 (gl_WorkGroupSize.x * gl_WorkGroupSize.y));)
+            GLSL(wg_sum = 0u;)
+        GLSL(barrier();)
+        GLSLF("atomicAdd(wg_sum, uint(sig * %f));\n", MP_REF_WHITE);
 
-        // Finally, have one thread per invocation update the total maximum
-        // and advance the index
-        GLSL(memoryBarrierBuffer();)
+        // Use the group average even for the frame maximum, which makes the
+        // values slightly more stable and ignores tiny super-highlights.
+        GLSL(memoryBarrierShared();)
         GLSL(barrier();)
-        GLSL(if (gl_GlobalInvocationID == ivec3(0)) {) // do this once per invocation
-            GLSLF("uint next = (index + 1) %% %d;\n", PEAK_DETECT_FRAMES+1);
-            GLSLF("sig_peak_raw = sig_peak_raw + frame_max[index] - frame_max[next];\n");
-            GLSLF("frame_max[next] = %d;\n", (int)MP_REF_WHITE);
-            GLSL(index = next;)
+        GLSL(uint num_wg = gl_NumWorkGroups.x * gl_NumWorkGroups.y;)
+        GLSL(if (gl_LocalInvocationIndex == 0) {)
+            GLSL(uint wg_avg = wg_sum / (gl_WorkGroupSize.x * gl_WorkGroupSize.y);)
+            GLSL(atomicMax(frame_max[frame_idx], wg_avg);)
+            GLSL(atomicAdd(frame_avg[frame_idx], wg_avg);)
         GLSL(})
 
+        // Use the state accumulated over the previous frames. This is racy
+        // against the update below, but the values move very slowly.
+        GLSL(if (frame_num > 0u))
+            GLSLF("sig_peak = max(1.0, %f * float(total_max) / float(frame_num));\n",
+                  1.0 / MP_REF_WHITE);
+
+        // The last work group to finish updates the global state
         GLSL(memoryBarrierBuffer();)
-        GLSL(barrier();)
-        GLSLF("float sig_peak = 1.0/%f * float(sig_peak_raw);\n",
-              MP_REF_WHITE * PEAK_DETECT_FRAMES);
-    } else {
-        GLSLHF("const float sig_peak = %f;\n", ref_peak);
+        GLSL(if (gl_LocalInvocationIndex == 0 && atomicAdd(counter, 1u) == num_wg - 1u) {)
+            GLSL(counter = 0u;)
+            GLSL(uint cur_max = frame_max[frame_idx];)
+            GLSL(uint cur_avg = frame_avg[frame_idx] / num_wg;)
+            GLSL(frame_avg[frame_idx] = cur_avg;)
+
+            // On a scene change, forget about the previous frames, so the
+            // new scene doesn't get the old scene's brightness
+            if (scene_threshold > 0) {
+                GLSL(int diff = int(frame_num * cur_avg) - int(total_avg);)
+                GLSLF("if (frame_num > 0u && abs(diff) > int(frame_num) * %d) {\n",
+                      (int)(scene_threshold * MP_REF_WHITE));
+                    GLSL(frame_num = 0u;)
+                    GLSL(total_max = total_avg = 0u;)
+                    GLSLF("for (uint i = 0u; i < %du; i++)\n", PEAK_DETECT_FRAMES+1);
+                        GLSL(frame_max[i] = frame_avg[i] = 0u;)
+                    GLSL(frame_max[frame_idx] = cur_max;)
+                    GLSL(frame_avg[frame_idx] = cur_avg;)
+                GLSL(})
+            }
+
+            // Add the current frame, then drop and reset the oldest one
+            GLSLF("uint next = (frame_idx + 1u) %% %du;\n", PEAK_DETECT_FRAMES+1);
+            GLSL(total_max += cur_max - frame_max[next];)
+            GLSL(total_avg += cur_avg - frame_avg[next];)
+            GLSL(frame_max[next] = frame_avg[next] = 0u;)
+            GLSL(frame_idx = next;)
+            GLSLF("frame_num = min(frame_num + 1u, %du);\n", PEAK_DETECT_FRAMES);
+            GLSL(memoryBarrierBuffer();)
+        GLSL(})
     }
 
     GLSL(float sig_orig = sig;)
@@ -677,12 +708,12 @@ static void pass_tone_map(struct gl_shader_cache *sc, float ref_peak,
 // linearized (e.g. for linear-scaling). If `detect_peak` is true, we will
 // detect the peak instead of relying on metadata. Note that this requires
 // the caller to have already bound the appropriate SSBO and set up the
-// compute shader metadata
+// compute shader metadata. scene_threshold is passed to pass_tone_map().
 void pass_color_map(struct gl_shader_cache *sc,
                     struct mp_colorspace src, struct mp_colorspace dst,
                     enum tone_mapping algo, float tone_mapping_param,
                     float tone_mapping_desat, bool detect_peak,
-                    bool gamut_warning, bool is_linear)
+                    float scene_threshold, bool gamut_warning, bool is_linear)
 {
     GLSLF("// color mapping\n");
 
@@ -694,9 +725,9 @@ void pass_color_map(struct gl_shader_cache *sc,
     // Some operations need access to the video's luma coefficients, so make
     // them available
     float rgb2xyz[3][3];
-    mp_get_rgb2xyz_matrix(mp_get_csp_primaries(src.primaries), rgb2xyz);
+    mp_get_prim_rgb2xyz_matrix(src.primaries, rgb2xyz);
     gl_sc_uniform_vec3(sc, "src_luma", rgb2xyz[1]);
-    mp_get_rgb2xyz_matrix(mp_get_csp_primaries(dst.primaries), rgb2xyz);
+    mp_get_prim_rgb2xyz_matrix(dst.primaries, rgb2xyz);
     gl_sc_uniform_vec3(sc, "dst_luma", rgb2xyz[1]);
 
     // All operations from here on require linear light as a starting point,
@@ -726,10 +757,9 @@ void pass_color_map(struct gl_shader_cache *sc,
 
     // Adapt to the right colorspace if necessary
     if (src.primaries != dst.primaries) {
-        struct mp_csp_primaries csp_src = mp_get_csp_primaries(src.primaries),
-                                csp_dst = mp_get_csp_primaries(dst.primaries);
-        float m[3][3] = {{0}};
-        mp_get_cms_matrix(csp_src, csp_dst, MP_INTENT_RELATIVE_COLORIMETRIC, m);
+        float m[3][3];
+        mp_get_prim_cms_matrix(src.primaries, dst.primaries,
+                               MP_INTENT_RELATIVE_COLORIMETRIC, m);
         gl_sc_uniform_mat3(sc, "cms_matrix", true, &m[0][0]);
         GLSL(color.rgb = cms_matrix * color.rgb;)
         // Since this can reduce the gamut, figure out by how much
@@ -740,7 +770,7 @@ void pass_color_map(struct gl_shader_cache *sc,
     // Tone map to prevent clipping when the source signal peak exceeds the
     // encodable range or we've reduced the gamut
     if (ref_peak > 1) {
-        pass_tone_map(sc, detect_peak ? 0 : ref_peak, algo,
+        pass_tone_map(sc, ref_peak, detect_peak, scene_threshold, algo,
                       tone_mapping_param, tone_mapping_desat);
     }
 
@@ -870,3 +900,17 @@ void pass_sample_unsharp(struct gl_shader_cache *sc, float param) {
     GLSLF("color = p + t * %f;\n", param);
     GLSLF("}\n");
 }
+
+// Simple intra-field deinterlacing: keep the lines of one field, and
+// interpolate the lines of the other field from their neighbours.
+void pass_sample_field_deint(struct gl_shader_cache *sc, bool top_field)
+{
+    GLSLF("{\n");
+    GLSL(float row = floor(HOOKED_pos.y * HOOKED_size.y);)
+    GLSLF("if (mod(row, 2.0) == %s) {\n", top_field ? "1.0" : "0.0");
+    GLSL(color = 0.5 * (HOOKED_texOff(vec2(0, -1)) + HOOKED_texOff(vec2(0, 1)));)
+    GLSL(} else {)
+    GLSL(color = HOOKED_tex(HOOKED_pos);)
+    GLSL(})
+    GLSLF("}\n");
+}
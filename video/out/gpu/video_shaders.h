@@ -46,11 +46,12 @@ void pass_color_map(struct gl_shader_cache *sc,
                     struct mp_colorspace src, struct mp_colorspace dst,
                     enum tone_mapping algo, float tone_mapping_param,
                     float tone_mapping_desat, bool use_detected_peak,
-                    bool gamut_warning, bool is_linear);
+                    float scene_threshold, bool gamut_warning, bool is_linear);
 
 void pass_sample_deband(struct gl_shader_cache *sc, struct deband_opts *opts,
                         AVLFG *lfg, enum mp_csp_trc trc);
 
 void pass_sample_unsharp(struct gl_shader_cache *sc, float param);
+void pass_sample_field_deint(struct gl_shader_cache *sc, bool top_field);
 
 #endif
@@ -89,6 +89,7 @@ struct priv {
     struct ra_swapchain_fns fns;
     GLuint main_fb;
     struct ra_tex *wrapped_fb; // corresponds to main_fb
+    bool skip_swap; // start_frame callback skipped the current frame
     // for debugging:
     int frames_rendered;
     unsigned int prev_sgi_sync_count;
@@ -181,6 +182,8 @@ bool ra_gl_ctx_init(struct ra_ctx *ctx, GL *gl, struct ra_gl_ctx_params params)
             p->fns.submit_frame = ext->submit_frame;
         if (ext->swap_buffers)
             p->fns.swap_buffers = ext->swap_buffers;
+        if (ext->get_vsync)
+            p->fns.get_vsync = ext->get_vsync;
     }
 
     if (!gl->version && !gl->es)
@@ -268,6 +271,10 @@ struct mp_image *ra_gl_ctx_screenshot(struct ra_swapchain *sw)
 bool ra_gl_ctx_start_frame(struct ra_swapchain *sw, struct ra_fbo *out_fbo)
 {
     struct priv *p = sw->priv;
+    if (p->params.start_frame && !p->params.start_frame(sw->ctx)) {
+        p->skip_swap = true;
+        return false;
+    }
     out_fbo->tex = p->wrapped_fb;
     out_fbo->flip = !p->params.flipped; // OpenGL FBs are normally flipped
     return true;
@@ -319,6 +326,11 @@ void ra_gl_ctx_swap_buffers(struct ra_swapchain *sw)
     struct priv *p = sw->priv;
     GL *gl = p->gl;
 
+    if (p->skip_swap) {
+        p->skip_swap = false;
+        return;
+    }
+
     p->params.swap_buffers(sw->ctx);
     p->frames_rendered++;
 
@@ -346,10 +358,18 @@ void ra_gl_ctx_swap_buffers(struct ra_swapchain *sw)
     }
 }
 
+void ra_gl_ctx_get_vsync(struct ra_swapchain *sw, struct vo_vsync_info *info)
+{
+    struct priv *p = sw->priv;
+    if (p->params.get_vsync)
+        p->params.get_vsync(sw->ctx, info);
+}
+
 static const struct ra_swapchain_fns ra_gl_swapchain_fns = {
     .color_depth   = ra_gl_ctx_color_depth,
     .screenshot    = ra_gl_ctx_screenshot,
     .start_frame   = ra_gl_ctx_start_frame,
     .submit_frame  = ra_gl_ctx_submit_frame,
     .swap_buffers  = ra_gl_ctx_swap_buffers,
+    .get_vsync     = ra_gl_ctx_get_vsync,
 };
@@ -23,6 +23,13 @@ struct ra_gl_ctx_params {
     // function or if you override it yourself.
     void (*swap_buffers)(struct ra_ctx *ctx);
 
+    // See ra_swapchain_fns.get_vsync. Optional.
+    void (*get_vsync)(struct ra_ctx *ctx, struct vo_vsync_info *info);
+
+    // Called before rendering a frame. If this returns false, the frame is
+    // skipped and swap_buffers is not called for it. Optional.
+    bool (*start_frame)(struct ra_ctx *ctx);
+
     // Set to false if the implementation follows normal GL semantics, which is
     // upside down. Set to true if it does *not*, i.e. if rendering is right
     // side up
@@ -54,3 +61,4 @@ struct mp_image *ra_gl_ctx_screenshot(struct ra_swapchain *sw);
 bool ra_gl_ctx_start_frame(struct ra_swapchain *sw, struct ra_fbo *out_fbo);
 bool ra_gl_ctx_submit_frame(struct ra_swapchain *sw, const struct vo_frame *frame);
 void ra_gl_ctx_swap_buffers(struct ra_swapchain *sw);
+void ra_gl_ctx_get_vsync(struct ra_swapchain *sw, struct vo_vsync_info *info);
@@ -31,6 +31,7 @@
 #include "libmpv/opengl_cb.h"
 #include "video/out/drm_common.h"
 #include "common/common.h"
+#include "osdep/timer.h"
 
 #include "egl_helpers.h"
 #include "common.h"
@@ -45,12 +46,23 @@ struct framebuffer
     uint32_t id;
 };
 
+struct queued_frame
+{
+    struct gbm_bo *bo;
+    struct framebuffer *fb;
+    drmModeAtomicReq *request;
+};
+
 struct gbm
 {
     struct gbm_surface *surface;
     struct gbm_device *device;
+    // Currently on screen.
     struct gbm_bo *bo;
-    struct gbm_bo *next_bo;
+    // Rendered frames waiting for scanout. queue[0] is the one being flipped
+    // (waiting_for_flip is set whenever the queue is not empty).
+    struct queued_frame queue[DRM_MAX_QUEUED_FRAMES];
+    int num_queued;
 };
 
 struct egl
@@ -74,6 +86,12 @@ struct priv {
     bool active;
     bool waiting_for_flip;
 
+    // Presentation feedback from the page flip events.
+    bool monotonic_timestamps;
+    int64_t flip_time; // mp_time_us() of the last flip, 0 if none yet
+    unsigned int flip_sequence;
+    int64_t skipped_vsyncs;
+
     bool vt_switcher_active;
     struct vt_switcher vt_switcher;
 
@@ -164,6 +182,98 @@ static void update_framebuffer_from_bo(struct ra_ctx *ctx, struct gbm_bo *bo)
     p->fb = fb;
 }
 
+static void queue_flip(struct ra_ctx *ctx);
+
+// queue[0] was flipped (or failed to); make it the frame on screen.
+static void frame_displayed(struct ra_ctx *ctx)
+{
+    struct priv *p = ctx->priv;
+    assert(p->gbm.num_queued > 0);
+
+    struct queued_frame frame = p->gbm.queue[0];
+    MP_TARRAY_REMOVE_AT(p->gbm.queue, p->gbm.num_queued, 0);
+    p->waiting_for_flip = false;
+
+    if (frame.request)
+        drmModeAtomicFree(frame.request);
+    if (p->gbm.bo)
+        gbm_surface_release_buffer(p->gbm.surface, p->gbm.bo);
+    p->gbm.bo = frame.bo;
+
+    if (p->gbm.num_queued)
+        queue_flip(ctx);
+}
+
+static void page_flipped(int fd, unsigned int frame, unsigned int sec,
+                         unsigned int usec, void *data)
+{
+    struct ra_ctx *ctx = data;
+    struct priv *p = ctx->priv;
+
+    if (p->monotonic_timestamps) {
+        if (p->flip_time && frame > p->flip_sequence + 1)
+            p->skipped_vsyncs += frame - p->flip_sequence - 1;
+        p->flip_time = mp_time_from_raw_us(sec * (uint64_t)1000000 + usec);
+        p->flip_sequence = frame;
+    }
+
+    frame_displayed(ctx);
+}
+
+// Start flipping to queue[0]. Only one flip can be pending at a time, so
+// the following frames are flipped from the page flip event.
+static void queue_flip(struct ra_ctx *ctx)
+{
+    struct priv *p = ctx->priv;
+    struct drm_atomic_context *atomic_ctx = p->kms->atomic_context;
+    struct queued_frame *frame = &p->gbm.queue[0];
+    int ret;
+
+    assert(!p->waiting_for_flip && p->gbm.num_queued > 0);
+
+    if (atomic_ctx) {
+        drm_object_set_property(frame->request, atomic_ctx->primary_plane, "FB_ID", frame->fb->id);
+        drm_object_set_property(frame->request, atomic_ctx->primary_plane, "CRTC_ID", atomic_ctx->crtc->id);
+        drm_object_set_property(frame->request, atomic_ctx->primary_plane, "ZPOS", 1);
+
+        ret = drmModeAtomicCommit(p->kms->fd, frame->request,
+                                  DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, ctx);
+        if (ret)
+            MP_WARN(ctx->vo, "Failed to commit atomic request (%d)\n", ret);
+    } else {
+        ret = drmModePageFlip(p->kms->fd, p->kms->crtc_id, frame->fb->id,
+                              DRM_MODE_PAGE_FLIP_EVENT, ctx);
+        if (ret)
+            MP_WARN(ctx->vo, "Failed to queue page flip: %s\n", mp_strerror(errno));
+    }
+
+    if (ret) {
+        // There will be no event; drop the frame instead of stalling the queue.
+        frame_displayed(ctx);
+        return;
+    }
+    p->waiting_for_flip = true;
+}
+
+static void wait_for_flip(struct ra_ctx *ctx)
+{
+    struct priv *p = ctx->priv;
+
+    const int timeout_ms = 3000;
+    struct pollfd fds[1] = { { .events = POLLIN, .fd = p->kms->fd } };
+    while (poll(fds, 1, timeout_ms) < 0 && errno == EINTR) {}
+    if (fds[0].revents & POLLIN) {
+        int ret = drmHandleEvent(p->kms->fd, &p->ev);
+        if (ret == 0)
+            return;
+        MP_ERR(ctx->vo, "drmHandleEvent failed: %i\n", ret);
+    } else {
+        MP_WARN(ctx->vo, "Timeout waiting for page flip.\n");
+    }
+    // Don't wait forever for an event that may never come.
+    frame_displayed(ctx);
+}
+
 static bool crtc_setup(struct ra_ctx *ctx)
 {
     struct priv *p = ctx->priv;
@@ -185,14 +295,9 @@ static void crtc_release(struct ra_ctx *ctx)
         return;
     p->active = false;
 
-    // wait for current page flip
-    while (p->waiting_for_flip) {
-        int ret = drmHandleEvent(p->kms->fd, &p->ev);
-        if (ret) {
-            MP_ERR(ctx->vo, "drmHandleEvent failed: %i\n", ret);
-            break;
-        }
-    }
+    // wait until all queued frames were flipped
+    while (p->waiting_for_flip)
+        wait_for_flip(ctx);
 
     if (p->old_crtc) {
         drmModeSetCrtc(p->kms->fd,
@@ -237,70 +342,88 @@ static void acquire_vt(void *data)
     crtc_setup(ctx);
 }
 
-static bool drm_atomic_egl_start_frame(struct ra_swapchain *sw, struct ra_fbo *out_fbo)
+static bool drm_egl_start_frame(struct ra_swapchain *sw, struct ra_fbo *out_fbo)
 {
     struct priv *p = sw->ctx->priv;
-    if (p->kms->atomic_context) {
-        p->kms->atomic_context->request = drmModeAtomicAlloc();
-        p->drm_params.atomic_request = p->kms->atomic_context->request;
-        return ra_gl_ctx_start_frame(sw, out_fbo);
+    struct drm_atomic_context *atomic_ctx = p->kms->atomic_context;
+    if (atomic_ctx) {
+        if (!atomic_ctx->request)
+            atomic_ctx->request = drmModeAtomicAlloc();
+        p->drm_params.atomic_request = atomic_ctx->request;
     }
-    return false;
+    return ra_gl_ctx_start_frame(sw, out_fbo);
 }
 
-static const struct ra_swapchain_fns drm_atomic_swapchain = {
-    .start_frame   = drm_atomic_egl_start_frame,
+// The flips are paced by swap_buffers() itself, so the swapchain depth
+// simulation with fences is not needed.
+static const struct ra_swapchain_fns drm_egl_swapchain = {
+    .start_frame   = drm_egl_start_frame,
 };
 
 static void drm_egl_swap_buffers(struct ra_ctx *ctx)
 {
     struct priv *p = ctx->priv;
     struct drm_atomic_context *atomic_ctx = p->kms->atomic_context;
-    int ret;
 
     eglSwapBuffers(p->egl.display, p->egl.surface);
-    p->gbm.next_bo = gbm_surface_lock_front_buffer(p->gbm.surface);
-    p->waiting_for_flip = true;
-    update_framebuffer_from_bo(ctx, p->gbm.next_bo);
 
+    struct queued_frame frame = {
+        .bo = gbm_surface_lock_front_buffer(p->gbm.surface),
+    };
     if (atomic_ctx) {
-        drm_object_set_property(atomic_ctx->request, atomic_ctx->primary_plane, "FB_ID", p->fb->id);
-        drm_object_set_property(atomic_ctx->request, atomic_ctx->primary_plane, "CRTC_ID", atomic_ctx->crtc->id);
-        drm_object_set_property(atomic_ctx->request, atomic_ctx->primary_plane, "ZPOS", 1);
-
-        ret = drmModeAtomicCommit(p->kms->fd, atomic_ctx->request,
-                                  DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, NULL);
-        if (ret)
-            MP_WARN(ctx->vo, "Failed to commit atomic request (%d)\n", ret);
-    } else {
-        ret = drmModePageFlip(p->kms->fd, p->kms->crtc_id, p->fb->id,
-                                  DRM_MODE_PAGE_FLIP_EVENT, p);
-        if (ret) {
-            MP_WARN(ctx->vo, "Failed to queue page flip: %s\n", mp_strerror(errno));
-        }
+        frame.request = atomic_ctx->request;
+        p->drm_params.atomic_request = atomic_ctx->request = NULL;
     }
-
-    // poll page flip finish event
-    const int timeout_ms = 3000;
-    struct pollfd fds[1] = { { .events = POLLIN, .fd = p->kms->fd } };
-    poll(fds, 1, timeout_ms);
-    if (fds[0].revents & POLLIN) {
-        ret = drmHandleEvent(p->kms->fd, &p->ev);
-        if (ret != 0) {
-            MP_ERR(ctx->vo, "drmHandleEvent failed: %i\n", ret);
-            p->waiting_for_flip = false;
-            return;
-        }
+    if (!frame.bo) {
+        MP_ERR(ctx->vo, "Failed to lock GBM surface.\n");
+        if (frame.request)
+            drmModeAtomicFree(frame.request);
+        return;
     }
-    p->waiting_for_flip = false;
+    update_framebuffer_from_bo(ctx, frame.bo);
+    frame.fb = p->fb;
+
+    assert(p->gbm.num_queued < DRM_MAX_QUEUED_FRAMES);
+    p->gbm.queue[p->gbm.num_queued++] = frame;
+    if (!p->waiting_for_flip)
+        queue_flip(ctx);
+
+    // Render ahead by up to swapchain_depth frames. Also wait if GBM has no
+    // free buffer left for the next frame.
+    int depth = MPCLAMP(ctx->opts.swapchain_depth, 1, DRM_MAX_QUEUED_FRAMES);
+    while (p->waiting_for_flip && (p->gbm.num_queued >= depth ||
+                                   !gbm_surface_has_free_buffers(p->gbm.surface)))
+        wait_for_flip(ctx);
+}
 
-    if (atomic_ctx) {
-        drmModeAtomicFree(atomic_ctx->request);
-        p->drm_params.atomic_request = atomic_ctx->request = NULL;
+static void drm_egl_get_vsync(struct ra_ctx *ctx, struct vo_vsync_info *info)
+{
+    struct priv *p = ctx->priv;
+    if (!p->flip_time)
+        return;
+
+    info->skipped_vsyncs = p->skipped_vsyncs;
+    p->skipped_vsyncs = 0;
+
+    double fps = kms_get_display_fps(p->kms);
+    if (fps <= 0)
+        return;
+    info->vsync_duration = 1e6 / fps;
+
+    if (!p->gbm.num_queued) {
+        info->last_queue_display_time = p->flip_time;
+        return;
     }
 
-    gbm_surface_release_buffer(p->gbm.surface, p->gbm.bo);
-    p->gbm.bo = p->gbm.next_bo;
+    // Each queued frame is flipped on one of the following vblanks. If the
+    // last flip was a while ago (e.g. after pausing), go to the next vblank
+    // after now.
+    int64_t next = p->flip_time + info->vsync_duration;
+    int64_t now = mp_time_us();
+    if (next < now)
+        next += ((now - next) / info->vsync_duration + 1) * info->vsync_duration;
+    info->last_queue_display_time =
+        next + (p->gbm.num_queued - 1) * info->vsync_duration;
 }
 
 static void drm_egl_uninit(struct ra_ctx *ctx)
@@ -337,6 +460,7 @@ static bool drm_egl_init(struct ra_ctx *ctx)
 
     struct priv *p = ctx->priv = talloc_zero(ctx, struct priv);
     p->ev.version = DRM_EVENT_CONTEXT_VERSION;
+    p->ev.page_flip_handler = page_flipped;
 
     p->vt_switcher_active = vt_switcher_init(&p->vt_switcher, ctx->vo->log);
     if (p->vt_switcher_active) {
@@ -393,15 +517,20 @@ static bool drm_egl_init(struct ra_ctx *ctx)
         return false;
     }
 
+    uint64_t cap = 0;
+    p->monotonic_timestamps =
+        drmGetCap(p->kms->fd, DRM_CAP_TIMESTAMP_MONOTONIC, &cap) == 0 && cap;
+
     p->drm_params.fd = p->kms->fd;
     p->drm_params.crtc_id = p->kms->crtc_id;
-    p->drm_params.atomic_request = p->kms->atomic_context->request;
+    if (p->kms->atomic_context)
+        p->drm_params.atomic_request = p->kms->atomic_context->request;
     struct ra_gl_ctx_params params = {
         .swap_buffers = drm_egl_swap_buffers,
+        .get_vsync = drm_egl_get_vsync,
         .native_display_type = "opengl-cb-drm-params",
         .native_display = &p->drm_params,
-        .external_swapchain = p->kms->atomic_context ? &drm_atomic_swapchain :
-                                                       NULL,
+        .external_swapchain = &drm_egl_swapchain,
     };
     if (!ra_gl_ctx_init(ctx, &p->gl, params))
         return false;
@@ -54,9 +54,20 @@ static void resize(struct ra_ctx *ctx)
 static void wayland_egl_swap_buffers(struct ra_ctx *ctx)
 {
     struct priv *p = ctx->priv;
+    vo_wayland_submit_frame(ctx->vo->wl);
     eglSwapBuffers(p->egl_display, p->egl_surface);
 }
 
+static bool wayland_egl_start_frame(struct ra_ctx *ctx)
+{
+    return vo_wayland_start_frame(ctx->vo->wl);
+}
+
+static void wayland_egl_get_vsync(struct ra_ctx *ctx, struct vo_vsync_info *info)
+{
+    vo_wayland_get_vsync(ctx->vo->wl, info);
+}
+
 static bool egl_create_context(struct ra_ctx *ctx)
 {
     struct priv *p = ctx->priv = talloc_zero(ctx, struct priv);
@@ -78,6 +89,8 @@ static bool egl_create_context(struct ra_ctx *ctx)
 
     struct ra_gl_ctx_params params = {
         .swap_buffers = wayland_egl_swap_buffers,
+        .get_vsync = wayland_egl_get_vsync,
+        .start_frame = wayland_egl_start_frame,
         .native_display_type = "wl",
         .native_display = wl->display,
     };
@@ -37,8 +37,10 @@
 #define CUDA_DECL(NAME, TYPE) \
     TYPE *mpv_ ## NAME;
 CUDA_FNS(CUDA_DECL)
+CUDA_INTEROP_FNS(CUDA_DECL)
 
 static bool cuda_loaded = false;
+static bool cuda_interop_loaded = false;
 static pthread_once_t cuda_load_once = PTHREAD_ONCE_INIT;
 
 static void cuda_do_load(void)
@@ -54,6 +56,10 @@ static void cuda_do_load(void)
     CUDA_FNS(CUDA_LOAD_SYMBOL)
 
     cuda_loaded = true;
+
+    CUDA_INTEROP_FNS(CUDA_LOAD_SYMBOL)
+
+    cuda_interop_loaded = true;
 }
 
 bool cuda_load(void)
@@ -61,3 +67,8 @@ bool cuda_load(void)
     pthread_once(&cuda_load_once, cuda_do_load);
     return cuda_loaded;
 }
+
+bool cuda_load_interop(void)
+{
+    return cuda_load() && cuda_interop_loaded;
+}
@@ -25,8 +25,6 @@
 #include <stdbool.h>
 #include <stddef.h>
 
-#include "gl_headers.h"
-
 #define CUDA_VERSION 7050
 
 #if defined(_WIN32) || defined(__CYGWIN__)
@@ -89,6 +87,88 @@ typedef enum CUGLDeviceList_enum {
 
 #define CU_GRAPHICS_REGISTER_FLAGS_WRITE_DISCARD 2
 
+// External memory/semaphore interop (CUDA 10), used for Vulkan interop.
+
+typedef struct CUextMemory_st *CUexternalMemory;
+typedef struct CUextSemaphore_st *CUexternalSemaphore;
+typedef struct CUmipmappedArray_st *CUmipmappedArray;
+
+typedef struct CUuuid_st {
+    char bytes[16];
+} CUuuid;
+
+typedef enum CUarray_format_enum {
+    CU_AD_FORMAT_UNSIGNED_INT8 = 0x01,
+    CU_AD_FORMAT_UNSIGNED_INT16 = 0x02,
+} CUarray_format;
+
+typedef struct CUDA_ARRAY3D_DESCRIPTOR_st {
+    size_t Width;
+    size_t Height;
+    size_t Depth;
+    CUarray_format Format;
+    unsigned int NumChannels;
+    unsigned int Flags;
+} CUDA_ARRAY3D_DESCRIPTOR;
+
+typedef enum CUexternalMemoryHandleType_enum {
+    CU_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD = 1,
+    CU_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_WIN32 = 2,
+} CUexternalMemoryHandleType;
+
+#define CUDA_EXTERNAL_MEMORY_DEDICATED 0x1
+
+typedef struct CUDA_EXTERNAL_MEMORY_HANDLE_DESC_st {
+    CUexternalMemoryHandleType type;
+    union {
+        int fd;
+        struct {
+            void *handle;
+            const void *name;
+        } win32;
+    } handle;
+    unsigned long long size;
+    unsigned int flags;
+    unsigned int reserved[16];
+} CUDA_EXTERNAL_MEMORY_HANDLE_DESC;
+
+typedef struct CUDA_EXTERNAL_MEMORY_MIPMAPPED_ARRAY_DESC_st {
+    unsigned long long offset;
+    CUDA_ARRAY3D_DESCRIPTOR arrayDesc;
+    unsigned int numLevels;
+    unsigned int reserved[16];
+} CUDA_EXTERNAL_MEMORY_MIPMAPPED_ARRAY_DESC;
+
+typedef enum CUexternalSemaphoreHandleType_enum {
+    CU_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD = 1,
+    CU_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_WIN32 = 2,
+} CUexternalSemaphoreHandleType;
+
+typedef struct CUDA_EXTERNAL_SEMAPHORE_HANDLE_DESC_st {
+    CUexternalSemaphoreHandleType type;
+    union {
+        int fd;
+        struct {
+            void *handle;
+            const void *name;
+        } win32;
+    } handle;
+    unsigned int flags;
+    unsigned int reserved[16];
+} CUDA_EXTERNAL_SEMAPHORE_HANDLE_DESC;
+
+// The signal and wait parameters have the same layout.
+typedef struct CUDA_EXTERNAL_SEMAPHORE_SIGNAL_PARAMS_st {
+    struct {
+        struct {
+            unsigned long long value;
+        } fence;
+        unsigned int reserved[16];
+    } params;
+    unsigned int flags;
+    unsigned int reserved[16];
+} CUDA_EXTERNAL_SEMAPHORE_SIGNAL_PARAMS, CUDA_EXTERNAL_SEMAPHORE_WAIT_PARAMS;
+
 typedef CUresult CUDAAPI tcuInit(unsigned int Flags);
 typedef CUresult CUDAAPI tcuCtxCreate_v2(CUcontext *pctx, unsigned int flags, CUdevice dev);
 typedef CUresult CUDAAPI tcuCtxPushCurrent_v2(CUcontext *pctx);
@@ -99,11 +179,24 @@ typedef CUresult CUDAAPI tcuMemcpy2D_v2(const CUDA_MEMCPY2D *pcopy);
 typedef CUresult CUDAAPI tcuGetErrorName(CUresult error, const char** pstr);
 typedef CUresult CUDAAPI tcuGetErrorString(CUresult error, const char** pstr);
 typedef CUresult CUDAAPI tcuGLGetDevices_v2(unsigned int* pCudaDeviceCount, CUdevice* pCudaDevices, unsigned int cudaDeviceCount, CUGLDeviceList deviceList);
-typedef CUresult CUDAAPI tcuGraphicsGLRegisterImage(CUgraphicsResource* pCudaResource, GLuint image, GLenum target, unsigned int Flags);
+typedef CUresult CUDAAPI tcuGraphicsGLRegisterImage(CUgraphicsResource* pCudaResource, unsigned int image, unsigned int target, unsigned int Flags);
 typedef CUresult CUDAAPI tcuGraphicsUnregisterResource(CUgraphicsResource resource);
 typedef CUresult CUDAAPI tcuGraphicsMapResources(unsigned int count, CUgraphicsResource* resources, CUstream hStream);
 typedef CUresult CUDAAPI tcuGraphicsUnmapResources(unsigned int count, CUgraphicsResource* resources, CUstream hStream);
 typedef CUresult CUDAAPI tcuGraphicsSubResourceGetMappedArray(CUarray* pArray, CUgraphicsResource resource, unsigned int arrayIndex, unsigned int mipLevel);
+typedef CUresult CUDAAPI tcuDeviceGetCount(int *count);
+typedef CUresult CUDAAPI tcuDeviceGetUuid(CUuuid *uuid, CUdevice dev);
+typedef CUresult CUDAAPI tcuMemcpy2DAsync_v2(const CUDA_MEMCPY2D *pcopy, CUstream hStream);
+typedef CUresult CUDAAPI tcuCtxSynchronize(void);
+typedef CUresult CUDAAPI tcuImportExternalMemory(CUexternalMemory *extMem_out, const CUDA_EXTERNAL_MEMORY_HANDLE_DESC *memHandleDesc);
+typedef CUresult CUDAAPI tcuDestroyExternalMemory(CUexternalMemory extMem);
+typedef CUresult CUDAAPI tcuExternalMemoryGetMappedMipmappedArray(CUmipmappedArray *mipmap, CUexternalMemory extMem, const CUDA_EXTERNAL_MEMORY_MIPMAPPED_ARRAY_DESC *mipmapDesc);
+typedef CUresult CUDAAPI tcuMipmappedArrayGetLevel(CUarray *pLevelArray, CUmipmappedArray hMipmappedArray, unsigned int level);
+typedef CUresult CUDAAPI tcuMipmappedArrayDestroy(CUmipmappedArray hMipmappedArray);
+typedef CUresult CUDAAPI tcuImportExternalSemaphore(CUexternalSemaphore *extSem_out, const CUDA_EXTERNAL_SEMAPHORE_HANDLE_DESC *semHandleDesc);
+typedef CUresult CUDAAPI tcuDestroyExternalSemaphore(CUexternalSemaphore extSem);
+typedef CUresult CUDAAPI tcuSignalExternalSemaphoresAsync(const CUexternalSemaphore *extSemArray, const CUDA_EXTERNAL_SEMAPHORE_SIGNAL_PARAMS *paramsArray, unsigned int numExtSems, CUstream stream);
+typedef CUresult CUDAAPI tcuWaitExternalSemaphoresAsync(const CUexternalSemaphore *extSemArray, const CUDA_EXTERNAL_SEMAPHORE_WAIT_PARAMS *paramsArray, unsigned int numExtSems, CUstream stream);
 
 #define CUDA_FNS(FN) \
     FN(cuInit, tcuInit) \
@@ -122,10 +215,28 @@ typedef CUresult CUDAAPI tcuGraphicsSubResourceGetMappedArray(CUarray* pArray, C
     FN(cuGraphicsUnmapResources, tcuGraphicsUnmapResources) \
     FN(cuGraphicsSubResourceGetMappedArray, tcuGraphicsSubResourceGetMappedArray) \
 
+// Only needed for Vulkan interop, and missing in older drivers, so they are
+// loaded separately (see cuda_load_interop()).
+#define CUDA_INTEROP_FNS(FN) \
+    FN(cuDeviceGetCount, tcuDeviceGetCount) \
+    FN(cuDeviceGetUuid, tcuDeviceGetUuid) \
+    FN(cuMemcpy2DAsync_v2, tcuMemcpy2DAsync_v2) \
+    FN(cuCtxSynchronize, tcuCtxSynchronize) \
+    FN(cuImportExternalMemory, tcuImportExternalMemory) \
+    FN(cuDestroyExternalMemory, tcuDestroyExternalMemory) \
+    FN(cuExternalMemoryGetMappedMipmappedArray, tcuExternalMemoryGetMappedMipmappedArray) \
+    FN(cuMipmappedArrayGetLevel, tcuMipmappedArrayGetLevel) \
+    FN(cuMipmappedArrayDestroy, tcuMipmappedArrayDestroy) \
+    FN(cuImportExternalSemaphore, tcuImportExternalSemaphore) \
+    FN(cuDestroyExternalSemaphore, tcuDestroyExternalSemaphore) \
+    FN(cuSignalExternalSemaphoresAsync, tcuSignalExternalSemaphoresAsync) \
+    FN(cuWaitExternalSemaphoresAsync, tcuWaitExternalSemaphoresAsync) \
+
 #define CUDA_EXT_DECL(NAME, TYPE) \
     extern TYPE *mpv_ ## NAME;
 
 CUDA_FNS(CUDA_EXT_DECL)
+CUDA_INTEROP_FNS(CUDA_EXT_DECL)
 
 #define cuInit mpv_cuInit
 #define cuCtxCreate mpv_cuCtxCreate_v2
@@ -142,7 +253,23 @@ CUDA_FNS(CUDA_EXT_DECL)
 #define cuGraphicsMapResources mpv_cuGraphicsMapResources
 #define cuGraphicsUnmapResources mpv_cuGraphicsUnmapResources
 #define cuGraphicsSubResourceGetMappedArray mpv_cuGraphicsSubResourceGetMappedArray
+#define cuDeviceGetCount mpv_cuDeviceGetCount
+#define cuDeviceGetUuid mpv_cuDeviceGetUuid
+#define cuMemcpy2DAsync mpv_cuMemcpy2DAsync_v2
+#define cuCtxSynchronize mpv_cuCtxSynchronize
+#define cuImportExternalMemory mpv_cuImportExternalMemory
+#define cuDestroyExternalMemory mpv_cuDestroyExternalMemory
+#define cuExternalMemoryGetMappedMipmappedArray mpv_cuExternalMemoryGetMappedMipmappedArray
+#define cuMipmappedArrayGetLevel mpv_cuMipmappedArrayGetLevel
+#define cuMipmappedArrayDestroy mpv_cuMipmappedArrayDestroy
+#define cuImportExternalSemaphore mpv_cuImportExternalSemaphore
+#define cuDestroyExternalSemaphore mpv_cuDestroyExternalSemaphore
+#define cuSignalExternalSemaphoresAsync mpv_cuSignalExternalSemaphoresAsync
+#define cuWaitExternalSemaphoresAsync mpv_cuWaitExternalSemaphoresAsync
 
 bool cuda_load(void);
 
+// Like cuda_load(), but also requires the CUDA_INTEROP_FNS.
+bool cuda_load_interop(void);
+
 #endif // MPV_CUDA_DYNAMIC_H
@@ -50,7 +50,9 @@ struct priv {
     struct mp_image_params params;
   
     struct drm_atomic_context *ctx;
-    struct drm_frame current_frame, old_frame;
+    struct drm_frame current_frame;
+    // Frames still queued for scanout (or on screen), newest first.
+    struct drm_frame old_frames[DRM_MAX_QUEUED_FRAMES];
 
     struct mp_rect src, dst;
 
@@ -61,18 +63,21 @@ static void set_current_frame(struct ra_hwdec *hw, struct drm_frame *frame)
 {
     struct priv *p = hw->priv;
 
-    // frame will be on screen after next vsync
-    // current_frame is currently the displayed frame and will be replaced
-    // by frame after next vsync.
-    // We used old frame as triple buffering to make sure that the drm framebuffer
-    // is not being displayed when we release it.
+    // frame will be on screen once the frames queued before it were flipped.
+    // The context queues up to DRM_MAX_QUEUED_FRAMES frames for page flipping,
+    // so keep that many old frames to make sure that the drm framebuffer is
+    // not being displayed when we release it.
 
+    struct drm_frame *oldest = &p->old_frames[DRM_MAX_QUEUED_FRAMES - 1];
     if (p->ctx) {
-        drm_prime_destroy_framebuffer(p->log, p->ctx->fd, &p->old_frame.fb);
+        drm_prime_destroy_framebuffer(p->log, p->ctx->fd, &oldest->fb);
     }
+    mp_image_setrefp(&oldest->image, NULL);
 
-    mp_image_setrefp(&p->old_frame.image, p->current_frame.image);
-    p->old_frame.fb = p->current_frame.fb;
+    memmove(&p->old_frames[1], &p->old_frames[0],
+            (DRM_MAX_QUEUED_FRAMES - 1) * sizeof(p->old_frames[0]));
+    p->old_frames[0] = p->current_frame;
+    p->current_frame.image = NULL;
 
     if (frame) {
         p->current_frame.fb = frame->fb;
@@ -192,7 +197,9 @@ static void uninit(struct ra_hwdec *hw)
 {
     struct priv *p = hw->priv;
 
-    set_current_frame(hw, NULL);
+    // Push out the current and all old frames.
+    for (int n = 0; n <= DRM_MAX_QUEUED_FRAMES; n++)
+        set_current_frame(hw, NULL);
 
     if (p->ctx) {
         drm_atomic_destroy_context(p->ctx);
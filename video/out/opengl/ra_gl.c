@@ -1,16 +1,36 @@
 #include <libavutil/intreadwrite.h>
 
+#include "osdep/timer.h"
+#include "video/out/vo.h"
+
 #include "formats.h"
 #include "utils.h"
 #include "ra_gl.h"
 
 static struct ra_fns ra_fns_gl;
 
+// Persistently mapped upload ring (used with ra.use_pbo, if possible)
+#define UPLOAD_RING_MIN_SIZE (16 * 1024 * 1024)
+#define UPLOAD_RING_ALIGN 256
+
+// Part of the upload ring still in use by GL
+struct upload_region {
+    size_t start, end;
+    GLsync fence;
+};
+
 // For ra.priv
 struct ra_gl {
     GL *gl;
     bool debug_enable;
     bool timer_active; // hack for GL_TIME_ELAPSED limitations
+    struct ra_buf *ring;
+    bool ring_failed; // don't try to create it again
+    size_t ring_pos;
+    struct upload_region *regions; // oldest first
+    int num_regions;
+    bool uploading; // within gl_tex_upload()
+    struct voctrl_upload_stats stats;
 };
 
 // For ra_tex.priv
@@ -93,6 +113,10 @@ static int ra_init_gl(struct ra *ra, GL *gl)
     ra->fns = &ra_fns_gl;
     ra->glsl_version = gl->glsl_version;
     ra->glsl_es = gl->es > 0;
+    ra->driver_id = talloc_asprintf(ra, "%s / %s / %s",
+                                    gl->GetString(GL_VENDOR),
+                                    gl->GetString(GL_RENDERER),
+                                    gl->GetString(GL_VERSION));
 
     static const int caps_map[][2] = {
         {RA_CAP_DIRECT_UPLOAD,      0},
@@ -196,6 +220,8 @@ static int ra_init_gl(struct ra *ra, GL *gl)
     if (ra->caps & RA_CAP_COMPUTE) {
         gl->GetIntegerv(GL_MAX_COMPUTE_SHARED_MEMORY_SIZE, &ival);
         ra->max_shmem = ival;
+        gl->GetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &ival);
+        ra->max_compute_group_threads = ival;
     }
 
     gl->Disable(GL_DITHER);
@@ -219,6 +245,13 @@ struct ra *ra_create_gl(GL *gl, struct mp_log *log)
 
 static void gl_destroy(struct ra *ra)
 {
+    struct ra_gl *p = ra->priv;
+    GL *gl = p->gl;
+
+    for (int n = 0; n < p->num_regions; n++)
+        gl->DeleteSync(p->regions[n].fence);
+    ra_buf_free(ra, &p->ring);
+
     talloc_free(ra->priv);
 }
 
@@ -326,8 +359,11 @@ static struct ra_tex *gl_tex_create(struct ra *ra,
 
     gl_check_error(gl, ra->log, "after creating texture");
 
-    // Even blitting needs an FBO in OpenGL for strange reasons
-    if (tex->params.render_dst || tex->params.blit_src || tex->params.blit_dst) {
+    // Even blitting needs an FBO in OpenGL for strange reasons (and reading
+    // back the texture uses glReadPixels on it)
+    if (tex->params.render_dst || tex->params.blit_src || tex->params.blit_dst ||
+        tex->params.downloadable)
+    {
         if (!tex->params.format->renderable) {
             MP_ERR(ra, "Trying to create renderable texture with unsupported "
                    "format.\n");
@@ -399,6 +435,7 @@ struct ra_tex *ra_create_wrapped_fb(struct ra *ra, GLuint gl_fbo, int w, int h)
             .render_dst = true,
             .blit_src = true,
             .blit_dst = true,
+            .downloadable = true,
         },
     };
 
@@ -445,8 +482,174 @@ bool ra_is_gl(struct ra *ra)
     return ra->fns == &ra_fns_gl;
 }
 
+// Number of bytes read from the source for the given upload.
+static size_t upload_size(const struct ra_tex_upload_params *params)
+{
+    const struct ra_tex_params *tp = &params->tex->params;
+    size_t pixel_size = tp->format->pixel_size;
+    if (tp->dimensions != 2)
+        return tp->w * tp->h * tp->d * pixel_size;
+
+    struct mp_rect rc = {0, 0, tp->w, tp->h};
+    if (params->rc)
+        rc = *params->rc;
+    return params->stride * (mp_rect_h(rc) - 1) + mp_rect_w(rc) * pixel_size;
+}
+
+// Drop the oldest in-flight region of the upload ring once GL is done with
+// it. If block is set, wait for it. Returns false if nothing was dropped.
+static bool ring_retire(struct ra *ra, bool block)
+{
+    struct ra_gl *p = ra->priv;
+    GL *gl = p->gl;
+
+    if (!p->num_regions)
+        return false;
+
+    struct upload_region *r = &p->regions[0];
+    if (block) {
+        int64_t start = mp_time_us();
+        GLenum res = gl->ClientWaitSync(r->fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                        1000000000); // 1 second
+        p->stats.stalls++;
+        p->stats.stall_time += mp_time_us() - start;
+        if (res == GL_TIMEOUT_EXPIRED) {
+            MP_WARN(ra, "Timeout waiting for texture upload.\n");
+            return false;
+        }
+    } else {
+        GLenum res = gl->ClientWaitSync(r->fence, 0, 0);
+        if (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED)
+            return false;
+    }
+
+    gl->DeleteSync(r->fence);
+    MP_TARRAY_REMOVE_AT(p->regions, p->num_regions, 0);
+    return true;
+}
+
+// Reserve size bytes of the upload ring, (re)creating it if needed. Blocks
+// only if the GPU is still reading all of the space.
+static bool ring_alloc(struct ra *ra, size_t size, size_t *out_offset)
+{
+    struct ra_gl *p = ra->priv;
+
+    size_t ring_size = p->ring ? p->ring->params.size : 0;
+    if (size > ring_size / 4) {
+        if (p->ring_failed)
+            return false;
+
+        // Replace it with a bigger one once all uploads from it are done.
+        while (p->num_regions) {
+            if (!ring_retire(ra, true))
+                return false;
+        }
+        ra_buf_free(ra, &p->ring);
+
+        ring_size = UPLOAD_RING_MIN_SIZE;
+        while (size > ring_size / 4)
+            ring_size *= 2;
+
+        p->ring = ra_buf_create(ra, &(struct ra_buf_params){
+            .type = RA_BUF_TYPE_TEX_UPLOAD,
+            .size = ring_size,
+            .host_mapped = true,
+        });
+        p->ring_pos = 0;
+        if (!p->ring) {
+            MP_VERBOSE(ra, "Persistently mapped upload buffer not available, "
+                       "using normal PBOs.\n");
+            p->ring_failed = true;
+            return false;
+        }
+        MP_VERBOSE(ra, "Using a %zu MB persistently mapped upload buffer.\n",
+                   ring_size >> 20);
+    }
+
+    while (ring_retire(ra, false)) {}
+
+    if (p->ring_pos + size > ring_size)
+        p->ring_pos = 0;
+
+    size_t start = p->ring_pos, end = start + size;
+    for (int n = 0; n < p->num_regions; n++) {
+        struct upload_region *r = &p->regions[n];
+        if (r->start < end && start < r->end) {
+            // Regions are retired oldest first, so start over.
+            if (!ring_retire(ra, true))
+                return false;
+            n = -1;
+        }
+    }
+
+    p->ring_pos = MP_ALIGN_UP(end, UPLOAD_RING_ALIGN);
+    *out_offset = start;
+    return true;
+}
+
+static bool tex_upload(struct ra *ra, const struct ra_tex_upload_params *params);
+
+// Upload by copying the data into the persistently mapped ring. Unlike with
+// normal PBOs, the driver doesn't need to make a copy or synchronize.
+static bool tex_upload_ring(struct ra *ra,
+                            const struct ra_tex_upload_params *params)
+{
+    struct ra_gl *p = ra->priv;
+
+    size_t size = upload_size(params);
+    size_t offset;
+    if (!ring_alloc(ra, size, &offset))
+        return false;
+
+    memcpy((char *)p->ring->data + offset, params->src, size);
+
+    struct ra_tex_upload_params newparams = *params;
+    newparams.buf = p->ring;
+    newparams.buf_offset = offset;
+    newparams.src = NULL;
+    if (!tex_upload(ra, &newparams))
+        return false;
+
+    // Take over the fence tex_upload() created for the whole buffer.
+    struct ra_buf_gl *buf_gl = p->ring->priv;
+    MP_TARRAY_APPEND(p, p->regions, p->num_regions, (struct upload_region){
+        .start = offset,
+        .end = offset + size,
+        .fence = buf_gl->fence,
+    });
+    buf_gl->fence = NULL;
+    return true;
+}
+
 static bool gl_tex_upload(struct ra *ra,
                           const struct ra_tex_upload_params *params)
+{
+    struct ra_gl *p = ra->priv;
+    struct ra_tex_gl *tex_gl = params->tex->priv;
+
+    // Nested call from ra_tex_upload_pbo(), already accounted for.
+    if (p->uploading)
+        return tex_upload(ra, params);
+
+    int64_t start = mp_time_us();
+    p->uploading = true;
+
+    bool ok;
+    if (ra->use_pbo && !params->buf) {
+        ok = tex_upload_ring(ra, params) ||
+             ra_tex_upload_pbo(ra, &tex_gl->pbo, params);
+    } else {
+        ok = tex_upload(ra, params);
+    }
+
+    p->uploading = false;
+    p->stats.uploads++;
+    p->stats.bytes += upload_size(params);
+    p->stats.time += mp_time_us() - start;
+    return ok;
+}
+
+static bool tex_upload(struct ra *ra, const struct ra_tex_upload_params *params)
 {
     GL *gl = ra_gl_get(ra);
     struct ra_tex *tex = params->tex;
@@ -456,9 +659,6 @@ static bool gl_tex_upload(struct ra *ra,
     assert(tex->params.host_mutable);
     assert(!params->buf || !params->src);
 
-    if (ra->use_pbo && !params->buf)
-        return ra_tex_upload_pbo(ra, &tex_gl->pbo, params);
-
     const void *src = params->src;
     if (buf) {
         gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, buf_gl->buffer);
@@ -545,6 +745,7 @@ static struct ra_buf *gl_buf_create(struct ra *ra,
 
     switch (params->type) {
     case RA_BUF_TYPE_TEX_UPLOAD:     buf_gl->target = GL_PIXEL_UNPACK_BUFFER;   break;
+    case RA_BUF_TYPE_TEX_DOWNLOAD:   buf_gl->target = GL_PIXEL_PACK_BUFFER;     break;
     case RA_BUF_TYPE_SHADER_STORAGE: buf_gl->target = GL_SHADER_STORAGE_BUFFER; break;
     case RA_BUF_TYPE_UNIFORM:        buf_gl->target = GL_UNIFORM_BUFFER;        break;
     default: abort();
@@ -557,7 +758,8 @@ static struct ra_buf *gl_buf_create(struct ra *ra,
                          GL_MAP_READ_BIT | GL_MAP_WRITE_BIT;
 
         unsigned storflags = flags;
-        if (params->type == RA_BUF_TYPE_TEX_UPLOAD)
+        if (params->type == RA_BUF_TYPE_TEX_UPLOAD ||
+            params->type == RA_BUF_TYPE_TEX_DOWNLOAD)
             storflags |= GL_CLIENT_STORAGE_BIT;
 
         gl->BufferStorage(buf_gl->target, params->size, params->initial_data,
@@ -572,6 +774,7 @@ static struct ra_buf *gl_buf_create(struct ra *ra,
         GLenum hint;
         switch (params->type) {
         case RA_BUF_TYPE_TEX_UPLOAD:     hint = GL_STREAM_DRAW; break;
+        case RA_BUF_TYPE_TEX_DOWNLOAD:   hint = GL_STREAM_READ; break;
         case RA_BUF_TYPE_SHADER_STORAGE: hint = GL_STREAM_COPY; break;
         case RA_BUF_TYPE_UNIFORM:        hint = GL_STATIC_DRAW; break;
         default: abort();
@@ -617,6 +820,53 @@ static bool gl_buf_poll(struct ra *ra, struct ra_buf *buf)
     return !buf_gl->fence;
 }
 
+static bool gl_tex_download(struct ra *ra, struct ra_tex *tex, struct ra_buf *buf)
+{
+    GL *gl = ra_gl_get(ra);
+    struct ra_tex_gl *tex_gl = tex->priv;
+    struct ra_buf_gl *buf_gl = buf->priv;
+
+    assert(tex->params.downloadable && tex->params.dimensions == 2);
+    assert(buf->params.type == RA_BUF_TYPE_TEX_DOWNLOAD);
+
+    // Fences are needed to know when the data is available
+    if (!buf->data || !gl->FenceSync)
+        return false;
+
+    GLenum format = tex_gl->format, type = tex_gl->type;
+    int pixel_size = tex->params.format->pixel_size;
+    if (!pixel_size) {
+        format = GL_RGBA;
+        type = GL_UNSIGNED_BYTE;
+        pixel_size = 4;
+    }
+    if (buf->params.size < (size_t)tex->params.w * tex->params.h * pixel_size)
+        return false;
+
+    gl->BindFramebuffer(GL_FRAMEBUFFER, tex_gl->fbo);
+    gl->BindBuffer(GL_PIXEL_PACK_BUFFER, buf_gl->buffer);
+    gl->PixelStorei(GL_PACK_ALIGNMENT, 1);
+    gl->ReadPixels(0, 0, tex->params.w, tex->params.h, format, type, NULL);
+    gl->PixelStorei(GL_PACK_ALIGNMENT, 4);
+    gl->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    gl->BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (buf_gl->fence)
+        gl->DeleteSync(buf_gl->fence);
+    buf_gl->fence = gl->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    gl_check_error(gl, ra->log, "after reading back texture");
+    return true;
+}
+
+static void gl_upload_stats(struct ra *ra, struct voctrl_upload_stats *out)
+{
+    struct ra_gl *p = ra->priv;
+
+    *out = p->stats;
+    out->ring_size = p->ring ? p->ring->params.size : 0;
+}
+
 static void gl_clear(struct ra *ra, struct ra_tex *dst, float color[4],
                      struct mp_rect *scissor)
 {
@@ -1126,6 +1376,7 @@ static struct ra_fns ra_fns_gl = {
     .tex_create             = gl_tex_create,
     .tex_destroy            = gl_tex_destroy,
     .tex_upload             = gl_tex_upload,
+    .tex_download           = gl_tex_download,
     .buf_create             = gl_buf_create,
     .buf_destroy            = gl_buf_destroy,
     .buf_update             = gl_buf_update,
@@ -1142,4 +1393,5 @@ static struct ra_fns ra_fns_gl = {
     .timer_start            = gl_timer_start,
     .timer_stop             = gl_timer_stop,
     .debug_marker           = gl_debug_marker,
+    .upload_stats           = gl_upload_stats,
 };
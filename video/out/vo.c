@@ -33,6 +33,7 @@
 #include "osdep/threads.h"
 #include "misc/dispatch.h"
 #include "misc/rendezvous.h"
+#include "misc/thread_sched.h"
 #include "options/options.h"
 #include "misc/bstr.h"
 #include "vo.h"
@@ -159,8 +160,13 @@ struct vo_internal {
     int req_frames;                 // VO's requested value of num_frames
     uint64_t current_frame_id;
 
+    int64_t pending_input_time;     // see vo_set_input_time()
+    struct vo_input_latency input_latency;
+
     double display_fps;
     int opt_framedrop;
+
+    int dwidth, dheight;            // copy of vo->dwidth/dheight (0 if unset)
 };
 
 extern const struct m_sub_options gl_video_conf;
@@ -261,6 +267,7 @@ static struct vo *vo_create(bool probing, struct mpv_global *global,
         return NULL;
     };
     struct vo *vo = talloc_ptrtype(NULL, vo);
+    ta_set_account(vo, MP_MEM_VO);
     *vo = (struct vo) {
         .log = mp_log_new(vo, log, name),
         .driver = desc.p,
@@ -431,7 +438,9 @@ static void check_estimated_display_fps(struct vo *vo)
 
 // Attempt to detect vsyncs delayed/skipped by the driver. This tries to deal
 // with strong jitter too, because some drivers have crap vsync timing.
-static void vsync_skip_detection(struct vo *vo)
+// skipped_vsyncs is the number of skipped vsyncs reported by the display
+// system, or -1 if it has to be guessed from the timing samples.
+static void vsync_skip_detection(struct vo *vo, int64_t skipped_vsyncs)
 {
     struct vo_internal *in = vo->in;
 
@@ -445,14 +454,19 @@ static void vsync_skip_detection(struct vo *vo)
             desync_early = diff / window;
     }
     int64_t desync = diff / in->num_vsync_samples;
-    if (in->drop_point > window * 2 &&
-        llabs(desync - desync_early) >= in->vsync_interval * 3 / 4)
-    {
+    bool delayed;
+    if (skipped_vsyncs >= 0) {
+        delayed = skipped_vsyncs > 0;
+    } else {
+        delayed = in->drop_point > window * 2 &&
+                  llabs(desync - desync_early) >= in->vsync_interval * 3 / 4;
+    }
+    if (delayed) {
         // Assume a drop. An underflow can technically speaking not be a drop
         // (it's up to the driver what this is supposed to mean), but no reason
         // to treat it differently.
         in->base_vsync = in->prev_vsync;
-        in->delayed_count += 1;
+        in->delayed_count += MPMAX(skipped_vsyncs, 1);
         in->drop_point = 0;
         MP_STATS(vo, "vo-delayed");
     }
@@ -461,11 +475,16 @@ static void vsync_skip_detection(struct vo *vo)
 }
 
 // Always called locked.
-static void update_vsync_timing_after_swap(struct vo *vo)
+static void update_vsync_timing_after_swap(struct vo *vo,
+                                           struct vo_vsync_info *vsync)
 {
     struct vo_internal *in = vo->in;
 
-    int64_t now = mp_time_us();
+    // Prefer the actual presentation time reported by the display system over
+    // the time the swap returned. It's offset by the latency of the output,
+    // which doesn't matter for the intervals, but has much less jitter.
+    int64_t now = vsync->last_queue_display_time > 0 ?
+                  vsync->last_queue_display_time : mp_time_us();
     int64_t prev_vsync = in->prev_vsync;
 
     in->prev_vsync = now;
@@ -495,11 +514,13 @@ static void update_vsync_timing_after_swap(struct vo *vo)
     for (int n = 0; n < in->num_vsync_samples; n++)
         avg += in->vsync_samples[n];
     in->estimated_vsync_interval = avg / in->num_vsync_samples;
+    if (vsync->vsync_duration > 0)
+        in->estimated_vsync_interval = vsync->vsync_duration;
     in->estimated_vsync_jitter =
         vsync_stddef(vo, in->vsync_interval) / in->vsync_interval;
 
     check_estimated_display_fps(vo);
-    vsync_skip_detection(vo);
+    vsync_skip_detection(vo, vsync->skipped_vsyncs);
 
     MP_STATS(vo, "value %f jitter", in->estimated_vsync_jitter);
     MP_STATS(vo, "value %f vsync-diff", in->vsync_samples[0] / 1e6);
@@ -552,6 +573,14 @@ static void check_vo_caps(struct vo *vo)
                    "video output does not support this.\n", rot);
         }
     }
+    struct mp_image_params nogpu = *vo->params;
+    nogpu.gpu_ops = (struct mp_gpu_ops){0};
+    if (!(vo->driver->caps & VO_CAP_GPU_OPS) &&
+        !mp_image_params_equal(&nogpu, vo->params))
+    {
+        MP_WARN(vo, "The gpu video filter is used, but the video output does "
+                "not support it.\n");
+    }
 }
 
 static void run_reconfig(void *p)
@@ -772,18 +801,63 @@ void vo_wait_frame(struct vo *vo)
 
 // Wait until realtime is >= ts
 // called without lock
-static void wait_until(struct vo *vo, int64_t target)
+// If precise is set, wake up --video-timing-spin early, and busy-wait for the
+// rest of the time.
+static void wait_until(struct vo *vo, int64_t target, bool precise)
 {
     struct vo_internal *in = vo->in;
-    struct timespec ts = mp_time_us_to_timespec(target);
+    int64_t spin = precise ? vo->opts->timing_spin * 1e6 : 0;
+    int64_t wakeup = target - spin;
+    struct timespec ts = mp_time_us_to_timespec(wakeup);
+    bool interrupted = false;
     pthread_mutex_lock(&in->lock);
-    while (target > mp_time_us()) {
-        if (in->queued_events & VO_EVENT_LIVE_RESIZING)
+    while (wakeup > mp_time_us()) {
+        if (in->queued_events & VO_EVENT_LIVE_RESIZING) {
+            interrupted = true;
             break;
+        }
         if (pthread_cond_timedwait(&in->wakeup, &in->lock, &ts))
             break;
     }
     pthread_mutex_unlock(&in->lock);
+    if (spin > 0 && !interrupted)
+        mp_sleep_until_spin_us(target, spin);
+}
+
+// Return the time of the oldest input the frame about to be flipped reflects,
+// and reset it, so repeated frames and redraws don't count it again. The
+// current frame must be the one being rendered (or NULL).
+// Locked by lock.
+static int64_t take_input_time(struct vo *vo, struct vo_frame *frame)
+{
+    struct vo_internal *in = vo->in;
+    int64_t t = in->pending_input_time;
+    if (frame && frame->input_time && (!t || frame->input_time < t))
+        t = frame->input_time;
+    in->pending_input_time = 0;
+    if (in->current_frame)
+        in->current_frame->input_time = 0;
+    return t;
+}
+
+// Called after flip_page, with the result of take_input_time().
+// Locked by lock.
+static void record_input_latency(struct vo *vo, int64_t input_time)
+{
+    struct vo_internal *in = vo->in;
+    struct vo_input_latency *l = &in->input_latency;
+    if (!input_time)
+        return;
+    int64_t t = MPMAX(mp_time_us() - input_time, 0);
+    l->last = t;
+    l->peak = MPMAX(l->peak, t);
+    l->count++;
+    // moving average over roughly the last 16 samples
+    l->avg = l->count == 1 ? t : l->avg + (t - l->avg) / 16;
+    int bucket = 0;
+    for (int64_t ms = t / 1000; ms > 1; ms >>= 1)
+        bucket++;
+    l->histogram[MPMIN(bucket, VO_INPUT_LATENCY_HIST_BUCKETS - 1)]++;
 }
 
 bool vo_render_frame_external(struct vo *vo)
@@ -857,6 +931,7 @@ bool vo_render_frame_external(struct vo *vo)
         in->rendering = true;
         in->hasframe_rendered = true;
         int64_t prev_drop_count = vo->in->drop_count;
+        int64_t input_time = take_input_time(vo, frame);
         pthread_mutex_unlock(&in->lock);
         wakeup_core(vo); // core can queue new video now
 
@@ -870,19 +945,27 @@ bool vo_render_frame_external(struct vo *vo)
 
         MP_STATS(vo, "end video-draw");
 
-        wait_until(vo, target);
+        wait_until(vo, target, frame->display_synced);
 
         MP_STATS(vo, "start video-flip");
 
         vo->driver->flip_page(vo);
 
+        struct vo_vsync_info vsync = {
+            .last_queue_display_time = -1,
+            .skipped_vsyncs = -1,
+        };
+        if (vo->driver->get_vsync)
+            vo->driver->get_vsync(vo, &vsync);
+
         MP_STATS(vo, "end video-flip");
 
         pthread_mutex_lock(&in->lock);
         in->dropped_frame = prev_drop_count < vo->in->drop_count;
         in->rendering = false;
+        record_input_latency(vo, input_time);
 
-        update_vsync_timing_after_swap(vo);
+        update_vsync_timing_after_swap(vo, &vsync);
     }
 
     if (vo->driver->caps & VO_CAP_NOREDRAW) {
@@ -932,6 +1015,7 @@ static void do_redraw(struct vo *vo)
     frame->still = true;
     frame->pts = 0;
     frame->duration = -1;
+    int64_t input_time = take_input_time(vo, frame);
     pthread_mutex_unlock(&in->lock);
 
     if (vo->driver->draw_frame) {
@@ -944,6 +1028,10 @@ static void do_redraw(struct vo *vo)
 
     vo->driver->flip_page(vo);
 
+    pthread_mutex_lock(&in->lock);
+    record_input_latency(vo, input_time);
+    pthread_mutex_unlock(&in->lock);
+
     if (frame != &dummy)
         talloc_free(frame);
 }
@@ -993,6 +1081,8 @@ static void *vo_thread(void *ptr)
     bool vo_paused = false;
 
     mpthread_set_name("vo");
+    ta_set_thread_account(MP_MEM_VO);
+    mp_thread_set_role(vo->global, vo->log, MP_THREAD_ROLE_VIDEO);
 
     int r = vo->driver->preinit(vo) ? -1 : 0;
     mp_rendezvous(vo, r); // init barrier
@@ -1029,6 +1119,8 @@ static void *vo_thread(void *ptr)
             in->want_redraw = true;
             wakeup_core(vo);
         }
+        in->dwidth = vo->config_ok ? vo->dwidth : 0;
+        in->dheight = vo->config_ok ? vo->dheight : 0;
         bool redraw = in->request_redraw;
         bool send_reset = in->send_reset;
         in->send_reset = false;
@@ -1203,6 +1295,17 @@ int vo_get_num_req_frames(struct vo *vo)
     return res;
 }
 
+// Return the current window size. Sets it to 0x0 if the VO is not configured
+// yet. Unlike vo->dwidth/dheight, this can be called from any thread.
+void vo_get_window_size(struct vo *vo, int *w, int *h)
+{
+    struct vo_internal *in = vo->in;
+    pthread_mutex_lock(&in->lock);
+    *w = in->dwidth;
+    *h = in->dheight;
+    pthread_mutex_unlock(&in->lock);
+}
+
 int64_t vo_get_vsync_interval(struct vo *vo)
 {
     struct vo_internal *in = vo->in;
@@ -1271,6 +1374,29 @@ int64_t vo_get_delayed_count(struct vo *vo)
     return res;
 }
 
+// Attribute user input received at input_time (mp_time_us()) to the next
+// redraw or frame that is presented. This is for changes that don't produce
+// a new frame, such as OSD updates while paused. Frames carrying their own
+// time in vo_frame.input_time don't need this.
+void vo_set_input_time(struct vo *vo, int64_t input_time)
+{
+    struct vo_internal *in = vo->in;
+    pthread_mutex_lock(&in->lock);
+    if (!in->pending_input_time || input_time < in->pending_input_time)
+        in->pending_input_time = input_time;
+    pthread_mutex_unlock(&in->lock);
+}
+
+// Statistics about the time between the arrival of user input and the flip of
+// the first frame or redraw reflecting it.
+void vo_get_input_latency(struct vo *vo, struct vo_input_latency *out)
+{
+    struct vo_internal *in = vo->in;
+    pthread_mutex_lock(&in->lock);
+    *out = in->input_latency;
+    pthread_mutex_unlock(&in->lock);
+}
+
 double vo_get_display_fps(struct vo *vo)
 {
     struct vo_internal *in = vo->in;
@@ -84,6 +84,9 @@ enum mp_voctrl {
     VOCTRL_UPDATE_PLAYBACK_STATE,       // struct voctrl_playback_state*
 
     VOCTRL_PERFORMANCE_DATA,            // struct voctrl_performance_data*
+    VOCTRL_SHADER_CACHE_STATS,          // struct voctrl_shader_cache_stats*
+    VOCTRL_GPU_MEMORY_STATS,            // struct voctrl_gpu_memory_stats*
+    VOCTRL_UPLOAD_STATS,                // struct voctrl_upload_stats*
 
     VOCTRL_SET_CURSOR_VISIBILITY,       // bool*
 
@@ -103,6 +106,9 @@ enum mp_voctrl {
 
     // Retrieve window contents. (Normal screenshots use vo_get_current_frame().)
     VOCTRL_SCREENSHOT_WIN,              // struct mp_image**
+    // Like VOCTRL_SCREENSHOT_WIN, but reads back the next rendered frame
+    // asynchronously, without blocking rendering.
+    VOCTRL_SCREENSHOT_WIN_ASYNC,        // struct voctrl_screenshot_async*
 
     VOCTRL_UPDATE_RENDER_OPTS,
 
@@ -144,17 +150,38 @@ struct voctrl_playback_state {
 
 // VOCTRL_PERFORMANCE_DATA
 #define VO_PERF_SAMPLE_COUNT 256
+// Bucket 0 counts times below 2us, bucket n times in [2^n, 2^(n+1)) us, and
+// the last bucket all times above that.
+#define VO_PERF_HIST_BUCKETS 20
 
 struct mp_pass_perf {
     // times are all in nanoseconds
     uint64_t last, avg, peak;
+    // percentiles over the samples
+    uint64_t p50, p95, p99;
     uint64_t samples[VO_PERF_SAMPLE_COUNT];
     uint64_t count;
+    // number of samples per time range, since the pass was created (unlike
+    // the other fields, not limited to the last VO_PERF_SAMPLE_COUNT ones)
+    uint64_t histogram[VO_PERF_HIST_BUCKETS];
 };
 
 #define VO_PASS_PERF_MAX 64
 
+// See vo_get_input_latency(). Bucket 0 counts latencies below 2 ms, bucket n
+// latencies in [2^n, 2^(n+1)) ms, and the last bucket all latencies above that.
+#define VO_INPUT_LATENCY_HIST_BUCKETS 12
+
+struct vo_input_latency {
+    // times are all in microseconds
+    int64_t last, avg, peak;
+    int64_t count;
+    uint64_t histogram[VO_INPUT_LATENCY_HIST_BUCKETS];
+};
+
 struct mp_frame_perf {
+    // sum of all passes, per frame
+    struct mp_pass_perf total;
     int count;
     struct mp_pass_perf perf[VO_PASS_PERF_MAX];
     // The owner of this struct does not have ownership over the names, and
@@ -167,6 +194,52 @@ struct voctrl_performance_data {
     struct mp_frame_perf fresh, redraw;
 };
 
+// VOCTRL_SHADER_CACHE_STATS
+struct voctrl_shader_cache_stats {
+    int64_t hits, misses;   // shaders loaded from/not found in the disk cache
+    int64_t compiles;       // shaders created by the GPU API
+    int64_t compile_time;   // total time spent creating them, in microseconds
+    int64_t disk_size;      // total size of the cache files in bytes
+    int disk_entries;       // number of cache files
+};
+
+#define VO_MAX_MEMORY_HEAPS 16
+
+struct mp_gpu_memory_heap {
+    int64_t size;           // total size of the heap, in bytes
+    bool device_local;      // heap is VRAM
+    int64_t budget;         // usable by the process (0 if unknown)
+    int64_t usage;          // used by the whole process (0 if unknown)
+    int64_t allocated;      // allocated by the VO from the device
+    int64_t used;           // part of the allocated memory that is in use
+    int num_slabs;          // number of separate device allocations
+};
+
+// VOCTRL_GPU_MEMORY_STATS
+struct voctrl_gpu_memory_stats {
+    int num_heaps;
+    struct mp_gpu_memory_heap heaps[VO_MAX_MEMORY_HEAPS];
+};
+
+// VOCTRL_UPLOAD_STATS
+struct voctrl_upload_stats {
+    int64_t uploads;    // number of texture uploads
+    int64_t bytes;      // total source data uploaded
+    int64_t time;       // total time spent in uploads (us), including stalls
+    int64_t stalls;     // waits for the GPU to release upload memory
+    int64_t stall_time; // total time spent in these waits (us)
+    int64_t ring_size;  // persistently mapped upload buffer size, 0 if none
+};
+
+// VOCTRL_SCREENSHOT_WIN_ASYNC
+struct voctrl_screenshot_async {
+    // Called on the VO thread once the image is available. The callee takes
+    // ownership of img, which is NULL on failure (or if the VO is destroyed
+    // before the frame was read back).
+    void (*cb)(void *ctx, struct mp_image *img);
+    void *ctx;
+};
+
 enum {
     // VO does handle mp_image_params.rotate in 90 degree steps
     VO_CAP_ROTATE90     = 1 << 0,
@@ -174,6 +247,8 @@ enum {
     VO_CAP_FRAMEDROP    = 1 << 1,
     // VO does not support redraws (vo_mediacodec_embed).
     VO_CAP_NOREDRAW     = 1 << 2,
+    // VO does handle mp_image_params.gpu_ops
+    VO_CAP_GPU_OPS      = 1 << 3,
 };
 
 #define VO_MAX_REQ_FRAMES 10
@@ -232,6 +307,9 @@ struct vo_frame {
     // VO if frames are dropped.
     int num_frames;
     struct mp_image *frames[VO_MAX_REQ_FRAMES];
+    // mp_time_us() at which the oldest user input this frame reflects was
+    // received, or 0. Used for the input latency statistics only.
+    int64_t input_time;
     // ID for frames[0] (== current). If current==NULL, the number is
     // meaningless. Otherwise, it's an unique ID for the frame. The ID for
     // a frame is guaranteed not to change (instant redraws will use the same
@@ -241,6 +319,23 @@ struct vo_frame {
     uint64_t frame_id;
 };
 
+// Presentation feedback. See get_vsync(). May not be supported by all VOs.
+struct vo_vsync_info {
+    // mp_time_us() timestamp at which the last queued frame will likely be
+    // displayed (this is in the future, unless the frame is instantly output).
+    // 0 or lower if unset or unsupported.
+    // This implies the latency of the output.
+    int64_t last_queue_display_time;
+
+    // Time between 2 vsync events in microseconds. 0 or lower if unknown.
+    int64_t vsync_duration;
+
+    // Number of skipped physical vsyncs between the last two presented
+    // frames, as reported by the display system. -1 if unknown, in which case
+    // the VO core tries to detect skipped vsyncs on its own.
+    int64_t skipped_vsyncs;
+};
+
 struct vo_driver {
     // Encoding functionality, which can be invoked via --o only.
     bool encode;
@@ -329,6 +424,15 @@ struct vo_driver {
      */
     void (*flip_page)(struct vo *vo);
 
+    /*
+     * Return presentation feedback. The implementation should not touch fields
+     * it doesn't support; the info fields are preinitialized to neutral
+     * values. Usually called once after flip_page(), but can be called any
+     * time. The values returned by this are always relative to the last
+     * flip_page() call.
+     */
+    void (*get_vsync)(struct vo *vo, struct vo_vsync_info *info);
+
     /* These optional callbacks can be provided if the GUI framework used by
      * the VO requires entering a message loop for receiving events and does
      * not call vo_wakeup() from a separate thread when there are new events.
@@ -429,6 +533,8 @@ void vo_set_paused(struct vo *vo, bool paused);
 int64_t vo_get_drop_count(struct vo *vo);
 void vo_increment_drop_count(struct vo *vo, int64_t n);
 int64_t vo_get_delayed_count(struct vo *vo);
+void vo_set_input_time(struct vo *vo, int64_t input_time);
+void vo_get_input_latency(struct vo *vo, struct vo_input_latency *out);
 void vo_query_formats(struct vo *vo, uint8_t *list);
 void vo_event(struct vo *vo, int event);
 int vo_query_and_reset_events(struct vo *vo, int events);
@@ -438,6 +544,7 @@ void vo_disable_external_renderloop(struct vo *vo);
 bool vo_render_frame_external(struct vo *vo);
 void vo_set_queue_params(struct vo *vo, int64_t offset_us, int num_req_frames);
 int vo_get_num_req_frames(struct vo *vo);
+void vo_get_window_size(struct vo *vo, int *w, int *h);
 int64_t vo_get_vsync_interval(struct vo *vo);
 double vo_get_estimated_vsync_interval(struct vo *vo);
 double vo_get_estimated_vsync_jitter(struct vo *vo);
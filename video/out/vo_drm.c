@@ -25,7 +25,11 @@
 
 #include <libswscale/swscale.h>
 
+#include "config.h"
 #include "drm_common.h"
+#if HAVE_DRMPRIME
+#include "drm_prime.h"
+#endif
 
 #include "common/msg.h"
 #include "osdep/timer.h"
@@ -51,6 +55,13 @@ struct framebuffer {
     uint32_t fb;
 };
 
+struct prime_frame {
+#if HAVE_DRMPRIME
+    struct drm_prime_framebuffer fb;
+#endif
+    struct mp_image *image;
+};
+
 struct priv {
     char *connector_spec;
     int mode_id;
@@ -75,6 +86,13 @@ struct priv {
     struct mp_rect dst;
     struct mp_osd_res osd;
     struct mp_sws_context *sws;
+
+    // Zero-copy path: IMGFMT_DRMPRIME frames are put directly on the overlay
+    // plane of the atomic context, and the primary plane stays black.
+    bool prime;
+    struct prime_frame prime_next;  // set with draw_image(), not committed yet
+    struct prime_frame prime_cur;   // on screen after the pending flip
+    struct prime_frame prime_old;   // on screen until the pending flip
 };
 
 static void fb_destroy(int fd, struct framebuffer *buf)
@@ -166,6 +184,78 @@ static bool fb_setup_double_buffering(struct vo *vo)
     return true;
 }
 
+static void prime_frame_free(struct vo *vo, struct prime_frame *frame)
+{
+#if HAVE_DRMPRIME
+    struct priv *p = vo->priv;
+    drm_prime_destroy_framebuffer(vo->log, p->kms->fd, &frame->fb);
+#endif
+    mp_image_unrefp(&frame->image);
+}
+
+#if HAVE_DRMPRIME
+static void prime_draw_image(struct vo *vo, struct mp_image *mpi)
+{
+    struct priv *p = vo->priv;
+
+    if (mpi == p->prime_cur.image && !p->prime_next.image)
+        return; // redraw; it's already on the overlay
+
+    prime_frame_free(vo, &p->prime_next);
+
+    AVDRMFrameDescriptor *desc = (AVDRMFrameDescriptor *)mpi->planes[0];
+    struct prime_frame next = {0};
+    if (drm_prime_create_framebuffer(vo->log, p->kms->fd, desc, mpi->w, mpi->h,
+                                     &next.fb) < 0)
+        return;
+    next.image = mp_image_new_ref(mpi);
+    p->prime_next = next;
+}
+
+// Put prime_next on the overlay plane. The plane does the scaling and format
+// conversion. Completion is signaled with a page flip event.
+static bool prime_commit(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+    struct drm_atomic_context *ctx = p->kms->atomic_context;
+    struct drm_object *plane = ctx->overlay_plane;
+
+    drmModeAtomicReq *req = drmModeAtomicAlloc();
+    if (!req)
+        return false;
+
+    int src_w = p->src.x1 - p->src.x0, src_h = p->src.y1 - p->src.y0;
+    drm_object_set_property(req, plane, "FB_ID", p->prime_next.fb.fb_id);
+    drm_object_set_property(req, plane, "CRTC_ID", ctx->crtc->id);
+    drm_object_set_property(req, plane, "SRC_X", (uint64_t)p->src.x0 << 16);
+    drm_object_set_property(req, plane, "SRC_Y", (uint64_t)p->src.y0 << 16);
+    drm_object_set_property(req, plane, "SRC_W", (uint64_t)src_w << 16);
+    drm_object_set_property(req, plane, "SRC_H", (uint64_t)src_h << 16);
+    drm_object_set_property(req, plane, "CRTC_X", p->dst.x0);
+    drm_object_set_property(req, plane, "CRTC_Y", p->dst.y0);
+    drm_object_set_property(req, plane, "CRTC_W", p->dst.x1 - p->dst.x0);
+    drm_object_set_property(req, plane, "CRTC_H", p->dst.y1 - p->dst.y0);
+
+    int ret = drmModeAtomicCommit(p->kms->fd, req, DRM_MODE_ATOMIC_NONBLOCK |
+                                  DRM_MODE_PAGE_FLIP_EVENT, p);
+    drmModeAtomicFree(req);
+    if (ret < 0) {
+        MP_WARN(vo, "Failed to commit the overlay plane %d: %s\n",
+                plane->id, mp_strerror(errno));
+        prime_frame_free(vo, &p->prime_next);
+        return false;
+    }
+
+    // The previous flip completed before this commit (flip_page() waits for
+    // the event), so prime_old is not scanned out anymore.
+    prime_frame_free(vo, &p->prime_old);
+    p->prime_old = p->prime_cur;
+    p->prime_cur = p->prime_next;
+    p->prime_next = (struct prime_frame){0};
+    return true;
+}
+#endif
+
 static void page_flipped(int fd, unsigned int frame, unsigned int sec,
                          unsigned int usec, void *data)
 {
@@ -270,6 +360,18 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     vo->dheight = p->screen_h;
     vo_get_src_dst_rects(vo, &p->src, &p->dst, &p->osd);
 
+    struct framebuffer *buf = p->bufs;
+    for (unsigned int i = 0; i < BUF_COUNT; i++)
+        memset(buf[i].map, 0, buf[i].size);
+
+    p->prime = params->imgfmt == IMGFMT_DRMPRIME;
+    if (p->prime) {
+        MP_VERBOSE(vo, "Using the overlay plane for DRM PRIME frames. OSD is "
+                   "not rendered.\n");
+        vo->want_redraw = true;
+        return 0;
+    }
+
     int w = p->dst.x1 - p->dst.x0;
     int h = p->dst.y1 - p->dst.y0;
 
@@ -298,10 +400,6 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     mp_image_params_guess_csp(&p->sws->dst);
     mp_image_set_params(p->cur_frame, &p->sws->dst);
 
-    struct framebuffer *buf = p->bufs;
-    for (unsigned int i = 0; i < BUF_COUNT; i++)
-        memset(buf[i].map, 0, buf[i].size);
-
     if (mp_sws_reinit(p->sws) < 0)
         return -1;
 
@@ -313,6 +411,14 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
 {
     struct priv *p = vo->priv;
 
+#if HAVE_DRMPRIME
+    if (p->prime) {
+        if (p->active && mpi)
+            prime_draw_image(vo, mpi);
+        goto done;
+    }
+#endif
+
     if (p->active) {
         if (mpi) {
             struct mp_image src = *mpi;
@@ -338,6 +444,7 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
                    p->cur_frame->stride[0]);
     }
 
+done:
     if (mpi != p->last_input) {
         talloc_free(p->last_input);
         p->last_input = mpi;
@@ -350,15 +457,25 @@ static void flip_page(struct vo *vo)
     if (!p->active || p->pflip_happening)
         return;
 
-    int ret = drmModePageFlip(p->kms->fd, p->kms->crtc_id,
+    int ret;
+#if HAVE_DRMPRIME
+    if (p->prime) {
+        if (!p->prime_next.image || !prime_commit(vo))
+            return;
+        p->pflip_happening = true;
+    } else
+#endif
+    {
+        ret = drmModePageFlip(p->kms->fd, p->kms->crtc_id,
                               p->bufs[p->front_buf].fb,
                               DRM_MODE_PAGE_FLIP_EVENT, p);
-    if (ret) {
-        MP_WARN(vo, "Cannot flip page for connector\n");
-    } else {
-        p->front_buf++;
-        p->front_buf %= BUF_COUNT;
-        p->pflip_happening = true;
+        if (ret) {
+            MP_WARN(vo, "Cannot flip page for connector\n");
+        } else {
+            p->front_buf++;
+            p->front_buf %= BUF_COUNT;
+            p->pflip_happening = true;
+        }
     }
 
     // poll page flip finish event
@@ -383,6 +500,10 @@ static void uninit(struct vo *vo)
     crtc_release(vo);
 
     if (p->kms) {
+        // Removing the framebuffers also disables the overlay plane.
+        prime_frame_free(vo, &p->prime_next);
+        prime_frame_free(vo, &p->prime_cur);
+        prime_frame_free(vo, &p->prime_old);
         for (unsigned int i = 0; i < BUF_COUNT; i++)
             fb_destroy(p->kms->fd, &p->bufs[i]);
         kms_destroy(p->kms);
@@ -449,6 +570,11 @@ err:
 
 static int query_format(struct vo *vo, int format)
 {
+#if HAVE_DRMPRIME
+    struct priv *p = vo->priv;
+    if (format == IMGFMT_DRMPRIME)
+        return !!p->kms->atomic_context;
+#endif
     return sws_isSupportedInput(imgfmt2pixfmt(format));
 }
 
@@ -457,6 +583,8 @@ static int control(struct vo *vo, uint32_t request, void *arg)
     struct priv *p = vo->priv;
     switch (request) {
     case VOCTRL_SCREENSHOT_WIN:
+        if (p->prime)
+            break; // the video is not in our buffers
         *(struct mp_image**)arg = mp_image_new_copy(p->cur_frame);
         return VO_TRUE;
     case VOCTRL_REDRAW_FRAME:
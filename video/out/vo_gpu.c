@@ -36,12 +36,21 @@
 #include "options/m_config.h"
 #include "vo.h"
 #include "video/mp_image.h"
+#include "osdep/timer.h"
 #include "sub/osd.h"
 
 #include "gpu/context.h"
 #include "gpu/hwdec.h"
 #include "gpu/video.h"
 
+// A pending VOCTRL_SCREENSHOT_WIN_ASYNC request
+struct screenshot_req {
+    struct voctrl_screenshot_async cb;
+    struct ra_buf *buf;     // NULL until the download was started
+    int w, h, imgfmt;
+    bool flip;
+};
+
 struct gpu_priv {
     struct mp_log *log;
     struct ra_ctx *ctx;
@@ -53,6 +62,10 @@ struct gpu_priv {
     struct ra_hwdec *hwdec;
 
     int events;
+
+    struct screenshot_req **screenshots;
+    int num_screenshots;
+    bool rendered;          // a frame was rendered since the last event check
 };
 
 static void resize(struct vo *vo)
@@ -76,6 +89,82 @@ static void resize(struct vo *vo)
     vo->want_redraw = true;
 }
 
+static void finish_screenshot(struct gpu_priv *p, int n, struct mp_image *img)
+{
+    struct screenshot_req *req = p->screenshots[n];
+    MP_TARRAY_REMOVE_AT(p->screenshots, p->num_screenshots, n);
+    if (req->buf)
+        ra_buf_free(p->ctx->ra, &req->buf);
+    req->cb.cb(req->cb.ctx, img);
+    talloc_free(req);
+}
+
+// Start reading back the frame just rendered for all new requests.
+static void start_screenshots(struct gpu_priv *p, struct ra_fbo *fbo)
+{
+    struct ra *ra = p->ctx->ra;
+
+    for (int n = p->num_screenshots - 1; n >= 0; n--) {
+        struct screenshot_req *req = p->screenshots[n];
+        if (req->buf)
+            continue;
+
+        // Only 8 bit RGB framebuffers can be converted without extra work
+        const struct ra_format *fmt = fbo->tex->params.format;
+        req->imgfmt = 0;
+        if (!fmt->pixel_size || strcmp(fmt->name, "rgba8") == 0)
+            req->imgfmt = IMGFMT_RGB0;
+        if (strcmp(fmt->name, "bgra8") == 0)
+            req->imgfmt = IMGFMT_BGR0;
+
+        req->w = fbo->tex->params.w;
+        req->h = fbo->tex->params.h;
+        req->flip = fbo->flip;
+        if (req->imgfmt && fbo->tex->params.downloadable) {
+            req->buf = ra_buf_create(ra, &(struct ra_buf_params){
+                .type = RA_BUF_TYPE_TEX_DOWNLOAD,
+                .size = (size_t)req->w * req->h * 4,
+                .host_mapped = true,
+            });
+        }
+        if (!req->buf || !ra->fns->tex_download(ra, fbo->tex, req->buf)) {
+            MP_ERR(p, "Could not read back the framebuffer.\n");
+            finish_screenshot(p, n, NULL);
+        }
+    }
+}
+
+// Deliver all screenshots whose download has finished. If wait is set, block
+// until they are.
+static void poll_screenshots(struct gpu_priv *p, bool wait)
+{
+    struct ra *ra = p->ctx->ra;
+
+    for (int n = p->num_screenshots - 1; n >= 0; n--) {
+        struct screenshot_req *req = p->screenshots[n];
+        if (!req->buf)
+            continue;
+
+        while (!ra->fns->buf_poll(ra, req->buf)) {
+            if (!wait)
+                goto next;
+            mp_sleep_us(1000);
+        }
+
+        struct mp_image *img = mp_image_alloc(req->imgfmt, req->w, req->h);
+        if (img) {
+            memcpy_pic(img->planes[0], req->buf->data, req->w * 4, req->h,
+                       img->stride[0], req->w * 4);
+            // Rows start at the bottom of the screen for flipped rendering
+            if (req->flip)
+                mp_image_vflip(img);
+            img->params.color = gl_video_get_output_colorspace(p->renderer);
+        }
+        finish_screenshot(p, n, img);
+    next: ;
+    }
+}
+
 static void draw_frame(struct vo *vo, struct vo_frame *frame)
 {
     struct gpu_priv *p = vo->priv;
@@ -86,6 +175,11 @@ static void draw_frame(struct vo *vo, struct vo_frame *frame)
         return;
 
     gl_video_render_frame(p->renderer, frame, fbo);
+    if (gl_video_frame_incomplete(p->renderer))
+        vo->want_redraw = true;
+    if (p->num_screenshots)
+        start_screenshots(p, &fbo);
+    p->rendered = true;
     if (!sw->fns->submit_frame(sw, frame)) {
         MP_ERR(vo, "Failed presenting frame!\n");
         return;
@@ -97,6 +191,16 @@ static void flip_page(struct vo *vo)
     struct gpu_priv *p = vo->priv;
     struct ra_swapchain *sw = p->ctx->swapchain;
     sw->fns->swap_buffers(sw);
+    if (p->num_screenshots)
+        poll_screenshots(p, false);
+}
+
+static void get_vsync(struct vo *vo, struct vo_vsync_info *info)
+{
+    struct gpu_priv *p = vo->priv;
+    struct ra_swapchain *sw = p->ctx->swapchain;
+    if (sw->fns->get_vsync)
+        sw->fns->get_vsync(sw, info);
 }
 
 static int query_format(struct vo *vo, int format)
@@ -194,6 +298,16 @@ static int control(struct vo *vo, uint32_t request, void *data)
         *(struct mp_image **)data = screen;
         return true;
     }
+    case VOCTRL_SCREENSHOT_WIN_ASYNC: {
+        if (!p->ctx->ra->fns->tex_download)
+            break;
+        struct screenshot_req *req = talloc_ptrtype(NULL, req);
+        *req = (struct screenshot_req){
+            .cb = *(struct voctrl_screenshot_async *)data,
+        };
+        MP_TARRAY_APPEND(p, p->screenshots, p->num_screenshots, req);
+        return true;
+    }
     case VOCTRL_LOAD_HWDEC_API:
         request_hwdec_api(vo, data);
         return true;
@@ -213,6 +327,26 @@ static int control(struct vo *vo, uint32_t request, void *data)
     case VOCTRL_PERFORMANCE_DATA:
         gl_video_perfdata(p->renderer, (struct voctrl_performance_data *)data);
         return true;
+    case VOCTRL_SHADER_CACHE_STATS:
+        gl_video_shader_cache_stats(p->renderer, data);
+        return true;
+    case VOCTRL_GPU_MEMORY_STATS:
+        if (!p->ctx->ra->fns->memory_stats)
+            break;
+        p->ctx->ra->fns->memory_stats(p->ctx->ra, data);
+        return true;
+    case VOCTRL_UPLOAD_STATS:
+        if (!p->ctx->ra->fns->upload_stats)
+            break;
+        p->ctx->ra->fns->upload_stats(p->ctx->ra, data);
+        return true;
+    }
+
+    if (request == VOCTRL_CHECK_EVENTS && p->num_screenshots) {
+        // Don't let a request starve if nothing is being rendered (e.g. the
+        // frame was rendered while paused).
+        poll_screenshots(p, !p->rendered);
+        p->rendered = false;
     }
 
     int events = 0;
@@ -265,6 +399,9 @@ static void uninit(struct vo *vo)
 {
     struct gpu_priv *p = vo->priv;
 
+    while (p->num_screenshots)
+        finish_screenshot(p, 0, NULL);
+
     gl_video_uninit(p->renderer);
     ra_hwdec_uninit(p->hwdec);
     if (vo->hwdec_devs) {
@@ -329,7 +466,7 @@ static const struct gpu_priv defaults = { .opts = {
 const struct vo_driver video_out_gpu = {
     .description = "Shader-based GPU Renderer",
     .name = "gpu",
-    .caps = VO_CAP_ROTATE90,
+    .caps = VO_CAP_ROTATE90 | VO_CAP_GPU_OPS,
     .preinit = preinit,
     .query_format = query_format,
     .reconfig = reconfig,
@@ -337,6 +474,7 @@ const struct vo_driver video_out_gpu = {
     .get_image = get_image,
     .draw_frame = draw_frame,
     .flip_page = flip_page,
+    .get_vsync = get_vsync,
     .wait_events = wait_events,
     .wakeup = wakeup,
     .uninit = uninit,
@@ -21,11 +21,14 @@
 #include <math.h>
 #include <stdbool.h>
 #include <sys/stat.h>
+#include <pthread.h>
 
 #include <libswscale/swscale.h>
+#include <libavutil/cpu.h>
 
 #include "config.h"
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
 #include "osdep/io.h"
 #include "options/m_config.h"
 #include "options/path.h"
@@ -50,6 +53,7 @@ static const struct m_sub_options image_writer_conf = {
 struct vo_image_opts {
     struct image_writer_opts *opts;
     char *outdir;
+    int threads;
 };
 
 #define OPT_BASE_STRUCT struct vo_image_opts
@@ -58,6 +62,7 @@ static const struct m_sub_options vo_image_conf = {
     .opts = (const struct m_option[]) {
         OPT_SUBSTRUCT("vo-image", opts, image_writer_conf, 0),
         OPT_STRING("vo-image-outdir", outdir, M_OPT_FILE),
+        OPT_INTRANGE("vo-image-threads", threads, 0, 0, 64),
         {0},
     },
     .size = sizeof(struct vo_image_opts),
@@ -68,8 +73,53 @@ struct priv {
 
     struct mp_image *current;
     int frame;
+
+    // Images are encoded on the pool. The number of queued and running jobs
+    // is limited to max_pending, to bound memory usage.
+    struct mp_thread_pool *pool;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int pending;
+    int max_pending;
+};
+
+struct write_job {
+    struct vo *vo;
+    struct mp_image *img;
+    char *filename;
 };
 
+static void write_job_run(void *arg)
+{
+    struct write_job *job = arg;
+    struct vo *vo = job->vo;
+    struct priv *p = vo->priv;
+
+    // Frames are already encoded in parallel, so don't add more threads per
+    // frame by default.
+    struct image_writer_opts opts = *p->opts->opts;
+    if (p->pool && !opts.encoder_threads)
+        opts.encoder_threads = 1;
+
+    MP_INFO(vo, "Saving %s\n", job->filename);
+    write_image(job->img, &opts, job->filename, vo->log);
+    talloc_free(job);
+
+    pthread_mutex_lock(&p->lock);
+    p->pending--;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Wait until at most max jobs are queued or running.
+static void wait_pending(struct priv *p, int max)
+{
+    pthread_mutex_lock(&p->lock);
+    while (p->pending > max)
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
 static bool checked_mkdir(struct vo *vo, const char *buf)
 {
     MP_INFO(vo, "Creating output directory '%s'...\n", buf);
@@ -112,18 +162,34 @@ static void flip_page(struct vo *vo)
 
     (p->frame)++;
 
-    void *t = talloc_new(NULL);
-    char *filename = talloc_asprintf(t, "%08d.%s", p->frame,
-                                     image_writer_file_ext(p->opts->opts));
+    // The file name is picked here, so the order doesn't depend on which
+    // job finishes first.
+    struct write_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct write_job){
+        .vo = vo,
+        .img = talloc_steal(job, p->current),
+    };
+    p->current = NULL;
+    job->filename = talloc_asprintf(job, "%08d.%s", p->frame,
+                                    image_writer_file_ext(p->opts->opts));
 
     if (p->opts->outdir && strlen(p->opts->outdir))
-        filename = mp_path_join(t, p->opts->outdir, filename);
+        job->filename = mp_path_join(job, p->opts->outdir, job->filename);
 
-    MP_INFO(vo, "Saving %s\n", filename);
-    write_image(p->current, p->opts->opts, filename, vo->log);
+    if (!p->pool) {
+        write_job_run(job);
+        return;
+    }
 
-    talloc_free(t);
-    mp_image_unrefp(&p->current);
+    wait_pending(p, p->max_pending - 1);
+    pthread_mutex_lock(&p->lock);
+    p->pending++;
+    pthread_mutex_unlock(&p->lock);
+    mp_thread_pool_queue_job(p->pool, &(struct mp_thread_pool_job){
+        .fn = write_job_run,
+        .fn_ctx = job,
+        .prio = MP_THREAD_POOL_PRIO_BACKGROUND,
+    });
 }
 
 static int query_format(struct vo *vo, int fmt)
@@ -138,14 +204,32 @@ static void uninit(struct vo *vo)
     struct priv *p = vo->priv;
 
     mp_image_unrefp(&p->current);
+    wait_pending(p, 0);
+    talloc_free(p->pool); // joins the threads
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
 }
 
 static int preinit(struct vo *vo)
 {
     struct priv *p = vo->priv;
     p->opts = mp_get_config_group(vo, vo->global, &vo_image_conf);
-    if (p->opts->outdir && !checked_mkdir(vo, p->opts->outdir))
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+    if (p->opts->outdir && !checked_mkdir(vo, p->opts->outdir)) {
+        uninit(vo);
         return -1;
+    }
+
+    int threads = p->opts->threads;
+    if (!threads)
+        threads = MPMAX(av_cpu_count(), 1);
+    if (threads > 1) {
+        p->pool = mp_thread_pool_create_shared(vo, vo->global, threads);
+        p->max_pending = threads * 2;
+        if (!p->pool)
+            MP_WARN(vo, "Could not create threads, encoding synchronously.\n");
+    }
     return 0;
 }
 
@@ -35,9 +35,13 @@
 
 #include "sub/osd.h"
 
+// Number of frames queued for the encoder thread
+#define ENCODE_QUEUE_SIZE 4
+
 struct priv {
     AVStream *stream;
     AVCodecContext *codec;
+    struct encode_thread *encoder;
     int have_first_packet;
 
     int harddup;
@@ -71,6 +75,7 @@ static int preinit(struct vo *vo)
 }
 
 static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi);
+static void write_packet(void *priv, AVFrame *frame, AVPacket *packet);
 static void uninit(struct vo *vo)
 {
     struct priv *vc = vo->priv;
@@ -86,6 +91,9 @@ static void uninit(struct vo *vo)
 
     pthread_mutex_unlock(&vo->encode_lavc_ctx->lock);
 
+    encode_thread_destroy(vc->encoder);
+    vc->encoder = NULL;
+
     vc->shutdown = true;
 }
 
@@ -160,6 +168,11 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     if (encode_lavc_open_codec(vo->encode_lavc_ctx, vc->codec) < 0)
         goto error;
 
+    vc->encoder = encode_thread_create(vo->encode_lavc_ctx, vc->codec, vo->log,
+                                       ENCODE_QUEUE_SIZE, write_packet, vo);
+    if (!vc->encoder)
+        goto error;
+
 done:
     pthread_mutex_unlock(&vo->encode_lavc_ctx->lock);
     return 0;
@@ -185,8 +198,10 @@ static int query_format(struct vo *vo, int format)
     return flags;
 }
 
-static void write_packet(struct vo *vo, AVPacket *packet)
+// Called on the encoder thread, with the encode_lavc_context lock held.
+static void write_packet(void *priv, AVFrame *frame, AVPacket *packet)
 {
+    struct vo *vo = priv;
     struct priv *vc = vo->priv;
 
     packet->stream_index = vc->stream->index;
@@ -235,47 +250,6 @@ static void write_packet(struct vo *vo, AVPacket *packet)
     vc->have_first_packet = 1;
 }
 
-static void encode_video_and_write(struct vo *vo, AVFrame *frame)
-{
-    struct priv *vc = vo->priv;
-    AVPacket packet = {0};
-
-    int status = avcodec_send_frame(vc->codec, frame);
-    if (status < 0) {
-        MP_ERR(vo, "error encoding at %d %d/%d\n",
-               frame ? (int) frame->pts : -1,
-               vc->codec->time_base.num,
-               vc->codec->time_base.den);
-        return;
-    }
-    for (;;) {
-        av_init_packet(&packet);
-        status = avcodec_receive_packet(vc->codec, &packet);
-        if (status == AVERROR(EAGAIN)) { // No more packets for now.
-            if (frame == NULL) {
-                MP_ERR(vo, "sent flush frame, got EAGAIN");
-            }
-            break;
-        }
-        if (status == AVERROR_EOF) { // No more packets, ever.
-            if (frame != NULL) {
-                MP_ERR(vo, "sent image frame, got EOF");
-            }
-            break;
-        }
-        if (status < 0) {
-            MP_ERR(vo, "error encoding at %d %d/%d\n",
-                   frame ? (int) frame->pts : -1,
-                   vc->codec->time_base.num,
-                   vc->codec->time_base.den);
-            break;
-        }
-        encode_lavc_write_stats(vo->encode_lavc_ctx, vc->codec);
-        write_packet(vo, &packet);
-        av_packet_unref(&packet);
-    }
-}
-
 static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
 {
     struct priv *vc = vo->priv;
@@ -436,8 +410,7 @@ static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
                                           vc->worst_time_base, avc->time_base);
                 frame->pict_type = 0; // keep this at unknown/undefined
                 frame->quality = avc->global_quality;
-                encode_video_and_write(vo, frame);
-                av_frame_free(&frame);
+                encode_thread_submit(vc->encoder, frame);
 
                 ++vc->lastdisplaycount;
                 vc->lastencodedipts = vc->lastipts + skipframes;
@@ -449,7 +422,7 @@ static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
 
     if (!mpi) {
         // finish encoding
-        encode_video_and_write(vo, NULL);
+        encode_thread_submit(vc->encoder, NULL);
     } else {
         if (frameipts >= vc->lastframeipts) {
             if (vc->lastframeipts != AV_NOPTS_VALUE && vc->lastdisplaycount != 1)
@@ -44,12 +44,7 @@ static void flip_page(struct vo *vo)
         int64_t ft = 1e6 / p->cfg_fps;
         int64_t prev_vsync = mp_time_us() / ft;
         int64_t target_time = (prev_vsync + 1) * ft;
-        for (;;) {
-            int64_t now = mp_time_us();
-            if (now >= target_time)
-                break;
-            mp_sleep_us(target_time - now);
-        }
+        mp_sleep_until_us(target_time);
     }
 }
 
@@ -69,6 +69,8 @@ struct mpv_opengl_cb_context {
     int64_t expected_flip_count;    // next vsync event for next_frame
     bool redrawing;                 // next_frame was a redraw request
     int64_t flip_count;
+    int64_t last_flip_time;         // as passed to mpv_opengl_cb_report_flip
+    bool need_redraw;               // update callback was invoked for a redraw
     struct vo_frame *cur_frame;
     struct mp_image_params img_params;
     bool reconfigured, reset;
@@ -303,6 +305,7 @@ int mpv_opengl_cb_draw(mpv_opengl_cb_context *ctx, int fbo, int vp_w, int vp_h)
     }
     ctx->reconfigured = false;
     ctx->update_new_opts = false;
+    ctx->need_redraw = false;
 
     if (ctx->reset) {
         gl_video_reset(ctx->renderer);
@@ -360,15 +363,38 @@ int mpv_opengl_cb_report_flip(mpv_opengl_cb_context *ctx, int64_t time)
 
     pthread_mutex_lock(&ctx->lock);
     ctx->flip_count += 1;
+    ctx->last_flip_time = time > 0 ? time : mp_time_us();
     pthread_cond_signal(&ctx->wakeup);
     pthread_mutex_unlock(&ctx->lock);
 
     return 0;
 }
 
+int mpv_opengl_cb_get_frame_info(mpv_opengl_cb_context *ctx,
+                                 mpv_opengl_cb_frame_info *info)
+{
+    pthread_mutex_lock(&ctx->lock);
+    *info = (mpv_opengl_cb_frame_info){.duration = -1};
+    struct vo_frame *frame = ctx->next_frame;
+    if (frame) {
+        bool redraw = frame->redraw || !frame->current;
+        info->flags |= redraw ? MPV_OPENGL_CB_FRAME_REDRAW
+                              : MPV_OPENGL_CB_FRAME_NEW;
+        info->target_time = MPMAX(frame->pts, 0);
+        if (frame->duration > 0)
+            info->duration = frame->duration;
+    }
+    if (ctx->need_redraw || ctx->force_update || ctx->reconfigured ||
+        ctx->update_new_opts || ctx->reset)
+        info->flags |= MPV_OPENGL_CB_FRAME_REDRAW;
+    pthread_mutex_unlock(&ctx->lock);
+    return 0;
+}
+
 // Called locked.
 static void update(struct vo_priv *p)
 {
+    p->ctx->need_redraw = true;
     if (p->ctx->update_cb)
         p->ctx->update_cb(p->ctx->update_cb_ctx);
 }
@@ -437,6 +463,19 @@ done:
     pthread_mutex_unlock(&p->ctx->lock);
 }
 
+static void get_vsync(struct vo *vo, struct vo_vsync_info *info)
+{
+    struct vo_priv *p = vo->priv;
+
+    // Only meaningful if the user reports flips at all. flip_page() waited
+    // for the report of the frame queued last.
+    pthread_mutex_lock(&p->ctx->lock);
+    if (p->ctx->flip_count && !p->ctx->redrawing &&
+        p->ctx->flip_count >= p->ctx->expected_flip_count)
+        info->last_queue_display_time = p->ctx->last_flip_time;
+    pthread_mutex_unlock(&p->ctx->lock);
+}
+
 static int query_format(struct vo *vo, int format)
 {
     struct vo_priv *p = vo->priv;
@@ -537,13 +576,14 @@ static int preinit(struct vo *vo)
 const struct vo_driver video_out_opengl_cb = {
     .description = "OpenGL Callbacks for libmpv",
     .name = "opengl-cb",
-    .caps = VO_CAP_ROTATE90,
+    .caps = VO_CAP_ROTATE90 | VO_CAP_GPU_OPS,
     .preinit = preinit,
     .query_format = query_format,
     .reconfig = reconfig,
     .control = control,
     .draw_frame = draw_frame,
     .flip_page = flip_page,
+    .get_vsync = get_vsync,
     .uninit = uninit,
     .priv_size = sizeof(struct vo_priv),
 };
@@ -16,6 +16,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <config.h>
 
@@ -31,6 +32,7 @@
 #include "sub/osd.h"
 #include "video/sws_utils.h"
 #include "video/mp_image.h"
+#include "misc/bstr.h"
 
 #define IMGFMT IMGFMT_BGR24
 
@@ -41,10 +43,6 @@
 #define ESC_CLEAR_SCREEN "\e[2J"
 #define ESC_CLEAR_COLORS "\e[0m"
 #define ESC_GOTOXY "\e[%d;%df"
-#define ESC_COLOR_BG "\e[48;2;%d;%d;%dm"
-#define ESC_COLOR_FG "\e[38;2;%d;%d;%dm"
-#define ESC_COLOR256_BG "\e[48;5;%dm"
-#define ESC_COLOR256_FG "\e[38;5;%dm"
 #define DEFAULT_WIDTH 80
 #define DEFAULT_HEIGHT 25
 
@@ -53,6 +51,8 @@ struct vo_tct_opts {
     int width;   // 0 -> default
     int height;  // 0 -> default
     int term256;  // 0 -> true color
+    int incremental;
+    int threshold;
 };
 
 #define OPT_BASE_STRUCT struct vo_tct_opts
@@ -64,6 +64,8 @@ static const struct m_sub_options vo_tct_conf = {
         OPT_INT("vo-tct-width", width, 0),
         OPT_INT("vo-tct-height", height, 0),
         OPT_FLAG("vo-tct-256", term256, 0),
+        OPT_FLAG("vo-tct-incremental", incremental, 0),
+        OPT_INTRANGE("vo-tct-threshold", threshold, 0, 0, 255),
         {0}
     },
     .defaults = &(const struct vo_tct_opts) {
@@ -72,10 +74,16 @@ static const struct m_sub_options vo_tct_conf = {
     .size = sizeof(struct vo_tct_opts),
 };
 
+// The colors of a terminal cell, as 0xRRGGBB. For ALGO_PLAIN, fg is unused.
+struct cell {
+    uint32_t bg, fg;
+};
+
 struct priv {
     struct vo_tct_opts *opts;
-    size_t buffer_size;
-    char *buffer;
+    bstr out;               // output for the current frame
+    struct cell *cells;     // what is on the terminal, swidth*sheight
+    bool cells_valid;
     int swidth;
     int sheight;
     struct mp_image *frame;
@@ -113,66 +121,110 @@ static int rgb_to_x256(uint8_t r, uint8_t g, uint8_t b)
     return color_err <= gray_err ? 16 + color_index() : 232 + gray_index;
 }
 
-static void write_plain(
-    const int dwidth, const int dheight,
-    const int swidth, const int sheight,
-    const unsigned char *source, const int source_stride,
-    bool term256)
+static void append_str(struct priv *p, const char *s)
 {
-    assert(source);
-    const int tx = (dwidth - swidth) / 2;
-    const int ty = (dheight - sheight) / 2;
-    for (int y = 0; y < sheight; y++) {
-        const unsigned char *row = source + y * source_stride;
-        printf(ESC_GOTOXY, ty + y, tx);
-        for (int x = 0; x < swidth; x++) {
-            unsigned char b = *row++;
-            unsigned char g = *row++;
-            unsigned char r = *row++;
-            if (term256) {
-                printf(ESC_COLOR256_BG, rgb_to_x256(r, g, b));
-            } else {
-                printf(ESC_COLOR_BG, r, g, b);
-            }
-            printf(" ");
-        }
-        printf(ESC_CLEAR_COLORS);
+    bstr_xappend(p, &p->out, bstr0(s));
+}
+
+static void append_num(struct priv *p, unsigned v)
+{
+    char tmp[12];
+    int n = sizeof(tmp);
+    do {
+        tmp[--n] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    bstr_xappend(p, &p->out, (bstr){tmp + n, sizeof(tmp) - n});
+}
+
+static void append_color(struct priv *p, bool fg, uint32_t c)
+{
+    uint8_t r = c >> 16, g = c >> 8, b = c;
+    if (p->opts->term256) {
+        append_str(p, fg ? "\e[38;5;" : "\e[48;5;");
+        append_num(p, rgb_to_x256(r, g, b));
+    } else {
+        append_str(p, fg ? "\e[38;2;" : "\e[48;2;");
+        append_num(p, r);
+        append_str(p, ";");
+        append_num(p, g);
+        append_str(p, ";");
+        append_num(p, b);
     }
-    printf("\n");
+    append_str(p, "m");
 }
 
-static void write_half_blocks(
-    const int dwidth, const int dheight,
-    const int swidth, const int sheight,
-    unsigned char *source, int source_stride,
-    bool term256)
+static uint32_t read_bgr(const unsigned char *px)
 {
-    assert(source);
-    const int tx = (dwidth - swidth) / 2;
-    const int ty = (dheight - sheight) / 2;
-    for (int y = 0; y < sheight * 2; y += 2) {
-        const unsigned char *row_up = source + y * source_stride;
-        const unsigned char *row_down = source + (y + 1) * source_stride;
-        printf(ESC_GOTOXY, ty + y / 2, tx);
-        for (int x = 0; x < swidth; x++) {
-            unsigned char b_up = *row_up++;
-            unsigned char g_up = *row_up++;
-            unsigned char r_up = *row_up++;
-            unsigned char b_down = *row_down++;
-            unsigned char g_down = *row_down++;
-            unsigned char r_down = *row_down++;
-            if (term256) {
-                printf(ESC_COLOR256_BG, rgb_to_x256(r_up, g_up, b_up));
-                printf(ESC_COLOR256_FG, rgb_to_x256(r_down, g_down, b_down));
-            } else {
-                printf(ESC_COLOR_BG, r_up, g_up, b_up);
-                printf(ESC_COLOR_FG, r_down, g_down, b_down);
+    return (px[2] << 16) | (px[1] << 8) | px[0];
+}
+
+// Largest difference of a color component.
+static int color_dist(uint32_t a, uint32_t b)
+{
+    int d = 0;
+    for (int shift = 0; shift < 24; shift += 8)
+        d = MPMAX(d, abs((int)((a >> shift) & 0xFF) - (int)((b >> shift) & 0xFF)));
+    return d;
+}
+
+// Convert the scaled frame to terminal output in p->out. If p->cells is
+// valid, only cells whose colors changed by more than the threshold are
+// written. Escape sequences are omitted for runs of cells with the same
+// colors, and for positioning the cursor on consecutive cells.
+static void write_frame(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+    bool half = p->opts->algo != ALGO_PLAIN;
+    int threshold = p->opts->incremental ? p->opts->threshold : -1;
+    const int tx = (vo->dwidth - p->swidth) / 2;
+    const int ty = (vo->dheight - p->sheight) / 2;
+    const unsigned char *source = p->frame->planes[0];
+    const int stride = p->frame->stride[0];
+
+    p->out.len = 0;
+    for (int y = 0; y < p->sheight; y++) {
+        const unsigned char *row_up = source + y * (half ? 2 : 1) * stride;
+        const unsigned char *row_down = row_up + stride;
+        struct cell *cells = &p->cells[y * p->swidth];
+        bool have_colors = false, at_pos = false;
+        struct cell cur = {0};
+        for (int x = 0; x < p->swidth; x++) {
+            struct cell c = { .bg = read_bgr(row_up + x * 3) };
+            if (half)
+                c.fg = read_bgr(row_down + x * 3);
+
+            if (p->cells_valid && color_dist(c.bg, cells[x].bg) <= threshold &&
+                (!half || color_dist(c.fg, cells[x].fg) <= threshold))
+            {
+                at_pos = false;
+                continue;
+            }
+            cells[x] = c;
+
+            if (!at_pos) {
+                append_str(p, "\e[");
+                append_num(p, ty + y);
+                append_str(p, ";");
+                append_num(p, tx + x);
+                append_str(p, "f");
+                at_pos = true;
             }
-            printf("\xe2\x96\x84");  // UTF8 bytes of U+2584 (lower half block)
+            if (!have_colors || c.bg != cur.bg)
+                append_color(p, false, c.bg);
+            if (half && (!have_colors || c.fg != cur.fg))
+                append_color(p, true, c.fg);
+            have_colors = true;
+            cur = c;
+            // UTF8 bytes of U+2584 (lower half block)
+            append_str(p, half ? "\xe2\x96\x84" : " ");
         }
-        printf(ESC_CLEAR_COLORS);
+        if (have_colors)
+            append_str(p, ESC_CLEAR_COLORS);
     }
-    printf("\n");
+    if (!p->cells_valid || p->out.len)
+        append_str(p, "\n");
+    p->cells_valid = p->opts->incremental;
 }
 
 static void get_win_size(struct vo *vo, int *out_width, int *out_height) {
@@ -204,8 +256,9 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     p->swidth = p->dst.x1 - p->dst.x0;
     p->sheight = p->dst.y1 - p->dst.y0;
 
-    if (p->buffer)
-        free(p->buffer);
+    talloc_free(p->cells);
+    p->cells = talloc_zero_array(p, struct cell, p->swidth * p->sheight);
+    p->cells_valid = false;
 
     mp_sws_set_from_cmdline(p->sws, vo->opts->sws_opts);
     p->sws->src = *params;
@@ -243,17 +296,8 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
 static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
-    if (p->opts->algo == ALGO_PLAIN) {
-        write_plain(
-            vo->dwidth, vo->dheight, p->swidth, p->sheight,
-            p->frame->planes[0], p->frame->stride[0],
-            p->opts->term256);
-    } else {
-        write_half_blocks(
-            vo->dwidth, vo->dheight, p->swidth, p->sheight,
-            p->frame->planes[0], p->frame->stride[0],
-            p->opts->term256);
-    }
+    write_frame(vo);
+    fwrite(p->out.start, p->out.len, 1, stdout);
     fflush(stdout);
 }
 
@@ -263,8 +307,6 @@ static void uninit(struct vo *vo)
     printf(ESC_CLEAR_SCREEN);
     printf(ESC_GOTOXY, 0, 0);
     struct priv *p = vo->priv;
-    if (p->buffer)
-        talloc_free(p->buffer);
     if (p->sws)
         talloc_free(p->sws);
 }
@@ -54,12 +54,16 @@
 #include "options/options.h"
 #include "osdep/timer.h"
 
+// Number of images in the ring. With XShm, the server may still be reading
+// up to NUM_BUFFERS - 1 of them while the next one is drawn.
+#define NUM_BUFFERS 3
+
 struct priv {
     struct vo *vo;
 
     struct mp_image *original_image;
 
-    XImage *myximage[2];
+    XImage *myximage[NUM_BUFFERS];
     int depth;
     GC gc;
 
@@ -81,12 +85,13 @@ struct priv {
 
 #if HAVE_SHM
     int Shmem_Flag;
-    XShmSegmentInfo Shminfo[2];
+    XShmSegmentInfo Shminfo[NUM_BUFFERS];
     int Shm_Warned_Slow;
 #endif
 };
 
 static bool resize(struct vo *vo);
+static void wait_for_completion(struct vo *vo, int max_outstanding);
 
 static bool getMyXImage(struct priv *p, int foo)
 {
@@ -210,7 +215,9 @@ static bool resize(struct vo *vo)
 {
     struct priv *p = vo->priv;
 
-    for (int i = 0; i < 2; i++)
+    // The server must be done reading the images before they're freed.
+    wait_for_completion(vo, 0);
+    for (int i = 0; i < NUM_BUFFERS; i++)
         freeMyXImage(p, i);
 
     vo_get_src_dst_rects(vo, &p->src, &p->dst, &p->osd);
@@ -235,7 +242,7 @@ static bool resize(struct vo *vo)
     p->image_width = (p->dst_w + 7) & (~7);
     p->image_height = p->dst_h;
 
-    for (int i = 0; i < 2; i++) {
+    for (int i = 0; i < NUM_BUFFERS; i++) {
         if (!getMyXImage(p, i))
             return -1;
     }
@@ -316,14 +323,14 @@ static void wait_for_completion(struct vo *vo, int max_outstanding)
     struct priv *ctx = vo->priv;
     struct vo_x11_state *x11 = vo->x11;
     if (ctx->Shmem_Flag) {
-        while (x11->ShmCompletionWaitCount > max_outstanding) {
+        vo_x11_check_events(vo);
+        if (x11->ShmCompletionWaitCount > max_outstanding) {
             if (!ctx->Shm_Warned_Slow) {
                 MP_WARN(vo, "can't keep up! Waiting"
                             " for XShm completion events...\n");
                 ctx->Shm_Warned_Slow = 1;
             }
-            mp_sleep_us(1000);
-            vo_x11_check_events(vo);
+            vo_x11_wait_shm_completion(vo, max_outstanding);
         }
     }
 #endif
@@ -333,7 +340,9 @@ static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
     Display_Image(p, p->myximage[p->current_buf]);
-    p->current_buf = (p->current_buf + 1) % 2;
+    p->current_buf = (p->current_buf + 1) % NUM_BUFFERS;
+    // Let the server start on the image while the next one is being drawn.
+    XFlush(vo->x11->display);
 }
 
 // Note: REDRAW_FRAME can call this with NULL.
@@ -341,7 +350,7 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
 {
     struct priv *p = vo->priv;
 
-    wait_for_completion(vo, 1);
+    wait_for_completion(vo, NUM_BUFFERS - 1);
 
     struct mp_image img = get_x_buffer(p, p->current_buf);
 
@@ -375,10 +384,11 @@ static int query_format(struct vo *vo, int format)
 static void uninit(struct vo *vo)
 {
     struct priv *p = vo->priv;
-    if (p->myximage[0])
-        freeMyXImage(p, 0);
-    if (p->myximage[1])
-        freeMyXImage(p, 1);
+    wait_for_completion(vo, 0);
+    for (int i = 0; i < NUM_BUFFERS; i++) {
+        if (p->myximage[i])
+            freeMyXImage(p, i);
+    }
     if (p->gc)
         XFreeGC(vo->x11->display, p->gc);
 
@@ -117,6 +117,7 @@ static const struct fmt_entry fmt_table[] = {
 };
 
 static bool allocate_xvimage(struct vo *, int);
+static void wait_for_completion(struct vo *vo, int max_outstanding);
 static void deallocate_xvimage(struct vo *vo, int foo);
 static struct mp_image get_xv_buffer(struct vo *vo, int buf_index);
 
@@ -510,6 +511,7 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     MP_VERBOSE(vo, "using Xvideo port %d for hw scaling\n", ctx->xv_port);
 
     // In case config has been called before
+    wait_for_completion(vo, 0);
     for (i = 0; i < ctx->num_buffers; i++)
         deallocate_xvimage(vo, i);
 
@@ -681,14 +683,14 @@ static void wait_for_completion(struct vo *vo, int max_outstanding)
     struct xvctx *ctx = vo->priv;
     struct vo_x11_state *x11 = vo->x11;
     if (ctx->Shmem_Flag) {
-        while (x11->ShmCompletionWaitCount > max_outstanding) {
+        vo_x11_check_events(vo);
+        if (x11->ShmCompletionWaitCount > max_outstanding) {
             if (!ctx->Shm_Warned_Slow) {
                 MP_WARN(vo, "X11 can't keep up! Waiting"
                         " for XShm completion events...\n");
                 ctx->Shm_Warned_Slow = 1;
             }
-            mp_sleep_us(1000);
-            vo_x11_check_events(vo);
+            vo_x11_wait_shm_completion(vo, max_outstanding);
         }
     }
 #endif
@@ -702,8 +704,12 @@ static void flip_page(struct vo *vo)
     /* remember the currently visible buffer */
     ctx->current_buf = (ctx->current_buf + 1) % ctx->num_buffers;
 
-    if (!ctx->Shmem_Flag)
+    if (!ctx->Shmem_Flag) {
         XSync(vo->x11->display, False);
+    } else {
+        // Completion is handled asynchronously in wait_for_completion().
+        XFlush(vo->x11->display);
+    }
 }
 
 // Note: REDRAW_FRAME can call this with NULL.
@@ -758,6 +764,7 @@ static void uninit(struct vo *vo)
         XFree(ctx->fo);
         ctx->fo = NULL;
     }
+    wait_for_completion(vo, 0);
     for (i = 0; i < ctx->num_buffers; i++)
         deallocate_xvimage(vo, i);
     if (ctx->f_gc != None)
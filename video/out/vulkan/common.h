@@ -50,9 +50,24 @@ struct mpvk_ctx {
 
     struct vk_malloc *alloc; // memory allocator for this device
     struct vk_cmdpool *pool; // primary command pool for this device
+    struct vk_cmdpool *pool_transfer; // dedicated transfer queue (optional)
+    // Queue families of all pools, for resources that are used concurrently
+    // by them (VK_SHARING_MODE_CONCURRENT if num_qfs > 1).
+    uint32_t qfs[2];
+    int num_qfs;
     struct vk_cmd *last_cmd; // most recently submitted command
     struct spirv_compiler *spirv; // GLSL -> SPIR-V compiler
 
     // Cached capabilities
     VkPhysicalDeviceLimits limits;
+
+    // Optional extensions, enabled if supported by the instance/device
+    bool has_ext_mem_caps;      // VK_KHR_external_memory_capabilities
+    bool has_ext_sem_caps;      // VK_KHR_external_semaphore_capabilities
+    bool has_dmabuf_import;     // VK_EXT_external_memory_dma_buf (and deps)
+    bool has_drm_modifiers;     // VK_EXT_image_drm_format_modifier (and deps)
+    bool has_d3d11_import;      // VK_KHR_external_memory_win32 (and deps)
+    bool has_export;            // exporting memory/semaphores (fd or win32)
+    bool has_memory_budget;     // VK_EXT_memory_budget
+    bool has_display_timing;    // VK_GOOGLE_display_timing
 };
@@ -16,6 +16,7 @@
  */
 
 #include "options/m_config.h"
+#include "osdep/timer.h"
 #include "video/out/gpu/spirv.h"
 
 #include "context.h"
@@ -104,6 +105,8 @@ const struct m_sub_options vulkan_conf = {
                    {"immediate",    SWAP_IMMEDIATE})),
         OPT_INTRANGE("vulkan-queue-count", dev_opts.queue_count, 0, 1,
                      MPVK_MAX_QUEUES, OPTDEF_INT(1)),
+        OPT_FLAG("vulkan-transfer-queue", dev_opts.transfer_queue, 0,
+                 OPTDEF_INT(1)),
         {0}
     },
     .size = sizeof(struct vulkan_opts)
@@ -112,6 +115,7 @@ const struct m_sub_options vulkan_conf = {
 struct priv {
     struct mpvk_ctx *vk;
     struct vulkan_opts *opts;
+    struct ra_vk_ctx_params params;
     // Swapchain metadata:
     int w, h;                 // current size
     VkSwapchainCreateInfoKHR protoInfo; // partially filled-in prototype
@@ -125,6 +129,11 @@ struct priv {
     int num_acquired;         // size of this pool
     int idx_acquired;         // index of next free semaphore within this pool
     int last_imgidx;          // the image index last acquired (for submit)
+    // presentation feedback (VK_GOOGLE_display_timing):
+    uint32_t present_id;      // ID of the last queued present
+    uint32_t timing_id;       // ID of the last present with known timing
+    uint64_t timing_time;     // actualPresentTime of timing_id (ns)
+    uint64_t refresh_duration; // duration of a refresh cycle (ns), or 0
 };
 
 static const struct ra_swapchain_fns vulkan_swapchain;
@@ -266,6 +275,7 @@ void ra_vk_ctx_uninit(struct ra_ctx *ctx)
 static const struct ra_swapchain_fns vulkan_swapchain;
 
 bool ra_vk_ctx_init(struct ra_ctx *ctx, struct mpvk_ctx *vk,
+                    struct ra_vk_ctx_params params,
                     VkPresentModeKHR preferred_mode)
 {
     struct ra_swapchain *sw = ctx->swapchain = talloc_zero(NULL, struct ra_swapchain);
@@ -274,6 +284,7 @@ bool ra_vk_ctx_init(struct ra_ctx *ctx, struct mpvk_ctx *vk,
 
     struct priv *p = sw->priv = talloc_zero(sw, struct priv);
     p->vk = vk;
+    p->params = params;
     p->opts = mp_get_config_group(p, ctx->global, &vulkan_conf);
 
     if (!mpvk_find_phys_device(vk, p->opts->device, ctx->opts.allow_sw))
@@ -355,7 +366,7 @@ bool ra_vk_ctx_resize(struct ra_swapchain *sw, int w, int h)
     // more than one swapchain already active, so we need to flush any pending
     // asynchronous swapchain release operations that may be ongoing.
     while (p->old_swapchain)
-        mpvk_dev_poll_cmds(vk, 100000); // 100μs
+        mpvk_dev_poll_cmds(vk, UINT64_MAX);
 
     VkSwapchainCreateInfoKHR sinfo = p->protoInfo;
     sinfo.imageExtent  = (VkExtent2D){ w, h };
@@ -368,6 +379,19 @@ bool ra_vk_ctx_resize(struct ra_swapchain *sw, int w, int h)
     p->w = w;
     p->h = h;
 
+    // Past presentation timings belong to the old swapchain
+    p->timing_id = 0;
+    p->refresh_duration = 0;
+#ifdef VK_GOOGLE_display_timing
+    if (vk->has_display_timing) {
+        VK_LOAD_PFN(vkGetRefreshCycleDurationGOOGLE);
+        VkRefreshCycleDurationGOOGLE rc;
+        if (pfn_vkGetRefreshCycleDurationGOOGLE(vk->dev, p->swapchain, &rc)
+                == VK_SUCCESS)
+            p->refresh_duration = rc.refreshDuration;
+    }
+#endif
+
     // Freeing the old swapchain while it's still in use is an error, so do
     // it asynchronously once the device is idle.
     if (sinfo.oldSwapchain) {
@@ -440,6 +464,8 @@ static bool start_frame(struct ra_swapchain *sw, struct ra_fbo *out_fbo)
     struct mpvk_ctx *vk = p->vk;
     if (!p->swapchain)
         goto error;
+    if (p->params.start_frame && !p->params.start_frame(sw->ctx))
+        goto error;
 
     uint32_t imgidx = 0;
     MP_TRACE(vk, "vkAcquireNextImageKHR\n");
@@ -494,6 +520,22 @@ static bool submit_frame(struct ra_swapchain *sw, const struct vo_frame *frame)
         .pImageIndices = &p->last_imgidx,
     };
 
+#ifdef VK_GOOGLE_display_timing
+    // Tag each present with an ID, so we can match the timings reported by
+    // get_vsync() to the frames. We don't request a specific present time.
+    VkPresentTimeGOOGLE ptime = { .presentID = ++p->present_id };
+    VkPresentTimesInfoGOOGLE ptimes = {
+        .sType = VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE,
+        .swapchainCount = 1,
+        .pTimes = &ptime,
+    };
+    if (vk->has_display_timing)
+        pinfo.pNext = &ptimes;
+#endif
+
+    if (p->params.submit_frame)
+        p->params.submit_frame(sw->ctx);
+
     VK(vkQueuePresentKHR(queue, &pinfo));
     return true;
 
@@ -505,8 +547,71 @@ static void swap_buffers(struct ra_swapchain *sw)
 {
     struct priv *p = sw->priv;
 
+    // Block on the fence of the oldest frame still being rendered, instead
+    // of waking up periodically to check. The commands of a frame complete in
+    // submission order, so each wait retires at least one of them.
     while (p->frames_in_flight >= sw->ctx->opts.swapchain_depth)
-        mpvk_dev_poll_cmds(p->vk, 100000); // 100μs
+        mpvk_dev_poll_cmds(p->vk, UINT64_MAX);
+}
+
+static void get_vsync(struct ra_swapchain *sw, struct vo_vsync_info *info)
+{
+    struct priv *p = sw->priv;
+    if (p->params.get_vsync) {
+        p->params.get_vsync(sw->ctx, info);
+        return;
+    }
+
+#ifdef VK_GOOGLE_display_timing
+    struct mpvk_ctx *vk = p->vk;
+    if (!vk->has_display_timing || !p->swapchain)
+        return;
+
+    VK_LOAD_PFN(vkGetPastPresentationTimingGOOGLE);
+    uint32_t num = 0;
+    if (pfn_vkGetPastPresentationTimingGOOGLE(vk->dev, p->swapchain, &num,
+                                              NULL) != VK_SUCCESS)
+        return;
+
+    int64_t skipped = 0;
+    if (num) {
+        VkPastPresentationTimingGOOGLE *timings =
+            talloc_array(NULL, VkPastPresentationTimingGOOGLE, num);
+        if (pfn_vkGetPastPresentationTimingGOOGLE(vk->dev, p->swapchain, &num,
+                                                  timings) < 0)
+            num = 0;
+
+        // Each present is supposed to take exactly one refresh cycle, so
+        // anything beyond that between two successive presents was skipped.
+        for (int n = 0; n < num; n++) {
+            VkPastPresentationTimingGOOGLE *t = &timings[n];
+            if (p->timing_id && t->presentID == p->timing_id + 1 &&
+                p->refresh_duration && t->actualPresentTime > p->timing_time)
+            {
+                uint64_t diff = t->actualPresentTime - p->timing_time;
+                int64_t cycles =
+                    (diff + p->refresh_duration / 2) / p->refresh_duration;
+                skipped += MPMAX(cycles - 1, 0);
+            }
+            p->timing_id = t->presentID;
+            p->timing_time = t->actualPresentTime;
+        }
+        talloc_free(timings);
+    }
+
+    // Without the refresh duration, the timings can't be interpreted.
+    if (!p->timing_id || !p->refresh_duration)
+        return;
+
+    info->skipped_vsyncs = skipped;
+    info->vsync_duration = p->refresh_duration / 1000;
+
+    // The timestamps use CLOCK_MONOTONIC, the same clock as mp_raw_time_us().
+    // Extrapolate from the last known present to the frame just queued.
+    int64_t last = mp_time_from_raw_us(p->timing_time / 1000);
+    info->last_queue_display_time = last + (int64_t)(p->present_id -
+                                    p->timing_id) * info->vsync_duration;
+#endif
 }
 
 static const struct ra_swapchain_fns vulkan_swapchain = {
@@ -515,4 +620,5 @@ static const struct ra_swapchain_fns vulkan_swapchain = {
     .start_frame   = start_frame,
     .submit_frame  = submit_frame,
     .swap_buffers  = swap_buffers,
+    .get_vsync     = get_vsync,
 };
@@ -3,9 +3,23 @@
 #include "video/out/gpu/context.h"
 #include "common.h"
 
+struct ra_vk_ctx_params {
+    // Called before rendering a frame. If this returns false, the frame is
+    // skipped. Optional.
+    bool (*start_frame)(struct ra_ctx *ctx);
+
+    // Called right before a frame is presented. Optional.
+    void (*submit_frame)(struct ra_ctx *ctx);
+
+    // See ra_swapchain_fns.get_vsync. Optional. If set, this replaces the
+    // VK_GOOGLE_display_timing based implementation.
+    void (*get_vsync)(struct ra_ctx *ctx, struct vo_vsync_info *info);
+};
+
 // Helpers for ra_ctx based on ra_vk. These initialize ctx->ra and ctx->swchain.
 void ra_vk_ctx_uninit(struct ra_ctx *ctx);
 bool ra_vk_ctx_init(struct ra_ctx *ctx, struct mpvk_ctx *vk,
+                    struct ra_vk_ctx_params params,
                     VkPresentModeKHR preferred_mode);
 bool ra_vk_ctx_resize(struct ra_swapchain *sw, int w, int h);
 
@@ -35,6 +35,21 @@ static void wayland_vk_uninit(struct ra_ctx *ctx)
     vo_wayland_uninit(ctx->vo);
 }
 
+static bool wayland_vk_start_frame(struct ra_ctx *ctx)
+{
+    return vo_wayland_start_frame(ctx->vo->wl);
+}
+
+static void wayland_vk_submit_frame(struct ra_ctx *ctx)
+{
+    vo_wayland_submit_frame(ctx->vo->wl);
+}
+
+static void wayland_vk_get_vsync(struct ra_ctx *ctx, struct vo_vsync_info *info)
+{
+    vo_wayland_get_vsync(ctx->vo->wl, info);
+}
+
 static bool wayland_vk_init(struct ra_ctx *ctx)
 {
     struct priv *p = ctx->priv = talloc_zero(ctx, struct priv);
@@ -67,7 +82,13 @@ static bool wayland_vk_init(struct ra_ctx *ctx)
      * mean the entire player would block on acquiring swapchain images. Hence,
      * use MAILBOX to guarantee that there'll always be a swapchain image and
      * the player won't block waiting on those */
-    if (!ra_vk_ctx_init(ctx, vk, VK_PRESENT_MODE_MAILBOX_KHR))
+    struct ra_vk_ctx_params params = {
+        .start_frame = wayland_vk_start_frame,
+        .submit_frame = wayland_vk_submit_frame,
+        .get_vsync = wayland_vk_get_vsync,
+    };
+
+    if (!ra_vk_ctx_init(ctx, vk, params, VK_PRESENT_MODE_MAILBOX_KHR))
         goto error;
 
     return true;
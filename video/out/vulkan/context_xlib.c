@@ -64,7 +64,8 @@ static bool xlib_init(struct ra_ctx *ctx)
         goto error;
     }
 
-    if (!ra_vk_ctx_init(ctx, vk, VK_PRESENT_MODE_FIFO_KHR))
+    if (!ra_vk_ctx_init(ctx, vk, (struct ra_vk_ctx_params){0},
+                        VK_PRESENT_MODE_FIFO_KHR))
         goto error;
 
     return true;
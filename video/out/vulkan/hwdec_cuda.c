@@ -0,0 +1,466 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * CUDA->Vulkan interop, the Vulkan equivalent of opengl/hwdec_cuda.c. The
+ * textures are allocated by Vulkan, and their memory is imported into CUDA
+ * with the external memory API (CUDA 10). Decoded frames are copied into them
+ * on the GPU, so nothing goes through system memory. The copy and the Vulkan
+ * commands sampling the textures are ordered with a pair of exported
+ * semaphores per texture (see ra_vk_hold()).
+ */
+
+#include <string.h>
+
+#include "video/out/opengl/cuda_dynamic.h"
+
+#include <libavutil/hwcontext.h>
+#include <libavutil/hwcontext_cuda.h>
+
+#include "video/out/gpu/hwdec.h"
+#include "options/m_config.h"
+#include "ra_vk.h"
+
+struct priv_owner {
+    struct mp_hwdec_ctx hwctx;
+    CUcontext display_ctx;
+    CUcontext decode_ctx;
+};
+
+struct priv {
+    struct mp_image layout;
+    CUexternalMemory cu_mem[4];
+    CUmipmappedArray cu_mma[4];
+    CUarray cu_array[4];
+    CUexternalSemaphore cu_sem_hold[4];
+    CUexternalSemaphore cu_sem_release[4];
+    // Set if a texture was handed to CUDA, but CUDA failed to take it. The
+    // semaphores are out of sync then, so the mapper can't be used anymore.
+    bool broken;
+
+    CUcontext display_ctx;
+};
+
+static int check_cu(struct ra_hwdec *hw, CUresult err, const char *func)
+{
+    const char *err_name;
+    const char *err_string;
+
+    MP_TRACE(hw, "Calling %s\n", func);
+
+    if (err == CUDA_SUCCESS)
+        return 0;
+
+    cuGetErrorName(err, &err_name);
+    cuGetErrorString(err, &err_string);
+
+    MP_ERR(hw, "%s failed", func);
+    if (err_name && err_string)
+        MP_ERR(hw, " -> %s: %s", err_name, err_string);
+    MP_ERR(hw, "\n");
+
+    return -1;
+}
+
+#define CHECK_CU(x) check_cu(hw, (x), #x)
+
+// Find the CUDA device that corresponds to the vulkan device.
+static int find_display_dev(struct ra_hwdec *hw, CUdevice *out)
+{
+    uint8_t vk_uuid[VK_UUID_SIZE];
+    if (!ra_vk_get_uuid(hw->ra, vk_uuid)) {
+        MP_VERBOSE(hw, "Could not get the UUID of the vulkan device.\n");
+        return -1;
+    }
+
+    int count = 0;
+    if (CHECK_CU(cuDeviceGetCount(&count)) < 0)
+        return -1;
+
+    for (int n = 0; n < count; n++) {
+        CUdevice dev;
+        CUuuid uuid;
+        if (CHECK_CU(cuDeviceGet(&dev, n)) < 0 ||
+            CHECK_CU(cuDeviceGetUuid(&uuid, dev)) < 0)
+            continue;
+        if (memcmp(uuid.bytes, vk_uuid, VK_UUID_SIZE) == 0) {
+            *out = dev;
+            return 0;
+        }
+    }
+
+    MP_VERBOSE(hw, "No CUDA device matches the vulkan device.\n");
+    return -1;
+}
+
+static int cuda_init(struct ra_hwdec *hw)
+{
+    CUdevice display_dev;
+    AVBufferRef *hw_device_ctx = NULL;
+    CUcontext dummy;
+    int ret = 0;
+    struct priv_owner *p = hw->priv;
+
+    if (!ra_vk_can_export(hw->ra))
+        return -1;
+
+    bool loaded = cuda_load_interop();
+    if (!loaded) {
+        MP_VERBOSE(hw, "Failed to load CUDA symbols (CUDA 10 is required)\n");
+        return -1;
+    }
+
+    ret = CHECK_CU(cuInit(0));
+    if (ret < 0)
+        return -1;
+
+    ret = find_display_dev(hw, &display_dev);
+    if (ret < 0)
+        return -1;
+
+    ret = CHECK_CU(cuCtxCreate(&p->display_ctx, CU_CTX_SCHED_BLOCKING_SYNC,
+                               display_dev));
+    if (ret < 0)
+        return -1;
+
+    p->decode_ctx = p->display_ctx;
+
+    int decode_dev_idx = -1;
+    mp_read_option_raw(hw->global, "cuda-decode-device", &m_option_type_choice,
+                       &decode_dev_idx);
+
+    if (decode_dev_idx > -1) {
+        CUdevice decode_dev;
+        ret = CHECK_CU(cuDeviceGet(&decode_dev, decode_dev_idx));
+        if (ret < 0)
+            goto error;
+
+        if (decode_dev != display_dev) {
+            MP_INFO(hw, "Using separate decoder and display devices\n");
+
+            // Pop the display context. We won't use it again during init()
+            ret = CHECK_CU(cuCtxPopCurrent(&dummy));
+            if (ret < 0)
+                goto error;
+
+            ret = CHECK_CU(cuCtxCreate(&p->decode_ctx, CU_CTX_SCHED_BLOCKING_SYNC,
+                                       decode_dev));
+            if (ret < 0)
+                goto error;
+        }
+    }
+
+    hw_device_ctx = av_hwdevice_ctx_alloc(AV_HWDEVICE_TYPE_CUDA);
+    if (!hw_device_ctx)
+        goto error;
+
+    AVHWDeviceContext *device_ctx = (void *)hw_device_ctx->data;
+
+    AVCUDADeviceContext *device_hwctx = device_ctx->hwctx;
+    device_hwctx->cuda_ctx = p->decode_ctx;
+
+    ret = av_hwdevice_ctx_init(hw_device_ctx);
+    if (ret < 0) {
+        MP_ERR(hw, "av_hwdevice_ctx_init failed\n");
+        goto error;
+    }
+
+    ret = CHECK_CU(cuCtxPopCurrent(&dummy));
+    if (ret < 0)
+        goto error;
+
+    MP_VERBOSE(hw, "using CUDA Vulkan interop\n");
+
+    p->hwctx = (struct mp_hwdec_ctx) {
+        .type = hw->driver->api,
+        .ctx = p->decode_ctx,
+        .av_device_ref = hw_device_ctx,
+    };
+    p->hwctx.driver_name = hw->driver->name;
+    hwdec_devices_add(hw->devs, &p->hwctx);
+    return 0;
+
+ error:
+    av_buffer_unref(&hw_device_ctx);
+    CHECK_CU(cuCtxPopCurrent(&dummy));
+
+    return -1;
+}
+
+static void cuda_uninit(struct ra_hwdec *hw)
+{
+    struct priv_owner *p = hw->priv;
+
+    if (p->hwctx.ctx)
+        hwdec_devices_remove(hw->devs, &p->hwctx);
+    av_buffer_unref(&p->hwctx.av_device_ref);
+
+    if (p->decode_ctx && p->decode_ctx != p->display_ctx)
+        CHECK_CU(cuCtxDestroy(p->decode_ctx));
+
+    if (p->display_ctx)
+        CHECK_CU(cuCtxDestroy(p->display_ctx));
+}
+
+#undef CHECK_CU
+#define CHECK_CU(x) check_cu((mapper)->owner, (x), #x)
+
+static int import_sem(struct ra_hwdec_mapper *mapper, CUexternalSemaphore *sem,
+                      ra_vk_handle *handle)
+{
+    CUDA_EXTERNAL_SEMAPHORE_HANDLE_DESC desc = {0};
+#ifdef VK_KHR_external_memory_win32
+    desc.type = CU_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_WIN32;
+    desc.handle.win32.handle = *handle;
+#else
+    desc.type = CU_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD;
+    desc.handle.fd = *handle;
+#endif
+    int ret = CHECK_CU(cuImportExternalSemaphore(sem, &desc));
+#ifndef VK_KHR_external_memory_win32
+    if (ret >= 0)
+        *handle = -1; // CUDA took over the fd
+#endif
+    return ret;
+}
+
+// Create the vulkan texture for plane n, and import it into CUDA.
+static int init_plane(struct ra_hwdec_mapper *mapper, int n,
+                      const struct ra_format *format)
+{
+    struct priv *p = mapper->priv;
+    struct ra_vk_export ex;
+    int ret = -1;
+
+    struct ra_tex_params params = {
+        .dimensions = 2,
+        .w = mp_image_plane_w(&p->layout, n),
+        .h = mp_image_plane_h(&p->layout, n),
+        .d = 1,
+        .format = format,
+        .render_src = true,
+        .src_linear = format->linear_filter,
+    };
+
+    mapper->tex[n] = ra_vk_create_exported_tex(mapper->ra, &params, &ex);
+    if (!mapper->tex[n])
+        return -1;
+
+    CUDA_EXTERNAL_MEMORY_HANDLE_DESC mem_desc = {
+        .size = ex.mem_size,
+        .flags = CUDA_EXTERNAL_MEMORY_DEDICATED,
+    };
+#ifdef VK_KHR_external_memory_win32
+    mem_desc.type = CU_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_WIN32;
+    mem_desc.handle.win32.handle = ex.mem;
+#else
+    mem_desc.type = CU_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD;
+    mem_desc.handle.fd = ex.mem;
+#endif
+    if (CHECK_CU(cuImportExternalMemory(&p->cu_mem[n], &mem_desc)) < 0)
+        goto done;
+#ifndef VK_KHR_external_memory_win32
+    ex.mem = -1; // CUDA took over the fd
+#endif
+
+    CUDA_EXTERNAL_MEMORY_MIPMAPPED_ARRAY_DESC array_desc = {
+        .arrayDesc = {
+            .Width = params.w,
+            .Height = params.h,
+            .Format = format->component_size[0] > 8 ?
+                CU_AD_FORMAT_UNSIGNED_INT16 : CU_AD_FORMAT_UNSIGNED_INT8,
+            .NumChannels = format->num_components,
+        },
+        .numLevels = 1,
+    };
+    if (CHECK_CU(cuExternalMemoryGetMappedMipmappedArray(&p->cu_mma[n],
+                                        p->cu_mem[n], &array_desc)) < 0)
+        goto done;
+    if (CHECK_CU(cuMipmappedArrayGetLevel(&p->cu_array[n], p->cu_mma[n], 0)) < 0)
+        goto done;
+
+    if (import_sem(mapper, &p->cu_sem_hold[n], &ex.sem_hold) < 0 ||
+        import_sem(mapper, &p->cu_sem_release[n], &ex.sem_release) < 0)
+        goto done;
+
+    ret = 0;
+done:
+    ra_vk_export_close(&ex);
+    return ret;
+}
+
+static int mapper_init(struct ra_hwdec_mapper *mapper)
+{
+    struct priv_owner *p_owner = mapper->owner->priv;
+    struct priv *p = mapper->priv;
+    CUcontext dummy;
+    int ret = 0, eret = 0;
+
+    p->display_ctx = p_owner->display_ctx;
+
+    int imgfmt = mapper->src_params.hw_subfmt;
+    mapper->dst_params = mapper->src_params;
+    mapper->dst_params.imgfmt = imgfmt;
+    mapper->dst_params.hw_subfmt = 0;
+
+    mp_image_set_params(&p->layout, &mapper->dst_params);
+
+    struct ra_imgfmt_desc desc;
+    if (!ra_get_imgfmt_desc(mapper->ra, imgfmt, &desc)) {
+        MP_ERR(mapper, "Unsupported format: %s\n", mp_imgfmt_to_name(imgfmt));
+        return -1;
+    }
+
+    for (int n = 0; n < desc.num_planes; n++) {
+        const struct ra_format *format = desc.planes[n];
+        if (format->ctype != RA_CTYPE_UNORM || format->component_size[0] % 8 ||
+            format->component_size[0] > 16)
+        {
+            MP_ERR(mapper, "Unsupported format: %s\n",
+                   mp_imgfmt_to_name(imgfmt));
+            return -1;
+        }
+    }
+
+    ret = CHECK_CU(cuCtxPushCurrent(p->display_ctx));
+    if (ret < 0)
+        return ret;
+
+    for (int n = 0; n < desc.num_planes; n++) {
+        ret = init_plane(mapper, n, desc.planes[n]);
+        if (ret < 0)
+            goto error;
+    }
+
+ error:
+    eret = CHECK_CU(cuCtxPopCurrent(&dummy));
+    if (eret < 0)
+        return eret;
+
+    return ret;
+}
+
+static void mapper_uninit(struct ra_hwdec_mapper *mapper)
+{
+    struct priv *p = mapper->priv;
+    CUcontext dummy;
+
+    // Don't bail if any CUDA calls fail. This is all best effort.
+    CHECK_CU(cuCtxPushCurrent(p->display_ctx));
+    // The last copy and semaphore signal may still be pending.
+    CHECK_CU(cuCtxSynchronize());
+    for (int n = 0; n < 4; n++) {
+        if (p->cu_sem_hold[n])
+            CHECK_CU(cuDestroyExternalSemaphore(p->cu_sem_hold[n]));
+        if (p->cu_sem_release[n])
+            CHECK_CU(cuDestroyExternalSemaphore(p->cu_sem_release[n]));
+        if (p->cu_mma[n])
+            CHECK_CU(cuMipmappedArrayDestroy(p->cu_mma[n]));
+        if (p->cu_mem[n])
+            CHECK_CU(cuDestroyExternalMemory(p->cu_mem[n]));
+        p->cu_sem_hold[n] = p->cu_sem_release[n] = NULL;
+        p->cu_mma[n] = NULL;
+        p->cu_mem[n] = NULL;
+        ra_tex_free(mapper->ra, &mapper->tex[n]);
+    }
+    CHECK_CU(cuCtxPopCurrent(&dummy));
+}
+
+static void mapper_unmap(struct ra_hwdec_mapper *mapper)
+{
+}
+
+static int mapper_map(struct ra_hwdec_mapper *mapper)
+{
+    struct priv *p = mapper->priv;
+    CUcontext dummy;
+    int ret = 0, eret = 0;
+
+    if (p->broken)
+        return -1;
+
+    ret = CHECK_CU(cuCtxPushCurrent(p->display_ctx));
+    if (ret < 0)
+        return ret;
+
+    for (int n = 0; n < p->layout.num_planes; n++) {
+        if (!ra_vk_hold(mapper->ra, mapper->tex[n])) {
+            ret = -1;
+            goto error;
+        }
+
+        // From here on, CUDA must wait on and signal the semaphores, or they
+        // get out of sync with vulkan.
+        p->broken = true;
+
+        CUDA_EXTERNAL_SEMAPHORE_WAIT_PARAMS wp = {0};
+        ret = CHECK_CU(cuWaitExternalSemaphoresAsync(&p->cu_sem_hold[n],
+                                                     &wp, 1, 0));
+        if (ret < 0)
+            goto error;
+
+        CUDA_MEMCPY2D cpy = {
+            .srcMemoryType = CU_MEMORYTYPE_DEVICE,
+            .dstMemoryType = CU_MEMORYTYPE_ARRAY,
+            .srcDevice     = (CUdeviceptr)mapper->src->planes[n],
+            .srcPitch      = mapper->src->stride[n],
+            .srcY          = 0,
+            .dstArray      = p->cu_array[n],
+            .WidthInBytes  = mp_image_plane_w(&p->layout, n) *
+                             mapper->tex[n]->params.format->pixel_size,
+            .Height        = mp_image_plane_h(&p->layout, n),
+        };
+        // Even if this fails, the semaphore must be signaled.
+        ret = CHECK_CU(cuMemcpy2DAsync(&cpy, 0));
+
+        CUDA_EXTERNAL_SEMAPHORE_SIGNAL_PARAMS sp = {0};
+        if (CHECK_CU(cuSignalExternalSemaphoresAsync(&p->cu_sem_release[n],
+                                                     &sp, 1, 0)) < 0)
+        {
+            ret = -1;
+            goto error;
+        }
+
+        ra_vk_release(mapper->ra, mapper->tex[n]);
+        p->broken = false;
+        if (ret < 0)
+            goto error;
+    }
+
+ error:
+   eret = CHECK_CU(cuCtxPopCurrent(&dummy));
+   if (eret < 0)
+       return eret;
+
+   return ret;
+}
+
+const struct ra_hwdec_driver ra_hwdec_cuda_vk = {
+    .name = "cuda-vulkan",
+    .api = HWDEC_CUDA,
+    .imgfmts = {IMGFMT_CUDA, 0},
+    .priv_size = sizeof(struct priv_owner),
+    .init = cuda_init,
+    .uninit = cuda_uninit,
+    .mapper = &(const struct ra_hwdec_mapper_driver){
+        .priv_size = sizeof(struct priv),
+        .init = mapper_init,
+        .uninit = mapper_uninit,
+        .map = mapper_map,
+        .unmap = mapper_unmap,
+    },
+};
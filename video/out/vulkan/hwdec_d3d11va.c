@@ -0,0 +1,328 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <windows.h>
+#include <d3d11.h>
+#include <d3d11_1.h>
+#include <dxgi1_2.h>
+
+#include <libavutil/buffer.h>
+
+#include "config.h"
+
+#include "common/common.h"
+#include "osdep/windows_utils.h"
+#include "video/hwdec.h"
+#include "video/decode/d3d.h"
+#include "video/out/gpu/hwdec.h"
+#include "ra_vk.h"
+
+// The decoder textures can't be shared with vulkan directly (they're texture
+// arrays with decoder bind flags), so each frame is copied on the GPU into a
+// shared texture, which is imported into vulkan once per mapper. Access to the
+// shared texture is synchronized with its keyed mutex. Both sides acquire and
+// release it with key 1 (after the initial release by D3D11), because a frame
+// can be sampled by any number of vulkan commands.
+
+// How long to wait for vulkan to finish sampling the previous frame.
+#define MUTEX_TIMEOUT_MS 1000
+
+struct priv_owner {
+    struct mp_hwdec_ctx hwctx;
+    ID3D11Device *device;
+    ID3D11Device1 *device1;
+};
+
+struct priv {
+    ID3D11DeviceContext1 *ctx;
+    ID3D11Texture2D *copy_tex;
+    IDXGIKeyedMutex *mutex;
+    struct ra_tex *tex[2];
+};
+
+static void uninit(struct ra_hwdec *hw)
+{
+    struct priv_owner *p = hw->priv;
+    if (p->hwctx.ctx)
+        hwdec_devices_remove(hw->devs, &p->hwctx);
+    av_buffer_unref(&p->hwctx.av_device_ref);
+    SAFE_RELEASE(p->device1);
+    SAFE_RELEASE(p->device);
+}
+
+// Create the D3D11 device on the adapter used by vulkan.
+static IDXGIAdapter1 *find_adapter(struct ra_hwdec *hw)
+{
+    LUID luid;
+    if (!ra_vk_get_luid(hw->ra, &luid)) {
+        MP_VERBOSE(hw, "Could not get the LUID of the vulkan device.\n");
+        return NULL;
+    }
+
+    HMODULE dxgi_dll = GetModuleHandleW(L"dxgi.dll");
+    if (!dxgi_dll)
+        dxgi_dll = LoadLibraryW(L"dxgi.dll");
+    HRESULT (WINAPI *pCreateDXGIFactory1)(REFIID, void **) = dxgi_dll ?
+        (void *)GetProcAddress(dxgi_dll, "CreateDXGIFactory1") : NULL;
+    if (!pCreateDXGIFactory1)
+        return NULL;
+
+    IDXGIFactory1 *factory = NULL;
+    if (FAILED(pCreateDXGIFactory1(&IID_IDXGIFactory1, (void **)&factory)))
+        return NULL;
+
+    IDXGIAdapter1 *adapter = NULL;
+    for (UINT n = 0; ; n++) {
+        if (FAILED(IDXGIFactory1_EnumAdapters1(factory, n, &adapter)))
+            break;
+        DXGI_ADAPTER_DESC1 desc;
+        if (SUCCEEDED(IDXGIAdapter1_GetDesc1(adapter, &desc)) &&
+            desc.AdapterLuid.LowPart == luid.LowPart &&
+            desc.AdapterLuid.HighPart == luid.HighPart)
+            break;
+        SAFE_RELEASE(adapter);
+    }
+
+    IDXGIFactory1_Release(factory);
+    return adapter;
+}
+
+static int init(struct ra_hwdec *hw)
+{
+    struct priv_owner *p = hw->priv;
+    HRESULT hr;
+
+    if (!ra_vk_can_import_d3d11(hw->ra))
+        return -1;
+
+    d3d_load_dlls();
+    if (!d3d11_D3D11CreateDevice)
+        return -1;
+
+    IDXGIAdapter1 *adapter = find_adapter(hw);
+    if (!adapter) {
+        MP_VERBOSE(hw, "No D3D11 adapter matches the vulkan device.\n");
+        return -1;
+    }
+
+    hr = d3d11_D3D11CreateDevice((IDXGIAdapter *)adapter,
+                                 D3D_DRIVER_TYPE_UNKNOWN, NULL,
+                                 D3D11_CREATE_DEVICE_VIDEO_SUPPORT, NULL, 0,
+                                 D3D11_SDK_VERSION, &p->device, NULL, NULL);
+    IDXGIAdapter1_Release(adapter);
+    if (FAILED(hr)) {
+        MP_ERR(hw, "Failed to create D3D11 device: %s\n",
+               mp_HRESULT_to_str(hr));
+        return -1;
+    }
+
+    // D3D11VA requires Direct3D 11.1, so this should always succeed
+    hr = ID3D11Device_QueryInterface(p->device, &IID_ID3D11Device1,
+                                     (void**)&p->device1);
+    if (FAILED(hr)) {
+        MP_ERR(hw, "Failed to get D3D11.1 interface: %s\n",
+               mp_HRESULT_to_str(hr));
+        return -1;
+    }
+
+    // The immediate context is shared with the decoder thread
+    ID3D10Multithread *multithread;
+    hr = ID3D11Device_QueryInterface(p->device, &IID_ID3D10Multithread,
+                                     (void **)&multithread);
+    if (FAILED(hr)) {
+        MP_ERR(hw, "Failed to get Multithread interface: %s\n",
+               mp_HRESULT_to_str(hr));
+        return -1;
+    }
+    ID3D10Multithread_SetMultithreadProtected(multithread, TRUE);
+    ID3D10Multithread_Release(multithread);
+
+    p->hwctx = (struct mp_hwdec_ctx){
+        .type = HWDEC_D3D11VA,
+        .driver_name = hw->driver->name,
+        .ctx = p->device,
+        .av_device_ref = d3d11_wrap_device_ref(p->device),
+    };
+    if (!p->hwctx.av_device_ref) {
+        MP_ERR(hw, "Failed to allocate AVHWDeviceContext.\n");
+        return -1;
+    }
+
+    MP_VERBOSE(hw, "using D3D11VA Vulkan interop\n");
+
+    hwdec_devices_add(hw->devs, &p->hwctx);
+    return 0;
+}
+
+static void mapper_uninit(struct ra_hwdec_mapper *mapper)
+{
+    struct priv *p = mapper->priv;
+    for (int n = 0; n < 2; n++)
+        ra_tex_free(mapper->ra, &p->tex[n]);
+    SAFE_RELEASE(p->mutex);
+    SAFE_RELEASE(p->copy_tex);
+    SAFE_RELEASE(p->ctx);
+}
+
+static int mapper_init(struct ra_hwdec_mapper *mapper)
+{
+    struct priv_owner *o = mapper->owner->priv;
+    struct priv *p = mapper->priv;
+    IDXGIResource1 *res = NULL;
+    HANDLE handle = NULL;
+    HRESULT hr;
+    int ret = -1;
+
+    mapper->dst_params = mapper->src_params;
+    mapper->dst_params.imgfmt = mapper->src_params.hw_subfmt;
+    mapper->dst_params.hw_subfmt = 0;
+
+    DXGI_FORMAT copy_fmt;
+    switch (mapper->dst_params.imgfmt) {
+    case IMGFMT_NV12: copy_fmt = DXGI_FORMAT_NV12; break;
+    case IMGFMT_P010: copy_fmt = DXGI_FORMAT_P010; break;
+    default: return -1;
+    }
+
+    struct ra_imgfmt_desc desc = {0};
+    if (!ra_get_imgfmt_desc(mapper->ra, mapper->dst_params.imgfmt, &desc) ||
+        desc.num_planes != 2)
+        return -1;
+
+    // 4:2:0 textures must have even dimensions
+    int w = MP_ALIGN_UP(mapper->dst_params.w, 2);
+    int h = MP_ALIGN_UP(mapper->dst_params.h, 2);
+
+    D3D11_TEXTURE2D_DESC copy_desc = {
+        .Width = w,
+        .Height = h,
+        .MipLevels = 1,
+        .ArraySize = 1,
+        .SampleDesc.Count = 1,
+        .Format = copy_fmt,
+        .BindFlags = D3D11_BIND_SHADER_RESOURCE,
+        .MiscFlags = D3D11_RESOURCE_MISC_SHARED_NTHANDLE |
+                     D3D11_RESOURCE_MISC_SHARED_KEYEDMUTEX,
+    };
+    hr = ID3D11Device_CreateTexture2D(o->device, &copy_desc, NULL,
+                                      &p->copy_tex);
+    if (FAILED(hr)) {
+        MP_FATAL(mapper, "Could not create shared texture: %s\n",
+                 mp_HRESULT_to_str(hr));
+        goto done;
+    }
+
+    hr = ID3D11Texture2D_QueryInterface(p->copy_tex, &IID_IDXGIKeyedMutex,
+                                        (void **)&p->mutex);
+    if (FAILED(hr))
+        goto done;
+    hr = ID3D11Texture2D_QueryInterface(p->copy_tex, &IID_IDXGIResource1,
+                                        (void **)&res);
+    if (FAILED(hr))
+        goto done;
+    hr = IDXGIResource1_CreateSharedHandle(res, NULL,
+            DXGI_SHARED_RESOURCE_READ | DXGI_SHARED_RESOURCE_WRITE, NULL,
+            &handle);
+    if (FAILED(hr)) {
+        MP_FATAL(mapper, "Could not share texture: %s\n",
+                 mp_HRESULT_to_str(hr));
+        goto done;
+    }
+
+    struct mp_image layout = {0};
+    mp_image_set_params(&layout, &mapper->dst_params);
+
+    struct ra_tex_params params[2];
+    for (int n = 0; n < 2; n++) {
+        params[n] = (struct ra_tex_params) {
+            .dimensions = 2,
+            .w = n ? w / 2 : w,
+            .h = n ? h / 2 : h,
+            .d = 1,
+            .format = desc.planes[n],
+            .render_src = true,
+            .src_linear = desc.planes[n]->linear_filter,
+        };
+    }
+
+    if (!ra_vk_import_d3d11(mapper->ra, handle, params, p->tex)) {
+        MP_FATAL(mapper, "Could not import the texture into vulkan\n");
+        goto done;
+    }
+
+    // The texture starts out owned with key 0; hand it to key 1, which is
+    // used for everything else.
+    hr = IDXGIKeyedMutex_AcquireSync(p->mutex, 0, INFINITE);
+    if (FAILED(hr))
+        goto done;
+    IDXGIKeyedMutex_ReleaseSync(p->mutex, 1);
+
+    // A ref to the immediate context is needed for CopySubresourceRegion
+    ID3D11Device1_GetImmediateContext1(o->device1, &p->ctx);
+
+    for (int n = 0; n < 2; n++)
+        mapper->tex[n] = p->tex[n];
+    ret = 0;
+
+done:
+    if (handle)
+        CloseHandle(handle);
+    SAFE_RELEASE(res);
+    return ret;
+}
+
+static int mapper_map(struct ra_hwdec_mapper *mapper)
+{
+    struct priv *p = mapper->priv;
+    ID3D11Texture2D *tex = (void *)mapper->src->planes[0];
+    int subresource = (intptr_t)mapper->src->planes[1];
+
+    HRESULT hr = IDXGIKeyedMutex_AcquireSync(p->mutex, 1, MUTEX_TIMEOUT_MS);
+    if (hr != S_OK) {
+        MP_ERR(mapper, "Timeout waiting for the shared texture\n");
+        return -1;
+    }
+
+    ID3D11DeviceContext1_CopySubresourceRegion1(p->ctx,
+        (ID3D11Resource *)p->copy_tex, 0, 0, 0, 0,
+        (ID3D11Resource *)tex, subresource, (&(D3D11_BOX) {
+            .left = 0,
+            .top = 0,
+            .front = 0,
+            .right = mapper->dst_params.w,
+            .bottom = mapper->dst_params.h,
+            .back = 1,
+        }), D3D11_COPY_DISCARD);
+
+    IDXGIKeyedMutex_ReleaseSync(p->mutex, 1);
+    return 0;
+}
+
+const struct ra_hwdec_driver ra_hwdec_d3d11va_vk = {
+    .name = "d3d11va-vulkan",
+    .priv_size = sizeof(struct priv_owner),
+    .api = HWDEC_D3D11VA,
+    .imgfmts = {IMGFMT_D3D11VA, IMGFMT_D3D11NV12, 0},
+    .init = init,
+    .uninit = uninit,
+    .mapper = &(const struct ra_hwdec_mapper_driver){
+        .priv_size = sizeof(struct priv),
+        .init = mapper_init,
+        .uninit = mapper_uninit,
+        .map = mapper_map,
+    },
+};
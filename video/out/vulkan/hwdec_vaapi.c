@@ -0,0 +1,309 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+#include <va/va_drmcommon.h>
+
+#include <libavutil/hwcontext.h>
+#include <libavutil/hwcontext_vaapi.h>
+
+#include "config.h"
+
+#include "video/out/gpu/hwdec.h"
+#include "video/mp_image_pool.h"
+#include "video/vaapi.h"
+#include "ra_vk.h"
+
+struct priv_owner {
+    struct mp_vaapi_ctx *ctx;
+    VADisplay *display;
+    int *formats;
+    bool probing_formats; // temporary during init
+};
+
+struct priv {
+    int num_planes;
+    struct ra_tex_params params[4];
+    struct ra_tex *tex[4];
+    VADRMPRIMESurfaceDescriptor desc;
+    bool surface_acquired;
+};
+
+static void determine_working_formats(struct ra_hwdec *hw);
+
+static void uninit(struct ra_hwdec *hw)
+{
+    struct priv_owner *p = hw->priv;
+    if (p->ctx)
+        hwdec_devices_remove(hw->devs, &p->ctx->hwctx);
+    va_destroy(p->ctx);
+}
+
+static int init(struct ra_hwdec *hw)
+{
+    struct priv_owner *p = hw->priv;
+
+    if (!ra_vk_can_import_dmabuf(hw->ra))
+        return -1;
+
+    // There is no way to get the native display from the vulkan context, so
+    // open the VA display on a DRM render node. This normally picks the same
+    // GPU, but there is no guarantee on multi-GPU systems.
+    struct mp_hwdec_ctx *hwctx =
+        va_create_standalone(hw->global, hw->log, hw->probing);
+    if (!hwctx) {
+        MP_VERBOSE(hw, "Could not create a VA display.\n");
+        return -1;
+    }
+    p->ctx = hwctx->ctx;
+    p->ctx->hwctx.destroy = NULL; // owned by us, not by the decoder
+    p->display = p->ctx->display;
+
+    if (!p->ctx->av_device_ref) {
+        MP_VERBOSE(hw, "libavutil vaapi code rejected the driver?\n");
+        return -1;
+    }
+
+    if (hw->probing && va_guess_if_emulated(p->ctx))
+        return -1;
+
+    MP_VERBOSE(hw, "using VAAPI Vulkan interop\n");
+
+    determine_working_formats(hw);
+    if (!p->formats || !p->formats[0])
+        return -1;
+
+    p->ctx->hwctx.supported_formats = p->formats;
+    p->ctx->hwctx.driver_name = hw->driver->name;
+    hwdec_devices_add(hw->devs, &p->ctx->hwctx);
+    return 0;
+}
+
+static void mapper_unmap(struct ra_hwdec_mapper *mapper)
+{
+    struct priv *p = mapper->priv;
+
+    for (int n = 0; n < 4; n++)
+        ra_tex_free(mapper->ra, &p->tex[n]);
+
+    if (p->surface_acquired) {
+        for (int n = 0; n < p->desc.num_objects; n++)
+            close(p->desc.objects[n].fd);
+        p->surface_acquired = false;
+    }
+}
+
+static void mapper_uninit(struct ra_hwdec_mapper *mapper)
+{
+    // Textures are created per frame, and destroyed in mapper_unmap().
+}
+
+static bool check_fmt(struct ra_hwdec_mapper *mapper, int fmt)
+{
+    struct priv_owner *p_owner = mapper->owner->priv;
+    for (int n = 0; p_owner->formats && p_owner->formats[n]; n++) {
+        if (p_owner->formats[n] == fmt)
+            return true;
+    }
+    return false;
+}
+
+static int mapper_init(struct ra_hwdec_mapper *mapper)
+{
+    struct priv_owner *p_owner = mapper->owner->priv;
+    struct priv *p = mapper->priv;
+
+    mapper->dst_params = mapper->src_params;
+    mapper->dst_params.imgfmt = mapper->src_params.hw_subfmt;
+    mapper->dst_params.hw_subfmt = 0;
+
+    struct ra_imgfmt_desc desc = {0};
+    struct mp_image layout = {0};
+
+    if (!ra_get_imgfmt_desc(mapper->ra, mapper->dst_params.imgfmt, &desc))
+        return -1;
+
+    p->num_planes = desc.num_planes;
+    mp_image_set_params(&layout, &mapper->dst_params);
+
+    for (int n = 0; n < desc.num_planes; n++) {
+        p->params[n] = (struct ra_tex_params) {
+            .dimensions = 2,
+            .w = mp_image_plane_w(&layout, n),
+            .h = mp_image_plane_h(&layout, n),
+            .d = 1,
+            .format = desc.planes[n],
+            .render_src = true,
+            .src_linear = desc.planes[n]->linear_filter,
+        };
+
+        if (p->params[n].format->ctype != RA_CTYPE_UNORM)
+            return -1;
+    }
+
+    if (!p_owner->probing_formats && !check_fmt(mapper, mapper->dst_params.imgfmt))
+    {
+        MP_FATAL(mapper, "unsupported VA image format %s\n",
+                 mp_imgfmt_to_name(mapper->dst_params.imgfmt));
+        return -1;
+    }
+
+    return 0;
+}
+
+static int mapper_map(struct ra_hwdec_mapper *mapper)
+{
+    struct priv_owner *p_owner = mapper->owner->priv;
+    struct priv *p = mapper->priv;
+    VADisplay *display = p_owner->display;
+    VASurfaceID surface = va_surface_id(mapper->src);
+    VAStatus status;
+
+    // The export doesn't wait for decoding to finish.
+    status = vaSyncSurface(display, surface);
+    if (!CHECK_VA_STATUS(mapper, "vaSyncSurface()"))
+        goto err;
+
+    status = vaExportSurfaceHandle(display, surface,
+                                   VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2,
+                                   VA_EXPORT_SURFACE_READ_ONLY |
+                                   VA_EXPORT_SURFACE_SEPARATE_LAYERS,
+                                   &p->desc);
+    if (!CHECK_VA_STATUS(mapper, "vaExportSurfaceHandle()"))
+        goto err;
+    p->surface_acquired = true;
+
+    if (p->desc.num_layers != p->num_planes)
+        goto err;
+
+    for (int n = 0; n < p->num_planes; n++) {
+        const VADRMPRIMESurfaceDescriptor *desc = &p->desc;
+        if (desc->layers[n].num_planes != 1)
+            goto err;
+
+        int obj = desc->layers[n].object_index[0];
+        struct ra_vk_dmabuf buf = {
+            .fd = desc->objects[obj].fd,
+            .size = desc->objects[obj].size,
+            .offset = desc->layers[n].offset[0],
+            .pitch = desc->layers[n].pitch[0],
+            .modifier = desc->objects[obj].drm_format_modifier,
+        };
+
+        p->tex[n] = ra_vk_import_dmabuf(mapper->ra, &p->params[n], &buf);
+        if (!p->tex[n])
+            goto err;
+
+        mapper->tex[n] = p->tex[n];
+    }
+
+    if (p->desc.fourcc == VA_FOURCC_YV12)
+        MPSWAP(struct ra_tex*, mapper->tex[1], mapper->tex[2]);
+
+    return 0;
+
+err:
+    mapper_unmap(mapper);
+    if (!p_owner->probing_formats)
+        MP_FATAL(mapper, "mapping VAAPI surface to Vulkan failed\n");
+    return -1;
+}
+
+static bool try_format(struct ra_hwdec *hw, struct mp_image *surface)
+{
+    bool ok = false;
+    struct ra_hwdec_mapper *mapper = ra_hwdec_mapper_create(hw, &surface->params);
+    if (mapper)
+        ok = ra_hwdec_mapper_map(mapper, surface) >= 0;
+    ra_hwdec_mapper_free(&mapper);
+    return ok;
+}
+
+static void determine_working_formats(struct ra_hwdec *hw)
+{
+    struct priv_owner *p = hw->priv;
+    int num_formats = 0;
+    int *formats = NULL;
+
+    p->probing_formats = true;
+
+    AVHWFramesConstraints *fc =
+            av_hwdevice_get_hwframe_constraints(p->ctx->av_device_ref, NULL);
+    if (!fc) {
+        MP_WARN(hw, "failed to retrieve libavutil frame constaints\n");
+        goto done;
+    }
+    for (int n = 0; fc->valid_sw_formats[n] != AV_PIX_FMT_NONE; n++) {
+        AVBufferRef *fref = NULL;
+        struct mp_image *s = NULL;
+        AVFrame *frame = NULL;
+        fref = av_hwframe_ctx_alloc(p->ctx->av_device_ref);
+        if (!fref)
+            goto err;
+        AVHWFramesContext *fctx = (void *)fref->data;
+        fctx->format = AV_PIX_FMT_VAAPI;
+        fctx->sw_format = fc->valid_sw_formats[n];
+        fctx->width = 128;
+        fctx->height = 128;
+        if (av_hwframe_ctx_init(fref) < 0)
+            goto err;
+        frame = av_frame_alloc();
+        if (!frame)
+            goto err;
+        if (av_hwframe_get_buffer(fref, frame, 0) < 0)
+            goto err;
+        s = mp_image_from_av_frame(frame);
+        if (!s || !mp_image_params_valid(&s->params))
+            goto err;
+        if (try_format(hw, s))
+            MP_TARRAY_APPEND(p, formats, num_formats, s->params.hw_subfmt);
+    err:
+        talloc_free(s);
+        av_frame_free(&frame);
+        av_buffer_unref(&fref);
+    }
+    av_hwframe_constraints_free(&fc);
+
+done:
+    MP_TARRAY_APPEND(p, formats, num_formats, 0); // terminate it
+    p->formats = formats;
+    p->probing_formats = false;
+
+    MP_VERBOSE(hw, "Supported formats:\n");
+    for (int n = 0; formats[n]; n++)
+        MP_VERBOSE(hw, " %s\n", mp_imgfmt_to_name(formats[n]));
+}
+
+const struct ra_hwdec_driver ra_hwdec_vaapi_vk = {
+    .name = "vaapi-vulkan",
+    .priv_size = sizeof(struct priv_owner),
+    .api = HWDEC_VAAPI,
+    .imgfmts = {IMGFMT_VAAPI, 0},
+    .init = init,
+    .uninit = uninit,
+    .mapper = &(const struct ra_hwdec_mapper_driver){
+        .priv_size = sizeof(struct priv),
+        .init = mapper_init,
+        .uninit = mapper_uninit,
+        .map = mapper_map,
+        .unmap = mapper_unmap,
+    },
+};
@@ -1,6 +1,7 @@
 #include "malloc.h"
 #include "utils.h"
 #include "osdep/timer.h"
+#include "video/out/vo.h"
 
 // Controls the multiplication factor for new slab allocations. The new slab
 // will always be allocated such that the size of the slab is this factor times
@@ -22,6 +23,11 @@
 // map with lots of small buffers during uninit. (Default: 1 KB)
 #define MPVK_HEAP_MINIMUM_REGION_SIZE (1 << 10)
 
+// Controls how long a slab can stay completely unused before it's returned
+// to the device by vk_malloc_garbage_collect(). This avoids freeing and
+// reallocating memory on e.g. quick resolution changes. (Default: 3 s)
+#define MPVK_HEAP_IDLE_TIMEOUT (3 * 1000 * 1000)
+
 // Represents a region of available memory
 struct vk_region {
     size_t start; // first offset in region
@@ -41,6 +47,8 @@ struct vk_slab {
     size_t size;          // total size of `slab`
     size_t used;          // number of bytes actually in use (for GC accounting)
     bool dedicated;       // slab is allocated specifically for one object
+    uint32_t heap_index;  // VkMemoryHeap the memory was allocated from
+    int64_t idle_since;   // mp_time_us() when `used` dropped to 0 (or 0)
     // free space map: a sorted list of memory regions that are available
     struct vk_region *regions;
     int num_regions;
@@ -67,6 +75,14 @@ struct vk_malloc {
     VkPhysicalDeviceMemoryProperties props;
     struct vk_heap *heaps;
     int num_heaps;
+    // Accounting per VkMemoryHeap
+    VkDeviceSize allocated[VK_MAX_MEMORY_HEAPS]; // total size of all slabs
+    VkDeviceSize used[VK_MAX_MEMORY_HEAPS];      // total size of all slices
+    int num_slabs[VK_MAX_MEMORY_HEAPS];
+    // From VK_EXT_memory_budget, 0 if unknown
+    VkDeviceSize budget[VK_MAX_MEMORY_HEAPS];
+    VkDeviceSize usage[VK_MAX_MEMORY_HEAPS]; // process-wide, not only ours
+    bool budget_warned;
 };
 
 static void slab_free(struct mpvk_ctx *vk, struct vk_slab *slab)
@@ -76,6 +92,12 @@ static void slab_free(struct mpvk_ctx *vk, struct vk_slab *slab)
 
     assert(slab->used == 0);
 
+    if (slab->mem) {
+        struct vk_malloc *ma = vk->alloc;
+        ma->allocated[slab->heap_index] -= slab->size;
+        ma->num_slabs[slab->heap_index] -= 1;
+    }
+
     int64_t start = mp_time_us();
     vkDestroyBuffer(vk->dev, slab->buffer, MPVK_ALLOCATOR);
     // also implicitly unmaps the memory if needed
@@ -140,6 +162,13 @@ static struct vk_slab *slab_alloc(struct mpvk_ctx *vk, struct vk_heap *heap,
             .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
         };
 
+        // Upload buffers may be read by the transfer queue (see ra_vk.c)
+        if (vk->num_qfs > 1 && (heap->usage & VK_BUFFER_USAGE_TRANSFER_SRC_BIT)) {
+            binfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            binfo.queueFamilyIndexCount = vk->num_qfs;
+            binfo.pQueueFamilyIndices = vk->qfs;
+        }
+
         VK(vkCreateBuffer(vk->dev, &binfo, MPVK_ALLOCATOR, &slab->buffer));
 
         VkMemoryRequirements reqs;
@@ -159,6 +188,10 @@ static struct vk_slab *slab_alloc(struct mpvk_ctx *vk, struct vk_heap *heap,
     minfo.memoryTypeIndex = index;
     VK(vkAllocateMemory(vk->dev, &minfo, MPVK_ALLOCATOR, &slab->mem));
 
+    slab->heap_index = type.heapIndex;
+    vk->alloc->allocated[slab->heap_index] += slab->size;
+    vk->alloc->num_slabs[slab->heap_index] += 1;
+
     if (heap->flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
         VK(vkMapMemory(vk->dev, slab->mem, 0, VK_WHOLE_SIZE, 0, &slab->data));
 
@@ -233,11 +266,86 @@ static void heap_uninit(struct mpvk_ctx *vk, struct vk_heap *heap)
     *heap = (struct vk_heap){0};
 }
 
+// Refresh vk_malloc.budget and vk_malloc.usage, if supported.
+static void update_budget(struct mpvk_ctx *vk)
+{
+#ifdef VK_EXT_memory_budget
+    struct vk_malloc *ma = vk->alloc;
+    if (!vk->has_memory_budget)
+        return;
+
+    VK_LOAD_PFN(vkGetPhysicalDeviceMemoryProperties2KHR)
+    if (!pfn_vkGetPhysicalDeviceMemoryProperties2KHR)
+        return;
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+    };
+    VkPhysicalDeviceMemoryProperties2KHR props = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR,
+        .pNext = &budget,
+    };
+    pfn_vkGetPhysicalDeviceMemoryProperties2KHR(vk->physd, &props);
+
+    for (int i = 0; i < ma->props.memoryHeapCount; i++) {
+        ma->budget[i] = budget.heapBudget[i];
+        ma->usage[i] = budget.heapUsage[i];
+    }
+#endif
+}
+
 void vk_malloc_init(struct mpvk_ctx *vk)
 {
     assert(vk->physd);
     vk->alloc = talloc_zero(NULL, struct vk_malloc);
     vkGetPhysicalDeviceMemoryProperties(vk->physd, &vk->alloc->props);
+    update_budget(vk);
+}
+
+// Free slabs which have been unused for longer than min_idle microseconds.
+static void free_idle_slabs(struct mpvk_ctx *vk, int64_t min_idle)
+{
+    struct vk_malloc *ma = vk->alloc;
+    int64_t now = mp_time_us();
+
+    for (int i = 0; i < ma->num_heaps; i++) {
+        struct vk_heap *heap = &ma->heaps[i];
+        for (int n = heap->num_slabs - 1; n >= 0; n--) {
+            struct vk_slab *slab = heap->slabs[n];
+            if (slab->used || now - slab->idle_since < min_idle)
+                continue;
+            MP_TARRAY_REMOVE_AT(heap->slabs, heap->num_slabs, n);
+            slab_free(vk, slab);
+        }
+    }
+}
+
+void vk_malloc_garbage_collect(struct mpvk_ctx *vk)
+{
+    if (vk->alloc)
+        free_idle_slabs(vk, MPVK_HEAP_IDLE_TIMEOUT);
+}
+
+void vk_malloc_get_stats(struct mpvk_ctx *vk,
+                         struct voctrl_gpu_memory_stats *out)
+{
+    struct vk_malloc *ma = vk->alloc;
+    update_budget(vk);
+
+    *out = (struct voctrl_gpu_memory_stats){0};
+    int num = MPMIN(ma->props.memoryHeapCount, VO_MAX_MEMORY_HEAPS);
+    for (int i = 0; i < num; i++) {
+        VkMemoryHeap heap = ma->props.memoryHeaps[i];
+        out->heaps[out->num_heaps++] = (struct mp_gpu_memory_heap){
+            .size = heap.size,
+            .device_local = heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT,
+            .budget = ma->budget[i],
+            .usage = ma->usage[i],
+            .allocated = ma->allocated[i],
+            .used = ma->used[i],
+            .num_slabs = ma->num_slabs[i],
+        };
+    }
 }
 
 void vk_malloc_uninit(struct mpvk_ctx *vk)
@@ -261,6 +369,9 @@ void vk_free_memslice(struct mpvk_ctx *vk, struct vk_memslice slice)
 
     assert(slab->used >= slice.size);
     slab->used -= slice.size;
+    vk->alloc->used[slab->heap_index] -= slice.size;
+    if (!slab->used)
+        slab->idle_since = mp_time_us();
 
     MP_DBG(vk, "Freeing slice %zu + %zu from slab with size %zu\n",
            slice.offset, slice.size, slab->size);
@@ -312,6 +423,41 @@ static inline bool region_fits(struct vk_region r, size_t size, size_t align)
     return MP_ALIGN_UP(r.start, align) + size <= r.end;
 }
 
+// Reduce the size of a new slab if it would exceed the memory budget. Before
+// that, try to make room by freeing all unused slabs. `min_size` is what is
+// actually needed.
+static size_t fit_budget(struct mpvk_ctx *vk, struct vk_heap *heap,
+                         size_t min_size, size_t size)
+{
+    struct vk_malloc *ma = vk->alloc;
+
+    VkMemoryType type;
+    int index;
+    if (!find_best_memtype(vk, heap->typeBits, heap->flags, &type, &index))
+        return size;
+    uint32_t h = type.heapIndex;
+
+    update_budget(vk);
+    if (!ma->budget[h] || ma->usage[h] + size <= ma->budget[h])
+        return size;
+
+    free_idle_slabs(vk, 0);
+    update_budget(vk);
+
+    VkDeviceSize avail = ma->budget[h] - MPMIN(ma->budget[h], ma->usage[h]);
+    if (avail >= size)
+        return size;
+    if (avail >= min_size)
+        return avail;
+
+    if (!ma->budget_warned) {
+        MP_WARN(vk, "Exceeding the memory budget of heap %d (%zu MB).\n",
+                (int)h, (size_t)(ma->budget[h] >> 20));
+        ma->budget_warned = true;
+    }
+    return min_size;
+}
+
 // Finds the best-fitting region in a heap. If the heap is too small or too
 // fragmented, a new slab will be allocated under the hood.
 static bool heap_get_region(struct mpvk_ctx *vk, struct vk_heap *heap,
@@ -323,40 +469,54 @@ static bool heap_get_region(struct mpvk_ctx *vk, struct vk_heap *heap,
     // If the allocation is very big, serve it directly instead of bothering
     // with the heap
     if (size > MPVK_HEAP_MAXIMUM_SLAB_SIZE) {
-        slab = slab_alloc(vk, heap, size);
+        slab = slab_alloc(vk, heap, fit_budget(vk, heap, size, size));
+        if (slab)
+            slab->dedicated = true;
         *out_slab = slab;
         *out_index = 0;
         return !!slab;
     }
 
+    // Prefer the most used slab with a fitting region, and the best fitting
+    // region within it. This keeps allocations packed into few slabs, so the
+    // others are more likely to become idle and freed.
+    struct vk_slab *best_slab = NULL;
+    int best = -1;
     for (int i = 0; i < heap->num_slabs; i++) {
         slab = heap->slabs[i];
         if (slab->size < size)
             continue;
+        if (best_slab && slab->used < best_slab->used)
+            continue;
 
-        // Attempt a best fit search
-        int best = -1;
+        int fit = -1;
         for (int n = 0; n < slab->num_regions; n++) {
             struct vk_region r = slab->regions[n];
             if (!region_fits(r, size, align))
                 continue;
-            if (best >= 0 && region_len(r) > region_len(slab->regions[best]))
+            if (fit >= 0 && region_len(r) > region_len(slab->regions[fit]))
                 continue;
-            best = n;
+            fit = n;
         }
 
-        if (best >= 0) {
-            *out_slab = slab;
-            *out_index = best;
-            return true;
+        if (fit >= 0) {
+            best_slab = slab;
+            best = fit;
         }
     }
 
+    if (best_slab) {
+        *out_slab = best_slab;
+        *out_index = best;
+        return true;
+    }
+
     // Otherwise, allocate a new vk_slab and append it to the list.
     size_t cur_size = MPMAX(size, slab ? slab->size : 0);
     size_t slab_size = MPVK_HEAP_SLAB_GROWTH_RATE * cur_size;
     slab_size = MPMAX(MPVK_HEAP_MINIMUM_SLAB_SIZE, slab_size);
     slab_size = MPMIN(MPVK_HEAP_MAXIMUM_SLAB_SIZE, slab_size);
+    slab_size = fit_budget(vk, heap, size, slab_size);
     assert(slab_size >= size);
     slab = slab_alloc(vk, heap, slab_size);
     if (!slab)
@@ -396,6 +556,8 @@ static bool slice_heap(struct mpvk_ctx *vk, struct vk_heap *heap, size_t size,
     insert_region(slab, (struct vk_region) { out_end, reg.end });
 
     slab->used += size;
+    slab->idle_since = 0;
+    vk->alloc->used[slab->heap_index] += size;
     return true;
 }
 
@@ -5,6 +5,14 @@
 void vk_malloc_init(struct mpvk_ctx *vk);
 void vk_malloc_uninit(struct mpvk_ctx *vk);
 
+// Return memory of slabs which have been unused for a while to the device.
+// Should be called regularly, e.g. once per frame.
+void vk_malloc_garbage_collect(struct mpvk_ctx *vk);
+
+struct voctrl_gpu_memory_stats;
+void vk_malloc_get_stats(struct mpvk_ctx *vk,
+                         struct voctrl_gpu_memory_stats *out);
+
 // Represents a single "slice" of generic (non-buffer) memory, plus some
 // metadata for accounting. This struct is essentially read-only.
 struct vk_memslice {
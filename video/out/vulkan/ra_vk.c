@@ -1,3 +1,6 @@
+#include <inttypes.h>
+#include <unistd.h>
+
 #include "video/out/gpu/utils.h"
 #include "video/out/gpu/spirv.h"
 
@@ -11,6 +14,10 @@ struct ra_vk {
     struct mpvk_ctx *vk;
     struct ra_tex *clear_tex; // stupid hack for clear()
     struct vk_cmd *cmd;       // currently recording cmd
+    struct vk_cmd *tcmd;      // currently recording cmd on vk->pool_transfer
+    // Textures written by tcmd (see ra_tex_vk.transfer_pending)
+    struct ra_tex_vk **transfer_texs;
+    int num_transfer_texs;
 };
 
 struct mpvk_ctx *ra_vk_get(struct ra *ra)
@@ -34,6 +41,10 @@ static struct vk_cmd *vk_require_cmd(struct ra *ra)
     return p->cmd;
 }
 
+// Submit the pending uploads on the transfer queue, and make cmd (on the
+// primary queue) wait for them.
+static void vk_flush_transfer(struct ra *ra, struct vk_cmd *cmd);
+
 // Note: This technically follows the flush() API, but we don't need
 // to expose that (and in fact, it's a bad idea) since we control flushing
 // behavior with ra_vk_present_frame already.
@@ -42,6 +53,13 @@ static bool vk_flush(struct ra *ra, VkSemaphore *done)
     struct ra_vk *p = ra->priv;
     struct mpvk_ctx *vk = ra_vk_get(ra);
 
+    if (p->tcmd) {
+        struct vk_cmd *cmd = vk_require_cmd(ra);
+        if (!cmd)
+            return false;
+        vk_flush_transfer(ra, cmd);
+    }
+
     if (p->cmd) {
         if (!vk_cmd_submit(vk, p->cmd, done))
             return false;
@@ -193,8 +211,16 @@ struct ra *ra_create_vk(struct mpvk_ctx *vk, struct mp_log *log)
     ra->glsl_version = vk->spirv->glsl_version;
     ra->glsl_vulkan = true;
     ra->max_shmem = vk->limits.maxComputeSharedMemorySize;
+    ra->max_compute_group_threads = vk->limits.maxComputeWorkGroupInvocations;
     ra->max_pushc_size = vk->limits.maxPushConstantsSize;
 
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(vk->physd, &props);
+    ra->driver_id = talloc_asprintf(ra, "%s %04x:%04x driver %"PRIu32,
+                                    props.deviceName, (unsigned)props.vendorID,
+                                    (unsigned)props.deviceID,
+                                    props.driverVersion);
+
     if (vk->pool->props.queueFlags & VK_QUEUE_COMPUTE_BIT)
         ra->caps |= RA_CAP_COMPUTE;
 
@@ -202,7 +228,7 @@ struct ra *ra_create_vk(struct mpvk_ctx *vk, struct mp_log *log)
         goto error;
 
     // UBO support is required
-    ra->caps |= RA_CAP_BUF_RO | RA_CAP_FRAGCOORD;
+    ra->caps |= RA_CAP_BUF_RO | RA_CAP_FRAGCOORD | RA_CAP_PARALLEL_COMPILE;
 
     // textureGather is only supported in GLSL 400+
     if (ra->glsl_version >= 400)
@@ -280,12 +306,30 @@ static VkResult vk_create_render_pass(VkDevice dev, const struct ra_format *fmt,
     return vkCreateRenderPass(dev, &rinfo, MPVK_ALLOCATOR, out);
 }
 
+// An imported image whose planes are wrapped by separate textures.
+struct vk_shared_image {
+    VkImage img;
+    VkDeviceMemory mem;
+    bool keyed_mutex;
+    int refs; // number of textures referencing it
+    // The image layout is tracked for the whole image, not per plane
+    VkImageLayout current_layout;
+    VkPipelineStageFlags current_stage;
+    VkAccessFlags current_access;
+};
+
 // For ra_tex.priv
 struct ra_tex_vk {
     bool external_img;
     VkImageType type;
     VkImage img;
     struct vk_memslice mem;
+    VkDeviceMemory ext_mem; // for imported images, owned by the texture
+    struct vk_shared_image *shared; // for planes of an imported image
+    VkImageAspectFlags aspect; // aspect of the image view (for planes only)
+    // for exported images (see ra_vk_hold()/ra_vk_release())
+    VkSemaphore sem_hold, sem_release;
+    VkSemaphore ext_dep; // must be waited on by the next use, if set
     // for sampling
     VkImageView view;
     VkSampler sampler;
@@ -298,14 +342,81 @@ struct ra_tex_vk {
     VkImageLayout current_layout;
     VkPipelineStageFlags current_stage;
     VkAccessFlags current_access;
+    // for uploads on the transfer queue
+    bool concurrent;        // created with VK_SHARING_MODE_CONCURRENT
+    bool transfer_pending;  // written by ra_vk.tcmd, not waited on yet
+    int refs;               // number of pending commands on the primary queue
 };
 
+static void tex_unref(struct ra *ra, struct ra_tex_vk *tex_vk)
+{
+    tex_vk->refs--;
+}
+
+static void vk_flush_transfer(struct ra *ra, struct vk_cmd *cmd)
+{
+    struct ra_vk *p = ra->priv;
+    struct mpvk_ctx *vk = ra_vk_get(ra);
+
+    if (!p->tcmd)
+        return;
+
+    VkSemaphore done;
+    if (vk_cmd_submit(vk, p->tcmd, &done)) {
+        vk_cmd_dep(cmd, done, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    } else {
+        // Nothing can be done about it anymore; just don't wait on it.
+        MP_ERR(ra, "Failed submitting texture uploads!\n");
+    }
+    p->tcmd = NULL;
+
+    // The semaphore makes the writes available to the primary queue, so no
+    // further source stage/access masks are needed. The image layout is not
+    // affected by the queue change (the images are shared concurrently).
+    for (int n = 0; n < p->num_transfer_texs; n++) {
+        struct ra_tex_vk *tex_vk = p->transfer_texs[n];
+        tex_vk->transfer_pending = false;
+        tex_vk->current_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        tex_vk->current_access = 0;
+    }
+    p->num_transfer_texs = 0;
+}
+
 // Small helper to ease image barrier creation. if `discard` is set, the contents
 // of the image will be undefined after the barrier
-static void tex_barrier(struct vk_cmd *cmd, struct ra_tex_vk *tex_vk,
+static void tex_barrier(struct ra *ra, struct vk_cmd *cmd,
+                        struct ra_tex_vk *tex_vk,
                         VkPipelineStageFlags newStage, VkAccessFlags newAccess,
                         VkImageLayout newLayout, bool discard)
 {
+    struct ra_vk *p = ra->priv;
+
+    // Uses on the primary queue must wait for uploads on the transfer queue,
+    // and uploads on the transfer queue are only done to textures that are not
+    // used by pending commands on the primary queue (see vk_tex_upload()).
+    if (cmd != p->tcmd) {
+        if (tex_vk->transfer_pending)
+            vk_flush_transfer(ra, cmd);
+        tex_vk->refs++;
+        vk_cmd_callback(cmd, (vk_cb) tex_unref, ra, tex_vk);
+    }
+
+    struct vk_shared_image *shared = tex_vk->shared;
+    if (shared) {
+        tex_vk->current_layout = shared->current_layout;
+        tex_vk->current_stage = shared->current_stage;
+        tex_vk->current_access = shared->current_access;
+#ifdef VK_KHR_win32_keyed_mutex
+        if (shared->keyed_mutex)
+            vk_cmd_keyed_mutex(cmd, shared->mem, 1);
+#endif
+    }
+
+    if (tex_vk->ext_dep) {
+        vk_cmd_dep(cmd, tex_vk->ext_dep, newStage);
+        tex_vk->ext_dep = NULL;
+    }
+
     VkImageMemoryBarrier imgBarrier = {
         .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
         .oldLayout = tex_vk->current_layout,
@@ -333,6 +444,12 @@ static void tex_barrier(struct vk_cmd *cmd, struct ra_tex_vk *tex_vk,
     tex_vk->current_stage = newStage;
     tex_vk->current_layout = newLayout;
     tex_vk->current_access = newAccess;
+
+    if (shared) {
+        shared->current_stage = newStage;
+        shared->current_layout = newLayout;
+        shared->current_access = newAccess;
+    }
 }
 
 static void vk_tex_destroy(struct ra *ra, struct ra_tex *tex)
@@ -348,15 +465,45 @@ static void vk_tex_destroy(struct ra *ra, struct ra_tex *tex)
     vkDestroyRenderPass(vk->dev, tex_vk->dummyPass, MPVK_ALLOCATOR);
     vkDestroySampler(vk->dev, tex_vk->sampler, MPVK_ALLOCATOR);
     vkDestroyImageView(vk->dev, tex_vk->view, MPVK_ALLOCATOR);
-    if (!tex_vk->external_img) {
+    vkDestroySemaphore(vk->dev, tex_vk->sem_hold, MPVK_ALLOCATOR);
+    vkDestroySemaphore(vk->dev, tex_vk->sem_release, MPVK_ALLOCATOR);
+    if (tex_vk->shared) {
+        struct vk_shared_image *shared = tex_vk->shared;
+        if (--shared->refs == 0) {
+            vkDestroyImage(vk->dev, shared->img, MPVK_ALLOCATOR);
+            vkFreeMemory(vk->dev, shared->mem, MPVK_ALLOCATOR);
+            talloc_free(shared);
+        }
+    } else if (!tex_vk->external_img) {
         vkDestroyImage(vk->dev, tex_vk->img, MPVK_ALLOCATOR);
-        vk_free_memslice(vk, tex_vk->mem);
+        if (tex_vk->ext_mem) {
+            vkFreeMemory(vk->dev, tex_vk->ext_mem, MPVK_ALLOCATOR);
+        } else {
+            vk_free_memslice(vk, tex_vk->mem);
+        }
     }
 
     talloc_free(tex);
 }
 
-MAKE_LAZY_DESTRUCTOR(vk_tex_destroy, struct ra_tex);
+static void vk_tex_destroy_lazy(struct ra *ra, struct ra_tex *tex)
+{
+    if (!tex)
+        return;
+
+    // Make sure the lazy destruction happens after the pending upload.
+    struct ra_tex_vk *tex_vk = tex->priv;
+    if (tex_vk->transfer_pending) {
+        struct vk_cmd *cmd = vk_require_cmd(ra);
+        if (cmd) {
+            vk_flush_transfer(ra, cmd);
+        } else {
+            mpvk_dev_wait_idle(ra_vk_get(ra));
+        }
+    }
+
+    vk_callback(ra, (vk_cb) vk_tex_destroy, tex);
+}
 
 // Initializes non-VkImage values like the image view, samplers, etc.
 static bool vk_init_image(struct ra *ra, struct ra_tex *tex)
@@ -386,6 +533,8 @@ static bool vk_init_image(struct ra *ra, struct ra_tex *tex)
             .format = fmt->iformat,
             .subresourceRange = vk_range,
         };
+        if (tex_vk->aspect)
+            vinfo.subresourceRange.aspectMask = tex_vk->aspect;
 
         VK(vkCreateImageView(vk->dev, &vinfo, MPVK_ALLOCATOR, &tex_vk->view));
     }
@@ -466,7 +615,7 @@ static struct ra_tex *vk_tex_create(struct ra *ra,
         usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
     if (params->storage_dst)
         usage |= VK_IMAGE_USAGE_STORAGE_BIT;
-    if (params->blit_src)
+    if (params->blit_src || params->downloadable)
         usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
     if (params->host_mutable || params->blit_dst || params->initial_data)
         usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
@@ -514,6 +663,14 @@ static struct ra_tex *vk_tex_create(struct ra *ra,
         .pQueueFamilyIndices = &vk->pool->qf,
     };
 
+    // Allow uploading on the transfer queue
+    if (params->host_mutable && vk->num_qfs > 1) {
+        iinfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        iinfo.queueFamilyIndexCount = vk->num_qfs;
+        iinfo.pQueueFamilyIndices = vk->qfs;
+        tex_vk->concurrent = true;
+    }
+
     VK(vkCreateImage(vk->dev, &iinfo, MPVK_ALLOCATOR, &tex_vk->img));
 
     VkMemoryPropertyFlags memFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
@@ -577,6 +734,7 @@ struct ra_tex *ra_vk_wrap_swapchain_img(struct ra *ra, VkImage vkimg,
         .d = 1,
         .blit_src    = !!(info.imageUsage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT),
         .blit_dst    = !!(info.imageUsage & VK_IMAGE_USAGE_TRANSFER_DST_BIT),
+        .downloadable = !!(info.imageUsage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT),
         .render_src  = !!(info.imageUsage & VK_IMAGE_USAGE_SAMPLED_BIT),
         .render_dst  = !!(info.imageUsage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT),
         .storage_dst = !!(info.imageUsage & VK_IMAGE_USAGE_STORAGE_BIT),
@@ -597,6 +755,595 @@ error:
     return NULL;
 }
 
+bool ra_vk_can_import_dmabuf(struct ra *ra)
+{
+    struct mpvk_ctx *vk = ra_vk_get(ra);
+    return vk && vk->has_dmabuf_import;
+}
+
+struct ra_tex *ra_vk_import_dmabuf(struct ra *ra,
+                                   const struct ra_tex_params *params,
+                                   const struct ra_vk_dmabuf *buf)
+{
+    struct mpvk_ctx *vk = ra_vk_get(ra);
+    struct ra_tex *tex = NULL;
+    int fd = -1;
+
+    assert(params->dimensions == 2);
+    assert(!params->render_dst && !params->storage_dst && !params->blit_src &&
+           !params->blit_dst && !params->host_mutable && !params->initial_data);
+
+    if (!vk->has_dmabuf_import)
+        return NULL;
+
+    bool linear = buf->modifier == 0; // DRM_FORMAT_MOD_LINEAR
+    if (!linear && !vk->has_drm_modifiers) {
+        MP_VERBOSE(vk, "Can't import dma-buf with modifier 0x%"PRIx64".\n",
+                   buf->modifier);
+        return NULL;
+    }
+
+    tex = talloc_zero(NULL, struct ra_tex);
+    tex->params = *params;
+
+    struct ra_tex_vk *tex_vk = tex->priv = talloc_zero(tex, struct ra_tex_vk);
+    tex_vk->type = VK_IMAGE_TYPE_2D;
+
+    const struct vk_format *fmt = params->format->priv;
+
+    VkExternalMemoryImageCreateInfoKHR ext_info = {
+        .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO_KHR,
+        .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+    };
+
+    VkImageCreateInfo iinfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .pNext = &ext_info,
+        .imageType = tex_vk->type,
+        .format = fmt->iformat,
+        .extent = (VkExtent3D) { params->w, params->h, 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_LINEAR,
+        .usage = VK_IMAGE_USAGE_SAMPLED_BIT,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 1,
+        .pQueueFamilyIndices = &vk->pool->qf,
+    };
+
+    // With linear tiling, the plane offset is applied when binding the memory.
+    // With explicit modifiers, it's part of the plane layout instead.
+    size_t bind_offset = buf->offset;
+
+#ifdef VK_EXT_image_drm_format_modifier
+    VkSubresourceLayout plane_layout = {
+        .offset = buf->offset,
+        .rowPitch = buf->pitch,
+    };
+    VkImageDrmFormatModifierExplicitCreateInfoEXT mod_info = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_DRM_FORMAT_MODIFIER_EXPLICIT_CREATE_INFO_EXT,
+        .drmFormatModifier = buf->modifier,
+        .drmFormatModifierPlaneCount = 1,
+        .pPlaneLayouts = &plane_layout,
+    };
+    if (vk->has_drm_modifiers) {
+        ext_info.pNext = &mod_info;
+        iinfo.tiling = VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT;
+        bind_offset = 0;
+    }
+#endif
+
+    if (iinfo.tiling == VK_IMAGE_TILING_LINEAR) {
+        // Keep the contents on the first layout transition.
+        iinfo.initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
+
+        VkFormatProperties prop;
+        vkGetPhysicalDeviceFormatProperties(vk->physd, fmt->iformat, &prop);
+        VkFormatFeatureFlags flags = prop.linearTilingFeatures;
+        if (!(flags & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) ||
+            (params->src_linear &&
+             !(flags & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)))
+            goto error;
+    }
+
+    VK(vkCreateImage(vk->dev, &iinfo, MPVK_ALLOCATOR, &tex_vk->img));
+
+    if (iinfo.tiling == VK_IMAGE_TILING_LINEAR) {
+        // The driver decides about the layout of linear images, so we can
+        // only check whether it matches the dma-buf.
+        VkImageSubresource sub = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT };
+        VkSubresourceLayout layout;
+        vkGetImageSubresourceLayout(vk->dev, tex_vk->img, &sub, &layout);
+        if (layout.offset != 0 || layout.rowPitch != buf->pitch) {
+            MP_VERBOSE(vk, "dma-buf pitch %zu doesn't match image pitch %zu.\n",
+                       buf->pitch, (size_t)layout.rowPitch);
+            goto error;
+        }
+    }
+
+    VkMemoryRequirements reqs;
+    vkGetImageMemoryRequirements(vk->dev, tex_vk->img, &reqs);
+    if (bind_offset % reqs.alignment) {
+        MP_VERBOSE(vk, "dma-buf plane offset %zu is misaligned.\n", bind_offset);
+        goto error;
+    }
+
+    VK_LOAD_PFN(vkGetMemoryFdPropertiesKHR)
+    VkMemoryFdPropertiesKHR fd_props = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_FD_PROPERTIES_KHR,
+    };
+    VK(pfn_vkGetMemoryFdPropertiesKHR(vk->dev,
+            VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT, buf->fd, &fd_props));
+
+    uint32_t type_bits = fd_props.memoryTypeBits & reqs.memoryTypeBits;
+    int type_idx = -1;
+    for (int i = 0; i < 32; i++) {
+        if (type_bits & (1u << i)) {
+            type_idx = i;
+            break;
+        }
+    }
+    if (type_idx < 0) {
+        MP_VERBOSE(vk, "No compatible memory type for dma-buf import.\n");
+        goto error;
+    }
+
+    size_t size = buf->size ? buf->size : bind_offset + reqs.size;
+    if (size < bind_offset + reqs.size) {
+        MP_VERBOSE(vk, "dma-buf is too small for the image.\n");
+        goto error;
+    }
+
+    // On success, vulkan takes over the fd, so pass a duplicate.
+    fd = dup(buf->fd);
+    if (fd < 0)
+        goto error;
+
+    VkImportMemoryFdInfoKHR import_info = {
+        .sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_FD_INFO_KHR,
+        .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+        .fd = fd,
+    };
+    VkMemoryAllocateInfo ainfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = &import_info,
+        .allocationSize = size,
+        .memoryTypeIndex = type_idx,
+    };
+
+    VK(vkAllocateMemory(vk->dev, &ainfo, MPVK_ALLOCATOR, &tex_vk->ext_mem));
+    fd = -1;
+
+    VK(vkBindImageMemory(vk->dev, tex_vk->img, tex_vk->ext_mem, bind_offset));
+
+    if (!vk_init_image(ra, tex))
+        goto error;
+    tex_vk->current_layout = iinfo.initialLayout;
+
+    return tex;
+
+error:
+    if (fd >= 0)
+        close(fd);
+    vk_tex_destroy(ra, tex);
+    return NULL;
+}
+
+#ifdef VK_KHR_external_memory_win32
+bool ra_vk_can_import_d3d11(struct ra *ra)
+{
+    struct mpvk_ctx *vk = ra_vk_get(ra);
+    return vk && vk->has_d3d11_import;
+}
+
+bool ra_vk_get_luid(struct ra *ra, LUID *luid)
+{
+    struct mpvk_ctx *vk = ra_vk_get(ra);
+    if (!vk || !vk->has_ext_mem_caps)
+        return false;
+
+    VK_LOAD_PFN(vkGetPhysicalDeviceProperties2KHR)
+    if (!pfn_vkGetPhysicalDeviceProperties2KHR)
+        return false;
+
+    VkPhysicalDeviceIDPropertiesKHR id_props = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES_KHR,
+    };
+    VkPhysicalDeviceProperties2KHR props = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR,
+        .pNext = &id_props,
+    };
+    pfn_vkGetPhysicalDeviceProperties2KHR(vk->physd, &props);
+    if (!id_props.deviceLUIDValid)
+        return false;
+
+    memcpy(luid, id_props.deviceLUID, sizeof(*luid));
+    return true;
+}
+
+bool ra_vk_import_d3d11(struct ra *ra, HANDLE handle,
+                        const struct ra_tex_params params[2],
+                        struct ra_tex *tex[2])
+{
+    struct mpvk_ctx *vk = ra_vk_get(ra);
+    struct vk_shared_image *shared = NULL;
+
+    tex[0] = tex[1] = NULL;
+    if (!vk->has_d3d11_import)
+        return false;
+
+    // NV12 or P010 (which is treated as 16 bit, like in the d3d11 backend)
+    VkFormat format;
+    switch (params[0].format->component_size[0]) {
+    case 8:  format = VK_FORMAT_G8_B8R8_2PLANE_420_UNORM_KHR; break;
+    case 16: format = VK_FORMAT_G16_B16R16_2PLANE_420_UNORM_KHR; break;
+    default: return false;
+    }
+
+    VkExternalMemoryImageCreateInfoKHR ext_info = {
+        .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO_KHR,
+        .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_D3D11_TEXTURE_BIT_KHR,
+    };
+
+    VkImageCreateInfo iinfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .pNext = &ext_info,
+        // Each plane gets a view with a single-plane format
+        .flags = VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = format,
+        .extent = (VkExtent3D) { params[0].w, params[0].h, 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_SAMPLED_BIT,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 1,
+        .pQueueFamilyIndices = &vk->pool->qf,
+    };
+
+    shared = talloc_zero(NULL, struct vk_shared_image);
+    shared->current_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    shared->current_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    shared->keyed_mutex = true;
+
+    VK(vkCreateImage(vk->dev, &iinfo, MPVK_ALLOCATOR, &shared->img));
+
+    VkMemoryRequirements reqs;
+    vkGetImageMemoryRequirements(vk->dev, shared->img, &reqs);
+
+    VkPhysicalDeviceMemoryProperties mem_props;
+    vkGetPhysicalDeviceMemoryProperties(vk->physd, &mem_props);
+    int type_idx = -1;
+    for (int i = 0; i < mem_props.memoryTypeCount; i++) {
+        VkMemoryPropertyFlags flags = mem_props.memoryTypes[i].propertyFlags;
+        if ((reqs.memoryTypeBits & (1u << i)) &&
+            (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+        {
+            type_idx = i;
+            break;
+        }
+    }
+    if (type_idx < 0) {
+        MP_VERBOSE(vk, "No compatible memory type for D3D11 import.\n");
+        goto error;
+    }
+
+    // D3D11 textures must be imported as dedicated allocations. Importing from
+    // a handle doesn't take over the handle.
+    VkMemoryDedicatedAllocateInfoKHR dedicated_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO_KHR,
+        .image = shared->img,
+    };
+    VkImportMemoryWin32HandleInfoKHR import_info = {
+        .sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_WIN32_HANDLE_INFO_KHR,
+        .pNext = &dedicated_info,
+        .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_D3D11_TEXTURE_BIT_KHR,
+        .handle = handle,
+    };
+    VkMemoryAllocateInfo ainfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = &import_info,
+        .allocationSize = reqs.size,
+        .memoryTypeIndex = type_idx,
+    };
+
+    VK(vkAllocateMemory(vk->dev, &ainfo, MPVK_ALLOCATOR, &shared->mem));
+    VK(vkBindImageMemory(vk->dev, shared->img, shared->mem, 0));
+
+    static const VkImageAspectFlags aspects[2] = {
+        VK_IMAGE_ASPECT_PLANE_0_BIT_KHR,
+        VK_IMAGE_ASPECT_PLANE_1_BIT_KHR,
+    };
+
+    for (int n = 0; n < 2; n++) {
+        assert(params[n].dimensions == 2 && !params[n].render_dst &&
+               !params[n].storage_dst && !params[n].blit_src &&
+               !params[n].blit_dst && !params[n].host_mutable &&
+               !params[n].initial_data);
+
+        tex[n] = talloc_zero(NULL, struct ra_tex);
+        tex[n]->params = params[n];
+
+        struct ra_tex_vk *tex_vk = tex[n]->priv =
+            talloc_zero(tex[n], struct ra_tex_vk);
+        tex_vk->type = VK_IMAGE_TYPE_2D;
+        tex_vk->img = shared->img;
+        tex_vk->aspect = aspects[n];
+        tex_vk->shared = shared;
+        shared->refs++;
+
+        if (!vk_init_image(ra, tex[n]))
+            goto error;
+    }
+
+    return true;
+
+error:
+    // Once a texture references the image, the textures own it.
+    if (shared && !shared->refs) {
+        vkDestroyImage(vk->dev, shared->img, MPVK_ALLOCATOR);
+        vkFreeMemory(vk->dev, shared->mem, MPVK_ALLOCATOR);
+        talloc_free(shared);
+    }
+    for (int n = 0; n < 2; n++) {
+        vk_tex_destroy(ra, tex[n]);
+        tex[n] = NULL;
+    }
+    return false;
+}
+#endif
+
+#ifdef VK_KHR_external_memory_win32
+#define VK_EXT_MEM_HANDLE_TYPE VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_WIN32_BIT_KHR
+#define VK_EXT_SEM_HANDLE_TYPE VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_WIN32_BIT_KHR
+#else
+#define VK_EXT_MEM_HANDLE_TYPE VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT_KHR
+#define VK_EXT_SEM_HANDLE_TYPE VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT_KHR
+#endif
+
+bool ra_vk_can_export(struct ra *ra)
+{
+    struct mpvk_ctx *vk = ra_vk_get(ra);
+    return vk && vk->has_export;
+}
+
+bool ra_vk_get_uuid(struct ra *ra, uint8_t uuid[VK_UUID_SIZE])
+{
+    struct mpvk_ctx *vk = ra_vk_get(ra);
+    if (!vk || !vk->has_ext_mem_caps)
+        return false;
+
+    VK_LOAD_PFN(vkGetPhysicalDeviceProperties2KHR)
+    if (!pfn_vkGetPhysicalDeviceProperties2KHR)
+        return false;
+
+    VkPhysicalDeviceIDPropertiesKHR id_props = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES_KHR,
+    };
+    VkPhysicalDeviceProperties2KHR props = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR,
+        .pNext = &id_props,
+    };
+    pfn_vkGetPhysicalDeviceProperties2KHR(vk->physd, &props);
+
+    memcpy(uuid, id_props.deviceUUID, VK_UUID_SIZE);
+    return true;
+}
+
+static bool export_sem(struct mpvk_ctx *vk, VkSemaphore *sem,
+                       ra_vk_handle *out)
+{
+    VkExportSemaphoreCreateInfoKHR export_info = {
+        .sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO_KHR,
+        .handleTypes = VK_EXT_SEM_HANDLE_TYPE,
+    };
+    VkSemaphoreCreateInfo sinfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &export_info,
+    };
+    VK(vkCreateSemaphore(vk->dev, &sinfo, MPVK_ALLOCATOR, sem));
+
+#ifdef VK_KHR_external_memory_win32
+    VK_LOAD_PFN(vkGetSemaphoreWin32HandleKHR)
+    VkSemaphoreGetWin32HandleInfoKHR hinfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_WIN32_HANDLE_INFO_KHR,
+        .semaphore = *sem,
+        .handleType = VK_EXT_SEM_HANDLE_TYPE,
+    };
+    VK(pfn_vkGetSemaphoreWin32HandleKHR(vk->dev, &hinfo, out));
+#else
+    VK_LOAD_PFN(vkGetSemaphoreFdKHR)
+    VkSemaphoreGetFdInfoKHR finfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR,
+        .semaphore = *sem,
+        .handleType = VK_EXT_SEM_HANDLE_TYPE,
+    };
+    VK(pfn_vkGetSemaphoreFdKHR(vk->dev, &finfo, out));
+#endif
+    return true;
+
+error:
+    return false;
+}
+
+static void close_handle(ra_vk_handle *h)
+{
+#ifdef VK_KHR_external_memory_win32
+    if (*h)
+        CloseHandle(*h);
+    *h = NULL;
+#else
+    if (*h >= 0)
+        close(*h);
+    *h = -1;
+#endif
+}
+
+void ra_vk_export_close(struct ra_vk_export *ex)
+{
+    close_handle(&ex->mem);
+    close_handle(&ex->sem_hold);
+    close_handle(&ex->sem_release);
+}
+
+struct ra_tex *ra_vk_create_exported_tex(struct ra *ra,
+                                         const struct ra_tex_params *params,
+                                         struct ra_vk_export *out)
+{
+    struct mpvk_ctx *vk = ra_vk_get(ra);
+    struct ra_tex *tex = NULL;
+
+#ifdef VK_KHR_external_memory_win32
+    *out = (struct ra_vk_export){0};
+#else
+    *out = (struct ra_vk_export){ .mem = -1, .sem_hold = -1, .sem_release = -1 };
+#endif
+
+    assert(params->dimensions == 2);
+    assert(!params->render_dst && !params->storage_dst && !params->blit_src &&
+           !params->blit_dst && !params->host_mutable && !params->initial_data);
+
+    if (!vk->has_export)
+        return NULL;
+
+    tex = talloc_zero(NULL, struct ra_tex);
+    tex->params = *params;
+
+    struct ra_tex_vk *tex_vk = tex->priv = talloc_zero(tex, struct ra_tex_vk);
+    tex_vk->type = VK_IMAGE_TYPE_2D;
+
+    const struct vk_format *fmt = params->format->priv;
+
+    VkExternalMemoryImageCreateInfoKHR ext_info = {
+        .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO_KHR,
+        .handleTypes = VK_EXT_MEM_HANDLE_TYPE,
+    };
+
+    VkImageCreateInfo iinfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .pNext = &ext_info,
+        .imageType = tex_vk->type,
+        .format = fmt->iformat,
+        .extent = (VkExtent3D) { params->w, params->h, 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_SAMPLED_BIT,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 1,
+        .pQueueFamilyIndices = &vk->pool->qf,
+    };
+
+    VK(vkCreateImage(vk->dev, &iinfo, MPVK_ALLOCATOR, &tex_vk->img));
+
+    VkMemoryRequirements reqs;
+    vkGetImageMemoryRequirements(vk->dev, tex_vk->img, &reqs);
+
+    VkPhysicalDeviceMemoryProperties mem_props;
+    vkGetPhysicalDeviceMemoryProperties(vk->physd, &mem_props);
+    int type_idx = -1;
+    for (int i = 0; i < mem_props.memoryTypeCount; i++) {
+        VkMemoryPropertyFlags flags = mem_props.memoryTypes[i].propertyFlags;
+        if ((reqs.memoryTypeBits & (1u << i)) &&
+            (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+        {
+            type_idx = i;
+            break;
+        }
+    }
+    if (type_idx < 0) {
+        MP_VERBOSE(vk, "No compatible memory type for exported image.\n");
+        goto error;
+    }
+
+    // Dedicated allocations let the other API know the image layout.
+    VkMemoryDedicatedAllocateInfoKHR dedicated_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO_KHR,
+        .image = tex_vk->img,
+    };
+    VkExportMemoryAllocateInfoKHR export_info = {
+        .sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO_KHR,
+        .pNext = &dedicated_info,
+        .handleTypes = VK_EXT_MEM_HANDLE_TYPE,
+    };
+    VkMemoryAllocateInfo ainfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = &export_info,
+        .allocationSize = reqs.size,
+        .memoryTypeIndex = type_idx,
+    };
+
+    VK(vkAllocateMemory(vk->dev, &ainfo, MPVK_ALLOCATOR, &tex_vk->ext_mem));
+    VK(vkBindImageMemory(vk->dev, tex_vk->img, tex_vk->ext_mem, 0));
+    out->mem_size = reqs.size;
+
+#ifdef VK_KHR_external_memory_win32
+    VK_LOAD_PFN(vkGetMemoryWin32HandleKHR)
+    VkMemoryGetWin32HandleInfoKHR hinfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_GET_WIN32_HANDLE_INFO_KHR,
+        .memory = tex_vk->ext_mem,
+        .handleType = VK_EXT_MEM_HANDLE_TYPE,
+    };
+    VK(pfn_vkGetMemoryWin32HandleKHR(vk->dev, &hinfo, &out->mem));
+#else
+    VK_LOAD_PFN(vkGetMemoryFdKHR)
+    VkMemoryGetFdInfoKHR finfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR,
+        .memory = tex_vk->ext_mem,
+        .handleType = VK_EXT_MEM_HANDLE_TYPE,
+    };
+    VK(pfn_vkGetMemoryFdKHR(vk->dev, &finfo, &out->mem));
+#endif
+
+    if (!export_sem(vk, &tex_vk->sem_hold, &out->sem_hold) ||
+        !export_sem(vk, &tex_vk->sem_release, &out->sem_release))
+        goto error;
+
+    if (!vk_init_image(ra, tex))
+        goto error;
+
+    return tex;
+
+error:
+    ra_vk_export_close(out);
+    vk_tex_destroy(ra, tex);
+    return NULL;
+}
+
+bool ra_vk_hold(struct ra *ra, struct ra_tex *tex)
+{
+    struct ra_tex_vk *tex_vk = tex->priv;
+    assert(tex_vk->sem_hold);
+
+    struct vk_cmd *cmd = vk_require_cmd(ra);
+    if (!cmd)
+        return false;
+
+    tex_barrier(ra, cmd, tex_vk, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                VK_IMAGE_LAYOUT_GENERAL, false);
+    vk_cmd_sig(cmd, tex_vk->sem_hold);
+    return vk_flush(ra, NULL);
+}
+
+void ra_vk_release(struct ra *ra, struct ra_tex *tex)
+{
+    struct ra_tex_vk *tex_vk = tex->priv;
+    assert(tex_vk->sem_release && !tex_vk->ext_dep);
+
+    // The external writes are made available by the semaphore, and the layout
+    // is the one ra_vk_hold() left the image in.
+    tex_vk->ext_dep = tex_vk->sem_release;
+    tex_vk->current_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    tex_vk->current_access = 0;
+}
+
 // For ra_buf.priv
 struct ra_buf_vk {
     struct vk_bufslice slice;
@@ -707,6 +1454,10 @@ static struct ra_buf *vk_buf_create(struct ra *ra,
         bufFlags |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
         memFlags |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
         break;
+    case RA_BUF_TYPE_TEX_DOWNLOAD:
+        bufFlags |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        memFlags |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        break;
     case RA_BUF_TYPE_UNIFORM:
         bufFlags |= VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
         memFlags |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
@@ -730,9 +1481,12 @@ static struct ra_buf *vk_buf_create(struct ra *ra,
     }
 
     if (params->host_mapped) {
+        // Cached memory is needed because the mapping may also be read from
+        // the CPU, e.g. by decoders using it as reference frame (DR).
         memFlags |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
                     VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        align = MP_ALIGN_UP(align, vk->limits.optimalBufferCopyOffsetAlignment);
     }
 
     if (!vk_malloc_buffer(vk, bufFlags, memFlags, params->size, align,
@@ -757,10 +1511,48 @@ error:
 
 static bool vk_buf_poll(struct ra *ra, struct ra_buf *buf)
 {
+    struct mpvk_ctx *vk = ra_vk_get(ra);
     struct ra_buf_vk *buf_vk = buf->priv;
+
+    // The reference held by pending commands is only dropped by the command
+    // callbacks, so make sure those had a chance to run.
+    if (buf_vk->refcount > 1)
+        mpvk_dev_poll_cmds(vk, 0);
+
     return buf_vk->refcount == 1;
 }
 
+// Whether the upload can be done on the transfer queue, so that it runs in
+// parallel to rendering. This is only possible if the texture is not in use
+// by commands on the primary queue (which would need another semaphore in
+// the other direction).
+static bool can_upload_on_transfer(struct ra *ra, struct ra_tex *tex,
+                                   const VkBufferImageCopy *region)
+{
+    struct mpvk_ctx *vk = ra_vk_get(ra);
+    struct ra_tex_vk *tex_vk = tex->priv;
+
+    if (!vk->pool_transfer || !tex_vk->concurrent)
+        return false;
+
+    // Copies on DMA queues may be restricted to coarse blocks.
+    VkExtent3D gran = vk->pool_transfer->props.minImageTransferGranularity;
+    if (!gran.width || !gran.height || !gran.depth)
+        return false; // only whole mip levels; not worth bothering
+    const VkOffset3D *o = &region->imageOffset;
+    const VkExtent3D *e = &region->imageExtent;
+    if (o->x % gran.width || o->y % gran.height || o->z % gran.depth)
+        return false;
+    if ((e->width % gran.width && o->x + e->width != tex->params.w) ||
+        (e->height % gran.height && o->y + e->height != tex->params.h) ||
+        (e->depth % gran.depth && o->z + e->depth != tex->params.d))
+        return false;
+
+    if (tex_vk->refs)
+        mpvk_pool_poll_cmds(vk, vk->pool, 0);
+    return tex_vk->refs == 0;
+}
+
 static bool vk_tex_upload(struct ra *ra,
                           const struct ra_tex_upload_params *params)
 {
@@ -775,6 +1567,23 @@ static bool vk_tex_upload(struct ra *ra,
     struct ra_buf *buf = params->buf;
     struct ra_buf_vk *buf_vk = buf->priv;
 
+    // vkCmdCopyBufferToImage requires the buffer offset to be a multiple of
+    // both 4 and the texel size, and the stride to be a multiple of the texel
+    // size. Persistently mapped buffers (DR) are laid out by the decoder, so
+    // they may not satisfy this; copy through the host mapping instead.
+    int texel_size = tex->params.format->pixel_size;
+    VkDeviceSize buf_offset = buf_vk->slice.mem.offset + params->buf_offset;
+    bool misaligned = buf_offset % 4 || buf_offset % texel_size;
+    if (tex->params.dimensions == 2 && params->stride % texel_size)
+        misaligned = true;
+    if (misaligned && buf->data) {
+        MP_TRACE(ra, "Misaligned buffer upload, copying via host mapping.\n");
+        struct ra_tex_upload_params host_params = *params;
+        host_params.buf = NULL;
+        host_params.src = (char *)buf->data + params->buf_offset;
+        return ra_tex_upload_pbo(ra, &tex_vk->pbo, &host_params);
+    }
+
     VkBufferImageCopy region = {
         .bufferOffset = buf_vk->slice.mem.offset + params->buf_offset,
         .bufferRowLength = tex->params.w,
@@ -802,14 +1611,32 @@ static bool vk_tex_upload(struct ra *ra,
     uint64_t size = region.bufferRowLength * region.bufferImageHeight *
                     region.imageExtent.depth;
 
-    struct vk_cmd *cmd = vk_require_cmd(ra);
+    struct vk_cmd *cmd = NULL;
+    if (can_upload_on_transfer(ra, tex, &region)) {
+        struct ra_vk *p = ra->priv;
+        struct mpvk_ctx *vk = ra_vk_get(ra);
+        if (!p->tcmd)
+            p->tcmd = vk_cmd_begin(vk, vk->pool_transfer);
+        cmd = p->tcmd;
+        if (cmd && !tex_vk->transfer_pending) {
+            // All previous uses on the primary queue have completed, so
+            // there's nothing to wait for (and their pipeline stages
+            // wouldn't be valid on this queue anyway).
+            tex_vk->current_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            tex_vk->current_access = 0;
+            tex_vk->transfer_pending = true;
+            MP_TARRAY_APPEND(p, p->transfer_texs, p->num_transfer_texs, tex_vk);
+        }
+    }
+    if (!cmd)
+        cmd = vk_require_cmd(ra);
     if (!cmd)
         goto error;
 
     buf_barrier(ra, cmd, buf, VK_PIPELINE_STAGE_TRANSFER_BIT,
                 VK_ACCESS_TRANSFER_READ_BIT, region.bufferOffset, size);
 
-    tex_barrier(cmd, tex_vk, VK_PIPELINE_STAGE_TRANSFER_BIT,
+    tex_barrier(ra, cmd, tex_vk, VK_PIPELINE_STAGE_TRANSFER_BIT,
                 VK_ACCESS_TRANSFER_WRITE_BIT,
                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                 params->invalidate);
@@ -823,6 +1650,59 @@ error:
     return false;
 }
 
+static bool vk_tex_download(struct ra *ra, struct ra_tex *tex, struct ra_buf *buf)
+{
+    struct ra_tex_vk *tex_vk = tex->priv;
+    struct ra_buf_vk *buf_vk = buf->priv;
+
+    assert(tex->params.downloadable && tex->params.dimensions == 2);
+    assert(buf->params.type == RA_BUF_TYPE_TEX_DOWNLOAD);
+
+    size_t size = (size_t)tex->params.w * tex->params.h *
+                  tex->params.format->pixel_size;
+    if (!buf->data || !size || size > buf->params.size)
+        return false;
+
+    struct vk_cmd *cmd = vk_require_cmd(ra);
+    if (!cmd)
+        return false;
+
+    VkBufferImageCopy region = {
+        .bufferOffset = buf_vk->slice.mem.offset,
+        .bufferRowLength = tex->params.w,
+        .bufferImageHeight = tex->params.h,
+        .imageSubresource = vk_layers,
+        .imageExtent = (VkExtent3D){tex->params.w, tex->params.h, 1},
+    };
+
+    tex_barrier(ra, cmd, tex_vk, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_ACCESS_TRANSFER_READ_BIT,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false);
+
+    buf_barrier(ra, cmd, buf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_ACCESS_TRANSFER_WRITE_BIT, region.bufferOffset, size);
+
+    vkCmdCopyImageToBuffer(cmd->buf, tex_vk->img, tex_vk->current_layout,
+                           buf_vk->slice.buf, 1, &region);
+
+    // Make the copy visible to the host once the command has completed
+    VkBufferMemoryBarrier hostBarrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        .buffer = buf_vk->slice.buf,
+        .offset = region.bufferOffset,
+        .size = size,
+    };
+    vkCmdPipelineBarrier(cmd->buf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL,
+                         1, &hostBarrier, 0, NULL);
+    buf_vk->current_stage = VK_PIPELINE_STAGE_HOST_BIT;
+    buf_vk->current_access = VK_ACCESS_HOST_READ_BIT;
+
+    return true;
+}
+
 #define MPVK_NUM_DS MPVK_MAX_STREAMING_DEPTH
 
 // For ra_renderpass.priv
@@ -835,7 +1715,7 @@ struct ra_renderpass_vk {
     VkDescriptorSetLayout dsLayout;
     VkDescriptorPool dsPool;
     VkDescriptorSet dss[MPVK_NUM_DS];
-    int dindex;
+    uint32_t dmask; // bit set = the descriptor set is not in use by the GPU
     // Vertex buffers (vertices)
     struct ra_buf_pool vbo;
 
@@ -1081,6 +1961,7 @@ static struct ra_renderpass *vk_renderpass_create(struct ra *ra,
     };
 
     VK(vkAllocateDescriptorSets(vk->dev, &ainfo, pass_vk->dss));
+    pass_vk->dmask = (1u << MPVK_NUM_DS) - 1;
 
     VkPipelineLayoutCreateInfo linfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
@@ -1340,7 +2221,7 @@ static void vk_update_descriptor(struct ra *ra, struct vk_cmd *cmd,
         struct ra_tex_vk *tex_vk = tex->priv;
 
         assert(tex->params.render_src);
-        tex_barrier(cmd, tex_vk, passStages[pass->params.type],
+        tex_barrier(ra, cmd, tex_vk, passStages[pass->params.type],
                     VK_ACCESS_SHADER_READ_BIT,
                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false);
 
@@ -1359,7 +2240,7 @@ static void vk_update_descriptor(struct ra *ra, struct vk_cmd *cmd,
         struct ra_tex_vk *tex_vk = tex->priv;
 
         assert(tex->params.storage_dst);
-        tex_barrier(cmd, tex_vk, passStages[pass->params.type],
+        tex_barrier(ra, cmd, tex_vk, passStages[pass->params.type],
                     VK_ACCESS_SHADER_WRITE_BIT,
                     VK_IMAGE_LAYOUT_GENERAL, false);
 
@@ -1397,6 +2278,38 @@ static void vk_update_descriptor(struct ra *ra, struct vk_cmd *cmd,
     }
 }
 
+static void release_ds(struct ra_renderpass_vk *pass_vk, void *idx)
+{
+    pass_vk->dmask |= 1u << (uintptr_t)idx;
+}
+
+// Returns the index of a descriptor set of the pass that is not used by any
+// pending command. Descriptor sets may only be updated once the GPU is done
+// with them, so with many frames in flight (or a pass that is run very often
+// per frame) this may have to wait.
+static int get_free_ds(struct ra *ra, struct ra_renderpass_vk *pass_vk)
+{
+    struct mpvk_ctx *vk = ra_vk_get(ra);
+
+    if (!pass_vk->dmask)
+        mpvk_dev_poll_cmds(vk, 0);
+
+    if (!pass_vk->dmask) {
+        // The current command might be the one holding them, so submit it.
+        MP_TRACE(ra, "Waiting for a free descriptor set.\n");
+        vk_flush(ra, NULL);
+        while (!pass_vk->dmask && vk->pool->cindex_pending != vk->pool->cindex)
+            mpvk_dev_poll_cmds(vk, UINT64_MAX);
+    }
+
+    for (int i = 0; i < MPVK_NUM_DS; i++) {
+        if (pass_vk->dmask & (1u << i))
+            return i;
+    }
+
+    return -1;
+}
+
 static void vk_renderpass_run(struct ra *ra,
                               const struct ra_renderpass_run_params *params)
 {
@@ -1404,6 +2317,12 @@ static void vk_renderpass_run(struct ra *ra,
     struct ra_renderpass *pass = params->pass;
     struct ra_renderpass_vk *pass_vk = pass->priv;
 
+    int dindex = get_free_ds(ra, pass_vk);
+    if (dindex < 0) {
+        MP_ERR(ra, "No free descriptor sets!\n");
+        goto error;
+    }
+
     struct vk_cmd *cmd = vk_require_cmd(ra);
     if (!cmd)
         goto error;
@@ -1415,8 +2334,9 @@ static void vk_renderpass_run(struct ra *ra,
 
     vkCmdBindPipeline(cmd->buf, bindPoint[pass->params.type], pass_vk->pipe);
 
-    VkDescriptorSet ds = pass_vk->dss[pass_vk->dindex++];
-    pass_vk->dindex %= MPVK_NUM_DS;
+    VkDescriptorSet ds = pass_vk->dss[dindex];
+    pass_vk->dmask &= ~(1u << dindex);
+    vk_cmd_callback(cmd, (vk_cb)release_ds, pass_vk, (void *)(uintptr_t)dindex);
 
     for (int i = 0; i < params->num_values; i++)
         vk_update_descriptor(ra, cmd, pass, params->values[i], ds, i);
@@ -1472,7 +2392,7 @@ static void vk_renderpass_run(struct ra *ra,
         if (pass->params.enable_blend) {
             // Normally this transition is handled implicitly by the renderpass,
             // but if we need to preserve the FBO we have to do it manually.
-            tex_barrier(cmd, tex_vk, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            tex_barrier(ra, cmd, tex_vk, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
                         VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
                         VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, false);
         }
@@ -1529,7 +2449,7 @@ static void vk_blit(struct ra *ra, struct ra_tex *dst, struct ra_tex *src,
     if (!cmd)
         return;
 
-    tex_barrier(cmd, src_vk, VK_PIPELINE_STAGE_TRANSFER_BIT,
+    tex_barrier(ra, cmd, src_vk, VK_PIPELINE_STAGE_TRANSFER_BIT,
                 VK_ACCESS_TRANSFER_READ_BIT,
                 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
                 false);
@@ -1539,7 +2459,7 @@ static void vk_blit(struct ra *ra, struct ra_tex *dst, struct ra_tex *src,
                    dst_rc->x1 == dst->params.w &&
                    dst_rc->y1 == dst->params.h;
 
-    tex_barrier(cmd, dst_vk, VK_PIPELINE_STAGE_TRANSFER_BIT,
+    tex_barrier(ra, cmd, dst_vk, VK_PIPELINE_STAGE_TRANSFER_BIT,
                 VK_ACCESS_TRANSFER_WRITE_BIT,
                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                 discard);
@@ -1569,7 +2489,7 @@ static void vk_clear(struct ra *ra, struct ra_tex *tex, float color[4],
     struct mp_rect full = {0, 0, tex->params.w, tex->params.h};
     if (!rc || mp_rect_equals(rc, &full)) {
         // To clear the entire image, we can use the efficient clear command
-        tex_barrier(cmd, tex_vk, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        tex_barrier(ra, cmd, tex_vk, VK_PIPELINE_STAGE_TRANSFER_BIT,
                     VK_ACCESS_TRANSFER_WRITE_BIT,
                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true);
 
@@ -1686,11 +2606,17 @@ static uint64_t vk_timer_stop(struct ra *ra, ra_timer *ratimer)
     return timer->result;
 }
 
+static void vk_memory_stats(struct ra *ra, struct voctrl_gpu_memory_stats *out)
+{
+    vk_malloc_get_stats(ra_vk_get(ra), out);
+}
+
 static struct ra_fns ra_fns_vk = {
     .destroy                = vk_destroy_ra,
     .tex_create             = vk_tex_create,
     .tex_destroy            = vk_tex_destroy_lazy,
     .tex_upload             = vk_tex_upload,
+    .tex_download           = vk_tex_download,
     .buf_create             = vk_buf_create,
     .buf_destroy            = vk_buf_destroy_lazy,
     .buf_update             = vk_buf_update,
@@ -1707,6 +2633,7 @@ static struct ra_fns ra_fns_vk = {
     .timer_destroy          = vk_timer_destroy_lazy,
     .timer_start            = vk_timer_start,
     .timer_stop             = vk_timer_stop,
+    .memory_stats           = vk_memory_stats,
 };
 
 static void present_cb(void *priv, int *inflight)
@@ -1728,7 +2655,7 @@ bool ra_vk_submit(struct ra *ra, struct ra_tex *tex, VkSemaphore acquired,
 
     struct ra_tex_vk *tex_vk = tex->priv;
     assert(tex_vk->external_img);
-    tex_barrier(cmd, tex_vk, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+    tex_barrier(ra, cmd, tex_vk, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
                 VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, false);
 
     // These are the only two stages that we use/support for actually
@@ -1740,6 +2667,7 @@ bool ra_vk_submit(struct ra *ra, struct ra_tex *tex, VkSemaphore acquired,
                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
                VK_PIPELINE_STAGE_TRANSFER_BIT);
 
+    vk_malloc_garbage_collect(ra_vk_get(ra));
     return vk_flush(ra, done);
 
 error:
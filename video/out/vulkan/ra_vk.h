@@ -29,3 +29,91 @@ bool ra_vk_submit(struct ra *ra, struct ra_tex *tex, VkSemaphore acquired,
 // May be called on a struct ra of any type. Returns NULL if the ra is not
 // a vulkan ra.
 struct mpvk_ctx *ra_vk_get(struct ra *ra);
+
+// A single-plane image stored in a dma-buf.
+struct ra_vk_dmabuf {
+    int fd;             // not closed or taken over by ra_vk_import_dmabuf()
+    size_t size;        // size of the whole buffer, or 0 if unknown
+    size_t offset;      // byte offset of the plane within the buffer
+    size_t pitch;       // bytes per row
+    uint64_t modifier;  // DRM format modifier (0 = linear)
+};
+
+// Returns whether ra_vk_import_dmabuf() can work at all. Tiled images (with
+// a non-0 modifier) additionally need VK_EXT_image_drm_format_modifier.
+bool ra_vk_can_import_dmabuf(struct ra *ra);
+
+// Creates a texture that directly samples from the dma-buf, without copying.
+// Only params->render_src and params->src_linear are supported. The caller
+// needs to synchronize access to the contents, and must not change them
+// while the texture is in use. Returns NULL on failure.
+struct ra_tex *ra_vk_import_dmabuf(struct ra *ra,
+                                   const struct ra_tex_params *params,
+                                   const struct ra_vk_dmabuf *buf);
+
+#ifdef VK_KHR_external_memory_win32
+// Returns whether ra_vk_import_d3d11() can work at all.
+bool ra_vk_can_import_d3d11(struct ra *ra);
+
+// Get the LUID of the vulkan device, so that D3D11 resources can be created on
+// the same adapter. Returns false if it's not known.
+bool ra_vk_get_luid(struct ra *ra, LUID *luid);
+
+// Imports a 2-plane D3D11 texture (NV12 or P010) shared with an NT handle,
+// which was created with D3D11_RESOURCE_MISC_SHARED_NTHANDLE and
+// D3D11_RESOURCE_MISC_SHARED_KEYEDMUTEX. The handle is not taken over. The
+// planes are returned as separate textures in tex[0] and tex[1], which are
+// described by params[0] and params[1] (only render_src and src_linear are
+// supported). Each command that samples them acquires the keyed mutex with
+// key 1, and releases it with key 1. Returns success.
+bool ra_vk_import_d3d11(struct ra *ra, HANDLE handle,
+                        const struct ra_tex_params params[2],
+                        struct ra_tex *tex[2]);
+#endif
+
+// Native handle type used for sharing memory and semaphores with other APIs.
+#ifdef VK_KHR_external_memory_win32
+typedef HANDLE ra_vk_handle;
+#else
+typedef int ra_vk_handle;
+#endif
+
+// Memory and semaphores of a texture created by ra_vk_create_exported_tex().
+// The handles are owned by the caller (but note that importing a fd into e.g.
+// CUDA transfers the ownership).
+struct ra_vk_export {
+    ra_vk_handle mem;           // dedicated allocation of the image
+    size_t mem_size;
+    ra_vk_handle sem_hold;      // signaled by vulkan, see ra_vk_hold()
+    ra_vk_handle sem_release;   // signaled by the other API
+};
+
+// Returns whether ra_vk_create_exported_tex() can work at all.
+bool ra_vk_can_export(struct ra *ra);
+
+// Get the UUID of the vulkan device, so that other APIs can pick the same
+// device. Returns false if it's not known.
+bool ra_vk_get_uuid(struct ra *ra, uint8_t uuid[VK_UUID_SIZE]);
+
+// Creates a texture whose contents are written by another API (such as CUDA),
+// and exports its memory and a pair of semaphores, which the caller must
+// close with ra_vk_export_close() once it's done with them. Only
+// params->render_src and params->src_linear are supported. Returns NULL on
+// failure.
+struct ra_tex *ra_vk_create_exported_tex(struct ra *ra,
+                                         const struct ra_tex_params *params,
+                                         struct ra_vk_export *out);
+
+// Close all handles that are still set (the ones that weren't taken over).
+void ra_vk_export_close(struct ra_vk_export *ex);
+
+// Hand an exported texture over to the other API: once all pending vulkan uses
+// of it are done, sem_hold is signaled. The other API must wait on it before
+// writing the texture, and then signal sem_release, after which the caller
+// calls ra_vk_release(). Every ra_vk_hold() must be followed by exactly one
+// ra_vk_release(). Returns success.
+bool ra_vk_hold(struct ra *ra, struct ra_tex *tex);
+
+// Take the texture back from the other API. The next vulkan use waits on
+// sem_release.
+void ra_vk_release(struct ra *ra, struct ra_tex *tex);
@@ -1,4 +1,5 @@
 #include <libavutil/macros.h>
+#include <string.h>
 
 #include "video/out/gpu/spirv.h"
 #include "utils.h"
@@ -149,6 +150,7 @@ void mpvk_uninit(struct mpvk_ctx *vk)
         return;
 
     if (vk->dev) {
+        vk_cmdpool_uninit(vk, vk->pool_transfer);
         vk_cmdpool_uninit(vk, vk->pool);
         vk_malloc_uninit(vk);
         vkDestroyDevice(vk->dev, MPVK_ALLOCATOR);
@@ -167,6 +169,31 @@ void mpvk_uninit(struct mpvk_ctx *vk)
     *vk = (struct mpvk_ctx){0};
 }
 
+// Append all extensions in the NULL-terminated list `want` to `exts`, but only
+// if every single one of them is contained in `avail`. Returns success.
+// Extensions that are already in `exts` are not added again.
+static bool mpvk_add_exts(void *ta_ctx, const char ***exts, int *num_exts,
+                          VkExtensionProperties *avail, int num_avail,
+                          const char *const *want)
+{
+    for (int n = 0; want[n]; n++) {
+        bool found = false;
+        for (int i = 0; i < num_avail; i++)
+            found |= strcmp(avail[i].extensionName, want[n]) == 0;
+        if (!found)
+            return false;
+    }
+
+    for (int n = 0; want[n]; n++) {
+        bool dup = false;
+        for (int i = 0; i < *num_exts; i++)
+            dup |= strcmp((*exts)[i], want[n]) == 0;
+        if (!dup)
+            MP_TARRAY_APPEND(ta_ctx, *exts, *num_exts, want[n]);
+    }
+    return true;
+}
+
 bool mpvk_instance_init(struct mpvk_ctx *vk, struct mp_log *log,
                         const char *surf_ext_name, bool debug)
 {
@@ -189,30 +216,53 @@ bool mpvk_instance_init(struct mpvk_ctx *vk, struct mp_log *log,
         info.enabledLayerCount = MP_ARRAY_SIZE(layers);
     }
 
+    void *tmp = talloc_new(NULL);
+
     // Enable whatever extensions were compiled in.
-    const char *extensions[] = {
-        VK_KHR_SURFACE_EXTENSION_NAME,
-        surf_ext_name,
-
-        // Extra extensions only used for debugging. These are toggled by
-        // decreasing the enabledExtensionCount, so the number needs to be
-        // synchronized with the code below.
-        VK_EXT_DEBUG_REPORT_EXTENSION_NAME,
+    const char **exts = NULL;
+    int num_exts = 0;
+    MP_TARRAY_APPEND(tmp, exts, num_exts, VK_KHR_SURFACE_EXTENSION_NAME);
+    MP_TARRAY_APPEND(tmp, exts, num_exts, surf_ext_name);
+
+    // Extra extensions only used for debugging.
+    if (debug)
+        MP_TARRAY_APPEND(tmp, exts, num_exts, VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+
+    // Needed for importing external memory (hwdec interop), but optional.
+    static const char *const mem_caps_exts[] = {
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
+        VK_KHR_EXTERNAL_MEMORY_CAPABILITIES_EXTENSION_NAME,
+        NULL
     };
 
-    const int debugExtensionCount = 1;
+    // Needed for sharing semaphores with CUDA (hwdec interop)
+    static const char *const sem_caps_exts[] = {
+        VK_KHR_EXTERNAL_SEMAPHORE_CAPABILITIES_EXTENSION_NAME,
+        NULL
+    };
 
-    info.ppEnabledExtensionNames = extensions;
-    info.enabledExtensionCount = MP_ARRAY_SIZE(extensions);
+    uint32_t num_avail = 0;
+    vkEnumerateInstanceExtensionProperties(NULL, &num_avail, NULL);
+    VkExtensionProperties *avail =
+        talloc_array(tmp, VkExtensionProperties, num_avail);
+    vkEnumerateInstanceExtensionProperties(NULL, &num_avail, avail);
+
+    vk->has_ext_mem_caps = mpvk_add_exts(tmp, &exts, &num_exts, avail,
+                                         num_avail, mem_caps_exts);
+    if (vk->has_ext_mem_caps) {
+        vk->has_ext_sem_caps = mpvk_add_exts(tmp, &exts, &num_exts, avail,
+                                             num_avail, sem_caps_exts);
+    }
 
-    if (!debug)
-        info.enabledExtensionCount -= debugExtensionCount;
+    info.ppEnabledExtensionNames = exts;
+    info.enabledExtensionCount = num_exts;
 
     MP_VERBOSE(vk, "Creating instance with extensions:\n");
     for (int i = 0; i < info.enabledExtensionCount; i++)
         MP_VERBOSE(vk, "    %s\n", info.ppEnabledExtensionNames[i]);
 
     VkResult res = vkCreateInstance(&info, MPVK_ALLOCATOR, &vk->inst);
+    talloc_free(tmp);
     if (res != VK_SUCCESS) {
         MP_VERBOSE(vk, "Failed creating instance: %s\n", vk_err(res));
         return false;
@@ -491,16 +541,36 @@ bool mpvk_device_init(struct mpvk_ctx *vk, struct mpvk_device_opts opts)
         goto error;
     }
 
+    // Texture uploads can run in parallel to rendering on a dedicated
+    // transfer queue family (usually a DMA engine). Queue families which can
+    // also do graphics or compute are just the same hardware as the primary
+    // one, so ignore them.
+    int tidx = -1;
+    for (int i = 0; opts.transfer_queue && i < qfnum; i++) {
+        VkQueueFlags flags = qfs[i].queueFlags;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) &&
+            !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+        {
+            tidx = i;
+            break;
+        }
+    }
+
     // Now that we know which queue families we want, we can create the logical
     // device
     assert(opts.queue_count <= MPVK_MAX_QUEUES);
     static const float priorities[MPVK_MAX_QUEUES] = {0};
-    VkDeviceQueueCreateInfo qinfo = {
+    VkDeviceQueueCreateInfo qinfos[2] = {{
         .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
         .queueFamilyIndex = idx,
         .queueCount = MPMIN(qfs[idx].queueCount, opts.queue_count),
         .pQueuePriorities = priorities,
-    };
+    }, {
+        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+        .queueFamilyIndex = tidx,
+        .queueCount = 1,
+        .pQueuePriorities = priorities,
+    }};
 
     const char **exts = NULL;
     int num_exts = 0;
@@ -508,10 +578,117 @@ bool mpvk_device_init(struct mpvk_ctx *vk, struct mpvk_device_opts opts)
     if (vk->spirv->required_ext)
         MP_TARRAY_APPEND(tmp, exts, num_exts, vk->spirv->required_ext);
 
+    // Optional extensions for importing dma-bufs (used by hwdec interop)
+    static const char *const dmabuf_exts[] = {
+        VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME,
+        VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME,
+        VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME,
+        NULL
+    };
+
+#ifdef VK_EXT_image_drm_format_modifier
+    // Needed for importing tiled dma-bufs
+    static const char *const modifier_exts[] = {
+        VK_KHR_BIND_MEMORY_2_EXTENSION_NAME,
+        VK_KHR_IMAGE_FORMAT_LIST_EXTENSION_NAME,
+        VK_KHR_MAINTENANCE1_EXTENSION_NAME,
+        VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME,
+        VK_KHR_SAMPLER_YCBCR_CONVERSION_EXTENSION_NAME,
+        VK_EXT_IMAGE_DRM_FORMAT_MODIFIER_EXTENSION_NAME,
+        NULL
+    };
+#endif
+
+#ifdef VK_KHR_external_memory_win32
+    // Needed for importing D3D11 textures (used by hwdec interop)
+    static const char *const d3d11_exts[] = {
+        VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME,
+        VK_KHR_EXTERNAL_MEMORY_WIN32_EXTENSION_NAME,
+        VK_KHR_WIN32_KEYED_MUTEX_EXTENSION_NAME,
+        VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME,
+        VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME,
+        VK_KHR_BIND_MEMORY_2_EXTENSION_NAME,
+        VK_KHR_MAINTENANCE1_EXTENSION_NAME,
+        VK_KHR_SAMPLER_YCBCR_CONVERSION_EXTENSION_NAME,
+        NULL
+    };
+#endif
+
+    // Needed for sharing images and semaphores with CUDA (hwdec interop)
+    static const char *const export_exts[] = {
+        VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME,
+        VK_KHR_EXTERNAL_SEMAPHORE_EXTENSION_NAME,
+#ifdef VK_KHR_external_memory_win32
+        VK_KHR_EXTERNAL_MEMORY_WIN32_EXTENSION_NAME,
+        VK_KHR_EXTERNAL_SEMAPHORE_WIN32_EXTENSION_NAME,
+#else
+        VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME,
+        VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME,
+#endif
+        VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME,
+        VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME,
+        NULL
+    };
+
+#ifdef VK_EXT_memory_budget
+    // Used for respecting the VRAM budget in vk_malloc
+    static const char *const budget_exts[] = {
+        VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+        NULL
+    };
+#endif
+
+#ifdef VK_GOOGLE_display_timing
+    // Used for presentation feedback (vsync timing)
+    static const char *const timing_exts[] = {
+        VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME,
+        NULL
+    };
+#endif
+
+    uint32_t num_avail = 0;
+    vkEnumerateDeviceExtensionProperties(vk->physd, NULL, &num_avail, NULL);
+    VkExtensionProperties *avail =
+        talloc_array(tmp, VkExtensionProperties, num_avail);
+    vkEnumerateDeviceExtensionProperties(vk->physd, NULL, &num_avail, avail);
+
+    if (vk->has_ext_mem_caps) {
+        vk->has_dmabuf_import = mpvk_add_exts(tmp, &exts, &num_exts, avail,
+                                              num_avail, dmabuf_exts);
+#ifdef VK_EXT_image_drm_format_modifier
+        if (vk->has_dmabuf_import) {
+            vk->has_drm_modifiers = mpvk_add_exts(tmp, &exts, &num_exts, avail,
+                                                  num_avail, modifier_exts);
+        }
+#endif
+#ifdef VK_KHR_external_memory_win32
+        vk->has_d3d11_import = mpvk_add_exts(tmp, &exts, &num_exts, avail,
+                                             num_avail, d3d11_exts);
+#endif
+        if (vk->has_ext_sem_caps) {
+            vk->has_export = mpvk_add_exts(tmp, &exts, &num_exts, avail,
+                                           num_avail, export_exts);
+        }
+    }
+
+#ifdef VK_EXT_memory_budget
+    // Requires VK_KHR_get_physical_device_properties2, which is enabled
+    // together with the external memory capabilities
+    if (vk->has_ext_mem_caps) {
+        vk->has_memory_budget = mpvk_add_exts(tmp, &exts, &num_exts, avail,
+                                              num_avail, budget_exts);
+    }
+#endif
+
+#ifdef VK_GOOGLE_display_timing
+    vk->has_display_timing = mpvk_add_exts(tmp, &exts, &num_exts, avail,
+                                           num_avail, timing_exts);
+#endif
+
     VkDeviceCreateInfo dinfo = {
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-        .queueCreateInfoCount = 1,
-        .pQueueCreateInfos = &qinfo,
+        .queueCreateInfoCount = tidx >= 0 ? 2 : 1,
+        .pQueueCreateInfos = qinfos,
         .ppEnabledExtensionNames = exts,
         .enabledExtensionCount = num_exts,
     };
@@ -525,8 +702,16 @@ bool mpvk_device_init(struct mpvk_ctx *vk, struct mpvk_device_opts opts)
     vk_malloc_init(vk);
 
     // Create the vk_cmdpools and all required queues / synchronization objects
-    if (!vk_cmdpool_init(vk, qinfo, qfs[idx], &vk->pool))
+    if (!vk_cmdpool_init(vk, qinfos[0], qfs[idx], &vk->pool))
         goto error;
+    vk->qfs[vk->num_qfs++] = idx;
+
+    if (tidx >= 0) {
+        MP_VERBOSE(vk, "Using QF %d for texture uploads.\n", tidx);
+        if (!vk_cmdpool_init(vk, qinfos[1], qfs[tidx], &vk->pool_transfer))
+            goto error;
+        vk->qfs[vk->num_qfs++] = tidx;
+    }
 
     talloc_free(tmp);
     return true;
@@ -584,6 +769,7 @@ void mpvk_pool_wait_idle(struct mpvk_ctx *vk, struct vk_cmdpool *pool)
 
 void mpvk_dev_wait_idle(struct mpvk_ctx *vk)
 {
+    mpvk_pool_wait_idle(vk, vk->pool_transfer);
     mpvk_pool_wait_idle(vk, vk->pool);
 }
 
@@ -611,8 +797,9 @@ void mpvk_pool_poll_cmds(struct mpvk_ctx *vk, struct vk_cmdpool *pool,
     }
 }
 
-void mpvk_dev_poll_cmds(struct mpvk_ctx *vk, uint32_t timeout)
+void mpvk_dev_poll_cmds(struct mpvk_ctx *vk, uint64_t timeout)
 {
+    mpvk_pool_poll_cmds(vk, vk->pool_transfer, 0);
     mpvk_pool_poll_cmds(vk, vk->pool, timeout);
 }
 
@@ -644,6 +831,25 @@ void vk_cmd_dep(struct vk_cmd *cmd, VkSemaphore dep,
     cmd->depstages[cmd->num_deps++] = depstage;
 }
 
+void vk_cmd_sig(struct vk_cmd *cmd, VkSemaphore sig)
+{
+    assert(cmd->num_sigs < MPVK_MAX_CMD_DEPS);
+    cmd->sigs[cmd->num_sigs++] = sig;
+}
+
+#ifdef VK_KHR_win32_keyed_mutex
+void vk_cmd_keyed_mutex(struct vk_cmd *cmd, VkDeviceMemory mem, uint64_t key)
+{
+    for (int i = 0; i < cmd->num_mutexes; i++) {
+        if (cmd->mutexes[i] == mem)
+            return;
+    }
+    assert(cmd->num_mutexes < MPVK_MAX_CMD_DEPS);
+    cmd->mutexes[cmd->num_mutexes] = mem;
+    cmd->mutex_keys[cmd->num_mutexes++] = key;
+}
+#endif
+
 struct vk_cmd *vk_cmd_begin(struct mpvk_ctx *vk, struct vk_cmdpool *pool)
 {
     // Garbage collect the cmdpool first
@@ -689,11 +895,34 @@ bool vk_cmd_submit(struct mpvk_ctx *vk, struct vk_cmd *cmd, VkSemaphore *done)
         .pWaitDstStageMask = cmd->depstages,
     };
 
+    VkSemaphore sigs[MPVK_MAX_CMD_DEPS + 1];
+    int num_sigs = 0;
+    for (int i = 0; i < cmd->num_sigs; i++)
+        sigs[num_sigs++] = cmd->sigs[i];
     if (done) {
-        sinfo.signalSemaphoreCount = 1;
-        sinfo.pSignalSemaphores = &cmd->done;
+        sigs[num_sigs++] = cmd->done;
         *done = cmd->done;
     }
+    sinfo.signalSemaphoreCount = num_sigs;
+    sinfo.pSignalSemaphores = sigs;
+
+#ifdef VK_KHR_win32_keyed_mutex
+    uint32_t timeouts[MPVK_MAX_CMD_DEPS];
+    for (int i = 0; i < cmd->num_mutexes; i++)
+        timeouts[i] = INFINITE;
+    VkWin32KeyedMutexAcquireReleaseInfoKHR mutex_info = {
+        .sType = VK_STRUCTURE_TYPE_WIN32_KEYED_MUTEX_ACQUIRE_RELEASE_INFO_KHR,
+        .acquireCount = cmd->num_mutexes,
+        .pAcquireSyncs = cmd->mutexes,
+        .pAcquireKeys = cmd->mutex_keys,
+        .pAcquireTimeouts = timeouts,
+        .releaseCount = cmd->num_mutexes,
+        .pReleaseSyncs = cmd->mutexes,
+        .pReleaseKeys = cmd->mutex_keys,
+    };
+    if (cmd->num_mutexes)
+        sinfo.pNext = &mutex_info;
+#endif
 
     VK(vkResetFences(vk->dev, 1, &cmd->fence));
     VK(vkQueueSubmit(queue, 1, &sinfo, cmd->fence));
@@ -703,8 +932,15 @@ bool vk_cmd_submit(struct mpvk_ctx *vk, struct vk_cmd *cmd, VkSemaphore *done)
     for (int i = 0; i < cmd->num_deps; i++)
         cmd->deps[i] = NULL;
     cmd->num_deps = 0;
-
-    vk->last_cmd = cmd;
+    cmd->num_sigs = 0;
+#ifdef VK_KHR_win32_keyed_mutex
+    cmd->num_mutexes = 0;
+#endif
+
+    // Commands on the transfer queue are always waited on by a later command
+    // on the primary queue, so they don't count for vk_dev_callback().
+    if (pool == vk->pool)
+        vk->last_cmd = cmd;
     return true;
 
 error:
@@ -55,6 +55,7 @@ bool mpvk_pick_surface_format(struct mpvk_ctx *vk);
 
 struct mpvk_device_opts {
     int queue_count;    // number of queues to use
+    int transfer_queue; // use a dedicated transfer queue if available
 };
 
 // Create a logical device and initialize the vk_cmdpools
@@ -70,7 +71,7 @@ void mpvk_dev_wait_idle(struct mpvk_ctx *vk);
 // 0, it only garbage collects completed commands without blocking.
 void mpvk_pool_poll_cmds(struct mpvk_ctx *vk, struct vk_cmdpool *pool,
                          uint64_t timeout);
-void mpvk_dev_poll_cmds(struct mpvk_ctx *vk, uint32_t timeout);
+void mpvk_dev_poll_cmds(struct mpvk_ctx *vk, uint64_t timeout);
 
 // Since lots of vulkan operations need to be done lazily once the affected
 // resources are no longer in use, provide an abstraction for tracking these.
@@ -102,11 +103,22 @@ struct vk_cmd {
     VkSemaphore deps[MPVK_MAX_CMD_DEPS];
     VkPipelineStageFlags depstages[MPVK_MAX_CMD_DEPS];
     int num_deps;
+    // Additional semaphores to signal once the command completes. These are
+    // *not* owned by the vk_cmd either
+    VkSemaphore sigs[MPVK_MAX_CMD_DEPS];
+    int num_sigs;
     // Since VkFences are useless, we have to manually track "callbacks"
     // to fire once the VkFence completes. These are used for multiple purposes,
     // ranging from garbage collection (resource deallocation) to fencing.
     struct vk_callback *callbacks;
     int num_callbacks;
+#ifdef VK_KHR_win32_keyed_mutex
+    // Keyed mutexes (of imported D3D11 textures) that are acquired while the
+    // command executes.
+    VkDeviceMemory mutexes[MPVK_MAX_CMD_DEPS];
+    uint64_t mutex_keys[MPVK_MAX_CMD_DEPS];
+    int num_mutexes;
+#endif
 };
 
 // Associate a callback with the completion of the current command. This
@@ -118,6 +130,17 @@ void vk_cmd_callback(struct vk_cmd *cmd, vk_cb callback, void *p, void *arg);
 void vk_cmd_dep(struct vk_cmd *cmd, VkSemaphore dep,
                 VkPipelineStageFlags depstage);
 
+// Signal this semaphore once the current command completes (in addition to
+// the `done` semaphore returned by vk_cmd_submit()).
+void vk_cmd_sig(struct vk_cmd *cmd, VkSemaphore sig);
+
+#ifdef VK_KHR_win32_keyed_mutex
+// Acquire the keyed mutex of the imported memory with the given key before the
+// command executes, and release it with the same key afterwards. Adding the
+// same memory multiple times is allowed.
+void vk_cmd_keyed_mutex(struct vk_cmd *cmd, VkDeviceMemory mem, uint64_t key);
+#endif
+
 #define MPVK_MAX_QUEUES 8
 #define MPVK_MAX_CMDS 64
 
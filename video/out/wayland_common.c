@@ -16,6 +16,7 @@
  */
 
 #include <poll.h>
+#include <time.h>
 #include <unistd.h>
 #include <linux/input.h>
 #include "common/msg.h"
@@ -35,6 +36,13 @@
 // Generated from server-decoration.xml
 #include "video/out/wayland/srv-decor.h"
 
+// Generated from presentation-time.xml
+#include "video/out/wayland/presentation-time.h"
+
+// Frames not acknowledged by the compositor for this long are assumed to
+// belong to a hidden surface.
+#define HIDDEN_TIMEOUT_US 250000
+
 static void xdg_shell_ping(void *data, struct zxdg_shell_v6 *shell, uint32_t serial)
 {
     zxdg_shell_v6_pong(shell, serial);
@@ -756,14 +764,27 @@ static const struct wl_surface_listener surface_listener = {
     surface_handle_leave,
 };
 
+// The compositor acknowledged our last frame, so the surface is visible.
+static void frame_done(struct vo_wayland_state *wl)
+{
+    wl->frame_wait = false;
+    if (wl->hidden) {
+        MP_VERBOSE(wl, "Surface visible again, resuming rendering.\n");
+        wl->hidden = false;
+        wl->pending_vo_events |= VO_EVENT_EXPOSE;
+    }
+}
+
 static const struct wl_callback_listener frame_listener;
 
 static void frame_callback(void *data, struct wl_callback *callback, uint32_t time)
 {
     struct vo_wayland_state *wl = data;
 
-    if (callback)
+    if (callback) {
         wl_callback_destroy(callback);
+        frame_done(wl);
+    }
 
     wl->frame_callback = wl_surface_frame(wl->surface);
     wl_callback_add_listener(wl->frame_callback, &frame_listener, wl);
@@ -776,6 +797,88 @@ static const struct wl_callback_listener frame_listener = {
     frame_callback,
 };
 
+static void visible_callback(void *data, struct wl_callback *callback,
+                             uint32_t time)
+{
+    struct vo_wayland_state *wl = data;
+    wl_callback_destroy(callback);
+    wl->visible_callback = NULL;
+    frame_done(wl);
+}
+
+static const struct wl_callback_listener visible_listener = {
+    visible_callback,
+};
+
+static void presentation_clock_id(void *data, struct wp_presentation *pres,
+                                  uint32_t clk_id)
+{
+    struct vo_wayland_state *wl = data;
+    wl->presentation_clock_id = clk_id;
+}
+
+static const struct wp_presentation_listener presentation_listener = {
+    presentation_clock_id,
+};
+
+struct feedback_ctx {
+    struct vo_wayland_state *wl;
+    int64_t frame;
+};
+
+static void feedback_sync_output(void *data, struct wp_presentation_feedback *fb,
+                                 struct wl_output *output)
+{
+}
+
+static void feedback_presented(void *data, struct wp_presentation_feedback *fb,
+                               uint32_t tv_sec_hi, uint32_t tv_sec_lo,
+                               uint32_t tv_nsec, uint32_t refresh,
+                               uint32_t seq_hi, uint32_t seq_lo, uint32_t flags)
+{
+    struct feedback_ctx *ctx = data;
+    struct vo_wayland_state *wl = ctx->wl;
+    wp_presentation_feedback_destroy(fb);
+
+    // Only the monotonic clock can be compared to mp_time_us()
+    if (wl->presentation_clock_id != CLOCK_MONOTONIC ||
+        ctx->frame <= wl->feedback_frame)
+        goto done;
+
+    uint64_t sec = ((uint64_t)tv_sec_hi << 32) | tv_sec_lo;
+    uint64_t msc = ((uint64_t)seq_hi << 32) | seq_lo;
+    bool vsync = flags & WP_PRESENTATION_FEEDBACK_KIND_VSYNC;
+
+    // The vsync counter is only meaningful for vsync'ed presents. Every vsync
+    // between two successive frames that didn't show a new frame was skipped.
+    if (vsync && wl->feedback_msc && ctx->frame == wl->feedback_frame + 1 &&
+        msc > wl->feedback_msc)
+    {
+        wl->skipped_vsyncs = MPMAX(wl->skipped_vsyncs, 0) +
+                             (int64_t)(msc - wl->feedback_msc - 1);
+    }
+
+    wl->feedback_frame = ctx->frame;
+    wl->feedback_time = sec * 1000000 + tv_nsec / 1000;
+    wl->feedback_msc = vsync ? msc : 0;
+    wl->feedback_refresh = refresh;
+
+done:
+    talloc_free(ctx);
+}
+
+static void feedback_discarded(void *data, struct wp_presentation_feedback *fb)
+{
+    wp_presentation_feedback_destroy(fb);
+    talloc_free(data);
+}
+
+static const struct wp_presentation_feedback_listener feedback_listener = {
+    feedback_sync_output,
+    feedback_presented,
+    feedback_discarded,
+};
+
 static void registry_handle_add(void *data, struct wl_registry *reg, uint32_t id,
                                 const char *interface, uint32_t ver)
 {
@@ -831,6 +934,11 @@ static void registry_handle_add(void *data, struct wl_registry *reg, uint32_t id
         wl->idle_inhibit_manager = wl_registry_bind(reg, id, &zwp_idle_inhibit_manager_v1_interface, 1);
     }
 
+    if (!strcmp(interface, wp_presentation_interface.name) && found++) {
+        wl->presentation = wl_registry_bind(reg, id, &wp_presentation_interface, 1);
+        wp_presentation_add_listener(wl->presentation, &presentation_listener, wl);
+    }
+
     if (found > 1)
         MP_VERBOSE(wl, "Registered for protocol %s\n", interface);
 }
@@ -1044,6 +1152,11 @@ int vo_wayland_init(struct vo *vo)
         MP_VERBOSE(wl, "Compositor doesn't support the %s protocol!\n",
                    zwp_idle_inhibit_manager_v1_interface.name);
 
+    if (!wl->presentation)
+        MP_VERBOSE(wl, "Compositor doesn't support the %s protocol!\n",
+                   wp_presentation_interface.name);
+    wl->skipped_vsyncs = -1;
+
     wl->display_fd = wl_display_get_fd(wl->display);
     mp_make_wakeup_pipe(wl->wakeup_pipe);
 
@@ -1073,6 +1186,9 @@ void vo_wayland_uninit(struct vo *vo)
     if (wl->idle_inhibit_manager)
         zwp_idle_inhibit_manager_v1_destroy(wl->idle_inhibit_manager);
 
+    if (wl->presentation)
+        wp_presentation_destroy(wl->presentation);
+
     if (wl->shell)
         zxdg_shell_v6_destroy(wl->shell);
 
@@ -1094,6 +1210,9 @@ void vo_wayland_uninit(struct vo *vo)
     if (wl->frame_callback)
         wl_callback_destroy(wl->frame_callback);
 
+    if (wl->visible_callback)
+        wl_callback_destroy(wl->visible_callback);
+
     if (wl->display) {
         close(wl_display_get_fd(wl->display));
         wl_display_disconnect(wl->display);
@@ -1302,6 +1421,7 @@ int vo_wayland_control(struct vo *vo, int *events, int request, void *arg)
     case VOCTRL_PAUSE: {
         wl_callback_destroy(wl->frame_callback);
         wl->frame_callback = NULL;
+        wl->frame_wait = false; // no longer tracked by the callback
         vo_disable_external_renderloop(wl->vo);
         return VO_TRUE;
     }
@@ -1390,3 +1510,71 @@ void vo_wayland_wait_events(struct vo *vo, int64_t until_time_us)
     if (fds[1].revents & POLLIN)
         mp_flush_wakeup_pipe(wl->wakeup_pipe[0]);
 }
+
+// Request presentation feedback for the next surface commit. Call this right
+// before the frame is committed (e.g. before eglSwapBuffers()).
+bool vo_wayland_start_frame(struct vo_wayland_state *wl)
+{
+    // Compositors stop sending frame callbacks for surfaces that are not
+    // visible (minimized, occluded, on another workspace). Skip rendering
+    // until the next callback arrives in that case.
+    if (wl->frame_wait && !wl->hidden &&
+        mp_time_us() - wl->frame_wait_start > HIDDEN_TIMEOUT_US)
+    {
+        MP_VERBOSE(wl, "Surface hidden, not rendering.\n");
+        wl->hidden = true;
+    }
+    return !wl->hidden;
+}
+
+static void request_feedback(struct vo_wayland_state *wl)
+{
+    if (!wl->presentation)
+        return;
+
+    struct feedback_ctx *ctx = talloc_ptrtype(wl, ctx);
+    *ctx = (struct feedback_ctx){
+        .wl = wl,
+        .frame = ++wl->frames_submitted,
+    };
+    struct wp_presentation_feedback *fb =
+        wp_presentation_feedback(wl->presentation, wl->surface);
+    wp_presentation_feedback_add_listener(fb, &feedback_listener, ctx);
+}
+
+void vo_wayland_submit_frame(struct vo_wayland_state *wl)
+{
+    // The render loop's frame callback already covers this commit. Outside of
+    // it (e.g. while paused), request one only to detect occlusion.
+    if (!wl->frame_callback && !wl->visible_callback) {
+        wl->visible_callback = wl_surface_frame(wl->surface);
+        wl_callback_add_listener(wl->visible_callback, &visible_listener, wl);
+    }
+
+    if (!wl->frame_wait) {
+        wl->frame_wait = true;
+        wl->frame_wait_start = mp_time_us();
+    }
+
+    request_feedback(wl);
+}
+
+void vo_wayland_get_vsync(struct vo_wayland_state *wl,
+                          struct vo_vsync_info *info)
+{
+    if (!wl->feedback_frame)
+        return;
+
+    info->skipped_vsyncs = wl->skipped_vsyncs;
+    if (wl->skipped_vsyncs > 0)
+        wl->skipped_vsyncs = 0;
+
+    // A refresh of 0 means the output has no constant refresh rate
+    if (!wl->feedback_refresh)
+        return;
+    info->vsync_duration = wl->feedback_refresh / 1000;
+
+    // Extrapolate from the last presented frame to the frame just committed
+    info->last_queue_display_time = mp_time_from_raw_us(wl->feedback_time) +
+        (wl->frames_submitted - wl->feedback_frame) * info->vsync_duration;
+}
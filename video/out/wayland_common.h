@@ -64,6 +64,10 @@ struct vo_wayland_state {
     uint32_t pointer_id;
     int display_fd;
     struct wl_callback       *frame_callback;
+    struct wl_callback       *visible_callback;
+    bool frame_wait;            // a committed frame wasn't acknowledged yet
+    int64_t frame_wait_start;   // time of the oldest such commit
+    bool hidden;                // surface assumed to be invisible
     struct wl_list            output_list;
     struct vo_wayland_output *current_output;
 
@@ -77,6 +81,16 @@ struct vo_wayland_state {
     struct zwp_idle_inhibit_manager_v1 *idle_inhibit_manager;
     struct zwp_idle_inhibitor_v1 *idle_inhibitor;
 
+    /* Presentation feedback */
+    struct wp_presentation *presentation;
+    uint32_t presentation_clock_id;
+    int64_t  frames_submitted;  // number of frames requesting feedback
+    int64_t  feedback_frame;    // frame (by the above count) last presented
+    int64_t  feedback_time;     // presentation time of that frame (raw us)
+    uint64_t feedback_msc;      // vsync counter at that frame
+    uint32_t feedback_refresh;  // refresh duration (ns), or 0
+    int64_t  skipped_vsyncs;    // since the last vo_wayland_get_vsync(), or -1
+
     /* Input */
     struct wl_seat     *seat;
     struct wl_pointer  *pointer;
@@ -109,5 +123,9 @@ void vo_wayland_check_events(struct vo *vo);
 void vo_wayland_uninit(struct vo *vo);
 void vo_wayland_wakeup(struct vo *vo);
 void vo_wayland_wait_events(struct vo *vo, int64_t until_time_us);
+bool vo_wayland_start_frame(struct vo_wayland_state *wl);
+void vo_wayland_submit_frame(struct vo_wayland_state *wl);
+void vo_wayland_get_vsync(struct vo_wayland_state *wl,
+                          struct vo_vsync_info *info);
 
 #endif /* MPLAYER_WAYLAND_COMMON_H */
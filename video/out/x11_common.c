@@ -1902,6 +1902,36 @@ void vo_x11_wait_events(struct vo *vo, int64_t until_time_us)
         mp_flush_wakeup_pipe(x11->wakeup_pipe[0]);
 }
 
+// Wait until at most max_outstanding XShmPutImage requests are still being
+// processed by the server. This blocks on the X connection, so it returns as
+// soon as the ShmCompletion event arrives. Returns false on timeout, in which
+// case the outstanding requests are forgotten.
+bool vo_x11_wait_shm_completion(struct vo *vo, int max_outstanding)
+{
+    struct vo_x11_state *x11 = vo->x11;
+    int64_t deadline = mp_time_us() + 1000000;
+
+    XFlush(x11->display);
+    while (1) {
+        vo_x11_check_events(vo);
+        if (x11->ShmCompletionWaitCount <= max_outstanding)
+            return true;
+
+        int64_t wait_us = deadline - mp_time_us();
+        if (wait_us <= 0)
+            break;
+
+        // Don't poll the wakeup pipe; that would eat wakeups meant for the
+        // VO loop.
+        struct pollfd fd = { .fd = x11->event_fd, .events = POLLIN };
+        poll(&fd, 1, (wait_us + 999) / 1000);
+    }
+
+    MP_WARN(x11, "Timeout waiting for XShm completion events.\n");
+    x11->ShmCompletionWaitCount = 0;
+    return false;
+}
+
 static void xscreensaver_heartbeat(struct vo_x11_state *x11)
 {
     double time = mp_time_sec();
@@ -142,6 +142,7 @@ void vo_x11_config_vo_window(struct vo *vo);
 int vo_x11_control(struct vo *vo, int *events, int request, void *arg);
 void vo_x11_wakeup(struct vo *vo);
 void vo_x11_wait_events(struct vo *vo, int64_t until_time_us);
+bool vo_x11_wait_shm_completion(struct vo *vo, int max_outstanding);
 
 void vo_x11_silence_xlib(int dir);
 
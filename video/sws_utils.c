@@ -16,6 +16,7 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
 
 #include <libswscale/swscale.h>
 #include <libavcodec/avcodec.h>
@@ -34,6 +35,7 @@
 #include "csputils.h"
 #include "common/msg.h"
 #include "video/filter/vf.h"
+#include "misc/thread_pool.h"
 #include "osdep/endian.h"
 
 //global sws_flags from the command line
@@ -45,6 +47,7 @@ struct sws_opts {
     int chr_hshift;
     float chr_sharpen;
     float lum_sharpen;
+    int threads;
 };
 
 #define OPT_BASE_STRUCT struct sws_opts
@@ -68,11 +71,13 @@ const struct m_sub_options sws_conf = {
         OPT_INT("chs", chr_hshift, 0),
         OPT_FLOATRANGE("ls", lum_sharpen, 0, -100.0, 100.0),
         OPT_FLOATRANGE("cs", chr_sharpen, 0, -100.0, 100.0),
+        OPT_INTRANGE("threads", threads, 0, 1, 64),
         {0}
     },
     .size = sizeof(struct sws_opts),
     .defaults = &(const struct sws_opts){
         .scaler = SWS_BICUBIC,
+        .threads = 1,
     },
 };
 
@@ -95,6 +100,8 @@ void mp_sws_set_from_cmdline(struct mp_sws_context *ctx, struct sws_opts *opts)
 
     ctx->flags = SWS_PRINT_INFO;
     ctx->flags |= opts->scaler;
+
+    ctx->threads = opts->threads;
 }
 
 bool mp_sws_supported_format(int imgfmt)
@@ -245,6 +252,113 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
     return 1;
 }
 
+struct slice_job {
+    struct mp_sws_context *ctx;
+    struct mp_image src, dst;
+    int res;
+
+    pthread_mutex_t *lock;
+    pthread_cond_t *wakeup;
+    int *pending;
+};
+
+static void scale_slice(void *p)
+{
+    struct slice_job *job = p;
+
+    job->res = mp_sws_scale(job->ctx, &job->dst, &job->src);
+
+    pthread_mutex_lock(job->lock);
+    *job->pending -= 1;
+    pthread_cond_broadcast(job->wakeup);
+    pthread_mutex_unlock(job->lock);
+}
+
+// Convert the image as horizontal bands with one libswscale context each.
+// Only possible if there's no vertical scaling, because the bands need to be
+// independent. Returns false if the image can't be sliced.
+static bool scale_sliced(struct mp_sws_context *ctx, struct mp_image *dst,
+                         struct mp_image *src, bool reinit)
+{
+    // Band height; keeps planes aligned for any chroma subsampling.
+    const int align = 16;
+
+    int h = src->h;
+    int num = MPMIN(ctx->threads, h / (align * 4));
+    if (num < 2 || dst->h != h ||
+        ((src->fmt.flags | dst->fmt.flags) & MP_IMGFLAG_PAL))
+        return false;
+
+    if (!ctx->pool || ctx->pool_threads != ctx->threads - 1) {
+        talloc_free(ctx->pool);
+        ctx->pool_threads = ctx->threads - 1;
+        ctx->pool = mp_thread_pool_create(ctx, ctx->pool_threads);
+        if (!ctx->pool)
+            return false;
+    }
+
+    while (ctx->num_slices < num) {
+        struct mp_sws_context *s = mp_sws_alloc(ctx);
+        MP_TARRAY_APPEND(ctx, ctx->slices, ctx->num_slices, s);
+    }
+
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t wakeup = PTHREAD_COND_INITIALIZER;
+    int pending = num;
+    struct slice_job jobs[64];
+    assert(num <= MP_ARRAY_SIZE(jobs));
+
+    for (int n = 0; n < num; n++) {
+        struct mp_sws_context *s = ctx->slices[n];
+        s->log = ctx->log;
+        s->flags = ctx->flags;
+        s->brightness = ctx->brightness;
+        s->contrast = ctx->contrast;
+        s->saturation = ctx->saturation;
+        s->params[0] = ctx->params[0];
+        s->params[1] = ctx->params[1];
+        // Borrowed; reset before the slice context could free them.
+        s->src_filter = ctx->src_filter;
+        s->dst_filter = ctx->dst_filter;
+        s->force_reload |= reinit;
+
+        int y0 = n == 0 ? 0 : (h * n / num) & ~(align - 1);
+        int y1 = n == num - 1 ? h : (h * (n + 1) / num) & ~(align - 1);
+
+        jobs[n] = (struct slice_job){
+            .ctx = s,
+            .src = *src,
+            .dst = *dst,
+            .lock = &lock,
+            .wakeup = &wakeup,
+            .pending = &pending,
+        };
+        mp_image_crop(&jobs[n].src, 0, y0, src->w, y1);
+        mp_image_crop(&jobs[n].dst, 0, y0, dst->w, y1);
+    }
+
+    // The last slice runs on the calling thread.
+    for (int n = 0; n < num - 1; n++)
+        mp_thread_pool_queue(ctx->pool, scale_slice, &jobs[n]);
+    scale_slice(&jobs[num - 1]);
+
+    pthread_mutex_lock(&lock);
+    while (pending)
+        pthread_cond_wait(&wakeup, &lock);
+    pthread_mutex_unlock(&lock);
+
+    pthread_cond_destroy(&wakeup);
+    pthread_mutex_destroy(&lock);
+
+    for (int n = 0; n < num; n++) {
+        ctx->slices[n]->src_filter = ctx->slices[n]->dst_filter = NULL;
+        if (jobs[n].res < 0)
+            MP_ERR(ctx, "Converting image slice failed.\n");
+    }
+
+    return true;
+}
+
 // Scale from src to dst - if src/dst have different parameters from previous
 // calls, the context is reinitialized. Return error code. (It can fail if
 // reinitialization was necessary, and swscale returned an error.)
@@ -260,6 +374,9 @@ int mp_sws_scale(struct mp_sws_context *ctx, struct mp_image *dst,
         return r;
     }
 
+    if (ctx->threads > 1 && scale_sliced(ctx, dst, src, r > 0))
+        return 0;
+
     sws_scale(ctx->sws, (const uint8_t *const *) src->planes, src->stride,
               0, src->h, dst->planes, dst->stride);
     return 0;
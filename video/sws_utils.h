@@ -32,6 +32,9 @@ struct mp_sws_context {
     int flags;
     int brightness, contrast, saturation;
     bool force_reload;
+    // If >1, split the image into horizontal bands, which are converted in
+    // parallel. Only used if the image is not scaled vertically.
+    int threads;
     // These are also implicitly set by mp_sws_scale(), and thus optional.
     // Setting them before that call makes sense when using mp_sws_reinit().
     struct mp_image_params src, dst;
@@ -48,6 +51,12 @@ struct mp_sws_context {
 
     // Contains parameters for which sws is valid
     struct mp_sws_context *cached;
+
+    // For threads>1
+    struct mp_sws_context **slices;
+    int num_slices;
+    struct mp_thread_pool *pool;
+    int pool_threads;
 };
 
 struct mp_sws_context *mp_sws_alloc(void *talloc_ctx);
@@ -0,0 +1,15 @@
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+void *a_ptr;
+
+int main(void)
+{
+    __m256i* p = (__m256i*)a_ptr;
+    __m256i ymm0 = _mm256_loadu_si256(p);
+    ymm0 = _mm256_permute4x64_epi64(_mm256_mullo_epi16(ymm0, ymm0), 0xD8);
+    _mm256_storeu_si256(p + 1, ymm0);
+
+    return 0;
+}
@@ -0,0 +1,15 @@
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#include <emmintrin.h>
+
+void *a_ptr;
+
+int main(void)
+{
+    __m128i* p = (__m128i*)a_ptr;
+    __m128i xmm0 = _mm_loadu_si128(p);
+    __m128 f = _mm_cvtepi32_ps(xmm0);
+    _mm_storeu_si128(p + 1, _mm_add_epi16(xmm0, _mm_cvttps_epi32(f)));
+
+    return 0;
+}
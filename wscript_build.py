@@ -129,6 +129,12 @@ def build(ctx):
         ctx.wayland_protocol_header(proto_dir = ctx.env.WL_PROTO_DIR,
             protocol  = "unstable/idle-inhibit/idle-inhibit-unstable-v1",
             target    = "video/out/wayland/idle-inhibit-v1.h")
+        ctx.wayland_protocol_code(proto_dir = ctx.env.WL_PROTO_DIR,
+            protocol  = "stable/presentation-time/presentation-time",
+            target    = "video/out/wayland/presentation-time.c")
+        ctx.wayland_protocol_header(proto_dir = ctx.env.WL_PROTO_DIR,
+            protocol  = "stable/presentation-time/presentation-time",
+            target    = "video/out/wayland/presentation-time.h")
         ctx.wayland_protocol_code(proto_dir = "../video/out/wayland",
             protocol = "server-decoration",
             target   = "video/out/wayland/srv-decor.c")
@@ -193,7 +199,12 @@ def build(ctx):
         ( "audio/filter/af_pan.c",               "libaf" ),
         ( "audio/filter/af_rubberband.c",        "rubberband" ),
         ( "audio/filter/af_scaletempo.c",        "libaf" ),
+        ( "audio/filter/af_scaletempo_avx2.c",   "avx2-intrinsics" ),
+        ( "audio/filter/af_scaletempo_sse2.c",   "sse2-intrinsics" ),
         ( "audio/filter/af_volume.c",            "libaf" ),
+        ( "audio/filter/dsp.c",                  "libaf" ),
+        ( "audio/filter/dsp_avx2.c",             "avx2-intrinsics" ),
+        ( "audio/filter/dsp_sse2.c",             "sse2-intrinsics" ),
         ( "audio/filter/tools.c",                "libaf" ),
         ( "audio/out/ao.c" ),
         ( "audio/out/ao_alsa.c",                 "alsa" ),
@@ -229,6 +240,7 @@ def build(ctx):
         ( "common/codecs.c" ),
         ( "common/encode_lavc.c",                "encoding" ),
         ( "common/common.c" ),
+        ( "common/lavfi_threads.c" ),
         ( "common/tags.c" ),
         ( "common/msg.c" ),
         ( "common/playlist.c" ),
@@ -254,7 +266,9 @@ def build(ctx):
         ( "demux/demux_timeline.c" ),
         ( "demux/demux_tv.c",                    "tv" ),
         ( "demux/ebml.c" ),
+        ( "demux/hls_prefetch.c" ),
         ( "demux/packet.c" ),
+        ( "demux/spill.c" ),
         ( "demux/timeline.c" ),
 
         ## Input
@@ -272,10 +286,12 @@ def build(ctx):
         ( "misc/charset_conv.c" ),
         ( "misc/dispatch.c" ),
         ( "misc/json.c" ),
+        ( "misc/msgpack.c" ),
         ( "misc/node.c" ),
         ( "misc/ring.c" ),
         ( "misc/rendezvous.c" ),
         ( "misc/thread_pool.c" ),
+        ( "misc/thread_sched.c" ),
 
         ## Options
         ( "options/m_config.c" ),
@@ -303,6 +319,7 @@ def build(ctx):
         ( "player/screenshot.c" ),
         ( "player/scripting.c" ),
         ( "player/sub.c" ),
+        ( "player/thumbnail.c" ),
         ( "player/video.c" ),
 
         ## Streams
@@ -334,6 +351,7 @@ def build(ctx):
         ( "stream/stream_null.c" ),
         ( "stream/stream_rar.c" ),
         ( "stream/stream_smb.c",                 "libsmbclient" ),
+        ( "stream/stream_subprocess.c" ),
         ( "stream/stream_tv.c",                  "tv" ),
         ( "stream/tv.c",                         "tv" ),
         ( "stream/tvi_dummy.c",                  "tv" ),
@@ -343,6 +361,8 @@ def build(ctx):
         ( "sub/ass_mp.c",                        "libass"),
         ( "sub/dec_sub.c" ),
         ( "sub/draw_bmp.c" ),
+        ( "sub/draw_bmp_avx2.c",                 "avx2-intrinsics" ),
+        ( "sub/draw_bmp_sse2.c",                 "sse2-intrinsics" ),
         ( "sub/img_convert.c" ),
         ( "sub/lavc_conv.c" ),
         ( "sub/osd.c" ),
@@ -359,6 +379,7 @@ def build(ctx):
         ( "video/image_writer.c" ),
         ( "video/img_format.c" ),
         ( "video/hwdec.c" ),
+        ( "video/gpu_memcpy.c",                  "sse4-intrinsics" ),
         ( "video/mp_image.c" ),
         ( "video/mp_image_pool.c" ),
         ( "video/sws_utils.c" ),
@@ -373,6 +394,7 @@ def build(ctx):
         ( "video/decode/vd_lavc.c" ),
         ( "video/filter/refqueue.c" ),
         ( "video/filter/vf.c" ),
+        ( "video/filter/vf_gpu.c" ),
         ( "video/filter/vf_lavfi.c" ),
         ( "video/out/aspect.c" ),
         ( "video/out/bitmap_packer.c" ),
@@ -418,7 +440,7 @@ def build(ctx):
         ( "video/out/opengl/context_x11egl.c",   "egl-x11" ),
         ( "video/out/opengl/cuda_dynamic.c",     "cuda-hwaccel" ),
         ( "video/out/opengl/egl_helpers.c",      "egl-helpers" ),
-        ( "video/out/opengl/hwdec_cuda.c",       "cuda-hwaccel" ),
+        ( "video/out/opengl/hwdec_cuda.c",       "cuda-hwaccel && gl" ),
         ( "video/out/opengl/hwdec_d3d11egl.c",   "d3d-hwaccel" ),
         ( "video/out/opengl/hwdec_d3d11eglrgb.c","d3d-hwaccel" ),
         ( "video/out/opengl/hwdec_dxva2gldx.c",  "gl-dxinterop-d3d9" ),
@@ -458,11 +480,15 @@ def build(ctx):
         ( "video/out/vulkan/context_wayland.c",  "vulkan && wayland" ),
         ( "video/out/vulkan/context_win.c",      "vulkan && win32-desktop" ),
         ( "video/out/vulkan/spirv_nvidia.c",     "vulkan" ),
+        ( "video/out/vulkan/hwdec_vaapi.c",      "vaapi-vulkan" ),
+        ( "video/out/vulkan/hwdec_d3d11va.c",    "d3d11va-vulkan" ),
+        ( "video/out/vulkan/hwdec_cuda.c",       "cuda-vulkan" ),
         ( "video/out/win32/exclusive_hack.c",    "gl-win32" ),
         ( "video/out/wayland_common.c",          "wayland" ),
         ( "video/out/wayland/xdg-shell-v6.c",    "wayland" ),
         ( "video/out/wayland/idle-inhibit-v1.c", "wayland" ),
         ( "video/out/wayland/srv-decor.c",       "wayland" ),
+        ( "video/out/wayland/presentation-time.c", "wayland" ),
         ( "video/out/win_state.c"),
         ( "video/out/x11_common.c",              "x11" ),
         ( "video/out/drm_atomic.c",              "drm" ),